@@ -0,0 +1,380 @@
+//------------------------------------------------------------------------------
+// <copyright file="CaptureProfile.cpp">
+//     Settings of an unattended capture, read from a profile file.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "CaptureProfile.h"
+#include "FrameWriters.h"
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+
+/// <summary>
+/// Constructor. 640x480 color and depth of the first sensor with skeleton tracking, recorded as image files until
+/// interrupted. Depth goes into PNG files, or RVL files in builds which cannot write PNG
+/// </summary>
+CaptureProfile::CaptureProfile()
+    : source(CaptureSourceKinect)
+    , sensorIndex(0)
+    , speed(1.0)
+    , frameLimit(0)
+    , durationSeconds(0.0)
+    , statsSeconds(5.0)
+    , dropPolicy(RecordDropPolicyBlock)
+    , largePages(false)
+    , colorWidth(640)
+    , colorHeight(480)
+    , depthWidth(640)
+    , depthHeight(480)
+    , nearMode(false)
+    , skeleton(true)
+    , seated(false)
+{
+    if (!PngDepthWriter::IsAvailable())
+    {
+        recording.depthFormat = RecordingDepthFormatRvl;
+    }
+}
+
+/// <summary>
+/// Strip white space from both ends of a string
+/// </summary>
+static std::string Trim(const std::string& text)
+{
+    size_t begin = 0;
+    size_t end   = text.size();
+    while (begin < end && isspace((unsigned char)text[begin]))
+    {
+        begin++;
+    }
+    while (end > begin && isspace((unsigned char)text[end - 1]))
+    {
+        end--;
+    }
+
+    return text.substr(begin, end - begin);
+}
+
+/// <summary>
+/// Parse a number which must make up the whole value
+/// </summary>
+static bool ParseNumber(const std::string& value, double minimum, double maximum, double& number)
+{
+    char* pEnd = nullptr;
+    number = strtod(value.c_str(), &pEnd);
+    return !value.empty() && '\0' == *pEnd && number >= minimum && number <= maximum;
+}
+
+/// <summary>
+/// Parse a switch given as on/off, true/false, yes/no or 1/0
+/// </summary>
+static bool ParseSwitch(const std::string& value, bool& on)
+{
+    if ("on" == value || "true" == value || "yes" == value || "1" == value)
+    {
+        on = true;
+        return true;
+    }
+    if ("off" == value || "false" == value || "no" == value || "0" == value)
+    {
+        on = false;
+        return true;
+    }
+
+    return false;
+}
+
+/// <summary>
+/// Parse a resolution given as [width]x[height], which must be one of those listed
+/// </summary>
+static bool ParseResolution(const std::string& value, const char* const* ppAllowed, int& width, int& height)
+{
+    for (; *ppAllowed; ppAllowed++)
+    {
+        if (value == *ppAllowed)
+        {
+            return 2 == sscanf(value.c_str(), "%dx%d", &width, &height);
+        }
+    }
+
+    return false;
+}
+
+/// <summary>
+/// Apply one key = value pair of a profile
+/// </summary>
+/// <returns>Empty if the pair was applied, otherwise why it was not</returns>
+static std::string ApplySetting(const std::string& key, const std::string& value, CaptureProfile& profile)
+{
+    static const char* const colorResolutions[] = { "640x480", "1280x960", nullptr };
+    static const char* const depthResolutions[] = { "80x60", "320x240", "640x480", nullptr };
+
+    double number = 0.0;
+    bool   ok     = false;
+
+    if ("source" == key)
+    {
+        ok = true;
+        if ("kinect" == value)
+        {
+            profile.source = CaptureSourceKinect;
+        }
+        else if ("replay" == value)
+        {
+            profile.source = CaptureSourceReplay;
+        }
+        else if ("synthetic" == value)
+        {
+            profile.source = CaptureSourceSynthetic;
+        }
+        else
+        {
+            ok = false;
+        }
+    }
+    else if ("sensor" == key)
+    {
+        ok = ParseNumber(value, 0, 7, number);
+        profile.sensorIndex = (int)number;
+    }
+    else if ("replay" == key)
+    {
+        ok = !value.empty();
+        profile.replayPath = value;
+    }
+    else if ("speed" == key)
+    {
+        // A multiple of real time, or max to deliver frames as fast as the streams take them
+        if ("realtime" == value)
+        {
+            ok = true;
+            profile.speed = 1.0;
+        }
+        else if ("max" == value)
+        {
+            ok = true;
+            profile.speed = 0.0;
+        }
+        else
+        {
+            ok = ParseNumber(value, 0.01, 1000, profile.speed);
+        }
+    }
+    else if ("frames" == key)
+    {
+        ok = ParseNumber(value, 0, 1e12, number);
+        profile.frameLimit = (uint64_t)number;
+    }
+    else if ("synthetic_players" == key)
+    {
+        ok = ParseNumber(value, 0, SensorSkeletonCount, number);
+        profile.scene.players = (int)number;
+    }
+    else if ("synthetic_noise" == key)
+    {
+        ok = ParseNumber(value, 0, 1000, number);
+        profile.scene.noise = (int)number;
+    }
+    else if ("directory" == key)
+    {
+        ok = true;
+        profile.directory = value;
+    }
+    else if ("duration" == key)
+    {
+        ok = ParseNumber(value, 0, 1e7, profile.durationSeconds);
+    }
+    else if ("stats_interval" == key)
+    {
+        ok = ParseNumber(value, 0, 1e5, profile.statsSeconds);
+    }
+    else if ("output" == key)
+    {
+        ok = true;
+        if ("files" == value)
+        {
+            profile.recording.output = RecordingOutputImageFiles;
+        }
+        else if ("container" == value)
+        {
+            profile.recording.output = RecordingOutputContainer;
+        }
+        else
+        {
+            ok = false;
+        }
+    }
+    else if ("color_format" == key)
+    {
+        ok = true;
+        if ("bmp" == value)
+        {
+            profile.recording.colorFormat = RecordingColorFormatBmp;
+        }
+        else if ("qoi" == value)
+        {
+            profile.recording.colorFormat = RecordingColorFormatQoi;
+        }
+        else if ("jpeg" == value)
+        {
+            profile.recording.colorFormat = RecordingColorFormatJpeg;
+        }
+        else
+        {
+            ok = false;
+        }
+    }
+    else if ("depth_format" == key)
+    {
+        ok = true;
+        if ("png" == value)
+        {
+            profile.recording.depthFormat = RecordingDepthFormatPng;
+        }
+        else if ("rvl" == value)
+        {
+            profile.recording.depthFormat = RecordingDepthFormatRvl;
+        }
+        else if ("tdp" == value)
+        {
+            profile.recording.depthFormat = RecordingDepthFormatTemporal;
+        }
+        else
+        {
+            ok = false;
+        }
+    }
+    else if ("jpeg_quality" == key)
+    {
+        ok = ParseNumber(value, 1, 100, number);
+        profile.recording.jpegQuality = (int)number;
+    }
+    else if ("skip_unpaired" == key)
+    {
+        ok = ParseSwitch(value, profile.recording.skipUnpaired);
+    }
+    else if ("split_seconds" == key)
+    {
+        ok = ParseNumber(value, 0, 1e7, profile.recording.splitSeconds);
+    }
+    else if ("split_mb" == key)
+    {
+        ok = ParseNumber(value, 0, 1e9, number);
+        profile.recording.splitBytes = (uint64_t)(number * (1 << 20));
+    }
+    else if ("drop_policy" == key)
+    {
+        ok = true;
+        if ("block" == value)
+        {
+            profile.dropPolicy = RecordDropPolicyBlock;
+        }
+        else if ("newest" == value)
+        {
+            profile.dropPolicy = RecordDropPolicyNewest;
+        }
+        else if ("oldest" == value)
+        {
+            profile.dropPolicy = RecordDropPolicyOldest;
+        }
+        else if ("color_first" == value)
+        {
+            profile.dropPolicy = RecordDropPolicyColorFirst;
+        }
+        else
+        {
+            ok = false;
+        }
+    }
+    else if ("large_pages" == key)
+    {
+        ok = ParseSwitch(value, profile.largePages);
+    }
+    else if ("color_resolution" == key)
+    {
+        ok = ParseResolution(value, colorResolutions, profile.colorWidth, profile.colorHeight);
+    }
+    else if ("depth_resolution" == key)
+    {
+        ok = ParseResolution(value, depthResolutions, profile.depthWidth, profile.depthHeight);
+    }
+    else if ("near_mode" == key)
+    {
+        ok = ParseSwitch(value, profile.nearMode);
+    }
+    else if ("skeleton" == key)
+    {
+        ok = ParseSwitch(value, profile.skeleton);
+    }
+    else if ("seated" == key)
+    {
+        ok = ParseSwitch(value, profile.seated);
+    }
+    else
+    {
+        return "unknown key '" + key + "'";
+    }
+
+    return ok ? std::string() : "bad value '" + value + "' for " + key;
+}
+
+/// <summary>
+/// Read a capture profile. Each line holds a key = value pair; blank lines and text after '#' are ignored.
+/// Keys not in the file keep the value the profile had
+/// </summary>
+/// <param name="pPath">Path of the profile file</param>
+/// <param name="profile">Profile the settings are read into</param>
+/// <param name="error">Receives the file, line and reason if the file cannot be read, or holds an unknown key or a bad value</param>
+/// <returns>Indicates success or failure</returns>
+bool LoadCaptureProfile(const char* pPath, CaptureProfile& profile, std::string& error)
+{
+    FILE* pFile = fopen(pPath, "r");
+    if (!pFile)
+    {
+        error = std::string(pPath) + ": cannot open";
+        return false;
+    }
+
+    // A profile with a bad line is rejected as a whole, an unattended capture should not run half configured
+    CaptureProfile loaded = profile;
+    char           line[1024];
+    int            lineNumber = 0;
+    error.clear();
+    while (error.empty() && fgets(line, sizeof(line), pFile))
+    {
+        lineNumber++;
+
+        std::string text = line;
+        size_t comment = text.find('#');
+        if (std::string::npos != comment)
+        {
+            text.erase(comment);
+        }
+        text = Trim(text);
+        if (text.empty())
+        {
+            continue;
+        }
+
+        size_t equals = text.find('=');
+        std::string reason = (std::string::npos == equals) ? "expected key = value"
+                                                           : ApplySetting(Trim(text.substr(0, equals)), Trim(text.substr(equals + 1)), loaded);
+        if (!reason.empty())
+        {
+            char location[32];
+            snprintf(location, sizeof(location), ":%d: ", lineNumber);
+            error = pPath + std::string(location) + reason;
+        }
+    }
+    fclose(pFile);
+
+    if (!error.empty())
+    {
+        return false;
+    }
+
+    profile = loaded;
+    return true;
+}
@@ -0,0 +1,62 @@
+//------------------------------------------------------------------------------
+// <copyright file="CaptureProfile.h">
+//     Settings of an unattended capture, read from a profile file.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <string>
+
+#include "FrameRecorder.h"
+#include "RecordingSetup.h"
+#include "SyntheticSensorSource.h"
+
+// What the frames of a capture come from
+enum CaptureSource
+{
+    CaptureSourceKinect,            // The sensor of sensorIndex
+    CaptureSourceReplay,            // A recorded session, replayed as a sensor would deliver it
+    CaptureSourceSynthetic,         // Generated frames, see SyntheticSensorSource
+};
+
+// Settings of a capture running without viewers, e.g. on a production rig
+struct CaptureProfile
+{
+    CaptureSource       source;
+    int                 sensorIndex;        // Sensor to capture from, in the order the runtime lists them
+    std::string         replayPath;         // Container file or session folder a replay reads
+    double              speed;              // Multiple of real time stand-in sources deliver at, 0 for as fast as the streams take it
+    uint64_t            frameLimit;         // Frames per stream a stand-in source delivers before the capture ends, 0 for no limit
+    SyntheticScene      scene;
+    std::string         directory;          // Directory the recording goes into, created if missing. Empty for the current one
+    double              durationSeconds;    // Time after which the capture stops, 0 to run until interrupted
+    double              statsSeconds;       // Interval of the throughput lines, 0 for none
+
+    RecordingOptions    recording;
+    RecordDropPolicy    dropPolicy;
+    bool                largePages;
+
+    int                 colorWidth;         // 640x480 or 1280x960
+    int                 colorHeight;
+    int                 depthWidth;         // 80x60, 320x240 or 640x480
+    int                 depthHeight;
+    bool                nearMode;
+    bool                skeleton;           // Skeleton tracking, the frames are counted but not recorded
+    bool                seated;
+
+    /// <summary>
+    /// Constructor. 640x480 color and depth of the first sensor with skeleton tracking, recorded as image files until interrupted
+    /// </summary>
+    CaptureProfile();
+};
+
+/// <summary>
+/// Read a capture profile. Each line holds a key = value pair; blank lines and text after '#' are ignored.
+/// Keys not in the file keep the value the profile had
+/// </summary>
+/// <param name="pPath">Path of the profile file</param>
+/// <param name="profile">Profile the settings are read into</param>
+/// <param name="error">Receives the file, line and reason if the file cannot be read, or holds an unknown key or a bad value</param>
+/// <returns>Indicates success or failure</returns>
+bool LoadCaptureProfile(const char* pPath, CaptureProfile& profile, std::string& error);
@@ -0,0 +1,219 @@
+//------------------------------------------------------------------------------
+// <copyright file="CaptureSession.cpp">
+//     Recorder, pools and clock of an unattended capture, independent of the sensor.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "CaptureSession.h"
+#include "FramePath.h"
+#include "FrameWriters.h"
+#include "RecordingSetup.h"
+
+#include <algorithm>
+#include <thread>
+
+#ifdef _WIN32
+#include <direct.h>
+#define ChangeDirectory(pName)  _chdir(pName)
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#define ChangeDirectory(pName)  chdir(pName)
+#endif
+
+/// <summary>
+/// Create a directory and those above it, if they do not exist yet
+/// </summary>
+static void MakeDirectoriesIfMissing(const std::string& path)
+{
+    for (size_t i = 1; i <= path.size(); i++)
+    {
+        if (i == path.size() || '/' == path[i] || FRAME_PATH_SEPARATOR == path[i])
+        {
+            std::string parent = path.substr(0, i);
+#ifdef _WIN32
+            _mkdir(parent.c_str());
+#else
+            mkdir(parent.c_str(), 0755);
+#endif
+        }
+    }
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="profile">Settings of the capture</param>
+CaptureSession::CaptureSession(const CaptureProfile& profile)
+    : m_profile(profile)
+    , m_recorder(m_taskPool)
+    , m_stopRequested(false)
+{
+    m_startTime = Clock::now();
+    m_lastSample = Sample();
+    m_lastSample.time = m_startTime;
+}
+
+/// <summary>
+/// Destructor. Stops the recorder and writes out all pending frames
+/// </summary>
+CaptureSession::~CaptureSession()
+{
+    Stop();
+}
+
+/// <summary>
+/// Enter the directory of the profile, creating it if missing, and attach the writers to the recorder
+/// </summary>
+/// <param name="error">Receives why the session could not be opened</param>
+/// <returns>Indicates success or failure</returns>
+bool CaptureSession::Open(std::string& error)
+{
+    // Writers, lists and logs all go into the current directory
+    if (!m_profile.directory.empty())
+    {
+        MakeDirectoriesIfMissing(m_profile.directory);
+        if (0 != ChangeDirectory(m_profile.directory.c_str()))
+        {
+            error = m_profile.directory + ": cannot enter directory";
+            return false;
+        }
+    }
+
+    // Every depth frame would fail, an unattended capture must not run without depth
+    if (RecordingOutputImageFiles == m_profile.recording.output && RecordingDepthFormatPng == m_profile.recording.depthFormat &&
+        !PngDepthWriter::IsAvailable())
+    {
+        error = "depth_format png needs a build with OpenCV, use rvl or tdp";
+        return false;
+    }
+
+    m_framePool.SetLargePages(m_profile.largePages);
+    m_recorder.SetFramePool(&m_framePool);
+    m_recorder.SetDropPolicy(m_profile.dropPolicy);
+    SetUpRecorder(m_recorder, m_profile.recording);
+
+    return true;
+}
+
+/// <summary>
+/// Start recording
+/// </summary>
+/// <returns>Indicates success or failure</returns>
+bool CaptureSession::Start()
+{
+    m_startTime = Clock::now();
+    m_lastSample = Sample();
+    m_lastSample.time = m_startTime;
+
+    return m_recorder.Start();
+}
+
+/// <summary>
+/// Write out all queued frames and stop recording
+/// </summary>
+void CaptureSession::Stop()
+{
+    m_recorder.Stop();
+}
+
+/// <summary>
+/// Wait until the duration of the profile has passed, a stop is requested or the source runs out of frames,
+/// printing a throughput line every stats interval of the profile
+/// </summary>
+/// <param name="countFrames">Reads the frame counts of the streams</param>
+/// <param name="pOut">Stream the lines are printed to</param>
+void CaptureSession::Run(const FrameCounter& countFrames, FILE* pOut)
+{
+    const std::chrono::milliseconds poll(100);
+    const Clock::duration duration = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(m_profile.durationSeconds));
+    const Clock::duration interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(m_profile.statsSeconds));
+
+    Clock::time_point nextStats = m_startTime + interval;
+    while (!m_stopRequested)
+    {
+        Clock::time_point now = Clock::now();
+        if (m_profile.durationSeconds > 0.0 && now - m_startTime >= duration)
+        {
+            break;
+        }
+
+        uint64_t frames[CaptureStreamCount] = {};
+        bool     more = countFrames(frames);
+
+        // The last line of a source which ran out covers the time since the line before
+        if (m_profile.statsSeconds > 0.0 && (now >= nextStats || !more))
+        {
+            fprintf(pOut, "%s\n", SampleStats(frames).c_str());
+            fflush(pOut);
+
+            // Lines stay on the grid of the interval even if one comes late
+            while (nextStats <= now)
+            {
+                nextStats += interval;
+            }
+        }
+
+        if (!more)
+        {
+            break;
+        }
+
+        std::this_thread::sleep_for(poll);
+    }
+}
+
+/// <summary>
+/// Get the number of frames the writers failed to store, over both streams
+/// </summary>
+uint64_t CaptureSession::GetWriteFailures() const
+{
+    uint64_t failures = 0;
+    for (int i = 0; i < RecordStreamCount; i++)
+    {
+        failures += m_recorder.GetStats((RecordStream)i).writeFailures;
+    }
+
+    return failures;
+}
+
+/// <summary>
+/// Describe the throughput since the previous call, or since the session started
+/// </summary>
+/// <param name="frames">Frames each stream has produced so far</param>
+/// <returns>One line of frame rates, recorder rates, drops and queue depths</returns>
+std::string CaptureSession::SampleStats(const uint64_t frames[CaptureStreamCount])
+{
+    Sample sample;
+    sample.time = Clock::now();
+    std::copy(frames, frames + CaptureStreamCount, sample.frames);
+
+    FrameRecorderStats stats[RecordStreamCount];
+    for (int i = 0; i < RecordStreamCount; i++)
+    {
+        stats[i] = m_recorder.GetStats((RecordStream)i);
+        sample.written[i] = stats[i].framesWritten;
+        sample.dropped[i] = stats[i].framesDropped;
+    }
+
+    double seconds = std::chrono::duration<double>(sample.time - m_lastSample.time).count();
+    double scale   = seconds > 0.0 ? 1.0 / seconds : 0.0;
+    double elapsed = std::chrono::duration<double>(sample.time - m_startTime).count();
+
+    char line[256];
+    snprintf(line, sizeof(line),
+             "%8.1f s  color %5.1f  depth %5.1f  skeleton %5.1f fps  |  written %5.1f + %5.1f fps  dropped %llu + %llu  queued %u + %u",
+             elapsed,
+             (sample.frames[CaptureStreamColor]    - m_lastSample.frames[CaptureStreamColor])    * scale,
+             (sample.frames[CaptureStreamDepth]    - m_lastSample.frames[CaptureStreamDepth])    * scale,
+             (sample.frames[CaptureStreamSkeleton] - m_lastSample.frames[CaptureStreamSkeleton]) * scale,
+             (sample.written[RecordStreamColor] - m_lastSample.written[RecordStreamColor]) * scale,
+             (sample.written[RecordStreamDepth] - m_lastSample.written[RecordStreamDepth]) * scale,
+             (unsigned long long)(sample.dropped[RecordStreamColor] - m_lastSample.dropped[RecordStreamColor]),
+             (unsigned long long)(sample.dropped[RecordStreamDepth] - m_lastSample.dropped[RecordStreamDepth]),
+             (unsigned)stats[RecordStreamColor].queueDepth,
+             (unsigned)stats[RecordStreamDepth].queueDepth);
+
+    m_lastSample = sample;
+    return line;
+}
@@ -0,0 +1,126 @@
+//------------------------------------------------------------------------------
+// <copyright file="CaptureSession.h">
+//     Recorder, pools and clock of an unattended capture, independent of the sensor.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+
+#include "CaptureProfile.h"
+#include "FramePool.h"
+#include "FrameRecorder.h"
+#include "SensorClock.h"
+#include "TaskPool.h"
+
+// Streams whose throughput is reported, the recorded ones first
+enum CaptureStream
+{
+    CaptureStreamColor = RecordStreamColor,
+    CaptureStreamDepth = RecordStreamDepth,
+    CaptureStreamSkeleton,
+    CaptureStreamCount,
+};
+
+/// <summary>
+/// The part of an unattended capture which does not depend on the sensor: the task pool, the frame pool,
+/// the recorder set up from a profile and the clock stamping the frames. The sensor side attaches its streams
+/// to them, then Run waits for the end of the capture and prints the throughput of the streams meanwhile.
+/// </summary>
+class CaptureSession
+{
+public:
+    // Reads the number of frames each stream has produced so far. False once the source has no more frames, e.g. at the end of a replay
+    typedef std::function<bool(uint64_t frames[CaptureStreamCount])> FrameCounter;
+
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="profile">Settings of the capture</param>
+    explicit CaptureSession(const CaptureProfile& profile);
+
+    /// <summary>
+    /// Destructor. Stops the recorder and writes out all pending frames
+    /// </summary>
+   ~CaptureSession();
+
+    /// <summary>
+    /// Enter the directory of the profile, creating it if missing, and attach the writers to the recorder
+    /// </summary>
+    /// <param name="error">Receives why the session could not be opened</param>
+    /// <returns>Indicates success or failure</returns>
+    bool Open(std::string& error);
+
+    /// <summary>
+    /// Start recording
+    /// </summary>
+    /// <returns>Indicates success or failure</returns>
+    bool Start();
+
+    /// <summary>
+    /// Write out all queued frames and stop recording
+    /// </summary>
+    void Stop();
+
+    /// <summary>
+    /// Wait until the duration of the profile has passed, a stop is requested or the source runs out of frames,
+    /// printing a throughput line every stats interval of the profile
+    /// </summary>
+    /// <param name="countFrames">Reads the frame counts of the streams</param>
+    /// <param name="pOut">Stream the lines are printed to</param>
+    void Run(const FrameCounter& countFrames, FILE* pOut);
+
+    /// <summary>
+    /// Get the number of frames the writers failed to store, over both streams
+    /// </summary>
+    uint64_t GetWriteFailures() const;
+
+    /// <summary>
+    /// Make Run return. Only sets a flag, so it may be called from a signal or console control handler
+    /// </summary>
+    void RequestStop() { m_stopRequested = true; }
+
+    /// <summary>
+    /// Describe the throughput since the previous call, or since the session started
+    /// </summary>
+    /// <param name="frames">Frames each stream has produced so far</param>
+    /// <returns>One line of frame rates, recorder rates, drops and queue depths</returns>
+    std::string SampleStats(const uint64_t frames[CaptureStreamCount]);
+
+    const CaptureProfile& GetProfile() const { return m_profile; }
+    TaskPool&       GetTaskPool()    { return m_taskPool; }
+    FramePool&      GetFramePool()   { return m_framePool; }
+    FrameRecorder&  GetRecorder()    { return m_recorder; }
+    SensorClock&    GetSensorClock() { return m_sensorClock; }
+
+private:
+    CaptureSession(const CaptureSession&);
+    CaptureSession& operator=(const CaptureSession&);
+
+    typedef std::chrono::steady_clock Clock;
+
+    // Counts at the previous sample
+    struct Sample
+    {
+        Clock::time_point   time;
+        uint64_t            frames[CaptureStreamCount];
+        uint64_t            written[RecordStreamCount];
+        uint64_t            dropped[RecordStreamCount];
+    };
+
+private:
+    CaptureProfile      m_profile;
+    TaskPool            m_taskPool;
+    FramePool           m_framePool;
+    FrameRecorder       m_recorder;     // Declared after the pools, so it writes out its frames before they go
+    SensorClock         m_sensorClock;
+    std::atomic<bool>   m_stopRequested;
+    Clock::time_point   m_startTime;
+    Sample              m_lastSample;
+};
@@ -0,0 +1,263 @@
+//------------------------------------------------------------------------------
+// <copyright file="CaptureStreams.cpp">
+//     Streams of an unattended capture, taking their frames from any sensor source.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "CaptureStreams.h"
+#include "SyntheticSensorSource.h"
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="pSource">The pointer to the source the frames come from</param>
+/// <param name="stream">Color or depth</param>
+CaptureImageStream::CaptureImageStream(SensorSource* pSource, SensorStream stream)
+    : FrameStream(pSource)
+    , m_stream(stream)
+    , m_width(0)
+    , m_height(0)
+{
+}
+
+/// <summary>
+/// Open the stream, BGRA color or depth with player index where the source tracks skeletons
+/// </summary>
+/// <param name="width">Width to open with</param>
+/// <param name="height">Height to open with</param>
+/// <returns>Indicates success or failure</returns>
+bool CaptureImageStream::OpenStream(uint32_t width, uint32_t height)
+{
+    StreamLock lock(this);
+
+    SensorImageType type = SensorImageColor;
+    if (SensorStreamDepth == m_stream)
+    {
+        type = m_pSource->HasSkeletonTracking() ? SensorImageDepthAndPlayerIndex : SensorImageDepth;
+    }
+
+    if (!m_pSource->OpenImageStream(m_stream, type, width, height, m_frameReady))
+    {
+        return false;
+    }
+
+    m_width  = width;
+    m_height = height;
+    m_latestFrame.Reset();
+    ClearPreTrigger();      // Frames of the old size are not recorded with the new ones
+
+    // Lay out frames for the size before the first one arrives. Color and depth pixels take 4 bytes each
+    if (m_pFramePool)
+    {
+        m_pFramePool->SetFrameSize((RecordStream)m_stream, (size_t)m_width * m_height * 4);
+    }
+
+    return true;
+}
+
+/// <summary>
+/// Copy the next frame and hand it over to the recorder
+/// </summary>
+void CaptureImageStream::ProcessStreamFrame()
+{
+    SensorImage image;
+    if (!m_pSource->GetNextImage(m_stream, image))
+    {
+        return;
+    }
+
+    // Taken before any processing, so it is as close to the arrival of the frame as possible
+    double hostTime = SensorClock::GetHostTime();
+
+    FrameHandle frame;
+    if (!m_paused && 0 != image.pitch)
+    {
+        RecordPixelFormat format = SensorStreamColor == m_stream ? RecordPixelFormatBgra32 : RecordPixelFormatDepthPixel32;
+        frame = CopyFrame((RecordStream)m_stream, format, 4, m_width, m_height, image, hostTime);
+    }
+
+    m_pSource->ReleaseImage(m_stream);
+
+    if (frame)
+    {
+        PublishFrame(frame);
+    }
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="pSource">The pointer to the source the skeletons come from</param>
+CaptureSkeletonStream::CaptureSkeletonStream(SensorSource* pSource)
+    : FrameStream(pSource)
+{
+}
+
+/// <summary>
+/// Start tracking skeletons
+/// </summary>
+/// <param name="flags">SensorTrackingFlags</param>
+/// <returns>Indicates success or failure</returns>
+bool CaptureSkeletonStream::StartStream(uint32_t flags)
+{
+    StreamLock lock(this);
+
+    return m_pSource->EnableSkeletonTracking(flags, m_frameReady);
+}
+
+/// <summary>
+/// Take the next skeleton frame
+/// </summary>
+void CaptureSkeletonStream::ProcessStreamFrame()
+{
+    if (m_pSource->GetNextSkeletonFrame(m_skeletonFrame) && !m_paused)
+    {
+        m_frameCount++;
+    }
+}
+
+/// <summary>
+/// Constructor. Creates the streams and attaches them to the pool, recorder and clock of the session
+/// </summary>
+/// <param name="source">Source the frames come from, used until the streams are stopped. It sets their events, so is deleted first</param>
+/// <param name="session">Session the frames are recorded by, must outlive the streams</param>
+CaptureStreams::CaptureStreams(SensorSource& source, CaptureSession& session)
+    : m_source(source)
+    , m_session(session)
+    , m_running(false)
+    , m_pColorStream(new CaptureImageStream(&source, SensorStreamColor))
+    , m_pDepthStream(new CaptureImageStream(&source, SensorStreamDepth))
+    , m_pSkeletonStream(new CaptureSkeletonStream(&source))
+{
+    CaptureImageStream* imageStreams[] = { m_pColorStream.get(), m_pDepthStream.get() };
+    for (CaptureImageStream* pStream : imageStreams)
+    {
+        pStream->SetFramePool(&m_session.GetFramePool());
+        pStream->SetFrameRecorder(&m_session.GetRecorder());
+        pStream->SetSensorClock(&m_session.GetSensorClock());
+    }
+
+    // A stand-in off real time delivers frames at host times which have nothing to do with their sensor time
+    const CaptureProfile& profile = m_session.GetProfile();
+    m_session.GetSensorClock().SetFreeRunning(CaptureSourceKinect != profile.source && 1.0 != profile.speed);
+
+    // Same threads as with windows: color has one of its own, depth and skeleton frames arrive together
+    m_colorDispatcher.Add("color", m_pColorStream->GetFrameReadyEvent(), [this]() { m_pColorStream->DispatchFrame(); });
+    m_depthDispatcher.Add("depth", m_pDepthStream->GetFrameReadyEvent(), [this]() { m_pDepthStream->DispatchFrame(); });
+    if (profile.skeleton && m_source.HasSkeletonTracking())
+    {
+        m_depthDispatcher.Add("skeleton", m_pSkeletonStream->GetFrameReadyEvent(), [this]() { m_pSkeletonStream->DispatchFrame(); });
+    }
+}
+
+/// <summary>
+/// Destructor. Stops the dispatchers
+/// </summary>
+CaptureStreams::~CaptureStreams()
+{
+    Stop();
+}
+
+/// <summary>
+/// Open the streams with the resolutions and modes of the profile of the session and start dispatching
+/// </summary>
+/// <returns>Indicates success or failure</returns>
+bool CaptureStreams::Start()
+{
+    const CaptureProfile& profile = m_session.GetProfile();
+
+    if (!m_pColorStream->OpenStream(profile.colorWidth, profile.colorHeight))
+    {
+        return false;
+    }
+
+    m_source.SetNearMode(profile.nearMode);
+    if (!m_pDepthStream->OpenStream(profile.depthWidth, profile.depthHeight))
+    {
+        return false;
+    }
+
+    // Skeleton frames are only counted. A sensor initialized without the skeletal engine has no tracking
+    if (profile.skeleton && m_source.HasSkeletonTracking())
+    {
+        uint32_t flags = (profile.nearMode ? SensorTrackingNearRange : 0) | (profile.seated ? SensorTrackingSeated : 0);
+        if (!m_pSkeletonStream->StartStream(flags))
+        {
+            return false;
+        }
+    }
+
+    m_running = true;
+    return m_colorDispatcher.Start() && m_depthDispatcher.Start();
+}
+
+/// <summary>
+/// Stop the dispatchers, after the frames they are processing are handed over, and log their counters
+/// </summary>
+void CaptureStreams::Stop()
+{
+    if (!m_running)
+    {
+        return;
+    }
+
+    m_colorDispatcher.Stop();
+    m_depthDispatcher.Stop();
+    m_colorDispatcher.LogSession();
+    m_depthDispatcher.LogSession();
+    m_running = false;
+}
+
+/// <summary>
+/// Read the frame counts of the streams, as CaptureSession::Run takes them
+/// </summary>
+/// <param name="frames">Receives the counts</param>
+/// <returns>False once the source has delivered all its frames</returns>
+bool CaptureStreams::CountFrames(uint64_t frames[CaptureStreamCount]) const
+{
+    // Read without the stream locks, the dispatchers keep running meanwhile
+    frames[CaptureStreamColor]    = m_pColorStream->GetFrameCount();
+    frames[CaptureStreamDepth]    = m_pDepthStream->GetFrameCount();
+    frames[CaptureStreamSkeleton] = m_pSkeletonStream->GetFrameCount();
+
+    return !m_source.IsFinished();
+}
+
+/// <summary>
+/// Create the stand-in source a profile selects, a replay or generated frames, set to its speed and frame limit
+/// </summary>
+/// <param name="profile">Profile with a source other than a sensor</param>
+/// <param name="decodeImage">Decoder of the PNG and JPEG files of a replayed session folder, may be empty</param>
+/// <param name="error">Receives why the source could not be created</param>
+/// <returns>Source owned by the caller, nullptr on failure</returns>
+SensorSource* CreateStandInSource(const CaptureProfile& profile, const ReplaySensorSource::ImageDecoder& decodeImage, std::string& error)
+{
+    std::unique_ptr<StandInSensorSource> pSource;
+    switch (profile.source)
+    {
+    case CaptureSourceReplay:
+        {
+            std::unique_ptr<ReplaySensorSource> pReplay(new ReplaySensorSource());
+            pReplay->SetImageDecoder(decodeImage);
+            if (profile.replayPath.empty() || !pReplay->Open(profile.replayPath))
+            {
+                error = "Recording '" + profile.replayPath + "' cannot be read or holds no frames";
+                return nullptr;
+            }
+            pSource = std::move(pReplay);
+        }
+        break;
+
+    case CaptureSourceSynthetic:
+        pSource.reset(new SyntheticSensorSource(profile.scene));
+        break;
+
+    default:
+        error = "Profile captures from a sensor, not from a stand-in source";
+        return nullptr;
+    }
+
+    pSource->SetSpeed(profile.speed);
+    pSource->SetFrameLimit(profile.frameLimit);
+    return pSource.release();
+}
@@ -0,0 +1,145 @@
+//------------------------------------------------------------------------------
+// <copyright file="CaptureStreams.h">
+//     Streams of an unattended capture, taking their frames from any sensor source.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "CaptureSession.h"
+#include "EventDispatcher.h"
+#include "FrameStream.h"
+#include "ReplaySensorSource.h"
+
+/// <summary>
+/// Color or depth stream without a viewer: each frame is copied once into the pool and handed to the recorder
+/// </summary>
+class CaptureImageStream : public FrameStream
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="pSource">The pointer to the source the frames come from</param>
+    /// <param name="stream">Color or depth</param>
+    CaptureImageStream(SensorSource* pSource, SensorStream stream);
+
+    /// <summary>
+    /// Open the stream, BGRA color or depth with player index where the source tracks skeletons
+    /// </summary>
+    /// <param name="width">Width to open with</param>
+    /// <param name="height">Height to open with</param>
+    /// <returns>Indicates success or failure</returns>
+    bool OpenStream(uint32_t width, uint32_t height);
+
+    /// <summary>
+    /// Copy the next frame and hand it over to the recorder
+    /// </summary>
+    virtual void ProcessStreamFrame();
+
+    uint32_t GetWidth() const  { return m_width; }
+    uint32_t GetHeight() const { return m_height; }
+
+private:
+    SensorStream    m_stream;
+    uint32_t        m_width;        // Size the source delivers, which for a replay is the recorded one
+    uint32_t        m_height;
+};
+
+/// <summary>
+/// Skeleton stream without a viewer. Skeletons are not recorded, the frames are only counted
+/// </summary>
+class CaptureSkeletonStream : public FrameStream
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="pSource">The pointer to the source the skeletons come from</param>
+    explicit CaptureSkeletonStream(SensorSource* pSource);
+
+    /// <summary>
+    /// Start tracking skeletons
+    /// </summary>
+    /// <param name="flags">SensorTrackingFlags</param>
+    /// <returns>Indicates success or failure</returns>
+    bool StartStream(uint32_t flags);
+
+    /// <summary>
+    /// Take the next skeleton frame
+    /// </summary>
+    virtual void ProcessStreamFrame();
+
+private:
+    SensorSkeletonFrame m_skeletonFrame;
+};
+
+/// <summary>
+/// Color, depth and skeleton streams of a capture session, with the dispatchers servicing them. Knows nothing
+/// of the source beyond SensorSource, so the same capture runs from a sensor, a replay or generated frames.
+/// </summary>
+class CaptureStreams
+{
+public:
+    /// <summary>
+    /// Constructor. Creates the streams and attaches them to the pool, recorder and clock of the session
+    /// </summary>
+    /// <param name="source">Source the frames come from, used until the streams are stopped. It sets their events, so is deleted first</param>
+    /// <param name="session">Session the frames are recorded by, must outlive the streams</param>
+    CaptureStreams(SensorSource& source, CaptureSession& session);
+
+    /// <summary>
+    /// Destructor. Stops the dispatchers
+    /// </summary>
+   ~CaptureStreams();
+
+    /// <summary>
+    /// Open the streams with the resolutions and modes of the profile of the session and start dispatching
+    /// </summary>
+    /// <returns>Indicates success or failure</returns>
+    bool Start();
+
+    /// <summary>
+    /// Stop the dispatchers, after the frames they are processing are handed over, and log their counters
+    /// </summary>
+    void Stop();
+
+    /// <summary>
+    /// Read the frame counts of the streams, as CaptureSession::Run takes them
+    /// </summary>
+    /// <param name="frames">Receives the counts</param>
+    /// <returns>False once the source has delivered all its frames</returns>
+    bool CountFrames(uint64_t frames[CaptureStreamCount]) const;
+
+    const CaptureImageStream& GetColorStream() const { return *m_pColorStream; }
+    const CaptureImageStream& GetDepthStream() const { return *m_pDepthStream; }
+
+private:
+    CaptureStreams(const CaptureStreams&);
+    CaptureStreams& operator=(const CaptureStreams&);
+
+private:
+    SensorSource&       m_source;
+    CaptureSession&     m_session;
+    bool                m_running;
+
+    std::unique_ptr<CaptureImageStream>     m_pColorStream;
+    std::unique_ptr<CaptureImageStream>     m_pDepthStream;
+    std::unique_ptr<CaptureSkeletonStream>  m_pSkeletonStream;
+
+    // Declared after the streams, so the threads are gone before the streams they call
+    EventDispatcher     m_colorDispatcher;
+    EventDispatcher     m_depthDispatcher;
+};
+
+/// <summary>
+/// Create the stand-in source a profile selects, a replay or generated frames, set to its speed and frame limit
+/// </summary>
+/// <param name="profile">Profile with a source other than a sensor</param>
+/// <param name="decodeImage">Decoder of the PNG and JPEG files of a replayed session folder, may be empty</param>
+/// <param name="error">Receives why the source could not be created</param>
+/// <returns>Source owned by the caller, nullptr on failure</returns>
+SensorSource* CreateStandInSource(const CaptureProfile& profile, const ReplaySensorSource::ImageDecoder& decodeImage, std::string& error);
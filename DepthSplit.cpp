@@ -0,0 +1,220 @@
+//------------------------------------------------------------------------------
+// <copyright file="DepthSplit.cpp">
+//     Splitting of NUI_DEPTH_IMAGE_PIXEL frames into depth and player index planes.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "DepthSplit.h"
+
+#ifdef DEPTH_SPLIT_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+// MSVC compiles AVX2 intrinsics in any function, the caller checks the processor
+#define DEPTH_SPLIT_AVX2_FUNCTION
+#else
+#define DEPTH_SPLIT_AVX2_FUNCTION __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace
+{
+    /// <summary>
+    /// Reference kernel, also splits the pixels left over by the vector kernels
+    /// </summary>
+    void SplitScalar(const uint16_t* pPixels, size_t count, uint16_t* pDepth, uint8_t* pPlayerIndex)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            pDepth[i] = pPixels[2 * i + 1];
+        }
+
+        if (pPlayerIndex)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                pPlayerIndex[i] = (uint8_t)pPixels[2 * i];
+            }
+        }
+    }
+
+#ifdef DEPTH_SPLIT_X86
+    /// <summary>
+    /// 16 pixels per iteration. The arithmetic shift sign-extends the depth in the high half of each
+    /// pixel, so the signed saturating pack keeps its 16 bits unchanged
+    /// </summary>
+    void SplitSse2(const uint16_t* pPixels, size_t count, uint16_t* pDepth, uint8_t* pPlayerIndex)
+    {
+        const __m128i lowByte = _mm_set1_epi32(0xff);
+        const size_t  blocks  = count / 16;
+
+        for (size_t block = 0; block < blocks; block++)
+        {
+            const __m128i* pIn = reinterpret_cast<const __m128i*>(pPixels + block * 32);
+            __m128i p0 = _mm_loadu_si128(pIn);
+            __m128i p1 = _mm_loadu_si128(pIn + 1);
+            __m128i p2 = _mm_loadu_si128(pIn + 2);
+            __m128i p3 = _mm_loadu_si128(pIn + 3);
+
+            __m128i* pOut = reinterpret_cast<__m128i*>(pDepth + block * 16);
+            _mm_storeu_si128(pOut,     _mm_packs_epi32(_mm_srai_epi32(p0, 16), _mm_srai_epi32(p1, 16)));
+            _mm_storeu_si128(pOut + 1, _mm_packs_epi32(_mm_srai_epi32(p2, 16), _mm_srai_epi32(p3, 16)));
+
+            if (pPlayerIndex)
+            {
+                __m128i i01 = _mm_packs_epi32(_mm_and_si128(p0, lowByte), _mm_and_si128(p1, lowByte));
+                __m128i i23 = _mm_packs_epi32(_mm_and_si128(p2, lowByte), _mm_and_si128(p3, lowByte));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(pPlayerIndex + block * 16), _mm_packus_epi16(i01, i23));
+            }
+        }
+
+        size_t done = blocks * 16;
+        SplitScalar(pPixels + 2 * done, count - done, pDepth + done, pPlayerIndex ? pPlayerIndex + done : nullptr);
+    }
+
+    /// <summary>
+    /// 32 pixels per iteration. The packs work within 128-bit lanes, a permutation restores the pixel order
+    /// </summary>
+    DEPTH_SPLIT_AVX2_FUNCTION
+    void SplitAvx2(const uint16_t* pPixels, size_t count, uint16_t* pDepth, uint8_t* pPlayerIndex)
+    {
+        const __m256i lowByte    = _mm256_set1_epi32(0xff);
+        const __m256i indexOrder = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+        const size_t  blocks     = count / 32;
+
+        for (size_t block = 0; block < blocks; block++)
+        {
+            const __m256i* pIn = reinterpret_cast<const __m256i*>(pPixels + block * 64);
+            __m256i p0 = _mm256_loadu_si256(pIn);
+            __m256i p1 = _mm256_loadu_si256(pIn + 1);
+            __m256i p2 = _mm256_loadu_si256(pIn + 2);
+            __m256i p3 = _mm256_loadu_si256(pIn + 3);
+
+            __m256i d01 = _mm256_packs_epi32(_mm256_srai_epi32(p0, 16), _mm256_srai_epi32(p1, 16));
+            __m256i d23 = _mm256_packs_epi32(_mm256_srai_epi32(p2, 16), _mm256_srai_epi32(p3, 16));
+
+            __m256i* pOut = reinterpret_cast<__m256i*>(pDepth + block * 32);
+            _mm256_storeu_si256(pOut,     _mm256_permute4x64_epi64(d01, 0xd8));
+            _mm256_storeu_si256(pOut + 1, _mm256_permute4x64_epi64(d23, 0xd8));
+
+            if (pPlayerIndex)
+            {
+                __m256i i01 = _mm256_packs_epi32(_mm256_and_si256(p0, lowByte), _mm256_and_si256(p1, lowByte));
+                __m256i i23 = _mm256_packs_epi32(_mm256_and_si256(p2, lowByte), _mm256_and_si256(p3, lowByte));
+                __m256i indices = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(i01, i23), indexOrder);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(pPlayerIndex + block * 32), indices);
+            }
+        }
+
+        size_t done = blocks * 32;
+        SplitSse2(pPixels + 2 * done, count - done, pDepth + done, pPlayerIndex ? pPlayerIndex + done : nullptr);
+    }
+
+    /// <summary>
+    /// Check whether the processor and the operating system support AVX2
+    /// </summary>
+    bool HasAvx2()
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+        {
+            return false;
+        }
+
+        // AVX and OSXSAVE, then YMM state enabled by the operating system
+        __cpuid(info, 1);
+        if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6)
+        {
+            return false;
+        }
+
+        __cpuidex(info, 7, 0);
+        return 0 != (info[1] & (1 << 5));
+#else
+        return 0 != __builtin_cpu_supports("avx2");
+#endif
+    }
+#endif
+
+    /// <summary>
+    /// Pick the fastest supported kernel
+    /// </summary>
+    DepthSplitKernel SelectKernel()
+    {
+#ifdef DEPTH_SPLIT_X86
+        return HasAvx2() ? DepthSplitKernelAvx2 : DepthSplitKernelSse2;
+#else
+        return DepthSplitKernelScalar;
+#endif
+    }
+}
+
+/// <summary>
+/// Split extended depth pixels, NUI_DEPTH_IMAGE_PIXEL { USHORT playerIndex; USHORT depth; }, into a
+/// contiguous 16-bit depth plane and an 8-bit player index plane in one pass, with the fastest
+/// kernel the processor supports
+/// </summary>
+/// <param name="pPixels">The pointer to pairs of player index and depth</param>
+/// <param name="count">Number of pixels</param>
+/// <param name="pDepth">Receives count depth values</param>
+/// <param name="pPlayerIndex">Receives count player indices, the low byte of each. nullptr to only extract depth</param>
+void SplitDepthPixels(const uint16_t* pPixels, size_t count, uint16_t* pDepth, uint8_t* pPlayerIndex)
+{
+    SplitDepthPixels(GetDepthSplitKernel(), pPixels, count, pDepth, pPlayerIndex);
+}
+
+/// <summary>
+/// Split extended depth pixels with a particular kernel, for comparing the kernels
+/// </summary>
+/// <returns>False if the processor or the build does not support the kernel</returns>
+bool SplitDepthPixels(DepthSplitKernel kernel, const uint16_t* pPixels, size_t count, uint16_t* pDepth, uint8_t* pPlayerIndex)
+{
+    switch (kernel)
+    {
+    case DepthSplitKernelScalar:
+        SplitScalar(pPixels, count, pDepth, pPlayerIndex);
+        return true;
+
+#ifdef DEPTH_SPLIT_X86
+    case DepthSplitKernelSse2:
+        SplitSse2(pPixels, count, pDepth, pPlayerIndex);
+        return true;
+
+    case DepthSplitKernelAvx2:
+        if (DepthSplitKernelAvx2 != GetDepthSplitKernel())
+        {
+            return false;
+        }
+        SplitAvx2(pPixels, count, pDepth, pPlayerIndex);
+        return true;
+#endif
+
+    default:
+        return false;
+    }
+}
+
+/// <summary>
+/// Get the kernel SplitDepthPixels uses on this processor
+/// </summary>
+DepthSplitKernel GetDepthSplitKernel()
+{
+    static const DepthSplitKernel kernel = SelectKernel();
+    return kernel;
+}
+
+/// <summary>
+/// Get printable name of a kernel
+/// </summary>
+const char* GetDepthSplitKernelName(DepthSplitKernel kernel)
+{
+    switch (kernel)
+    {
+    case DepthSplitKernelScalar:    return "scalar";
+    case DepthSplitKernelSse2:      return "sse2";
+    case DepthSplitKernelAvx2:      return "avx2";
+    default:                        return "unknown";
+    }
+}
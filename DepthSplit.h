@@ -0,0 +1,50 @@
+//------------------------------------------------------------------------------
+// <copyright file="DepthSplit.h">
+//     Splitting of NUI_DEPTH_IMAGE_PIXEL frames into depth and player index planes.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define DEPTH_SPLIT_X86
+#endif
+
+// Kernels selectable for SplitDepthPixels
+enum DepthSplitKernel
+{
+    DepthSplitKernelScalar,
+    DepthSplitKernelSse2,
+    DepthSplitKernelAvx2,
+    DepthSplitKernelCount
+};
+
+/// <summary>
+/// Split extended depth pixels, NUI_DEPTH_IMAGE_PIXEL { USHORT playerIndex; USHORT depth; }, into a
+/// contiguous 16-bit depth plane and an 8-bit player index plane in one pass, with the fastest
+/// kernel the processor supports
+/// </summary>
+/// <param name="pPixels">The pointer to pairs of player index and depth</param>
+/// <param name="count">Number of pixels</param>
+/// <param name="pDepth">Receives count depth values</param>
+/// <param name="pPlayerIndex">Receives count player indices, the low byte of each. nullptr to only extract depth</param>
+void SplitDepthPixels(const uint16_t* pPixels, size_t count, uint16_t* pDepth, uint8_t* pPlayerIndex);
+
+/// <summary>
+/// Split extended depth pixels with a particular kernel, for comparing the kernels
+/// </summary>
+/// <returns>False if the processor or the build does not support the kernel</returns>
+bool SplitDepthPixels(DepthSplitKernel kernel, const uint16_t* pPixels, size_t count, uint16_t* pDepth, uint8_t* pPlayerIndex);
+
+/// <summary>
+/// Get the kernel SplitDepthPixels uses on this processor
+/// </summary>
+DepthSplitKernel GetDepthSplitKernel();
+
+/// <summary>
+/// Get printable name of a kernel
+/// </summary>
+const char* GetDepthSplitKernelName(DepthSplitKernel kernel);
@@ -0,0 +1,368 @@
+//------------------------------------------------------------------------------
+// <copyright file="EventDispatcher.cpp">
+//     Waits on the ready events of several streams and routes each signal to its stream.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "EventDispatcher.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+#ifndef _WIN32
+    // Tag of the stop event in the epoll set, sources are tagged with their index
+    const uint64_t StopTag = ~0ull;
+#endif
+}
+
+/// <summary>
+/// Constructor. The event is reset
+/// </summary>
+DispatchEvent::DispatchEvent()
+{
+#ifdef _WIN32
+    m_handle = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+#else
+    m_handle = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#endif
+}
+
+/// <summary>
+/// Destructor. Closes the event
+/// </summary>
+DispatchEvent::~DispatchEvent()
+{
+#ifdef _WIN32
+    if (m_handle)
+    {
+        CloseHandle(m_handle);
+    }
+#else
+    if (m_handle >= 0)
+    {
+        close(m_handle);
+    }
+#endif
+}
+
+/// <summary>
+/// Set the event. It stays set until it is reset
+/// </summary>
+void DispatchEvent::Set()
+{
+#ifdef _WIN32
+    SetEvent(m_handle);
+#else
+    uint64_t one = 1;
+    ssize_t written = write(m_handle, &one, sizeof(one));
+    (void)written;
+#endif
+}
+
+/// <summary>
+/// Reset the event
+/// </summary>
+void DispatchEvent::Reset()
+{
+#ifdef _WIN32
+    ResetEvent(m_handle);
+#else
+    // Draining the counter makes the descriptor unreadable again
+    uint64_t count;
+    ssize_t drained = read(m_handle, &count, sizeof(count));
+    (void)drained;
+#endif
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+EventDispatcher::EventDispatcher()
+    : m_wakeups(0)
+{
+#ifndef _WIN32
+    m_epoll = epoll_create1(EPOLL_CLOEXEC);
+
+    epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events   = EPOLLIN;
+    event.data.u64 = StopTag;
+    epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_stop.GetHandle(), &event);
+#endif
+}
+
+/// <summary>
+/// Destructor. Stops the thread
+/// </summary>
+EventDispatcher::~EventDispatcher()
+{
+    Stop();
+
+#ifndef _WIN32
+    if (m_epoll >= 0)
+    {
+        close(m_epoll);
+    }
+#endif
+}
+
+/// <summary>
+/// Add an event and the handler it is routed to. Only while the dispatcher is stopped
+/// </summary>
+/// <param name="name">Name of the source in the session log</param>
+/// <param name="handle">Event to wait on, owned by the caller</param>
+/// <param name="handler">Handler run on the dispatcher thread when the event is set</param>
+/// <returns>Index of the source</returns>
+size_t EventDispatcher::Add(const char* name, EventHandle handle, const Handler& handler)
+{
+    Source source;
+    source.name    = name;
+    source.handle  = handle;
+    source.handler = handler;
+    memset(&source.stats, 0, sizeof(source.stats));
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_sources.push_back(source);
+
+#ifndef _WIN32
+    epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events   = EPOLLIN;      // Level triggered, like waiting on a manual-reset event
+    event.data.u64 = m_sources.size() - 1;
+    epoll_ctl(m_epoll, EPOLL_CTL_ADD, handle, &event);
+#endif
+
+    return m_sources.size() - 1;
+}
+
+/// <summary>
+/// Start the thread waiting on the events
+/// </summary>
+/// <returns>True if the thread is running</returns>
+bool EventDispatcher::Start()
+{
+    if (m_thread.joinable())
+    {
+        return true;
+    }
+
+    m_stop.Reset();
+    m_thread = std::thread(&EventDispatcher::DispatchThread, this);
+
+#ifdef _WIN32
+    // Frames are waited for by the sensor, keep up with them when the machine is busy
+    SetThreadPriority(m_thread.native_handle(), THREAD_PRIORITY_ABOVE_NORMAL);
+#endif
+
+    return m_thread.joinable();
+}
+
+/// <summary>
+/// Stop the thread, after the handlers it is running have returned
+/// </summary>
+void EventDispatcher::Stop()
+{
+    if (!m_thread.joinable())
+    {
+        return;
+    }
+
+    m_stop.Set();
+    m_thread.join();
+}
+
+/// <summary>
+/// Get a snapshot of the counters of a source
+/// </summary>
+/// <param name="index">Index returned by Add</param>
+/// <returns>Counters of the source</returns>
+EventSourceStats EventDispatcher::GetStats(size_t index) const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_sources[index].stats;
+}
+
+/// <summary>
+/// Get the number of times the thread woke up for ready events
+/// </summary>
+uint64_t EventDispatcher::GetWakeups() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_wakeups;
+}
+
+/// <summary>
+/// Thread procedure waiting on the events and running the handlers
+/// </summary>
+void EventDispatcher::DispatchThread()
+{
+    std::vector<size_t> ready;
+    ready.reserve(m_sources.size());
+
+#ifdef _WIN32
+    // The stop event comes first, so it wins over events which are set at the same time
+    std::vector<HANDLE> handles;
+    handles.push_back(m_stop.GetHandle());
+    for (const Source& source : m_sources)
+    {
+        handles.push_back(source.handle);
+    }
+
+    while (true)
+    {
+        DWORD ret = WaitForMultipleObjects((DWORD)handles.size(), handles.data(), FALSE, INFINITE);
+        if (WAIT_OBJECT_0 == ret || ret >= WAIT_OBJECT_0 + handles.size())
+        {
+            break;
+        }
+
+        // The wait reports the first set event only, collect the others which are set as well
+        size_t first = ret - WAIT_OBJECT_0 - 1;
+        ready.clear();
+        ready.push_back(first);
+        for (size_t i = first + 1; i < m_sources.size(); i++)
+        {
+            if (WAIT_OBJECT_0 == WaitForSingleObject(m_sources[i].handle, 0))
+            {
+                ready.push_back(i);
+            }
+        }
+
+        Dispatch(ready);
+    }
+#else
+    std::vector<epoll_event> events(m_sources.size() + 1);
+    while (true)
+    {
+        int count = epoll_wait(m_epoll, events.data(), (int)events.size(), -1);
+        if (count < 0)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+            break;
+        }
+
+        bool stop = false;
+        ready.clear();
+        for (int i = 0; i < count; i++)
+        {
+            if (StopTag == events[i].data.u64)
+            {
+                stop = true;
+            }
+            else
+            {
+                ready.push_back((size_t)events[i].data.u64);
+            }
+        }
+
+        if (stop)
+        {
+            break;
+        }
+
+        // Same order as on Windows, the order the sources were added
+        std::sort(ready.begin(), ready.end());
+        Dispatch(ready);
+    }
+#endif
+}
+
+/// <summary>
+/// Run the handlers of the ready sources of one wakeup and count them
+/// </summary>
+/// <param name="ready">Indices of the ready sources</param>
+void EventDispatcher::Dispatch(const std::vector<size_t>& ready)
+{
+    std::chrono::steady_clock::time_point wakeup = std::chrono::steady_clock::now();
+
+    for (size_t index : ready)
+    {
+        Source& source = m_sources[index];
+        source.handler();
+
+        // Includes the handlers of the same wakeup which ran before
+        double latency = std::chrono::duration<double>(std::chrono::steady_clock::now() - wakeup).count();
+
+        std::lock_guard<std::mutex> lock(m_lock);
+        EventSourceStats& stats = source.stats;
+        ++stats.dispatches;
+        stats.batchedDispatches += ready.size() > 1 ? 1 : 0;
+        stats.latencySeconds    += latency;
+        stats.maxLatencySeconds  = std::max(stats.maxLatencySeconds, latency);
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    ++m_wakeups;
+}
+
+/// <summary>
+/// Append the counters of every source to session.log in the current directory
+/// </summary>
+void EventDispatcher::LogSession() const
+{
+    std::vector<Source> sources;
+    uint64_t            wakeups;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        sources = m_sources;
+        wakeups = m_wakeups;
+    }
+
+    if (0 == wakeups)
+    {
+        return;
+    }
+
+    FILE* pLog = fopen("session.log", "a");
+    if (!pLog)
+    {
+        return;
+    }
+
+    char   timeText[32];
+    time_t now = time(nullptr);
+    tm     local;
+#ifdef _WIN32
+    localtime_s(&local, &now);
+#else
+    localtime_r(&now, &local);
+#endif
+    strftime(timeText, sizeof(timeText), "%Y-%m-%d %H:%M:%S", &local);
+
+    for (const Source& source : sources)
+    {
+        const EventSourceStats& stats = source.stats;
+        if (0 == stats.dispatches)
+        {
+            continue;
+        }
+
+        fprintf(pLog, "%s %s events: %llu dispatched in %llu wakeups, %llu batched with other streams, "
+            "latency %.2f ms/event (max %.2f)\n",
+            timeText, source.name.c_str(), (unsigned long long)stats.dispatches, (unsigned long long)wakeups,
+            (unsigned long long)stats.batchedDispatches,
+            stats.latencySeconds * 1000 / stats.dispatches, stats.maxLatencySeconds * 1000);
+    }
+
+    fclose(pLog);
+}
@@ -0,0 +1,165 @@
+//------------------------------------------------------------------------------
+// <copyright file="EventDispatcher.h">
+//     Waits on the ready events of several streams and routes each signal to its stream.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+typedef void*   EventHandle;    // HANDLE of a manual-reset event, as handed to the sensor
+#else
+typedef int     EventHandle;    // eventfd, readable while the event is set
+#endif
+
+// Counters of one event source
+struct EventSourceStats
+{
+    uint64_t dispatches;            // Times the handler ran
+    uint64_t batchedDispatches;     // Dispatches which shared a wakeup with other sources
+    double   latencySeconds;        // Sum of the time from the wakeup until the handler returned
+    double   maxLatencySeconds;
+};
+
+/// <summary>
+/// Manual-reset event the dispatcher can wait on. On Windows the sensor takes the handle and sets and
+/// resets it, elsewhere it stands in for it, e.g. in the benchmark
+/// </summary>
+class DispatchEvent
+{
+public:
+    /// <summary>
+    /// Constructor. The event is reset
+    /// </summary>
+    DispatchEvent();
+
+    /// <summary>
+    /// Destructor. Closes the event
+    /// </summary>
+   ~DispatchEvent();
+
+public:
+    /// <summary>
+    /// Set the event. It stays set until it is reset
+    /// </summary>
+    void Set();
+
+    /// <summary>
+    /// Reset the event
+    /// </summary>
+    void Reset();
+
+    /// <summary>
+    /// Get the handle to wait on
+    /// </summary>
+    EventHandle GetHandle() const { return m_handle; }
+
+private:
+    DispatchEvent(const DispatchEvent&);
+    DispatchEvent& operator=(const DispatchEvent&);
+
+private:
+    EventHandle m_handle;
+};
+
+/// <summary>
+/// One thread waiting on the ready events of a group of streams. A wakeup runs the handler of every
+/// source which is ready at that moment, in the order the sources were added, so streams which fire
+/// together are serviced together, and no stream is polled whose event did not fire. Handlers are
+/// expected to consume the signal, e.g. by getting the next frame from the sensor, which resets the event.
+/// </summary>
+class EventDispatcher
+{
+public:
+    typedef std::function<void()> Handler;
+
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    EventDispatcher();
+
+    /// <summary>
+    /// Destructor. Stops the thread
+    /// </summary>
+   ~EventDispatcher();
+
+public:
+    /// <summary>
+    /// Add an event and the handler it is routed to. Only while the dispatcher is stopped
+    /// </summary>
+    /// <param name="name">Name of the source in the session log</param>
+    /// <param name="handle">Event to wait on, owned by the caller</param>
+    /// <param name="handler">Handler run on the dispatcher thread when the event is set</param>
+    /// <returns>Index of the source</returns>
+    size_t Add(const char* name, EventHandle handle, const Handler& handler);
+
+    /// <summary>
+    /// Start the thread waiting on the events
+    /// </summary>
+    /// <returns>True if the thread is running</returns>
+    bool Start();
+
+    /// <summary>
+    /// Stop the thread, after the handlers it is running have returned
+    /// </summary>
+    void Stop();
+
+    /// <summary>
+    /// Get a snapshot of the counters of a source
+    /// </summary>
+    /// <param name="index">Index returned by Add</param>
+    /// <returns>Counters of the source</returns>
+    EventSourceStats GetStats(size_t index) const;
+
+    /// <summary>
+    /// Get the number of times the thread woke up for ready events
+    /// </summary>
+    uint64_t GetWakeups() const;
+
+    /// <summary>
+    /// Append the counters of every source to session.log in the current directory
+    /// </summary>
+    void LogSession() const;
+
+private:
+    struct Source
+    {
+        std::string         name;
+        EventHandle         handle;
+        Handler             handler;
+        EventSourceStats    stats;
+    };
+
+    /// <summary>
+    /// Thread procedure waiting on the events and running the handlers
+    /// </summary>
+    void DispatchThread();
+
+    /// <summary>
+    /// Run the handlers of the ready sources of one wakeup and count them
+    /// </summary>
+    /// <param name="ready">Indices of the ready sources</param>
+    void Dispatch(const std::vector<size_t>& ready);
+
+private:
+    EventDispatcher(const EventDispatcher&);
+    EventDispatcher& operator=(const EventDispatcher&);
+
+private:
+    std::vector<Source>     m_sources;          // Fixed while the thread runs
+    DispatchEvent           m_stop;
+    std::thread             m_thread;
+#ifndef _WIN32
+    int                     m_epoll;
+#endif
+
+    mutable std::mutex      m_lock;             // Guards the counters
+    uint64_t                m_wakeups;
+};
@@ -0,0 +1,435 @@
+//------------------------------------------------------------------------------
+// <copyright file="FrameAssociator.cpp">
+//     Online pairing of depth frames with color frames at capture time.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "FrameAssociator.h"
+#include "RecordingSegments.h"
+#include "SensorClock.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="pPath">Path of the associations file. nullptr to only pair the frames</param>
+/// <param name="tolerance">Maximum difference of capture times in seconds of a pair</param>
+/// <param name="skipUnpaired">True to drop the frames without a partner</param>
+FrameAssociator::FrameAssociator(const char* pPath, double tolerance, bool skipUnpaired)
+    : m_pPath(pPath)
+    , m_tolerance(tolerance)
+    , m_skipUnpaired(skipUnpaired)
+    , m_open(false)
+    , m_pSegmenter(nullptr)
+    , m_participant(0)
+    , m_segment(0)
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+
+    for (int i = 0; i < RecordStreamCount; i++)
+    {
+        m_newest[i] = 0.0;
+        m_seen[i]   = false;
+    }
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+FrameAssociator::~FrameAssociator()
+{
+}
+
+/// <summary>
+/// Start a session. The associations file is written if frames of both streams are stored as files
+/// </summary>
+/// <param name="pColorExtension">File name extension of stored color frames. nullptr if they are not stored as files</param>
+/// <param name="pDepthExtension">File name extension of stored depth frames. nullptr if they are not stored as files</param>
+/// <param name="pSegmenter">Segmenter of a segmented recording, nullptr for one associations file</param>
+/// <returns>False if the associations file can not be opened</returns>
+bool FrameAssociator::Open(const char* pColorExtension, const char* pDepthExtension, RecordingSegmenter* pSegmenter)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    memset(&m_stats, 0, sizeof(m_stats));
+    for (int i = 0; i < RecordStreamCount; i++)
+    {
+        m_pending[i].clear();
+        m_newest[i] = 0.0;
+        m_seen[i]   = false;
+    }
+
+    m_pColorPath.reset();
+    m_pDepthPath.reset();
+    m_file.Close();
+    m_pSegmenter = nullptr;
+    m_segment    = 0;
+
+    if (m_pPath && pColorExtension && pDepthExtension)
+    {
+        // Same names the frame writers give the files, relative to the segment directory if there is one
+        m_pColorPath.reset(new FramePathFormatter("rgb", pColorExtension));
+        m_pDepthPath.reset(new FramePathFormatter("depth", pDepthExtension));
+
+        if (pSegmenter)
+        {
+            m_pCloser.reset(new SegmentCloser(pSegmenter->GetPool()));
+            m_pNextSegmentFile.reset(new SegmentPrefetch<SegmentFile>(pSegmenter->GetPool(),
+                [this, pSegmenter](uint32_t segment) { return OpenSegmentFile(pSegmenter, segment); },
+                [](SegmentFile* pFile) { pFile->file.Close(); remove(pFile->path.c_str()); delete pFile; }));
+
+            m_pSegmentFile.reset(OpenSegmentFile(pSegmenter, 0));
+            if (!m_pSegmentFile)
+            {
+                return false;
+            }
+
+            m_pSegmenter  = pSegmenter;
+            m_participant = pSegmenter->Join();
+            m_pNextSegmentFile->Prefetch(1);
+        }
+        else if (!m_file.Open(m_pPath))
+        {
+            return false;
+        }
+    }
+
+    m_open = true;
+    return true;
+}
+
+/// <summary>
+/// Add a frame to the session
+/// </summary>
+/// <param name="frame">Frame to associate, the associator holds a reference while it is pending</param>
+/// <param name="released">Receives the frames to be written, in order within each stream</param>
+void FrameAssociator::Add(FrameHandle frame, FrameList& released)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    RecordStream stream = frame->stream;
+    if (!m_open || stream < 0 || stream >= RecordStreamCount)
+    {
+        released.push_back(std::move(frame));
+        return;
+    }
+
+    PendingFrame pending;
+    pending.timestamp = frame->timestamp;
+    pending.hostTime  = frame->hostTime;
+    pending.segment   = m_pSegmenter ? m_pSegmenter->GetSegment(frame->timestamp) : 0;
+    pending.matched   = false;
+
+    if (m_skipUnpaired)
+    {
+        pending.frame = std::move(frame);
+    }
+    else
+    {
+        released.push_back(std::move(frame));
+    }
+
+    m_newest[stream] = m_seen[stream] ? std::max(m_newest[stream], pending.timestamp) : pending.timestamp;
+    m_seen[stream]   = true;
+    m_pending[stream].push_back(std::move(pending));
+
+    Decide(false, released);
+}
+
+/// <summary>
+/// Decide the frames still waiting, close the associations file and log the session
+/// </summary>
+/// <param name="released">Receives the last frames to be written</param>
+void FrameAssociator::Close(FrameList& released)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    if (!m_open)
+    {
+        return;
+    }
+
+    Decide(true, released);
+
+    m_file.Close();
+    if (m_pSegmenter)
+    {
+        RetireSegmentFile();
+        m_pNextSegmentFile->Cancel();
+        m_pCloser->Wait();
+        m_pSegmenter = nullptr;
+    }
+    m_open = false;
+
+    LogSession();
+}
+
+/// <summary>
+/// Get a snapshot of the counters of the session
+/// </summary>
+FrameAssociatorStats FrameAssociator::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_stats;
+}
+
+/// <summary>
+/// Pair and release the frames which can be decided. Called with the lock held
+/// </summary>
+/// <param name="flush">True to decide all frames, at the end of the session</param>
+/// <param name="released">Receives the frames to be written</param>
+void FrameAssociator::Decide(bool flush, FrameList& released)
+{
+    std::deque<PendingFrame>& colors = m_pending[RecordStreamColor];
+    std::deque<PendingFrame>& depths = m_pending[RecordStreamDepth];
+    double now = SensorClock::GetHostTime();
+
+    // Depth frames in capture order, each takes the nearest color frame no earlier depth frame took
+    while (!depths.empty())
+    {
+        PendingFrame& depth = depths.front();
+
+        size_t best       = colors.size();
+        double bestOffset = m_tolerance;
+        bool   later      = false;
+        for (size_t i = 0; i < colors.size(); i++)
+        {
+            if (colors[i].matched || colors[i].segment < depth.segment)
+            {
+                continue;
+            }
+
+            if (colors[i].segment > depth.segment)
+            {
+                // Pairs stay within a segment, and segments follow each other in time
+                later = true;
+                break;
+            }
+
+            double offset = fabs(colors[i].timestamp - depth.timestamp);
+            if (offset <= bestOffset)
+            {
+                best       = i;
+                bestOffset = offset;
+            }
+
+            if (colors[i].timestamp >= depth.timestamp)
+            {
+                // Color frames further on are further away
+                later = true;
+                break;
+            }
+        }
+
+        // Otherwise a color frame still to come may be nearer
+        bool decided = flush || later ||
+            (m_seen[RecordStreamColor] && m_newest[RecordStreamColor] >= depth.timestamp + m_tolerance) ||
+            m_newest[RecordStreamDepth] - depth.timestamp > ASSOCIATION_MAX_WAIT ||
+            depths.size() > MaxPendingFrames;
+        if (!decided)
+        {
+            break;
+        }
+
+        SwitchSegment(depth.segment);
+        if (best < colors.size())
+        {
+            colors[best].matched = true;
+            depth.matched        = true;
+            AddPair(colors[best], depth, now);
+        }
+        else
+        {
+            ++m_stats.unpairedDepth;
+        }
+
+        Release(depth, released);
+        depths.pop_front();
+    }
+
+    // Color frames in capture order, once no waiting or future depth frame can take them
+    while (!colors.empty())
+    {
+        PendingFrame& color = colors.front();
+
+        if (!color.matched && !flush && colors.size() <= MaxPendingFrames &&
+            m_newest[RecordStreamColor] - color.timestamp <= ASSOCIATION_MAX_WAIT)
+        {
+            double limit = color.timestamp + m_tolerance;
+            if (!m_seen[RecordStreamDepth] || m_newest[RecordStreamDepth] < limit ||
+                (!depths.empty() && depths.front().timestamp <= limit))
+            {
+                break;
+            }
+        }
+
+        if (!color.matched)
+        {
+            ++m_stats.unpairedColor;
+        }
+
+        Release(color, released);
+        colors.pop_front();
+    }
+}
+
+/// <summary>
+/// Account a pair and append it to the associations file. Called with the lock held
+/// </summary>
+void FrameAssociator::AddPair(const PendingFrame& color, const PendingFrame& depth, double now)
+{
+    double offset = fabs(color.timestamp - depth.timestamp);
+
+    ++m_stats.pairs;
+    m_stats.offsetSeconds   += offset;
+    m_stats.maxOffsetSeconds = std::max(m_stats.maxOffsetSeconds, offset);
+
+    // Frames which did not come from a sensor have no arrival time
+    double arrival = std::max(color.hostTime, depth.hostTime);
+    if (arrival > 0.0)
+    {
+        double delay = std::max(0.0, now - arrival);
+        m_stats.delaySeconds   += delay;
+        m_stats.maxDelaySeconds = std::max(m_stats.maxDelaySeconds, delay);
+    }
+
+    FrameListFile* pFile = m_pSegmenter ? (m_pSegmentFile ? &m_pSegmentFile->file : nullptr) : &m_file;
+    if (!m_pColorPath || !m_pDepthPath || !pFile)
+    {
+        return;
+    }
+
+    m_pColorPath->Format(color.timestamp);
+    m_pDepthPath->Format(depth.timestamp);
+
+    size_t lineLength = 2 * MaxFixedChars + m_pColorPath->GetLength() + m_pDepthPath->GetLength() + 4;
+    if (m_line.size() < lineLength)
+    {
+        m_line.resize(lineLength);
+    }
+
+    size_t length = FormatFixed(m_line.data(), color.timestamp, 6);
+    m_line[length++] = ' ';
+    memcpy(m_line.data() + length, m_pColorPath->GetPath(), m_pColorPath->GetLength());
+    length += m_pColorPath->GetLength();
+    m_line[length++] = ' ';
+    length += FormatFixed(m_line.data() + length, depth.timestamp, 6);
+    m_line[length++] = ' ';
+    memcpy(m_line.data() + length, m_pDepthPath->GetPath(), m_pDepthPath->GetLength());
+    length += m_pDepthPath->GetLength();
+    m_line[length++] = '\n';
+
+    pFile->AppendLine(m_line.data(), length);
+}
+
+/// <summary>
+/// Create the directory of a segment and open its associations file. Runs on the pool
+/// </summary>
+/// <returns>nullptr if the file can not be opened</returns>
+FrameAssociator::SegmentFile* FrameAssociator::OpenSegmentFile(RecordingSegmenter* pSegmenter, uint32_t segment) const
+{
+    std::unique_ptr<SegmentFile> pFile(new SegmentFile);
+    pFile->segment = segment;
+    pFile->path    = pSegmenter->MakeSegmentDirectory(segment) + FRAME_PATH_SEPARATOR + m_pPath;
+
+    return pFile->file.Open(pFile->path.c_str()) ? pFile.release() : nullptr;
+}
+
+/// <summary>
+/// Switch to the associations file of a later segment, closing the current one on the pool. Called with the lock held
+/// </summary>
+void FrameAssociator::SwitchSegment(uint32_t segment)
+{
+    if (!m_pSegmenter || segment <= m_segment)
+    {
+        return;
+    }
+
+    // Usually opened ahead on the pool, so this only swaps files
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool prefetched = false;
+
+    RetireSegmentFile();
+    m_pSegmentFile.reset(m_pNextSegmentFile->Take(segment, prefetched));
+    m_segment = segment;
+
+    m_pSegmenter->CountRollover(prefetched,
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    m_pNextSegmentFile->Prefetch(segment + 1);
+}
+
+/// <summary>
+/// Hand the associations file of the current segment over to be closed. Called with the lock held
+/// </summary>
+void FrameAssociator::RetireSegmentFile()
+{
+    std::shared_ptr<SegmentFile> pFile(std::move(m_pSegmentFile));
+    RecordingSegmenter*          pSegmenter  = m_pSegmenter;
+    uint32_t                     participant = m_participant;
+    uint32_t                     segment     = m_segment;
+
+    m_pCloser->Close([pFile, pSegmenter, participant, segment]()
+    {
+        if (pFile)
+        {
+            pFile->file.Close();
+        }
+        pSegmenter->Finish(participant, segment);
+    });
+}
+
+/// <summary>
+/// Hand a decided frame over to be written, or drop it
+/// </summary>
+void FrameAssociator::Release(PendingFrame& pending, FrameList& released)
+{
+    // Frames are only held when unpaired ones are skipped
+    if (pending.frame && pending.matched)
+    {
+        released.push_back(std::move(pending.frame));
+    }
+}
+
+/// <summary>
+/// Append the counters of the session to session.log in the current directory
+/// </summary>
+void FrameAssociator::LogSession() const
+{
+    if (0 == m_stats.pairs + m_stats.unpairedColor + m_stats.unpairedDepth)
+    {
+        return;
+    }
+
+    FILE* pLog = fopen("session.log", "a");
+    if (!pLog)
+    {
+        return;
+    }
+
+    char   timeText[32];
+    time_t now = time(nullptr);
+    tm     local;
+#ifdef _WIN32
+    localtime_s(&local, &now);
+#else
+    localtime_r(&now, &local);
+#endif
+    strftime(timeText, sizeof(timeText), "%Y-%m-%d %H:%M:%S", &local);
+
+    double pairs = m_stats.pairs ? (double)m_stats.pairs : 1.0;
+    fprintf(pLog, "%s association: %llu pairs, %llu color and %llu depth frames unpaired (%s), "
+        "offset %.2f ms/pair (max %.2f), delay %.2f ms/pair (max %.2f)\n",
+        timeText, (unsigned long long)m_stats.pairs,
+        (unsigned long long)m_stats.unpairedColor, (unsigned long long)m_stats.unpairedDepth,
+        m_skipUnpaired ? "skipped" : "kept",
+        m_stats.offsetSeconds * 1000 / pairs, m_stats.maxOffsetSeconds * 1000,
+        m_stats.delaySeconds * 1000 / pairs, m_stats.maxDelaySeconds * 1000);
+
+    fclose(pLog);
+}
@@ -0,0 +1,187 @@
+//------------------------------------------------------------------------------
+// <copyright file="FrameAssociator.h">
+//     Online pairing of depth frames with color frames at capture time.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "FrameHandle.h"
+#include "FramePath.h"
+#include "RecordFrame.h"
+
+#define ASSOCIATION_DEFAULT_TOLERANCE   0.02    // Seconds, the maximum difference the TUM association script accepts by default
+#define ASSOCIATION_MAX_WAIT            0.5     // Seconds a frame waits for the other stream before it is decided without it
+
+class RecordingSegmenter;
+class SegmentCloser;
+template <typename T> class SegmentPrefetch;
+
+// Counters of an association session
+struct FrameAssociatorStats
+{
+    uint64_t pairs;
+    uint64_t unpairedColor;
+    uint64_t unpairedDepth;
+    double   offsetSeconds;         // Sum of the capture time differences of the pairs
+    double   maxOffsetSeconds;
+    double   delaySeconds;          // Sum of the times from the arrival of the later frame of a pair to its association
+    double   maxDelaySeconds;
+};
+
+/// <summary>
+/// Pairs every depth frame with the nearest color frame captured within a tolerance while recording,
+/// replacing the association script run over rgb.txt and depth.txt afterwards. Each color frame is
+/// used by one pair at most. The pairs are appended to a TUM style associations file,
+/// "[color timestamp] [color path] [depth timestamp] [depth path]" per line.
+///
+/// Frames pass through unchanged, or when unpaired frames are skipped, are held back until it is
+/// known whether they have a partner. A frame is decided as soon as a frame of the other stream
+/// captured after it arrives, so frames are held for about one frame period; if the other stream
+/// stalls they are decided after ASSOCIATION_MAX_WAIT. Frames of each stream are released in order.
+///
+/// In a segmented recording frames are only paired within a segment, and each segment gets its own
+/// associations file with the name of the file given, in the directory of the segment.
+/// </summary>
+class FrameAssociator
+{
+public:
+    typedef std::vector<FrameHandle> FrameList;
+
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="pPath">Path of the associations file. nullptr to only pair the frames</param>
+    /// <param name="tolerance">Maximum difference of capture times in seconds of a pair</param>
+    /// <param name="skipUnpaired">True to drop the frames without a partner</param>
+    FrameAssociator(const char* pPath, double tolerance = ASSOCIATION_DEFAULT_TOLERANCE, bool skipUnpaired = false);
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+   ~FrameAssociator();
+
+    static const size_t MaxPendingFrames = 64;     // Frames per stream waiting for a decision, bounds the memory held back
+
+    /// <summary>
+    /// Start a session. The associations file is written if frames of both streams are stored as files
+    /// </summary>
+    /// <param name="pColorExtension">File name extension of stored color frames. nullptr if they are not stored as files</param>
+    /// <param name="pDepthExtension">File name extension of stored depth frames. nullptr if they are not stored as files</param>
+    /// <param name="pSegmenter">Segmenter of a segmented recording, nullptr for one associations file</param>
+    /// <returns>False if the associations file can not be opened</returns>
+    bool Open(const char* pColorExtension, const char* pDepthExtension, RecordingSegmenter* pSegmenter = nullptr);
+
+    /// <summary>
+    /// Add a frame to the session
+    /// </summary>
+    /// <param name="frame">Frame to associate, the associator holds a reference while it is pending</param>
+    /// <param name="released">Receives the frames to be written, in order within each stream</param>
+    void Add(FrameHandle frame, FrameList& released);
+
+    /// <summary>
+    /// Decide the frames still waiting, close the associations file and log the session
+    /// </summary>
+    /// <param name="released">Receives the last frames to be written</param>
+    void Close(FrameList& released);
+
+    /// <summary>
+    /// Check whether frames without a partner are dropped
+    /// </summary>
+    bool IsSkippingUnpaired() const { return m_skipUnpaired; }
+
+    /// <summary>
+    /// Get a snapshot of the counters of the session
+    /// </summary>
+    FrameAssociatorStats GetStats() const;
+
+private:
+    struct PendingFrame
+    {
+        FrameHandle                     frame;          // Only held when unpaired frames are skipped
+        double                          timestamp;
+        double                          hostTime;
+        uint32_t                        segment;
+        bool                            matched;
+    };
+
+    // Associations file of a segment
+    struct SegmentFile
+    {
+        uint32_t                        segment;
+        std::string                     path;
+        FrameListFile                   file;
+    };
+
+    /// <summary>
+    /// Pair and release the frames which can be decided. Called with the lock held
+    /// </summary>
+    /// <param name="flush">True to decide all frames, at the end of the session</param>
+    /// <param name="released">Receives the frames to be written</param>
+    void Decide(bool flush, FrameList& released);
+
+    /// <summary>
+    /// Account a pair and append it to the associations file. Called with the lock held
+    /// </summary>
+    void AddPair(const PendingFrame& color, const PendingFrame& depth, double now);
+
+    /// <summary>
+    /// Create the directory of a segment and open its associations file. Runs on the pool
+    /// </summary>
+    /// <returns>nullptr if the file can not be opened</returns>
+    SegmentFile* OpenSegmentFile(RecordingSegmenter* pSegmenter, uint32_t segment) const;
+
+    /// <summary>
+    /// Switch to the associations file of a later segment, closing the current one on the pool. Called with the lock held
+    /// </summary>
+    void SwitchSegment(uint32_t segment);
+
+    /// <summary>
+    /// Hand the associations file of the current segment over to be closed. Called with the lock held
+    /// </summary>
+    void RetireSegmentFile();
+
+    /// <summary>
+    /// Hand a decided frame over to be written, or drop it
+    /// </summary>
+    void Release(PendingFrame& pending, FrameList& released);
+
+    /// <summary>
+    /// Append the counters of the session to session.log in the current directory
+    /// </summary>
+    void LogSession() const;
+
+private:
+    mutable std::mutex          m_lock;
+
+    const char*                 m_pPath;
+    double                      m_tolerance;
+    bool                        m_skipUnpaired;
+    bool                        m_open;
+
+    std::deque<PendingFrame>    m_pending[RecordStreamCount];
+    double                      m_newest[RecordStreamCount];    // Capture time of the latest frame of each stream
+    bool                        m_seen[RecordStreamCount];
+
+    std::unique_ptr<FramePathFormatter> m_pColorPath;
+    std::unique_ptr<FramePathFormatter> m_pDepthPath;
+    FrameListFile               m_file;
+    std::vector<char>           m_line;     // Grows to the longest line written
+
+    RecordingSegmenter*                             m_pSegmenter;       // Set while a segmented session is open
+    uint32_t                                        m_participant;
+    uint32_t                                        m_segment;          // Segment the latest depth frame was decided in
+    std::unique_ptr<SegmentFile>                    m_pSegmentFile;     // Associations of the segment pairs are added to
+    std::unique_ptr<SegmentPrefetch<SegmentFile>>   m_pNextSegmentFile;
+    std::unique_ptr<SegmentCloser>                  m_pCloser;
+
+    FrameAssociatorStats        m_stats;
+};
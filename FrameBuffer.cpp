@@ -0,0 +1,411 @@
+//------------------------------------------------------------------------------
+// <copyright file="FrameBuffer.cpp">
+//     Pixel storage of recorded frames, backed by preallocated slabs or the heap.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "FrameBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const size_t CacheLineBytes = 64;
+
+#ifdef _WIN32
+    /// <summary>
+    /// Large pages need the lock pages in memory privilege, which the process has to enable once
+    /// </summary>
+    bool EnableLockMemoryPrivilege()
+    {
+        HANDLE hToken;
+        if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &hToken))
+        {
+            return false;
+        }
+
+        TOKEN_PRIVILEGES privileges;
+        privileges.PrivilegeCount           = 1;
+        privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+
+        // AdjustTokenPrivileges succeeds without assigning a privilege the account does not hold
+        bool enabled = LookupPrivilegeValue(nullptr, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid) &&
+                       AdjustTokenPrivileges(hToken, FALSE, &privileges, 0, nullptr, nullptr) &&
+                       ERROR_SUCCESS == GetLastError();
+
+        CloseHandle(hToken);
+        return enabled;
+    }
+#endif
+
+    /// <summary>
+    /// Allocate zeroed pages for an arena
+    /// </summary>
+    /// <param name="bytes">Bytes needed, rounded up to whole pages</param>
+    /// <param name="largePages">True to try large pages first. Set to whether large pages were used</param>
+    /// <returns>The pointer to the pages, nullptr on failure</returns>
+    uint8_t* AllocatePages(size_t& bytes, bool& largePages)
+    {
+#ifdef _WIN32
+        if (largePages)
+        {
+            static const bool privilege = EnableLockMemoryPrivilege();
+            size_t largePageBytes = GetLargePageMinimum();
+            if (privilege && largePageBytes)
+            {
+                size_t rounded = (bytes + largePageBytes - 1) / largePageBytes * largePageBytes;
+                void* pPages = VirtualAlloc(nullptr, rounded, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+                if (pPages)
+                {
+                    bytes = rounded;
+                    return static_cast<uint8_t*>(pPages);
+                }
+            }
+        }
+
+        largePages = false;
+        return static_cast<uint8_t*>(VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+#else
+        if (largePages)
+        {
+#ifdef MAP_HUGETLB
+            const size_t hugePageBytes = 2 * 1024 * 1024;
+            size_t rounded = (bytes + hugePageBytes - 1) / hugePageBytes * hugePageBytes;
+            void* pPages = mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (MAP_FAILED != pPages)
+            {
+                bytes = rounded;
+                return static_cast<uint8_t*>(pPages);
+            }
+#endif
+            largePages = false;
+        }
+
+        void* pPages = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        return MAP_FAILED != pPages ? static_cast<uint8_t*>(pPages) : nullptr;
+#endif
+    }
+
+    /// <summary>
+    /// Release pages allocated by AllocatePages
+    /// </summary>
+    void FreePages(uint8_t* pPages, size_t bytes)
+    {
+#ifdef _WIN32
+        (void)bytes;
+        VirtualFree(pPages, 0, MEM_RELEASE);
+#else
+        munmap(pPages, bytes);
+#endif
+    }
+
+    /// <summary>
+    /// Write one byte of every page so the pages are backed before the first frame
+    /// </summary>
+    void TouchPages(uint8_t* pPages, size_t bytes)
+    {
+#ifdef _WIN32
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        size_t pageBytes = info.dwPageSize;
+#else
+        size_t pageBytes = (size_t)sysconf(_SC_PAGESIZE);
+#endif
+        for (size_t offset = 0; offset < bytes; offset += pageBytes)
+        {
+            pPages[offset] = 0;
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+//
+// FrameBuffer
+//
+// -----------------------------------------------------------------------------
+
+/// <summary>
+/// Constructor. The buffer is empty and holds no memory
+/// </summary>
+FrameBuffer::FrameBuffer()
+    : m_pData(nullptr)
+    , m_size(0)
+    , m_capacity(0)
+{
+}
+
+/// <summary>
+/// Copy constructor. The copy holds memory on the heap
+/// </summary>
+FrameBuffer::FrameBuffer(const FrameBuffer& other)
+    : m_pData(nullptr)
+    , m_size(0)
+    , m_capacity(0)
+{
+    assign(other.m_pData, other.m_pData + other.m_size);
+}
+
+/// <summary>
+/// Move constructor. The slab, if any, moves along
+/// </summary>
+FrameBuffer::FrameBuffer(FrameBuffer&& other)
+    : m_pData(other.m_pData)
+    , m_size(other.m_size)
+    , m_capacity(other.m_capacity)
+    , m_pArena(std::move(other.m_pArena))
+{
+    other.m_pData    = nullptr;
+    other.m_size     = 0;
+    other.m_capacity = 0;
+}
+
+/// <summary>
+/// Destructor. Frees the memory
+/// </summary>
+FrameBuffer::~FrameBuffer()
+{
+    Free();
+}
+
+/// <summary>
+/// Copy the contents, into the memory held if it is large enough
+/// </summary>
+FrameBuffer& FrameBuffer::operator=(const FrameBuffer& other)
+{
+    if (this != &other)
+    {
+        assign(other.m_pData, other.m_pData + other.m_size);
+    }
+
+    return *this;
+}
+
+/// <summary>
+/// Free the memory held and take over the memory of the other buffer
+/// </summary>
+FrameBuffer& FrameBuffer::operator=(FrameBuffer&& other)
+{
+    if (this != &other)
+    {
+        Free();
+
+        m_pData    = other.m_pData;
+        m_size     = other.m_size;
+        m_capacity = other.m_capacity;
+        m_pArena   = std::move(other.m_pArena);
+
+        other.m_pData    = nullptr;
+        other.m_size     = 0;
+        other.m_capacity = 0;
+    }
+
+    return *this;
+}
+
+/// <summary>
+/// Change the size. Contents up to the smaller size are kept
+/// </summary>
+/// <param name="size">New size in bytes</param>
+void FrameBuffer::resize(size_t size)
+{
+    Grow(size, std::min(size, m_size));
+    m_size = size;
+}
+
+/// <summary>
+/// Replace the contents with a copy of a range of bytes
+/// </summary>
+void FrameBuffer::assign(const uint8_t* pFirst, const uint8_t* pLast)
+{
+    size_t size = pLast - pFirst;
+    Grow(size, 0);
+    if (size)
+    {
+        memcpy(m_pData, pFirst, size);
+    }
+    m_size = size;
+}
+
+/// <summary>
+/// Free the memory, or hand the slab back to its arena
+/// </summary>
+void FrameBuffer::Free()
+{
+    if (m_pArena)
+    {
+        m_pArena->Return(m_pData);
+        m_pArena.reset();
+    }
+    else
+    {
+        delete[] m_pData;
+    }
+
+    m_pData    = nullptr;
+    m_size     = 0;
+    m_capacity = 0;
+}
+
+/// <summary>
+/// Make room for a number of bytes, on the heap if the memory held is too small
+/// </summary>
+/// <param name="capacity">Bytes needed</param>
+/// <param name="keepSize">Number of bytes of the current contents to keep</param>
+void FrameBuffer::Grow(size_t capacity, size_t keepSize)
+{
+    if (capacity <= m_capacity)
+    {
+        return;
+    }
+
+    uint8_t* pData = new uint8_t[capacity];
+    if (keepSize)
+    {
+        memcpy(pData, m_pData, keepSize);
+    }
+
+    Free();
+    m_pData    = pData;
+    m_capacity = capacity;
+}
+
+// -----------------------------------------------------------------------------
+//
+// FrameArena
+//
+// -----------------------------------------------------------------------------
+
+/// <summary>
+/// Constructor
+/// </summary>
+FrameArena::FrameArena()
+    : m_pMemory(nullptr)
+    , m_memoryBytes(0)
+    , m_slabBytes(0)
+    , m_slabStride(0)
+    , m_slabCount(0)
+    , m_maxSlabsInUse(0)
+    , m_largePages(false)
+{
+}
+
+/// <summary>
+/// Destructor. Releases the memory
+/// </summary>
+FrameArena::~FrameArena()
+{
+    if (m_pMemory)
+    {
+        FreePages(m_pMemory, m_memoryBytes);
+    }
+}
+
+/// <summary>
+/// Allocate an arena and touch all its pages, so handing out slabs never faults
+/// </summary>
+/// <param name="slabBytes">Size of each slab, the size of a frame</param>
+/// <param name="slabCount">Number of slabs</param>
+/// <param name="largePages">True to try large pages first. Falls back to normal pages</param>
+/// <returns>The new arena, nullptr if the memory could not be allocated</returns>
+std::shared_ptr<FrameArena> FrameArena::Create(size_t slabBytes, size_t slabCount, bool largePages)
+{
+    if (0 == slabBytes || 0 == slabCount)
+    {
+        return nullptr;
+    }
+
+    std::shared_ptr<FrameArena> pArena(new FrameArena());
+    pArena->m_slabBytes   = slabBytes;
+    pArena->m_slabStride  = (slabBytes + CacheLineBytes - 1) / CacheLineBytes * CacheLineBytes;
+    pArena->m_slabCount   = slabCount;
+    pArena->m_memoryBytes = pArena->m_slabStride * slabCount;
+    pArena->m_largePages  = largePages;
+    pArena->m_pMemory     = AllocatePages(pArena->m_memoryBytes, pArena->m_largePages);
+    if (!pArena->m_pMemory)
+    {
+        return nullptr;
+    }
+
+    TouchPages(pArena->m_pMemory, pArena->m_memoryBytes);
+
+    // Handed out from the back, lowest addresses first
+    pArena->m_freeSlabs.reserve(slabCount);
+    for (size_t i = slabCount; i > 0; i--)
+    {
+        pArena->m_freeSlabs.push_back(pArena->m_pMemory + (i - 1) * pArena->m_slabStride);
+    }
+
+    return pArena;
+}
+
+/// <summary>
+/// Hand a free slab to a buffer. The buffer frees what it held before
+/// </summary>
+/// <param name="buffer">Buffer to take the slab, left empty</param>
+/// <returns>False if all slabs are in use</returns>
+bool FrameArena::Attach(FrameBuffer& buffer)
+{
+    uint8_t* pSlab;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_freeSlabs.empty())
+        {
+            return false;
+        }
+
+        pSlab = m_freeSlabs.back();
+        m_freeSlabs.pop_back();
+        m_maxSlabsInUse = std::max(m_maxSlabsInUse, m_slabCount - m_freeSlabs.size());
+    }
+
+    buffer.Free();
+    buffer.m_pData    = pSlab;
+    buffer.m_capacity = m_slabBytes;
+    buffer.m_pArena   = shared_from_this();
+    return true;
+}
+
+/// <summary>
+/// Get a snapshot of the occupancy
+/// </summary>
+FrameArenaStats FrameArena::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    FrameArenaStats stats;
+    stats.slabBytes     = m_slabBytes;
+    stats.slabCount     = m_slabCount;
+    stats.slabsInUse    = m_slabCount - m_freeSlabs.size();
+    stats.maxSlabsInUse = m_maxSlabsInUse;
+    stats.largePages    = m_largePages;
+    return stats;
+}
+
+/// <summary>
+/// Restart the high-water mark from the slabs in use now
+/// </summary>
+void FrameArena::ResetHighWaterMark()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_maxSlabsInUse = m_slabCount - m_freeSlabs.size();
+}
+
+/// <summary>
+/// Take back a slab freed by a buffer
+/// </summary>
+void FrameArena::Return(uint8_t* pSlab)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_freeSlabs.push_back(pSlab);
+}
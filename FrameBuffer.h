@@ -0,0 +1,176 @@
+//------------------------------------------------------------------------------
+// <copyright file="FrameBuffer.h">
+//     Pixel storage of recorded frames, backed by preallocated slabs or the heap.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class FrameArena;
+
+/// <summary>
+/// Pixel storage of a recorded frame. Holds either a slab of a FrameArena, which goes back to the arena
+/// when the buffer is freed, or memory on the heap. Like std::vector it keeps its memory when resized
+/// or assigned to within its capacity, so refilling a frame of the same geometry does not allocate.
+/// </summary>
+class FrameBuffer
+{
+public:
+    /// <summary>
+    /// Constructor. The buffer is empty and holds no memory
+    /// </summary>
+    FrameBuffer();
+
+    /// <summary>
+    /// Copy constructor. The copy holds memory on the heap
+    /// </summary>
+    FrameBuffer(const FrameBuffer& other);
+
+    /// <summary>
+    /// Move constructor. The slab, if any, moves along
+    /// </summary>
+    FrameBuffer(FrameBuffer&& other);
+
+    /// <summary>
+    /// Destructor. Frees the memory
+    /// </summary>
+   ~FrameBuffer();
+
+    /// <summary>
+    /// Copy the contents, into the memory held if it is large enough
+    /// </summary>
+    FrameBuffer& operator=(const FrameBuffer& other);
+
+    /// <summary>
+    /// Free the memory held and take over the memory of the other buffer
+    /// </summary>
+    FrameBuffer& operator=(FrameBuffer&& other);
+
+public:
+    uint8_t*        data()          { return m_pData; }
+    const uint8_t*  data() const    { return m_pData; }
+    size_t          size() const    { return m_size; }
+    size_t          capacity() const { return m_capacity; }
+    bool            empty() const   { return 0 == m_size; }
+
+    /// <summary>
+    /// Change the size. Contents up to the smaller size are kept
+    /// </summary>
+    /// <param name="size">New size in bytes</param>
+    void resize(size_t size);
+
+    /// <summary>
+    /// Replace the contents with a copy of a range of bytes
+    /// </summary>
+    void assign(const uint8_t* pFirst, const uint8_t* pLast);
+
+    /// <summary>
+    /// Free the memory, or hand the slab back to its arena
+    /// </summary>
+    void Free();
+
+    /// <summary>
+    /// Check if the buffer holds a slab of an arena
+    /// </summary>
+    bool IsPooled() const { return nullptr != m_pArena; }
+
+private:
+    /// <summary>
+    /// Make room for a number of bytes, on the heap if the memory held is too small
+    /// </summary>
+    /// <param name="capacity">Bytes needed</param>
+    /// <param name="keepSize">Number of bytes of the current contents to keep</param>
+    void Grow(size_t capacity, size_t keepSize);
+
+    friend class FrameArena;
+
+private:
+    uint8_t*                    m_pData;
+    size_t                      m_size;
+    size_t                      m_capacity;
+    std::shared_ptr<FrameArena> m_pArena;       // Arena the slab belongs to, nullptr for memory on the heap
+};
+
+// Occupancy of an arena
+struct FrameArenaStats
+{
+    size_t  slabBytes;
+    size_t  slabCount;
+    size_t  slabsInUse;
+    size_t  maxSlabsInUse;      // High-water mark since the arena was created or the mark was reset
+    bool    largePages;         // Arena is backed by large pages
+};
+
+/// <summary>
+/// One block of memory allocated up front and cut into equally sized slabs, one per frame. Slabs are
+/// handed out to FrameBuffers and come back when the buffers are freed, from any thread. The arena
+/// lives as long as it has slabs out.
+/// </summary>
+class FrameArena : public std::enable_shared_from_this<FrameArena>
+{
+public:
+    /// <summary>
+    /// Allocate an arena and touch all its pages, so handing out slabs never faults
+    /// </summary>
+    /// <param name="slabBytes">Size of each slab, the size of a frame</param>
+    /// <param name="slabCount">Number of slabs</param>
+    /// <param name="largePages">True to try large pages first. Falls back to normal pages</param>
+    /// <returns>The new arena, nullptr if the memory could not be allocated</returns>
+    static std::shared_ptr<FrameArena> Create(size_t slabBytes, size_t slabCount, bool largePages);
+
+    /// <summary>
+    /// Destructor. Releases the memory
+    /// </summary>
+   ~FrameArena();
+
+    /// <summary>
+    /// Hand a free slab to a buffer. The buffer frees what it held before
+    /// </summary>
+    /// <param name="buffer">Buffer to take the slab, left empty</param>
+    /// <returns>False if all slabs are in use</returns>
+    bool Attach(FrameBuffer& buffer);
+
+    /// <summary>
+    /// Get size of each slab
+    /// </summary>
+    size_t GetSlabBytes() const { return m_slabBytes; }
+
+    /// <summary>
+    /// Get a snapshot of the occupancy
+    /// </summary>
+    FrameArenaStats GetStats() const;
+
+    /// <summary>
+    /// Restart the high-water mark from the slabs in use now
+    /// </summary>
+    void ResetHighWaterMark();
+
+private:
+    FrameArena();
+    FrameArena(const FrameArena&);
+    FrameArena& operator=(const FrameArena&);
+
+    /// <summary>
+    /// Take back a slab freed by a buffer
+    /// </summary>
+    void Return(uint8_t* pSlab);
+
+    friend class FrameBuffer;
+
+private:
+    uint8_t*                m_pMemory;
+    size_t                  m_memoryBytes;
+    size_t                  m_slabBytes;
+    size_t                  m_slabStride;       // Slab size rounded up to whole cache lines
+    size_t                  m_slabCount;
+    size_t                  m_maxSlabsInUse;
+    bool                    m_largePages;
+    mutable std::mutex      m_lock;
+    std::vector<uint8_t*>   m_freeSlabs;        // Never grows past the number of slabs
+};
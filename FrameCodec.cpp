@@ -0,0 +1,309 @@
+//------------------------------------------------------------------------------
+// <copyright file="FrameCodec.cpp">
+//     Interface of frame encoders and decoding of stored frames.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "FrameCodec.h"
+#include "JpegCodec.h"
+#include "QoiCodec.h"
+#include "RvlCodec.h"
+#include "TemporalDepthCodec.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+// -----------------------------------------------------------------------------
+//
+// FrameEncoder
+//
+// -----------------------------------------------------------------------------
+
+/// <summary>
+/// Constructor
+/// </summary>
+FrameEncoder::FrameEncoder()
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+/// <summary>
+/// Start a new session. Clears the statistics and any state kept between frames
+/// </summary>
+void FrameEncoder::Reset()
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+/// <summary>
+/// Encode a frame and account it in the statistics
+/// </summary>
+/// <param name="frame">Frame to encode</param>
+/// <param name="payload">Receives the encoded payload</param>
+/// <returns>Indicates success or failure</returns>
+bool FrameEncoder::Encode(const RecordFrame& frame, std::vector<uint8_t>& payload)
+{
+    bool keyframe = false;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (!EncodeFrame(frame, payload, keyframe))
+    {
+        ++m_stats.failures;
+        return false;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Both recorded pixel formats take 4 bytes per pixel
+    ++m_stats.frames;
+    m_stats.keyframes    += keyframe ? 1 : 0;
+    m_stats.lastKeyframe  = keyframe;
+    m_stats.rawBytes     += (uint64_t)frame.width * frame.height * 4;
+    m_stats.encodedBytes += payload.size();
+
+    m_stats.encodeSeconds    += seconds;
+    m_stats.lastEncodeSeconds = seconds;
+    if (seconds > m_stats.maxEncodeSeconds)
+    {
+        m_stats.maxEncodeSeconds = seconds;
+    }
+
+    return true;
+}
+
+/// <summary>
+/// Append the statistics of a finished session to session.log in the current directory
+/// </summary>
+/// <param name="stream">Stream the encoder was used for</param>
+/// <param name="encoder">Encoder of the session</param>
+void LogEncoderSession(RecordStream stream, const FrameEncoder& encoder)
+{
+    LogEncoderSession(stream, encoder.GetCodec(), encoder.GetStats());
+}
+
+/// <summary>
+/// Append the statistics of a finished session to session.log in the current directory
+/// </summary>
+/// <param name="stream">Stream the frames belong to</param>
+/// <param name="codec">Codec the frames were encoded with</param>
+/// <param name="stats">Statistics of the session</param>
+void LogEncoderSession(RecordStream stream, RecordCodec codec, const FrameEncoderStats& stats)
+{
+    if (0 == stats.frames)
+    {
+        return;
+    }
+
+    FILE* pLog = fopen("session.log", "a");
+    if (!pLog)
+    {
+        return;
+    }
+
+    char   timeText[32];
+    time_t now = time(nullptr);
+    tm     local;
+#ifdef _WIN32
+    localtime_s(&local, &now);
+#else
+    localtime_r(&now, &local);
+#endif
+    strftime(timeText, sizeof(timeText), "%Y-%m-%d %H:%M:%S", &local);
+
+    const double MB = 1024.0 * 1024.0;
+    fprintf(pLog, "%s %s %s: %llu frames (%llu keyframes, %llu failed), %.1f MB raw, %.1f MB stored, ratio %.2f, "
+        "%.1f KB/frame, encode %.2f ms/frame (max %.2f)\n",
+        timeText, RecordStreamColor == stream ? "color" : "depth", GetCodecName(codec),
+        (unsigned long long)stats.frames, (unsigned long long)stats.keyframes, (unsigned long long)stats.failures,
+        stats.rawBytes / MB, stats.encodedBytes / MB,
+        stats.encodedBytes ? (double)stats.rawBytes / stats.encodedBytes : 0.0,
+        stats.encodedBytes / 1024.0 / stats.frames, stats.encodeSeconds * 1000 / stats.frames, stats.maxEncodeSeconds * 1000);
+
+    fclose(pLog);
+}
+
+// -----------------------------------------------------------------------------
+//
+// FrameDecoder
+//
+// -----------------------------------------------------------------------------
+
+/// <summary>
+/// Constructor
+/// </summary>
+FrameDecoder::FrameDecoder()
+{
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+FrameDecoder::~FrameDecoder()
+{
+}
+
+/// <summary>
+/// Decode the next payload of the stream
+/// </summary>
+/// <param name="codec">Codec of the payload</param>
+/// <param name="pPayload">The pointer to payload</param>
+/// <param name="size">Size of payload in bytes</param>
+/// <param name="frame">Receives the pixels. For raw payloads format, width, height and stride must be set</param>
+/// <returns>False if the payload is damaged or its reference frame has not been decoded</returns>
+bool FrameDecoder::Decode(RecordCodec codec, const uint8_t* pPayload, size_t size, RecordFrame& frame)
+{
+    if (RecordCodecTemporalDepth == codec)
+    {
+        if (!m_pTemporalDepth)
+        {
+            m_pTemporalDepth.reset(new TemporalDepthDecoder());
+        }
+        return m_pTemporalDepth->Decode(pPayload, size, frame);
+    }
+
+    return DecodeFramePayload(codec, pPayload, size, frame);
+}
+
+// -----------------------------------------------------------------------------
+//
+// Payload functions
+//
+// -----------------------------------------------------------------------------
+
+/// <summary>
+/// Get printable name of a codec
+/// </summary>
+const char* GetCodecName(RecordCodec codec)
+{
+    switch (codec)
+    {
+    case RecordCodecRaw:            return "raw";
+    case RecordCodecPng:            return "png";
+    case RecordCodecRvl:            return "rvl";
+    case RecordCodecTemporalDepth:  return "tdp";
+    case RecordCodecQoi:            return "qoi";
+    case RecordCodecJpeg:           return "jpg";
+    default:                        return "unknown";
+    }
+}
+
+/// <summary>
+/// Decode a stored payload into raw frame pixels. The caller fills the stream, timestamp
+/// and frame number; the pixel description comes from the payload where the codec stores it.
+/// Payloads predicted from earlier frames need a FrameDecoder.
+/// </summary>
+/// <param name="codec">Codec of the payload</param>
+/// <param name="pPayload">The pointer to payload</param>
+/// <param name="size">Size of payload in bytes</param>
+/// <param name="frame">Receives the pixels. For raw payloads format, width, height and stride must be set</param>
+/// <returns>Indicates success or failure</returns>
+bool DecodeFramePayload(RecordCodec codec, const uint8_t* pPayload, size_t size, RecordFrame& frame)
+{
+    switch (codec)
+    {
+    case RecordCodecRaw:
+        if (size < (size_t)frame.stride * frame.height)
+        {
+            return false;
+        }
+        frame.data.assign(pPayload, pPayload + size);
+        return true;
+
+    case RecordCodecRvl:
+        return RvlDecodeDepth(pPayload, size, frame);
+
+    case RecordCodecTemporalDepth:
+        {
+            // Only keyframes decode without the previous frame
+            TemporalDepthDecoder decoder;
+            return decoder.Decode(pPayload, size, frame);
+        }
+
+    case RecordCodecQoi:
+        return QoiDecodeColor(pPayload, size, frame);
+
+    default:
+        return false;
+    }
+}
+
+/// <summary>
+/// Read the frame size from an encoded payload without decoding it
+/// </summary>
+/// <param name="codec">Codec of the payload</param>
+/// <param name="pPayload">The pointer to payload</param>
+/// <param name="size">Size of payload in bytes</param>
+/// <param name="width">Receives the frame width</param>
+/// <param name="height">Receives the frame height</param>
+/// <returns>False if the codec does not store the size or the payload is damaged</returns>
+bool GetEncodedFrameSize(RecordCodec codec, const uint8_t* pPayload, size_t size, uint32_t& width, uint32_t& height)
+{
+    switch (codec)
+    {
+    case RecordCodecPng:
+        // Signature followed by the IHDR chunk, which starts with big-endian width and height
+        if (size < 24 || 0 != memcmp(pPayload + 12, "IHDR", 4))
+        {
+            return false;
+        }
+        width  = ((uint32_t)pPayload[16] << 24) | ((uint32_t)pPayload[17] << 16) | ((uint32_t)pPayload[18] << 8) | pPayload[19];
+        height = ((uint32_t)pPayload[20] << 24) | ((uint32_t)pPayload[21] << 16) | ((uint32_t)pPayload[22] << 8) | pPayload[23];
+        return true;
+
+    case RecordCodecRvl:
+        {
+            RvlHeader header;
+            if (size < sizeof(header))
+            {
+                return false;
+            }
+            memcpy(&header, pPayload, sizeof(header));
+            if (RVL_MAGIC != header.magic)
+            {
+                return false;
+            }
+            width  = header.width;
+            height = header.height;
+        }
+        return true;
+
+    case RecordCodecTemporalDepth:
+        {
+            TemporalDepthHeader header;
+            if (!TemporalDepthDecoder::ReadHeader(pPayload, size, header))
+            {
+                return false;
+            }
+            width  = header.width;
+            height = header.height;
+        }
+        return true;
+
+    case RecordCodecQoi:
+        return QoiGetSize(pPayload, size, width, height);
+
+    case RecordCodecJpeg:
+        return JpegGetSize(pPayload, size, width, height);
+
+    default:
+        return false;
+    }
+}
+
+/// <summary>
+/// Check whether a payload decodes without reference to earlier frames
+/// </summary>
+/// <param name="codec">Codec of the payload</param>
+/// <param name="pPayload">The pointer to payload</param>
+/// <param name="size">Size of payload in bytes</param>
+/// <returns>True for keyframes and for all payloads of intra-frame codecs</returns>
+bool IsKeyframePayload(RecordCodec codec, const uint8_t* pPayload, size_t size)
+{
+    if (RecordCodecTemporalDepth == codec)
+    {
+        TemporalDepthHeader header;
+        return TemporalDepthDecoder::ReadHeader(pPayload, size, header) && header.reference == header.sequence;
+    }
+
+    return true;
+}
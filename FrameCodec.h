@@ -0,0 +1,182 @@
+//------------------------------------------------------------------------------
+// <copyright file="FrameCodec.h">
+//     Interface of frame encoders and decoding of stored frames.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "RecordFrame.h"
+
+// Counters of an encoder over one recording session
+struct FrameEncoderStats
+{
+    uint64_t frames;
+    uint64_t keyframes;         // Frames which decode without reference to earlier frames
+    uint64_t failures;
+    uint64_t rawBytes;          // Size of the frames without row padding
+    uint64_t encodedBytes;
+    double   encodeSeconds;     // Time spent in the encoder, summed over all frames
+    double   maxEncodeSeconds;  // Longest time spent on a single frame
+    double   lastEncodeSeconds; // Time spent on the most recent frame
+    bool     lastKeyframe;      // Whether the most recent frame decodes on its own
+};
+
+/// <summary>
+/// Interface of an encoder turning recorded frames into a compressed payload.
+/// An encoder is used by one thread at a time and may keep state between frames.
+/// </summary>
+class FrameEncoder
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    FrameEncoder();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    virtual ~FrameEncoder() {}
+
+    /// <summary>
+    /// Get the codec the payloads are encoded with
+    /// </summary>
+    virtual RecordCodec GetCodec() const = 0;
+
+    /// <summary>
+    /// Get file name extension for payloads stored as separate files, e.g. ".rvl"
+    /// </summary>
+    virtual const char* GetFileExtension() const = 0;
+
+    /// <summary>
+    /// Start a new session. Clears the statistics and any state kept between frames
+    /// </summary>
+    virtual void Reset();
+
+    /// <summary>
+    /// Make the next frame a keyframe, e.g. after the payload of an earlier one could not be stored.
+    /// May be called while another thread encodes. Encoders which keep no state between frames ignore it
+    /// </summary>
+    virtual void RequestKeyframe() {}
+
+    /// <summary>
+    /// Encode a frame and account it in the statistics
+    /// </summary>
+    /// <param name="frame">Frame to encode</param>
+    /// <param name="payload">Receives the encoded payload</param>
+    /// <returns>Indicates success or failure</returns>
+    bool Encode(const RecordFrame& frame, std::vector<uint8_t>& payload);
+
+    /// <summary>
+    /// Get the statistics of the current session
+    /// </summary>
+    const FrameEncoderStats& GetStats() const { return m_stats; }
+
+protected:
+    /// <summary>
+    /// Encode a frame
+    /// </summary>
+    /// <param name="frame">Frame to encode</param>
+    /// <param name="payload">Receives the encoded payload</param>
+    /// <param name="keyframe">Receives whether the payload decodes on its own</param>
+    /// <returns>Indicates success or failure</returns>
+    virtual bool EncodeFrame(const RecordFrame& frame, std::vector<uint8_t>& payload, bool& keyframe) = 0;
+
+private:
+    FrameEncoderStats   m_stats;
+};
+
+/// <summary>
+/// Get printable name of a codec
+/// </summary>
+const char* GetCodecName(RecordCodec codec);
+
+/// <summary>
+/// Append the statistics of a finished session to session.log in the current directory
+/// </summary>
+/// <param name="stream">Stream the encoder was used for</param>
+/// <param name="encoder">Encoder of the session</param>
+void LogEncoderSession(RecordStream stream, const FrameEncoder& encoder);
+
+/// <summary>
+/// Append the statistics of a finished session to session.log in the current directory
+/// </summary>
+/// <param name="stream">Stream the frames belong to</param>
+/// <param name="codec">Codec the frames were encoded with</param>
+/// <param name="stats">Statistics of the session</param>
+void LogEncoderSession(RecordStream stream, RecordCodec codec, const FrameEncoderStats& stats);
+
+class TemporalDepthDecoder;
+
+/// <summary>
+/// Decodes the frames of one stream in recording order, keeping the reference
+/// frames needed by codecs which predict from earlier frames
+/// </summary>
+class FrameDecoder
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    FrameDecoder();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+   ~FrameDecoder();
+
+    /// <summary>
+    /// Decode the next payload of the stream
+    /// </summary>
+    /// <param name="codec">Codec of the payload</param>
+    /// <param name="pPayload">The pointer to payload</param>
+    /// <param name="size">Size of payload in bytes</param>
+    /// <param name="frame">Receives the pixels. For raw payloads format, width, height and stride must be set</param>
+    /// <returns>False if the payload is damaged or its reference frame has not been decoded</returns>
+    bool Decode(RecordCodec codec, const uint8_t* pPayload, size_t size, RecordFrame& frame);
+
+private:
+    FrameDecoder(const FrameDecoder&);
+    FrameDecoder& operator=(const FrameDecoder&);
+
+private:
+    std::unique_ptr<TemporalDepthDecoder>   m_pTemporalDepth;
+};
+
+/// <summary>
+/// Decode a stored payload into raw frame pixels. The caller fills the stream, timestamp
+/// and frame number; the pixel description comes from the payload where the codec stores it.
+/// Payloads predicted from earlier frames need a FrameDecoder.
+/// </summary>
+/// <param name="codec">Codec of the payload</param>
+/// <param name="pPayload">The pointer to payload</param>
+/// <param name="size">Size of payload in bytes</param>
+/// <param name="frame">Receives the pixels. For raw payloads format, width, height and stride must be set</param>
+/// <returns>Indicates success or failure</returns>
+bool DecodeFramePayload(RecordCodec codec, const uint8_t* pPayload, size_t size, RecordFrame& frame);
+
+/// <summary>
+/// Read the frame size from an encoded payload without decoding it
+/// </summary>
+/// <param name="codec">Codec of the payload</param>
+/// <param name="pPayload">The pointer to payload</param>
+/// <param name="size">Size of payload in bytes</param>
+/// <param name="width">Receives the frame width</param>
+/// <param name="height">Receives the frame height</param>
+/// <returns>False if the codec does not store the size or the payload is damaged</returns>
+bool GetEncodedFrameSize(RecordCodec codec, const uint8_t* pPayload, size_t size, uint32_t& width, uint32_t& height);
+
+/// <summary>
+/// Check whether a payload decodes without reference to earlier frames
+/// </summary>
+/// <param name="codec">Codec of the payload</param>
+/// <param name="pPayload">The pointer to payload</param>
+/// <param name="size">Size of payload in bytes</param>
+/// <returns>True for keyframes and for all payloads of intra-frame codecs</returns>
+bool IsKeyframePayload(RecordCodec codec, const uint8_t* pPayload, size_t size);
@@ -0,0 +1,113 @@
+//------------------------------------------------------------------------------
+// <copyright file="FrameHandle.cpp">
+//     Reference counted handle sharing one copy of a frame between its consumers.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "FrameHandle.h"
+
+/// <summary>
+/// Constructor. The handle refers to no frame
+/// </summary>
+FrameHandle::FrameHandle()
+    : m_pFrame(nullptr)
+{
+}
+
+/// <summary>
+/// Constructor. Takes a reference to a frame
+/// </summary>
+/// <param name="pFrame">Frame to refer to</param>
+FrameHandle::FrameHandle(SharedFrame* pFrame)
+    : m_pFrame(pFrame)
+{
+    if (m_pFrame)
+    {
+        m_pFrame->references.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+FrameHandle::FrameHandle(const FrameHandle& other)
+    : m_pFrame(other.m_pFrame)
+{
+    if (m_pFrame)
+    {
+        m_pFrame->references.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+FrameHandle::FrameHandle(FrameHandle&& other)
+    : m_pFrame(other.m_pFrame)
+{
+    other.m_pFrame = nullptr;
+}
+
+/// <summary>
+/// Destructor. Releases the reference
+/// </summary>
+FrameHandle::~FrameHandle()
+{
+    Reset();
+}
+
+FrameHandle& FrameHandle::operator=(const FrameHandle& other)
+{
+    if (m_pFrame != other.m_pFrame)
+    {
+        FrameHandle copy(other);
+        Reset();
+        m_pFrame      = copy.m_pFrame;
+        copy.m_pFrame = nullptr;
+    }
+
+    return *this;
+}
+
+FrameHandle& FrameHandle::operator=(FrameHandle&& other)
+{
+    if (this != &other)
+    {
+        Reset();
+        m_pFrame       = other.m_pFrame;
+        other.m_pFrame = nullptr;
+    }
+
+    return *this;
+}
+
+/// <summary>
+/// Create a frame on the heap, for frames which do not come from a pool
+/// </summary>
+/// <returns>Handle of the new frame</returns>
+FrameHandle FrameHandle::Create()
+{
+    return FrameHandle(new SharedFrame());
+}
+
+/// <summary>
+/// Release the reference. The frame is recycled when this was the last one
+/// </summary>
+void FrameHandle::Reset()
+{
+    if (!m_pFrame)
+    {
+        return;
+    }
+
+    // Acquire-release, so the reads of the other consumers are done before the frame is refilled
+    SharedFrame* pFrame = m_pFrame;
+    m_pFrame = nullptr;
+    if (1 == pFrame->references.fetch_sub(1, std::memory_order_acq_rel))
+    {
+        if (pFrame->pRecycler)
+        {
+            // The recycler may be dropped along with the reference it holds
+            std::shared_ptr<FrameRecycler> pRecycler = std::move(pFrame->pRecycler);
+            pRecycler->Recycle(pFrame);
+        }
+        else
+        {
+            delete pFrame;
+        }
+    }
+}
@@ -0,0 +1,109 @@
+//------------------------------------------------------------------------------
+// <copyright file="FrameHandle.h">
+//     Reference counted handle sharing one copy of a frame between its consumers.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "RecordFrame.h"
+
+struct SharedFrame;
+
+/// <summary>
+/// Takes back frames whose last handle has been released
+/// </summary>
+class FrameRecycler
+{
+public:
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    virtual ~FrameRecycler() {}
+
+    /// <summary>
+    /// Take back a frame no handle refers to any more. Called on the thread which released the last handle
+    /// </summary>
+    /// <param name="pFrame">The frame, the recycler takes the ownership</param>
+    virtual void Recycle(SharedFrame* pFrame) = 0;
+};
+
+/// <summary>
+/// A frame with the count of handles referring to it
+/// </summary>
+struct SharedFrame
+{
+    RecordFrame                     frame;
+    std::atomic<uint32_t>           references;
+    std::shared_ptr<FrameRecycler>  pRecycler;      // Takes the frame back, nullptr to delete it
+
+    SharedFrame()
+        : references(0)
+    {
+    }
+};
+
+/// <summary>
+/// Reference counted handle of a frame. A stream fills the frame once after acquiring it and publishes it;
+/// from then on the frame is immutable and the viewer, the recorder and any other consumer hold handles to
+/// the same pixels instead of copies. The frame goes back to its pool when the last handle is released.
+/// Copying a handle is thread safe, a single handle object is not.
+/// </summary>
+class FrameHandle
+{
+public:
+    /// <summary>
+    /// Constructor. The handle refers to no frame
+    /// </summary>
+    FrameHandle();
+
+    /// <summary>
+    /// Constructor. Takes a reference to a frame
+    /// </summary>
+    /// <param name="pFrame">Frame to refer to</param>
+    explicit FrameHandle(SharedFrame* pFrame);
+
+    FrameHandle(const FrameHandle& other);
+    FrameHandle(FrameHandle&& other);
+
+    /// <summary>
+    /// Destructor. Releases the reference
+    /// </summary>
+   ~FrameHandle();
+
+    FrameHandle& operator=(const FrameHandle& other);
+    FrameHandle& operator=(FrameHandle&& other);
+
+public:
+    /// <summary>
+    /// Create a frame on the heap, for frames which do not come from a pool
+    /// </summary>
+    /// <returns>Handle of the new frame</returns>
+    static FrameHandle Create();
+
+    const RecordFrame*  operator->() const  { return &m_pFrame->frame; }
+    const RecordFrame&  operator*() const   { return m_pFrame->frame; }
+    explicit operator bool() const          { return nullptr != m_pFrame; }
+
+    /// <summary>
+    /// Get the frame to fill it. Only allowed before the frame is published, while this is its only handle
+    /// </summary>
+    RecordFrame* GetMutable() { return &m_pFrame->frame; }
+
+    /// <summary>
+    /// Get the number of handles referring to the frame
+    /// </summary>
+    uint32_t GetReferenceCount() const { return m_pFrame ? m_pFrame->references.load() : 0; }
+
+    /// <summary>
+    /// Release the reference. The frame is recycled when this was the last one
+    /// </summary>
+    void Reset();
+
+private:
+    SharedFrame*    m_pFrame;
+};
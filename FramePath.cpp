@@ -0,0 +1,241 @@
+//------------------------------------------------------------------------------
+// <copyright file="FramePath.cpp">
+//     Allocation-free formatting of frame file names and frame list entries.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "FramePath.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+    const uint64_t PowersOfTen[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 };
+
+    // Size of the stdio buffer of a frame list, a few seconds of lines
+    const size_t ListBufferBytes = 64 * 1024;
+}
+
+/// <summary>
+/// Format an unsigned integer
+/// </summary>
+/// <param name="pBuffer">Receives the digits, not terminated. Needs 20 characters</param>
+/// <returns>Number of characters written</returns>
+size_t FormatUnsigned(char* pBuffer, uint64_t value)
+{
+    char   digits[20];
+    size_t count = 0;
+    do
+    {
+        digits[count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        pBuffer[i] = digits[count - 1 - i];
+    }
+    return count;
+}
+
+/// <summary>
+/// Format a non-negative number with a fixed number of decimals, as printf("%.*f") does,
+/// using integer arithmetic. Values must stay below 2^52
+/// </summary>
+/// <param name="pBuffer">Receives the digits, not terminated. Needs 20 + decimals characters</param>
+/// <param name="value">Number to format</param>
+/// <param name="decimals">Number of decimals, at most 9</param>
+/// <returns>Number of characters written</returns>
+size_t FormatFixed(char* pBuffer, double value, int decimals)
+{
+    decimals = decimals < 0 ? 0 : (decimals > 9 ? 9 : decimals);
+
+    if (!(value > 0))
+    {
+        value = 0;
+    }
+
+    // Splitting off the integer part is exact. The product with the scale is not, so the
+    // rounding decision is made on the exact difference to the halfway point, which fma
+    // gives with the correct sign; exact ties round to even like printf
+    uint64_t scale    = PowersOfTen[decimals];
+    uint64_t whole    = (uint64_t)value;
+    double   fraction = value - (double)whole;
+    uint64_t scaled   = (uint64_t)(fraction * scale);
+    double   above    = std::fma(fraction, (double)scale, -((double)scaled + 0.5));
+    if (above > 0 || (0 == above && ((decimals ? scaled : whole) & 1)))
+    {
+        ++scaled;
+    }
+    if (scaled >= scale)
+    {
+        ++whole;
+        scaled -= scale;
+    }
+
+    size_t length = FormatUnsigned(pBuffer, whole);
+    if (decimals)
+    {
+        pBuffer[length++] = '.';
+
+        for (int i = decimals - 1; i >= 0; i--)
+        {
+            pBuffer[length + i] = (char)('0' + scaled % 10);
+            scaled /= 10;
+        }
+        length += decimals;
+    }
+
+    return length;
+}
+
+// -----------------------------------------------------------------------------
+//
+// FramePathFormatter
+//
+// -----------------------------------------------------------------------------
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="pFolder">Folder of the files, also the prefix of their names, e.g. "rgb"</param>
+/// <param name="pExtension">File name extension including the dot, e.g. ".bmp"</param>
+/// <param name="pDirectory">Directory the folder is in, e.g. "segment_0001". nullptr for the current directory</param>
+FramePathFormatter::FramePathFormatter(const char* pFolder, const char* pExtension, const char* pDirectory)
+    : m_extension(pExtension)
+    , m_directoryLength(0)
+    , m_length(0)
+{
+    size_t directoryLength = pDirectory ? strlen(pDirectory) : 0;
+    size_t folderLength    = strlen(pFolder);
+
+    // Sized for the longest timestamp behind the prefix, so formatting never allocates
+    m_path.resize(directoryLength + 2 * folderLength + 3 + MaxFixedChars + m_extension.size() + 1);
+
+    if (directoryLength)
+    {
+        memcpy(m_path.data(), pDirectory, directoryLength);
+        m_path[directoryLength] = FRAME_PATH_SEPARATOR;
+        m_directoryLength = directoryLength + 1;
+    }
+
+    char* pPrefix = m_path.data() + m_directoryLength;
+    memcpy(pPrefix, pFolder, folderLength);
+    pPrefix[folderLength] = FRAME_PATH_SEPARATOR;
+    memcpy(pPrefix + folderLength + 1, pFolder, folderLength);
+    pPrefix[2 * folderLength + 1] = '_';
+    m_prefixLength = m_directoryLength + 2 * folderLength + 2;
+    m_path[m_prefixLength] = '\0';
+}
+
+/// <summary>
+/// Format the path of the frame with the given timestamp
+/// </summary>
+/// <returns>Zero terminated path, valid until the next call</returns>
+const char* FramePathFormatter::Format(double timestamp)
+{
+    m_length = m_prefixLength + FormatFixed(m_path.data() + m_prefixLength, timestamp, 6);
+    memcpy(m_path.data() + m_length, m_extension.data(), m_extension.size());
+    m_length += m_extension.size();
+    m_path[m_length] = '\0';
+
+    return m_path.data();
+}
+
+// -----------------------------------------------------------------------------
+//
+// FrameListFile
+//
+// -----------------------------------------------------------------------------
+
+/// <summary>
+/// Constructor
+/// </summary>
+FrameListFile::FrameListFile()
+    : m_pFile(nullptr)
+    , m_unflushed(0)
+{
+}
+
+/// <summary>
+/// Destructor. Flushes and closes the file
+/// </summary>
+FrameListFile::~FrameListFile()
+{
+    Close();
+}
+
+/// <summary>
+/// Open a list for appending
+/// </summary>
+/// <param name="pPath">Path of the list file</param>
+/// <returns>Indicates success or failure</returns>
+bool FrameListFile::Open(const char* pPath)
+{
+    Close();
+
+    m_pFile = fopen(pPath, "a");
+    if (!m_pFile)
+    {
+        return false;
+    }
+
+    setvbuf(m_pFile, nullptr, _IOFBF, ListBufferBytes);
+    return true;
+}
+
+/// <summary>
+/// Append a "[timestamp]\t[text]" line
+/// </summary>
+/// <param name="timestamp">Timestamp of the frame</param>
+/// <param name="pText">Text following the timestamp, usually the path of the frame</param>
+/// <param name="length">Length of text</param>
+void FrameListFile::Append(double timestamp, const char* pText, size_t length)
+{
+    if (m_line.size() < MaxFixedChars + length + 2)
+    {
+        m_line.resize(MaxFixedChars + length + 2);
+    }
+
+    size_t lineLength = FormatFixed(m_line.data(), timestamp, 6);
+    m_line[lineLength++] = '\t';
+    memcpy(m_line.data() + lineLength, pText, length);
+    lineLength += length;
+    m_line[lineLength++] = '\n';
+
+    AppendLine(m_line.data(), lineLength);
+}
+
+/// <summary>
+/// Append a line formatted by the caller
+/// </summary>
+/// <param name="pLine">Line including the line feed</param>
+/// <param name="length">Length of the line</param>
+void FrameListFile::AppendLine(const char* pLine, size_t length)
+{
+    if (!m_pFile)
+    {
+        return;
+    }
+
+    fwrite(pLine, 1, length, m_pFile);
+    if (++m_unflushed >= FlushInterval)
+    {
+        fflush(m_pFile);
+        m_unflushed = 0;
+    }
+}
+
+/// <summary>
+/// Flush and close the file
+/// </summary>
+void FrameListFile::Close()
+{
+    if (m_pFile)
+    {
+        fclose(m_pFile);
+        m_pFile     = nullptr;
+        m_unflushed = 0;
+    }
+}
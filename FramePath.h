@@ -0,0 +1,145 @@
+//------------------------------------------------------------------------------
+// <copyright file="FramePath.h">
+//     Allocation-free formatting of frame file names and frame list entries.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define FRAME_PATH_SEPARATOR    '\\'
+#else
+#define FRAME_PATH_SEPARATOR    '/'
+#endif
+
+/// <summary>
+/// Format a non-negative number with a fixed number of decimals, as printf("%.*f") does,
+/// using integer arithmetic. Values must stay below 2^52
+/// </summary>
+/// <param name="pBuffer">Receives the digits, not terminated. Needs 20 + decimals characters</param>
+/// <param name="value">Number to format</param>
+/// <param name="decimals">Number of decimals, at most 9</param>
+/// <returns>Number of characters written</returns>
+size_t FormatFixed(char* pBuffer, double value, int decimals);
+
+/// <summary>
+/// Format an unsigned integer
+/// </summary>
+/// <param name="pBuffer">Receives the digits, not terminated. Needs 20 characters</param>
+/// <returns>Number of characters written</returns>
+size_t FormatUnsigned(char* pBuffer, uint64_t value);
+
+// Characters FormatFixed writes at most: 20 digits, the point and 9 decimals
+const size_t MaxFixedChars = 30;
+
+/// <summary>
+/// Formats the file names of a stream, [folder]\[folder]_[timestamp][extension], into a buffer
+/// which is sized and set up once. The timestamp has the 6 decimals the frame lists have always used.
+/// Files of a segmented recording get the directory of their segment in front, which the lists leave out
+/// </summary>
+class FramePathFormatter
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="pFolder">Folder of the files, also the prefix of their names, e.g. "rgb"</param>
+    /// <param name="pExtension">File name extension including the dot, e.g. ".bmp"</param>
+    /// <param name="pDirectory">Directory the folder is in, e.g. "segment_0001". nullptr for the current directory</param>
+    FramePathFormatter(const char* pFolder, const char* pExtension, const char* pDirectory = nullptr);
+
+    /// <summary>
+    /// Format the path of the frame with the given timestamp
+    /// </summary>
+    /// <returns>Zero terminated path, valid until the next call</returns>
+    const char* Format(double timestamp);
+
+    /// <summary>
+    /// Get the last formatted path
+    /// </summary>
+    const char* GetPath() const { return m_path.data(); }
+
+    /// <summary>
+    /// Get the length of the last formatted path
+    /// </summary>
+    size_t GetLength() const { return m_length; }
+
+    /// <summary>
+    /// Get the last formatted path without the directory, relative to the directory
+    /// </summary>
+    const char* GetRelativePath() const { return m_path.data() + m_directoryLength; }
+
+    /// <summary>
+    /// Get the length of the last formatted path without the directory
+    /// </summary>
+    size_t GetRelativeLength() const { return m_length - m_directoryLength; }
+
+private:
+    std::vector<char>   m_path;
+    std::string         m_extension;
+    size_t              m_directoryLength;  // Including the separator
+    size_t              m_prefixLength;
+    size_t              m_length;
+};
+
+/// <summary>
+/// Frame list such as rgb.txt, kept open for a session. Lines are appended to a large
+/// stdio buffer and flushed in batches, so a crash loses at most the last batch
+/// </summary>
+class FrameListFile
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    FrameListFile();
+
+    /// <summary>
+    /// Destructor. Flushes and closes the file
+    /// </summary>
+   ~FrameListFile();
+
+    static const unsigned FlushInterval = 32;       // Lines per batch, about a second of frames
+
+    /// <summary>
+    /// Open a list for appending
+    /// </summary>
+    /// <param name="pPath">Path of the list file</param>
+    /// <returns>Indicates success or failure</returns>
+    bool Open(const char* pPath);
+
+    /// <summary>
+    /// Append a "[timestamp]\t[text]" line
+    /// </summary>
+    /// <param name="timestamp">Timestamp of the frame</param>
+    /// <param name="pText">Text following the timestamp, usually the path of the frame</param>
+    /// <param name="length">Length of text</param>
+    void Append(double timestamp, const char* pText, size_t length);
+
+    /// <summary>
+    /// Append a line formatted by the caller
+    /// </summary>
+    /// <param name="pLine">Line including the line feed</param>
+    /// <param name="length">Length of the line</param>
+    void AppendLine(const char* pLine, size_t length);
+
+    /// <summary>
+    /// Flush and close the file
+    /// </summary>
+    void Close();
+
+private:
+    FrameListFile(const FrameListFile&);
+    FrameListFile& operator=(const FrameListFile&);
+
+private:
+    FILE*               m_pFile;
+    unsigned            m_unflushed;
+    std::vector<char>   m_line;     // Grows to the longest line appended
+};
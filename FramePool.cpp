@@ -0,0 +1,332 @@
+//------------------------------------------------------------------------------
+// <copyright file="FramePool.cpp">
+//     Preallocated frames recycled between acquisition, display and the recorder writers.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "FramePool.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <vector>
+
+/// <summary>
+/// State of the pool, shared with the frames out so it outlives the pool while they are
+/// </summary>
+class FramePool::Store : public FrameRecycler
+{
+public:
+    struct StreamFrames
+    {
+        size_t                      frameBytes;
+        std::shared_ptr<FrameArena> pArena;
+        std::vector<SharedFrame*>   spareFrames;    // Never grows past the number of slabs
+        size_t                      maxSlabsInUse;  // Of the arenas replaced since the counters were reset
+        uint64_t                    acquisitions;
+        uint64_t                    heapFallbacks;
+        uint64_t                    geometryChanges;
+    };
+
+    /// <summary>
+    /// Constructor. Creates the frame objects of every stream up front
+    /// </summary>
+    Store(size_t slabsPerStream)
+        : largePages(false)
+        , slabCount(std::max<size_t>(1, slabsPerStream))
+    {
+        for (int i = 0; i < RecordStreamCount; i++)
+        {
+            StreamFrames& frames = streams[i];
+            frames.frameBytes = 0;
+            frames.spareFrames.reserve(slabCount);
+            while (frames.spareFrames.size() < slabCount)
+            {
+                frames.spareFrames.push_back(new SharedFrame());
+            }
+        }
+
+        ResetStats();
+    }
+
+    /// <summary>
+    /// Destructor. Deletes the spare frame objects
+    /// </summary>
+    virtual ~Store()
+    {
+        for (int i = 0; i < RecordStreamCount; i++)
+        {
+            for (SharedFrame* pFrame : streams[i].spareFrames)
+            {
+                delete pFrame;
+            }
+        }
+    }
+
+    /// <summary>
+    /// Take back a frame no handle refers to any more
+    /// </summary>
+    virtual void Recycle(SharedFrame* pFrame)
+    {
+        RecordStream stream = pFrame->frame.stream;
+        pFrame->frame.data.Free();
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+
+            // Frame objects created beyond the arena are let go
+            std::vector<SharedFrame*>& spareFrames = streams[stream].spareFrames;
+            if (spareFrames.size() < slabCount)
+            {
+                spareFrames.push_back(pFrame);
+                return;
+            }
+        }
+
+        delete pFrame;
+    }
+
+    /// <summary>
+    /// Lay out the arena of a stream for its frame size. Called with the lock held
+    /// </summary>
+    void LayOut(StreamFrames& frames)
+    {
+        if (frames.pArena)
+        {
+            if (frames.pArena->GetSlabBytes() == frames.frameBytes)
+            {
+                return;
+            }
+
+            frames.maxSlabsInUse = std::max(frames.maxSlabsInUse, frames.pArena->GetStats().maxSlabsInUse);
+            ++frames.geometryChanges;
+        }
+
+        // Null if the frame size is not known yet or the memory is not available, frames then come from the heap
+        frames.pArena = FrameArena::Create(frames.frameBytes, slabCount, largePages);
+    }
+
+    /// <summary>
+    /// Zero the counters. Called with the lock held
+    /// </summary>
+    void ResetStats()
+    {
+        for (int i = 0; i < RecordStreamCount; i++)
+        {
+            StreamFrames& frames   = streams[i];
+            frames.maxSlabsInUse   = 0;
+            frames.acquisitions    = 0;
+            frames.heapFallbacks   = 0;
+            frames.geometryChanges = 0;
+
+            if (frames.pArena)
+            {
+                frames.pArena->ResetHighWaterMark();
+            }
+        }
+    }
+
+    /// <summary>
+    /// Get the counters of a stream. Called with the lock held
+    /// </summary>
+    FramePoolStats CollectStats(const StreamFrames& frames) const
+    {
+        FramePoolStats stats;
+        memset(&stats, 0, sizeof(stats));
+        stats.maxSlabsInUse   = frames.maxSlabsInUse;
+        stats.acquisitions    = frames.acquisitions;
+        stats.heapFallbacks   = frames.heapFallbacks;
+        stats.geometryChanges = frames.geometryChanges;
+
+        if (frames.pArena)
+        {
+            FrameArenaStats arena = frames.pArena->GetStats();
+            stats.slabBytes     = arena.slabBytes;
+            stats.slabCount     = arena.slabCount;
+            stats.slabsInUse    = arena.slabsInUse;
+            stats.maxSlabsInUse = std::max(stats.maxSlabsInUse, arena.maxSlabsInUse);
+            stats.largePages    = arena.largePages;
+        }
+
+        return stats;
+    }
+
+public:
+    mutable std::mutex  lock;
+    bool                largePages;
+    size_t              slabCount;
+    StreamFrames        streams[RecordStreamCount];
+};
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="slabCount">Number of frames per stream</param>
+FramePool::FramePool(size_t slabCount)
+    : m_pStore(std::make_shared<Store>(slabCount))
+{
+}
+
+/// <summary>
+/// Destructor. Frames still out keep their arenas alive until they are released
+/// </summary>
+FramePool::~FramePool()
+{
+}
+
+/// <summary>
+/// Choose whether arenas are allocated with large pages. Lays out the arenas again
+/// </summary>
+/// <param name="largePages">True to try large pages, falling back to normal pages</param>
+void FramePool::SetLargePages(bool largePages)
+{
+    std::lock_guard<std::mutex> lock(m_pStore->lock);
+
+    if (m_pStore->largePages == largePages)
+    {
+        return;
+    }
+
+    m_pStore->largePages = largePages;
+    for (int i = 0; i < RecordStreamCount; i++)
+    {
+        Store::StreamFrames& frames = m_pStore->streams[i];
+        if (frames.pArena)
+        {
+            frames.maxSlabsInUse = std::max(frames.maxSlabsInUse, frames.pArena->GetStats().maxSlabsInUse);
+            frames.pArena.reset();
+            m_pStore->LayOut(frames);
+        }
+    }
+}
+
+/// <summary>
+/// Set the frame size of a stream and lay out its arena. Called when the stream is opened
+/// </summary>
+/// <param name="stream">Stream to set</param>
+/// <param name="frameBytes">Bytes of pixel data per frame</param>
+void FramePool::SetFrameSize(RecordStream stream, size_t frameBytes)
+{
+    std::lock_guard<std::mutex> lock(m_pStore->lock);
+
+    Store::StreamFrames& frames = m_pStore->streams[stream];
+    frames.frameBytes = frameBytes;
+    m_pStore->LayOut(frames);
+}
+
+/// <summary>
+/// Get a frame with room for the pixel data of a frame of the stream. Its other fields are left to the caller
+/// </summary>
+/// <param name="stream">Stream the frame belongs to</param>
+/// <param name="frameBytes">Bytes of pixel data the frame will carry</param>
+/// <returns>Only handle of the frame, with an empty buffer backed by a slab if one is free</returns>
+FrameHandle FramePool::Acquire(RecordStream stream, size_t frameBytes)
+{
+    std::lock_guard<std::mutex> lock(m_pStore->lock);
+
+    Store::StreamFrames& frames = m_pStore->streams[stream];
+
+    SharedFrame* pFrame;
+    if (!frames.spareFrames.empty())
+    {
+        pFrame = frames.spareFrames.back();
+        frames.spareFrames.pop_back();
+    }
+    else
+    {
+        pFrame = new SharedFrame();
+    }
+    pFrame->pRecycler    = m_pStore;
+    pFrame->frame.stream = stream;
+
+    if (frames.frameBytes != frameBytes)
+    {
+        // The stream changed geometry without being opened again, e.g. a different row pitch
+        frames.frameBytes = frameBytes;
+        m_pStore->LayOut(frames);
+    }
+
+    ++frames.acquisitions;
+    if (!frames.pArena || !frames.pArena->Attach(pFrame->frame.data))
+    {
+        // Consumers hold on to more frames than the arena covers
+        ++frames.heapFallbacks;
+    }
+
+    return FrameHandle(pFrame);
+}
+
+/// <summary>
+/// Get a snapshot of the counters of a stream
+/// </summary>
+/// <param name="stream">Stream to query</param>
+/// <returns>Counters of the stream</returns>
+FramePoolStats FramePool::GetStats(RecordStream stream) const
+{
+    std::lock_guard<std::mutex> lock(m_pStore->lock);
+    return m_pStore->CollectStats(m_pStore->streams[stream]);
+}
+
+/// <summary>
+/// Start counting anew, at the start of a recording session
+/// </summary>
+void FramePool::ResetStats()
+{
+    std::lock_guard<std::mutex> lock(m_pStore->lock);
+    m_pStore->ResetStats();
+}
+
+/// <summary>
+/// Append the counters to session.log in the current directory
+/// </summary>
+void FramePool::LogSession() const
+{
+    FramePoolStats stats[RecordStreamCount];
+    {
+        std::lock_guard<std::mutex> lock(m_pStore->lock);
+        for (int i = 0; i < RecordStreamCount; i++)
+        {
+            stats[i] = m_pStore->CollectStats(m_pStore->streams[i]);
+        }
+    }
+
+    if (0 == stats[RecordStreamColor].acquisitions + stats[RecordStreamDepth].acquisitions)
+    {
+        return;
+    }
+
+    FILE* pLog = fopen("session.log", "a");
+    if (!pLog)
+    {
+        return;
+    }
+
+    char   timeText[32];
+    time_t now = time(nullptr);
+    tm     local;
+#ifdef _WIN32
+    localtime_s(&local, &now);
+#else
+    localtime_r(&now, &local);
+#endif
+    strftime(timeText, sizeof(timeText), "%Y-%m-%d %H:%M:%S", &local);
+
+    for (int i = 0; i < RecordStreamCount; i++)
+    {
+        if (0 == stats[i].acquisitions)
+        {
+            continue;
+        }
+
+        fprintf(pLog, "%s %s frame pool: %llu slabs of %.1f KB (%s pages), peak %llu in use, "
+            "%llu of %llu frames on the heap, %llu geometry changes\n",
+            timeText, RecordStreamColor == i ? "color" : "depth",
+            (unsigned long long)stats[i].slabCount, stats[i].slabBytes / 1024.0, stats[i].largePages ? "large" : "normal",
+            (unsigned long long)stats[i].maxSlabsInUse, (unsigned long long)stats[i].heapFallbacks,
+            (unsigned long long)stats[i].acquisitions, (unsigned long long)stats[i].geometryChanges);
+    }
+
+    fclose(pLog);
+}
@@ -0,0 +1,98 @@
+//------------------------------------------------------------------------------
+// <copyright file="FramePool.h">
+//     Preallocated frames recycled between acquisition, display and the recorder writers.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <memory>
+
+#include "FrameBuffer.h"
+#include "FrameHandle.h"
+#include "RecordFrame.h"
+
+// Counters of the frames of one stream
+struct FramePoolStats
+{
+    size_t   slabBytes;         // Frame size the arena is laid out for, 0 if there is none
+    size_t   slabCount;
+    size_t   slabsInUse;
+    size_t   maxSlabsInUse;     // High-water mark since the counters were reset
+    uint64_t acquisitions;
+    uint64_t heapFallbacks;     // Frames which got memory on the heap because every slab was in use
+    uint64_t geometryChanges;   // Arenas laid out again for a new frame size
+    bool     largePages;
+};
+
+/// <summary>
+/// Hands out frames whose pixels live in an arena per stream, laid out for the frame size of the stream
+/// when it is opened. A frame goes back to the pool when its last handle is released, on whichever thread
+/// that happens, so streaming and recording do not touch the heap once the arenas are set up. A frame size
+/// change lays out a new arena once, the old one goes away with its last frame.
+/// </summary>
+class FramePool
+{
+public:
+    static const size_t DefaultSlabCount = 24;  // A full recorder queue, frames held by the associator and the viewer
+
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="slabCount">Number of frames per stream</param>
+    FramePool(size_t slabCount = DefaultSlabCount);
+
+    /// <summary>
+    /// Destructor. Frames still out keep their arenas alive until they are released
+    /// </summary>
+   ~FramePool();
+
+public:
+    /// <summary>
+    /// Choose whether arenas are allocated with large pages. Lays out the arenas again
+    /// </summary>
+    /// <param name="largePages">True to try large pages, falling back to normal pages</param>
+    void SetLargePages(bool largePages);
+
+    /// <summary>
+    /// Set the frame size of a stream and lay out its arena. Called when the stream is opened
+    /// </summary>
+    /// <param name="stream">Stream to set</param>
+    /// <param name="frameBytes">Bytes of pixel data per frame</param>
+    void SetFrameSize(RecordStream stream, size_t frameBytes);
+
+    /// <summary>
+    /// Get a frame with room for the pixel data of a frame of the stream. Its other fields are left to the caller
+    /// </summary>
+    /// <param name="stream">Stream the frame belongs to</param>
+    /// <param name="frameBytes">Bytes of pixel data the frame will carry</param>
+    /// <returns>Only handle of the frame, with an empty buffer backed by a slab if one is free</returns>
+    FrameHandle Acquire(RecordStream stream, size_t frameBytes);
+
+    /// <summary>
+    /// Get a snapshot of the counters of a stream
+    /// </summary>
+    /// <param name="stream">Stream to query</param>
+    /// <returns>Counters of the stream</returns>
+    FramePoolStats GetStats(RecordStream stream) const;
+
+    /// <summary>
+    /// Start counting anew, at the start of a recording session
+    /// </summary>
+    void ResetStats();
+
+    /// <summary>
+    /// Append the counters to session.log in the current directory
+    /// </summary>
+    void LogSession() const;
+
+private:
+    FramePool(const FramePool&);
+    FramePool& operator=(const FramePool&);
+
+private:
+    class Store;
+
+    // Outlives the pool while frames are out
+    std::shared_ptr<Store>  m_pStore;
+};
@@ -0,0 +1,610 @@
+//------------------------------------------------------------------------------
+// <copyright file="FrameRecorder.cpp">
+//     Asynchronous recorder decoupling frame acquisition from disk writes.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "FrameRecorder.h"
+#include "RecordingSegments.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+namespace
+{
+    const char* const DropPolicyNames[] = { "block", "drop newest", "drop oldest", "drop color first" };
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="pool">Pool running the stages, must outlive the recorder</param>
+/// <param name="queueCapacity">Maximum number of frames buffered per stream</param>
+FrameRecorder::FrameRecorder(TaskPool& pool, size_t queueCapacity)
+    : m_pool(pool)
+    , m_queueCapacity(std::max<size_t>(1, queueCapacity))
+    , m_stopping(false)
+    , m_associating(false)
+    , m_dropPolicy(RecordDropPolicyBlock)
+    , m_droppedListPath("dropped.txt")
+    , m_pFramePool(nullptr)
+    , m_submissions(0)
+{
+    for (int i = 0; i < RecordStreamCount; i++)
+    {
+        m_channels[i].running = false;
+        memset(&m_channels[i].stats, 0, sizeof(FrameRecorderStats));
+    }
+}
+
+/// <summary>
+/// Destructor. Stops the recorder and writes out all pending frames
+/// </summary>
+FrameRecorder::~FrameRecorder()
+{
+    Stop();
+}
+
+/// <summary>
+/// Attach a writer to a stream. The recorder takes the ownership of the writer.
+/// Must be called while the recorder is stopped.
+/// </summary>
+/// <param name="stream">Stream the writer stores</param>
+/// <param name="pWriter">The pointer to writer object. nullptr to stop recording the stream</param>
+void FrameRecorder::SetWriter(RecordStream stream, FrameWriter* pWriter)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    StreamChannel& channel = m_channels[stream];
+    if (!channel.running)
+    {
+        channel.writer.reset(pWriter);
+    }
+}
+
+/// <summary>
+/// Attach an associator pairing the depth frames with color frames. It is used while both
+/// streams are recorded. The recorder takes the ownership of the associator.
+/// Must be called while the recorder is stopped.
+/// </summary>
+/// <param name="pAssociator">The pointer to associator object. nullptr to record the streams independently</param>
+void FrameRecorder::SetAssociator(FrameAssociator* pAssociator)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    if (!m_associating)
+    {
+        m_pAssociator.reset(pAssociator);
+    }
+}
+
+/// <summary>
+/// Attach the pool the recorded frames come from, so its counters are logged per session.
+/// Must be called while the recorder is stopped.
+/// </summary>
+/// <param name="pFramePool">The pointer to pool object, not owned. nullptr to log nothing</param>
+void FrameRecorder::SetFramePool(FramePool* pFramePool)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_pFramePool = pFramePool;
+}
+
+/// <summary>
+/// Select what happens to frames while the queue of their stream is full. Takes effect with the next frame
+/// </summary>
+/// <param name="policy">Drop policy</param>
+void FrameRecorder::SetDropPolicy(RecordDropPolicy policy)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_dropPolicy = policy;
+}
+
+/// <summary>
+/// Set the path of the list of dropped frames, dropped.txt in the current directory unless set.
+/// Must be called while the recorder is stopped.
+/// </summary>
+/// <param name="pPath">Path of the list, nullptr to only count dropped frames</param>
+void FrameRecorder::SetDroppedListPath(const char* pPath)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_droppedListPath = pPath ? pPath : "";
+}
+
+/// <summary>
+/// Split the recording into segments. Frames are assigned to segments as they are submitted, the writers
+/// are expected to be SegmentedFrameWriters sharing the segmenter. Must be called while the recorder is stopped.
+/// </summary>
+/// <param name="pSegmenter">Segmenter, nullptr to record in one piece</param>
+void FrameRecorder::SetSegmenter(const std::shared_ptr<RecordingSegmenter>& pSegmenter)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_pSegmenter = pSegmenter;
+}
+
+/// <summary>
+/// Open writers and start the pipeline of every stream which has a writer
+/// </summary>
+/// <returns>Indicates success or failure</returns>
+bool FrameRecorder::Start()
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    // A submission may still be in the pipeline it found, which is rebuilt below
+    m_submissionsDone.wait(lock, [this]() { return 0 == m_submissions; });
+
+    m_stopping = false;
+
+    // Opened whatever the policy, as it may be switched during the session
+    if (!m_droppedListPath.empty())
+    {
+        m_droppedList.Open(m_droppedListPath.c_str());
+    }
+
+    if (m_pFramePool)
+    {
+        m_pFramePool->ResetStats();
+    }
+    m_pool.ResetStats();
+
+    // The writers open the first segment
+    if (m_pSegmenter)
+    {
+        m_pSegmenter->Start();
+    }
+
+    bool result = true;
+    for (int i = 0; i < RecordStreamCount; i++)
+    {
+        StreamChannel& channel = m_channels[i];
+        if (channel.running || !channel.writer)
+        {
+            continue;
+        }
+
+        if (!channel.writer->Open())
+        {
+            result = false;
+            continue;
+        }
+
+        CreatePipeline(channel);
+        channel.pipeline->Start();
+        channel.running = true;
+        memset(&channel.stats, 0, sizeof(FrameRecorderStats));
+    }
+
+    StreamChannel& color = m_channels[RecordStreamColor];
+    StreamChannel& depth = m_channels[RecordStreamDepth];
+    if (m_pAssociator && !m_associating && color.running && depth.running)
+    {
+        m_associating = m_pAssociator->Open(color.writer->GetFileExtension(), depth.writer->GetFileExtension(), m_pSegmenter.get());
+        result = result && m_associating;
+    }
+
+    return result;
+}
+
+/// <summary>
+/// Write out all queued frames, stop the pipelines and close writers
+/// </summary>
+void FrameRecorder::Stop()
+{
+    bool associating;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_stopping  = true;
+        associating = m_associating;
+    }
+
+    if (associating)
+    {
+        // Waits for a submission still queueing the frames it released, so the streams stay in order.
+        // Frames held back by the associator are queued after them
+        std::lock_guard<std::mutex> submitLock(m_submitLock);
+        FrameAssociator::FrameList released;
+        m_pAssociator->Close(released);
+
+        for (FrameHandle& frame : released)
+        {
+            QueueFrame(std::move(frame));
+        }
+
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_associating = false;
+    }
+
+    for (int i = 0; i < RecordStreamCount; i++)
+    {
+        // Runs the queued frames through the remaining stages, and turns away submissions waiting for room
+        if (m_channels[i].running)
+        {
+            m_channels[i].pipeline->Stop();
+        }
+    }
+
+    {
+        // Submissions which got past the check for m_stopping finish before the session is logged,
+        // so the frames they drop are counted in it and not in the next one
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_submissionsDone.wait(lock, [this]() { return 0 == m_submissions; });
+    }
+
+    bool logging = false;
+    for (int i = 0; i < RecordStreamCount; i++)
+    {
+        StreamChannel& channel = m_channels[i];
+        if (!channel.running)
+        {
+            continue;
+        }
+
+        channel.writer->Close();
+        channel.pipeline->LogSession((RecordStreamColor == i) ? "color" : "depth");
+        logging = true;
+    }
+
+    if (logging && m_pSegmenter)
+    {
+        // Every writer has closed its segments
+        m_pSegmenter->Stop();
+    }
+
+    if (logging)
+    {
+        // Still marked running, so the streams of the session are logged
+        LogSession();
+        m_pool.LogSession();
+        if (m_pFramePool)
+        {
+            m_pFramePool->LogSession();
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    for (int i = 0; i < RecordStreamCount; i++)
+    {
+        m_channels[i].running = false;
+    }
+    m_droppedList.Close();
+}
+
+/// <summary>
+/// Check if frames of a stream are being recorded
+/// </summary>
+/// <param name="stream">Stream to check</param>
+/// <returns>True if the stream has a running writer</returns>
+bool FrameRecorder::IsRecording(RecordStream stream) const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_channels[stream].running && !m_stopping;
+}
+
+/// <summary>
+/// Queue a frame for writing. While the queue of the stream is full, blocks or drops frames as the drop policy says
+/// </summary>
+/// <param name="frame">Frame to write. The recorder holds a reference until it is written</param>
+/// <returns>True if the frame has been queued, false if it has been dropped or the recorder is stopped</returns>
+bool FrameRecorder::SubmitFrame(FrameHandle frame)
+{
+    if (!frame || frame->stream < 0 || frame->stream >= RecordStreamCount)
+    {
+        return false;
+    }
+
+    bool                    associating;
+    Pipeline<RecordJob>*    pDepthPipeline;
+    RecordDropPolicy        policy;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_stopping || !m_channels[frame->stream].running)
+        {
+            return false;
+        }
+        associating    = m_associating;
+        pDepthPipeline = m_channels[RecordStreamDepth].running ? m_channels[RecordStreamDepth].pipeline.get() : nullptr;
+        policy         = m_dropPolicy;
+
+        // Stop and Start wait for the submission, so the pipelines stay in place until it has finished
+        ++m_submissions;
+    }
+
+    bool queued = AdmitAndQueueFrame(std::move(frame), policy, associating, pDepthPipeline);
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (0 == --m_submissions)
+    {
+        m_submissionsDone.notify_all();
+    }
+    return queued;
+}
+
+/// <summary>
+/// Run a submitted frame through the drop policy and the associator, and queue it
+/// </summary>
+/// <param name="frame">Frame to write</param>
+/// <param name="policy">Drop policy</param>
+/// <param name="associating">True if the frame goes through the associator</param>
+/// <param name="pDepthPipeline">Pipeline of the depth stream, nullptr unless depth frames are recorded</param>
+/// <returns>True if the frame has been queued, false if it has been dropped</returns>
+bool FrameRecorder::AdmitAndQueueFrame(FrameHandle frame, RecordDropPolicy policy, bool associating, Pipeline<RecordJob>* pDepthPipeline)
+{
+    // Decided before the associator sees the frame, so associations.txt only pairs frames which are recorded
+    FrameHandle evicted;
+    bool admitted = AdmitFrame(*frame, policy, associating, pDepthPipeline, evicted);
+    if (evicted)
+    {
+        DropFrame(*evicted);
+        evicted.Reset();
+    }
+
+    if (!admitted)
+    {
+        DropFrame(*frame);
+        return false;
+    }
+
+    // Set while stopped only, the frame's segment is looked up again from its capture time further on
+    if (m_pSegmenter)
+    {
+        m_pSegmenter->AssignFrame(*frame);
+    }
+
+    if (associating)
+    {
+        // Pairing is decided outside of the recorder lock. Submissions are serialized until the
+        // released frames are queued, so frames of a stream stay in order
+        std::lock_guard<std::mutex> submitLock(m_submitLock);
+        {
+            // The associator may have been closed by Stop meanwhile
+            std::unique_lock<std::mutex> lock(m_lock);
+            if (m_stopping)
+            {
+                lock.unlock();
+                DropFrame(*frame);
+                return false;
+            }
+        }
+
+        FrameAssociator::FrameList released;
+        m_pAssociator->Add(std::move(frame), released);
+
+        bool queued = true;
+        for (FrameHandle& releasedFrame : released)
+        {
+            queued = QueueFrame(std::move(releasedFrame)) && queued;
+        }
+        return queued;
+    }
+
+    return QueueFrame(std::move(frame));
+}
+
+/// <summary>
+/// Get a snapshot of the counters of a stream
+/// </summary>
+/// <param name="stream">Stream to query</param>
+/// <returns>Counters of the stream</returns>
+FrameRecorderStats FrameRecorder::GetStats(RecordStream stream) const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    const StreamChannel& channel = m_channels[stream];
+    FrameRecorderStats stats = channel.stats;
+    if (channel.pipeline)
+    {
+        PipelineStats pipelineStats = channel.pipeline->GetStats();
+        stats.submitStalls  = pipelineStats.stalls;
+        stats.queueDepth    = pipelineStats.inFlight;
+        stats.maxQueueDepth = pipelineStats.maxInFlight;
+    }
+    return stats;
+}
+
+/// <summary>
+/// Build the pipeline of a stream for the writer attached to it
+/// </summary>
+/// <param name="channel">Channel of the stream</param>
+void FrameRecorder::CreatePipeline(StreamChannel& channel)
+{
+    channel.pipeline.reset(new Pipeline<RecordJob>(m_pool));
+
+    unsigned concurrency = channel.writer->GetEncodeConcurrency();
+    if (0 == concurrency)
+    {
+        // The writer encodes and stores in one go, frames wait in front of it
+        channel.pipeline->AddStage("write", 1, m_queueCapacity,
+            [this, &channel](RecordJob& job) { WriteStage(channel, job); });
+        return;
+    }
+
+    // Frames wait in front of the encoders. Once encoded, one is written while the next waits its turn
+    channel.pipeline->AddStage("encode", concurrency, m_queueCapacity,
+        [&channel](RecordJob& job) { job.failed = !channel.writer->EncodeFrame(*job.frame, job.encoded); });
+    channel.pipeline->AddStage("write", 1, 2,
+        [this, &channel](RecordJob& job) { WriteStage(channel, job); });
+}
+
+/// <summary>
+/// Write stage of a stream: store the frame and count it
+/// </summary>
+/// <param name="channel">Channel of the stream</param>
+/// <param name="job">Frame to store, released afterwards</param>
+void FrameRecorder::WriteStage(StreamChannel& channel, RecordJob& job)
+{
+    bool written;
+    if (job.failed)
+    {
+        written = false;
+    }
+    else if (channel.writer->GetEncodeConcurrency())
+    {
+        written = channel.writer->StoreFrame(*job.frame, job.encoded);
+    }
+    else
+    {
+        written = channel.writer->WriteFrame(*job.frame);
+    }
+
+    // Back to the frame pool; the payload buffer stays with the job for the next frame
+    job.frame.Reset();
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (written)
+    {
+        ++channel.stats.framesWritten;
+    }
+    else
+    {
+        ++channel.stats.writeFailures;
+    }
+}
+
+/// <summary>
+/// Decide whether a frame is queued under a drop policy, making room for it if the policy drops older frames
+/// </summary>
+/// <param name="frame">Frame being submitted</param>
+/// <param name="policy">Drop policy</param>
+/// <param name="associating">True if the frame goes through the associator</param>
+/// <param name="pDepthPipeline">Pipeline of the depth stream, nullptr unless depth frames are recorded</param>
+/// <param name="evicted">Receives a queued frame taken out to make room</param>
+/// <returns>True to queue the frame, false to drop it</returns>
+bool FrameRecorder::AdmitFrame(const RecordFrame& frame, RecordDropPolicy policy, bool associating, Pipeline<RecordJob>* pDepthPipeline, FrameHandle& evicted)
+{
+    Pipeline<RecordJob>& pipeline = *m_channels[frame.stream].pipeline;
+
+    switch (policy)
+    {
+    case RecordDropPolicyNewest:
+        return pipeline.HasRoomFor(1);
+
+    case RecordDropPolicyOldest:
+        if (associating)
+        {
+            // Queued frames have been paired already, dropping them would leave pairs in associations.txt
+            // without their frames. The frame which has not been paired yet gives way instead
+            return pipeline.HasRoomFor(1);
+        }
+
+        if (!pipeline.HasRoomFor(1))
+        {
+            // If every queued frame is being encoded already, the frame waits for the first of them
+            RecordJob job;
+            job.encoded.keyframe = false;
+            job.failed           = false;
+            if (pipeline.EvictOldest(job))
+            {
+                evicted = std::move(job.frame);
+            }
+        }
+        return true;
+
+    case RecordDropPolicyColorFirst:
+        if (RecordStreamColor != frame.stream)
+        {
+            return true;
+        }
+
+        // Color frames are the larger ones, they give way while depth frames fill more than half of their queue
+        return pipeline.HasRoomFor(1) && (!pDepthPipeline || pDepthPipeline->HasRoomFor(m_queueCapacity / 2));
+
+    default:
+        return true;
+    }
+}
+
+/// <summary>
+/// Count a dropped frame and list it in dropped.txt
+/// </summary>
+/// <param name="frame">Frame dropped</param>
+void FrameRecorder::DropFrame(const RecordFrame& frame)
+{
+    // "[timestamp]\t[rgb|depth]\t[frame number]", the streams named after their frame lists
+    const char* pName = (RecordStreamColor == frame.stream) ? "rgb" : "depth";
+    char   text[32];
+    size_t length = strlen(pName);
+    memcpy(text, pName, length);
+    text[length++] = '\t';
+    length += FormatUnsigned(text + length, frame.frameNumber);
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    StreamChannel& channel = m_channels[frame.stream];
+    ++channel.stats.framesDropped;
+    channel.stats.lastDroppedFrame = frame.frameNumber;
+    m_droppedList.Append(frame.timestamp, text, length);
+}
+
+/// <summary>
+/// Submit a frame to the pipeline of its stream. Blocks while the pipeline is full
+/// </summary>
+/// <param name="frame">Frame to write</param>
+/// <returns>True if the frame has been queued, false if it has been dropped as the recorder stopped</returns>
+bool FrameRecorder::QueueFrame(FrameHandle frame)
+{
+    StreamChannel& channel = m_channels[frame->stream];
+
+    // The pipeline turns the frame away once it has been stopped, which a submission racing Stop
+    // may find. The frame was admitted, so it is counted as dropped rather than released unseen
+    bool queued = channel.pipeline && channel.pipeline->Submit([&](RecordJob& job)
+    {
+        job.frame            = std::move(frame);
+        job.encoded.keyframe = false;
+        job.failed           = false;
+    });
+
+    if (!queued)
+    {
+        DropFrame(*frame);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    ++channel.stats.framesSubmitted;
+    return true;
+}
+
+/// <summary>
+/// Append the counters of every recorded stream to session.log in the current directory
+/// </summary>
+void FrameRecorder::LogSession() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    FILE* pLog = fopen("session.log", "a");
+    if (!pLog)
+    {
+        return;
+    }
+
+    char   timeText[32];
+    time_t now = time(nullptr);
+    tm     local;
+#ifdef _WIN32
+    localtime_s(&local, &now);
+#else
+    localtime_r(&now, &local);
+#endif
+    strftime(timeText, sizeof(timeText), "%Y-%m-%d %H:%M:%S", &local);
+
+    for (int i = 0; i < RecordStreamCount; i++)
+    {
+        const StreamChannel& channel = m_channels[i];
+        if (!channel.running)
+        {
+            continue;
+        }
+
+        const FrameRecorderStats& stats = channel.stats;
+        fprintf(pLog, "%s %s recording: %llu frames written, %llu failed, %llu dropped under the %s policy",
+            timeText, (RecordStreamColor == i) ? "color" : "depth", (unsigned long long)stats.framesWritten,
+            (unsigned long long)stats.writeFailures, (unsigned long long)stats.framesDropped, DropPolicyNames[m_dropPolicy]);
+        if (stats.framesDropped)
+        {
+            fprintf(pLog, ", last one frame %u", stats.lastDroppedFrame);
+        }
+        fprintf(pLog, "\n");
+    }
+
+    fclose(pLog);
+}
@@ -0,0 +1,311 @@
+//------------------------------------------------------------------------------
+// <copyright file="FrameRecorder.h">
+//     Asynchronous recorder decoupling frame acquisition from disk writes.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "FrameAssociator.h"
+#include "FrameHandle.h"
+#include "FramePath.h"
+#include "FramePool.h"
+#include "Pipeline.h"
+#include "RecordFrame.h"
+#include "TaskPool.h"
+
+class RecordingSegmenter;
+
+// Frame encoded by the encode stage of the recorder, handed to the write stage
+struct EncodedFrame
+{
+    std::vector<uint8_t>    payload;
+    double                  encodeSeconds;
+    bool                    keyframe;       // Decodes without the payloads before it
+};
+
+/// <summary>
+/// Interface of a sink which encodes and stores recorded frames.
+/// Writers which only implement WriteFrame get one frame at a time, in order. Writers which split the
+/// work into EncodeFrame and StoreFrame get up to GetEncodeConcurrency frames encoded at the same time,
+/// while the frames before them are stored one at a time, in order.
+/// </summary>
+class FrameWriter
+{
+public:
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    virtual ~FrameWriter() {}
+
+    /// <summary>
+    /// Prepare the writer for a new recording session
+    /// </summary>
+    /// <returns>Indicates success or failure</returns>
+    virtual bool Open() { return true; }
+
+    /// <summary>
+    /// Encode and store a frame
+    /// </summary>
+    /// <param name="frame">Frame to write</param>
+    /// <returns>Indicates success or failure</returns>
+    virtual bool WriteFrame(const RecordFrame& frame) = 0;
+
+    /// <summary>
+    /// Get the number of frames EncodeFrame may run on at the same time
+    /// </summary>
+    /// <returns>0 if frames are encoded and stored by WriteFrame</returns>
+    virtual unsigned GetEncodeConcurrency() const { return 0; }
+
+    /// <summary>
+    /// Encode a frame ahead of StoreFrame. Only called if GetEncodeConcurrency is not 0
+    /// </summary>
+    /// <param name="frame">Frame to encode</param>
+    /// <param name="encoded">Receives the payload, which may hold the one of an earlier frame</param>
+    /// <returns>Indicates success or failure</returns>
+    virtual bool EncodeFrame(const RecordFrame& /*frame*/, EncodedFrame& /*encoded*/) { return false; }
+
+    /// <summary>
+    /// Store a frame encoded by EncodeFrame
+    /// </summary>
+    /// <param name="frame">Frame to store</param>
+    /// <param name="encoded">Payload of the frame</param>
+    /// <returns>Indicates success or failure</returns>
+    virtual bool StoreFrame(const RecordFrame& /*frame*/, const EncodedFrame& /*encoded*/) { return false; }
+
+    /// <summary>
+    /// Get file name extension of frames stored as separate files
+    /// </summary>
+    /// <returns>Extension including the dot, nullptr if frames are not stored as separate files</returns>
+    virtual const char* GetFileExtension() const { return nullptr; }
+
+    /// <summary>
+    /// Flush and close everything opened for the session
+    /// </summary>
+    virtual void Close() {}
+
+    /// <summary>
+    /// Close a session no frame was written in and remove what Open created for it
+    /// </summary>
+    virtual void Discard() { Close(); }
+};
+
+// What the recorder does with frames while the queue of their stream is full, e.g. while the disk falls behind
+enum RecordDropPolicy
+{
+    RecordDropPolicyBlock = 0,      // Wait for room. Nothing is lost, but acquisition stalls along with the disk
+    RecordDropPolicyNewest,         // Drop the frame being submitted
+    RecordDropPolicyOldest,         // Drop the oldest frame not being encoded yet to make room for the new one
+    RecordDropPolicyColorFirst,     // Drop color frames once depth frames start to queue up, depth frames wait
+};
+
+// Counters describing the state of one recorded stream during a session
+struct FrameRecorderStats
+{
+    uint64_t framesSubmitted;   // Frames queued, including those evicted again to make room
+    uint64_t framesWritten;
+    uint64_t writeFailures;
+    uint64_t framesDropped;     // Frames turned away or evicted by the drop policy, or turned away by Stop
+    uint32_t lastDroppedFrame;  // Sensor frame number of the latest dropped frame
+    uint64_t submitStalls;      // Number of submissions which had to wait for a free queue slot
+    size_t   queueDepth;        // Frames submitted and not written yet
+    size_t   maxQueueDepth;
+};
+
+/// <summary>
+/// Records the streams through one pipeline per stream on a pool shared with the other streams: an encode
+/// stage running as many frames as the writer allows, and a write stage storing them one at a time in order.
+/// When a queue fills up the drop policy decides which frames give way; dropped frames are counted and
+/// listed in dropped.txt by their sensor frame number, so gaps in a recording can be told from sensor drops.
+/// </summary>
+class FrameRecorder
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="pool">Pool running the stages, must outlive the recorder</param>
+    /// <param name="queueCapacity">Maximum number of frames buffered per stream</param>
+    FrameRecorder(TaskPool& pool, size_t queueCapacity = DefaultQueueCapacity);
+
+    /// <summary>
+    /// Destructor. Stops the recorder and writes out all pending frames
+    /// </summary>
+   ~FrameRecorder();
+
+public:
+    static const size_t DefaultQueueCapacity = 16;
+
+    /// <summary>
+    /// Attach a writer to a stream. The recorder takes the ownership of the writer.
+    /// Must be called while the recorder is stopped.
+    /// </summary>
+    /// <param name="stream">Stream the writer stores</param>
+    /// <param name="pWriter">The pointer to writer object. nullptr to stop recording the stream</param>
+    void SetWriter(RecordStream stream, FrameWriter* pWriter);
+
+    /// <summary>
+    /// Attach an associator pairing the depth frames with color frames. It is used while both
+    /// streams are recorded. The recorder takes the ownership of the associator.
+    /// Must be called while the recorder is stopped.
+    /// </summary>
+    /// <param name="pAssociator">The pointer to associator object. nullptr to record the streams independently</param>
+    void SetAssociator(FrameAssociator* pAssociator);
+
+    /// <summary>
+    /// Attach the pool the recorded frames come from, so its counters are logged per session.
+    /// Must be called while the recorder is stopped.
+    /// </summary>
+    /// <param name="pFramePool">The pointer to pool object, not owned. nullptr to log nothing</param>
+    void SetFramePool(FramePool* pFramePool);
+
+    /// <summary>
+    /// Select what happens to frames while the queue of their stream is full. Takes effect with the next frame
+    /// </summary>
+    /// <param name="policy">Drop policy</param>
+    void SetDropPolicy(RecordDropPolicy policy);
+
+    /// <summary>
+    /// Set the path of the list of dropped frames, dropped.txt in the current directory unless set.
+    /// Must be called while the recorder is stopped.
+    /// </summary>
+    /// <param name="pPath">Path of the list, nullptr to only count dropped frames</param>
+    void SetDroppedListPath(const char* pPath);
+
+    /// <summary>
+    /// Split the recording into segments. Frames are assigned to segments as they are submitted, the writers
+    /// are expected to be SegmentedFrameWriters sharing the segmenter. Must be called while the recorder is stopped.
+    /// </summary>
+    /// <param name="pSegmenter">Segmenter, nullptr to record in one piece</param>
+    void SetSegmenter(const std::shared_ptr<RecordingSegmenter>& pSegmenter);
+
+    /// <summary>
+    /// Get the pool running the stages, e.g. to open and close the files of segments on
+    /// </summary>
+    TaskPool& GetPool() const { return m_pool; }
+
+    /// <summary>
+    /// Open writers and start the pipeline of every stream which has a writer
+    /// </summary>
+    /// <returns>Indicates success or failure</returns>
+    bool Start();
+
+    /// <summary>
+    /// Write out all queued frames, stop the pipelines and close writers
+    /// </summary>
+    void Stop();
+
+    /// <summary>
+    /// Check if frames of a stream are being recorded
+    /// </summary>
+    /// <param name="stream">Stream to check</param>
+    /// <returns>True if the stream has a running writer</returns>
+    bool IsRecording(RecordStream stream) const;
+
+    /// <summary>
+    /// Queue a frame for writing. While the queue of the stream is full, blocks or drops frames as the drop policy says
+    /// </summary>
+    /// <param name="frame">Frame to write. The recorder holds a reference until it is written</param>
+    /// <returns>True if the frame has been queued, false if it has been dropped or the recorder is stopped</returns>
+    bool SubmitFrame(FrameHandle frame);
+
+    /// <summary>
+    /// Get a snapshot of the counters of a stream
+    /// </summary>
+    /// <param name="stream">Stream to query</param>
+    /// <returns>Counters of the stream</returns>
+    FrameRecorderStats GetStats(RecordStream stream) const;
+
+private:
+    // Frame passing through the pipeline of a stream
+    struct RecordJob
+    {
+        FrameHandle     frame;
+        EncodedFrame    encoded;
+        bool            failed;
+    };
+
+    struct StreamChannel
+    {
+        std::unique_ptr<FrameWriter>                writer;
+        std::unique_ptr<Pipeline<RecordJob>>        pipeline;
+        bool                                        running;
+        FrameRecorderStats                          stats;
+    };
+
+    /// <summary>
+    /// Build the pipeline of a stream for the writer attached to it
+    /// </summary>
+    /// <param name="channel">Channel of the stream</param>
+    void CreatePipeline(StreamChannel& channel);
+
+    /// <summary>
+    /// Write stage of a stream: store the frame and count it
+    /// </summary>
+    /// <param name="channel">Channel of the stream</param>
+    /// <param name="job">Frame to store, released afterwards</param>
+    void WriteStage(StreamChannel& channel, RecordJob& job);
+
+    /// <summary>
+    /// Decide whether a frame is queued under a drop policy, making room for it if the policy drops older frames
+    /// </summary>
+    /// <param name="frame">Frame being submitted</param>
+    /// <param name="policy">Drop policy</param>
+    /// <param name="associating">True if the frame goes through the associator</param>
+    /// <param name="pDepthPipeline">Pipeline of the depth stream, nullptr unless depth frames are recorded</param>
+    /// <param name="evicted">Receives a queued frame taken out to make room</param>
+    /// <returns>True to queue the frame, false to drop it</returns>
+    bool AdmitFrame(const RecordFrame& frame, RecordDropPolicy policy, bool associating, Pipeline<RecordJob>* pDepthPipeline, FrameHandle& evicted);
+
+    /// <summary>
+    /// Run a submitted frame through the drop policy and the associator, and queue it
+    /// </summary>
+    /// <param name="frame">Frame to write</param>
+    /// <param name="policy">Drop policy</param>
+    /// <param name="associating">True if the frame goes through the associator</param>
+    /// <param name="pDepthPipeline">Pipeline of the depth stream, nullptr unless depth frames are recorded</param>
+    /// <returns>True if the frame has been queued, false if it has been dropped</returns>
+    bool AdmitAndQueueFrame(FrameHandle frame, RecordDropPolicy policy, bool associating, Pipeline<RecordJob>* pDepthPipeline);
+
+    /// <summary>
+    /// Count a dropped frame and list it in dropped.txt
+    /// </summary>
+    /// <param name="frame">Frame dropped</param>
+    void DropFrame(const RecordFrame& frame);
+
+    /// <summary>
+    /// Submit a frame to the pipeline of its stream. Blocks while the pipeline is full
+    /// </summary>
+    /// <param name="frame">Frame to write</param>
+    /// <returns>True if the frame has been queued, false if it has been dropped as the recorder stopped</returns>
+    bool QueueFrame(FrameHandle frame);
+
+    /// <summary>
+    /// Append the counters of every recorded stream to session.log in the current directory
+    /// </summary>
+    void LogSession() const;
+
+private:
+    TaskPool&               m_pool;
+    size_t                  m_queueCapacity;
+    bool                    m_stopping;
+    bool                    m_associating;      // Both streams are recorded and frames go through the associator
+    RecordDropPolicy        m_dropPolicy;
+    std::string             m_droppedListPath;
+    FrameListFile           m_droppedList;      // Guarded by m_lock
+    std::unique_ptr<FrameAssociator> m_pAssociator;
+    std::shared_ptr<RecordingSegmenter> m_pSegmenter;
+    mutable std::mutex      m_lock;
+    std::mutex              m_submitLock;       // Held from associating a frame until the frames it released are queued,
+                                                // and while the associator releases the frames it held back at the end
+    StreamChannel           m_channels[RecordStreamCount];
+    FramePool*              m_pFramePool;
+    unsigned                m_submissions;      // SubmitFrame calls past the check for m_stopping, guarded by m_lock
+    std::condition_variable m_submissionsDone;
+};
@@ -0,0 +1,271 @@
+//------------------------------------------------------------------------------
+// <copyright file="FrameStream.cpp">
+//     Stream taking frames from a sensor source and handing them to the recorder.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "FrameStream.h"
+
+#include <chrono>
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="pSource">The pointer to the source the frames come from, must outlive the stream</param>
+FrameStream::FrameStream(SensorSource* pSource)
+    : m_pSource(pSource)
+    , m_pRecorder(nullptr)
+    , m_pFramePool(nullptr)
+    , m_pSensorClock(nullptr)
+    , m_replaying(false)
+    , m_paused(false)
+    , m_frameCount(0)
+{
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+FrameStream::~FrameStream()
+{
+}
+
+/// <summary>
+/// Pause the stream
+/// </summary>
+/// <param name="pause">Pause or resume the stream</param>
+void FrameStream::PauseStream(bool pause)
+{
+    StreamLock lock(this);
+
+    m_paused = pause;
+}
+
+/// <summary>
+/// Attach recorder which incoming frames are submitted to
+/// </summary>
+/// <param name="pRecorder">The pointer to recorder object. nullptr to stop recording</param>
+void FrameStream::SetFrameRecorder(FrameRecorder* pRecorder)
+{
+    m_pRecorder = pRecorder;
+}
+
+/// <summary>
+/// Attach pool the frames copied out of the sensor come from
+/// </summary>
+/// <param name="pFramePool">The pointer to pool object. nullptr to copy frames to the heap</param>
+void FrameStream::SetFramePool(FramePool* pFramePool)
+{
+    m_pFramePool = pFramePool;
+}
+
+/// <summary>
+/// Attach ring keeping the latest frames while the stream is not recorded. They are recorded ahead of
+/// the live frames once recording starts. The stream takes the ownership of the ring
+/// </summary>
+/// <param name="pBuffer">The pointer to ring object. nullptr to keep no frames</param>
+void FrameStream::SetPreTriggerBuffer(PreTriggerBuffer* pBuffer)
+{
+    std::unique_ptr<PreTriggerBuffer> pBufferToFree(pBuffer);
+    {
+        StreamLock lock(this);
+        FlushPreTrigger();
+        m_pPreTrigger.swap(pBufferToFree);
+    }
+
+    // The memory of the old ring is freed outside of the lock
+}
+
+/// <summary>
+/// Record the frames still waiting in the pre-trigger ring since recording started. Called before the
+/// recorder is stopped, so they go into the recording they belong to and none is left for the next one
+/// </summary>
+void FrameStream::FlushPreTrigger()
+{
+    StreamLock lock(this);
+    if (!m_replaying)
+    {
+        return;
+    }
+
+    FrameHandle buffered;
+    while (m_pPreTrigger->Pop(m_pFramePool, buffered))
+    {
+        m_pRecorder->SubmitFrame(std::move(buffered));
+    }
+    m_replaying = false;
+    m_pPreTrigger->LogSession();
+}
+
+/// <summary>
+/// Get the latest frame the stream has copied out of the sensor, shared with the viewer and the recorder
+/// </summary>
+/// <returns>Handle of the frame, empty if the stream has not published one</returns>
+FrameHandle FrameStream::GetLatestFrame() const
+{
+    StreamLock lock(this);
+    return m_latestFrame;
+}
+
+/// <summary>
+/// Process the frame the stream event was set for, with the stream lock held. Called by the event
+/// dispatcher waiting on the event, so settings changed from the UI thread take effect between frames
+/// </summary>
+void FrameStream::DispatchFrame()
+{
+    StreamLock lock(this);
+    ProcessStreamFrame();
+}
+
+/// <summary>
+/// Attach clock mapping sensor timestamps of recorded frames to wall-clock time
+/// </summary>
+/// <param name="pClock">The pointer to clock object, shared by the image streams of a sensor</param>
+void FrameStream::SetSensorClock(SensorClock* pClock)
+{
+    m_pSensorClock = pClock;
+}
+
+/// <summary>
+/// Fill the identification and timestamps of a recorded frame from the sensor image
+/// </summary>
+/// <param name="image">Image the pixels are copied from</param>
+/// <param name="hostTime">Host time the image arrived at, from SensorClock::GetHostTime</param>
+/// <param name="frame">Frame to stamp</param>
+void FrameStream::StampFrame(const SensorImage& image, double hostTime, RecordFrame& frame)
+{
+    frame.frameNumber = image.frameNumber;
+    frame.sensorTime  = image.sensorTime;
+    frame.hostTime    = hostTime;
+
+    if (m_pSensorClock)
+    {
+        frame.timestamp = m_pSensorClock->Map(frame.sensorTime, hostTime);
+    }
+    else
+    {
+        using namespace std::chrono;
+        frame.timestamp = duration_cast<microseconds>(system_clock::now().time_since_epoch()).count() / 1e6;
+    }
+}
+
+/// <summary>
+/// Copy the pixels of a sensor image into a frame of the pool. This is the only copy out of the source,
+/// the viewer, the recorder and other consumers share it. Size comes from the open stream, row pitch from the image
+/// </summary>
+/// <param name="stream">Stream the frame belongs to</param>
+/// <param name="format">Layout of the pixels</param>
+/// <param name="bytesPerPixel">Bytes per pixel of the layout</param>
+/// <param name="width">Width of the open stream</param>
+/// <param name="height">Height of the open stream</param>
+/// <param name="image">Image taken from the source</param>
+/// <param name="hostTime">Host time the image arrived at</param>
+/// <returns>Only handle of the frame, empty if the image does not match the stream</returns>
+FrameHandle FrameStream::CopyFrame(RecordStream stream, RecordPixelFormat format, uint32_t bytesPerPixel, uint32_t width, uint32_t height,
+                                   const SensorImage& image, double hostTime)
+{
+    // Rows may be padded, the frame keeps the pitch and consumers read it row by row
+    uint32_t pitch = image.pitch;
+    if (0 == width || pitch < width * bytesPerPixel || image.size < pitch * height)
+    {
+        return FrameHandle();
+    }
+
+    FrameHandle frame = m_pFramePool ? m_pFramePool->Acquire(stream, pitch * height) : FrameHandle::Create();
+
+    RecordFrame* pFrame = frame.GetMutable();
+    pFrame->stream = stream;
+    pFrame->format = format;
+    pFrame->width  = width;
+    pFrame->height = height;
+    pFrame->stride = pitch;
+    pFrame->data.assign(image.pBits, image.pBits + pitch * height);
+    StampFrame(image, hostTime, *pFrame);
+
+    return frame;
+}
+
+/// <summary>
+/// Make a frame the latest of the stream and hand it over to the recorder
+/// </summary>
+/// <param name="frame">Frame filled by CopyFrame</param>
+void FrameStream::PublishFrame(const FrameHandle& frame)
+{
+    m_latestFrame = frame;
+    m_frameCount++;
+
+    // Encoding and writing happen on the recorder thread, which holds its own reference
+    uint64_t dropped = 0;
+    if (m_pRecorder && m_pRecorder->IsRecording(frame->stream))
+    {
+        if (m_pPreTrigger && !m_pPreTrigger->IsEmpty())
+        {
+            ReplayPreTrigger(frame);
+        }
+        else
+        {
+            m_pRecorder->SubmitFrame(frame);
+        }
+        dropped = m_pRecorder->GetStats(frame->stream).framesDropped;
+    }
+    else if (m_pPreTrigger)
+    {
+        if (m_replaying)
+        {
+            // Recording stopped without FlushPreTrigger, what is left belongs to it and not to the next one
+            m_pPreTrigger->Clear();
+            m_replaying = false;
+        }
+
+        // Kept until recording is triggered
+        m_pPreTrigger->Push(*frame);
+    }
+
+    // Frames given way to a disk falling behind show up as they happen
+    ShowDroppedFrames(dropped);
+}
+
+/// <summary>
+/// Hand frames kept before recording started over to the recorder, a few per live frame so they catch up.
+/// The live frame queues behind them in the ring until the ring is empty. Room for it is made by recording
+/// older frames, never by pushing them out
+/// </summary>
+/// <param name="frame">Live frame</param>
+void FrameStream::ReplayPreTrigger(const FrameHandle& frame)
+{
+    m_replaying = true;
+
+    // Two frames out per frame in, so a window of N seconds is through after N seconds
+    FrameHandle buffered;
+    for (int i = 0; i < 2 && m_pPreTrigger->Pop(m_pFramePool, buffered); i++)
+    {
+        m_pRecorder->SubmitFrame(std::move(buffered));
+    }
+
+    while (!m_pPreTrigger->IsEmpty() && !m_pPreTrigger->Append(*frame))
+    {
+        if (m_pPreTrigger->Pop(m_pFramePool, buffered))
+        {
+            m_pRecorder->SubmitFrame(std::move(buffered));
+        }
+    }
+
+    if (m_pPreTrigger->IsEmpty())
+    {
+        m_pRecorder->SubmitFrame(frame);
+        m_replaying = false;
+        m_pPreTrigger->LogSession();
+    }
+}
+
+/// <summary>
+/// Drop the frames kept before recording, e.g. when the stream is opened with another resolution
+/// </summary>
+void FrameStream::ClearPreTrigger()
+{
+    if (m_pPreTrigger)
+    {
+        m_pPreTrigger->Clear();
+    }
+    m_replaying = false;
+}
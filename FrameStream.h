@@ -0,0 +1,197 @@
+//------------------------------------------------------------------------------
+// <copyright file="FrameStream.h">
+//     Stream taking frames from a sensor source and handing them to the recorder.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include "EventDispatcher.h"
+#include "FramePool.h"
+#include "FrameRecorder.h"
+#include "PreTriggerBuffer.h"
+#include "SensorClock.h"
+#include "SensorSource.h"
+
+/// <summary>
+/// The part of a stream which does not depend on the display: the frame ready event the source sets, the
+/// lock settings and frames are changed under, and the way from a frame taken from the source to the
+/// recorder, through the pool, the sensor clock and the pre-trigger ring. The streams of the window add
+/// their viewers on top, the streams of an unattended capture use it as it is.
+/// </summary>
+class FrameStream
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="pSource">The pointer to the source the frames come from, must outlive the stream</param>
+    explicit FrameStream(SensorSource* pSource);
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    virtual ~FrameStream();
+
+public:
+    /// <summary>
+    /// Attach recorder which incoming frames are submitted to
+    /// </summary>
+    /// <param name="pRecorder">The pointer to recorder object. nullptr to stop recording</param>
+    void SetFrameRecorder(FrameRecorder* pRecorder);
+
+    /// <summary>
+    /// Attach pool the frames copied out of the sensor come from
+    /// </summary>
+    /// <param name="pFramePool">The pointer to pool object. nullptr to copy frames to the heap</param>
+    void SetFramePool(FramePool* pFramePool);
+
+    /// <summary>
+    /// Get the latest frame the stream has copied out of the sensor, shared with the viewer and the recorder
+    /// </summary>
+    /// <returns>Handle of the frame, empty if the stream has not published one</returns>
+    FrameHandle GetLatestFrame() const;
+
+    /// <summary>
+    /// Attach clock mapping sensor timestamps of recorded frames to wall-clock time
+    /// </summary>
+    /// <param name="pClock">The pointer to clock object, shared by the image streams of a sensor</param>
+    void SetSensorClock(SensorClock* pClock);
+
+    /// <summary>
+    /// Attach ring keeping the latest frames while the stream is not recorded. They are recorded ahead of
+    /// the live frames once recording starts. The stream takes the ownership of the ring
+    /// </summary>
+    /// <param name="pBuffer">The pointer to ring object. nullptr to keep no frames</param>
+    void SetPreTriggerBuffer(PreTriggerBuffer* pBuffer);
+
+    /// <summary>
+    /// Record the frames still waiting in the pre-trigger ring since recording started. Called before the
+    /// recorder is stopped, so they go into the recording they belong to and none is left for the next one
+    /// </summary>
+    void FlushPreTrigger();
+
+    /// <summary>
+    /// Get the number of frames the stream has processed since it was created, paused frames excluded
+    /// </summary>
+    /// <returns>Frame count, read without the stream lock</returns>
+    uint64_t GetFrameCount() const { return m_frameCount; }
+
+    /// <summary>
+    /// Subclass should override this method to process the next incoming
+    /// stream frame when stream event is set.
+    /// </summary>
+    virtual void ProcessStreamFrame() = 0;
+
+    /// <summary>
+    /// Process the frame the stream event was set for, with the stream lock held. Called by the event
+    /// dispatcher waiting on the event, so settings changed from the UI thread take effect between frames
+    /// </summary>
+    void DispatchFrame();
+
+    /// <summary>
+    /// Pause the stream
+    /// </summary>
+    /// <param name="pause">Pause or resume the stream</param>
+    virtual void PauseStream(bool pause);
+
+    /// <summary>
+    /// Get stream frame ready event handle
+    /// </summary>
+    /// <returns>Handle to event</returns>
+    EventHandle GetFrameReadyEvent() const { return m_frameReady.GetHandle(); }
+
+protected:
+    /// <summary>
+    /// Holds the lock of a stream while in scope. The lock may be taken again by the thread holding it
+    /// </summary>
+    class StreamLock
+    {
+    public:
+        StreamLock(const FrameStream* pStream)
+            : m_lock(pStream->m_lock)
+        {
+        }
+
+    private:
+        StreamLock(const StreamLock&);
+        StreamLock& operator=(const StreamLock&);
+
+    private:
+        std::lock_guard<std::recursive_mutex> m_lock;
+    };
+
+    /// <summary>
+    /// Fill the identification and timestamps of a recorded frame from the sensor image
+    /// </summary>
+    /// <param name="image">Image the pixels are copied from</param>
+    /// <param name="hostTime">Host time the image arrived at, from SensorClock::GetHostTime</param>
+    /// <param name="frame">Frame to stamp</param>
+    void StampFrame(const SensorImage& image, double hostTime, RecordFrame& frame);
+
+    /// <summary>
+    /// Copy the pixels of a sensor image into a frame of the pool. This is the only copy out of the source,
+    /// the viewer, the recorder and other consumers share it. Size comes from the open stream, row pitch from the image
+    /// </summary>
+    /// <param name="stream">Stream the frame belongs to</param>
+    /// <param name="format">Layout of the pixels</param>
+    /// <param name="bytesPerPixel">Bytes per pixel of the layout</param>
+    /// <param name="width">Width of the open stream</param>
+    /// <param name="height">Height of the open stream</param>
+    /// <param name="image">Image taken from the source</param>
+    /// <param name="hostTime">Host time the image arrived at</param>
+    /// <returns>Only handle of the frame, empty if the image does not match the stream</returns>
+    FrameHandle CopyFrame(RecordStream stream, RecordPixelFormat format, uint32_t bytesPerPixel, uint32_t width, uint32_t height,
+                          const SensorImage& image, double hostTime);
+
+    /// <summary>
+    /// Make a frame the latest of the stream and hand it over to the recorder
+    /// </summary>
+    /// <param name="frame">Frame filled by CopyFrame</param>
+    void PublishFrame(const FrameHandle& frame);
+
+    /// <summary>
+    /// Show the frames the recorder dropped so far, e.g. on a viewer. Called for every frame published
+    /// </summary>
+    /// <param name="dropped">Frames of the stream dropped by the recorder, 0 while not recording</param>
+    virtual void ShowDroppedFrames(uint64_t dropped) { (void)dropped; }
+
+    /// <summary>
+    /// Hand frames kept before recording started over to the recorder, a few per live frame so they catch up.
+    /// The live frame queues behind them in the ring until the ring is empty. Room for it is made by recording
+    /// older frames, never by pushing them out
+    /// </summary>
+    /// <param name="frame">Live frame</param>
+    void ReplayPreTrigger(const FrameHandle& frame);
+
+    /// <summary>
+    /// Drop the frames kept before recording, e.g. when the stream is opened with another resolution
+    /// </summary>
+    void ClearPreTrigger();
+
+protected:
+    SensorSource*       m_pSource;
+    FrameRecorder*      m_pRecorder;
+    FramePool*          m_pFramePool;
+    FrameHandle         m_latestFrame;
+    SensorClock*        m_pSensorClock;
+    DispatchEvent       m_frameReady;
+
+    std::unique_ptr<PreTriggerBuffer>   m_pPreTrigger;
+    bool                                m_replaying;    // The ring holds frames of the running recording
+
+    bool                    m_paused;
+    std::atomic<uint64_t>   m_frameCount;
+
+private:
+    FrameStream(const FrameStream&);
+    FrameStream& operator=(const FrameStream&);
+
+private:
+    mutable std::recursive_mutex    m_lock;
+};
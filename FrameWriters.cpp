@@ -0,0 +1,522 @@
+//------------------------------------------------------------------------------
+// <copyright file="FrameWriters.cpp">
+//     Frame writers storing one image file per frame plus a timestamp log.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "FrameWriters.h"
+#include "DepthSplit.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#ifdef FRAMEWRITERS_WITH_OPENCV
+#include <opencv2/opencv.hpp>
+#endif
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/// <summary>
+/// Create a directory, if it does not exist yet
+/// </summary>
+static void MakeDirectoryIfMissing(const std::string& path)
+{
+#ifdef _WIN32
+    _mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0755);
+#endif
+}
+
+/// <summary>
+/// Remove a directory, if it is empty
+/// </summary>
+static void RemoveEmptyDirectory(const std::string& path)
+{
+#ifdef _WIN32
+    _rmdir(path.c_str());
+#else
+    rmdir(path.c_str());
+#endif
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="stream">Stream of the frames, selects folder and list</param>
+/// <param name="pExtension">File name extension including the dot</param>
+/// <param name="pDirectory">Directory of folder and list, nullptr for the current directory</param>
+FrameFileSet::FrameFileSet(RecordStream stream, const char* pExtension, const char* pDirectory)
+    : m_pName((RecordStreamColor == stream) ? "rgb" : "depth")
+    , m_directory(pDirectory ? pDirectory : "")
+    , m_path(m_pName, pExtension, pDirectory)
+{
+}
+
+/// <summary>
+/// Create the folder and open the list for a new session
+/// </summary>
+/// <returns>Indicates success or failure</returns>
+bool FrameFileSet::Open()
+{
+    char listName[16];
+    snprintf(listName, sizeof(listName), "%s.txt", m_pName);
+
+    if (!m_directory.empty())
+    {
+        MakeDirectoryIfMissing(m_directory);
+    }
+    MakeDirectoryIfMissing(GetSiblingPath(m_pName));
+    return m_list.Open(GetSiblingPath(listName).c_str());
+}
+
+/// <summary>
+/// Close the list of a session no frame was stored in, and remove it along with the folder
+/// </summary>
+void FrameFileSet::Discard()
+{
+    char listName[16];
+    snprintf(listName, sizeof(listName), "%s.txt", m_pName);
+
+    m_list.Close();
+    remove(GetSiblingPath(listName).c_str());
+    RemoveEmptyDirectory(GetSiblingPath(m_pName));
+
+    // Only goes once the other stream has removed its files as well
+    if (!m_directory.empty())
+    {
+        RemoveEmptyDirectory(m_directory);
+    }
+}
+
+/// <summary>
+/// Get the path of a file next to the list, e.g. "rgb_encode.txt" in the directory of the segment
+/// </summary>
+std::string FrameFileSet::GetSiblingPath(const char* pName) const
+{
+    return m_directory.empty() ? std::string(pName) : m_directory + FRAME_PATH_SEPARATOR + pName;
+}
+
+/// <summary>
+/// Write an encoded frame to its file and add it to the list
+/// </summary>
+/// <returns>Indicates success or failure</returns>
+bool FrameFileSet::Store(const RecordFrame& frame, const std::vector<uint8_t>& payload)
+{
+    FILE* pFile = fopen(FormatPath(frame.timestamp), "wb");
+    if (!pFile)
+    {
+        return false;
+    }
+
+    bool written = payload.size() == fwrite(payload.data(), 1, payload.size(), pFile);
+    if (0 != fclose(pFile) || !written)
+    {
+        return false;
+    }
+
+    AddToList(frame.timestamp);
+    return true;
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="pDirectory">Directory to store in, nullptr for the current directory</param>
+BitmapColorWriter::BitmapColorWriter(const char* pDirectory)
+    : m_files(RecordStreamColor, ".bmp", pDirectory)
+{
+}
+
+/// <summary>
+/// Encode and store a color frame
+/// </summary>
+/// <param name="frame">Frame to write</param>
+/// <returns>Indicates success or failure</returns>
+bool BitmapColorWriter::WriteFrame(const RecordFrame& frame)
+{
+    if (RecordPixelFormatBgra32 != frame.format)
+    {
+        return false;
+    }
+
+    if (frame.data.size() < (size_t)frame.stride * frame.height)
+    {
+        return false;
+    }
+
+    if (!SaveRGBToBitmap(frame.data.data(), frame.width, frame.height, frame.stride, m_files.FormatPath(frame.timestamp)))
+    {
+        return false;
+    }
+
+    m_files.AddToList(frame.timestamp);
+    return true;
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="pDirectory">Directory to store in, nullptr for the current directory</param>
+PngDepthWriter::PngDepthWriter(const char* pDirectory)
+    : m_files(RecordStreamDepth, ".png", pDirectory)
+{
+}
+
+/// <summary>
+/// Check whether the build can write PNG files, only those with OpenCV can
+/// </summary>
+bool PngDepthWriter::IsAvailable()
+{
+#ifdef FRAMEWRITERS_WITH_OPENCV
+    return true;
+#else
+    return false;
+#endif
+}
+
+/// <summary>
+/// Encode and store a depth frame
+/// </summary>
+/// <param name="frame">Frame to write</param>
+/// <returns>Indicates success or failure</returns>
+bool PngDepthWriter::WriteFrame(const RecordFrame& frame)
+{
+#ifdef FRAMEWRITERS_WITH_OPENCV
+    if (RecordPixelFormatDepthPixel32 != frame.format)
+    {
+        return false;
+    }
+
+    if (frame.data.size() < (size_t)frame.stride * frame.height)
+    {
+        return false;
+    }
+
+    m_filename.assign(m_files.FormatPath(frame.timestamp));
+
+    // The texture interleaves player index and depth, the image gets the depth of every pixel
+    m_depthPlane.resize((size_t)frame.width * frame.height);
+    for (uint32_t y = 0; y < frame.height; y++)
+    {
+        SplitDepthPixels(reinterpret_cast<const uint16_t*>(frame.data.data() + (size_t)y * frame.stride), frame.width,
+                         m_depthPlane.data() + (size_t)y * frame.width, nullptr);
+    }
+
+    cv::Mat depth_image(frame.height, frame.width, CV_16UC1, m_depthPlane.data());
+    if (!cv::imwrite(m_filename, depth_image))
+    {
+        return false;
+    }
+
+    m_files.AddToList(frame.timestamp);
+    return true;
+#else
+    // Built without a PNG encoder, the lossless depth formats take its place
+    (void)frame;
+    return false;
+#endif
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="stream">Stream the writer stores, selects folder and log file</param>
+/// <param name="pEncoder">Encoder for the frames, owned by the writer</param>
+/// <param name="pDirectory">Directory to store in, nullptr for the current directory</param>
+EncodedFrameWriter::EncodedFrameWriter(RecordStream stream, FrameEncoder* pEncoder, const char* pDirectory)
+    : m_stream(stream)
+    , m_pEncoder(pEncoder)
+    , m_files(stream, pEncoder->GetFileExtension(), pDirectory)
+    , m_storeFailed(false)
+{
+}
+
+/// <summary>
+/// Start a new session of the encoder, create the folder and open the list
+/// </summary>
+/// <returns>Indicates success or failure</returns>
+bool EncodedFrameWriter::Open()
+{
+    m_pEncoder->Reset();
+    m_storeFailed = false;
+    return m_files.Open();
+}
+
+/// <summary>
+/// Close the list and log the compression achieved in the session
+/// </summary>
+void EncodedFrameWriter::Close()
+{
+    m_files.Close();
+    LogEncoderSession(m_stream, *m_pEncoder);
+}
+
+/// <summary>
+/// Encode and store a frame
+/// </summary>
+/// <param name="frame">Frame to write</param>
+/// <returns>Indicates success or failure</returns>
+bool EncodedFrameWriter::WriteFrame(const RecordFrame& frame)
+{
+    return EncodeFrame(frame, m_encoded) && StoreFrame(frame, m_encoded);
+}
+
+/// <summary>
+/// Encode a frame ahead of StoreFrame
+/// </summary>
+/// <param name="frame">Frame to encode</param>
+/// <param name="encoded">Receives the payload</param>
+/// <returns>Indicates success or failure</returns>
+bool EncodedFrameWriter::EncodeFrame(const RecordFrame& frame, EncodedFrame& encoded)
+{
+    bool result = m_pEncoder->Encode(frame, encoded.payload);
+    encoded.encodeSeconds = m_pEncoder->GetStats().lastEncodeSeconds;
+    encoded.keyframe      = m_pEncoder->GetStats().lastKeyframe;
+    return result;
+}
+
+/// <summary>
+/// Store an encoded frame and add it to the list
+/// </summary>
+/// <param name="frame">Frame to store</param>
+/// <param name="encoded">Payload of the frame</param>
+/// <returns>Indicates success or failure</returns>
+bool EncodedFrameWriter::StoreFrame(const RecordFrame& frame, const EncodedFrame& encoded)
+{
+    // Frames predicted from one which was lost would not decode. They are turned away until the
+    // keyframe the encoder was asked for, which may be a frame or two behind those encoded already
+    if (m_storeFailed && !encoded.keyframe)
+    {
+        return false;
+    }
+
+    m_storeFailed = !m_files.Store(frame, encoded.payload);
+    if (m_storeFailed)
+    {
+        m_pEncoder->RequestKeyframe();
+        return false;
+    }
+    return true;
+}
+
+/// <summary>
+/// Create the encoders of a parallel writer
+/// </summary>
+static std::vector<std::unique_ptr<FrameEncoder>> CreateEncoders(const ParallelEncodedFrameWriter::EncoderFactory& createEncoder, unsigned count)
+{
+    std::vector<std::unique_ptr<FrameEncoder>> encoders;
+    for (unsigned i = 0; i < count; i++)
+    {
+        encoders.push_back(std::unique_ptr<FrameEncoder>(createEncoder()));
+    }
+
+    return encoders;
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="stream">Stream the writer stores, selects folder and log files</param>
+/// <param name="createEncoder">Creates an encoder. Encoders must keep no state between frames</param>
+/// <param name="concurrency">Number of frames encoded at the same time</param>
+/// <param name="pDirectory">Directory to store in, nullptr for the current directory</param>
+ParallelEncodedFrameWriter::ParallelEncodedFrameWriter(RecordStream stream, const EncoderFactory& createEncoder, unsigned concurrency,
+                                                       const char* pDirectory)
+    : m_stream(stream)
+    , m_createEncoder(createEncoder)
+    , m_concurrency((std::max)(1u, concurrency))
+    , m_encoders(CreateEncoders(createEncoder, m_concurrency))
+    , m_files(stream, m_encoders[0]->GetFileExtension(), pDirectory)
+{
+    for (const std::unique_ptr<FrameEncoder>& pEncoder : m_encoders)
+    {
+        m_idleEncoders.push_back(pEncoder.get());
+    }
+}
+
+/// <summary>
+/// Start a new session of the encoders and open the lists
+/// </summary>
+/// <returns>Indicates success or failure</returns>
+bool ParallelEncodedFrameWriter::Open()
+{
+    if (!m_files.Open())
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    for (const std::unique_ptr<FrameEncoder>& pEncoder : m_encoders)
+    {
+        pEncoder->Reset();
+    }
+
+    m_encodeLog.Open(m_files.GetSiblingPath((RecordStreamColor == m_stream) ? "rgb_encode.txt" : "depth_encode.txt").c_str());
+    return true;
+}
+
+/// <summary>
+/// Encode and store a frame
+/// </summary>
+/// <param name="frame">Frame to write</param>
+/// <returns>Indicates success or failure</returns>
+bool ParallelEncodedFrameWriter::WriteFrame(const RecordFrame& frame)
+{
+    return EncodeFrame(frame, m_encoded) && StoreFrame(frame, m_encoded);
+}
+
+/// <summary>
+/// Encode a frame with an encoder no other frame is using
+/// </summary>
+/// <param name="frame">Frame to encode</param>
+/// <param name="encoded">Receives the payload and the encode time</param>
+/// <returns>Indicates success or failure</returns>
+bool ParallelEncodedFrameWriter::EncodeFrame(const RecordFrame& frame, EncodedFrame& encoded)
+{
+    FrameEncoder* pEncoder;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_idleEncoders.empty())
+        {
+            // Called more often at the same time than announced, add another encoder rather than wait
+            m_encoders.push_back(std::unique_ptr<FrameEncoder>(m_createEncoder()));
+            m_idleEncoders.push_back(m_encoders.back().get());
+        }
+
+        pEncoder = m_idleEncoders.back();
+        m_idleEncoders.pop_back();
+    }
+
+    bool result = pEncoder->Encode(frame, encoded.payload);
+    encoded.encodeSeconds = pEncoder->GetStats().lastEncodeSeconds;
+    encoded.keyframe      = pEncoder->GetStats().lastKeyframe;
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_idleEncoders.push_back(pEncoder);
+    return result;
+}
+
+/// <summary>
+/// Store an encoded frame, add it to the list and log its encode time and size
+/// </summary>
+/// <param name="frame">Frame to store</param>
+/// <param name="encoded">Payload of the frame</param>
+/// <returns>Indicates success or failure</returns>
+bool ParallelEncodedFrameWriter::StoreFrame(const RecordFrame& frame, const EncodedFrame& encoded)
+{
+    if (!m_files.Store(frame, encoded.payload))
+    {
+        return false;
+    }
+
+    // [timestamp]\t[encode milliseconds]\t[bytes]
+    char   line[64];
+    size_t length = FormatFixed(line, frame.timestamp, 6);
+    line[length++] = '\t';
+    length += FormatFixed(line + length, encoded.encodeSeconds * 1000, 3);
+    line[length++] = '\t';
+    length += FormatUnsigned(line + length, encoded.payload.size());
+    line[length++] = '\n';
+    m_encodeLog.AppendLine(line, length);
+
+    return true;
+}
+
+/// <summary>
+/// Close the lists and log the compression achieved in the session
+/// </summary>
+void ParallelEncodedFrameWriter::Close()
+{
+    m_files.Close();
+    m_encodeLog.Close();
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    FrameEncoderStats total = m_encoders[0]->GetStats();
+    for (size_t i = 1; i < m_encoders.size(); i++)
+    {
+        const FrameEncoderStats& stats = m_encoders[i]->GetStats();
+        total.frames        += stats.frames;
+        total.keyframes     += stats.keyframes;
+        total.failures      += stats.failures;
+        total.rawBytes      += stats.rawBytes;
+        total.encodedBytes  += stats.encodedBytes;
+        total.encodeSeconds += stats.encodeSeconds;
+        total.maxEncodeSeconds = (std::max)(total.maxEncodeSeconds, stats.maxEncodeSeconds);
+    }
+
+    LogEncoderSession(m_stream, m_encoders[0]->GetCodec(), total);
+}
+
+/// <summary>
+/// Close the lists and remove them along with the folder
+/// </summary>
+void ParallelEncodedFrameWriter::Discard()
+{
+    m_encodeLog.Close();
+    remove(m_files.GetSiblingPath((RecordStreamColor == m_stream) ? "rgb_encode.txt" : "depth_encode.txt").c_str());
+    m_files.Discard();
+}
+
+/// <summary>
+/// Put a little-endian value into a file header
+/// </summary>
+static void PutLE(uint8_t* p, uint32_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+    {
+        p[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+/// <summary>
+/// Write a 32-bit color image as a top-down bitmap file
+/// </summary>
+/// <param name="pBuffer">The pointer to the pixels</param>
+/// <param name="width">Width of the image</param>
+/// <param name="height">Height of the image</param>
+/// <param name="stride">Bytes per row in the buffer</param>
+/// <param name="pFilename">Path of the file</param>
+/// <returns>Indicates success or failure</returns>
+bool SaveRGBToBitmap(const uint8_t* pBuffer, int width, int height, int stride, const char* pFilename)
+{
+    // BITMAPFILEHEADER (14 bytes) followed by BITMAPINFOHEADER (40 bytes), laid out by hand as Windows does
+    uint8_t header[54] = { 0 };
+
+    // 32-bit rows need no padding in the file
+    int rowBytes = width * 4;
+
+    header[0] = 'B';
+    header[1] = 'M';
+    PutLE(header + 2, sizeof(header) + rowBytes * height, 4);    // bfSize
+    PutLE(header + 10, sizeof(header), 4);                      // bfOffBits
+    PutLE(header + 14, 40, 4);                                  // biSize
+    PutLE(header + 18, (uint32_t)width, 4);
+    PutLE(header + 22, (uint32_t)-height, 4);                   // top-down bitmap
+    PutLE(header + 26, 1, 2);                                   // biPlanes
+    PutLE(header + 28, 32, 2);                                  // biBitCount, BI_RGB compression is 0
+
+    FILE* pFile = fopen(pFilename, "wb");
+    if (!pFile) return false;
+
+    bool written = 1 == fwrite(header, sizeof(header), 1, pFile);
+    if (stride == rowBytes)
+    {
+        written = written && 1 == fwrite(pBuffer, rowBytes * height, 1, pFile);
+    }
+    else
+    {
+        for (int y = 0; written && y < height; y++)
+        {
+            written = 1 == fwrite(pBuffer + (size_t)y * stride, rowBytes, 1, pFile);
+        }
+    }
+    if (0 != fclose(pFile) || !written) return false;
+
+    return true;
+}
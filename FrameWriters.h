@@ -0,0 +1,343 @@
+//------------------------------------------------------------------------------
+// <copyright file="FrameWriters.h">
+//     Frame writers storing one image file per frame plus a timestamp log.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "FrameCodec.h"
+#include "FramePath.h"
+#include "FrameRecorder.h"
+
+// 16-bit PNG depth files are written with OpenCV, which the capture application always links
+// and RgbdTool only when it is built with it
+#if (defined(_WIN32) && !defined(_CONSOLE)) || defined(RGBDTOOL_WITH_OPENCV)
+#define FRAMEWRITERS_WITH_OPENCV
+#endif
+
+/// <summary>
+/// Image files of a stream, rgb\rgb_[timestamp][ext] or depth\depth_[timestamp][ext], and their
+/// list rgb.txt or depth.txt. The folder is created and the list opened once per session. Files of
+/// a segmented recording go into the directory of their segment, the list holds paths relative to it
+/// </summary>
+class FrameFileSet
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="stream">Stream of the frames, selects folder and list</param>
+    /// <param name="pExtension">File name extension including the dot</param>
+    /// <param name="pDirectory">Directory of folder and list, nullptr for the current directory</param>
+    FrameFileSet(RecordStream stream, const char* pExtension, const char* pDirectory = nullptr);
+
+    /// <summary>
+    /// Create the folder and open the list for a new session
+    /// </summary>
+    /// <returns>Indicates success or failure</returns>
+    bool Open();
+
+    /// <summary>
+    /// Format the path of a frame
+    /// </summary>
+    /// <returns>Zero terminated path, valid until the next call</returns>
+    const char* FormatPath(double timestamp) { return m_path.Format(timestamp); }
+
+    /// <summary>
+    /// Add the last formatted path to the list
+    /// </summary>
+    void AddToList(double timestamp) { m_list.Append(timestamp, m_path.GetRelativePath(), m_path.GetRelativeLength()); }
+
+    /// <summary>
+    /// Write an encoded frame to its file and add it to the list
+    /// </summary>
+    /// <returns>Indicates success or failure</returns>
+    bool Store(const RecordFrame& frame, const std::vector<uint8_t>& payload);
+
+    /// <summary>
+    /// Flush and close the list
+    /// </summary>
+    void Close() { m_list.Close(); }
+
+    /// <summary>
+    /// Close the list of a session no frame was stored in, and remove it along with the folder
+    /// </summary>
+    void Discard();
+
+    /// <summary>
+    /// Get the path of a file next to the list, e.g. "rgb_encode.txt" in the directory of the segment
+    /// </summary>
+    std::string GetSiblingPath(const char* pName) const;
+
+private:
+    const char*         m_pName;
+    std::string         m_directory;
+    FramePathFormatter  m_path;
+    FrameListFile       m_list;
+};
+
+/// <summary>
+/// Writes color frames as 32-bit bitmaps to rgb\rgb_[timestamp].bmp and logs them in rgb.txt
+/// </summary>
+class BitmapColorWriter : public FrameWriter
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="pDirectory">Directory to store in, nullptr for the current directory</param>
+    BitmapColorWriter(const char* pDirectory = nullptr);
+
+    /// <summary>
+    /// Create the folder and open the list
+    /// </summary>
+    /// <returns>Indicates success or failure</returns>
+    virtual bool Open() { return m_files.Open(); }
+
+    /// <summary>
+    /// Encode and store a color frame
+    /// </summary>
+    /// <param name="frame">Frame to write</param>
+    /// <returns>Indicates success or failure</returns>
+    virtual bool WriteFrame(const RecordFrame& frame);
+
+    /// <summary>
+    /// Get file name extension of the stored frames
+    /// </summary>
+    virtual const char* GetFileExtension() const { return ".bmp"; }
+
+    /// <summary>
+    /// Close the list
+    /// </summary>
+    virtual void Close() { m_files.Close(); }
+
+    /// <summary>
+    /// Close the list and remove it along with the folder
+    /// </summary>
+    virtual void Discard() { m_files.Discard(); }
+
+private:
+    FrameFileSet    m_files;
+};
+
+/// <summary>
+/// Writes depth frames as 16-bit PNG images to depth\depth_[timestamp].png and logs them in depth.txt
+/// </summary>
+class PngDepthWriter : public FrameWriter
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="pDirectory">Directory to store in, nullptr for the current directory</param>
+    PngDepthWriter(const char* pDirectory = nullptr);
+
+    /// <summary>
+    /// Check whether the build can write PNG files, only those with OpenCV can
+    /// </summary>
+    static bool IsAvailable();
+
+    /// <summary>
+    /// Create the folder and open the list
+    /// </summary>
+    /// <returns>Indicates success or failure</returns>
+    virtual bool Open() { return m_files.Open(); }
+
+    /// <summary>
+    /// Encode and store a depth frame
+    /// </summary>
+    /// <param name="frame">Frame to write</param>
+    /// <returns>Indicates success or failure</returns>
+    virtual bool WriteFrame(const RecordFrame& frame);
+
+    /// <summary>
+    /// Get file name extension of the stored frames
+    /// </summary>
+    virtual const char* GetFileExtension() const { return ".png"; }
+
+    /// <summary>
+    /// Close the list
+    /// </summary>
+    virtual void Close() { m_files.Close(); }
+
+    /// <summary>
+    /// Close the list and remove it along with the folder
+    /// </summary>
+    virtual void Discard() { m_files.Discard(); }
+
+private:
+    FrameFileSet            m_files;
+    std::string             m_filename;     // Path handed to OpenCV, keeps its capacity from frame to frame
+    std::vector<uint16_t>   m_depthPlane;   // Depth split from the player index
+};
+
+/// <summary>
+/// Writes frames compressed by a FrameEncoder to rgb\rgb_[timestamp][ext] or depth\depth_[timestamp][ext]
+/// and logs them in rgb.txt or depth.txt. The recorder encodes a frame while the one before is stored
+/// </summary>
+class EncodedFrameWriter : public FrameWriter
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="stream">Stream the writer stores, selects folder and log file</param>
+    /// <param name="pEncoder">Encoder for the frames, owned by the writer</param>
+    /// <param name="pDirectory">Directory to store in, nullptr for the current directory</param>
+    EncodedFrameWriter(RecordStream stream, FrameEncoder* pEncoder, const char* pDirectory = nullptr);
+
+    /// <summary>
+    /// Start a new session of the encoder, create the folder and open the list
+    /// </summary>
+    /// <returns>Indicates success or failure</returns>
+    virtual bool Open();
+
+    /// <summary>
+    /// Encode and store a frame
+    /// </summary>
+    /// <param name="frame">Frame to write</param>
+    /// <returns>Indicates success or failure</returns>
+    virtual bool WriteFrame(const RecordFrame& frame);
+
+    /// <summary>
+    /// One frame at a time, the encoder may keep state from frame to frame
+    /// </summary>
+    virtual unsigned GetEncodeConcurrency() const { return 1; }
+
+    /// <summary>
+    /// Encode a frame ahead of StoreFrame
+    /// </summary>
+    /// <param name="frame">Frame to encode</param>
+    /// <param name="encoded">Receives the payload</param>
+    /// <returns>Indicates success or failure</returns>
+    virtual bool EncodeFrame(const RecordFrame& frame, EncodedFrame& encoded);
+
+    /// <summary>
+    /// Store an encoded frame and add it to the list
+    /// </summary>
+    /// <param name="frame">Frame to store</param>
+    /// <param name="encoded">Payload of the frame</param>
+    /// <returns>Indicates success or failure</returns>
+    virtual bool StoreFrame(const RecordFrame& frame, const EncodedFrame& encoded);
+
+    /// <summary>
+    /// Get file name extension of the stored frames
+    /// </summary>
+    virtual const char* GetFileExtension() const { return m_pEncoder->GetFileExtension(); }
+
+    /// <summary>
+    /// Close the list and log the compression achieved in the session
+    /// </summary>
+    virtual void Close();
+
+    /// <summary>
+    /// Close the list and remove it along with the folder
+    /// </summary>
+    virtual void Discard() { m_files.Discard(); }
+
+private:
+    RecordStream                    m_stream;
+    std::unique_ptr<FrameEncoder>   m_pEncoder;
+    FrameFileSet                    m_files;
+    EncodedFrame                    m_encoded;      // Payload of frames written by WriteFrame
+    bool                            m_storeFailed;  // Until a keyframe has been stored again
+};
+
+/// <summary>
+/// Like EncodedFrameWriter, but lets the recorder encode several frames at the same time, each with an
+/// encoder of its own, so slow encoders such as JPEG keep up with the sensor. Also logs encode time and
+/// size of every frame in rgb_encode.txt or depth_encode.txt
+/// </summary>
+class ParallelEncodedFrameWriter : public FrameWriter
+{
+public:
+    typedef std::function<FrameEncoder*()> EncoderFactory;
+
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="stream">Stream the writer stores, selects folder and log files</param>
+    /// <param name="createEncoder">Creates an encoder. Encoders must keep no state between frames</param>
+    /// <param name="concurrency">Number of frames encoded at the same time</param>
+    /// <param name="pDirectory">Directory to store in, nullptr for the current directory</param>
+    ParallelEncodedFrameWriter(RecordStream stream, const EncoderFactory& createEncoder, unsigned concurrency,
+                               const char* pDirectory = nullptr);
+
+    /// <summary>
+    /// Start a new session of the encoders and open the lists
+    /// </summary>
+    /// <returns>Indicates success or failure</returns>
+    virtual bool Open();
+
+    /// <summary>
+    /// Encode and store a frame
+    /// </summary>
+    /// <param name="frame">Frame to write</param>
+    /// <returns>Indicates success or failure</returns>
+    virtual bool WriteFrame(const RecordFrame& frame);
+
+    /// <summary>
+    /// Get the number of frames encoded at the same time
+    /// </summary>
+    virtual unsigned GetEncodeConcurrency() const { return m_concurrency; }
+
+    /// <summary>
+    /// Encode a frame with an encoder no other frame is using
+    /// </summary>
+    /// <param name="frame">Frame to encode</param>
+    /// <param name="encoded">Receives the payload and the encode time</param>
+    /// <returns>Indicates success or failure</returns>
+    virtual bool EncodeFrame(const RecordFrame& frame, EncodedFrame& encoded);
+
+    /// <summary>
+    /// Store an encoded frame, add it to the list and log its encode time and size
+    /// </summary>
+    /// <param name="frame">Frame to store</param>
+    /// <param name="encoded">Payload of the frame</param>
+    /// <returns>Indicates success or failure</returns>
+    virtual bool StoreFrame(const RecordFrame& frame, const EncodedFrame& encoded);
+
+    /// <summary>
+    /// Get file name extension of the stored frames
+    /// </summary>
+    virtual const char* GetFileExtension() const { return m_encoders[0]->GetFileExtension(); }
+
+    /// <summary>
+    /// Close the lists and log the compression achieved in the session
+    /// </summary>
+    virtual void Close();
+
+    /// <summary>
+    /// Close the lists and remove them along with the folder
+    /// </summary>
+    virtual void Discard();
+
+private:
+    RecordStream                                m_stream;
+    EncoderFactory                              m_createEncoder;
+    unsigned                                    m_concurrency;
+    std::mutex                                  m_lock;         // Guards the encoders
+    std::vector<std::unique_ptr<FrameEncoder>>  m_encoders;
+    std::vector<FrameEncoder*>                  m_idleEncoders;
+    FrameFileSet                                m_files;
+    FrameListFile                               m_encodeLog;
+    EncodedFrame                                m_encoded;      // Payload of frames written by WriteFrame
+};
+
+/// <summary>
+/// Write a 32-bit color image as a top-down bitmap file
+/// </summary>
+/// <param name="pBuffer">The pointer to the pixels</param>
+/// <param name="width">Width of the image</param>
+/// <param name="height">Height of the image</param>
+/// <param name="stride">Bytes per row in the buffer</param>
+/// <param name="pFilename">Path of the file</param>
+/// <returns>Indicates success or failure</returns>
+bool SaveRGBToBitmap(const uint8_t* pBuffer, int width, int height, int stride, const char* pFilename);
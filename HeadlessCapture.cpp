@@ -0,0 +1,218 @@
+//------------------------------------------------------------------------------
+// <copyright file="HeadlessCapture.cpp">
+//     Capture from a sensor without windows, configured from a profile file.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "HeadlessCapture.h"
+#include "NuiSensorSource.h"
+#include "Utility.h"
+
+#include <cstdio>
+
+CaptureSession* volatile HeadlessCapture::s_pActiveSession = nullptr;
+
+/// <summary>
+/// Constructor
+/// </summary>
+HeadlessCapture::HeadlessCapture()
+    : m_pSession(nullptr)
+    , m_pNuiSensor(nullptr)
+    , m_pSource(nullptr)
+    , m_pStreams(nullptr)
+{
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+HeadlessCapture::~HeadlessCapture()
+{
+    CleanUp();
+}
+
+/// <summary>
+/// Capture as the profile says and return when done
+/// </summary>
+/// <param name="pProfilePath">Path of the profile file</param>
+/// <returns>Exit code of the process, 0 on success</returns>
+int HeadlessCapture::Run(const char* pProfilePath)
+{
+    std::string error;
+    if (!LoadCaptureProfile(pProfilePath, m_profile, error))
+    {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+
+    if (!OpenSource())
+    {
+        return 1;
+    }
+
+    // The session enters the recording directory, everything after it writes there
+    m_pSession = new CaptureSession(m_profile);
+    if (!m_pSession->Open(error))
+    {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+
+    m_pStreams = new CaptureStreams(*m_pSource, *m_pSession);
+    if (!m_pSession->Start() || !m_pStreams->Start())
+    {
+        fprintf(stderr, "Streams of the source cannot be started\n");
+        return 1;
+    }
+
+    s_pActiveSession = m_pSession;
+    SetConsoleCtrlHandler(ConsoleCtrlHandler, TRUE);
+
+    // A replay opens the streams with the recorded sizes
+    const CaptureImageStream& color = m_pStreams->GetColorStream();
+    const CaptureImageStream& depth = m_pStreams->GetDepthStream();
+    if (m_profile.durationSeconds > 0.0)
+    {
+        printf("Recording color %ux%u and depth %ux%u for %.0f seconds\n",
+               color.GetWidth(), color.GetHeight(), depth.GetWidth(), depth.GetHeight(), m_profile.durationSeconds);
+    }
+    else
+    {
+        printf("Recording color %ux%u and depth %ux%u until Ctrl+C\n",
+               color.GetWidth(), color.GetHeight(), depth.GetWidth(), depth.GetHeight());
+    }
+    fflush(stdout);
+
+    m_pSession->Run([this](uint64_t frames[CaptureStreamCount]) { return m_pStreams->CountFrames(frames); }, stdout);
+
+    SetConsoleCtrlHandler(ConsoleCtrlHandler, FALSE);
+    s_pActiveSession = nullptr;
+
+    // Frames the writers failed to store make the capture fail, nobody watches an unattended one
+    m_pStreams->Stop();
+    m_pSession->Stop();
+    uint64_t failures = m_pSession->GetWriteFailures();
+
+    CleanUp();
+    printf("Recording stopped\n");
+    if (failures > 0)
+    {
+        fprintf(stderr, "%llu frames could not be written, see session.log\n", (unsigned long long)failures);
+        return 1;
+    }
+
+    return 0;
+}
+
+/// <summary>
+/// Create and initialize the sensor the profile selects
+/// </summary>
+/// <returns>Indicates success or failure</returns>
+bool HeadlessCapture::OpenSensor()
+{
+    int count = 0;
+    if (FAILED(NuiGetSensorCount(&count)) || m_profile.sensorIndex >= count)
+    {
+        return false;
+    }
+
+    if (FAILED(NuiCreateSensorByIndex(m_profile.sensorIndex, &m_pNuiSensor)) || S_OK != m_pNuiSensor->NuiStatus())
+    {
+        return false;
+    }
+
+    // No audio, and no skeletal engine unless skeletons are tracked
+    DWORD flags = NUI_INITIALIZE_FLAG_USES_COLOR;
+    flags |= m_profile.skeleton ? NUI_INITIALIZE_FLAG_USES_DEPTH_AND_PLAYER_INDEX | NUI_INITIALIZE_FLAG_USES_SKELETON
+                                : NUI_INITIALIZE_FLAG_USES_DEPTH;
+
+    HRESULT hr = m_pNuiSensor->NuiInitialize(flags);
+    if (FAILED(hr))
+    {
+        return false;
+    }
+
+    // Ensure infrared emitter enabled
+    m_pNuiSensor->NuiSetForceInfraredEmitterOff(FALSE);
+
+    return true;
+}
+
+/// <summary>
+/// Create the source the profile selects, the sensor or a stand-in for it
+/// </summary>
+/// <returns>Indicates success or failure</returns>
+bool HeadlessCapture::OpenSource()
+{
+    if (CaptureSourceKinect != m_profile.source)
+    {
+        // PNG and JPEG frames of a replay are skipped here, RgbdTool capture decodes them with its image library
+        std::string error;
+        m_pSource = CreateStandInSource(m_profile, ReplaySensorSource::ImageDecoder(), error);
+        if (!m_pSource)
+        {
+            fprintf(stderr, "%s\n", error.c_str());
+            return false;
+        }
+
+        return true;
+    }
+
+    if (!OpenSensor())
+    {
+        fprintf(stderr, "Sensor %d is not connected or cannot be initialized\n", m_profile.sensorIndex);
+        return false;
+    }
+
+    m_pSource = new NuiSensorSource(m_pNuiSensor);
+    return true;
+}
+
+/// <summary>
+/// Stop the dispatchers, then release streams, session, source and sensor in that order
+/// </summary>
+void HeadlessCapture::CleanUp()
+{
+    // Threads use the streams, stop them first
+    if (m_pStreams)
+    {
+        m_pStreams->Stop();
+    }
+
+    // The source sets the frame ready events of the streams until it is gone
+    SafeDelete(m_pSource);
+    SafeDelete(m_pStreams);
+
+    // Streams are gone, write out the frames still queued
+    SafeDelete(m_pSession);
+
+    if (m_pNuiSensor)
+    {
+        m_pNuiSensor->NuiShutdown();
+    }
+    SafeRelease(m_pNuiSensor);
+}
+
+/// <summary>
+/// Stop the capture on Ctrl+C, Ctrl+Break or when the console is closed
+/// </summary>
+BOOL WINAPI HeadlessCapture::ConsoleCtrlHandler(DWORD ctrlType)
+{
+    CaptureSession* pSession = s_pActiveSession;
+    if (!pSession)
+    {
+        return FALSE;
+    }
+
+    // Runs on a thread of its own. The capture winds down on the main thread, which writes out the queued frames
+    pSession->RequestStop();
+    if (CTRL_C_EVENT == ctrlType || CTRL_BREAK_EVENT == ctrlType)
+    {
+        return TRUE;
+    }
+
+    // The process ends when this returns for any other event, give the main thread a moment to finish
+    Sleep(3000);
+    return FALSE;
+}
@@ -0,0 +1,71 @@
+//------------------------------------------------------------------------------
+// <copyright file="HeadlessCapture.h">
+//     Capture from a sensor without windows, configured from a profile file.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <NuiApi.h>
+#include "CaptureSession.h"
+#include "CaptureStreams.h"
+
+/// <summary>
+/// Records a sensor with no window, message loop or viewer, e.g. on a production rig nobody watches. The
+/// streams run without viewers, so frames are copied once into the pool and handed to the recorder without
+/// any conversion for display. The profile may select a replay or generated frames instead of the sensor, to
+/// load-test the capture without one. Runs until the duration of the profile has passed, Ctrl+C is pressed or
+/// the source runs out of frames, printing throughput lines to the console.
+/// </summary>
+class HeadlessCapture
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    HeadlessCapture();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+   ~HeadlessCapture();
+
+    /// <summary>
+    /// Capture as the profile says and return when done
+    /// </summary>
+    /// <param name="pProfilePath">Path of the profile file</param>
+    /// <returns>Exit code of the process, 0 on success</returns>
+    int Run(const char* pProfilePath);
+
+private:
+    /// <summary>
+    /// Create and initialize the sensor the profile selects
+    /// </summary>
+    /// <returns>Indicates success or failure</returns>
+    bool OpenSensor();
+
+    /// <summary>
+    /// Create the source the profile selects, the sensor or a stand-in for it
+    /// </summary>
+    /// <returns>Indicates success or failure</returns>
+    bool OpenSource();
+
+    /// <summary>
+    /// Stop the dispatchers, then release streams, session, source and sensor in that order
+    /// </summary>
+    void CleanUp();
+
+    /// <summary>
+    /// Stop the capture on Ctrl+C, Ctrl+Break or when the console is closed
+    /// </summary>
+    static BOOL WINAPI ConsoleCtrlHandler(DWORD ctrlType);
+
+private:
+    CaptureProfile      m_profile;
+    CaptureSession*     m_pSession;
+    INuiSensor*         m_pNuiSensor;
+    SensorSource*       m_pSource;
+    CaptureStreams*     m_pStreams;
+
+    static CaptureSession* volatile s_pActiveSession;   // Session the console control handler stops
+};
@@ -183,6 +183,7 @@ void ImageRenderer::CreateSolidBrushes()
     CreateSolidBrush(D2D1::ColorF::White,       ImageRendererBrushWhite);
     CreateSolidBrush(D2D1::ColorF::Gray,        ImageRendererBrushGray);
     CreateSolidBrush(D2D1::ColorF::Green,       ImageRendererBrushGreen);
+    CreateSolidBrush(D2D1::ColorF::Red,         ImageRendererBrushRed);
 }
 
 /// <summary>
@@ -313,8 +314,9 @@ HRESULT ImageRenderer::ResizeRenderTarget(UINT width, UINT height)
 /// </summary>
 /// <param name="pImage">The pointer to image buffer</param>
 /// <param name="size">The image size</param>
+/// <param name="stride">Bytes per row of the image</param>
 /// <param name="rect">The rectangle in the window to render the image</param>
-void ImageRenderer::DrawImage(const BYTE* pImage, const D2D1_SIZE_U& size, const D2D1_RECT_F& rect)
+void ImageRenderer::DrawImage(const BYTE* pImage, const D2D1_SIZE_U& size, UINT stride, const D2D1_RECT_F& rect)
 {
     // Check image buffer pointer
     if (!pImage)
@@ -334,7 +336,7 @@ void ImageRenderer::DrawImage(const BYTE* pImage, const D2D1_SIZE_U& size, const
     if (SUCCEEDED(hr))
     {
         // Copy the image from image buffer to D2D1 bit map
-        hr = m_pBitmap->CopyFromMemory(NULL, pImage, size.width * sizeof(UINT));
+        hr = m_pBitmap->CopyFromMemory(NULL, pImage, stride);
         if (SUCCEEDED(hr))
         {
             // Draw the bitmap stretched to the size of the window
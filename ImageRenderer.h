@@ -18,6 +18,7 @@ enum ImageRendererBrush
     ImageRendererBrushWhite,
     ImageRendererBrushGray,
     ImageRendererBrushGreen,
+    ImageRendererBrushRed,
     ImageRendererBrushCount
 };
 
@@ -74,8 +75,9 @@ public:
     /// </summary>
     /// <param name="pImage">The pointer to image buffer</param>
     /// <param name="size">The image size</param>
+    /// <param name="stride">Bytes per row of the image</param>
     /// <param name="rect">The rectangle in the window to render the image</param>
-    void DrawImage(const BYTE* pImage, const D2D1_SIZE_U& size, const D2D1_RECT_F& rect);
+    void DrawImage(const BYTE* pImage, const D2D1_SIZE_U& size, UINT stride, const D2D1_RECT_F& rect);
 
     /// <summary>
     /// Draw FPS text
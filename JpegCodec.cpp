@@ -0,0 +1,109 @@
+//------------------------------------------------------------------------------
+// <copyright file="JpegCodec.cpp">
+//     Lossy compression of color frames to baseline JPEG.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "JpegCodec.h"
+
+// The only translation unit which compiles stb_image_write. Frames are encoded to memory, the writers do the file I/O
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#define STBI_WRITE_NO_STDIO
+#include "stb_image_write.h"
+
+namespace
+{
+    /// <summary>
+    /// stb_image_write output callback appending to a payload vector
+    /// </summary>
+    void AppendToPayload(void* pContext, void* pData, int size)
+    {
+        std::vector<uint8_t>* pPayload = static_cast<std::vector<uint8_t>*>(pContext);
+        const uint8_t*        pBytes   = static_cast<const uint8_t*>(pData);
+        pPayload->insert(pPayload->end(), pBytes, pBytes + size);
+    }
+}
+
+/// <summary>
+/// Read the image size from the frame header of a JPEG payload
+/// </summary>
+/// <returns>False if the payload is not a JPEG image or has no frame header</returns>
+bool JpegGetSize(const uint8_t* pPayload, size_t size, uint32_t& width, uint32_t& height)
+{
+    if (size < 4 || 0xFF != pPayload[0] || 0xD8 != pPayload[1])
+    {
+        return false;
+    }
+
+    // Walk the marker segments up to the first start-of-frame (SOF0 to SOF2)
+    size_t offset = 2;
+    while (offset + 4 <= size && 0xFF == pPayload[offset])
+    {
+        uint8_t marker = pPayload[offset + 1];
+        size_t  length = ((size_t)pPayload[offset + 2] << 8) | pPayload[offset + 3];
+
+        if (marker >= 0xC0 && marker <= 0xC2)
+        {
+            // Length, precision, then big-endian height and width
+            if (offset + 9 > size)
+            {
+                return false;
+            }
+            height = ((uint32_t)pPayload[offset + 5] << 8) | pPayload[offset + 6];
+            width  = ((uint32_t)pPayload[offset + 7] << 8) | pPayload[offset + 8];
+            return true;
+        }
+
+        offset += 2 + length;
+    }
+
+    return false;
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="quality">JPEG quality from 1 (smallest) to 100 (best)</param>
+JpegColorEncoder::JpegColorEncoder(int quality)
+    : m_quality(quality < 1 ? 1 : (quality > 100 ? 100 : quality))
+{
+}
+
+/// <summary>
+/// Encode a color frame
+/// </summary>
+/// <param name="frame">Frame to encode, must be RecordPixelFormatBgra32</param>
+/// <param name="payload">Receives the encoded payload</param>
+/// <param name="keyframe">Receives true, every JPEG frame decodes on its own</param>
+/// <returns>Indicates success or failure</returns>
+bool JpegColorEncoder::EncodeFrame(const RecordFrame& frame, std::vector<uint8_t>& payload, bool& keyframe)
+{
+    if (RecordPixelFormatBgra32 != frame.format || 0 == frame.width || 0 == frame.height ||
+        frame.width > 0xFFFF || frame.height > 0xFFFF ||
+        frame.data.size() < (size_t)frame.stride * frame.height)
+    {
+        return false;
+    }
+
+    m_rgb.resize((size_t)frame.width * frame.height * 3);
+    uint8_t* pOut = m_rgb.data();
+    for (uint32_t y = 0; y < frame.height; y++)
+    {
+        const uint8_t* pPixel = frame.data.data() + (size_t)y * frame.stride;
+        for (uint32_t x = 0; x < frame.width; x++, pPixel += 4, pOut += 3)
+        {
+            pOut[0] = pPixel[2];
+            pOut[1] = pPixel[1];
+            pOut[2] = pPixel[0];
+        }
+    }
+
+    payload.clear();
+    if (!stbi_write_jpg_to_func(AppendToPayload, &payload, (int)frame.width, (int)frame.height, 3, m_rgb.data(), m_quality))
+    {
+        return false;
+    }
+
+    keyframe = true;
+    return true;
+}
@@ -0,0 +1,59 @@
+//------------------------------------------------------------------------------
+// <copyright file="JpegCodec.h">
+//     Lossy compression of color frames to baseline JPEG.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "FrameCodec.h"
+
+// Payloads are complete JFIF files written by the vendored stb_image_write.h, so frames stored
+// as separate .jpg files open in any image viewer. The fourth byte of BGRA32 frames is dropped.
+// There is no JPEG decoder in the tree: the offline tools pass JPEG payloads through unchanged.
+
+/// <summary>
+/// Read the image size from the frame header of a JPEG payload
+/// </summary>
+/// <returns>False if the payload is not a JPEG image or has no frame header</returns>
+bool JpegGetSize(const uint8_t* pPayload, size_t size, uint32_t& width, uint32_t& height);
+
+/// <summary>
+/// Lossy color encoder. Keeps no state between frames, so several instances
+/// can encode consecutive frames of a stream in parallel.
+/// </summary>
+class JpegColorEncoder : public FrameEncoder
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="quality">JPEG quality from 1 (smallest) to 100 (best)</param>
+    JpegColorEncoder(int quality = DefaultQuality);
+
+    static const int DefaultQuality = 90;
+
+    /// <summary>
+    /// Get the codec the payloads are encoded with
+    /// </summary>
+    virtual RecordCodec GetCodec() const { return RecordCodecJpeg; }
+
+    /// <summary>
+    /// Get file name extension for payloads stored as separate files
+    /// </summary>
+    virtual const char* GetFileExtension() const { return ".jpg"; }
+
+protected:
+    /// <summary>
+    /// Encode a color frame
+    /// </summary>
+    /// <param name="frame">Frame to encode, must be RecordPixelFormatBgra32</param>
+    /// <param name="payload">Receives the encoded payload</param>
+    /// <param name="keyframe">Receives true, every JPEG frame decodes on its own</param>
+    /// <returns>Indicates success or failure</returns>
+    virtual bool EncodeFrame(const RecordFrame& frame, std::vector<uint8_t>& payload, bool& keyframe);
+
+private:
+    int                     m_quality;
+    std::vector<uint8_t>    m_rgb;          // Frame converted to the packed RGB rows stb_image_write expects
+};
@@ -11,6 +11,7 @@
 #include "KinectWindow.h"
 #include "CameraColorSettingsViewer.h"
 #include "CameraExposureSettingsViewer.h"
+#include "JpegCodec.h"
 
 /// <summary>
 /// Return the chooser mode based on the given command Id
@@ -54,7 +55,9 @@ ChooserMode ConvertCommandIdToChooserMode(WORD commandId)
 /// <param name="pColorStream">The pointer to color stream object instance</param>
 /// <param name="pDepthStream">The pointer to depth stream object instance</param>
 /// <param name="pSkeletonStream">The pointer to skeleton stream object instance</param>
-KinectSettings::KinectSettings(INuiSensor* pNuiSensor, NuiStreamViewer* pPrimaryView, NuiStreamViewer* pSecondaryView, NuiColorStream* pColorStream, NuiDepthStream* pDepthStream, NuiSkeletonStream* pSkeletonStream, CameraSettingsViewer* pColorSettingsView, CameraSettingsViewer* pExposureSettingsView)
+/// <param name="pRecorder">The pointer to frame recorder instance</param>
+/// <param name="pFramePool">The pointer to pool the streams copy frames into</param>
+KinectSettings::KinectSettings(INuiSensor* pNuiSensor, NuiStreamViewer* pPrimaryView, NuiStreamViewer* pSecondaryView, NuiColorStream* pColorStream, NuiDepthStream* pDepthStream, NuiSkeletonStream* pSkeletonStream, CameraSettingsViewer* pColorSettingsView, CameraSettingsViewer* pExposureSettingsView, FrameRecorder* pRecorder, FramePool* pFramePool)
     : m_pNuiSensor(pNuiSensor)
     , m_pPrimaryView(pPrimaryView)
     , m_pSecondaryView(pSecondaryView)
@@ -63,8 +66,24 @@ KinectSettings::KinectSettings(INuiSensor* pNuiSensor, NuiStreamViewer* pPrimary
     , m_pSkeletonStream(pSkeletonStream)
     , m_pColorSettingsView(pColorSettingsView)
     , m_pExposureSettingsView(pExposureSettingsView)
+    , m_pRecorder(pRecorder)
+    , m_pFramePool(pFramePool)
+    , m_recordingOutput(RecordingOutputImageFiles)
+    , m_recordingDepthFormat(RecordingDepthFormatPng)
+    , m_recordingColorFormat(RecordingColorFormatBmp)
+    , m_jpegQuality(JpegColorEncoder::DefaultQuality)
+    , m_skipUnpaired(false)
+    , m_largePages(false)
+    , m_preTriggerSeconds(0.0)
+    , m_preTriggerMemory(PRETRIGGER_DEFAULT_MEMORY)
+    , m_preTriggerCompress(false)
+    , m_splitSeconds(0.0)
+    , m_splitBytes(0)
 {
     m_pNuiSensor->AddRef();
+
+    // Default output keeps the familiar rgb and depth folder layout
+    SetRecordingOutput(m_recordingOutput);
 }
 
 /// <summary>
@@ -99,43 +118,45 @@ void KinectSettings::ProcessMenuCommand(WORD commandId, WORD param, bool previou
             return;
         }
 
+        NUI_IMAGE_TYPE       type;
+        NUI_IMAGE_RESOLUTION resolution;
         switch (commandId)
         {
         case ID_RESOLUTION_RGBRESOLUTION640X480FPS30:
-            m_pColorStream->SetImageType(NUI_IMAGE_TYPE_COLOR);
-            m_pColorStream->SetImageResolution(NUI_IMAGE_RESOLUTION_640x480);
+            type       = NUI_IMAGE_TYPE_COLOR;
+            resolution = NUI_IMAGE_RESOLUTION_640x480;
             break;
 
         case ID_RESOLUTION_RGBRESOLUTION1280X960FPS12:
-            m_pColorStream->SetImageType(NUI_IMAGE_TYPE_COLOR);
-            m_pColorStream->SetImageResolution(NUI_IMAGE_RESOLUTION_1280x960);
+            type       = NUI_IMAGE_TYPE_COLOR;
+            resolution = NUI_IMAGE_RESOLUTION_1280x960;
             break;
 
         case ID_RESOLUTION_YUVRESOLUTION640X480FPS15:
-            m_pColorStream->SetImageType(NUI_IMAGE_TYPE_COLOR_YUV);
-            m_pColorStream->SetImageResolution(NUI_IMAGE_RESOLUTION_640x480);
+            type       = NUI_IMAGE_TYPE_COLOR_YUV;
+            resolution = NUI_IMAGE_RESOLUTION_640x480;
             break;
 
         case ID_RESOLUTION_INFRAREDRESOLUTION640X480FPS30:
-            m_pColorStream->SetImageType(NUI_IMAGE_TYPE_COLOR_INFRARED);
-            m_pColorStream->SetImageResolution(NUI_IMAGE_RESOLUTION_640x480);
+            type       = NUI_IMAGE_TYPE_COLOR_INFRARED;
+            resolution = NUI_IMAGE_RESOLUTION_640x480;
             break;
 
         case ID_RESOLUTION_RAWBAYERRESOLUTION640X480FPS30:
-            m_pColorStream->SetImageType(NUI_IMAGE_TYPE_COLOR_RAW_BAYER);
-            m_pColorStream->SetImageResolution(NUI_IMAGE_RESOLUTION_640x480);
+            type       = NUI_IMAGE_TYPE_COLOR_RAW_BAYER;
+            resolution = NUI_IMAGE_RESOLUTION_640x480;
             break;
 
         case ID_RESOLUTION_RAWBAYERRESOLUTION1280X960FPS12:
-            m_pColorStream->SetImageType(NUI_IMAGE_TYPE_COLOR_RAW_BAYER);
-            m_pColorStream->SetImageResolution(NUI_IMAGE_RESOLUTION_1280x960);
+            type       = NUI_IMAGE_TYPE_COLOR_RAW_BAYER;
+            resolution = NUI_IMAGE_RESOLUTION_1280x960;
             break;
 
         default:
             return;
         }
 
-        m_pColorStream->OpenStream();
+        m_pColorStream->OpenStream(type, resolution);
     }
     else if (ID_DEPTHSTREAM_PAUSE == commandId)
     {
@@ -231,6 +252,192 @@ void KinectSettings::ProcessMenuCommand(WORD commandId, WORD param, bool previou
 
         m_pSkeletonStream->SetChooserMode(ConvertCommandIdToChooserMode(commandId));
     }
+    else if (ID_RECORDING_OUTPUT_START <= commandId && ID_RECORDING_OUTPUT_END >= commandId)
+    {
+        // Set recording output type
+        switch (commandId)
+        {
+        case ID_OUTPUT_IMAGEFILES:
+            SetRecordingOutput(RecordingOutputImageFiles);
+            break;
+
+        case ID_OUTPUT_CONTAINERFILE:
+            SetRecordingOutput(RecordingOutputContainer);
+            break;
+
+        default:
+            return;
+        }
+    }
+    else if (ID_RECORDING_DEPTHFORMAT_START <= commandId && ID_RECORDING_DEPTHFORMAT_END >= commandId)
+    {
+        // Set recorded depth format
+        switch (commandId)
+        {
+        case ID_DEPTHFORMAT_PNG:
+            SetRecordingDepthFormat(RecordingDepthFormatPng);
+            break;
+
+        case ID_DEPTHFORMAT_RVL:
+            SetRecordingDepthFormat(RecordingDepthFormatRvl);
+            break;
+
+        case ID_DEPTHFORMAT_TEMPORAL:
+            SetRecordingDepthFormat(RecordingDepthFormatTemporal);
+            break;
+
+        default:
+            return;
+        }
+    }
+    else if (ID_RECORDING_COLORFORMAT_START <= commandId && ID_RECORDING_COLORFORMAT_END >= commandId)
+    {
+        // Set recorded color format
+        switch (commandId)
+        {
+        case ID_COLORFORMAT_BMP:
+            SetRecordingColorFormat(RecordingColorFormatBmp);
+            break;
+
+        case ID_COLORFORMAT_QOI:
+            SetRecordingColorFormat(RecordingColorFormatQoi);
+            break;
+
+        case ID_COLORFORMAT_JPEG95:
+            m_jpegQuality = 95;
+            SetRecordingColorFormat(RecordingColorFormatJpeg);
+            break;
+
+        case ID_COLORFORMAT_JPEG90:
+            m_jpegQuality = 90;
+            SetRecordingColorFormat(RecordingColorFormatJpeg);
+            break;
+
+        case ID_COLORFORMAT_JPEG75:
+            m_jpegQuality = 75;
+            SetRecordingColorFormat(RecordingColorFormatJpeg);
+            break;
+
+        default:
+            return;
+        }
+    }
+    else if (ID_RECORDING_DROPPOLICY_START <= commandId && ID_RECORDING_DROPPOLICY_END >= commandId)
+    {
+        // Set what happens to frames while the disk falls behind
+        switch (commandId)
+        {
+        case ID_DROPPOLICY_BLOCK:
+            SetRecordingDropPolicy(RecordDropPolicyBlock);
+            break;
+
+        case ID_DROPPOLICY_DROPNEWEST:
+            SetRecordingDropPolicy(RecordDropPolicyNewest);
+            break;
+
+        case ID_DROPPOLICY_DROPOLDEST:
+            SetRecordingDropPolicy(RecordDropPolicyOldest);
+            break;
+
+        case ID_DROPPOLICY_DROPCOLORFIRST:
+            SetRecordingDropPolicy(RecordDropPolicyColorFirst);
+            break;
+
+        default:
+            return;
+        }
+    }
+    else if (ID_RECORDING_PRETRIGGER_START <= commandId && ID_RECORDING_PRETRIGGER_END >= commandId)
+    {
+        // Set how many seconds before recording starts are kept
+        switch (commandId)
+        {
+        case ID_PRETRIGGER_OFF:
+            SetRecordingPreTrigger(0.0);
+            break;
+
+        case ID_PRETRIGGER_5S:
+            SetRecordingPreTrigger(5.0);
+            break;
+
+        case ID_PRETRIGGER_10S:
+            SetRecordingPreTrigger(10.0);
+            break;
+
+        case ID_PRETRIGGER_30S:
+            SetRecordingPreTrigger(30.0);
+            break;
+
+        default:
+            return;
+        }
+    }
+    else if (ID_RECORDING_PRETRIGGERMEMORY_START <= commandId && ID_RECORDING_PRETRIGGERMEMORY_END >= commandId)
+    {
+        // Set the memory kept for each stream
+        switch (commandId)
+        {
+        case ID_PRETRIGGERMEMORY_128MB:
+            SetRecordingPreTriggerMemory((size_t)128 << 20);
+            break;
+
+        case ID_PRETRIGGERMEMORY_512MB:
+            SetRecordingPreTriggerMemory((size_t)512 << 20);
+            break;
+
+        default:
+            return;
+        }
+    }
+    else if (ID_RECORDING_SPLIT_START <= commandId && ID_RECORDING_SPLIT_END >= commandId)
+    {
+        // Set when a new segment starts
+        switch (commandId)
+        {
+        case ID_SPLIT_OFF:
+            SetRecordingSplit(0.0, 0);
+            break;
+
+        case ID_SPLIT_1MIN:
+            SetRecordingSplit(60.0, 0);
+            break;
+
+        case ID_SPLIT_10MIN:
+            SetRecordingSplit(600.0, 0);
+            break;
+
+        case ID_SPLIT_1GB:
+            SetRecordingSplit(0.0, (uint64_t)1 << 30);
+            break;
+
+        case ID_SPLIT_4GB:
+            SetRecordingSplit(0.0, (uint64_t)4 << 30);
+            break;
+
+        default:
+            return;
+        }
+    }
+    else if (ID_PRETRIGGER_COMPRESS == commandId)
+    {
+        // Keep frames compressed or as they are
+        SetRecordingPreTriggerCompression(!previouslyChecked);
+    }
+    else if (ID_RECORDING_RECORD == commandId)
+    {
+        // Start or stop recording
+        SetRecording(!previouslyChecked);
+    }
+    else if (ID_RECORDING_SKIPUNPAIRED == commandId)
+    {
+        // Drop or keep frames without a partner
+        SetRecordingSkipUnpaired(!previouslyChecked);
+    }
+    else if (ID_RECORDING_LARGEPAGES == commandId)
+    {
+        // Back recorded frames with large pages or normal pages
+        SetRecordingLargePages(!previouslyChecked);
+    }
     else
     {
         switch (commandId)
@@ -261,4 +468,208 @@ void KinectSettings::ProcessMenuCommand(WORD commandId, WORD param, bool previou
             break;
         }
     }
+}
+
+/// <summary>
+/// Attach the writers of an output type to the recorder. Restarts the recorder if it is running
+/// </summary>
+/// <param name="output">Recording output type</param>
+void KinectSettings::SetRecordingOutput(RecordingOutput output)
+{
+    if (!m_pRecorder)
+    {
+        return;
+    }
+
+    m_recordingOutput = output;
+
+    // Writers can only be replaced while the recorder is stopped
+    bool running = m_pRecorder->IsRecording(RecordStreamColor) || m_pRecorder->IsRecording(RecordStreamDepth);
+    StopRecorder();
+
+    RecordingOptions options;
+    options.output       = output;
+    options.depthFormat  = m_recordingDepthFormat;
+    options.colorFormat  = m_recordingColorFormat;
+    options.jpegQuality  = m_jpegQuality;
+    options.skipUnpaired = m_skipUnpaired;
+    options.splitSeconds = m_splitSeconds;
+    options.splitBytes   = m_splitBytes;
+    SetUpRecorder(*m_pRecorder, options);
+
+    if (running)
+    {
+        m_pRecorder->Start();
+    }
+}
+
+/// <summary>
+/// Select the encoding of recorded depth frames. Restarts the recorder if it is running
+/// </summary>
+/// <param name="format">Depth format</param>
+void KinectSettings::SetRecordingDepthFormat(RecordingDepthFormat format)
+{
+    m_recordingDepthFormat = format;
+
+    // Writers own their encoders, so they are recreated for the new format
+    SetRecordingOutput(m_recordingOutput);
+}
+
+/// <summary>
+/// Select the encoding of recorded color frames. Restarts the recorder if it is running
+/// </summary>
+/// <param name="format">Color format</param>
+void KinectSettings::SetRecordingColorFormat(RecordingColorFormat format)
+{
+    m_recordingColorFormat = format;
+
+    // Writers own their encoders, so they are recreated for the new format
+    SetRecordingOutput(m_recordingOutput);
+}
+
+/// <summary>
+/// Select whether frames without a partner in the other stream are recorded. Restarts the recorder if it is running
+/// </summary>
+/// <param name="skip">True to drop unpaired frames</param>
+void KinectSettings::SetRecordingSkipUnpaired(bool skip)
+{
+    m_skipUnpaired = skip;
+
+    // The associator is recreated along with the writers
+    SetRecordingOutput(m_recordingOutput);
+}
+
+/// <summary>
+/// Select what happens to frames while the recorder queues are full. Takes effect without restarting the recorder
+/// </summary>
+/// <param name="policy">Drop policy</param>
+void KinectSettings::SetRecordingDropPolicy(RecordDropPolicy policy)
+{
+    if (m_pRecorder)
+    {
+        m_pRecorder->SetDropPolicy(policy);
+    }
+}
+
+/// <summary>
+/// Start or stop recording. Frames kept by the pre-trigger buffers are recorded first
+/// </summary>
+/// <param name="record">True to start recording</param>
+void KinectSettings::SetRecording(bool record)
+{
+    if (!m_pRecorder)
+    {
+        return;
+    }
+
+    if (record)
+    {
+        m_pRecorder->Start();
+    }
+    else
+    {
+        StopRecorder();
+    }
+}
+
+/// <summary>
+/// Stop the recorder once the streams have handed over the pre-trigger frames of the recording
+/// </summary>
+void KinectSettings::StopRecorder()
+{
+    if (m_pColorStream)
+    {
+        m_pColorStream->FlushPreTrigger();
+    }
+    if (m_pDepthStream)
+    {
+        m_pDepthStream->FlushPreTrigger();
+    }
+
+    m_pRecorder->Stop();
+}
+
+/// <summary>
+/// Select how many seconds of frames before recording starts are kept in memory
+/// </summary>
+/// <param name="seconds">Length of the window, 0 to keep none</param>
+void KinectSettings::SetRecordingPreTrigger(double seconds)
+{
+    m_preTriggerSeconds = seconds;
+    ApplyPreTrigger();
+}
+
+/// <summary>
+/// Select the memory each stream keeps its pre-trigger frames in
+/// </summary>
+/// <param name="memoryBytes">Memory per stream</param>
+void KinectSettings::SetRecordingPreTriggerMemory(size_t memoryBytes)
+{
+    m_preTriggerMemory = memoryBytes;
+    ApplyPreTrigger();
+}
+
+/// <summary>
+/// Select whether pre-trigger frames are compressed in memory
+/// </summary>
+/// <param name="compress">True to keep frames compressed with the lossless codecs</param>
+void KinectSettings::SetRecordingPreTriggerCompression(bool compress)
+{
+    m_preTriggerCompress = compress;
+    ApplyPreTrigger();
+}
+
+/// <summary>
+/// Give the streams new pre-trigger buffers for the current settings. Frames kept so far are dropped
+/// </summary>
+void KinectSettings::ApplyPreTrigger()
+{
+    PreTriggerBuffer* pColorBuffer = CreatePreTriggerBuffer(RecordStreamColor, m_preTriggerSeconds, m_preTriggerMemory, m_preTriggerCompress);
+    PreTriggerBuffer* pDepthBuffer = CreatePreTriggerBuffer(RecordStreamDepth, m_preTriggerSeconds, m_preTriggerMemory, m_preTriggerCompress);
+
+    if (m_pColorStream)
+    {
+        m_pColorStream->SetPreTriggerBuffer(pColorBuffer);
+    }
+    else
+    {
+        delete pColorBuffer;
+    }
+
+    if (m_pDepthStream)
+    {
+        m_pDepthStream->SetPreTriggerBuffer(pDepthBuffer);
+    }
+    else
+    {
+        delete pDepthBuffer;
+    }
+}
+
+/// <summary>
+/// Select when the recording is split into a new segment. Restarts the recorder if it is running
+/// </summary>
+/// <param name="seconds">Time after which a new segment starts, 0 for no limit</param>
+/// <param name="bytes">Size after which a new segment starts, 0 for no limit</param>
+void KinectSettings::SetRecordingSplit(double seconds, uint64_t bytes)
+{
+    m_splitSeconds = seconds;
+    m_splitBytes   = bytes;
+
+    // The segmenter is recreated along with the writers
+    SetRecordingOutput(m_recordingOutput);
+}
+
+/// <summary>
+/// Select whether frames are allocated with large pages
+/// </summary>
+/// <param name="largePages">True to try large pages</param>
+void KinectSettings::SetRecordingLargePages(bool largePages)
+{
+    m_largePages = largePages;
+    if (m_pFramePool)
+    {
+        // Frames still held keep their old arena until they are released
+        m_pFramePool->SetLargePages(m_largePages);
+    }
 }
\ No newline at end of file
@@ -11,6 +11,9 @@
 #include "NuiDepthStream.h"
 #include "NuiSkeletonStream.h"
 #include "CameraSettingsViewer.h"
+#include "FrameCodec.h"
+#include "FrameRecorder.h"
+#include "RecordingSetup.h"
 
 class KinectSettings
 {
@@ -24,7 +27,9 @@ public:
     /// <param name="pColorStream">The pointer to color stream object instance</param>
     /// <param name="pDepthStream">The pointer to depth stream object instance</param>
     /// <param name="pSkeletonStream">The pointer to skeleton stream object instance</param>
-    KinectSettings(INuiSensor* pNuiSensor, NuiStreamViewer* pPrimaryView, NuiStreamViewer* pSecondarView, NuiColorStream* pColorStream, NuiDepthStream* pDepthStream, NuiSkeletonStream* pSkeletonStream, CameraSettingsViewer* pColorSettingsView, CameraSettingsViewer* pExposureSettingsView);
+    /// <param name="pRecorder">The pointer to frame recorder instance</param>
+    /// <param name="pFramePool">The pointer to pool the streams copy frames into</param>
+    KinectSettings(INuiSensor* pNuiSensor, NuiStreamViewer* pPrimaryView, NuiStreamViewer* pSecondarView, NuiColorStream* pColorStream, NuiDepthStream* pDepthStream, NuiSkeletonStream* pSkeletonStream, CameraSettingsViewer* pColorSettingsView, CameraSettingsViewer* pExposureSettingsView, FrameRecorder* pRecorder, FramePool* pFramePool);
 
     /// <summary>
     /// Destructor
@@ -40,6 +45,84 @@ public:
     /// <param name="previouslyChecked">Check status of menu item before command is issued</param>
     void ProcessMenuCommand(WORD commandId, WORD param, bool previouslyChecked);
 
+private:
+    /// <summary>
+    /// Attach the writers of an output type to the recorder. Restarts the recorder if it is running
+    /// </summary>
+    /// <param name="output">Recording output type</param>
+    void SetRecordingOutput(RecordingOutput output);
+
+    /// <summary>
+    /// Select the encoding of recorded depth frames. Restarts the recorder if it is running
+    /// </summary>
+    /// <param name="format">Depth format</param>
+    void SetRecordingDepthFormat(RecordingDepthFormat format);
+
+    /// <summary>
+    /// Select the encoding of recorded color frames. Restarts the recorder if it is running
+    /// </summary>
+    /// <param name="format">Color format</param>
+    void SetRecordingColorFormat(RecordingColorFormat format);
+
+    /// <summary>
+    /// Select whether frames without a partner in the other stream are recorded. Restarts the recorder if it is running
+    /// </summary>
+    /// <param name="skip">True to drop unpaired frames</param>
+    void SetRecordingSkipUnpaired(bool skip);
+
+    /// <summary>
+    /// Select what happens to frames while the recorder queues are full. Takes effect without restarting the recorder
+    /// </summary>
+    /// <param name="policy">Drop policy</param>
+    void SetRecordingDropPolicy(RecordDropPolicy policy);
+
+    /// <summary>
+    /// Select when the recording is split into a new segment. Restarts the recorder if it is running
+    /// </summary>
+    /// <param name="seconds">Time after which a new segment starts, 0 for no limit</param>
+    /// <param name="bytes">Size after which a new segment starts, 0 for no limit</param>
+    void SetRecordingSplit(double seconds, uint64_t bytes);
+
+    /// <summary>
+    /// Select whether frames are allocated with large pages
+    /// </summary>
+    /// <param name="largePages">True to try large pages</param>
+    void SetRecordingLargePages(bool largePages);
+
+    /// <summary>
+    /// Start or stop recording. Frames kept by the pre-trigger buffers are recorded first
+    /// </summary>
+    /// <param name="record">True to start recording</param>
+    void SetRecording(bool record);
+
+    /// <summary>
+    /// Select how many seconds of frames before recording starts are kept in memory
+    /// </summary>
+    /// <param name="seconds">Length of the window, 0 to keep none</param>
+    void SetRecordingPreTrigger(double seconds);
+
+    /// <summary>
+    /// Select the memory each stream keeps its pre-trigger frames in
+    /// </summary>
+    /// <param name="memoryBytes">Memory per stream</param>
+    void SetRecordingPreTriggerMemory(size_t memoryBytes);
+
+    /// <summary>
+    /// Select whether pre-trigger frames are compressed in memory
+    /// </summary>
+    /// <param name="compress">True to keep frames compressed with the lossless codecs</param>
+    void SetRecordingPreTriggerCompression(bool compress);
+
+    /// <summary>
+    /// Give the streams new pre-trigger buffers for the current settings. Frames kept so far are dropped
+    /// </summary>
+    void ApplyPreTrigger();
+
+    /// <summary>
+    /// Stop the recorder once the streams have handed over the pre-trigger frames of the recording
+    /// </summary>
+    void StopRecorder();
+
 private:
     INuiSensor*              m_pNuiSensor;
     // Stream viewers
@@ -54,4 +137,19 @@ private:
     // Camera settings
     CameraSettingsViewer*     m_pColorSettingsView;
     CameraSettingsViewer*     m_pExposureSettingsView;
+
+    // Recording
+    FrameRecorder*           m_pRecorder;
+    FramePool*               m_pFramePool;
+    RecordingOutput          m_recordingOutput;
+    RecordingDepthFormat     m_recordingDepthFormat;
+    RecordingColorFormat     m_recordingColorFormat;
+    int                      m_jpegQuality;
+    bool                     m_skipUnpaired;
+    bool                     m_largePages;
+    double                   m_preTriggerSeconds;
+    size_t                   m_preTriggerMemory;
+    bool                     m_preTriggerCompress;
+    double                   m_splitSeconds;
+    uint64_t                 m_splitBytes;
 };
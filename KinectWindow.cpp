@@ -96,12 +96,13 @@ KinectWindow::KinectWindow(HINSTANCE hInstance, HWND hWndParent, INuiSensor* pNu
     m_tabbedViews.push_back((m_pAccelView));
     m_tabbedViews.push_back((m_pTiltAngleView));
 
-    // Create stream objects
-    m_pColorStream         = new NuiColorStream(m_pNuiSensor);
-    m_pDepthStream         = new NuiDepthStream(m_pNuiSensor);
-    m_pSkeletonStream      = new NuiSkeletonStream(m_pNuiSensor);
+    // Create stream objects. Image, skeleton and accelerometer streams take their frames through the source
+    m_pSensorSource        = new NuiSensorSource(m_pNuiSensor);
+    m_pColorStream         = new NuiColorStream(m_pSensorSource);
+    m_pDepthStream         = new NuiDepthStream(m_pSensorSource);
+    m_pSkeletonStream      = new NuiSkeletonStream(m_pSensorSource);
     m_pAudioStream         = new NuiAudioStream(m_pNuiSensor);
-    m_pAccelerometerStream = new NuiAccelerometerStream(m_pNuiSensor);
+    m_pAccelerometerStream = new NuiAccelerometerStream(m_pSensorSource);
 
     // Attach stream objects to viewers
     m_pColorStream->SetStreamViewer(m_pPrimaryView);
@@ -111,6 +112,34 @@ KinectWindow::KinectWindow(HINSTANCE hInstance, HWND hWndParent, INuiSensor* pNu
     m_pAudioStream->SetStreamViewer(m_pAudioView);
     m_pAccelerometerStream->SetStreamViewer(m_pAccelView);
 
+    // Color and depth frames are copied once into the pool and shared by the viewers and the recorder
+    m_pFramePool = new FramePool();
+    m_pColorStream->SetFramePool(m_pFramePool);
+    m_pDepthStream->SetFramePool(m_pFramePool);
+
+    // Frames are converted for display, encoded and written on a pool shared by the streams
+    m_pTaskPool = new TaskPool();
+    m_pDepthStream->SetTaskPool(m_pTaskPool);
+
+    // Create recorder and attach it to the image streams. Writers are attached by settings object
+    m_pRecorder = new FrameRecorder(*m_pTaskPool);
+    m_pRecorder->SetFramePool(m_pFramePool);
+    m_pColorStream->SetFrameRecorder(m_pRecorder);
+    m_pDepthStream->SetFrameRecorder(m_pRecorder);
+
+    // Color and depth frames are stamped by the same sensor clock
+    m_pSensorClock = new SensorClock();
+    m_pColorStream->SetSensorClock(m_pSensorClock);
+    m_pDepthStream->SetSensorClock(m_pSensorClock);
+
+    // Frame ready events are routed straight to their streams. Color, the largest frames, has a thread of
+    // its own, depth and skeleton frames arrive together and are serviced in the same wakeup
+    m_pColorDispatcher = new EventDispatcher();
+    m_pColorDispatcher->Add("color", m_pColorStream->GetFrameReadyEvent(), [this]() { m_pColorStream->DispatchFrame(); });
+    m_pDepthDispatcher = new EventDispatcher();
+    m_pDepthDispatcher->Add("depth", m_pDepthStream->GetFrameReadyEvent(), [this]() { m_pDepthStream->DispatchFrame(); });
+    m_pDepthDispatcher->Add("skeleton", m_pSkeletonStream->GetFrameReadyEvent(), [this]() { m_pSkeletonStream->DispatchFrame(); });
+
     // Create settings object
     m_pSettings = new KinectSettings(m_pNuiSensor,
                                      m_pPrimaryView,
@@ -119,7 +148,9 @@ KinectWindow::KinectWindow(HINSTANCE hInstance, HWND hWndParent, INuiSensor* pNu
                                      m_pDepthStream,
                                      m_pSkeletonStream,
                                      m_pColorSettingsView,
-                                     m_pExposureSettingsView);
+                                     m_pExposureSettingsView,
+                                     m_pRecorder,
+                                     m_pFramePool);
 }
 
 /// <summary>
@@ -353,10 +384,6 @@ LRESULT KinectWindow::DialogProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lPa
 {
     switch (uMsg)
     {
-    case WM_STREAMEVENT:
-        UpdateStreams();
-        break;
-
     case WM_TIMEREVENT:
         UpdateTimedStreams();
         break;
@@ -531,6 +558,9 @@ void KinectWindow::BringUpWindow()
 /// </sumamry>
 void KinectWindow::StartStreams()
 {
+    // Recorder pipelines
+    m_pRecorder->Start();
+
     // Color stream
     m_pColorStream->StartStream();
 
@@ -546,6 +576,10 @@ void KinectWindow::StartStreams()
     // Accelerometer reading stream
     m_pAccelerometerStream->StartStream();
 
+    // Color, depth and skeleton frames are processed on dispatcher threads, the window only repaints
+    m_pColorDispatcher->Start();
+    m_pDepthDispatcher->Start();
+
     // Start waitble timer
     StartTimer();
 }
@@ -563,6 +597,22 @@ void KinectWindow::StartTimer()
     }
 }
 
+/// <summary>
+/// Stop the dispatcher threads processing color, depth and skeleton frames
+/// </summary>
+void KinectWindow::StopAcquisition()
+{
+    if (m_pColorDispatcher)
+    {
+        m_pColorDispatcher->Stop();
+    }
+
+    if (m_pDepthDispatcher)
+    {
+        m_pDepthDispatcher->Stop();
+    }
+}
+
 /// <summary>
 /// Release all resources
 /// </summary>
@@ -574,11 +624,37 @@ void KinectWindow::CleanUp()
         m_hTimer = nullptr;
     }
 
+    // Threads use the streams and the viewers, stop them first
+    StopAcquisition();
+    if (m_pColorDispatcher && m_pDepthDispatcher)
+    {
+        m_pColorDispatcher->LogSession();
+        m_pDepthDispatcher->LogSession();
+    }
+    SafeDelete(m_pColorDispatcher);
+    SafeDelete(m_pDepthDispatcher);
+
+    // Pre-trigger frames not replayed yet belong to the recording still running
+    if (m_pColorStream && m_pDepthStream)
+    {
+        m_pColorStream->FlushPreTrigger();
+        m_pDepthStream->FlushPreTrigger();
+    }
+
+    // The source sets the frame ready events of the streams until it is gone
+    SafeDelete(m_pSensorSource);
     SafeDelete(m_pColorStream);
     SafeDelete(m_pDepthStream);
     SafeDelete(m_pSkeletonStream);
     SafeDelete(m_pAudioStream);
     SafeDelete(m_pAccelerometerStream);
+
+    // Streams are gone, write out the frames still queued
+    SafeDelete(m_pRecorder);
+    SafeDelete(m_pTaskPool);
+    SafeDelete(m_pFramePool);
+    SafeDelete(m_pSensorClock);
+
     SafeDelete(m_pPrimaryView);
     SafeDelete(m_pSecondaryView);
     SafeDelete(m_pAudioView);
@@ -692,6 +768,44 @@ void KinectWindow::InitializeMenu()
                              ID_SKELETONSTREAM_CHOOSERMODE_END,
                              ID_CHOOSERMODE_DEFAULTSYSTEMTRACKING,
                              MF_BYCOMMAND);
+        CheckMenuRadioItem(hMenu,
+                             ID_RECORDING_OUTPUT_START,
+                             ID_RECORDING_OUTPUT_END,
+                             ID_OUTPUT_IMAGEFILES,
+                             MF_BYCOMMAND);
+        CheckMenuRadioItem(hMenu,
+                             ID_RECORDING_DEPTHFORMAT_START,
+                             ID_RECORDING_DEPTHFORMAT_END,
+                             ID_DEPTHFORMAT_PNG,
+                             MF_BYCOMMAND);
+        CheckMenuRadioItem(hMenu,
+                             ID_RECORDING_COLORFORMAT_START,
+                             ID_RECORDING_COLORFORMAT_END,
+                             ID_COLORFORMAT_BMP,
+                             MF_BYCOMMAND);
+        CheckMenuRadioItem(hMenu,
+                             ID_RECORDING_DROPPOLICY_START,
+                             ID_RECORDING_DROPPOLICY_END,
+                             ID_DROPPOLICY_BLOCK,
+                             MF_BYCOMMAND);
+        CheckMenuRadioItem(hMenu,
+                             ID_RECORDING_PRETRIGGER_START,
+                             ID_RECORDING_PRETRIGGER_END,
+                             ID_PRETRIGGER_OFF,
+                             MF_BYCOMMAND);
+        CheckMenuRadioItem(hMenu,
+                             ID_RECORDING_PRETRIGGERMEMORY_START,
+                             ID_RECORDING_PRETRIGGERMEMORY_END,
+                             ID_PRETRIGGERMEMORY_128MB,
+                             MF_BYCOMMAND);
+        CheckMenuRadioItem(hMenu,
+                             ID_RECORDING_SPLIT_START,
+                             ID_RECORDING_SPLIT_END,
+                             ID_SPLIT_OFF,
+                             MF_BYCOMMAND);
+
+        // Recording starts along with the streams
+        CheckMenuItem(hMenu, ID_RECORDING_RECORD, MF_BYCOMMAND | MF_CHECKED);
 
         // This device does not support camera settings
         if (!m_bSupportCameraSettings)
@@ -755,6 +869,13 @@ bool KinectWindow::ProcessMenuItem(UINT id, bool& checked)
             }
             break;
 
+        case ID_RECORDING_RECORD:
+        case ID_RECORDING_SKIPUNPAIRED:
+        case ID_RECORDING_LARGEPAGES:
+        case ID_PRETRIGGER_COMPRESS:
+            // Plain check item
+            return InvertCheckMenuItem(hMenu, id, checked);
+
         case ID_VIEWS_SWITCH:
         case ID_CAMERA_COLORSETTINGS:
         case ID_CAMERA_EXPOSURESETTINGS:
@@ -801,6 +922,41 @@ bool KinectWindow::ProcessMenuItem(UINT id, bool& checked)
                     // Color stream image resolution
                     return true;
                 }
+                else if (CheckRadioItem(id, ID_RECORDING_OUTPUT_START, ID_RECORDING_OUTPUT_END, hMenu))
+                {
+                    // Recording output type
+                    return true;
+                }
+                else if (CheckRadioItem(id, ID_RECORDING_DEPTHFORMAT_START, ID_RECORDING_DEPTHFORMAT_END, hMenu))
+                {
+                    // Recorded depth format
+                    return true;
+                }
+                else if (CheckRadioItem(id, ID_RECORDING_COLORFORMAT_START, ID_RECORDING_COLORFORMAT_END, hMenu))
+                {
+                    // Recorded color format
+                    return true;
+                }
+                else if (CheckRadioItem(id, ID_RECORDING_DROPPOLICY_START, ID_RECORDING_DROPPOLICY_END, hMenu))
+                {
+                    // Recording drop policy
+                    return true;
+                }
+                else if (CheckRadioItem(id, ID_RECORDING_PRETRIGGER_START, ID_RECORDING_PRETRIGGER_END, hMenu))
+                {
+                    // Pre-trigger window
+                    return true;
+                }
+                else if (CheckRadioItem(id, ID_RECORDING_PRETRIGGERMEMORY_START, ID_RECORDING_PRETRIGGERMEMORY_END, hMenu))
+                {
+                    // Pre-trigger memory
+                    return true;
+                }
+                else if (CheckRadioItem(id, ID_RECORDING_SPLIT_START, ID_RECORDING_SPLIT_END, hMenu))
+                {
+                    // Recording split
+                    return true;
+                }
             }
         }
     }
@@ -923,6 +1079,9 @@ void KinectWindow::OnClose(HWND hWnd, WPARAM wParam)
         SetEvent(m_hStopStreamEventThread);
     }
 
+    // Stop acquisition threads before the sensor goes away under them
+    StopAcquisition();
+
     // Shut down the device
     if (nullptr != m_pNuiSensor)
     {
@@ -981,16 +1140,6 @@ bool KinectWindow::CalculateViewRects(RECT& priRect, RECT& secRect, RECT& tabRec
     return false;
 }
 
-/// <summary>
-/// Process color, depth and skeleton streams
-/// </summary>
-void KinectWindow::UpdateStreams()
-{
-    m_pColorStream->ProcessStreamFrame();
-    m_pDepthStream->ProcessStreamFrame();
-    m_pSkeletonStream->ProcessStreamFrame();
-}
-
 /// <summary>
 /// Process audio, accelerometer and tilt angle streams
 /// </summary>
@@ -1001,17 +1150,14 @@ void KinectWindow::UpdateTimedStreams()
 }
 
 /// <summary>
-/// Thread to handle stream events
+/// Thread to handle timer events of the timed streams. Color, depth and skeleton frames are dispatched by event dispatchers
 /// </summary>
 /// <param name="pThis">Pionter to Kinect window instance</param>
 /// <returns>Exit result from thread</returns>
 DWORD KinectWindow::StreamEventThread(KinectWindow* pThis)
 {
     HANDLE events[] = {pThis->m_hStopStreamEventThread, 
-                       pThis->m_hTimer, 
-                       pThis->m_pColorStream->GetFrameReadyEvent(), 
-                       pThis->m_pDepthStream->GetFrameReadyEvent(), 
-                       pThis->m_pSkeletonStream->GetFrameReadyEvent()};
+                       pThis->m_hTimer};
 
     while (true)
     {
@@ -1024,10 +1170,6 @@ DWORD KinectWindow::StreamEventThread(KinectWindow* pThis)
         {
             SendMessageW(pThis->GetWindow(), WM_TIMEREVENT, 0, 0);
         }
-        else if(WAIT_OBJECT_0 + 4 >= ret)
-        {
-            SendMessageW(pThis->GetWindow(), WM_STREAMEVENT, 0, 0);
-        }
     }
 
     return 0;
@@ -13,8 +13,12 @@
 #include "NuiSkeletonStream.h"
 #include "NuiAudioStream.h"
 #include "NuiAccelerometerStream.h"
+#include "NuiSensorSource.h"
 #include "NuiTiltAngleViewer.h"
 #include "KinectSettings.h"
+#include "FrameRecorder.h"
+#include "SensorClock.h"
+#include "EventDispatcher.h"
 
 class KinectWindow : public NuiViewer
 {
@@ -131,9 +135,9 @@ private:
     void StartTimer();
 
     /// <summary>
-    /// Process color, depth and skeleton streams
+    /// Stop the dispatcher threads processing color, depth and skeleton frames
     /// </summary>
-    void UpdateStreams();
+    void StopAcquisition();
 
     /// <summary>
     /// Process audio, accelerometer and tilt angle streams
@@ -237,7 +241,7 @@ private:
     void OnClose(HWND hWnd, WPARAM wParam);
 
     /// <summary>
-    /// Thread to handle stream events
+    /// Thread to handle timer events of the timed streams. Color, depth and skeleton frames are dispatched by event dispatchers
     /// </summary>
     /// <param name="pThis">Pionter to Kinect window instance</param>
     static DWORD WINAPI StreamEventThread(KinectWindow* pThis);
@@ -264,12 +268,20 @@ private:
     CameraSettingsViewer*   m_pExposureSettingsView;    // Pointer to camera exposure settings viewer
     bool                    m_bSupportCameraSettings;   // Indicate whether the sensor supports camera settings
 
+    NuiSensorSource*        m_pSensorSource;            // Pointer to source the streams take the frames of the sensor from
     NuiColorStream*         m_pColorStream;             // Pointer to color stream
     NuiDepthStream*         m_pDepthStream;             // Pointer to depth stream
     NuiSkeletonStream*      m_pSkeletonStream;          // Pointer to skeleton stream
     NuiAudioStream*         m_pAudioStream;             // Pointer to audio stream
     NuiAccelerometerStream* m_pAccelerometerStream;     // Pointer to accelerometer stream
 
+    FrameRecorder*          m_pRecorder;                // Pointer to recorder writing color and depth frames to disk
+    TaskPool*               m_pTaskPool;                // Pointer to pool running the display and recording stages of the streams
+    FramePool*              m_pFramePool;               // Pointer to pool color and depth frames are copied into
+    SensorClock*            m_pSensorClock;             // Pointer to clock mapping sensor timestamps to wall-clock time
+    EventDispatcher*        m_pColorDispatcher;         // Pointer to dispatcher thread processing color frames
+    EventDispatcher*        m_pDepthDispatcher;         // Pointer to dispatcher thread processing depth and skeleton frames
+
     INuiSensor*             m_pNuiSensor;               // Pointer to Nui sensor
 
     std::vector<NuiViewer*>             m_views;        // Collection of Kinect window's sub views
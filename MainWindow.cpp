@@ -7,6 +7,7 @@
 #include "stdafx.h"
 
 #include "MainWindow.h"
+#include "HeadlessCapture.h"
 #include "Utility.h"
 
 //Define the global independent Direct resources
@@ -48,6 +49,28 @@ void DiscardIndependentResources()
 /// <returns>status</returns>
 int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLine, int nCmdShow)
 {
+    // /headless [profile] records without any window, reporting to the console it was started from
+    int argc = 0;
+    LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+    if (argv && argc >= 3 && (0 == _wcsicmp(argv[1], L"/headless") || 0 == _wcsicmp(argv[1], L"--headless")))
+    {
+        char profilePath[MAX_PATH];
+        WideCharToMultiByte(CP_ACP, 0, argv[2], -1, profilePath, ARRAYSIZE(profilePath), nullptr, nullptr);
+        LocalFree(argv);
+
+        if (!AttachConsole(ATTACH_PARENT_PROCESS))
+        {
+            AllocConsole();
+        }
+        FILE* pFile = nullptr;
+        freopen_s(&pFile, "CONOUT$", "w", stdout);
+        freopen_s(&pFile, "CONOUT$", "w", stderr);
+
+        HeadlessCapture capture;
+        return capture.Run(profilePath);
+    }
+    LocalFree(argv);
+
     EnsureIndependentResourcesCreated();
 
     CMainWindow application;
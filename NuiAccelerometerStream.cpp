@@ -11,15 +11,11 @@
 /// <summary>
 /// Constructor
 /// </summary>
-/// <param name="pNuiSensor">The pointer to Nui sensor object</param>
-NuiAccelerometerStream::NuiAccelerometerStream(INuiSensor* pNuiSensor)
-    : m_pNuiSensor(pNuiSensor)
+/// <param name="pSource">The pointer to the source the readings come from</param>
+NuiAccelerometerStream::NuiAccelerometerStream(SensorSource* pSource)
+    : m_pSource(pSource)
     , m_pAccelerometerViewer(nullptr)
 {
-    if (m_pNuiSensor)
-    {
-        m_pNuiSensor->AddRef();
-    }
 }
 
 /// <summary>
@@ -27,7 +23,6 @@ NuiAccelerometerStream::NuiAccelerometerStream(INuiSensor* pNuiSensor)
 /// </summary>
 NuiAccelerometerStream::~NuiAccelerometerStream()
 {
-    SafeRelease(m_pNuiSensor);
 }
 
 /// <summary>
@@ -54,10 +49,8 @@ void NuiAccelerometerStream::SetStreamViewer(NuiAccelerometerViewer* pViewer)
 void NuiAccelerometerStream::ProcessStream()
 {
     // Get the reading
-    Vector4 reading;
-    HRESULT hr = m_pNuiSensor->NuiAccelerometerGetCurrentReading(&reading);
-
-    if (SUCCEEDED(hr) && m_pAccelerometerViewer)
+    SensorVector reading;
+    if (m_pSource->GetAccelerometerReading(reading) && m_pAccelerometerViewer)
     {
         // Set the reading to viewer
         m_pAccelerometerViewer->SetAccelerometerReadings(reading.x, reading.y, reading.z);
@@ -8,6 +8,7 @@
 
 #include <NuiApi.h>
 #include "NuiAccelerometerViewer.h"
+#include "SensorSource.h"
 
 class NuiAccelerometerStream
 {
@@ -15,8 +16,8 @@ public:
     /// <summary>
     /// Constructor
     /// </summary>
-    /// <param name="pNuiSensor">The pointer to Nui sensor object</param>
-    NuiAccelerometerStream(INuiSensor* pNuiSensor);
+    /// <param name="pSource">The pointer to the source the readings come from</param>
+    NuiAccelerometerStream(SensorSource* pSource);
 
     /// <summary>
     /// Destructor
@@ -42,6 +43,6 @@ public:
     HRESULT StartStream();
 
 private:
-    INuiSensor*             m_pNuiSensor;
+    SensorSource*           m_pSource;
     NuiAccelerometerViewer* m_pAccelerometerViewer;
 };
\ No newline at end of file
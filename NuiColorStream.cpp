@@ -7,19 +7,14 @@
 #include "stdafx.h"
 #include "NuiColorStream.h"
 #include "NuiStreamViewer.h"
-
-#include <fstream>
-#include <iomanip>
-#include <sstream>
-
-#include <chrono>
+#include "NuiSensorSource.h"
 
 /// <summary>
 /// Constructor
 /// </summary>
-/// <param name="pNuiSensor">The pointer to Nui sensor object</param>
-NuiColorStream::NuiColorStream(INuiSensor* pNuiSensor)
-    : NuiStream(pNuiSensor)
+/// <param name="pSource">The pointer to the source the frames come from</param>
+NuiColorStream::NuiColorStream(SensorSource* pSource)
+    : NuiStream(pSource)
     , m_imageType(NUI_IMAGE_TYPE_COLOR)
     , m_imageResolution(NUI_IMAGE_RESOLUTION_640x480)
 {
@@ -39,6 +34,8 @@ NuiColorStream::~NuiColorStream()
 /// <returns>Previously attached viewer object. If none, returns nullptr</returns>
 NuiStreamViewer* NuiColorStream::SetStreamViewer(NuiStreamViewer* pStreamViewer)
 {
+    StreamLock lock(this);
+
     if (pStreamViewer)
     {
         // Set image data to newly attached viewer object as well
@@ -55,6 +52,8 @@ NuiStreamViewer* NuiColorStream::SetStreamViewer(NuiStreamViewer* pStreamViewer)
 /// <returns>Indicate success or failure.</returns>
 HRESULT NuiColorStream::StartStream()
 {
+    StreamLock lock(this);
+
     SetImageType(NUI_IMAGE_TYPE_COLOR);                 // Set default image type to color image
 	SetImageResolution(NUI_IMAGE_RESOLUTION_640x480);   // Set default image resolution to 640x480(@30fps) or 1280x960(@10fps)
     return OpenStream();
@@ -66,29 +65,64 @@ HRESULT NuiColorStream::StartStream()
 /// <returns>Indicates success or failure.</returns>
 HRESULT NuiColorStream::OpenStream()
 {
+    StreamLock lock(this);
+
     // Open color stream.
-    HRESULT hr = m_pNuiSensor->NuiImageStreamOpen(m_imageType,
-                                                  m_imageResolution,
-                                                  0,
-                                                  2,
-                                                  GetFrameReadyEvent(),
-                                                  &m_hStreamHandle);
+    DWORD width  = 0;
+    DWORD height = 0;
+    NuiImageResolutionToSize(m_imageResolution, width, height);
+
+    uint32_t openWidth  = width;
+    uint32_t openHeight = height;
+    HRESULT hr = m_pSource->OpenImageStream(SensorStreamColor, NuiSensorSource::ToImageType(m_imageType), openWidth, openHeight, m_frameReady)
+                 ? S_OK : E_FAIL;
+
+    // The image buffer is laid out for a resolution of the sensor, a source delivering another size is of no use
+    if (SUCCEEDED(hr) && (openWidth != width || openHeight != height))
+    {
+        hr = E_INVALIDARG;
+    }
 
     // Reset image buffer
     if (SUCCEEDED(hr))
     {
         m_imageBuffer.SetImageSize(m_imageResolution);  // Set source image resolution to image buffer
+        m_latestFrame.Reset();
+        ClearPreTrigger();      // Frames of the old resolution are not recorded with the new ones
+
+        // Lay out frames for the new resolution before the first one arrives
+        if (m_pFramePool)
+        {
+            m_pFramePool->SetFrameSize(RecordStreamColor, m_imageBuffer.GetSourceWidth() * m_imageBuffer.GetSourceHeight() * 4);
+        }
     }
 
     return hr;
 }
 
+/// <summary>
+/// Open stream with another image type and resolution. Both change between two frames
+/// </summary>
+/// <param name="type">Image type to be set</param>
+/// <param name="resolution">Image resolution to be set</param>
+/// <returns>Indicates success or failure.</returns>
+HRESULT NuiColorStream::OpenStream(NUI_IMAGE_TYPE type, NUI_IMAGE_RESOLUTION resolution)
+{
+    StreamLock lock(this);
+
+    SetImageType(type);
+    SetImageResolution(resolution);
+    return OpenStream();
+}
+
 /// <summary>
 /// Set image type. Only color image types are acceptable
 /// </summary>
 /// <param name="type">Image type to be set</param>
 void NuiColorStream::SetImageType(NUI_IMAGE_TYPE type)
 {
+    StreamLock lock(this);
+
     switch (type)
     {
     case NUI_IMAGE_TYPE_COLOR:
@@ -103,7 +137,10 @@ void NuiColorStream::SetImageType(NUI_IMAGE_TYPE type)
     }
 
     // Sync the stream viewer image type
-    m_pStreamViewer->SetImageType(m_imageType);
+    if (m_pStreamViewer)
+    {
+        m_pStreamViewer->SetImageType(m_imageType);
+    }
 }
 
 /// <summary>
@@ -112,6 +149,8 @@ void NuiColorStream::SetImageType(NUI_IMAGE_TYPE type)
 /// <param name="resolution">Image resolution to be set</param>
 void NuiColorStream::SetImageResolution(NUI_IMAGE_RESOLUTION resolution)
 {
+    StreamLock lock(this);
+
     switch (resolution)
     {
     case NUI_IMAGE_RESOLUTION_640x480:
@@ -129,11 +168,8 @@ void NuiColorStream::SetImageResolution(NUI_IMAGE_RESOLUTION resolution)
 /// </summary>
 void NuiColorStream::ProcessStreamFrame()
 {
-    if (WAIT_OBJECT_0 == WaitForSingleObject(GetFrameReadyEvent(), 0))
-    {
-        // Frame ready event has been set. Proceed to process incoming frame
-        ProcessColor();
-    }
+    // Only dispatched when the frame ready event has been set
+    ProcessColor();
 }
 
 /// <summary>
@@ -141,108 +177,63 @@ void NuiColorStream::ProcessStreamFrame()
 /// </summary>
 void NuiColorStream::ProcessColor()
 {
-    HRESULT hr;
-    NUI_IMAGE_FRAME imageFrame;
+    SensorImage image;
 
     // Attempt to get the color frame
-    hr = m_pNuiSensor->NuiImageStreamGetNextFrame(m_hStreamHandle, 0, &imageFrame);
-    if (FAILED(hr))
+    if (!m_pSource->GetNextImage(SensorStreamColor, image))
     {
         return;
     }
 
+    // Taken before any processing, so it is as close to the arrival of the frame as possible
+    double hostTime = SensorClock::GetHostTime();
+
+    FrameHandle frame;
     if (m_paused)
     {
         // Stream paused. Skip frame process and release the frame.
         goto ReleaseFrame;
     }
 
-    INuiFrameTexture* pTexture = imageFrame.pFrameTexture;
-
-    // Lock the frame data so the Kinect knows not to modify it while we are reading it
-    NUI_LOCKED_RECT lockedRect;
-    pTexture->LockRect(0, &lockedRect, NULL, 0);
-
-    // Make sure we've received valid data
-    if (lockedRect.Pitch != 0)
+    // Make sure we've received valid data. The source keeps the pixels unchanged until the image is released
+    if (image.pitch != 0)
     {
+        // Bayer and infrared images are only converted for display, there is nothing to do without a viewer
         switch (m_imageType)
         {
         case NUI_IMAGE_TYPE_COLOR_RAW_BAYER:    // Convert raw bayer data to color image and copy to image buffer
-            m_imageBuffer.CopyBayer(lockedRect.pBits, lockedRect.size);
+            if (m_pStreamViewer)
+            {
+                m_imageBuffer.CopyBayer(image.pBits, image.size);
+            }
             break;
 
         case NUI_IMAGE_TYPE_COLOR_INFRARED:     // Convert infrared data to color image and copy to image buffer
-            m_imageBuffer.CopyInfrared(lockedRect.pBits, lockedRect.size);
+            if (m_pStreamViewer)
+            {
+                m_imageBuffer.CopyInfrared(image.pBits, image.size);
+            }
             break;
 
-        default:    // Copy color data to image buffer
-            m_imageBuffer.CopyRGB(lockedRect.pBits, lockedRect.size);
-            using namespace std::chrono;
-            auto now = system_clock::now();
-            auto epoch = now.time_since_epoch();
-            double timestamp = duration_cast<microseconds>(epoch).count() / 1e6;
-
-            std::wstringstream wss;
-            wss << L"rgb\\rgb_" << std::fixed << std::setprecision(6) << timestamp << L".bmp";
-            std::wstring wfilename = wss.str();
-
-            CreateDirectory(L"rgb", NULL);
-            SaveRGBToBitmap(lockedRect.pBits, 640, 480, wfilename.c_str());
-
-            // associations ļ RGB д
-            /*
-            std::wofstream log(L"associations.txt", std::ios::app);
-            if (log)
-                log << std::fixed << std::setprecision(6)
-                << timestamp << L" rgb/rgb_" << timestamp << L".bmp"
-                << L" depth/depth_" << timestamp << L".png" << std::endl;
-            */
-
-            std::wofstream rgblog(L"rgb.txt", std::ios::app);
-            if (rgblog)
-                rgblog << std::fixed << std::setprecision(6) << timestamp << L"\t" << wfilename << std::endl;
+        default:    // Copy color data once into a frame shared by the viewer and the recorder
+            frame = CopyFrame(RecordStreamColor, RecordPixelFormatBgra32, 4, m_imageBuffer.GetSourceWidth(), m_imageBuffer.GetSourceHeight(),
+                              image, hostTime);
+            m_imageBuffer.SetFrame(frame);
             break;
         }
 
         if (m_pStreamViewer)
         {
-            // Set image data to viewer
-            m_pStreamViewer->SetImage(&m_imageBuffer);
+            // The viewer picks up the image when it repaints
+            m_pStreamViewer->NotifyImage();
         }
     }
 
-    // Unlock frame data
-    pTexture->UnlockRect(0);
+    if (frame)
+    {
+        PublishFrame(frame);
+    }
 
 ReleaseFrame:
-    m_pNuiSensor->NuiImageStreamReleaseFrame(m_hStreamHandle, &imageFrame);
-}
-
-HRESULT SaveRGBToBitmap(const BYTE* pBuffer, int width, int height, const std::wstring& filename)
-{
-    BITMAPFILEHEADER bfh = { 0 };
-    BITMAPINFOHEADER bih = { 0 };
-
-    int stride = width * 4;
-
-    bfh.bfType = 0x4D42; // 'BM'
-    bfh.bfSize = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER) + stride * height;
-    bfh.bfOffBits = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER);
-
-    bih.biSize = sizeof(BITMAPINFOHEADER);
-    bih.biWidth = width;
-    bih.biHeight = -height; // top-down bitmap
-    bih.biPlanes = 1;
-    bih.biBitCount = 32;
-    bih.biCompression = BI_RGB;
-
-    std::ofstream file(filename, std::ios::binary);
-    if (!file) return E_FAIL;
-
-    file.write((char*)&bfh, sizeof(bfh));
-    file.write((char*)&bih, sizeof(bih));
-    file.write((char*)pBuffer, stride * height);
-
-    return S_OK;
-}
+    m_pSource->ReleaseImage(SensorStreamColor);
+}
\ No newline at end of file
@@ -9,16 +9,14 @@
 #include "NuiStream.h"
 #include "NuiImageBuffer.h"
 
-#include <string>
-
 class NuiColorStream : public NuiStream
 {
 public:
     /// <summary>
     /// Constructor
     /// </summary>
-    /// <param name="pNuiSensor">The pointer to Nui sensor object</param>
-    NuiColorStream(INuiSensor* pNuiSensor);
+    /// <param name="pSource">The pointer to the source the frames come from</param>
+    NuiColorStream(SensorSource* pSource);
 
     /// <summary>
     /// Destructor
@@ -45,6 +43,14 @@ public:
     /// <returns>Indicates success or failure.</returns>
     HRESULT OpenStream();
 
+    /// <summary>
+    /// Open stream with another image type and resolution. Both change between two frames
+    /// </summary>
+    /// <param name="type">Image type to be set</param>
+    /// <param name="resolution">Image resolution to be set</param>
+    /// <returns>Indicates success or failure.</returns>
+    HRESULT OpenStream(NUI_IMAGE_TYPE type, NUI_IMAGE_RESOLUTION resolution);
+
     /// <summary>
     /// Process a incoming stream frame
     /// </summary>
@@ -72,6 +78,4 @@ private:
     NUI_IMAGE_TYPE       m_imageType;
     NUI_IMAGE_RESOLUTION m_imageResolution;
     NuiImageBuffer       m_imageBuffer;
-};
-
-HRESULT SaveRGBToBitmap(const BYTE* buf, int w, int h, const std::wstring& name);
\ No newline at end of file
+};
\ No newline at end of file
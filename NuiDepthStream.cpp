@@ -8,26 +8,15 @@
 #include <cmath>
 #include "NuiDepthStream.h"
 #include "NuiStreamViewer.h"
-
-
-#include <fstream>
-#include <string>
-#include <sstream>
-#include <iomanip>
-#include <ctime>
-#include <windows.h>
-
-#include <chrono>
-#include <opencv2/opencv.hpp>
-#include <locale>
-#include <codecvt>
+#include "NuiSensorSource.h"
+#include "DepthSplit.h"
 
 /// <summary>
 /// Constructor
 /// <summary>
-/// <param name="pNuiSensor">The pointer to NUI sensor device instance</param>
-NuiDepthStream::NuiDepthStream(INuiSensor* pNuiSensor)
-    : NuiStream(pNuiSensor)
+/// <param name="pSource">The pointer to the source the frames come from</param>
+NuiDepthStream::NuiDepthStream(SensorSource* pSource)
+    : NuiStream(pSource)
     , m_imageType(NUI_IMAGE_TYPE_DEPTH_AND_PLAYER_INDEX)
     , m_nearMode(false)
     , m_depthTreatment(CLAMP_UNRELIABLE_DEPTHS)
@@ -39,6 +28,8 @@ NuiDepthStream::NuiDepthStream(INuiSensor* pNuiSensor)
 /// </summary>
 NuiDepthStream::~NuiDepthStream()
 {
+    // Conversions still running fill the image buffer
+    m_pDisplayPipeline.reset();
 }
 
 /// <summary>
@@ -48,6 +39,14 @@ NuiDepthStream::~NuiDepthStream()
 /// <returns>Previously attached viewer object. If none, returns nullptr</returns>
 NuiStreamViewer* NuiDepthStream::SetStreamViewer(NuiStreamViewer* pStreamViewer)
 {
+    StreamLock lock(this);
+
+    // Conversions still running notify the viewer
+    if (m_pDisplayPipeline)
+    {
+        m_pDisplayPipeline->Flush();
+    }
+
     if (pStreamViewer)
     {
         // Set image data to newly attached viewer object as well
@@ -64,11 +63,10 @@ NuiStreamViewer* NuiDepthStream::SetStreamViewer(NuiStreamViewer* pStreamViewer)
 /// <param name="nearMode">True to enable near mode. False to disable</param>
 void NuiDepthStream::SetNearMode(bool nearMode)
 {
+    StreamLock lock(this);
+
     m_nearMode = nearMode;
-    if (INVALID_HANDLE_VALUE != m_hStreamHandle)
-    {
-        m_pNuiSensor->NuiImageStreamSetImageFrameFlags(m_hStreamHandle, (m_nearMode ? NUI_IMAGE_STREAM_FLAG_ENABLE_NEAR_MODE : 0));
-    }
+    m_pSource->SetNearMode(m_nearMode);
 }
 
 /// <summary>
@@ -77,9 +75,29 @@ void NuiDepthStream::SetNearMode(bool nearMode)
 /// <param name="treatment">Depth treatment mode to set</param>
 void NuiDepthStream::SetDepthTreatment(DEPTH_TREATMENT treatment)
 {
+    StreamLock lock(this);
+
     m_depthTreatment = treatment;
 }
 
+/// <summary>
+/// Attach pool converting the frames for display, so the next frame can be taken meanwhile
+/// </summary>
+/// <param name="pPool">The pointer to pool object, must outlive the stream. nullptr to convert on acquisition</param>
+void NuiDepthStream::SetTaskPool(TaskPool* pPool)
+{
+    StreamLock lock(this);
+
+    m_pDisplayPipeline.reset();
+    if (pPool)
+    {
+        // Room for one frame waiting while the one before is converted, later frames are not shown
+        m_pDisplayPipeline.reset(new Pipeline<DisplayJob>(*pPool));
+        m_pDisplayPipeline->AddStage("display", 1, 2, [this](DisplayJob& job) { DisplayFrame(job); });
+        m_pDisplayPipeline->Start();
+    }
+}
+
 /// <summary>
 /// Start stream processing.
 /// </summary>
@@ -96,19 +114,44 @@ HRESULT NuiDepthStream::StartStream()
 /// <returns>Indicates success or failure.</returns>
 HRESULT NuiDepthStream::OpenStream(NUI_IMAGE_RESOLUTION resolution)
 {
-    m_imageType = HasSkeletalEngine(m_pNuiSensor) ? NUI_IMAGE_TYPE_DEPTH_AND_PLAYER_INDEX : NUI_IMAGE_TYPE_DEPTH;
+    StreamLock lock(this);
+
+    m_imageType = m_pSource->HasSkeletonTracking() ? NUI_IMAGE_TYPE_DEPTH_AND_PLAYER_INDEX : NUI_IMAGE_TYPE_DEPTH;
 
     // Open depth stream
-    HRESULT hr = m_pNuiSensor->NuiImageStreamOpen(m_imageType,
-                                                  resolution,
-                                                  0,
-                                                  2,
-                                                  GetFrameReadyEvent(),
-                                                  &m_hStreamHandle);
+    DWORD width  = 0;
+    DWORD height = 0;
+    NuiImageResolutionToSize(resolution, width, height);
+
+    uint32_t openWidth  = width;
+    uint32_t openHeight = height;
+    HRESULT hr = m_pSource->OpenImageStream(SensorStreamDepth, NuiSensorSource::ToImageType(m_imageType), openWidth, openHeight, m_frameReady)
+                 ? S_OK : E_FAIL;
+
+    // The image buffer is laid out for a resolution of the sensor, a source delivering another size is of no use
+    if (SUCCEEDED(hr) && (openWidth != width || openHeight != height))
+    {
+        hr = E_INVALIDARG;
+    }
+
     if (SUCCEEDED(hr))
     {
-        m_pNuiSensor->NuiImageStreamSetImageFrameFlags(m_hStreamHandle, m_nearMode ? NUI_IMAGE_STREAM_FLAG_ENABLE_NEAR_MODE : 0);   // Set image flags
+        // Conversions still running fill the image buffer at its current size
+        if (m_pDisplayPipeline)
+        {
+            m_pDisplayPipeline->Flush();
+        }
+
+        m_pSource->SetNearMode(m_nearMode);     // Set image flags
         m_imageBuffer.SetImageSize(resolution); // Set source image resolution to image buffer
+        m_latestFrame.Reset();
+        ClearPreTrigger();      // Frames of the old resolution are not recorded with the new ones
+
+        // Lay out frames for the new resolution before the first one arrives
+        if (m_pFramePool)
+        {
+            m_pFramePool->SetFrameSize(RecordStreamDepth, m_imageBuffer.GetSourceWidth() * m_imageBuffer.GetSourceHeight() * sizeof(NUI_DEPTH_IMAGE_PIXEL));
+        }
     }
 
     return hr;
@@ -119,11 +162,8 @@ HRESULT NuiDepthStream::OpenStream(NUI_IMAGE_RESOLUTION resolution)
 /// </summary>
 void NuiDepthStream::ProcessStreamFrame()
 {
-    if (WAIT_OBJECT_0 == WaitForSingleObject(GetFrameReadyEvent(), 0))
-    {
-        // if we have received any valid new depth data we may need to draw
-        ProcessDepth();
-    }
+    // Only dispatched when the frame ready event has been set
+    ProcessDepth();
 }
 
 /// <summary>
@@ -131,79 +171,89 @@ void NuiDepthStream::ProcessStreamFrame()
 /// </summary>
 void NuiDepthStream::ProcessDepth()
 {
-    HRESULT         hr;
-    NUI_IMAGE_FRAME imageFrame;
+    SensorImage image;
 
-    // Attempt to get the depth frame
-    hr = m_pNuiSensor->NuiImageStreamGetNextFrame(m_hStreamHandle, 0, &imageFrame);
-    if (FAILED(hr))
+    // Attempt to get the depth frame, as pixels of depth and player index
+    if (!m_pSource->GetNextImage(SensorStreamDepth, image))
     {
         return;
     }
 
+    // Taken before any processing, so it is as close to the arrival of the frame as possible
+    double hostTime = SensorClock::GetHostTime();
+
+    FrameHandle frame;
     if (m_paused)
     {
         // Stream paused. Skip frame process and release the frame.
         goto ReleaseFrame;
     }
 
-    BOOL nearMode;
-    INuiFrameTexture* pTexture;
+    BOOL nearMode = image.nearMode ? TRUE : FALSE;
 
-    // Get the depth image pixel texture
-    hr = m_pNuiSensor->NuiImageFrameGetDepthImagePixelFrameTexture(m_hStreamHandle, &imageFrame, &nearMode, &pTexture);
-    if (FAILED(hr))
+    // Make sure we've received valid data
+    if (image.pitch != 0)
     {
-        goto ReleaseFrame;
+        // Copy the pixels once into a frame shared by the display and the recorder
+        frame = CopyFrame(RecordStreamDepth, RecordPixelFormatDepthPixel32, sizeof(NUI_DEPTH_IMAGE_PIXEL),
+                          m_imageBuffer.GetSourceWidth(), m_imageBuffer.GetSourceHeight(), image, hostTime);
     }
 
-    NUI_LOCKED_RECT lockedRect;
-
-    // Lock the frame data so the Kinect knows not to modify it while we're reading it
-    pTexture->LockRect(0, &lockedRect, NULL, 0);
-
-    // Make sure we've received valid data
-    if (lockedRect.Pitch != 0)
+    // Without a viewer, e.g. in headless capture, nobody looks at the display image
+    if (frame && m_pStreamViewer)
     {
-        // Conver depth data to color image and copy to image buffer
-        m_imageBuffer.CopyDepth(lockedRect.pBits, lockedRect.size, nearMode, m_depthTreatment);
-
-        // Draw ou the data with Direct2D
-        if (m_pStreamViewer)
+        DEPTH_TREATMENT treatment = m_depthTreatment;
+        if (m_pDisplayPipeline)
         {
-            m_pStreamViewer->SetImage(&m_imageBuffer);
+            // Skipped while the display is still busy with earlier frames, it only shows the latest one
+            m_pDisplayPipeline->TrySubmit([&](DisplayJob& job)
+            {
+                job.frame     = frame;
+                job.nearMode  = nearMode;
+                job.treatment = treatment;
+            });
         }
+        else
+        {
+            DisplayJob job = { frame, nearMode, treatment };
+            DisplayFrame(job);
+        }
+    }
 
-        CreateDirectory(L"depth", NULL);
-
-        using namespace std::chrono;
-        auto now = system_clock::now();
-        auto epoch = now.time_since_epoch();
-        double timestamp = duration_cast<microseconds>(epoch).count() / 1e6;
-
-        std::wstringstream wss;
-        wss << L"depth\\depth_" << std::fixed << std::setprecision(6) << timestamp << L".png";
-        std::wstring wfilename = wss.str();
-        std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
-		std::string filename = converter.to_bytes(wfilename);  // ȫwstring->stringתʽ
+    if (frame)
+    {
+        PublishFrame(frame);
+    }
 
-		//stbi_wrtie_pngʹopencv16λͼ Ontolius 250414 1252
-        cv::Mat depth_image(480, 640, CV_16UC1, lockedRect.pBits);
-        cv::imwrite(filename, depth_image);
+ReleaseFrame:
+    // Release the frame
+    m_pSource->ReleaseImage(SensorStreamDepth);
+}
 
-        // д depth ־
-        std::wofstream depthlog(L"depth.txt", std::ios::app);
-        if (depthlog) {
-            depthlog << std::fixed << std::setprecision(6) << timestamp << L"\t" << wfilename << std::endl;
-        }
+/// <summary>
+/// Split a depth frame into planes and convert them to the display image
+/// </summary>
+/// <param name="job">Frame to convert, released afterwards</param>
+void NuiDepthStream::DisplayFrame(DisplayJob& job)
+{
+    const RecordFrame& frame = *job.frame;
 
+    // Split depth and player index in one vectorized pass per row, then convert them to color image
+    UINT pixels = frame.width * frame.height;
+    m_depthPlane.resize(pixels);
+    m_playerIndexPlane.resize(pixels);
+    for (UINT y = 0; y < frame.height; y++)
+    {
+        const uint16_t* pRow = reinterpret_cast<const uint16_t*>(frame.data.data() + y * frame.stride);
+        SplitDepthPixels(pRow, frame.width, m_depthPlane.data() + y * frame.width, m_playerIndexPlane.data() + y * frame.width);
     }
 
-    // Done with the texture. Unlock and release it
-    pTexture->UnlockRect(0);
-    pTexture->Release();
+    m_imageBuffer.CopyDepth(m_depthPlane.data(), m_playerIndexPlane.data(), pixels, job.nearMode, job.treatment);
+    job.frame.Reset();
 
-ReleaseFrame:
-    // Release the frame
-    m_pNuiSensor->NuiImageStreamReleaseFrame(m_hStreamHandle, &imageFrame);
+    // The viewer draws the image with Direct2D when it repaints
+    if (m_pStreamViewer)
+    {
+        m_pStreamViewer->NotifyImage();
+    }
 }
\ No newline at end of file
@@ -8,8 +8,10 @@
 
 #include "NuiStream.h"
 #include "NuiImageBuffer.h"
+#include "Pipeline.h"
 
-#include <string>
+#include <memory>
+#include <vector>
 
 class NuiDepthStream : public NuiStream
 {
@@ -17,8 +19,8 @@ public:
     /// <summary>
     /// Constructor
     /// <summary>
-    /// <param name="pNuiSensor">The pointer to NUI sensor device instance</param>
-    NuiDepthStream(INuiSensor* pNuiSensor);
+    /// <param name="pSource">The pointer to the source the frames come from</param>
+    NuiDepthStream(SensorSource* pSource);
 
     /// <summary>
     /// Destructor
@@ -63,15 +65,42 @@ public:
     /// <param name="treatment">Depth treatment mode to set</param>
     void SetDepthTreatment(DEPTH_TREATMENT treatment);
 
+    /// <summary>
+    /// Attach pool converting the frames for display, so the next frame can be taken meanwhile
+    /// </summary>
+    /// <param name="pPool">The pointer to pool object, must outlive the stream. nullptr to convert on acquisition</param>
+    void SetTaskPool(TaskPool* pPool);
+
 private:
+    // Depth frame on its way to the display, with the settings it arrived under
+    struct DisplayJob
+    {
+        FrameHandle     frame;
+        BOOL            nearMode;
+        DEPTH_TREATMENT treatment;
+    };
+
     /// <summary>
     /// Retrieve depth data from stream frame
     /// </summary>
     void ProcessDepth();
 
+    /// <summary>
+    /// Split a depth frame into planes and convert them to the display image
+    /// </summary>
+    /// <param name="job">Frame to convert, released afterwards</param>
+    void DisplayFrame(DisplayJob& job);
+
 private:
     bool            m_nearMode;
     NUI_IMAGE_TYPE  m_imageType;
     NuiImageBuffer  m_imageBuffer;
     DEPTH_TREATMENT m_depthTreatment;
+
+    // Frame split into planes, kept from frame to frame
+    std::vector<USHORT> m_depthPlane;
+    std::vector<BYTE>   m_playerIndexPlane;
+
+    // Display stage, one frame at a time as it owns the planes and fills the image buffer
+    std::unique_ptr<Pipeline<DisplayJob>> m_pDisplayPipeline;
 };
\ No newline at end of file
@@ -38,12 +38,8 @@ const BYTE NuiImageBuffer::m_intensityShiftB[] = {0, 0, 2, 2, 0, 2, 0};
 NuiImageBuffer::NuiImageBuffer()
     : m_nearMode(false)
     , m_depthTreatment(CLAMP_UNRELIABLE_DEPTHS)
-    , m_nSizeInBytes(0)
-    , m_width(0)
-    , m_height(0)
     , m_srcWidth(0)
     , m_srcHeight(0)
-    , m_pBuffer(nullptr)
 {
     InitDepthColorTable();
 }
@@ -53,7 +49,6 @@ NuiImageBuffer::NuiImageBuffer()
 /// </summary>
 NuiImageBuffer::~NuiImageBuffer()
 {
-    SafeDelete(m_pBuffer);
 }
 
 /// <summary>
@@ -83,7 +78,7 @@ void NuiImageBuffer::GetImageSize(NUI_IMAGE_RESOLUTION resolution, DWORD& width,
 /// <returns>Width of image.</returns>
 DWORD NuiImageBuffer::GetWidth() const
 {
-    return m_width;
+    return m_images.GetFront().width;
 }
 
 /// <summary>
@@ -92,7 +87,34 @@ DWORD NuiImageBuffer::GetWidth() const
 /// <returns>Width of height.</returns>
 DWORD NuiImageBuffer::GetHeight() const
 {
-    return m_height;
+    return m_images.GetFront().height;
+}
+
+/// <summary>
+/// Get bytes per row of image.
+/// </summary>
+/// <returns>Bytes per row of image.</returns>
+DWORD NuiImageBuffer::GetStride() const
+{
+    return m_images.GetFront().stride;
+}
+
+/// <summary>
+/// Get width of source frames, set by SetImageSize.
+/// </summary>
+/// <returns>Width of source frames.</returns>
+DWORD NuiImageBuffer::GetSourceWidth() const
+{
+    return m_srcWidth;
+}
+
+/// <summary>
+/// Get height of source frames, set by SetImageSize.
+/// </summary>
+/// <returns>Height of source frames.</returns>
+DWORD NuiImageBuffer::GetSourceHeight() const
+{
+    return m_srcHeight;
 }
 
 /// <suumary>
@@ -101,7 +123,8 @@ DWORD NuiImageBuffer::GetHeight() const
 /// <returns>Size of buffer.</returns>
 DWORD NuiImageBuffer::GetBufferSize() const
 {
-    return m_nSizeInBytes;
+    const Image& image = m_images.GetFront();
+    return image.frame ? (DWORD)image.frame->data.size() : image.nSizeInBytes;
 }
 
 /// <summary>
@@ -111,30 +134,68 @@ DWORD NuiImageBuffer::GetBufferSize() const
 /// The pointer to the allocated buffer
 /// Return value could be nullptr if the buffer is not allocated
 /// </returns>
-BYTE* NuiImageBuffer::GetBuffer() const
+const BYTE* NuiImageBuffer::GetBuffer() const
+{
+    const Image& image = m_images.GetFront();
+    return image.frame ? image.frame->data.data() : image.pBuffer;
+}
+
+/// <summary>
+/// Pick up the latest image the stream has published. Called by the viewer before it reads the image
+/// </summary>
+/// <returns>True if there is a new image</returns>
+bool NuiImageBuffer::Update()
 {
-    return m_pBuffer;
+    return m_images.Update();
+}
+
+/// <summary>
+/// Publish a 32 bits per pixel frame shared with the recorder as the next image, without copying it
+/// </summary>
+/// <param name="frame">Handle of the frame</param>
+void NuiImageBuffer::SetFrame(const FrameHandle& frame)
+{
+    if (!frame)
+    {
+        return;
+    }
+
+    // The buffer of the slot is kept for later conversions
+    Image& image = m_images.GetBack();
+    image.width  = frame->width;
+    image.height = frame->height;
+    image.stride = frame->stride;
+    image.frame  = frame;
+
+    m_images.Publish();
 }
 
 /// <summary>
-/// Allocate a buffer of size and return it
+/// Allocate the buffer of the next image and return it. The image takes the source image size
 /// </summary>
 /// <param name="size">Size of buffer to allocate</param>
 /// <returns>The pointer to the allocated buffer. If size hasn't changed, the previously allocated buffer is returned</returns>
 BYTE* NuiImageBuffer::ResetBuffer(UINT size)
 {
-    if (!m_pBuffer || m_nSizeInBytes != size)
+    Image& image = m_images.GetBack();
+    if (!image.pBuffer || image.nSizeInBytes != size)
     {
-        SafeDeleteArray(m_pBuffer);
+        SafeDeleteArray(image.pBuffer);
 
         if (0 != size)
         {
-            m_pBuffer = new BYTE[size];
+            image.pBuffer = new BYTE[size];
         }
-        m_nSizeInBytes = size;
+        image.nSizeInBytes = size;
     }
 
-    return m_pBuffer;
+    // Converted image size is equal to source image size
+    image.width  = 0 != size ? m_srcWidth : 0;
+    image.height = 0 != size ? m_srcHeight : 0;
+    image.stride = image.width * BYTES_PER_PIXEL_RGB;
+    image.frame.Reset();
+
+    return image.pBuffer;
 }
 
 /// <summary>
@@ -142,9 +203,8 @@ BYTE* NuiImageBuffer::ResetBuffer(UINT size)
 /// </summary>
 void NuiImageBuffer::Clear()
 {
-    m_width  = 0;
-    m_height = 0;
     ResetBuffer(0);
+    m_images.Publish();
 }
 
 /// <summary>
@@ -286,15 +346,13 @@ void NuiImageBuffer::CopyRGB(const BYTE* pImage, UINT size)
         return;
     }
 
-    // Set image size to source image size
-    m_width  = m_srcWidth;
-    m_height = m_srcHeight;
-
-    // Allocate buffer for image
-    ResetBuffer(m_width * m_height * BYTES_PER_PIXEL_RGB);
+    // Allocate buffer for image, of source image size
+    BYTE* pBuffer = ResetBuffer(m_srcWidth * m_srcHeight * BYTES_PER_PIXEL_RGB);
 
     // Copy source image to buffer
-    memcpy_s(m_pBuffer, m_nSizeInBytes, pImage, size);
+    memcpy_s(pBuffer, size, pImage, size);
+
+    m_images.Publish();
 }
 
 /// <summary>
@@ -316,12 +374,8 @@ void NuiImageBuffer::CopyBayer(const BYTE* pImage, UINT size)
         return;
     }
 
-    // Converted image size is equal to source image size
-    m_width  = m_srcWidth;
-    m_height = m_srcHeight;
-
-    // Allocate buffer for image
-    UINT* pBuffer = (UINT*)ResetBuffer(m_width * m_height * BYTES_PER_PIXEL_RGB);
+    // Allocate buffer for image, of source image size
+    UINT* pBuffer = (UINT*)ResetBuffer(m_srcWidth * m_srcHeight * BYTES_PER_PIXEL_RGB);
 
     // Run through pixels
     for (DWORD y = 0; y < m_srcHeight; y += 2)
@@ -344,6 +398,8 @@ void NuiImageBuffer::CopyBayer(const BYTE* pImage, UINT size)
             SetColor(pBuffer + secondRowOffset + 1, r, g2, b);
         }
     }
+
+    m_images.Publish();
 }
 
 /// <summary>
@@ -359,12 +415,8 @@ void NuiImageBuffer::CopyInfrared(const BYTE* pImage, UINT size)
         return;
     }
 
-    // Converted image size is equal to source image size
-    m_width  = m_srcWidth;
-    m_height = m_srcHeight;
-
-    // Allocate buffer for image
-    UINT*   pBuffer   = (UINT*)ResetBuffer(m_width * m_height * BYTES_PER_PIXEL_RGB);
+    // Allocate buffer for image, of source image size
+    UINT*   pBuffer   = (UINT*)ResetBuffer(m_srcWidth * m_srcHeight * BYTES_PER_PIXEL_RGB);
 
     // Initialize pixel pointers
     USHORT* pPixelRun = (USHORT*)pImage;
@@ -383,19 +435,22 @@ void NuiImageBuffer::CopyInfrared(const BYTE* pImage, UINT size)
         ++pPixelRun;
         ++pBuffer;
     }
+
+    m_images.Publish();
 }
 
 /// <summary>
-/// Copy and convert depth frame image to image buffer
+/// Convert depth frame split into depth and player index planes to image buffer
 /// </summary>
-/// <param name="pImage">The pointer to the frame image to copy</param>
-/// <param name="size">Size in bytes to copy</param>
+/// <param name="pDepth">The pointer to the depth plane</param>
+/// <param name="pPlayerIndex">The pointer to the player index plane</param>
+/// <param name="pixels">Number of pixels in each plane</param>
 /// <param name="nearMode">Depth stream range mode</param>
 /// <param name="treatment">Depth treatment mode</param>
-void NuiImageBuffer::CopyDepth(const BYTE* pImage, UINT size, BOOL nearMode, DEPTH_TREATMENT treatment)
+void NuiImageBuffer::CopyDepth(const USHORT* pDepth, const BYTE* pPlayerIndex, UINT pixels, BOOL nearMode, DEPTH_TREATMENT treatment)
 {
-    // Check source buffer size
-    if (size != m_srcWidth * m_srcHeight * BYTES_PER_PIXEL_DEPTH)
+    // Check source plane size
+    if (pixels != m_srcWidth * m_srcHeight)
     {
         return;
     }
@@ -409,29 +464,14 @@ void NuiImageBuffer::CopyDepth(const BYTE* pImage, UINT size, BOOL nearMode, DEP
         InitDepthColorTable();
     }
 
-    // Converted image size is equal to source image size
-    m_width  = m_srcWidth;
-    m_height = m_srcHeight;
-
-    // Allocate buffer for color image. If required buffer size hasn't changed, the previously allocated buffer is returned
-    UINT* rgbrun = (UINT*)ResetBuffer(m_width * m_height * BYTES_PER_PIXEL_RGB);
-
-    // Initialize pixel pointers to start and end of image buffer
-    NUI_DEPTH_IMAGE_PIXEL* pPixelRun = (NUI_DEPTH_IMAGE_PIXEL*)pImage;
-    NUI_DEPTH_IMAGE_PIXEL* pPixelEnd = pPixelRun + m_srcWidth * m_srcHeight;
+    // Allocate buffer for color image of source image size. If required buffer size hasn't changed, the previously allocated buffer is returned
+    UINT* rgbrun = (UINT*)ResetBuffer(m_srcWidth * m_srcHeight * BYTES_PER_PIXEL_RGB);
 
-    // Run through pixels
-    while (pPixelRun < pPixelEnd)
+    // Run through pixels, getting mapped color of depth and player index from depth-color table
+    for (UINT i = 0; i < pixels; i++)
     {
-        // Get pixel depth and player index
-        USHORT depth = pPixelRun->depth;
-        USHORT index = pPixelRun->playerIndex;
-
-        // Get mapped color from depth-color table
-        *rgbrun = m_depthColorTable[index][depth];
-
-        // Move the pointers to next pixel
-        ++rgbrun;
-        ++pPixelRun;
+        rgbrun[i] = m_depthColorTable[pPlayerIndex[i]][pDepth[i]];
     }
+
+    m_images.Publish();
 }
\ No newline at end of file
@@ -7,6 +7,8 @@
 #pragma once
 
 #include <NuiApi.h>
+#include "FrameHandle.h"
+#include "TripleBuffer.h"
 
 #define MAX_PLAYER_INDEX    6
 
@@ -17,6 +19,12 @@ enum DEPTH_TREATMENT
     DISPLAY_ALL_DEPTHS,
 };
 
+/// <summary>
+/// Converts stream frames to 32 bits per pixel images for display. Images go from the stream to the
+/// viewer through a triple buffer: the stream writes the next image while the viewer paints the latest
+/// complete one, on another thread if need be. The Copy methods and SetFrame are the producer side,
+/// Update and the image getters the consumer side.
+/// </summary>
 class NuiImageBuffer
 {
 public:
@@ -42,6 +50,12 @@ public:
     /// </summary>
     void Clear();
 
+    /// <summary>
+    /// Pick up the latest image the stream has published. Called by the viewer before it reads the image
+    /// </summary>
+    /// <returns>True if there is a new image</returns>
+    bool Update();
+
     /// <summary>
     /// Get width of image.
     /// </sumamry>
@@ -54,6 +68,24 @@ public:
     /// <returns>Width of height.</returns>
     DWORD GetHeight() const;
 
+    /// <summary>
+    /// Get bytes per row of image.
+    /// </summary>
+    /// <returns>Bytes per row of image.</returns>
+    DWORD GetStride() const;
+
+    /// <summary>
+    /// Get width of source frames, set by SetImageSize.
+    /// </summary>
+    /// <returns>Width of source frames.</returns>
+    DWORD GetSourceWidth() const;
+
+    /// <summary>
+    /// Get height of source frames, set by SetImageSize.
+    /// </summary>
+    /// <returns>Height of source frames.</returns>
+    DWORD GetSourceHeight() const;
+
     /// <suumary>
     /// Get size of buffer.
     /// <summary>
@@ -67,7 +99,13 @@ public:
     /// The pointer to the allocated buffer
     /// Return value could be nullptr if the buffer is not allocated
     /// </returns>
-    BYTE* GetBuffer() const;
+    const BYTE* GetBuffer() const;
+
+    /// <summary>
+    /// Publish a 32 bits per pixel frame shared with the recorder as the next image, without copying it
+    /// </summary>
+    /// <param name="frame">Handle of the frame</param>
+    void SetFrame(const FrameHandle& frame);
 
     /// <summary>
     /// Copy color frame image to image buffer
@@ -91,13 +129,14 @@ public:
     void CopyInfrared(const BYTE* source, UINT size);
 
     /// <summary>
-    /// Copy and convert depth frame image to image buffer
+    /// Convert depth frame split into depth and player index planes to image buffer
     /// </summary>
-    /// <param name="pImage">The pointer to the frame image to copy</param>
-    /// <param name="size">Size in bytes to copy</param>
+    /// <param name="pDepth">The pointer to the depth plane</param>
+    /// <param name="pPlayerIndex">The pointer to the player index plane</param>
+    /// <param name="pixels">Number of pixels in each plane</param>
     /// <param name="nearMode">Depth stream range mode</param>
     /// <param name="treatment">Depth treatment mode</param>
-    void CopyDepth(const BYTE* source, UINT size, BOOL nearMode, DEPTH_TREATMENT treatment);
+    void CopyDepth(const USHORT* pDepth, const BYTE* pPlayerIndex, UINT pixels, BOOL nearMode, DEPTH_TREATMENT treatment);
 
 
 private:
@@ -133,12 +172,27 @@ private:
     BYTE GetIntensity(int depth);
 
     /// <summary>
-    /// Allocate a buffer of size and return it
+    /// Allocate the buffer of the next image and return it. The image takes the source image size
     /// </summary>
     /// <param name="size">Size of buffer to allocate. Zeor to release buffer memory</param>
     /// <returns>The pointer to the allocated buffer. If size hasn't changed, the previously allocated buffer is returned</returns>
     BYTE* ResetBuffer(UINT size);
 
+private:
+    // One image on its way from the stream to the viewer
+    struct Image
+    {
+        DWORD           width;
+        DWORD           height;
+        DWORD           stride;
+        DWORD           nSizeInBytes;
+        BYTE*           pBuffer;
+        FrameHandle     frame;          // Shown instead of the buffer when set
+
+        Image() : width(0), height(0), stride(0), nSizeInBytes(0), pBuffer(nullptr) {}
+       ~Image() { delete[] pBuffer; }
+    };
+
 private:
     static const BYTE    m_intensityShiftR[MAX_PLAYER_INDEX + 1];
     static const BYTE    m_intensityShiftG[MAX_PLAYER_INDEX + 1];
@@ -146,11 +200,8 @@ private:
     UINT                 m_depthColorTable[MAX_PLAYER_INDEX + 1][USHRT_MAX + 1];
 
     bool                m_nearMode;
-    DWORD               m_width;
-    DWORD               m_height;
     DWORD               m_srcWidth;
     DWORD               m_srcHeight;
-    DWORD               m_nSizeInBytes;
-    BYTE*               m_pBuffer;
     DEPTH_TREATMENT     m_depthTreatment;
+    TripleBuffer<Image> m_images;
 };
\ No newline at end of file
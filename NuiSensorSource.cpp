@@ -0,0 +1,368 @@
+//------------------------------------------------------------------------------
+// <copyright file="NuiSensorSource.cpp">
+//     Sensor source delivering the frames of a Kinect sensor.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "NuiSensorSource.h"
+#include "Utility.h"
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="pNuiSensor">The pointer to the initialized Nui sensor, referenced by the source</param>
+NuiSensorSource::NuiSensorSource(INuiSensor* pNuiSensor)
+    : m_pNuiSensor(pNuiSensor)
+    , m_nearMode(false)
+{
+    if (m_pNuiSensor)
+    {
+        m_pNuiSensor->AddRef();
+    }
+
+    for (ImageStream& stream : m_streams)
+    {
+        stream.hStream  = INVALID_HANDLE_VALUE;
+        stream.pTexture = nullptr;
+        stream.taken    = false;
+    }
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+NuiSensorSource::~NuiSensorSource()
+{
+    for (int stream = 0; stream < SensorStreamSkeleton; stream++)
+    {
+        ReleaseImage((SensorStream)stream);
+    }
+
+    SafeRelease(m_pNuiSensor);
+}
+
+/// <summary>
+/// Open or reopen an image stream with the resolution of its size
+/// </summary>
+bool NuiSensorSource::OpenImageStream(SensorStream stream, SensorImageType type, uint32_t& width, uint32_t& height, DispatchEvent& frameReady)
+{
+    static const NUI_IMAGE_TYPE imageTypes[] =
+    {
+        NUI_IMAGE_TYPE_COLOR,
+        NUI_IMAGE_TYPE_COLOR_YUV,
+        NUI_IMAGE_TYPE_COLOR_INFRARED,
+        NUI_IMAGE_TYPE_COLOR_RAW_BAYER,
+        NUI_IMAGE_TYPE_DEPTH,
+        NUI_IMAGE_TYPE_DEPTH_AND_PLAYER_INDEX,
+    };
+
+    static const NUI_IMAGE_RESOLUTION resolutions[] =
+    {
+        NUI_IMAGE_RESOLUTION_80x60,
+        NUI_IMAGE_RESOLUTION_320x240,
+        NUI_IMAGE_RESOLUTION_640x480,
+        NUI_IMAGE_RESOLUTION_1280x960,
+    };
+
+    if (stream >= SensorStreamSkeleton)
+    {
+        return false;
+    }
+
+    bool         depth       = SensorImageDepth == type || SensorImageDepthAndPlayerIndex == type;
+    ImageStream& imageStream = m_streams[stream];
+    if ((SensorStreamDepth == stream) != depth)
+    {
+        return false;
+    }
+
+    for (NUI_IMAGE_RESOLUTION resolution : resolutions)
+    {
+        DWORD resolutionWidth  = 0;
+        DWORD resolutionHeight = 0;
+        NuiImageResolutionToSize(resolution, resolutionWidth, resolutionHeight);
+        if (resolutionWidth != width || resolutionHeight != height)
+        {
+            continue;
+        }
+
+        // A frame still taken belongs to the stream being replaced
+        ReleaseImage(stream);
+
+        HRESULT hr = m_pNuiSensor->NuiImageStreamOpen(imageTypes[type], resolution, 0, 2, frameReady.GetHandle(), &imageStream.hStream);
+        if (SUCCEEDED(hr) && depth)
+        {
+            m_pNuiSensor->NuiImageStreamSetImageFrameFlags(imageStream.hStream, m_nearMode ? NUI_IMAGE_STREAM_FLAG_ENABLE_NEAR_MODE : 0);
+        }
+
+        return SUCCEEDED(hr);
+    }
+
+    return false;
+}
+
+/// <summary>
+/// Set the range of the depth stream, opened or not
+/// </summary>
+void NuiSensorSource::SetNearMode(bool nearMode)
+{
+    m_nearMode = nearMode;
+
+    HANDLE hStream = m_streams[SensorStreamDepth].hStream;
+    if (INVALID_HANDLE_VALUE != hStream)
+    {
+        m_pNuiSensor->NuiImageStreamSetImageFrameFlags(hStream, m_nearMode ? NUI_IMAGE_STREAM_FLAG_ENABLE_NEAR_MODE : 0);
+    }
+}
+
+/// <summary>
+/// Take the next frame of an open stream and lock its texture. Depth comes as depth image pixels
+/// </summary>
+bool NuiSensorSource::GetNextImage(SensorStream stream, SensorImage& image)
+{
+    if (stream >= SensorStreamSkeleton)
+    {
+        return false;
+    }
+
+    ImageStream& imageStream = m_streams[stream];
+    if (INVALID_HANDLE_VALUE == imageStream.hStream || imageStream.taken)
+    {
+        return false;
+    }
+
+    if (FAILED(m_pNuiSensor->NuiImageStreamGetNextFrame(imageStream.hStream, 0, &imageStream.frame)))
+    {
+        return false;
+    }
+    imageStream.taken = true;
+
+    BOOL nearMode = FALSE;
+    if (SensorStreamDepth == stream)
+    {
+        // Depth and player index together, at full depth resolution
+        if (FAILED(m_pNuiSensor->NuiImageFrameGetDepthImagePixelFrameTexture(imageStream.hStream, &imageStream.frame, &nearMode, &imageStream.pTexture)))
+        {
+            imageStream.pTexture = nullptr;
+            ReleaseImage(stream);
+            return false;
+        }
+    }
+    else
+    {
+        imageStream.pTexture = imageStream.frame.pFrameTexture;
+        imageStream.pTexture->AddRef();
+    }
+
+    // Lock the frame data so the Kinect knows not to modify it while we are reading it
+    NUI_LOCKED_RECT lockedRect;
+    imageStream.pTexture->LockRect(0, &lockedRect, NULL, 0);
+
+    image.pBits       = lockedRect.pBits;
+    image.pitch       = (uint32_t)lockedRect.Pitch;
+    image.size        = (uint32_t)lockedRect.size;
+    image.frameNumber = imageStream.frame.dwFrameNumber;
+    image.sensorTime  = imageStream.frame.liTimeStamp.QuadPart;
+    image.nearMode    = FALSE != nearMode;
+    return true;
+}
+
+/// <summary>
+/// Unlock the texture of a frame taken with GetNextImage and release the frame
+/// </summary>
+void NuiSensorSource::ReleaseImage(SensorStream stream)
+{
+    if (stream >= SensorStreamSkeleton)
+    {
+        return;
+    }
+
+    ImageStream& imageStream = m_streams[stream];
+    if (imageStream.pTexture)
+    {
+        imageStream.pTexture->UnlockRect(0);
+        imageStream.pTexture->Release();
+        imageStream.pTexture = nullptr;
+    }
+
+    if (imageStream.taken)
+    {
+        m_pNuiSensor->NuiImageStreamReleaseFrame(imageStream.hStream, &imageStream.frame);
+        imageStream.taken = false;
+    }
+}
+
+/// <summary>
+/// Check whether the sensor was initialized with skeleton tracking
+/// </summary>
+bool NuiSensorSource::HasSkeletonTracking() const
+{
+    return FALSE != HasSkeletalEngine(m_pNuiSensor);
+}
+
+/// <summary>
+/// Start tracking skeletons, or change the options of tracking
+/// </summary>
+bool NuiSensorSource::EnableSkeletonTracking(uint32_t flags, DispatchEvent& frameReady)
+{
+    DWORD nuiFlags = ((flags & SensorTrackingSeated) ? NUI_SKELETON_TRACKING_FLAG_ENABLE_SEATED_SUPPORT : 0)
+        | ((flags & SensorTrackingNearRange) ? NUI_SKELETON_TRACKING_FLAG_ENABLE_IN_NEAR_RANGE : 0)
+        | ((flags & SensorTrackingChooseSkeletons) ? NUI_SKELETON_TRACKING_FLAG_TITLE_SETS_TRACKED_SKELETONS : 0);
+
+    return SUCCEEDED(m_pNuiSensor->NuiSkeletonTrackingEnable(frameReady.GetHandle(), nuiFlags));
+}
+
+/// <summary>
+/// Stop tracking skeletons
+/// </summary>
+bool NuiSensorSource::DisableSkeletonTracking()
+{
+    return SUCCEEDED(m_pNuiSensor->NuiSkeletonTrackingDisable());
+}
+
+/// <summary>
+/// Take the next skeleton frame and smooth it out
+/// </summary>
+bool NuiSensorSource::GetNextSkeletonFrame(SensorSkeletonFrame& frame)
+{
+    NUI_SKELETON_FRAME skeletonFrame;
+    if (FAILED(m_pNuiSensor->NuiSkeletonGetNextFrame(0, &skeletonFrame)))
+    {
+        return false;
+    }
+
+    m_pNuiSensor->NuiTransformSmooth(&skeletonFrame, nullptr);
+    FromNuiSkeletonFrame(skeletonFrame, frame);
+    return true;
+}
+
+/// <summary>
+/// Choose the skeletons tracked in full
+/// </summary>
+void NuiSensorSource::SetTrackedSkeletons(const uint32_t trackingIds[2])
+{
+    DWORD ids[2] = {trackingIds[0], trackingIds[1]};
+    m_pNuiSensor->NuiSkeletonSetTrackedSkeletons(ids);
+}
+
+/// <summary>
+/// Get the latest reading of the accelerometer
+/// </summary>
+bool NuiSensorSource::GetAccelerometerReading(SensorVector& reading)
+{
+    Vector4 vector;
+    if (FAILED(m_pNuiSensor->NuiAccelerometerGetCurrentReading(&vector)))
+    {
+        return false;
+    }
+
+    reading.x = vector.x;
+    reading.y = vector.y;
+    reading.z = vector.z;
+    reading.w = vector.w;
+    return true;
+}
+
+/// <summary>
+/// Get the image type of a source for a Nui image type
+/// </summary>
+/// <param name="type">Nui image type</param>
+/// <returns>Image type, BGRA color for types without one</returns>
+SensorImageType NuiSensorSource::ToImageType(NUI_IMAGE_TYPE type)
+{
+    switch (type)
+    {
+    case NUI_IMAGE_TYPE_COLOR_YUV:              return SensorImageColorYuv;
+    case NUI_IMAGE_TYPE_COLOR_INFRARED:         return SensorImageColorInfrared;
+    case NUI_IMAGE_TYPE_COLOR_RAW_BAYER:        return SensorImageColorRawBayer;
+    case NUI_IMAGE_TYPE_DEPTH:                  return SensorImageDepth;
+    case NUI_IMAGE_TYPE_DEPTH_AND_PLAYER_INDEX: return SensorImageDepthAndPlayerIndex;
+    default:                                    return SensorImageColor;
+    }
+}
+
+/// <summary>
+/// Copy a vector of a source into a Nui vector
+/// </summary>
+static Vector4 ToVector4(const SensorVector& vector)
+{
+    Vector4 result = {vector.x, vector.y, vector.z, vector.w};
+    return result;
+}
+
+/// <summary>
+/// Copy a Nui vector into a vector of a source
+/// </summary>
+static SensorVector FromVector4(const Vector4& vector)
+{
+    SensorVector result = {vector.x, vector.y, vector.z, vector.w};
+    return result;
+}
+
+/// <summary>
+/// Copy a skeleton frame of a source into a Nui skeleton frame, as the viewers and the skeleton choosers take it
+/// </summary>
+/// <param name="source">Frame taken from a source</param>
+/// <param name="frame">Receives the frame</param>
+void NuiSensorSource::ToNuiSkeletonFrame(const SensorSkeletonFrame& source, NUI_SKELETON_FRAME& frame)
+{
+    ZeroMemory(&frame, sizeof(frame));
+    frame.liTimeStamp.QuadPart = source.sensorTime;
+    frame.dwFrameNumber        = source.frameNumber;
+    frame.dwFlags              = source.flags;
+    frame.vFloorClipPlane      = ToVector4(source.floorClipPlane);
+    frame.vNormalToGravity     = ToVector4(source.normalToGravity);
+
+    for (int i = 0; i < SensorSkeletonCount; i++)
+    {
+        const SensorSkeleton& skeleton = source.skeletons[i];
+        NUI_SKELETON_DATA&    data     = frame.SkeletonData[i];
+
+        data.eTrackingState    = (NUI_SKELETON_TRACKING_STATE)skeleton.trackingState;
+        data.dwTrackingID      = skeleton.trackingId;
+        data.dwEnrollmentIndex = skeleton.enrollmentIndex;
+        data.dwUserIndex       = skeleton.userIndex;
+        data.Position          = ToVector4(skeleton.position);
+        data.dwQualityFlags    = skeleton.qualityFlags;
+
+        for (int joint = 0; joint < SensorJointCount; joint++)
+        {
+            data.SkeletonPositions[joint]               = ToVector4(skeleton.joints[joint]);
+            data.eSkeletonPositionTrackingState[joint]  = (NUI_SKELETON_POSITION_TRACKING_STATE)skeleton.jointStates[joint];
+        }
+    }
+}
+
+/// <summary>
+/// Copy a Nui skeleton frame into a skeleton frame of a source
+/// </summary>
+/// <param name="source">Frame taken from the sensor</param>
+/// <param name="frame">Receives the frame</param>
+void NuiSensorSource::FromNuiSkeletonFrame(const NUI_SKELETON_FRAME& source, SensorSkeletonFrame& frame)
+{
+    frame.sensorTime      = source.liTimeStamp.QuadPart;
+    frame.frameNumber     = source.dwFrameNumber;
+    frame.flags           = source.dwFlags;
+    frame.floorClipPlane  = FromVector4(source.vFloorClipPlane);
+    frame.normalToGravity = FromVector4(source.vNormalToGravity);
+
+    for (int i = 0; i < SensorSkeletonCount; i++)
+    {
+        const NUI_SKELETON_DATA& data     = source.SkeletonData[i];
+        SensorSkeleton&          skeleton = frame.skeletons[i];
+
+        skeleton.trackingState   = data.eTrackingState;
+        skeleton.trackingId      = data.dwTrackingID;
+        skeleton.enrollmentIndex = data.dwEnrollmentIndex;
+        skeleton.userIndex       = data.dwUserIndex;
+        skeleton.position        = FromVector4(data.Position);
+        skeleton.qualityFlags    = data.dwQualityFlags;
+
+        for (int joint = 0; joint < SensorJointCount; joint++)
+        {
+            skeleton.joints[joint]      = FromVector4(data.SkeletonPositions[joint]);
+            skeleton.jointStates[joint] = data.eSkeletonPositionTrackingState[joint];
+        }
+    }
+}
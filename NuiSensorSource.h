@@ -0,0 +1,80 @@
+//------------------------------------------------------------------------------
+// <copyright file="NuiSensorSource.h">
+//     Sensor source delivering the frames of a Kinect sensor.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <NuiApi.h>
+#include "SensorSource.h"
+
+/// <summary>
+/// Source taking the frames of the streams from a Kinect sensor through INuiSensor. The sensor has to be
+/// initialized with the streams used. Each stream is only called from one thread at a time, the one holding
+/// the lock of the stream, so the source keeps no lock of its own
+/// </summary>
+class NuiSensorSource : public SensorSource
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="pNuiSensor">The pointer to the initialized Nui sensor, referenced by the source</param>
+    NuiSensorSource(INuiSensor* pNuiSensor);
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+   ~NuiSensorSource();
+
+public:
+    virtual bool OpenImageStream(SensorStream stream, SensorImageType type, uint32_t& width, uint32_t& height, DispatchEvent& frameReady);
+    virtual void SetNearMode(bool nearMode);
+    virtual bool GetNextImage(SensorStream stream, SensorImage& image);
+    virtual void ReleaseImage(SensorStream stream);
+    virtual bool HasSkeletonTracking() const;
+    virtual bool EnableSkeletonTracking(uint32_t flags, DispatchEvent& frameReady);
+    virtual bool DisableSkeletonTracking();
+    virtual bool GetNextSkeletonFrame(SensorSkeletonFrame& frame);
+    virtual void SetTrackedSkeletons(const uint32_t trackingIds[2]);
+    virtual bool GetAccelerometerReading(SensorVector& reading);
+    virtual bool IsFinished() const { return false; }
+
+public:
+    /// <summary>
+    /// Get the image type of a source for a Nui image type
+    /// </summary>
+    /// <param name="type">Nui image type</param>
+    /// <returns>Image type, BGRA color for types without one</returns>
+    static SensorImageType ToImageType(NUI_IMAGE_TYPE type);
+
+    /// <summary>
+    /// Copy a skeleton frame of a source into a Nui skeleton frame, as the viewers and the skeleton choosers take it
+    /// </summary>
+    /// <param name="source">Frame taken from a source</param>
+    /// <param name="frame">Receives the frame</param>
+    static void ToNuiSkeletonFrame(const SensorSkeletonFrame& source, NUI_SKELETON_FRAME& frame);
+
+    /// <summary>
+    /// Copy a Nui skeleton frame into a skeleton frame of a source
+    /// </summary>
+    /// <param name="source">Frame taken from the sensor</param>
+    /// <param name="frame">Receives the frame</param>
+    static void FromNuiSkeletonFrame(const NUI_SKELETON_FRAME& source, SensorSkeletonFrame& frame);
+
+private:
+    // Image stream of the sensor, with the frame taken and not released yet
+    struct ImageStream
+    {
+        HANDLE              hStream;
+        NUI_IMAGE_FRAME     frame;
+        INuiFrameTexture*   pTexture;       // Locked texture of the frame, owned for depth pixels
+        bool                taken;
+    };
+
+private:
+    INuiSensor*     m_pNuiSensor;
+    ImageStream     m_streams[SensorStreamSkeleton];
+    bool            m_nearMode;
+};
@@ -7,13 +7,14 @@
 #include "stdafx.h"
 #include "NuiSkeletonStream.h"
 #include "NuiStreamViewer.h"
+#include "NuiSensorSource.h"
 
 /// <summary>
 /// Constructor
 /// <summary>
-/// <param name="pNuiSensor">The pointer to NUI sensor device instance</param>
-NuiSkeletonStream::NuiSkeletonStream(INuiSensor* pNuiSensor)
-    : NuiStream(pNuiSensor)
+/// <param name="pSource">The pointer to the source the skeletons come from</param>
+NuiSkeletonStream::NuiSkeletonStream(SensorSource* pSource)
+    : NuiStream(pSource)
     , m_near(false)
     , m_seated(false)
     , m_chooserMode(ChooserModeDefault)
@@ -42,6 +43,8 @@ NuiSkeletonStream::~NuiSkeletonStream()
 /// <param name="nearMode">True to enable near mode. False to disable</param>
 void NuiSkeletonStream::SetNearMode(bool nearMode)
 {
+    StreamLock lock(this);
+
     if (m_near != nearMode)
     {
         m_near = nearMode;
@@ -55,6 +58,8 @@ void NuiSkeletonStream::SetNearMode(bool nearMode)
 /// <param name="seated">True to enable seated mode. False to disable</param>
 void NuiSkeletonStream::SetSeatedMode(bool seated)
 {
+    StreamLock lock(this);
+
     if (m_seated != seated)
     {
         m_seated = seated;
@@ -68,6 +73,8 @@ void NuiSkeletonStream::SetSeatedMode(bool seated)
 /// <param name="mode">Chooser mode to be set</param>
 void NuiSkeletonStream::SetChooserMode(ChooserMode mode)
 {
+    StreamLock lock(this);
+
     if (m_chooserMode != mode)
     {
         m_chooserMode = mode;
@@ -81,6 +88,8 @@ void NuiSkeletonStream::SetChooserMode(ChooserMode mode)
 /// <param name="pStreamViewer">The pointer to the stream viewer to be attached</param>
 void NuiSkeletonStream::SetSecondStreamViewer(NuiStreamViewer* pStreamViewer)
 {
+    StreamLock lock(this);
+
     m_pSecondStreamViewer = pStreamViewer;
 }
 
@@ -89,7 +98,9 @@ void NuiSkeletonStream::SetSecondStreamViewer(NuiStreamViewer* pStreamViewer)
 /// </summary>
 HRESULT NuiSkeletonStream::StartStream()
 {
-    if (HasSkeletalEngine(m_pNuiSensor))
+    StreamLock lock(this);
+
+    if (m_pSource->HasSkeletonTracking())
     {
         if (m_paused)
         {
@@ -97,14 +108,14 @@ HRESULT NuiSkeletonStream::StartStream()
             AssignSkeletonFrameToStreamViewers(nullptr);
 
             // Disable tracking skeleton
-            return m_pNuiSensor->NuiSkeletonTrackingDisable();
+            return m_pSource->DisableSkeletonTracking() ? S_OK : E_FAIL;
         }
         else
         {
             // Enable tracking skeleton
-            DWORD flags = (m_seated ? NUI_SKELETON_TRACKING_FLAG_ENABLE_SEATED_SUPPORT : 0) | (m_near ? NUI_SKELETON_TRACKING_FLAG_ENABLE_IN_NEAR_RANGE : 0)
-                | (ChooserModeDefault != m_chooserMode ? NUI_SKELETON_TRACKING_FLAG_TITLE_SETS_TRACKED_SKELETONS : 0);
-            return m_pNuiSensor->NuiSkeletonTrackingEnable(GetFrameReadyEvent(), flags);
+            uint32_t flags = (m_seated ? SensorTrackingSeated : 0) | (m_near ? SensorTrackingNearRange : 0)
+                | (ChooserModeDefault != m_chooserMode ? SensorTrackingChooseSkeletons : 0);
+            return m_pSource->EnableSkeletonTracking(flags, m_frameReady) ? S_OK : E_FAIL;
         }
     }
 
@@ -117,6 +128,8 @@ HRESULT NuiSkeletonStream::StartStream()
 /// <param name="pause">True to pause the stream and false to resume</param>
 void NuiSkeletonStream::PauseStream(bool pause)
 {
+    StreamLock lock(this);
+
     if (m_paused != pause)
     {
         m_paused = pause;
@@ -129,11 +142,8 @@ void NuiSkeletonStream::PauseStream(bool pause)
 /// </summary>
 void NuiSkeletonStream::ProcessStreamFrame()
 {
-    if (WAIT_OBJECT_0 == WaitForSingleObject(GetFrameReadyEvent(), 0))
-    {
-        // if we have received any valid new depth data we may need to draw
-        ProcessSkeleton();
-    }
+    // Only dispatched when the frame ready event has been set
+    ProcessSkeleton();
 }
 
 /// <summary>
@@ -141,9 +151,9 @@ void NuiSkeletonStream::ProcessStreamFrame()
 /// <summary>
 void NuiSkeletonStream::ProcessSkeleton()
 {
-    // Retrieve skeleton frame
-    HRESULT hr = m_pNuiSensor->NuiSkeletonGetNextFrame(0, &m_skeletonFrame);
-    if (FAILED(hr) || m_paused)
+    // Retrieve skeleton frame, smoothed by the source
+    SensorSkeletonFrame skeletonFrame;
+    if (!m_pSource->GetNextSkeletonFrame(skeletonFrame) || m_paused)
     {
         // If occur error when get skeleton data or pause tracking skeleton,
         // clear skeleton data in stream viewers
@@ -151,11 +161,11 @@ void NuiSkeletonStream::ProcessSkeleton()
         return;
     }
 
-    // smooth out the skeleton data
-    m_pNuiSensor->NuiTransformSmooth(&m_skeletonFrame, nullptr);
+    NuiSensorSource::ToNuiSkeletonFrame(skeletonFrame, m_skeletonFrame);
 
     // Set skeleton data to stream viewers
     AssignSkeletonFrameToStreamViewers(&m_skeletonFrame);
+    m_frameCount++;
 
     UpdateTrackedSkeletons();
 }
@@ -186,7 +196,8 @@ void NuiSkeletonStream::UpdateTrackedSkeletons()
         trackIDs[SecondTrackID] = 0;
     }
 
-    m_pNuiSensor->NuiSkeletonSetTrackedSkeletons(trackIDs);
+    uint32_t ids[TrackIDIndexCount] = {trackIDs[FirstTrackID], trackIDs[SecondTrackID]};
+    m_pSource->SetTrackedSkeletons(ids);
 }
 
 /// <summary>
@@ -36,8 +36,8 @@ public:
     /// <summary>
     /// Constructor
     /// <summary>
-    /// <param name="pNuiSensor">The pointer to NUI sensor device instance</param>
-    NuiSkeletonStream(INuiSensor* pNuiSensor);
+    /// <param name="pSource">The pointer to the source the skeletons come from</param>
+    NuiSkeletonStream(SensorSource* pSource);
 
     /// <summary>
     /// Destructor
@@ -11,19 +11,11 @@
 /// <summary>
 /// Constructor
 /// </summary>
-/// <param name="pNuiSensor">The pointer to Nui sensor device instance</param>
-NuiStream::NuiStream(INuiSensor* pNuiSensor)
-    : m_pNuiSensor(pNuiSensor)
+/// <param name="pSource">The pointer to the source the frames come from, a sensor or a stand-in for one</param>
+NuiStream::NuiStream(SensorSource* pSource)
+    : FrameStream(pSource)
     , m_pStreamViewer(nullptr)
-    , m_hStreamHandle(INVALID_HANDLE_VALUE)
-    , m_paused(false)
 {
-    if (m_pNuiSensor)
-    {
-        m_pNuiSensor->AddRef();
-    }
-
-    m_hFrameReadyEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
 }
 
 /// <summary>
@@ -36,18 +28,6 @@ NuiStream::~NuiStream()
         // Clear reference to image buffer in stream viewer
         m_pStreamViewer->SetImage(nullptr);
     }
-
-    CloseHandle(m_hFrameReadyEvent);
-    SafeRelease(m_pNuiSensor);
-}
-
-/// <summary>
-/// Get stream frame ready event handle
-/// </summary>
-/// <returns>Handle to event</returns>
-HANDLE NuiStream::GetFrameReadyEvent()
-{
-    return m_hFrameReadyEvent;
 }
 
 /// <summary>
@@ -56,10 +36,15 @@ HANDLE NuiStream::GetFrameReadyEvent()
 /// <param name="pause">Pause or resume the stream</param>
 void NuiStream::PauseStream(bool pause)
 {
-    m_paused = pause;
+    StreamLock lock(this);
+
+    FrameStream::PauseStream(pause);
 
     // And meanwhile pause the skeleton
-    m_pStreamViewer->PauseSkeleton(pause);
+    if (m_pStreamViewer)
+    {
+        m_pStreamViewer->PauseSkeleton(pause);
+    }
 }
 
 /// <summary>
@@ -69,6 +54,8 @@ void NuiStream::PauseStream(bool pause)
 /// <returns>Previously attached viewer object. If none, returns nullptr</returns>
 NuiStreamViewer* NuiStream::SetStreamViewer(NuiStreamViewer * pStreamViewer)
 {
+    StreamLock lock(this);
+
     NuiStreamViewer* pOldViewer = m_pStreamViewer;
     m_pStreamViewer = pStreamViewer;
 
@@ -79,4 +66,16 @@ NuiStreamViewer* NuiStream::SetStreamViewer(NuiStreamViewer * pStreamViewer)
     }
 
     return pOldViewer;
-}
\ No newline at end of file
+}
+
+/// <summary>
+/// Show the frames the recorder dropped so far on the viewer
+/// </summary>
+/// <param name="dropped">Frames of the stream dropped by the recorder, 0 while not recording</param>
+void NuiStream::ShowDroppedFrames(uint64_t dropped)
+{
+    if (m_pStreamViewer)
+    {
+        m_pStreamViewer->SetDroppedFrames((LONG)dropped);
+    }
+}
@@ -8,16 +8,20 @@
 
 #include <NuiApi.h>
 #include "NuiStreamViewer.h"
+#include "FrameStream.h"
 #include "Utility.h"
 
-class NuiStream
+/// <summary>
+/// Stream of the window, showing the frames of the source on a viewer while handing them to the recorder
+/// </summary>
+class NuiStream : public FrameStream
 {
 public:
     /// <summary>
     /// Constructor
     /// </summary>
-    /// <param name="pNuiSensor">The pointer to Nui sensor device instance</param>
-    NuiStream(INuiSensor * pNuiSensor);
+    /// <param name="pSource">The pointer to the source the frames come from, a sensor or a stand-in for one</param>
+    NuiStream(SensorSource* pSource);
 
     /// <summary>
     /// Destructor
@@ -32,12 +36,6 @@ public:
     /// <returns>Previously attached viewer object. If none, returns nullptr</returns>
     virtual NuiStreamViewer* SetStreamViewer(NuiStreamViewer* pStreamViewer);
 
-    /// <summary>
-    /// Subclass should override this method to process the next incoming
-    /// stream frame when stream event is set.
-    /// </summary>
-    virtual void ProcessStreamFrame() = 0;
-
     /// <summary>
     /// Pause the stream
     /// </summary>
@@ -49,18 +47,13 @@ public:
     /// </summary>
     virtual HRESULT StartStream() = 0;
 
-public:
+protected:
     /// <summary>
-    /// Get stream frame ready event handle
+    /// Show the frames the recorder dropped so far on the viewer
     /// </summary>
-    /// <returns>Handle to event</returns>
-    HANDLE GetFrameReadyEvent();
+    /// <param name="dropped">Frames of the stream dropped by the recorder, 0 while not recording</param>
+    virtual void ShowDroppedFrames(uint64_t dropped);
 
 protected:
     NuiStreamViewer*    m_pStreamViewer;
-    INuiSensor*         m_pNuiSensor;
-
-    bool                m_paused;
-    HANDLE              m_hStreamHandle;
-    HANDLE              m_hFrameReadyEvent;
-};
\ No newline at end of file
+};
@@ -19,11 +19,12 @@ NuiStreamViewer::NuiStreamViewer(const NuiViewer* pParent)
     , m_imageType(NUI_IMAGE_TYPE_COLOR)
     , m_pImage(nullptr)
     , m_pauseSkeleton(false)
-    , m_pSkeletonFrame(nullptr)
     , m_drawEdgeFlags(0)
     , m_frameCount(0)
     , m_lastFrameCount(0)
     , m_fps(0)
+    , m_droppedFrames(0)
+    , m_repaintPending(0)
 {
     m_pImageRenderer = new ImageRenderer();
 
@@ -91,6 +92,9 @@ UINT NuiStreamViewer::GetDlgId()
 /// <param name="lParam">Extra message parameter</param>
 void NuiStreamViewer::OnPaint(WPARAM wParam, LPARAM lParam)
 {
+    // Frames published from here on need another repaint
+    InterlockedExchange(&m_repaintPending, 0);
+
     HRESULT hr = m_pImageRenderer->BeginDraw(m_hWnd);
     if (FAILED(hr))
         return;
@@ -102,6 +106,14 @@ void NuiStreamViewer::OnPaint(WPARAM wParam, LPARAM lParam)
         return;
     }
 
+    // Take the latest complete image and skeletons. They stay the same while they are drawn, whatever the streams write meanwhile
+    if (m_pImage)
+    {
+        m_pImage->Update();
+    }
+    m_skeletons.Update();
+    UpdateFrameRate();
+
     // Calculate the area the stream image is to streched to fit
     D2D1_RECT_F imageRect = GetImageRect(clientRect);
 
@@ -117,6 +129,9 @@ void NuiStreamViewer::OnPaint(WPARAM wParam, LPARAM lParam)
     // Draw FPS
     DrawFPS(clientRect);
 
+    // Draw frames dropped by the recorder
+    DrawDroppedFrames(clientRect);
+
     // Draw red edges if skeleton is close to edges of image
     DrawRedEdges(imageRect);
 
@@ -129,10 +144,12 @@ void NuiStreamViewer::OnPaint(WPARAM wParam, LPARAM lParam)
 /// <param name="imageRect">The rect which the color or depth image is streched to fit</param>
 void NuiStreamViewer::DrawImage(const D2D1_RECT_F& imageRect)
 {
-    if (m_pImage && m_pImage->GetBufferSize())
+    D2D1_SIZE_U imageSize;
+    UINT        stride;
+    const BYTE* pPixels = GetImagePixels(imageSize, stride);
+    if (pPixels)
     {
-        D2D1_SIZE_U imageSize = D2D1::SizeU(m_pImage->GetWidth(), m_pImage->GetHeight());
-        m_pImageRenderer->DrawImage(m_pImage->GetBuffer(), imageSize, imageRect);
+        m_pImageRenderer->DrawImage(pPixels, imageSize, stride, imageRect);
     }
 }
 
@@ -142,22 +159,23 @@ void NuiStreamViewer::DrawImage(const D2D1_RECT_F& imageRect)
 /// <param name="imageRect">The rect which the color or depth stream image is streched to fit</param>
 void NuiStreamViewer::DrawSkeletons(const D2D1_RECT_F& imageRect)
 {
-    if (m_pSkeletonFrame && !m_pauseSkeleton)
+    const Skeletons& skeletons = m_skeletons.GetFront();
+    if (skeletons.valid && !m_pauseSkeleton)
     {
         // Clip the area to avoid drawing outside the image
         m_pImageRenderer->SetClipRect(imageRect);
 
         for (int i = 0; i < NUI_SKELETON_COUNT; i++)
         {
-            NUI_SKELETON_TRACKING_STATE state = m_pSkeletonFrame->SkeletonData[i].eTrackingState;
+            NUI_SKELETON_TRACKING_STATE state = skeletons.frame.SkeletonData[i].eTrackingState;
             if (NUI_SKELETON_TRACKED == state)
             {
                 // Draw bones and joints of tracked skeleton
-                DrawSkeleton(m_pSkeletonFrame->SkeletonData[i], imageRect);
+                DrawSkeleton(skeletons.frame.SkeletonData[i], imageRect);
             }
             else if (NUI_SKELETON_POSITION_ONLY == state)
             {
-                DrawPosition(m_pSkeletonFrame->SkeletonData[i], imageRect);
+                DrawPosition(skeletons.frame.SkeletonData[i], imageRect);
             }
         }
 
@@ -319,15 +337,33 @@ void NuiStreamViewer::DrawFPS(const RECT& clientRect)
 /// <param name="clientRect">Client area of viewer's window</param>
 void NuiStreamViewer::DrawResolution(const RECT& clientRect)
 {
-    if (m_pImage)
+    D2D1_SIZE_U imageSize;
+    UINT        stride;
+    if (GetImagePixels(imageSize, stride))
     {
         WCHAR buffer[MaxStringChars];
         D2D1_RECT_F rect = D2D1::RectF((FLOAT)clientRect.left, (FLOAT)clientRect.top, (FLOAT)clientRect.right, 10.0f);
-        swprintf_s(buffer, sizeof(buffer) / sizeof(WCHAR), L"Resolution: %dx%d", m_pImage->GetWidth(), m_pImage->GetHeight());
+        swprintf_s(buffer, sizeof(buffer) / sizeof(WCHAR), L"Resolution: %dx%d", imageSize.width, imageSize.height);
         m_pImageRenderer->DrawText(buffer, (UINT)wcsnlen_s(buffer, MaxStringChars), rect, ImageRendererBrushGreen, ImageRendererTextFormatResolution);
     }
 }
 
+/// <summary>
+/// Draw the number of frames dropped by the recorder
+/// </summary>
+/// <param name="clientRect">Client area of viewer's window</param>
+void NuiStreamViewer::DrawDroppedFrames(const RECT& clientRect)
+{
+    LONG dropped = m_droppedFrames;
+    if (dropped > 0)
+    {
+        WCHAR buffer[MaxStringChars];
+        D2D1_RECT_F rect = D2D1::RectF((FLOAT)clientRect.left, (FLOAT)clientRect.top + 16.0f, (FLOAT)clientRect.right - 50.0f, 26.0f);
+        swprintf_s(buffer, sizeof(buffer) / sizeof(WCHAR), L"Recording: %d frames dropped", dropped);
+        m_pImageRenderer->DrawText(buffer, (UINT)wcsnlen_s(buffer, MaxStringChars), rect, ImageRendererBrushRed, ImageRendererTextFormatResolution);
+    }
+}
+
 /// <summary>
 /// Draw red edge on image when skeleton is close to or out of the image edge
 /// </summary>
@@ -408,24 +444,44 @@ void NuiStreamViewer::DrawRedEdges(const D2D1_RECT_F& imageRect)
 }
 
 /// <summary>
-/// Set the buffer containing the image pixels.
+/// Set the buffer containing the image pixels. Called when the viewer is attached to a stream
 /// </summary>
 /// <param name="pImage">The pointer to image buffer object</param>
-void NuiStreamViewer::SetImage(const NuiImageBuffer* pImage)
+void NuiStreamViewer::SetImage(NuiImageBuffer* pImage)
 {
     m_pImage = pImage;
-    if (m_pImage &&  m_pImage->GetBufferSize() && m_hWnd)
+    if (m_pImage)
     {
-        InvalidateRect(m_hWnd, nullptr, FALSE);
+        RequestRepaint();
+    }
+}
+
+/// <summary>
+/// Count an image published to the image buffer and schedule a repaint. Called from the acquisition thread
+/// </summary>
+void NuiStreamViewer::NotifyImage()
+{
+    InterlockedIncrement(&m_frameCount);
+    RequestRepaint();
+}
 
-        UpdateFrameRate();
+/// <summary>
+/// Set the number of frames the recorder has dropped in the current session, shown until it is reset to 0.
+/// Called from the acquisition thread
+/// </summary>
+/// <param name="count">Number of dropped frames</param>
+void NuiStreamViewer::SetDroppedFrames(LONG count)
+{
+    if (InterlockedExchange(&m_droppedFrames, count) != count)
+    {
+        RequestRepaint();
     }
 }
 
 /// <summary>
-/// Attach skeleton data.
+/// Copy skeleton data for the next repaint. Called from the acquisition thread of the skeleton stream
 /// </summary>
-/// <param name="pFrame">The pointer to skeleton frame</param>
+/// <param name="pFrame">The pointer to skeleton frame, nullptr to clear the skeletons</param>
 void NuiStreamViewer::SetSkeleton(const NUI_SKELETON_FRAME* pFrame)
 {
     if (!m_hWnd)
@@ -433,25 +489,42 @@ void NuiStreamViewer::SetSkeleton(const NUI_SKELETON_FRAME* pFrame)
         return;
     }
 
-    m_pSkeletonFrame = pFrame;
+    Skeletons& skeletons = m_skeletons.GetBack();
+    skeletons.valid = nullptr != pFrame;
+    if (pFrame)
+    {
+        skeletons.frame = *pFrame;
+    }
+    m_skeletons.Publish();
 
-    InvalidateRect(m_hWnd, nullptr, FALSE);
+    RequestRepaint();
 }
 
 /// <summary>
-/// Update frame rate
+/// Update frame rate from the images counted since the last update
 /// </summary>
 void NuiStreamViewer::UpdateFrameRate()
 {
-    m_frameCount++;
-
-    DWORD tickCount = GetTickCount();
-    DWORD span      = tickCount - m_lastTick;
+    LONG  frameCount = m_frameCount;
+    DWORD tickCount  = GetTickCount();
+    DWORD span       = tickCount - m_lastTick;
     if (span >= 1000)
     {
-        m_fps            = (UINT)((double)(m_frameCount - m_lastFrameCount) * 1000.0 / (double)span + 0.5);
+        m_fps            = (UINT)((double)(frameCount - m_lastFrameCount) * 1000.0 / (double)span + 0.5);
         m_lastTick       = tickCount;
-        m_lastFrameCount = m_frameCount;
+        m_lastFrameCount = frameCount;
+    }
+}
+
+/// <summary>
+/// Invalidate the window unless a repaint is pending already, so frames arriving faster than the
+/// window paints post one WM_PAINT between them. Safe to call from any thread
+/// </summary>
+void NuiStreamViewer::RequestRepaint()
+{
+    if (m_hWnd && 0 == InterlockedExchange(&m_repaintPending, 1))
+    {
+        InvalidateRect(m_hWnd, nullptr, FALSE);
     }
 }
 
@@ -512,9 +585,11 @@ bool NuiStreamViewer::IsOutOfImageRect(const D2D1_POINT_2F& point, const D2D1_RE
 D2D1_RECT_F NuiStreamViewer::GetImageRect(const RECT &client)
 {
     D2D1_RECT_F imageRect = D2D1::RectF();
-    if (m_pImage && m_pImage->GetBuffer())
+    D2D1_SIZE_U imageSize;
+    UINT        stride;
+    if (GetImagePixels(imageSize, stride))
     {
-        float ratio  = static_cast<float>(m_pImage->GetWidth()) / static_cast<float>(m_pImage->GetHeight());
+        float ratio  = static_cast<float>(imageSize.width) / static_cast<float>(imageSize.height);
         float width  = static_cast<float>(client.right);
         float height = width / ratio;
 
@@ -533,6 +608,24 @@ D2D1_RECT_F NuiStreamViewer::GetImageRect(const RECT &client)
     return imageRect;
 }
 
+/// <summary>
+/// Get the pixels of the image picked up from the image buffer
+/// </summary>
+/// <param name="size">Receives the image size</param>
+/// <param name="stride">Receives the bytes per row</param>
+/// <returns>The pointer to the pixels, nullptr if there is no image</returns>
+const BYTE* NuiStreamViewer::GetImagePixels(D2D1_SIZE_U& size, UINT& stride) const
+{
+    if (!m_pImage || !m_pImage->GetBufferSize() || !m_pImage->GetBuffer() || 0 == m_pImage->GetHeight())
+    {
+        return nullptr;
+    }
+
+    size   = D2D1::SizeU(m_pImage->GetWidth(), m_pImage->GetHeight());
+    stride = m_pImage->GetStride();
+    return m_pImage->GetBuffer();
+}
+
 /// <summary>
 /// Map skeleton point to window coordinate in image rect.
 /// </summary>
@@ -11,6 +11,7 @@
 #include "NuiViewer.h"
 #include "NuiImageBuffer.h"
 #include "ImageRenderer.h"
+#include "TripleBuffer.h"
 
 enum DRAW_EDGE_FLAG
 {
@@ -36,15 +37,27 @@ public:
 
 public:
     /// <summary>
-    /// Set the buffer containing the image pixels.
+    /// Set the buffer containing the image pixels. The viewer picks up the latest image the buffer has published when it paints
     /// </summary>
     /// <param name="pImage">The pointer to image buffer object</param>
-    void SetImage(const NuiImageBuffer* pImage);
+    void SetImage(NuiImageBuffer* pImage);
 
     /// <summary>
-    /// Attach skeleton data.
+    /// Count an image published to the image buffer and schedule a repaint. Called from the acquisition thread
     /// </summary>
-    /// <param name="pFrame">The pointer to skeleton frame</param>
+    void NotifyImage();
+
+    /// <summary>
+    /// Set the number of frames the recorder has dropped in the current session, shown until it is reset to 0.
+    /// Called from the acquisition thread
+    /// </summary>
+    /// <param name="count">Number of dropped frames</param>
+    void SetDroppedFrames(LONG count);
+
+    /// <summary>
+    /// Copy skeleton data for the next repaint. Called from the acquisition thread of the skeleton stream
+    /// </summary>
+    /// <param name="pFrame">The pointer to skeleton frame, nullptr to clear the skeletons</param>
     void SetSkeleton(const NUI_SKELETON_FRAME* pFrame);
 
     /// <summary>
@@ -143,6 +156,12 @@ private:
     /// <param name="clientRect">Client area of viewer's window</param>
     void DrawResolution(const RECT& clientRect);
 
+    /// <summary>
+    /// Draw the number of frames dropped by the recorder
+    /// </summary>
+    /// <param name="clientRect">Client area of viewer's window</param>
+    void DrawDroppedFrames(const RECT& clientRect);
+
     /// <summary>
     /// Draw red edge on image when skeleton is close to or out of the image edge
     /// </summary>
@@ -150,10 +169,16 @@ private:
     void DrawRedEdges(const D2D1_RECT_F& imageRect);
 
     /// <summary>
-    /// Update frame rate
+    /// Update frame rate from the images counted since the last update
     /// </summary>
     void UpdateFrameRate();
 
+    /// <summary>
+    /// Invalidate the window unless a repaint is pending already, so frames arriving faster than the
+    /// window paints post one WM_PAINT between them. Safe to call from any thread
+    /// </summary>
+    void RequestRepaint();
+
     /// <summary>
     /// Check which red edge should be drawn
     /// </summary>
@@ -174,6 +199,14 @@ private:
     /// <param name="client">Client area of viewer's window</param>
     D2D1_RECT_F GetImageRect(const RECT& client);
 
+    /// <summary>
+    /// Get the pixels of the image picked up from the image buffer
+    /// </summary>
+    /// <param name="size">Receives the image size</param>
+    /// <param name="stride">Receives the bytes per row</param>
+    /// <returns>The pointer to the pixels, nullptr if there is no image</returns>
+    const BYTE* GetImagePixels(D2D1_SIZE_U& size, UINT& stride) const;
+
     /// <summary>
     /// Map skeleton point to window coordinate in image rect.
     /// </summary>
@@ -182,18 +215,30 @@ private:
     /// <returns>Mapped coordinate in client area</returns>
     D2D1_POINT_2F ToImageRect(const Vector4& skeletonPoint, const D2D1_RECT_F& imageRect);
 
+private:
+    // Skeleton data copied for display
+    struct Skeletons
+    {
+        Skeletons() : valid(false) {}
+
+        bool                valid;      // False to draw no skeletons
+        NUI_SKELETON_FRAME  frame;
+    };
+
 private:
     NUI_IMAGE_TYPE              m_imageType;
 
-    const NuiImageBuffer*       m_pImage;
-    const NUI_SKELETON_FRAME*   m_pSkeletonFrame;
+    NuiImageBuffer*             m_pImage;
+    TripleBuffer<Skeletons>     m_skeletons;
 
     bool                m_pauseSkeleton;
     UINT                m_fps;
-    UINT                m_frameCount;
-    UINT                m_lastFrameCount;
+    volatile LONG       m_frameCount;       // Incremented by the acquisition thread
+    LONG                m_lastFrameCount;
     DWORD               m_lastTick;
+    volatile LONG       m_droppedFrames;    // Set by the acquisition thread
     DWORD               m_drawEdgeFlags;
+    volatile LONG       m_repaintPending;   // Set when the window is invalidated, cleared when it paints
 
     ImageRenderer*      m_pImageRenderer;
 };
\ No newline at end of file
@@ -0,0 +1,465 @@
+//------------------------------------------------------------------------------
+// <copyright file="Pipeline.h">
+//     Ordered pipeline of bounded stages running on a shared task pool.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "TaskPool.h"
+
+// Counters of one stage of a pipeline
+struct PipelineStageStats
+{
+    uint64_t items;             // Items the stage ran on
+    double   busySeconds;       // Sum of the time the stage function ran
+    double   maxBusySeconds;
+    unsigned maxRunning;        // Most items the stage ran on at the same time
+    size_t   maxDepth;          // Most items held by the stage, queued, running or waiting for the next stage
+};
+
+// Counters of a pipeline
+struct PipelineStats
+{
+    uint64_t submitted;
+    uint64_t stalls;            // Submissions which waited for room in the first stage
+    uint64_t rejected;          // Submissions turned away by TrySubmit because the first stage was full
+    uint64_t evicted;           // Queued items taken back out by EvictOldest
+    size_t   inFlight;          // Items submitted and not through the last stage yet
+    size_t   maxInFlight;
+};
+
+/// <summary>
+/// Items of one stream passing through a fixed sequence of stages, each a function run on the tasks of a
+/// shared pool. A stage holds at most its capacity of items, queued, running or finished, so a slow stage
+/// backs up into the ones before it and finally into Submit; and it runs on at most its concurrency of
+/// items at the same time, 1 for stages which keep state from item to item, such as a file being written.
+/// Items leave every stage in the order they were submitted, however many ran at the same time, so the
+/// stream stays in order from end to end. Items are reused once they have passed the last stage, which
+/// should release what an item refers to so it does not outlive the pipeline, e.g. a frame of a pool.
+/// </summary>
+template <typename T>
+class Pipeline
+{
+public:
+    typedef std::function<void(T& item)> StageFunction;
+
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="pool">Pool running the stages, must outlive the pipeline</param>
+    explicit Pipeline(TaskPool& pool)
+        : m_pool(pool)
+        , m_running(false)
+        , m_filling(0)
+    {
+        memset(&m_stats, 0, sizeof(m_stats));
+    }
+
+    /// <summary>
+    /// Destructor. Runs the submitted items through the remaining stages
+    /// </summary>
+   ~Pipeline()
+    {
+        Stop();
+    }
+
+public:
+    /// <summary>
+    /// Append a stage. Only while the pipeline is stopped
+    /// </summary>
+    /// <param name="name">Name of the stage in the session log</param>
+    /// <param name="concurrency">Most items the function runs on at the same time</param>
+    /// <param name="capacity">Most items the stage holds, at least the concurrency</param>
+    /// <param name="function">Function run on every item, on a task of the pool</param>
+    void AddStage(const char* name, unsigned concurrency, size_t capacity, const StageFunction& function)
+    {
+        std::unique_ptr<Stage> pStage(new Stage());
+        pStage->name        = name;
+        pStage->function    = function;
+        pStage->concurrency = (std::max)(1u, concurrency);
+        pStage->capacity    = (std::max)((size_t)pStage->concurrency, capacity);
+        pStage->launched    = 0;
+        pStage->running     = 0;
+        memset(&pStage->stats, 0, sizeof(pStage->stats));
+
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_stages.push_back(std::move(pStage));
+    }
+
+    /// <summary>
+    /// Accept submissions and reset the counters
+    /// </summary>
+    void Start()
+    {
+        ResetStats();
+
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_running = !m_stages.empty();
+    }
+
+    /// <summary>
+    /// Submit an item. Blocks while the first stage is full
+    /// </summary>
+    /// <param name="fill">Called with an item to fill, which may hold the contents of an earlier one</param>
+    /// <returns>True if the item has been submitted, false if the pipeline is stopped</returns>
+    template <typename Fill>
+    bool Submit(Fill fill)
+    {
+        return Enqueue(fill, true);
+    }
+
+    /// <summary>
+    /// Submit an item unless the first stage is full, e.g. for a display which only shows the latest item
+    /// </summary>
+    /// <param name="fill">Called with an item to fill, which may hold the contents of an earlier one</param>
+    /// <returns>True if the item has been submitted</returns>
+    template <typename Fill>
+    bool TrySubmit(Fill fill)
+    {
+        return Enqueue(fill, false);
+    }
+
+    /// <summary>
+    /// Check if the first stage has room for more items, so a caller may decide what to do before Submit would block
+    /// </summary>
+    /// <param name="count">Number of items</param>
+    /// <returns>True if the items could be submitted right away</returns>
+    bool HasRoomFor(size_t count) const
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return !m_stages.empty() && m_stages[0]->entries.size() + m_filling + count <= m_stages[0]->capacity;
+    }
+
+    /// <summary>
+    /// Take the oldest item out of the first stage which the stage has not started on yet, making room for a newer one
+    /// </summary>
+    /// <param name="item">Receives the item. What it held is left to be reused by a later submission</param>
+    /// <returns>True if an item was taken, false if every item of the stage has been started on</returns>
+    bool EvictOldest(T& item)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_stages.empty())
+        {
+            return false;
+        }
+
+        Stage& stage = *m_stages[0];
+        if (stage.launched >= stage.entries.size())
+        {
+            return false;
+        }
+
+        Entry* pEntry = stage.entries[stage.launched];
+        stage.entries.erase(stage.entries.begin() + stage.launched);
+        std::swap(item, pEntry->item);
+
+        m_spare.push_back(pEntry);
+        --m_stats.inFlight;
+        ++m_stats.evicted;
+        m_retired.notify_all();
+        return true;
+    }
+
+    /// <summary>
+    /// Wait until every item submitted so far has passed the last stage
+    /// </summary>
+    void Flush()
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_retired.wait(lock, [&]() { return 0 == m_stats.inFlight; });
+    }
+
+    /// <summary>
+    /// Turn away further submissions, also those waiting for room, and flush
+    /// </summary>
+    void Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_running = false;
+            m_retired.notify_all();
+        }
+
+        Flush();
+    }
+
+    /// <summary>
+    /// Get the number of stages
+    /// </summary>
+    size_t GetStageCount() const
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_stages.size();
+    }
+
+    /// <summary>
+    /// Get a snapshot of the counters of the pipeline
+    /// </summary>
+    PipelineStats GetStats() const
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_stats;
+    }
+
+    /// <summary>
+    /// Get a snapshot of the counters of a stage
+    /// </summary>
+    /// <param name="stage">Index of the stage in the order they were added</param>
+    PipelineStageStats GetStageStats(size_t stage) const
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_stages[stage]->stats;
+    }
+
+    /// <summary>
+    /// Append the counters of every stage to session.log in the current directory
+    /// </summary>
+    /// <param name="pName">Name of the pipeline, e.g. of its stream</param>
+    void LogSession(const char* pName) const
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (0 == m_stats.submitted)
+        {
+            return;
+        }
+
+        FILE* pLog = fopen("session.log", "a");
+        if (!pLog)
+        {
+            return;
+        }
+
+        char   timeText[32];
+        time_t now = time(nullptr);
+        tm     local;
+#ifdef _WIN32
+        localtime_s(&local, &now);
+#else
+        localtime_r(&now, &local);
+#endif
+        strftime(timeText, sizeof(timeText), "%Y-%m-%d %H:%M:%S", &local);
+
+        fprintf(pLog, "%s %s pipeline: %llu submitted, %llu stalled, %llu turned away, %llu evicted, peak %llu in flight\n",
+            timeText, pName, (unsigned long long)m_stats.submitted, (unsigned long long)m_stats.stalls,
+            (unsigned long long)m_stats.rejected, (unsigned long long)m_stats.evicted, (unsigned long long)m_stats.maxInFlight);
+
+        for (const std::unique_ptr<Stage>& pStage : m_stages)
+        {
+            const PipelineStageStats& stats = pStage->stats;
+            fprintf(pLog, "%s %s %s stage: %llu items, %.2f ms/item (max %.2f), peak %u of %u running, %llu of %llu held\n",
+                timeText, pName, pStage->name.c_str(), (unsigned long long)stats.items,
+                stats.items ? stats.busySeconds * 1000 / stats.items : 0.0, stats.maxBusySeconds * 1000,
+                stats.maxRunning, pStage->concurrency, (unsigned long long)stats.maxDepth, (unsigned long long)pStage->capacity);
+        }
+
+        fclose(pLog);
+    }
+
+private:
+    struct Entry
+    {
+        T       item;
+        bool    done;       // The current stage has finished with the item
+    };
+
+    struct Stage
+    {
+        std::string             name;
+        StageFunction           function;
+        unsigned                concurrency;
+        size_t                  capacity;
+        std::deque<Entry*>      entries;        // In submission order: launched ones first, then queued ones
+        size_t                  launched;       // Entries handed to the pool, running or done
+        unsigned                running;
+        PipelineStageStats      stats;
+    };
+
+    /// <summary>
+    /// Submit an item, waiting for room in the first stage if asked to
+    /// </summary>
+    template <typename Fill>
+    bool Enqueue(Fill& fill, bool wait)
+    {
+        Entry* pEntry;
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            if (m_running && !HasRoom())
+            {
+                if (!wait)
+                {
+                    ++m_stats.rejected;
+                    return false;
+                }
+
+                ++m_stats.stalls;
+                m_retired.wait(lock, [&]() { return HasRoom() || !m_running; });
+            }
+
+            if (!m_running)
+            {
+                return false;
+            }
+
+            if (m_spare.empty())
+            {
+                m_entries.push_back(std::unique_ptr<Entry>(new Entry()));
+                m_spare.push_back(m_entries.back().get());
+            }
+
+            pEntry = m_spare.back();
+            m_spare.pop_back();
+
+            // Room is kept for the item while it is filled
+            ++m_filling;
+            ++m_stats.submitted;
+            ++m_stats.inFlight;
+            m_stats.maxInFlight = (std::max)(m_stats.maxInFlight, m_stats.inFlight);
+        }
+
+        // Filled outside the lock, the stages keep running meanwhile
+        fill(pEntry->item);
+        pEntry->done = false;
+
+        std::lock_guard<std::mutex> lock(m_lock);
+        --m_filling;
+        m_stages[0]->entries.push_back(pEntry);
+        Pump();
+        return true;
+    }
+
+    /// <summary>
+    /// Check if the first stage can take another item. Called with the lock held
+    /// </summary>
+    bool HasRoom() const
+    {
+        return m_stages[0]->entries.size() + m_filling < m_stages[0]->capacity;
+    }
+
+    /// <summary>
+    /// Run a stage on an item, on a task of the pool
+    /// </summary>
+    void Run(size_t index, Entry* pEntry)
+    {
+        Stage& stage = *m_stages[index];
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        stage.function(pEntry->item);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::lock_guard<std::mutex> lock(m_lock);
+        pEntry->done = true;
+        --stage.running;
+        ++stage.stats.items;
+        stage.stats.busySeconds   += seconds;
+        stage.stats.maxBusySeconds = (std::max)(stage.stats.maxBusySeconds, seconds);
+        Pump();
+    }
+
+    /// <summary>
+    /// Move the finished items at the head of every stage on to the next one, last stage first so
+    /// room made there is used right away, and launch queued items up to the concurrency of each
+    /// stage. Called with the lock held
+    /// </summary>
+    void Pump()
+    {
+        bool retired = false;
+        for (size_t index = m_stages.size(); index-- > 0;)
+        {
+            Stage& stage = *m_stages[index];
+            Stage* pNext = index + 1 < m_stages.size() ? m_stages[index + 1].get() : nullptr;
+
+            // Only the head may move on, items finished early wait for the ones before them
+            while (!stage.entries.empty() && stage.entries.front()->done)
+            {
+                if (pNext && pNext->entries.size() >= pNext->capacity)
+                {
+                    break;
+                }
+
+                Entry* pEntry = stage.entries.front();
+                stage.entries.pop_front();
+                --stage.launched;
+                pEntry->done = false;
+
+                if (pNext)
+                {
+                    pNext->entries.push_back(pEntry);
+                    pNext->stats.maxDepth = (std::max)(pNext->stats.maxDepth, pNext->entries.size());
+                }
+                else
+                {
+                    m_spare.push_back(pEntry);
+                    --m_stats.inFlight;
+                    retired = true;
+                }
+            }
+        }
+
+        for (size_t index = 0; index < m_stages.size(); index++)
+        {
+            Stage& stage = *m_stages[index];
+            stage.stats.maxDepth = (std::max)(stage.stats.maxDepth, stage.entries.size());
+
+            while (stage.running < stage.concurrency && stage.launched < stage.entries.size())
+            {
+                Entry* pEntry = stage.entries[stage.launched++];
+                ++stage.running;
+                stage.stats.maxRunning = (std::max)(stage.stats.maxRunning, stage.running);
+                m_pool.Submit([this, index, pEntry]() { Run(index, pEntry); });
+            }
+        }
+
+        if (retired)
+        {
+            // Under the lock, a flushed pipeline may be destroyed as soon as it is released
+            m_retired.notify_all();
+        }
+    }
+
+    /// <summary>
+    /// Reset the counters of the pipeline and its stages
+    /// </summary>
+    void ResetStats()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        size_t inFlight = m_stats.inFlight;
+        memset(&m_stats, 0, sizeof(m_stats));
+        m_stats.inFlight = inFlight;
+
+        for (const std::unique_ptr<Stage>& pStage : m_stages)
+        {
+            memset(&pStage->stats, 0, sizeof(pStage->stats));
+        }
+    }
+
+private:
+    Pipeline(const Pipeline&);
+    Pipeline& operator=(const Pipeline&);
+
+private:
+    TaskPool&                               m_pool;
+    mutable std::mutex                      m_lock;
+    std::condition_variable                 m_retired;      // An item passed the last stage, or the pipeline stopped
+    std::vector<std::unique_ptr<Stage>>     m_stages;
+    std::vector<std::unique_ptr<Entry>>     m_entries;      // Every item ever needed, reused
+    std::vector<Entry*>                     m_spare;
+    bool                                    m_running;
+    size_t                                  m_filling;      // Items taken by Submit and not queued yet
+    PipelineStats                           m_stats;
+};
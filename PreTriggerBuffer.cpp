@@ -0,0 +1,323 @@
+//------------------------------------------------------------------------------
+// <copyright file="PreTriggerBuffer.cpp">
+//     Ring of the latest frames of a stream kept in memory until recording is triggered.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "PreTriggerBuffer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <new>
+
+/// <summary>
+/// Constructor. Allocates the memory of the ring
+/// </summary>
+/// <param name="stream">Stream the frames belong to</param>
+/// <param name="seconds">Length of the window</param>
+/// <param name="memoryBytes">Memory of the ring</param>
+/// <param name="pEncoder">Intra-frame encoder compressing the frames, owned by the buffer. nullptr to copy them as they are</param>
+PreTriggerBuffer::PreTriggerBuffer(RecordStream stream, double seconds, size_t memoryBytes, FrameEncoder* pEncoder)
+    : m_stream(stream)
+    , m_seconds(seconds)
+    , m_pMemory(new (std::nothrow) uint8_t[memoryBytes])
+    , m_memoryBytes(m_pMemory ? memoryBytes : 0)
+    , m_pEncoder(pEncoder)
+    , m_first(0)
+    , m_count(0)
+    , m_replayStart(-1.0)
+{
+    // One entry per frame of the window at the highest frame rate, and one for the frame being added
+    m_entries.resize((size_t)ceil(seconds * PRETRIGGER_MAX_FRAME_RATE) + 2);
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+/// <summary>
+/// Get the time between the oldest and the newest frame in the ring
+/// </summary>
+double PreTriggerBuffer::GetWindowSeconds() const
+{
+    if (0 == m_count)
+    {
+        return 0.0;
+    }
+
+    const Entry& newest = m_entries[(m_first + m_count - 1) % m_entries.size()];
+    return newest.timestamp - m_entries[m_first].timestamp;
+}
+
+/// <summary>
+/// Copy or compress a frame into the ring, pushing out the oldest frames to make room
+/// </summary>
+/// <param name="frame">Frame to keep</param>
+void PreTriggerBuffer::Push(const RecordFrame& frame)
+{
+    Store(frame, true);
+}
+
+/// <summary>
+/// Copy or compress a frame into the ring behind the others without pushing any out, for live frames
+/// queued while the ring is replayed. Frames kept for the recording only leave the ring by being replayed
+/// </summary>
+/// <param name="frame">Frame to keep</param>
+/// <returns>False if the frame does not fit until more frames are taken out, or cannot be kept at all</returns>
+bool PreTriggerBuffer::Append(const RecordFrame& frame)
+{
+    return Store(frame, false);
+}
+
+/// <summary>
+/// Copy or compress a frame into the ring
+/// </summary>
+/// <param name="frame">Frame to keep</param>
+/// <param name="evict">Push out the oldest frames to make room, or leave the frame out</param>
+/// <returns>False if the frame was not kept</returns>
+bool PreTriggerBuffer::Store(const RecordFrame& frame, bool evict)
+{
+    if (!m_pMemory || (!evict && m_count == m_entries.size()))
+    {
+        return false;
+    }
+
+    // Frames which fall out of the window go first, they may make all the room needed
+    while (evict && m_count > 0 && frame.timestamp - m_entries[m_first].timestamp > m_seconds)
+    {
+        Evict();
+    }
+
+    size_t         rawSize = std::min((size_t)frame.stride * frame.height, frame.data.size());
+    const uint8_t* pData   = frame.data.data();
+    size_t         size    = rawSize;
+    if (m_pEncoder)
+    {
+        // The payload buffer keeps its capacity, so it stops growing after the first frames
+        if (!m_pEncoder->Encode(frame, m_payload))
+        {
+            m_stats.framesLost += evict ? 1 : 0;
+            return false;
+        }
+
+        pData = m_payload.data();
+        size  = m_payload.size();
+    }
+
+    if (size > m_memoryBytes)
+    {
+        m_stats.framesLost += evict ? 1 : 0;
+        return false;
+    }
+
+    if (m_count == m_entries.size())
+    {
+        Evict();
+    }
+
+    size_t offset = 0;
+    if (!Reserve(size, evict, offset))
+    {
+        return false;
+    }
+    memcpy(m_pMemory.get() + offset, pData, size);
+
+    Entry& entry      = m_entries[(m_first + m_count) % m_entries.size()];
+    entry.format      = frame.format;
+    entry.width       = frame.width;
+    entry.height      = frame.height;
+    entry.stride      = frame.stride;
+    entry.frameNumber = frame.frameNumber;
+    entry.timestamp   = frame.timestamp;
+    entry.sensorTime  = frame.sensorTime;
+    entry.hostTime    = frame.hostTime;
+    entry.offset      = offset;
+    entry.size        = size;
+    ++m_count;
+
+    ++m_stats.framesBuffered;
+    m_stats.rawBytes      += rawSize;
+    m_stats.storedBytes   += size;
+    m_stats.bytesInUse    += size;
+    m_stats.maxBytesInUse  = std::max(m_stats.maxBytesInUse, m_stats.bytesInUse);
+    m_stats.framesInUse    = m_count;
+    return true;
+}
+
+/// <summary>
+/// Take the oldest frame out of the ring
+/// </summary>
+/// <param name="pPool">Pool the frame is taken from, nullptr for a frame on the heap</param>
+/// <param name="frame">Receives the frame</param>
+/// <returns>False if the ring is empty</returns>
+bool PreTriggerBuffer::Pop(FramePool* pPool, FrameHandle& frame)
+{
+    while (m_count > 0)
+    {
+        const Entry& entry = m_entries[m_first];
+        if (m_replayStart < 0)
+        {
+            m_replayStart = entry.timestamp;
+        }
+
+        frame = pPool ? pPool->Acquire(m_stream, (size_t)entry.stride * entry.height) : FrameHandle::Create();
+
+        RecordFrame*   pFrame  = frame.GetMutable();
+        const uint8_t* pStored = m_pMemory.get() + entry.offset;
+        pFrame->stream = m_stream;
+        pFrame->format = entry.format;
+        pFrame->width  = entry.width;
+        pFrame->height = entry.height;
+        pFrame->stride = entry.stride;
+
+        bool decoded = true;
+        if (m_pEncoder)
+        {
+            decoded = DecodeFramePayload(m_pEncoder->GetCodec(), pStored, entry.size, *pFrame);
+        }
+        else
+        {
+            pFrame->data.assign(pStored, pStored + entry.size);
+        }
+
+        pFrame->frameNumber = entry.frameNumber;
+        pFrame->timestamp   = entry.timestamp;
+        pFrame->sensorTime  = entry.sensorTime;
+        pFrame->hostTime    = entry.hostTime;
+        RemoveFirst();
+
+        if (0 == m_count)
+        {
+            m_stats.replayedSeconds += pFrame->timestamp - m_replayStart;
+            m_replayStart = -1.0;
+        }
+
+        if (decoded)
+        {
+            ++m_stats.framesReplayed;
+            return true;
+        }
+
+        ++m_stats.framesLost;
+        frame.Reset();
+    }
+
+    return false;
+}
+
+/// <summary>
+/// Drop every frame in the ring, e.g. when the stream changes resolution
+/// </summary>
+void PreTriggerBuffer::Clear()
+{
+    m_stats.framesEvicted += m_count;
+    m_first       = 0;
+    m_count       = 0;
+    m_replayStart = -1.0;
+    m_stats.bytesInUse  = 0;
+    m_stats.framesInUse = 0;
+}
+
+/// <summary>
+/// Append the counters to session.log in the current directory, e.g. once the ring has been replayed
+/// </summary>
+void PreTriggerBuffer::LogSession() const
+{
+    if (0 == m_stats.framesBuffered)
+    {
+        return;
+    }
+
+    FILE* pLog = fopen("session.log", "a");
+    if (!pLog)
+    {
+        return;
+    }
+
+    char   timeText[32];
+    time_t now = time(nullptr);
+    tm     local;
+#ifdef _WIN32
+    localtime_s(&local, &now);
+#else
+    localtime_r(&now, &local);
+#endif
+    strftime(timeText, sizeof(timeText), "%Y-%m-%d %H:%M:%S", &local);
+
+    fprintf(pLog, "%s %s pre-trigger: %llu frames replayed covering %.1f s, %llu buffered, %llu pushed out, %llu lost, "
+        "peak %.1f of %.1f MB, %s %.2f:1\n",
+        timeText, (RecordStreamColor == m_stream) ? "color" : "depth", (unsigned long long)m_stats.framesReplayed,
+        m_stats.replayedSeconds, (unsigned long long)m_stats.framesBuffered, (unsigned long long)m_stats.framesEvicted,
+        (unsigned long long)m_stats.framesLost, m_stats.maxBytesInUse / 1048576.0, m_memoryBytes / 1048576.0,
+        m_pEncoder ? GetCodecName(m_pEncoder->GetCodec()) : "raw",
+        m_stats.storedBytes ? (double)m_stats.rawBytes / m_stats.storedBytes : 0.0);
+
+    fclose(pLog);
+}
+
+/// <summary>
+/// Find room for a number of bytes after the newest entry, pushing out the oldest entries until there is
+/// </summary>
+/// <param name="size">Bytes needed, at most the memory of the ring</param>
+/// <param name="evict">Push out entries, or only take room which is free</param>
+/// <param name="offset">Receives the offset of the room</param>
+/// <returns>False if there is no room without pushing out entries</returns>
+bool PreTriggerBuffer::Reserve(size_t size, bool evict, size_t& offset)
+{
+    while (m_count > 0)
+    {
+        const Entry& oldest = m_entries[m_first];
+        const Entry& newest = m_entries[(m_first + m_count - 1) % m_entries.size()];
+        size_t end = newest.offset + newest.size;
+
+        if (newest.offset >= oldest.offset)
+        {
+            // Entries run from the oldest to the newest, room after them or at the start of the memory
+            if (m_memoryBytes - end >= size)
+            {
+                offset = end;
+                return true;
+            }
+            if (oldest.offset >= size)
+            {
+                offset = 0;
+                return true;
+            }
+        }
+        else if (oldest.offset - end >= size)
+        {
+            // Entries wrapped around, room between the newest and the oldest
+            offset = end;
+            return true;
+        }
+
+        if (!evict)
+        {
+            return false;
+        }
+        Evict();
+    }
+
+    offset = 0;
+    return true;
+}
+
+/// <summary>
+/// Push out the oldest entry
+/// </summary>
+void PreTriggerBuffer::Evict()
+{
+    RemoveFirst();
+    ++m_stats.framesEvicted;
+}
+
+/// <summary>
+/// Remove the oldest entry from the ring
+/// </summary>
+void PreTriggerBuffer::RemoveFirst()
+{
+    m_stats.bytesInUse -= m_entries[m_first].size;
+    m_first = (m_first + 1) % m_entries.size();
+    --m_count;
+    m_stats.framesInUse = m_count;
+}
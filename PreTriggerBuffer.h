@@ -0,0 +1,169 @@
+//------------------------------------------------------------------------------
+// <copyright file="PreTriggerBuffer.h">
+//     Ring of the latest frames of a stream kept in memory until recording is triggered.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "FrameCodec.h"
+#include "FrameHandle.h"
+#include "FramePool.h"
+#include "RecordFrame.h"
+
+#define PRETRIGGER_MAX_FRAME_RATE   30      // Frames per second the entries are laid out for, the fastest the sensor delivers
+#define PRETRIGGER_DEFAULT_MEMORY   ((size_t)128 << 20)  // Bytes per stream, about 100 raw 640x480 color frames
+
+// Counters of a pre-trigger buffer
+struct PreTriggerStats
+{
+    uint64_t framesBuffered;    // Frames put into the ring
+    uint64_t framesEvicted;     // Frames pushed out by newer ones, older than the window or out of memory
+    uint64_t framesReplayed;    // Frames taken out of the ring for recording
+    uint64_t framesLost;        // Frames larger than the memory, or which failed to encode or decode
+    uint64_t rawBytes;          // Pixel bytes of the buffered frames
+    uint64_t storedBytes;       // Bytes they took in the ring, smaller than rawBytes when compressed
+    double   replayedSeconds;   // Time between the first and the last frame replayed, summed over the triggers
+    size_t   bytesInUse;
+    size_t   maxBytesInUse;
+    size_t   framesInUse;
+};
+
+/// <summary>
+/// Keeps the frames of the last seconds of a stream in a ring of memory allocated once, so recording can
+/// start with what happened before it was triggered. Frames are copied into the ring as they are, or
+/// compressed by an intra-frame encoder to cover a longer window with the same memory. The oldest frames
+/// are pushed out when they fall out of the window or when the memory runs out, whichever comes first.
+/// Once recording is triggered the frames are taken out oldest first, into frames of the frame pool.
+///
+/// Not thread safe. The stream calls it from its acquisition thread, with the stream lock held.
+/// </summary>
+class PreTriggerBuffer
+{
+public:
+    /// <summary>
+    /// Constructor. Allocates the memory of the ring
+    /// </summary>
+    /// <param name="stream">Stream the frames belong to</param>
+    /// <param name="seconds">Length of the window</param>
+    /// <param name="memoryBytes">Memory of the ring</param>
+    /// <param name="pEncoder">Intra-frame encoder compressing the frames, owned by the buffer. nullptr to copy them as they are</param>
+    PreTriggerBuffer(RecordStream stream, double seconds, size_t memoryBytes, FrameEncoder* pEncoder);
+
+    /// <summary>
+    /// Check if the memory of the ring has been allocated
+    /// </summary>
+    bool IsValid() const { return nullptr != m_pMemory; }
+
+    /// <summary>
+    /// Check if there are frames in the ring
+    /// </summary>
+    bool IsEmpty() const { return 0 == m_count; }
+
+    /// <summary>
+    /// Get the time between the oldest and the newest frame in the ring
+    /// </summary>
+    double GetWindowSeconds() const;
+
+    /// <summary>
+    /// Copy or compress a frame into the ring, pushing out the oldest frames to make room
+    /// </summary>
+    /// <param name="frame">Frame to keep</param>
+    void Push(const RecordFrame& frame);
+
+    /// <summary>
+    /// Copy or compress a frame into the ring behind the others without pushing any out, for live frames
+    /// queued while the ring is replayed. Frames kept for the recording only leave the ring by being replayed
+    /// </summary>
+    /// <param name="frame">Frame to keep</param>
+    /// <returns>False if the frame does not fit until more frames are taken out, or cannot be kept at all</returns>
+    bool Append(const RecordFrame& frame);
+
+    /// <summary>
+    /// Take the oldest frame out of the ring
+    /// </summary>
+    /// <param name="pPool">Pool the frame is taken from, nullptr for a frame on the heap</param>
+    /// <param name="frame">Receives the frame</param>
+    /// <returns>False if the ring is empty</returns>
+    bool Pop(FramePool* pPool, FrameHandle& frame);
+
+    /// <summary>
+    /// Drop every frame in the ring, e.g. when the stream changes resolution
+    /// </summary>
+    void Clear();
+
+    /// <summary>
+    /// Get the counters
+    /// </summary>
+    const PreTriggerStats& GetStats() const { return m_stats; }
+
+    /// <summary>
+    /// Append the counters to session.log in the current directory, e.g. once the ring has been replayed
+    /// </summary>
+    void LogSession() const;
+
+private:
+    // Frame in the ring: the description of the frame and where its pixels or payload are
+    struct Entry
+    {
+        RecordPixelFormat   format;
+        uint32_t            width;
+        uint32_t            height;
+        uint32_t            stride;
+        uint32_t            frameNumber;
+        double              timestamp;
+        int64_t             sensorTime;
+        double              hostTime;
+        size_t              offset;
+        size_t              size;
+    };
+
+    /// <summary>
+    /// Copy or compress a frame into the ring
+    /// </summary>
+    /// <param name="frame">Frame to keep</param>
+    /// <param name="evict">Push out the oldest frames to make room, or leave the frame out</param>
+    /// <returns>False if the frame was not kept</returns>
+    bool Store(const RecordFrame& frame, bool evict);
+
+    /// <summary>
+    /// Find room for a number of bytes after the newest entry, pushing out the oldest entries until there is
+    /// </summary>
+    /// <param name="size">Bytes needed, at most the memory of the ring</param>
+    /// <param name="evict">Push out entries, or only take room which is free</param>
+    /// <param name="offset">Receives the offset of the room</param>
+    /// <returns>False if there is no room without pushing out entries</returns>
+    bool Reserve(size_t size, bool evict, size_t& offset);
+
+    /// <summary>
+    /// Push out the oldest entry
+    /// </summary>
+    void Evict();
+
+    /// <summary>
+    /// Remove the oldest entry from the ring
+    /// </summary>
+    void RemoveFirst();
+
+private:
+    PreTriggerBuffer(const PreTriggerBuffer&);
+    PreTriggerBuffer& operator=(const PreTriggerBuffer&);
+
+private:
+    RecordStream                    m_stream;
+    double                          m_seconds;
+    std::unique_ptr<uint8_t[]>      m_pMemory;
+    size_t                          m_memoryBytes;
+    std::unique_ptr<FrameEncoder>   m_pEncoder;
+    std::vector<uint8_t>            m_payload;      // Reused for every compressed frame
+    std::vector<Entry>              m_entries;      // Circular, sized for the window at the highest frame rate
+    size_t                          m_first;        // Index of the oldest entry
+    size_t                          m_count;
+    double                          m_replayStart;  // Timestamp of the first frame of the current replay, negative if none
+    PreTriggerStats                 m_stats;
+};
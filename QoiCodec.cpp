@@ -0,0 +1,300 @@
+//------------------------------------------------------------------------------
+// <copyright file="QoiCodec.cpp">
+//     Fast lossless compression of color frames in the QOI image format.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "QoiCodec.h"
+
+#include <cstring>
+
+#define QOI_OP_INDEX    0x00    // 00xxxxxx
+#define QOI_OP_DIFF     0x40    // 01xxxxxx
+#define QOI_OP_LUMA     0x80    // 10xxxxxx
+#define QOI_OP_RUN      0xc0    // 11xxxxxx
+#define QOI_OP_RGB      0xfe
+#define QOI_OP_RGBA     0xff
+#define QOI_MASK_2      0xc0
+
+namespace
+{
+    const uint8_t QoiEndMarker[QOI_END_MARKER_SIZE] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+
+    // Color in the order QOI stores it
+    struct QoiColor
+    {
+        uint8_t r, g, b, a;
+    };
+
+    inline int QoiHash(const QoiColor& c)
+    {
+        return (c.r * 3 + c.g * 5 + c.b * 7 + c.a * 11) & 63;
+    }
+
+    inline bool operator==(const QoiColor& x, const QoiColor& y)
+    {
+        return x.r == y.r && x.g == y.g && x.b == y.b && x.a == y.a;
+    }
+
+    inline void PutBE32(uint8_t* p, uint32_t value)
+    {
+        p[0] = (uint8_t)(value >> 24);
+        p[1] = (uint8_t)(value >> 16);
+        p[2] = (uint8_t)(value >> 8);
+        p[3] = (uint8_t)value;
+    }
+
+    inline uint32_t GetBE32(const uint8_t* p)
+    {
+        return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+    }
+}
+
+/// <summary>
+/// Read the image size from the header of a QOI payload
+/// </summary>
+/// <returns>False if the payload is not a QOI image</returns>
+bool QoiGetSize(const uint8_t* pPayload, size_t size, uint32_t& width, uint32_t& height)
+{
+    if (size < QOI_HEADER_SIZE + QOI_END_MARKER_SIZE || 0 != memcmp(pPayload, "qoif", 4))
+    {
+        return false;
+    }
+
+    width  = GetBE32(pPayload + 4);
+    height = GetBE32(pPayload + 8);
+    return true;
+}
+
+/// <summary>
+/// Encode a color frame
+/// </summary>
+/// <param name="frame">Frame to encode, must be RecordPixelFormatBgra32</param>
+/// <param name="payload">Receives the encoded payload</param>
+/// <param name="keyframe">Receives true, every QOI frame decodes on its own</param>
+/// <returns>Indicates success or failure</returns>
+bool QoiColorEncoder::EncodeFrame(const RecordFrame& frame, std::vector<uint8_t>& payload, bool& keyframe)
+{
+    if (RecordPixelFormatBgra32 != frame.format ||
+        frame.data.size() < (size_t)frame.stride * frame.height)
+    {
+        return false;
+    }
+
+    // Worst case is one QOI_OP_RGBA of 5 bytes per pixel
+    payload.resize(QOI_HEADER_SIZE + (size_t)frame.width * frame.height * 5 + QOI_END_MARKER_SIZE);
+    uint8_t* pOut = payload.data();
+
+    memcpy(pOut, "qoif", 4);
+    PutBE32(pOut + 4, frame.width);
+    PutBE32(pOut + 8, frame.height);
+    pOut[12] = 4;       // Channels, lowered to 3 below when the fourth byte is always opaque
+    pOut[13] = 0;       // sRGB
+    pOut += QOI_HEADER_SIZE;
+
+    QoiColor index[64];
+    memset(index, 0, sizeof(index));
+
+    QoiColor previous = { 0, 0, 0, 255 };
+    bool     opaque   = true;
+    int      run      = 0;
+
+    for (uint32_t y = 0; y < frame.height; y++)
+    {
+        const uint8_t* pPixel = frame.data.data() + (size_t)y * frame.stride;
+        for (uint32_t x = 0; x < frame.width; x++, pPixel += 4)
+        {
+            QoiColor pixel = { pPixel[2], pPixel[1], pPixel[0], pPixel[3] };
+
+            if (pixel == previous)
+            {
+                if (62 == ++run)
+                {
+                    *pOut++ = (uint8_t)(QOI_OP_RUN | (run - 1));
+                    run = 0;
+                }
+                continue;
+            }
+
+            if (run)
+            {
+                *pOut++ = (uint8_t)(QOI_OP_RUN | (run - 1));
+                run = 0;
+            }
+
+            int hash = QoiHash(pixel);
+            if (index[hash] == pixel)
+            {
+                *pOut++ = (uint8_t)(QOI_OP_INDEX | hash);
+            }
+            else
+            {
+                index[hash] = pixel;
+
+                if (pixel.a == previous.a)
+                {
+                    int dr = (int8_t)(pixel.r - previous.r);
+                    int dg = (int8_t)(pixel.g - previous.g);
+                    int db = (int8_t)(pixel.b - previous.b);
+                    int dgr = dr - dg;
+                    int dgb = db - dg;
+
+                    if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+                    {
+                        *pOut++ = (uint8_t)(QOI_OP_DIFF | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2));
+                    }
+                    else if (dgr >= -8 && dgr <= 7 && dg >= -32 && dg <= 31 && dgb >= -8 && dgb <= 7)
+                    {
+                        *pOut++ = (uint8_t)(QOI_OP_LUMA | (dg + 32));
+                        *pOut++ = (uint8_t)(((dgr + 8) << 4) | (dgb + 8));
+                    }
+                    else
+                    {
+                        *pOut++ = QOI_OP_RGB;
+                        *pOut++ = pixel.r;
+                        *pOut++ = pixel.g;
+                        *pOut++ = pixel.b;
+                    }
+                }
+                else
+                {
+                    *pOut++ = QOI_OP_RGBA;
+                    *pOut++ = pixel.r;
+                    *pOut++ = pixel.g;
+                    *pOut++ = pixel.b;
+                    *pOut++ = pixel.a;
+                }
+            }
+
+            opaque   = opaque && 255 == pixel.a;
+            previous = pixel;
+        }
+    }
+
+    if (run)
+    {
+        *pOut++ = (uint8_t)(QOI_OP_RUN | (run - 1));
+    }
+
+    memcpy(pOut, QoiEndMarker, QOI_END_MARKER_SIZE);
+    pOut += QOI_END_MARKER_SIZE;
+
+    if (opaque)
+    {
+        payload[12] = 3;
+    }
+
+    payload.resize(pOut - payload.data());
+    keyframe = true;
+    return true;
+}
+
+/// <summary>
+/// Decode a QOI payload into a BGRA32 frame
+/// </summary>
+/// <param name="pPayload">The pointer to payload</param>
+/// <param name="size">Size of payload in bytes</param>
+/// <param name="frame">Receives format, size and pixels</param>
+/// <returns>Indicates success or failure</returns>
+bool QoiDecodeColor(const uint8_t* pPayload, size_t size, RecordFrame& frame)
+{
+    uint32_t width, height;
+    if (!QoiGetSize(pPayload, size, width, height) ||
+        (uint64_t)width * height > (uint64_t)(size - QOI_HEADER_SIZE) * 62)
+    {
+        return false;
+    }
+
+    size_t pixels = (size_t)width * height;
+
+    frame.format = RecordPixelFormatBgra32;
+    frame.width  = width;
+    frame.height = height;
+    frame.stride = width * 4;
+    frame.data.resize(pixels * 4);
+
+    QoiColor index[64];
+    memset(index, 0, sizeof(index));
+
+    QoiColor pixel = { 0, 0, 0, 255 };
+    int      run   = 0;
+
+    const uint8_t* pIn    = pPayload + QOI_HEADER_SIZE;
+    const uint8_t* pEnd   = pPayload + size - QOI_END_MARKER_SIZE;
+    uint8_t*       pPixel = frame.data.data();
+
+    for (size_t i = 0; i < pixels; i++, pPixel += 4)
+    {
+        if (run > 0)
+        {
+            --run;
+        }
+        else
+        {
+            if (pIn >= pEnd)
+            {
+                return false;
+            }
+
+            int op = *pIn++;
+            if (QOI_OP_RGB == op)
+            {
+                if (pEnd - pIn < 3)
+                {
+                    return false;
+                }
+                pixel.r = pIn[0];
+                pixel.g = pIn[1];
+                pixel.b = pIn[2];
+                pIn += 3;
+            }
+            else if (QOI_OP_RGBA == op)
+            {
+                if (pEnd - pIn < 4)
+                {
+                    return false;
+                }
+                pixel.r = pIn[0];
+                pixel.g = pIn[1];
+                pixel.b = pIn[2];
+                pixel.a = pIn[3];
+                pIn += 4;
+            }
+            else if (QOI_OP_INDEX == (op & QOI_MASK_2))
+            {
+                pixel = index[op];
+            }
+            else if (QOI_OP_DIFF == (op & QOI_MASK_2))
+            {
+                pixel.r = (uint8_t)(pixel.r + ((op >> 4) & 3) - 2);
+                pixel.g = (uint8_t)(pixel.g + ((op >> 2) & 3) - 2);
+                pixel.b = (uint8_t)(pixel.b + (op & 3) - 2);
+            }
+            else if (QOI_OP_LUMA == (op & QOI_MASK_2))
+            {
+                if (pIn >= pEnd)
+                {
+                    return false;
+                }
+                int second = *pIn++;
+                int dg     = (op & 0x3f) - 32;
+                pixel.r = (uint8_t)(pixel.r + dg - 8 + ((second >> 4) & 0x0f));
+                pixel.g = (uint8_t)(pixel.g + dg);
+                pixel.b = (uint8_t)(pixel.b + dg - 8 + (second & 0x0f));
+            }
+            else
+            {
+                run = op & 0x3f;
+            }
+
+            index[QoiHash(pixel)] = pixel;
+        }
+
+        pPixel[0] = pixel.b;
+        pPixel[1] = pixel.g;
+        pPixel[2] = pixel.r;
+        pPixel[3] = pixel.a;
+    }
+
+    return true;
+}
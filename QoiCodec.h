@@ -0,0 +1,60 @@
+//------------------------------------------------------------------------------
+// <copyright file="QoiCodec.h">
+//     Fast lossless compression of color frames in the QOI image format.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "FrameCodec.h"
+
+// Payloads are complete QOI images (https://qoiformat.org/qoi-specification.pdf), so frames
+// stored as separate .qoi files open in common image viewers. QOI encodes each pixel in a single
+// pass as a run, a reference into a 64-entry table of recent colors, a small difference to the
+// previous pixel or the literal color, using whole bytes and no entropy coder.
+
+#define QOI_HEADER_SIZE     14
+#define QOI_END_MARKER_SIZE 8
+
+/// <summary>
+/// Decode a QOI payload into a BGRA32 frame
+/// </summary>
+/// <param name="pPayload">The pointer to payload</param>
+/// <param name="size">Size of payload in bytes</param>
+/// <param name="frame">Receives format, size and pixels</param>
+/// <returns>Indicates success or failure</returns>
+bool QoiDecodeColor(const uint8_t* pPayload, size_t size, RecordFrame& frame);
+
+/// <summary>
+/// Read the image size from the header of a QOI payload
+/// </summary>
+/// <returns>False if the payload is not a QOI image</returns>
+bool QoiGetSize(const uint8_t* pPayload, size_t size, uint32_t& width, uint32_t& height);
+
+/// <summary>
+/// Lossless color encoder. Keeps the fourth byte of BGRA32 frames, which costs
+/// nothing while it is constant, as it always is for the Kinect color stream.
+/// </summary>
+class QoiColorEncoder : public FrameEncoder
+{
+public:
+    /// <summary>
+    /// Get the codec the payloads are encoded with
+    /// </summary>
+    virtual RecordCodec GetCodec() const { return RecordCodecQoi; }
+
+    /// <summary>
+    /// Get file name extension for payloads stored as separate files
+    /// </summary>
+    virtual const char* GetFileExtension() const { return ".qoi"; }
+
+protected:
+    /// <summary>
+    /// Encode a color frame
+    /// </summary>
+    /// <param name="frame">Frame to encode, must be RecordPixelFormatBgra32</param>
+    /// <param name="payload">Receives the encoded payload</param>
+    /// <param name="keyframe">Receives true, every QOI frame decodes on its own</param>
+    /// <returns>Indicates success or failure</returns>
+    virtual bool EncodeFrame(const RecordFrame& frame, std::vector<uint8_t>& payload, bool& keyframe);
+};
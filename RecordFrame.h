@@ -0,0 +1,69 @@
+//------------------------------------------------------------------------------
+// <copyright file="RecordFrame.h">
+//     Frame description shared by the recording pipeline.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+
+#include "FrameBuffer.h"
+
+// Stream a recorded frame belongs to
+enum RecordStream
+{
+    RecordStreamColor = 0,
+    RecordStreamDepth,
+    RecordStreamCount
+};
+
+// Layout of the pixel data carried by a recorded frame
+enum RecordPixelFormat
+{
+    RecordPixelFormatUnknown = 0,
+    RecordPixelFormatBgra32,        // 4 bytes per pixel, B, G, R, X
+    RecordPixelFormatDepthPixel32,  // NUI_DEPTH_IMAGE_PIXEL, 16-bit player index followed by 16-bit depth
+};
+
+// Encoding of a stored frame
+enum RecordCodec
+{
+    RecordCodecRaw = 0,             // Pixels as copied from the sensor, rows of stride bytes
+    RecordCodecPng,                 // PNG image file, as written to the depth folder
+    RecordCodecRvl,                 // Lossless run-length/variable-length depth, see RvlCodec.h
+    RecordCodecTemporalDepth,       // Lossless depth predicted from the previous frame, see TemporalDepthCodec.h
+    RecordCodecQoi,                 // Lossless color in the QOI image format, see QoiCodec.h
+    RecordCodecJpeg,                // Lossy color as baseline JPEG, see JpegCodec.h
+};
+
+/// <summary>
+/// A frame copied out of the sensor texture once. Streams share it through FrameHandle with the
+/// viewer and the recorder, which holds it from submission until it has been written.
+/// </summary>
+struct RecordFrame
+{
+    RecordStream            stream;
+    RecordPixelFormat       format;
+    uint32_t                width;
+    uint32_t                height;
+    uint32_t                stride;         // Bytes per row in data
+    uint32_t                frameNumber;    // Sensor frame number, NUI_IMAGE_FRAME::dwFrameNumber
+    double                  timestamp;      // Capture time in seconds since epoch
+    int64_t                 sensorTime;     // Milliseconds of the sensor clock, NUI_IMAGE_FRAME::liTimeStamp
+    double                  hostTime;       // Seconds of the monotonic host clock when the frame arrived
+    FrameBuffer             data;           // Slab of the frame pool, or heap memory when the pool is exhausted
+
+    RecordFrame()
+        : stream(RecordStreamColor)
+        , format(RecordPixelFormatUnknown)
+        , width(0)
+        , height(0)
+        , stride(0)
+        , frameNumber(0)
+        , timestamp(0.0)
+        , sensorTime(0)
+        , hostTime(0.0)
+    {
+    }
+};
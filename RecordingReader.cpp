@@ -0,0 +1,827 @@
+//------------------------------------------------------------------------------
+// <copyright file="RecordingReader.cpp">
+//     Memory-mapped random access to recorded sessions.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "RecordingReader.h"
+#include "FrameCodec.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    /// <summary>
+    /// Get size of a file, or -1 if it does not exist
+    /// </summary>
+    int64_t GetFileSize64(const std::string& path)
+    {
+        std::ifstream file(path.c_str(), std::ios::binary | std::ios::ate);
+        return file ? (int64_t)file.tellg() : -1;
+    }
+
+    /// <summary>
+    /// Get the codec of an image file written by the recorder from its extension
+    /// </summary>
+    RecordCodec GetCodecOfFile(const std::string& file)
+    {
+        std::string extension = file.substr(file.find_last_of('.') + 1);
+        if ("png" == extension)
+        {
+            return RecordCodecPng;
+        }
+        else if ("rvl" == extension)
+        {
+            return RecordCodecRvl;
+        }
+        else if ("tdp" == extension)
+        {
+            return RecordCodecTemporalDepth;
+        }
+        else if ("qoi" == extension)
+        {
+            return RecordCodecQoi;
+        }
+        else if ("jpg" == extension)
+        {
+            return RecordCodecJpeg;
+        }
+
+        return RecordCodecRaw;
+    }
+
+    /// <summary>
+    /// Read a little-endian 32-bit value
+    /// </summary>
+    uint32_t GetLE32(const uint8_t* p)
+    {
+        return ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | p[0];
+    }
+
+    /// <summary>
+    /// Append the entries of one timestamp log to the folder index
+    /// </summary>
+    void ParseLog(const std::string& path, RecordStream stream,
+                  std::vector<RecordingIndexEntry>& entries, std::string& strings)
+    {
+        std::ifstream log(path.c_str(), std::ios::binary);
+        std::string   line;
+
+        while (std::getline(log, line))
+        {
+            // Each line is "<timestamp>\t<relative path>"
+            size_t tab = line.find('\t');
+            if (std::string::npos == tab)
+            {
+                continue;
+            }
+
+            std::string file = line.substr(tab + 1);
+            while (!file.empty() && ('\r' == file.back() || ' ' == file.back()))
+            {
+                file.pop_back();
+            }
+            if (file.empty() || file.size() > 0xFFFF)
+            {
+                continue;
+            }
+
+            RecordingIndexEntry entry;
+            memset(&entry, 0, sizeof(entry));
+            entry.timestamp  = strtod(line.c_str(), nullptr);
+            entry.pathOffset = (uint32_t)strings.size();
+            entry.pathLength = (uint16_t)file.size();
+            entry.stream     = (uint8_t)stream;
+            entry.codec      = (uint8_t)GetCodecOfFile(file);
+            entries.push_back(entry);
+
+            strings += file;
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+//
+// MappedFile
+//
+// -----------------------------------------------------------------------------
+
+/// <summary>
+/// Constructor
+/// </summary>
+MappedFile::MappedFile()
+    : m_pData(nullptr)
+    , m_size(0)
+#ifdef _WIN32
+    , m_hFile(INVALID_HANDLE_VALUE)
+    , m_hMapping(nullptr)
+#endif
+{
+}
+
+/// <summary>
+/// Destructor. Unmaps the file
+/// </summary>
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+/// <summary>
+/// Map a file into memory
+/// </summary>
+/// <param name="path">Path of the file</param>
+/// <param name="sequential">Hint that the file will be read front to back</param>
+/// <returns>Indicates success or failure</returns>
+bool MappedFile::Open(const std::string& path, bool sequential)
+{
+    Close();
+
+#ifdef _WIN32
+    m_hFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+                          sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS, NULL);
+    if (INVALID_HANDLE_VALUE == m_hFile)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_hFile, &size) || 0 == size.QuadPart)
+    {
+        Close();
+        return false;
+    }
+
+    m_hMapping = CreateFileMappingA(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!m_hMapping)
+    {
+        Close();
+        return false;
+    }
+
+    m_pData = static_cast<const uint8_t*>(MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0));
+    if (!m_pData)
+    {
+        Close();
+        return false;
+    }
+    m_size = (uint64_t)size.QuadPart;
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat info;
+    if (0 != fstat(fd, &info) || 0 == info.st_size)
+    {
+        close(fd);
+        return false;
+    }
+
+    void* pMap = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (MAP_FAILED == pMap)
+    {
+        return false;
+    }
+
+    madvise(pMap, (size_t)info.st_size, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+    m_pData = static_cast<const uint8_t*>(pMap);
+    m_size  = (uint64_t)info.st_size;
+#endif
+
+    return true;
+}
+
+/// <summary>
+/// Unmap the file
+/// </summary>
+void MappedFile::Close()
+{
+#ifdef _WIN32
+    if (m_pData)
+    {
+        UnmapViewOfFile(m_pData);
+    }
+    if (m_hMapping)
+    {
+        CloseHandle(m_hMapping);
+        m_hMapping = nullptr;
+    }
+    if (INVALID_HANDLE_VALUE != m_hFile)
+    {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (m_pData)
+    {
+        munmap(const_cast<uint8_t*>(m_pData), (size_t)m_size);
+    }
+#endif
+
+    m_pData = nullptr;
+    m_size  = 0;
+}
+
+/// <summary>
+/// Ask the OS to start reading a range of the file into memory
+/// </summary>
+/// <param name="offset">Offset of the range in bytes</param>
+/// <param name="size">Size of the range in bytes</param>
+void MappedFile::WillNeed(uint64_t offset, uint64_t size) const
+{
+    if (!m_pData || offset >= m_size)
+    {
+        return;
+    }
+    size = std::min(size, m_size - offset);
+
+#ifdef _WIN32
+    // PrefetchVirtualMemory is only available from Windows 8 on
+    struct MemoryRange
+    {
+        PVOID   VirtualAddress;
+        SIZE_T  NumberOfBytes;
+    };
+    typedef BOOL (WINAPI *PrefetchVirtualMemoryFn)(HANDLE, ULONG_PTR, MemoryRange*, ULONG);
+    static const PrefetchVirtualMemoryFn pPrefetch =
+        (PrefetchVirtualMemoryFn)GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "PrefetchVirtualMemory");
+
+    if (pPrefetch)
+    {
+        MemoryRange range = { (PVOID)(m_pData + offset), (SIZE_T)size };
+        pPrefetch(GetCurrentProcess(), 1, &range, 0);
+    }
+#else
+    static const uint64_t pageSize = (uint64_t)sysconf(_SC_PAGESIZE);
+
+    uint64_t begin = offset & ~(pageSize - 1);
+    madvise(const_cast<uint8_t*>(m_pData + begin), (size_t)(offset + size - begin), MADV_WILLNEED);
+#endif
+}
+
+// -----------------------------------------------------------------------------
+//
+// RecordingReader
+//
+// -----------------------------------------------------------------------------
+
+/// <summary>
+/// Constructor
+/// </summary>
+RecordingReader::RecordingReader()
+    : m_isContainer(false)
+    , m_pStringTable(nullptr)
+{
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+RecordingReader::~RecordingReader()
+{
+    Close();
+}
+
+/// <summary>
+/// Open a recording
+/// </summary>
+/// <param name="path">Path of a container file or of a session folder</param>
+/// <returns>Indicates success or failure</returns>
+bool RecordingReader::Open(const std::string& path)
+{
+    Close();
+
+    // Anything that is not a readable file is treated as a session folder
+    if (GetFileSize64(path) > 0 && OpenContainer(path))
+    {
+        return true;
+    }
+
+    Close();
+    return OpenFolder(path);
+}
+
+/// <summary>
+/// Release mappings. Views handed out before stay valid
+/// </summary>
+void RecordingReader::Close()
+{
+    m_pMapping.reset();
+    m_pStringTable = nullptr;
+    m_isContainer  = false;
+    m_folder.clear();
+
+    for (int i = 0; i < RecordStreamCount; i++)
+    {
+        m_entries[i].clear();
+        m_frameNumbers[i].clear();
+        m_prefetched[i].clear();
+    }
+}
+
+/// <summary>
+/// Open a container file
+/// </summary>
+bool RecordingReader::OpenContainer(const std::string& path)
+{
+    // The container reader validates the file and recovers the index of unfinished files
+    RgbdContainerReader container;
+    if (!container.Open(path))
+    {
+        return false;
+    }
+
+    m_pMapping = std::make_shared<MappedFile>();
+    if (!m_pMapping->Open(path, false))
+    {
+        return false;
+    }
+
+    for (const RgbdIndexEntry& indexEntry : container.GetIndex())
+    {
+        if (indexEntry.stream >= RecordStreamCount ||
+            indexEntry.offset + sizeof(RgbdChunkHeader) + indexEntry.payloadSize > m_pMapping->GetSize())
+        {
+            continue;
+        }
+
+        Entry entry;
+        entry.timestamp   = indexEntry.timestamp;
+        entry.frameNumber = indexEntry.frameNumber;
+        entry.offset      = indexEntry.offset;
+        entry.size        = indexEntry.payloadSize;
+        entry.width       = indexEntry.width;
+        entry.height      = indexEntry.height;
+        entry.format      = indexEntry.format;
+        entry.codec       = indexEntry.codec;
+        m_entries[indexEntry.stream].push_back(entry);
+    }
+
+    m_isContainer = true;
+    SortEntries();
+    return true;
+}
+
+/// <summary>
+/// Open a session folder, building its index if needed
+/// </summary>
+bool RecordingReader::OpenFolder(const std::string& folder)
+{
+    std::string indexPath = folder + "/" RECORDING_INDEX_FILENAME;
+
+    // Rebuild the index when the logs have grown since it was generated
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        m_pMapping = std::make_shared<MappedFile>();
+        if (m_pMapping->Open(indexPath, true) && m_pMapping->GetSize() >= sizeof(RecordingIndexHeader))
+        {
+            RecordingIndexHeader header;
+            memcpy(&header, m_pMapping->GetData(), sizeof(header));
+
+            if (0 == memcmp(header.magic, RECORDING_INDEX_MAGIC, sizeof(header.magic)) &&
+                header.rgbLogSize == (uint64_t)GetFileSize64(folder + "/rgb.txt") &&
+                header.depthLogSize == (uint64_t)GetFileSize64(folder + "/depth.txt") &&
+                sizeof(header) + (uint64_t)header.entryCount * sizeof(RecordingIndexEntry) + header.stringTableSize == m_pMapping->GetSize())
+            {
+                const uint8_t* pEntries = m_pMapping->GetData() + sizeof(header);
+                m_pStringTable = reinterpret_cast<const char*>(pEntries + header.entryCount * sizeof(RecordingIndexEntry));
+
+                for (uint32_t i = 0; i < header.entryCount; i++)
+                {
+                    RecordingIndexEntry indexEntry;
+                    memcpy(&indexEntry, pEntries + i * sizeof(indexEntry), sizeof(indexEntry));
+                    if (indexEntry.stream >= RecordStreamCount ||
+                        (uint64_t)indexEntry.pathOffset + indexEntry.pathLength > header.stringTableSize)
+                    {
+                        continue;
+                    }
+
+                    Entry entry;
+                    entry.timestamp   = indexEntry.timestamp;
+                    entry.frameNumber = 0;
+                    entry.offset      = indexEntry.pathOffset;
+                    entry.size        = indexEntry.pathLength;
+                    entry.width       = 0;
+                    entry.height      = 0;
+                    entry.format      = (uint8_t)(RecordStreamColor == indexEntry.stream ? RecordPixelFormatBgra32 : RecordPixelFormatDepthPixel32);
+                    entry.codec       = indexEntry.codec;
+                    m_entries[indexEntry.stream].push_back(entry);
+                }
+
+                m_folder = folder;
+                SortEntries();
+
+                // The logs carry no frame numbers, so frames are numbered in timestamp order
+                for (int stream = 0; stream < RecordStreamCount; stream++)
+                {
+                    for (size_t i = 0; i < m_entries[stream].size(); i++)
+                    {
+                        m_entries[stream][i].frameNumber = (uint32_t)i;
+                        m_frameNumbers[stream][i].first  = (uint32_t)i;
+                    }
+                }
+                return true;
+            }
+        }
+
+        m_pMapping.reset();
+        if (0 != attempt || !BuildFolderIndex(folder))
+        {
+            break;
+        }
+    }
+
+    return false;
+}
+
+/// <summary>
+/// Build the index file of a session folder from rgb.txt and depth.txt
+/// </summary>
+/// <param name="folder">Session folder</param>
+/// <returns>Indicates success or failure</returns>
+bool RecordingReader::BuildFolderIndex(const std::string& folder)
+{
+    std::vector<RecordingIndexEntry> entries;
+    std::string                      strings;
+
+    RecordingIndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RECORDING_INDEX_MAGIC, sizeof(header.magic));
+
+    // Sizes are taken before parsing, so lines appended meanwhile trigger another rebuild
+    int64_t rgbLogSize   = GetFileSize64(folder + "/rgb.txt");
+    int64_t depthLogSize = GetFileSize64(folder + "/depth.txt");
+    if (rgbLogSize < 0 && depthLogSize < 0)
+    {
+        return false;
+    }
+
+    header.rgbLogSize   = (uint64_t)rgbLogSize;
+    header.depthLogSize = (uint64_t)depthLogSize;
+
+    ParseLog(folder + "/rgb.txt", RecordStreamColor, entries, strings);
+    ParseLog(folder + "/depth.txt", RecordStreamDepth, entries, strings);
+
+    header.entryCount      = (uint32_t)entries.size();
+    header.stringTableSize = (uint32_t)strings.size();
+
+    // Write to a temporary file first so readers never map a half-written index
+    std::string indexPath = folder + "/" RECORDING_INDEX_FILENAME;
+    std::string tempPath  = indexPath + ".tmp";
+    {
+        std::ofstream file(tempPath.c_str(), std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(RecordingIndexEntry));
+        file.write(strings.data(), strings.size());
+        if (!file)
+        {
+            return false;
+        }
+    }
+
+    remove(indexPath.c_str());
+    return 0 == rename(tempPath.c_str(), indexPath.c_str());
+}
+
+/// <summary>
+/// Sort the entries of every stream by timestamp and build the frame number lookup
+/// </summary>
+void RecordingReader::SortEntries()
+{
+    for (int stream = 0; stream < RecordStreamCount; stream++)
+    {
+        std::vector<Entry>& entries = m_entries[stream];
+        std::stable_sort(entries.begin(), entries.end(),
+            [](const Entry& a, const Entry& b) { return a.timestamp < b.timestamp; });
+
+        std::vector<std::pair<uint32_t, size_t>>& frameNumbers = m_frameNumbers[stream];
+        frameNumbers.resize(entries.size());
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            frameNumbers[i] = std::make_pair(entries[i].frameNumber, i);
+        }
+        std::sort(frameNumbers.begin(), frameNumbers.end());
+    }
+}
+
+/// <summary>
+/// Get number of frames of a stream
+/// </summary>
+size_t RecordingReader::GetFrameCount(RecordStream stream) const
+{
+    return stream < RecordStreamCount ? m_entries[stream].size() : 0;
+}
+
+/// <summary>
+/// Get timestamp of a frame without touching its pixel data
+/// </summary>
+double RecordingReader::GetTimestamp(RecordStream stream, size_t index) const
+{
+    return index < GetFrameCount(stream) ? m_entries[stream][index].timestamp : 0.0;
+}
+
+/// <summary>
+/// Map the image file of a frame of a session folder
+/// </summary>
+std::shared_ptr<MappedFile> RecordingReader::MapFrameFile(RecordStream stream, size_t index, bool sequential) const
+{
+    const Entry& entry = m_entries[stream][index];
+
+    std::string path = m_folder + "/" + std::string(m_pStringTable + entry.offset, entry.size);
+#ifndef _WIN32
+    // The recorder logs Windows paths
+    std::replace(path.begin(), path.end(), '\\', '/');
+#endif
+
+    std::shared_ptr<MappedFile> pFile = std::make_shared<MappedFile>();
+    if (!pFile->Open(path, sequential))
+    {
+        pFile.reset();
+    }
+    return pFile;
+}
+
+/// <summary>
+/// Get a zero-copy view of a frame
+/// </summary>
+/// <param name="stream">Stream of the frame</param>
+/// <param name="index">Position of the frame in timestamp order</param>
+/// <param name="view">Receives the view</param>
+/// <returns>Indicates success or failure</returns>
+bool RecordingReader::GetFrame(RecordStream stream, size_t index, FrameView& view)
+{
+    if (index >= GetFrameCount(stream))
+    {
+        return false;
+    }
+
+    const Entry& entry = m_entries[stream][index];
+
+    view.stream      = stream;
+    view.format      = (RecordPixelFormat)entry.format;
+    view.codec       = (RecordCodec)entry.codec;
+    view.frameNumber = entry.frameNumber;
+    view.timestamp   = entry.timestamp;
+
+    if (m_isContainer)
+    {
+        RgbdChunkHeader header;
+        memcpy(&header, m_pMapping->GetData() + entry.offset, sizeof(header));
+        if (RGBD_CHUNK_MAGIC != header.magic)
+        {
+            return false;
+        }
+
+        view.width   = header.width;
+        view.height  = header.height;
+        view.stride  = header.stride;
+        view.pData   = m_pMapping->GetData() + entry.offset + sizeof(header);
+        view.size    = header.payloadSize;
+        view.mapping = m_pMapping;
+        return true;
+    }
+
+    std::shared_ptr<MappedFile> pFile;
+    std::map<size_t, std::shared_ptr<MappedFile>>::iterator it = m_prefetched[stream].find(index);
+    if (it != m_prefetched[stream].end())
+    {
+        pFile = it->second;
+        m_prefetched[stream].erase(it);
+    }
+    else
+    {
+        pFile = MapFrameFile(stream, index, true);
+    }
+
+    if (!pFile)
+    {
+        return false;
+    }
+
+    const uint8_t* pData = pFile->GetData();
+    uint64_t       size  = pFile->GetSize();
+
+    if (RecordCodecRaw != entry.codec)
+    {
+        // The whole encoded file is the payload
+        if (!GetEncodedFrameSize((RecordCodec)entry.codec, pData, (size_t)size, view.width, view.height))
+        {
+            return false;
+        }
+
+        view.stride = 0;
+        view.pData  = pData;
+        view.size   = (size_t)size;
+    }
+    else
+    {
+        // BITMAPFILEHEADER (14 bytes) followed by BITMAPINFOHEADER, pixels start at bfOffBits
+        if (size < 54 || 'B' != pData[0] || 'M' != pData[1])
+        {
+            return false;
+        }
+
+        uint32_t offBits  = GetLE32(pData + 10);
+        int32_t  width    = (int32_t)GetLE32(pData + 18);
+        int32_t  height   = (int32_t)GetLE32(pData + 22);
+        uint32_t bitCount = pData[28] | (pData[29] << 8);
+
+        if (32 != bitCount || width <= 0 || offBits >= size)
+        {
+            return false;
+        }
+
+        view.width  = (uint32_t)width;
+        view.height = (uint32_t)(height < 0 ? -height : height);
+        view.stride = view.width * 4;
+        view.pData  = pData + offBits;
+        view.size   = (size_t)std::min<uint64_t>(size - offBits, (uint64_t)view.stride * view.height);
+    }
+
+    view.mapping = pFile;
+    return true;
+}
+
+/// <summary>
+/// Find the frame closest in time to a timestamp. O(log n)
+/// </summary>
+/// <param name="stream">Stream to search</param>
+/// <param name="timestamp">Timestamp in seconds</param>
+/// <param name="index">Receives the position of the closest frame</param>
+/// <returns>False if the stream has no frames</returns>
+bool RecordingReader::FindByTimestamp(RecordStream stream, double timestamp, size_t& index) const
+{
+    if (0 == GetFrameCount(stream))
+    {
+        return false;
+    }
+
+    const std::vector<Entry>& entries = m_entries[stream];
+    std::vector<Entry>::const_iterator it = std::lower_bound(entries.begin(), entries.end(), timestamp,
+        [](const Entry& entry, double value) { return entry.timestamp < value; });
+
+    index = (size_t)(it - entries.begin());
+    if (index == entries.size() ||
+        (index > 0 && timestamp - entries[index - 1].timestamp <= entries[index].timestamp - timestamp))
+    {
+        index--;
+    }
+
+    return true;
+}
+
+/// <summary>
+/// Find the frame with a frame number. O(log n)
+/// </summary>
+/// <param name="stream">Stream to search</param>
+/// <param name="frameNumber">Frame number to find</param>
+/// <param name="index">Receives the position of the frame</param>
+/// <returns>False if there is no such frame</returns>
+bool RecordingReader::FindByFrameNumber(RecordStream stream, uint32_t frameNumber, size_t& index) const
+{
+    if (stream >= RecordStreamCount)
+    {
+        return false;
+    }
+
+    const std::vector<std::pair<uint32_t, size_t>>& frameNumbers = m_frameNumbers[stream];
+    std::vector<std::pair<uint32_t, size_t>>::const_iterator it = std::lower_bound(frameNumbers.begin(), frameNumbers.end(),
+        std::make_pair(frameNumber, (size_t)0));
+
+    if (it == frameNumbers.end() || it->first != frameNumber)
+    {
+        return false;
+    }
+
+    index = it->second;
+    return true;
+}
+
+/// <summary>
+/// Find the keyframe decoding has to start at to reach a frame. Frames of intra-frame codecs are their own keyframe
+/// </summary>
+/// <param name="stream">Stream of the frame</param>
+/// <param name="index">Position of the frame</param>
+/// <param name="keyframeIndex">Receives the position of the keyframe</param>
+/// <returns>False if no keyframe precedes the frame</returns>
+bool RecordingReader::FindKeyframe(RecordStream stream, size_t index, size_t& keyframeIndex)
+{
+    FrameView view;
+    for (size_t i = index + 1; i-- > 0;)
+    {
+        if (GetFrame(stream, i, view) && IsKeyframePayload(view.codec, view.pData, view.size))
+        {
+            keyframeIndex = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/// <summary>
+/// Hint that a run of frames is going to be read soon
+/// </summary>
+/// <param name="stream">Stream of the frames</param>
+/// <param name="index">Position of the first frame</param>
+/// <param name="count">Number of frames</param>
+void RecordingReader::Prefetch(RecordStream stream, size_t index, size_t count)
+{
+    size_t end = std::min(index + count, GetFrameCount(stream));
+    if (index >= end)
+    {
+        return;
+    }
+
+    if (m_isContainer)
+    {
+        // Frames of the other stream are interleaved, so one range covers the whole run
+        const Entry& first = m_entries[stream][index];
+        const Entry& last  = m_entries[stream][end - 1];
+        if (last.offset >= first.offset)
+        {
+            m_pMapping->WillNeed(first.offset, last.offset + sizeof(RgbdChunkHeader) + last.size - first.offset);
+        }
+        return;
+    }
+
+    // Map the image files ahead of use; GetFrame picks them up
+    std::map<size_t, std::shared_ptr<MappedFile>>& prefetched = m_prefetched[stream];
+    for (size_t i = index; i < end && prefetched.size() < MaxPrefetchedFiles; i++)
+    {
+        if (prefetched.count(i))
+        {
+            continue;
+        }
+
+        std::shared_ptr<MappedFile> pFile = MapFrameFile(stream, i, true);
+        if (pFile)
+        {
+            pFile->WillNeed(0, pFile->GetSize());
+            prefetched[i] = pFile;
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+//
+// RecordingIterator
+//
+// -----------------------------------------------------------------------------
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="reader">Reader to iterate</param>
+/// <param name="stream">Stream to iterate</param>
+/// <param name="readahead">Number of frames to prefetch ahead of the current one</param>
+RecordingIterator::RecordingIterator(RecordingReader& reader, RecordStream stream, size_t readahead)
+    : m_reader(reader)
+    , m_stream(stream)
+    , m_readahead(readahead)
+    , m_next(0)
+    , m_prefetched(0)
+{
+}
+
+/// <summary>
+/// Move to the next frame
+/// </summary>
+/// <param name="view">Receives the view of the frame</param>
+/// <returns>False at the end of the stream</returns>
+bool RecordingIterator::Next(FrameView& view)
+{
+    if (m_next >= m_reader.GetFrameCount(m_stream))
+    {
+        return false;
+    }
+
+    // Issue hints in batches of half the window so the window never runs dry
+    if (m_readahead > 0 && m_prefetched < m_next + m_readahead / 2 + 1)
+    {
+        size_t start = std::max(m_prefetched, m_next);
+        size_t end   = m_next + m_readahead;
+        m_reader.Prefetch(m_stream, start, end - start);
+        m_prefetched = end;
+    }
+
+    return m_reader.GetFrame(m_stream, m_next++, view);
+}
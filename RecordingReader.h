@@ -0,0 +1,284 @@
+//------------------------------------------------------------------------------
+// <copyright file="RecordingReader.h">
+//     Memory-mapped random access to recorded sessions.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "RgbdContainer.h"
+
+#define RECORDING_INDEX_FILENAME    "recording.kidx"
+#define RECORDING_INDEX_MAGIC       "KIDX0001"
+
+/// <summary>
+/// Read-only memory mapping of a whole file
+/// </summary>
+class MappedFile
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    MappedFile();
+
+    /// <summary>
+    /// Destructor. Unmaps the file
+    /// </summary>
+   ~MappedFile();
+
+public:
+    /// <summary>
+    /// Map a file into memory
+    /// </summary>
+    /// <param name="path">Path of the file</param>
+    /// <param name="sequential">Hint that the file will be read front to back</param>
+    /// <returns>Indicates success or failure</returns>
+    bool Open(const std::string& path, bool sequential);
+
+    /// <summary>
+    /// Unmap the file
+    /// </summary>
+    void Close();
+
+    /// <summary>
+    /// Ask the OS to start reading a range of the file into memory
+    /// </summary>
+    /// <param name="offset">Offset of the range in bytes</param>
+    /// <param name="size">Size of the range in bytes</param>
+    void WillNeed(uint64_t offset, uint64_t size) const;
+
+    const uint8_t* GetData() const { return m_pData; }
+    uint64_t GetSize() const { return m_size; }
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+private:
+    const uint8_t*  m_pData;
+    uint64_t        m_size;
+#ifdef _WIN32
+    void*           m_hFile;
+    void*           m_hMapping;
+#endif
+};
+
+/// <summary>
+/// Zero-copy view of a recorded frame. The pixel data stays valid as long as the view is alive
+/// </summary>
+struct FrameView
+{
+    RecordStream                stream;
+    RecordPixelFormat           format;
+    RecordCodec                 codec;
+    uint32_t                    width;
+    uint32_t                    height;
+    uint32_t                    stride;         // Bytes per row of raw pixels, 0 for encoded files
+    uint32_t                    frameNumber;
+    double                      timestamp;
+    const uint8_t*              pData;
+    size_t                      size;
+    std::shared_ptr<MappedFile> mapping;    // Keeps the mapping pData points into alive
+};
+
+#pragma pack(push, 1)
+
+// Header of the index generated for the rgb/depth folder layout
+struct RecordingIndexHeader
+{
+    char        magic[8];
+    uint32_t    entryCount;
+    uint32_t    stringTableSize;
+    uint64_t    rgbLogSize;         // Sizes of rgb.txt and depth.txt the index was built from
+    uint64_t    depthLogSize;
+};
+
+struct RecordingIndexEntry
+{
+    double      timestamp;
+    uint32_t    pathOffset;         // Offset of the path in the string table
+    uint16_t    pathLength;
+    uint8_t     stream;
+    uint8_t     codec;
+};
+
+#pragma pack(pop)
+
+/// <summary>
+/// Random access reader for a recorded session. Opens either a container file or a
+/// folder with the rgb/depth layout, for which a binary index file is generated on first use.
+/// </summary>
+class RecordingReader
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    RecordingReader();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+   ~RecordingReader();
+
+public:
+    /// <summary>
+    /// Open a recording
+    /// </summary>
+    /// <param name="path">Path of a container file or of a session folder</param>
+    /// <returns>Indicates success or failure</returns>
+    bool Open(const std::string& path);
+
+    /// <summary>
+    /// Release mappings. Views handed out before stay valid
+    /// </summary>
+    void Close();
+
+    /// <summary>
+    /// Get number of frames of a stream
+    /// </summary>
+    size_t GetFrameCount(RecordStream stream) const;
+
+    /// <summary>
+    /// Get timestamp of a frame without touching its pixel data
+    /// </summary>
+    double GetTimestamp(RecordStream stream, size_t index) const;
+
+    /// <summary>
+    /// Get a zero-copy view of a frame
+    /// </summary>
+    /// <param name="stream">Stream of the frame</param>
+    /// <param name="index">Position of the frame in timestamp order</param>
+    /// <param name="view">Receives the view</param>
+    /// <returns>Indicates success or failure</returns>
+    bool GetFrame(RecordStream stream, size_t index, FrameView& view);
+
+    /// <summary>
+    /// Find the frame closest in time to a timestamp. O(log n)
+    /// </summary>
+    /// <param name="stream">Stream to search</param>
+    /// <param name="timestamp">Timestamp in seconds</param>
+    /// <param name="index">Receives the position of the closest frame</param>
+    /// <returns>False if the stream has no frames</returns>
+    bool FindByTimestamp(RecordStream stream, double timestamp, size_t& index) const;
+
+    /// <summary>
+    /// Find the frame with a frame number. O(log n)
+    /// </summary>
+    /// <param name="stream">Stream to search</param>
+    /// <param name="frameNumber">Frame number to find</param>
+    /// <param name="index">Receives the position of the frame</param>
+    /// <returns>False if there is no such frame</returns>
+    bool FindByFrameNumber(RecordStream stream, uint32_t frameNumber, size_t& index) const;
+
+    /// <summary>
+    /// Find the keyframe decoding has to start at to reach a frame. Frames of intra-frame codecs are their own keyframe
+    /// </summary>
+    /// <param name="stream">Stream of the frame</param>
+    /// <param name="index">Position of the frame</param>
+    /// <param name="keyframeIndex">Receives the position of the keyframe</param>
+    /// <returns>False if no keyframe precedes the frame</returns>
+    bool FindKeyframe(RecordStream stream, size_t index, size_t& keyframeIndex);
+
+    /// <summary>
+    /// Hint that a run of frames is going to be read soon
+    /// </summary>
+    /// <param name="stream">Stream of the frames</param>
+    /// <param name="index">Position of the first frame</param>
+    /// <param name="count">Number of frames</param>
+    void Prefetch(RecordStream stream, size_t index, size_t count);
+
+    /// <summary>
+    /// Build the index file of a session folder from rgb.txt and depth.txt
+    /// </summary>
+    /// <param name="folder">Session folder</param>
+    /// <returns>Indicates success or failure</returns>
+    static bool BuildFolderIndex(const std::string& folder);
+
+private:
+    struct Entry
+    {
+        double      timestamp;
+        uint32_t    frameNumber;
+        uint64_t    offset;         // Chunk offset in the container, or path offset in the string table
+        uint32_t    size;           // Payload size, or path length
+        uint32_t    width;
+        uint32_t    height;
+        uint8_t     format;
+        uint8_t     codec;
+    };
+
+    /// <summary>
+    /// Open a container file
+    /// </summary>
+    bool OpenContainer(const std::string& path);
+
+    /// <summary>
+    /// Open a session folder, building its index if needed
+    /// </summary>
+    bool OpenFolder(const std::string& folder);
+
+    /// <summary>
+    /// Sort the entries of every stream by timestamp and build the frame number lookup
+    /// </summary>
+    void SortEntries();
+
+    /// <summary>
+    /// Map the image file of a frame of a session folder
+    /// </summary>
+    std::shared_ptr<MappedFile> MapFrameFile(RecordStream stream, size_t index, bool sequential) const;
+
+    static const size_t MaxPrefetchedFiles = 64;
+
+private:
+    bool                                    m_isContainer;
+    std::string                             m_folder;
+    std::shared_ptr<MappedFile>             m_pMapping;         // Container file or folder index file
+    const char*                             m_pStringTable;
+    std::vector<Entry>                      m_entries[RecordStreamCount];
+    std::vector<std::pair<uint32_t, size_t>> m_frameNumbers[RecordStreamCount];
+    std::map<size_t, std::shared_ptr<MappedFile>> m_prefetched[RecordStreamCount];   // Image files mapped ahead of use
+};
+
+/// <summary>
+/// Iterates the frames of one stream in order and keeps a readahead window in flight,
+/// so consumers can stream a recording at disk bandwidth.
+/// </summary>
+class RecordingIterator
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="reader">Reader to iterate</param>
+    /// <param name="stream">Stream to iterate</param>
+    /// <param name="readahead">Number of frames to prefetch ahead of the current one</param>
+    RecordingIterator(RecordingReader& reader, RecordStream stream, size_t readahead = DefaultReadahead);
+
+    static const size_t DefaultReadahead = 8;
+
+    /// <summary>
+    /// Move to the next frame
+    /// </summary>
+    /// <param name="view">Receives the view of the frame</param>
+    /// <returns>False at the end of the stream</returns>
+    bool Next(FrameView& view);
+
+    /// <summary>
+    /// Continue iteration from a position
+    /// </summary>
+    void Seek(size_t index) { m_next = index; m_prefetched = index; }
+
+private:
+    RecordingReader&    m_reader;
+    RecordStream        m_stream;
+    size_t              m_readahead;
+    size_t              m_next;
+    size_t              m_prefetched;   // Frames before this position have been prefetched
+};
@@ -0,0 +1,708 @@
+//------------------------------------------------------------------------------
+// <copyright file="RecordingSegments.cpp">
+//     Splitting of long recordings into numbered, self-contained segments.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "RecordingSegments.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/// <summary>
+/// Create a directory in the current directory, if it does not exist yet
+/// </summary>
+static void MakeDirectoryIfMissing(const char* pName)
+{
+#ifdef _WIN32
+    _mkdir(pName);
+#else
+    mkdir(pName, 0755);
+#endif
+}
+
+/// <summary>
+/// Remove a directory from the current directory, if it is empty
+/// </summary>
+static void RemoveEmptyDirectory(const char* pName)
+{
+#ifdef _WIN32
+    _rmdir(pName);
+#else
+    rmdir(pName);
+#endif
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="pool">Pool the next segments are opened and the previous ones closed on, must outlive the segmenter</param>
+/// <param name="maxSeconds">Capture time after which a new segment starts, 0 for no limit</param>
+/// <param name="maxBytes">Bytes written after which a new segment starts, 0 for no limit</param>
+RecordingSegmenter::RecordingSegmenter(TaskPool& pool, double maxSeconds, uint64_t maxBytes)
+    : m_pool(pool)
+    , m_maxSeconds(maxSeconds)
+    , m_maxBytes(maxBytes)
+    , m_indexPath("segments.txt")
+    , m_listedBelow(0)
+    , m_directories(0)
+{
+    for (int i = 0; i < RecordStreamCount; i++)
+    {
+        m_newest[i] = 0.0;
+        m_seen[i]   = false;
+    }
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+/// <summary>
+/// Set the path of the list of closed segments, segments.txt in the current directory unless set.
+/// Must be called while the recorder is stopped.
+/// </summary>
+/// <param name="pPath">Path of the list, nullptr to list nothing</param>
+void RecordingSegmenter::SetIndexPath(const char* pPath)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_indexPath = pPath ? pPath : "";
+}
+
+/// <summary>
+/// Start a session with segment 0. Called by the recorder before its writers are opened
+/// </summary>
+void RecordingSegmenter::Start()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    m_boundaries.clear();
+    m_segments.assign(1, SegmentRecord());
+    memset(&m_segments[0], 0, sizeof(SegmentRecord));
+    for (int i = 0; i < RecordStreamCount; i++)
+    {
+        m_newest[i] = 0.0;
+        m_seen[i]   = false;
+    }
+
+    m_closedBelow.clear();
+    m_listedBelow = 0;
+    m_directories = 0;
+    memset(&m_stats, 0, sizeof(m_stats));
+    m_stats.segments = 1;
+}
+
+/// <summary>
+/// List the segments not listed yet, remove the directory of a segment opened ahead but not reached,
+/// and log the session. Called by the recorder after its writers are closed
+/// </summary>
+void RecordingSegmenter::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+
+        // Every writer has closed its files by now
+        for (uint32_t& closedBelow : m_closedBelow)
+        {
+            closedBelow = (uint32_t)m_segments.size();
+        }
+        ListClosedSegments();
+
+        // Created for the writers of the next segment, which were discarded. Fails if anything is left in it
+        for (uint32_t segment = (uint32_t)m_segments.size(); segment < m_directories; segment++)
+        {
+            char name[32];
+            snprintf(name, sizeof(name), SEGMENT_NAME_FORMAT, segment);
+            RemoveEmptyDirectory(name);
+        }
+        m_directories = (uint32_t)m_segments.size();
+    }
+
+    LogSession();
+}
+
+/// <summary>
+/// Register a writer or list which moves through the segments, so segments are only listed as
+/// closed once it is done with them. Called when the session starts
+/// </summary>
+/// <returns>Identifier to report progress with</returns>
+uint32_t RecordingSegmenter::Join()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_closedBelow.push_back(0);
+    return (uint32_t)m_closedBelow.size() - 1;
+}
+
+/// <summary>
+/// Report that a writer or list has closed all segments up to one
+/// </summary>
+/// <param name="participant">Identifier returned by Join</param>
+/// <param name="segment">Last segment closed</param>
+void RecordingSegmenter::Finish(uint32_t participant, uint32_t segment)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    if (participant < m_closedBelow.size())
+    {
+        m_closedBelow[participant] = std::max(m_closedBelow[participant], segment + 1);
+        ListClosedSegments();
+    }
+}
+
+/// <summary>
+/// Assign a submitted frame to a segment, starting a new segment if the current one is full.
+/// Frames of each stream must be assigned in capture order
+/// </summary>
+/// <param name="frame">Frame submitted for recording</param>
+/// <returns>Segment of the frame</returns>
+uint32_t RecordingSegmenter::AssignFrame(const RecordFrame& frame)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    if (m_segments.empty())
+    {
+        return 0;
+    }
+
+    const SegmentRecord& current = m_segments.back();
+    bool full = current.frames > 0 &&
+        ((m_maxSeconds > 0 && frame.timestamp - current.firstTimestamp >= m_maxSeconds) ||
+         (m_maxBytes > 0 && current.bytes >= m_maxBytes));
+    if (full)
+    {
+        // The new segment starts after every frame assigned so far, so no frame assigned before changes
+        // its segment. A frame of a stream running behind the other stays in the current segment
+        double boundary = current.firstTimestamp;
+        for (int i = 0; i < RecordStreamCount; i++)
+        {
+            if (m_seen[i])
+            {
+                boundary = std::max(boundary, m_newest[i]);
+            }
+        }
+
+        if (frame.timestamp > boundary)
+        {
+            SegmentRecord next;
+            memset(&next, 0, sizeof(next));
+            m_boundaries.push_back(boundary);
+            m_segments.push_back(next);
+            m_stats.segments = (uint32_t)m_segments.size();
+        }
+    }
+
+    if (!m_seen[frame.stream] || frame.timestamp > m_newest[frame.stream])
+    {
+        m_newest[frame.stream] = frame.timestamp;
+    }
+    m_seen[frame.stream] = true;
+
+    uint32_t       segment = FindSegment(frame.timestamp);
+    SegmentRecord& record  = m_segments[segment];
+    if (0 == record.frames || frame.timestamp < record.firstTimestamp)
+    {
+        record.firstTimestamp = frame.timestamp;
+    }
+    record.lastTimestamp = std::max(record.lastTimestamp, frame.timestamp);
+    ++record.frames;
+
+    return segment;
+}
+
+/// <summary>
+/// Look up the segment of a frame assigned before
+/// </summary>
+/// <param name="timestamp">Capture time of the frame</param>
+/// <returns>Segment of the frame</returns>
+uint32_t RecordingSegmenter::GetSegment(double timestamp) const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return FindSegment(timestamp);
+}
+
+/// <summary>
+/// Count bytes written to a segment, for the size limit
+/// </summary>
+void RecordingSegmenter::AddBytes(uint32_t segment, uint64_t bytes)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    if (segment < m_segments.size())
+    {
+        m_segments[segment].bytes += bytes;
+    }
+}
+
+/// <summary>
+/// Get the bytes a segment is expected to take, to reserve disk space for it
+/// </summary>
+/// <returns>The size limit, or the size of the latest full segment if there is none</returns>
+uint64_t RecordingSegmenter::GetExpectedBytes() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    if (m_maxBytes)
+    {
+        return m_maxBytes;
+    }
+
+    // The newest segment is still being written, the one before it ran its full time
+    return (m_segments.size() >= 2) ? m_segments[m_segments.size() - 2].bytes : 0;
+}
+
+/// <summary>
+/// Get the directory of a segment, e.g. "segment_0001", creating it if needed
+/// </summary>
+/// <param name="segment">Segment number</param>
+/// <returns>Directory name relative to the current directory</returns>
+std::string RecordingSegmenter::MakeSegmentDirectory(uint32_t segment)
+{
+    char name[32];
+    snprintf(name, sizeof(name), SEGMENT_NAME_FORMAT, segment);
+
+    // Writers of both streams and the associator ask for it, whoever comes first creates it
+    MakeDirectoryIfMissing(name);
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_directories = std::max(m_directories, segment + 1);
+    return name;
+}
+
+/// <summary>
+/// Count a writer or list switching to the next segment
+/// </summary>
+/// <param name="prefetched">True if it had been opened ahead</param>
+/// <param name="seconds">Time the switch took</param>
+void RecordingSegmenter::CountRollover(bool prefetched, double seconds)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    ++m_stats.rollovers;
+    m_stats.prefetchedRollovers += prefetched ? 1 : 0;
+    m_stats.maxRolloverSeconds   = std::max(m_stats.maxRolloverSeconds, seconds);
+}
+
+/// <summary>
+/// Get a snapshot of the counters
+/// </summary>
+RecordingSegmenterStats RecordingSegmenter::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_stats;
+}
+
+/// <summary>
+/// Segment of a capture time. Called with the lock held
+/// </summary>
+uint32_t RecordingSegmenter::FindSegment(double timestamp) const
+{
+    // Number of boundaries the frame was captured after
+    return (uint32_t)(std::lower_bound(m_boundaries.begin(), m_boundaries.end(), timestamp) - m_boundaries.begin());
+}
+
+/// <summary>
+/// Append the segments every participant is done with to segments.txt. Called with the lock held
+/// </summary>
+void RecordingSegmenter::ListClosedSegments()
+{
+    uint32_t closedBelow = (uint32_t)m_segments.size();
+    for (uint32_t participantBelow : m_closedBelow)
+    {
+        closedBelow = std::min(closedBelow, participantBelow);
+    }
+
+    if (closedBelow <= m_listedBelow)
+    {
+        return;
+    }
+
+    // Opened and closed for every batch, so whoever watches the list sees a segment as soon as it is listed
+    FILE* pIndex = m_indexPath.empty() ? nullptr : fopen(m_indexPath.c_str(), "a");
+    for (uint32_t segment = m_listedBelow; segment < closedBelow; segment++)
+    {
+        // "[first timestamp]\t[last timestamp]\t[directory]\t[frames]\t[bytes]"
+        const SegmentRecord& record = m_segments[segment];
+        if (pIndex && record.frames)
+        {
+            char name[32];
+            snprintf(name, sizeof(name), SEGMENT_NAME_FORMAT, segment);
+            fprintf(pIndex, "%.6f\t%.6f\t%s\t%llu\t%llu\n", record.firstTimestamp, record.lastTimestamp, name,
+                (unsigned long long)record.frames, (unsigned long long)record.bytes);
+        }
+    }
+    m_listedBelow = closedBelow;
+
+    if (pIndex)
+    {
+        fclose(pIndex);
+    }
+}
+
+/// <summary>
+/// Append the counters of the session to session.log in the current directory
+/// </summary>
+void RecordingSegmenter::LogSession() const
+{
+    RecordingSegmenterStats stats = GetStats();
+    if (0 == stats.rollovers)
+    {
+        return;
+    }
+
+    FILE* pLog = fopen("session.log", "a");
+    if (!pLog)
+    {
+        return;
+    }
+
+    char   timeText[32];
+    time_t now = time(nullptr);
+    tm     local;
+#ifdef _WIN32
+    localtime_s(&local, &now);
+#else
+    localtime_r(&now, &local);
+#endif
+    strftime(timeText, sizeof(timeText), "%Y-%m-%d %H:%M:%S", &local);
+
+    fprintf(pLog, "%s segments: %u segments, %u rollovers, %u opened ahead, longest %.2f ms\n",
+        timeText, stats.segments, stats.rollovers, stats.prefetchedRollovers, stats.maxRolloverSeconds * 1000);
+
+    fclose(pLog);
+}
+
+// -----------------------------------------------------------------------------
+//
+// SegmentCloser
+//
+// -----------------------------------------------------------------------------
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="pool">Pool the files are closed on</param>
+SegmentCloser::SegmentCloser(TaskPool& pool)
+    : m_pool(pool)
+    , m_draining(false)
+    , m_submitted(false)
+{
+}
+
+/// <summary>
+/// Destructor. Waits for the files handed over
+/// </summary>
+SegmentCloser::~SegmentCloser()
+{
+    Wait();
+
+    // A task submitted before Wait took over the queue finds nothing to do, but still holds this
+    std::unique_lock<std::mutex> lock(m_lock);
+    m_drained.wait(lock, [&]() { return !m_submitted; });
+}
+
+/// <summary>
+/// Hand over a function closing the files of a segment
+/// </summary>
+void SegmentCloser::Close(const CloseFunction& close)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_queue.push_back(close);
+        if (m_draining || m_submitted)
+        {
+            return;
+        }
+        m_submitted = true;
+    }
+
+    m_pool.Submit([this]() { Drain(); });
+}
+
+/// <summary>
+/// Wait until every function handed over has run, running them on the calling thread if the pool has not started yet
+/// </summary>
+void SegmentCloser::Wait()
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    m_drained.wait(lock, [&]() { return !m_draining; });
+    if (m_queue.empty())
+    {
+        return;
+    }
+
+    // The pool may be busy with the frames of the stream, which are done by now
+    m_draining = true;
+    while (!m_queue.empty())
+    {
+        CloseFunction close = std::move(m_queue.front());
+        m_queue.pop_front();
+
+        lock.unlock();
+        close();
+        lock.lock();
+    }
+    m_draining = false;
+    m_drained.notify_all();
+}
+
+/// <summary>
+/// Task running the functions handed over until there are none left
+/// </summary>
+void SegmentCloser::Drain()
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    m_submitted = false;
+    if (m_draining)
+    {
+        m_drained.notify_all();
+        return;
+    }
+
+    m_draining = true;
+    while (!m_queue.empty())
+    {
+        CloseFunction close = std::move(m_queue.front());
+        m_queue.pop_front();
+
+        lock.unlock();
+        close();
+        lock.lock();
+    }
+    m_draining = false;
+    m_drained.notify_all();
+}
+
+// -----------------------------------------------------------------------------
+//
+// SegmentedFrameWriter
+//
+// -----------------------------------------------------------------------------
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="pSegmenter">Segmenter the recorder assigns the frames with</param>
+/// <param name="createWriter">Creates the writer of a segment. Called on the pool</param>
+SegmentedFrameWriter::SegmentedFrameWriter(const std::shared_ptr<RecordingSegmenter>& pSegmenter, const WriterFactory& createWriter)
+    : m_pSegmenter(pSegmenter)
+    , m_createWriter(createWriter)
+    , m_next(pSegmenter->GetPool(),
+             [this](uint32_t segment) { return CreateWriter(segment); },
+             [](FrameWriter* pWriter) { pWriter->Discard(); delete pWriter; })
+    , m_participant(0)
+    , m_concurrency(0)
+    , m_hasExtension(false)
+    , m_closer(pSegmenter->GetPool())
+{
+}
+
+/// <summary>
+/// Destructor. Waits for the writers being closed on the pool
+/// </summary>
+SegmentedFrameWriter::~SegmentedFrameWriter()
+{
+    Close();
+}
+
+/// <summary>
+/// Open the writer of the first segment and start opening the one of the second
+/// </summary>
+/// <returns>Indicates success or failure</returns>
+bool SegmentedFrameWriter::Open()
+{
+    Close();
+
+    Segment first;
+    first.number = 0;
+    first.writer.reset(CreateWriter(0));
+    if (!first.writer)
+    {
+        return false;
+    }
+
+    // Every segment writer is made by the same factory, so they all encode and name files alike
+    m_concurrency  = first.writer->GetEncodeConcurrency();
+    m_hasExtension = nullptr != first.writer->GetFileExtension();
+    m_extension    = m_hasExtension ? first.writer->GetFileExtension() : "";
+    m_participant  = m_pSegmenter->Join();
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_segments.push_back(std::move(first));
+    }
+
+    m_next.Prefetch(1);
+    return true;
+}
+
+/// <summary>
+/// Write a frame with the writer of its segment
+/// </summary>
+/// <param name="frame">Frame to write</param>
+/// <returns>Indicates success or failure</returns>
+bool SegmentedFrameWriter::WriteFrame(const RecordFrame& frame)
+{
+    uint32_t segment = m_pSegmenter->GetSegment(frame.timestamp);
+    Advance(segment);
+
+    FrameWriter* pWriter = GetWriter(segment);
+    if (!pWriter || !pWriter->WriteFrame(frame))
+    {
+        return false;
+    }
+
+    // The size of the frame as it came, the writers which encode and store in one go do not tell the size stored
+    m_pSegmenter->AddBytes(segment, (uint64_t)frame.stride * frame.height);
+    return true;
+}
+
+/// <summary>
+/// Encode a frame with the writer of its segment
+/// </summary>
+/// <param name="frame">Frame to encode</param>
+/// <param name="encoded">Receives the payload</param>
+/// <returns>Indicates success or failure</returns>
+bool SegmentedFrameWriter::EncodeFrame(const RecordFrame& frame, EncodedFrame& encoded)
+{
+    // Frames of the next segment may be encoded while the last ones of this segment are stored
+    FrameWriter* pWriter = GetWriter(m_pSegmenter->GetSegment(frame.timestamp));
+    return pWriter && pWriter->EncodeFrame(frame, encoded);
+}
+
+/// <summary>
+/// Store a frame with the writer of its segment
+/// </summary>
+/// <param name="frame">Frame to store</param>
+/// <param name="encoded">Payload of the frame</param>
+/// <returns>Indicates success or failure</returns>
+bool SegmentedFrameWriter::StoreFrame(const RecordFrame& frame, const EncodedFrame& encoded)
+{
+    uint32_t segment = m_pSegmenter->GetSegment(frame.timestamp);
+    Advance(segment);
+
+    FrameWriter* pWriter = GetWriter(segment);
+    if (!pWriter || !pWriter->StoreFrame(frame, encoded))
+    {
+        return false;
+    }
+
+    m_pSegmenter->AddBytes(segment, encoded.payload.size());
+    return true;
+}
+
+/// <summary>
+/// Close the writers of the session and discard the one opened ahead
+/// </summary>
+void SegmentedFrameWriter::Close()
+{
+    m_next.Cancel();
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        for (Segment& segment : m_segments)
+        {
+            Retire(segment);
+        }
+        m_segments.clear();
+    }
+
+    // The recorder is done with the writer, whatever the pool has not got to yet is closed here
+    m_closer.Wait();
+}
+
+/// <summary>
+/// Create and open the writer of a segment
+/// </summary>
+FrameWriter* SegmentedFrameWriter::CreateWriter(uint32_t segment)
+{
+    FrameWriter* pWriter = m_createWriter(segment);
+    if (pWriter && !pWriter->Open())
+    {
+        // Frames of the segment fail to write and are counted as such
+        pWriter->Close();
+    }
+
+    return pWriter;
+}
+
+/// <summary>
+/// Get the writer of a segment, taken over from the pool if the frame is the first of the segment,
+/// and start opening the writer of the segment after it
+/// </summary>
+FrameWriter* SegmentedFrameWriter::GetWriter(uint32_t segment)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    for (Segment& open : m_segments)
+    {
+        if (segment == open.number)
+        {
+            return open.writer.get();
+        }
+    }
+
+    if (!m_segments.empty() && segment < m_segments.back().number)
+    {
+        // Closed already, a frame can not go back to an earlier segment
+        return nullptr;
+    }
+
+    // Usually opened ahead on the pool, so this only swaps writers
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool prefetched = false;
+
+    Segment next;
+    next.number = segment;
+    next.writer.reset(m_next.Take(segment, prefetched));
+    m_segments.push_back(std::move(next));
+
+    m_pSegmenter->CountRollover(prefetched,
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+    m_next.Prefetch(segment + 1);
+    return m_segments.back().writer.get();
+}
+
+/// <summary>
+/// Move the writing on to the segment of a frame, closing the writers of the segments before it on the pool.
+/// Called by the stage storing frames in order
+/// </summary>
+void SegmentedFrameWriter::Advance(uint32_t segment)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    // Frames are stored in order, no frame of the earlier segments is left
+    while (!m_segments.empty() && m_segments.front().number < segment)
+    {
+        Retire(m_segments.front());
+        m_segments.pop_front();
+    }
+}
+
+/// <summary>
+/// Hand a writer over to be closed on the pool, after which its segment is reported done
+/// </summary>
+void SegmentedFrameWriter::Retire(Segment& segment)
+{
+    // Flushes the lists, writes the index of a container
+    std::shared_ptr<FrameWriter>        pWriter(std::move(segment.writer));
+    std::shared_ptr<RecordingSegmenter> pSegmenter  = m_pSegmenter;
+    uint32_t                            participant = m_participant;
+    uint32_t                            number      = segment.number;
+
+    m_closer.Close([pWriter, pSegmenter, participant, number]()
+    {
+        if (pWriter)
+        {
+            pWriter->Close();
+        }
+        pSegmenter->Finish(participant, number);
+    });
+}
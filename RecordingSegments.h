@@ -0,0 +1,493 @@
+//------------------------------------------------------------------------------
+// <copyright file="RecordingSegments.h">
+//     Splitting of long recordings into numbered, self-contained segments.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "FrameRecorder.h"
+#include "RecordFrame.h"
+#include "TaskPool.h"
+
+#define SEGMENT_NAME_FORMAT     "segment_%04u"      // Directory of a segment of image files, numbered from 0
+
+// Counters of a segmented recording session
+struct RecordingSegmenterStats
+{
+    uint32_t segments;              // Segments frames were assigned to
+    uint32_t rollovers;             // Switches of a writer or list to the next segment
+    uint32_t prefetchedRollovers;   // Switches which found the next segment opened ahead on the pool
+    double   maxRolloverSeconds;    // Longest time a switch kept a write stage from writing
+};
+
+/// <summary>
+/// Splits a recording into numbered segments once a segment has run for a time or has grown to a size.
+/// Frames are assigned to segments when they are submitted, by their capture time: a new segment starts
+/// after the latest capture time submitted so far in any stream, so a segment covers the same time span
+/// in every stream, and a frame's segment can be looked up again from its capture time by the writers
+/// and the associator. Each segment gets its own frame lists, associations and container file, so it
+/// can be used on its own; once every writer has moved past a segment it is listed in segments.txt,
+/// and may be uploaded or processed while the recording goes on.
+/// </summary>
+class RecordingSegmenter
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="pool">Pool the next segments are opened and the previous ones closed on, must outlive the segmenter</param>
+    /// <param name="maxSeconds">Capture time after which a new segment starts, 0 for no limit</param>
+    /// <param name="maxBytes">Bytes written after which a new segment starts, 0 for no limit</param>
+    RecordingSegmenter(TaskPool& pool, double maxSeconds, uint64_t maxBytes);
+
+    /// <summary>
+    /// Set the path of the list of closed segments, segments.txt in the current directory unless set.
+    /// Must be called while the recorder is stopped.
+    /// </summary>
+    /// <param name="pPath">Path of the list, nullptr to list nothing</param>
+    void SetIndexPath(const char* pPath);
+
+    /// <summary>
+    /// Start a session with segment 0. Called by the recorder before its writers are opened
+    /// </summary>
+    void Start();
+
+    /// <summary>
+    /// List the segments not listed yet, remove the directory of a segment opened ahead but not reached,
+    /// and log the session. Called by the recorder after its writers are closed
+    /// </summary>
+    void Stop();
+
+    /// <summary>
+    /// Register a writer or list which moves through the segments, so segments are only listed as
+    /// closed once it is done with them. Called when the session starts
+    /// </summary>
+    /// <returns>Identifier to report progress with</returns>
+    uint32_t Join();
+
+    /// <summary>
+    /// Report that a writer or list has closed all segments up to one
+    /// </summary>
+    /// <param name="participant">Identifier returned by Join</param>
+    /// <param name="segment">Last segment closed</param>
+    void Finish(uint32_t participant, uint32_t segment);
+
+    /// <summary>
+    /// Assign a submitted frame to a segment, starting a new segment if the current one is full.
+    /// Frames of each stream must be assigned in capture order
+    /// </summary>
+    /// <param name="frame">Frame submitted for recording</param>
+    /// <returns>Segment of the frame</returns>
+    uint32_t AssignFrame(const RecordFrame& frame);
+
+    /// <summary>
+    /// Look up the segment of a frame assigned before
+    /// </summary>
+    /// <param name="timestamp">Capture time of the frame</param>
+    /// <returns>Segment of the frame</returns>
+    uint32_t GetSegment(double timestamp) const;
+
+    /// <summary>
+    /// Count bytes written to a segment, for the size limit
+    /// </summary>
+    void AddBytes(uint32_t segment, uint64_t bytes);
+
+    /// <summary>
+    /// Get the bytes a segment is expected to take, to reserve disk space for it
+    /// </summary>
+    /// <returns>The size limit, or the size of the latest full segment if there is none</returns>
+    uint64_t GetExpectedBytes() const;
+
+    /// <summary>
+    /// Get the directory of a segment, e.g. "segment_0001", creating it if needed
+    /// </summary>
+    /// <param name="segment">Segment number</param>
+    /// <returns>Directory name relative to the current directory</returns>
+    std::string MakeSegmentDirectory(uint32_t segment);
+
+    /// <summary>
+    /// Count a writer or list switching to the next segment
+    /// </summary>
+    /// <param name="prefetched">True if it had been opened ahead</param>
+    /// <param name="seconds">Time the switch took</param>
+    void CountRollover(bool prefetched, double seconds);
+
+    /// <summary>
+    /// Get the pool segments are opened and closed on
+    /// </summary>
+    TaskPool& GetPool() const { return m_pool; }
+
+    /// <summary>
+    /// Get a snapshot of the counters
+    /// </summary>
+    RecordingSegmenterStats GetStats() const;
+
+private:
+    // Frames assigned to a segment
+    struct SegmentRecord
+    {
+        double      firstTimestamp;
+        double      lastTimestamp;
+        uint64_t    frames;
+        uint64_t    bytes;
+    };
+
+    /// <summary>
+    /// Segment of a capture time. Called with the lock held
+    /// </summary>
+    uint32_t FindSegment(double timestamp) const;
+
+    /// <summary>
+    /// Append the segments every participant is done with to segments.txt. Called with the lock held
+    /// </summary>
+    void ListClosedSegments();
+
+    /// <summary>
+    /// Append the counters of the session to session.log in the current directory
+    /// </summary>
+    void LogSession() const;
+
+private:
+    TaskPool&                   m_pool;
+    double                      m_maxSeconds;
+    uint64_t                    m_maxBytes;
+    std::string                 m_indexPath;
+
+    mutable std::mutex          m_lock;
+    std::vector<double>         m_boundaries;                   // Frames captured after boundary i belong to segment i + 1 or later
+    std::vector<SegmentRecord>  m_segments;
+    double                      m_newest[RecordStreamCount];    // Latest capture time assigned per stream
+    bool                        m_seen[RecordStreamCount];
+    std::vector<uint32_t>       m_closedBelow;                  // Per participant, the segments before this one are closed
+    uint32_t                    m_listedBelow;                  // Segments before this one are in segments.txt
+    uint32_t                    m_directories;                  // Segments before this one may have a directory
+    RecordingSegmenterStats     m_stats;
+};
+
+/// <summary>
+/// Resource of the next segment of a writer or list, e.g. a writer with its files open, created on the task
+/// pool while the current segment is being written. A resource still waiting in a queue of the pool when it is
+/// needed is created on the calling thread instead, so a stage never waits for a task queued behind it.
+/// </summary>
+template <typename T>
+class SegmentPrefetch
+{
+public:
+    typedef std::function<T*(uint32_t segment)> Factory;
+    typedef std::function<void(T*)>            Disposer;
+
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="pool">Pool creating the resources</param>
+    /// <param name="create">Creates and opens the resource of a segment</param>
+    /// <param name="discard">Closes a resource which was not used and deletes it</param>
+    SegmentPrefetch(TaskPool& pool, const Factory& create, const Disposer& discard)
+        : m_pool(pool)
+        , m_pState(std::make_shared<State>())
+    {
+        m_pState->create  = create;
+        m_pState->discard = discard;
+        m_pState->step    = StepIdle;
+        m_pState->segment = 0;
+    }
+
+    /// <summary>
+    /// Destructor. Discards a resource created ahead and not taken
+    /// </summary>
+   ~SegmentPrefetch()
+    {
+        Cancel();
+    }
+
+    /// <summary>
+    /// Start creating the resource of a segment on the pool
+    /// </summary>
+    void Prefetch(uint32_t segment)
+    {
+        Cancel();
+
+        {
+            std::lock_guard<std::mutex> lock(m_pState->lock);
+            m_pState->step    = StepQueued;
+            m_pState->segment = segment;
+        }
+
+        std::shared_ptr<State> pState = m_pState;
+        m_pool.Submit([pState, segment]() { Create(*pState, segment); });
+    }
+
+    /// <summary>
+    /// Take the resource of a segment, created ahead if it was prefetched, or else now
+    /// </summary>
+    /// <param name="segment">Segment needed</param>
+    /// <param name="prefetched">Receives true if the resource had been created ahead</param>
+    /// <returns>Resource owned by the caller</returns>
+    T* Take(uint32_t segment, bool& prefetched)
+    {
+        State& state = *m_pState;
+        std::unique_ptr<T> pResource;
+        {
+            std::unique_lock<std::mutex> lock(state.lock);
+            state.created.wait(lock, [&]() { return StepCreating != state.step; });
+
+            if (StepReady == state.step && segment == state.segment)
+            {
+                state.step = StepIdle;
+                prefetched = true;
+                return state.pResource.release();
+            }
+
+            // Another segment, or still queued: the task finds nothing to do when it runs
+            pResource = std::move(state.pResource);
+            state.step = StepIdle;
+        }
+
+        if (pResource)
+        {
+            state.discard(pResource.release());
+        }
+
+        prefetched = false;
+        return state.create(segment);
+    }
+
+    /// <summary>
+    /// Discard the resource created ahead, waiting for it if it is being created
+    /// </summary>
+    void Cancel()
+    {
+        State& state = *m_pState;
+        std::unique_ptr<T> pResource;
+        {
+            std::unique_lock<std::mutex> lock(state.lock);
+            state.created.wait(lock, [&]() { return StepCreating != state.step; });
+            pResource = std::move(state.pResource);
+            state.step = StepIdle;
+        }
+
+        if (pResource)
+        {
+            state.discard(pResource.release());
+        }
+    }
+
+private:
+    enum Step
+    {
+        StepIdle,
+        StepQueued,
+        StepCreating,
+        StepReady,
+    };
+
+    // Shared with the task, which may run after the prefetch has been cancelled
+    struct State
+    {
+        Factory                     create;
+        Disposer                    discard;
+        std::mutex                  lock;
+        std::condition_variable     created;
+        Step                        step;
+        uint32_t                    segment;
+        std::unique_ptr<T>          pResource;
+    };
+
+    /// <summary>
+    /// Task creating a prefetched resource, unless it has been taken over or cancelled meanwhile
+    /// </summary>
+    static void Create(State& state, uint32_t segment)
+    {
+        {
+            std::lock_guard<std::mutex> lock(state.lock);
+            if (StepQueued != state.step || segment != state.segment)
+            {
+                return;
+            }
+            state.step = StepCreating;
+        }
+
+        T* pResource = state.create(segment);
+
+        std::lock_guard<std::mutex> lock(state.lock);
+        state.pResource.reset(pResource);
+        state.step = StepReady;
+        state.created.notify_all();
+    }
+
+private:
+    SegmentPrefetch(const SegmentPrefetch&);
+    SegmentPrefetch& operator=(const SegmentPrefetch&);
+
+private:
+    TaskPool&               m_pool;
+    std::shared_ptr<State>  m_pState;
+};
+
+/// <summary>
+/// Closes the files of finished segments on the task pool, one after the other in the order they were handed
+/// over, so a segment is only reported done once the segments before it are.
+/// </summary>
+class SegmentCloser
+{
+public:
+    typedef std::function<void()> CloseFunction;
+
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="pool">Pool the files are closed on</param>
+    explicit SegmentCloser(TaskPool& pool);
+
+    /// <summary>
+    /// Destructor. Waits for the files handed over
+    /// </summary>
+   ~SegmentCloser();
+
+    /// <summary>
+    /// Hand over a function closing the files of a segment
+    /// </summary>
+    void Close(const CloseFunction& close);
+
+    /// <summary>
+    /// Wait until every function handed over has run, running them on the calling thread if the pool has not started yet
+    /// </summary>
+    void Wait();
+
+private:
+    /// <summary>
+    /// Task running the functions handed over until there are none left
+    /// </summary>
+    void Drain();
+
+private:
+    SegmentCloser(const SegmentCloser&);
+    SegmentCloser& operator=(const SegmentCloser&);
+
+private:
+    TaskPool&                   m_pool;
+    std::mutex                  m_lock;
+    std::deque<CloseFunction>   m_queue;
+    bool                        m_draining;     // A task or Wait is running the queue
+    bool                        m_submitted;    // A task is queued on the pool and has not started yet
+    std::condition_variable     m_drained;
+};
+
+/// <summary>
+/// Writer of a segmented recording. Passes each frame to a writer of the frame's segment, made by a factory,
+/// and opens the writer of the next segment on the pool ahead of time, so switching segments only swaps
+/// writers. Writers of finished segments are closed on the pool as well.
+/// </summary>
+class SegmentedFrameWriter : public FrameWriter
+{
+public:
+    typedef std::function<FrameWriter*(uint32_t segment)> WriterFactory;
+
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="pSegmenter">Segmenter the recorder assigns the frames with</param>
+    /// <param name="createWriter">Creates the writer of a segment. Called on the pool</param>
+    SegmentedFrameWriter(const std::shared_ptr<RecordingSegmenter>& pSegmenter, const WriterFactory& createWriter);
+
+    /// <summary>
+    /// Destructor. Waits for the writers being closed on the pool
+    /// </summary>
+   ~SegmentedFrameWriter();
+
+    /// <summary>
+    /// Open the writer of the first segment and start opening the one of the second
+    /// </summary>
+    /// <returns>Indicates success or failure</returns>
+    virtual bool Open();
+
+    /// <summary>
+    /// Write a frame with the writer of its segment
+    /// </summary>
+    /// <param name="frame">Frame to write</param>
+    /// <returns>Indicates success or failure</returns>
+    virtual bool WriteFrame(const RecordFrame& frame);
+
+    /// <summary>
+    /// Get the number of frames the segment writers encode at the same time
+    /// </summary>
+    virtual unsigned GetEncodeConcurrency() const { return m_concurrency; }
+
+    /// <summary>
+    /// Encode a frame with the writer of its segment
+    /// </summary>
+    /// <param name="frame">Frame to encode</param>
+    /// <param name="encoded">Receives the payload</param>
+    /// <returns>Indicates success or failure</returns>
+    virtual bool EncodeFrame(const RecordFrame& frame, EncodedFrame& encoded);
+
+    /// <summary>
+    /// Store a frame with the writer of its segment
+    /// </summary>
+    /// <param name="frame">Frame to store</param>
+    /// <param name="encoded">Payload of the frame</param>
+    /// <returns>Indicates success or failure</returns>
+    virtual bool StoreFrame(const RecordFrame& frame, const EncodedFrame& encoded);
+
+    /// <summary>
+    /// Get file name extension of the segment writers
+    /// </summary>
+    virtual const char* GetFileExtension() const { return m_hasExtension ? m_extension.c_str() : nullptr; }
+
+    /// <summary>
+    /// Close the writers of the session and discard the one opened ahead
+    /// </summary>
+    virtual void Close();
+
+private:
+    struct Segment
+    {
+        uint32_t                        number;
+        std::unique_ptr<FrameWriter>    writer;
+    };
+
+    /// <summary>
+    /// Create and open the writer of a segment
+    /// </summary>
+    FrameWriter* CreateWriter(uint32_t segment);
+
+    /// <summary>
+    /// Get the writer of a segment, taken over from the pool if the frame is the first of the segment,
+    /// and start opening the writer of the segment after it
+    /// </summary>
+    FrameWriter* GetWriter(uint32_t segment);
+
+    /// <summary>
+    /// Move the writing on to the segment of a frame, closing the writers of the segments before it on the pool.
+    /// Called by the stage storing frames in order
+    /// </summary>
+    void Advance(uint32_t segment);
+
+    /// <summary>
+    /// Hand a writer over to be closed on the pool, after which its segment is reported done
+    /// </summary>
+    void Retire(Segment& segment);
+
+private:
+    std::shared_ptr<RecordingSegmenter> m_pSegmenter;
+    WriterFactory                       m_createWriter;
+    SegmentPrefetch<FrameWriter>        m_next;
+    uint32_t                            m_participant;
+    unsigned                            m_concurrency;
+    bool                                m_hasExtension;
+    std::string                         m_extension;
+
+    std::mutex                          m_lock;         // Guards the writers
+    std::deque<Segment>                 m_segments;     // Open writers, the first is the one storing
+    SegmentCloser                       m_closer;
+};
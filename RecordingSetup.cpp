@@ -0,0 +1,265 @@
+//------------------------------------------------------------------------------
+// <copyright file="RecordingSetup.cpp">
+//     Creation of the recorder writers for the selected output and formats.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "RecordingSetup.h"
+#include "FrameAssociator.h"
+#include "FramePath.h"
+#include "FrameWriters.h"
+#include "JpegCodec.h"
+#include "QoiCodec.h"
+#include "RecordingSegments.h"
+#include "RgbdContainer.h"
+#include "RvlCodec.h"
+#include "TemporalDepthCodec.h"
+
+#include <cstdio>
+#include <ctime>
+#include <map>
+#include <mutex>
+
+namespace
+{
+    /// <summary>
+    /// Container files of a segmented recording, segment_[n]\capture_[time]_[n].krgbd, each shared by
+    /// the writers of both streams. Whichever stream gets to a segment first creates its container
+    /// </summary>
+    class SegmentContainers
+    {
+    public:
+        SegmentContainers(const char* pBaseName, const std::shared_ptr<RecordingSegmenter>& pSegmenter)
+            : m_baseName(pBaseName)
+            , m_pSegmenter(pSegmenter)
+        {
+        }
+
+        std::shared_ptr<RgbdContainerWriter> Get(uint32_t segment)
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+
+            std::shared_ptr<RgbdContainerWriter>& pContainer = m_containers[segment];
+            if (!pContainer)
+            {
+                char filename[256];
+                snprintf(filename, sizeof(filename), "%s_%04u.krgbd", m_baseName.c_str(), segment);
+
+                // Reserved for as much as the last full segment took, so the file is not extended piece by piece
+                pContainer = std::make_shared<RgbdContainerWriter>(m_pSegmenter->MakeSegmentDirectory(segment) + FRAME_PATH_SEPARATOR + filename);
+                pContainer->SetPreallocation(m_pSegmenter->GetExpectedBytes());
+            }
+
+            return pContainer;
+        }
+
+    private:
+        std::string                                             m_baseName;
+        std::shared_ptr<RecordingSegmenter>                     m_pSegmenter;
+        std::mutex                                              m_lock;
+        std::map<uint32_t, std::shared_ptr<RgbdContainerWriter>> m_containers;
+    };
+}
+
+/// <summary>
+/// Constructor. The familiar rgb and depth folders of BMP and PNG files
+/// </summary>
+RecordingOptions::RecordingOptions()
+    : output(RecordingOutputImageFiles)
+    , depthFormat(RecordingDepthFormatPng)
+    , colorFormat(RecordingColorFormatBmp)
+    , jpegQuality(JpegColorEncoder::DefaultQuality)
+    , skipUnpaired(false)
+    , splitSeconds(0.0)
+    , splitBytes(0)
+{
+}
+
+/// <summary>
+/// Create the encoder of a depth format
+/// </summary>
+/// <param name="format">Depth format</param>
+/// <returns>New encoder, or nullptr if depth frames are not encoded by a FrameEncoder</returns>
+FrameEncoder* CreateDepthEncoder(RecordingDepthFormat format)
+{
+    switch (format)
+    {
+    case RecordingDepthFormatRvl:
+        return new RvlDepthEncoder();
+
+    case RecordingDepthFormatTemporal:
+        return new TemporalDepthEncoder();
+
+    default:
+        return nullptr;
+    }
+}
+
+/// <summary>
+/// Create the encoder of a color format
+/// </summary>
+/// <param name="format">Color format</param>
+/// <param name="jpegQuality">Quality of JPEG compression</param>
+/// <returns>New encoder, or nullptr if color frames are not encoded by a FrameEncoder</returns>
+FrameEncoder* CreateColorEncoder(RecordingColorFormat format, int jpegQuality)
+{
+    switch (format)
+    {
+    case RecordingColorFormatQoi:
+        return new QoiColorEncoder();
+
+    case RecordingColorFormatJpeg:
+        return new JpegColorEncoder(jpegQuality);
+
+    default:
+        return nullptr;
+    }
+}
+
+/// <summary>
+/// Create the writer of a stream storing one image file per frame
+/// </summary>
+/// <param name="stream">Stream the writer stores</param>
+/// <param name="colorFormat">Color format</param>
+/// <param name="depthFormat">Depth format</param>
+/// <param name="jpegQuality">Quality of JPEG compression</param>
+/// <param name="pDirectory">Directory to store in, nullptr for the current directory</param>
+/// <returns>New writer</returns>
+FrameWriter* CreateImageWriter(RecordStream stream, RecordingColorFormat colorFormat, RecordingDepthFormat depthFormat,
+                               int jpegQuality, const char* pDirectory)
+{
+    if (RecordStreamColor == stream)
+    {
+        if (RecordingColorFormatJpeg == colorFormat)
+        {
+            // Too slow for one thread at 1280x960, every frame is encoded on its own so a pool can share the work
+            return new ParallelEncodedFrameWriter(RecordStreamColor,
+                [jpegQuality]() { return new JpegColorEncoder(jpegQuality); }, TaskPool::DefaultWorkerCount(), pDirectory);
+        }
+
+        FrameEncoder* pColorEncoder = CreateColorEncoder(colorFormat, jpegQuality);
+        if (pColorEncoder)
+        {
+            return new EncodedFrameWriter(RecordStreamColor, pColorEncoder, pDirectory);
+        }
+
+        return new BitmapColorWriter(pDirectory);
+    }
+
+    FrameEncoder* pDepthEncoder = CreateDepthEncoder(depthFormat);
+    if (pDepthEncoder)
+    {
+        return new EncodedFrameWriter(RecordStreamDepth, pDepthEncoder, pDirectory);
+    }
+
+    return new PngDepthWriter(pDirectory);
+}
+
+/// <summary>
+/// Give a stopped recorder the segmenter, writers and associator of a recording. Containers are named
+/// after the current time, files go into the current directory
+/// </summary>
+/// <param name="recorder">Recorder to set up, must be stopped</param>
+/// <param name="options">Output, formats and segments of the recording</param>
+void SetUpRecorder(FrameRecorder& recorder, const RecordingOptions& options)
+{
+    // Copied, as the writers of later segments are created on the pool after the options may have changed
+    RecordingColorFormat colorFormat = options.colorFormat;
+    RecordingDepthFormat depthFormat = options.depthFormat;
+    int                  jpegQuality = options.jpegQuality;
+
+    std::shared_ptr<RecordingSegmenter> pSegmenter;
+    if (options.splitSeconds > 0.0 || options.splitBytes > 0)
+    {
+        pSegmenter = std::make_shared<RecordingSegmenter>(recorder.GetPool(), options.splitSeconds, options.splitBytes);
+    }
+    recorder.SetSegmenter(pSegmenter);
+
+    switch (options.output)
+    {
+    case RecordingOutputContainer:
+        {
+            // Name the container after the time the output was selected
+            char   baseName[64];
+            time_t now = time(nullptr);
+            tm     local;
+#ifdef _WIN32
+            localtime_s(&local, &now);
+#else
+            localtime_r(&now, &local);
+#endif
+            strftime(baseName, sizeof(baseName), "capture_%Y%m%d_%H%M%S", &local);
+
+            if (pSegmenter)
+            {
+                std::shared_ptr<SegmentContainers> pContainers = std::make_shared<SegmentContainers>(baseName, pSegmenter);
+                recorder.SetWriter(RecordStreamColor, new SegmentedFrameWriter(pSegmenter,
+                    [pContainers, colorFormat, jpegQuality](uint32_t segment)
+                    {
+                        return new ContainerFrameWriter(pContainers->Get(segment), CreateColorEncoder(colorFormat, jpegQuality));
+                    }));
+                recorder.SetWriter(RecordStreamDepth, new SegmentedFrameWriter(pSegmenter,
+                    [pContainers, depthFormat](uint32_t segment)
+                    {
+                        return new ContainerFrameWriter(pContainers->Get(segment), CreateDepthEncoder(depthFormat));
+                    }));
+            }
+            else
+            {
+                std::shared_ptr<RgbdContainerWriter> pContainer = std::make_shared<RgbdContainerWriter>(std::string(baseName) + ".krgbd");
+                recorder.SetWriter(RecordStreamColor, new ContainerFrameWriter(pContainer, CreateColorEncoder(colorFormat, jpegQuality)));
+                recorder.SetWriter(RecordStreamDepth, new ContainerFrameWriter(pContainer, CreateDepthEncoder(depthFormat)));
+            }
+        }
+        break;
+
+    default:
+        for (int i = 0; i < RecordStreamCount; i++)
+        {
+            RecordStream stream = (RecordStream)i;
+            if (pSegmenter)
+            {
+                // Each segment gets its own rgb and depth folders and lists in its directory
+                recorder.SetWriter(stream, new SegmentedFrameWriter(pSegmenter,
+                    [pSegmenter, stream, colorFormat, depthFormat, jpegQuality](uint32_t segment)
+                    {
+                        return CreateImageWriter(stream, colorFormat, depthFormat, jpegQuality,
+                                                 pSegmenter->MakeSegmentDirectory(segment).c_str());
+                    }));
+            }
+            else
+            {
+                recorder.SetWriter(stream, CreateImageWriter(stream, colorFormat, depthFormat, jpegQuality, nullptr));
+            }
+        }
+        break;
+    }
+
+    // Pairs are listed in associations.txt next to the frame lists
+    recorder.SetAssociator(new FrameAssociator("associations.txt", ASSOCIATION_DEFAULT_TOLERANCE, options.skipUnpaired));
+}
+
+/// <summary>
+/// Create the ring keeping the latest frames of a stream before recording starts
+/// </summary>
+/// <param name="stream">Stream of the frames</param>
+/// <param name="seconds">Length of the window, 0 to keep none</param>
+/// <param name="memoryBytes">Memory of the ring</param>
+/// <param name="compress">True to keep frames compressed with the lossless codecs</param>
+/// <returns>New ring, or nullptr if no frames are kept</returns>
+PreTriggerBuffer* CreatePreTriggerBuffer(RecordStream stream, double seconds, size_t memoryBytes, bool compress)
+{
+    if (seconds <= 0.0)
+    {
+        return nullptr;
+    }
+
+    // Only intra-frame lossless codecs, frames are decoded one at a time and oldest ones are pushed out
+    FrameEncoder* pEncoder = nullptr;
+    if (compress)
+    {
+        pEncoder = (RecordStreamColor == stream) ? (FrameEncoder*)new QoiColorEncoder() : (FrameEncoder*)new RvlDepthEncoder();
+    }
+
+    return new PreTriggerBuffer(stream, seconds, memoryBytes, pEncoder);
+}
@@ -0,0 +1,99 @@
+//------------------------------------------------------------------------------
+// <copyright file="RecordingSetup.h">
+//     Creation of the recorder writers for the selected output and formats.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "FrameCodec.h"
+#include "FrameRecorder.h"
+#include "PreTriggerBuffer.h"
+
+// Where the recorder stores color and depth frames
+enum RecordingOutput
+{
+    RecordingOutputImageFiles,      // One image file per frame plus rgb.txt and depth.txt
+    RecordingOutputContainer,       // All frames in a single container file
+};
+
+// How recorded depth frames are encoded
+enum RecordingDepthFormat
+{
+    RecordingDepthFormatPng,        // 16-bit PNG files, raw frames in a container file
+    RecordingDepthFormatRvl,        // Lossless RVL compression
+    RecordingDepthFormatTemporal,   // Lossless prediction from the previous frame with periodic keyframes
+};
+
+// How recorded color frames are encoded
+enum RecordingColorFormat
+{
+    RecordingColorFormatBmp,        // 32-bit BMP files, raw frames in a container file
+    RecordingColorFormatQoi,        // Lossless QOI compression
+    RecordingColorFormatJpeg,       // Lossy JPEG compression, encoded on a pool of threads
+};
+
+// Settings the writers of a recording are created from
+struct RecordingOptions
+{
+    RecordingOutput         output;
+    RecordingDepthFormat    depthFormat;
+    RecordingColorFormat    colorFormat;
+    int                     jpegQuality;
+    bool                    skipUnpaired;   // Frames without a partner in the other stream are not recorded
+    double                  splitSeconds;   // Time after which a new segment starts, 0 for no limit
+    uint64_t                splitBytes;     // Size after which a new segment starts, 0 for no limit
+
+    /// <summary>
+    /// Constructor. The familiar rgb and depth folders of BMP and PNG files
+    /// </summary>
+    RecordingOptions();
+};
+
+/// <summary>
+/// Create the encoder of a depth format
+/// </summary>
+/// <param name="format">Depth format</param>
+/// <returns>New encoder, or nullptr if depth frames are not encoded by a FrameEncoder</returns>
+FrameEncoder* CreateDepthEncoder(RecordingDepthFormat format);
+
+/// <summary>
+/// Create the encoder of a color format
+/// </summary>
+/// <param name="format">Color format</param>
+/// <param name="jpegQuality">Quality of JPEG compression</param>
+/// <returns>New encoder, or nullptr if color frames are not encoded by a FrameEncoder</returns>
+FrameEncoder* CreateColorEncoder(RecordingColorFormat format, int jpegQuality);
+
+/// <summary>
+/// Create the writer of a stream storing one image file per frame
+/// </summary>
+/// <param name="stream">Stream the writer stores</param>
+/// <param name="colorFormat">Color format</param>
+/// <param name="depthFormat">Depth format</param>
+/// <param name="jpegQuality">Quality of JPEG compression</param>
+/// <param name="pDirectory">Directory to store in, nullptr for the current directory</param>
+/// <returns>New writer</returns>
+FrameWriter* CreateImageWriter(RecordStream stream, RecordingColorFormat colorFormat, RecordingDepthFormat depthFormat,
+                               int jpegQuality, const char* pDirectory);
+
+/// <summary>
+/// Give a stopped recorder the segmenter, writers and associator of a recording. Containers are named
+/// after the current time, files go into the current directory
+/// </summary>
+/// <param name="recorder">Recorder to set up, must be stopped</param>
+/// <param name="options">Output, formats and segments of the recording</param>
+void SetUpRecorder(FrameRecorder& recorder, const RecordingOptions& options);
+
+/// <summary>
+/// Create the ring keeping the latest frames of a stream before recording starts
+/// </summary>
+/// <param name="stream">Stream of the frames</param>
+/// <param name="seconds">Length of the window, 0 to keep none</param>
+/// <param name="memoryBytes">Memory of the ring</param>
+/// <param name="compress">True to keep frames compressed with the lossless codecs</param>
+/// <returns>New ring, or nullptr if no frames are kept</returns>
+PreTriggerBuffer* CreatePreTriggerBuffer(RecordStream stream, double seconds, size_t memoryBytes, bool compress);
@@ -0,0 +1,203 @@
+//------------------------------------------------------------------------------
+// <copyright file="ReplaySensorSource.cpp">
+//     Stand-in sensor replaying a recorded session.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "ReplaySensorSource.h"
+
+#include <algorithm>
+#include <cmath>
+
+/// <summary>
+/// Constructor
+/// </summary>
+ReplaySensorSource::ReplaySensorSource()
+    : m_firstTimestamp(0.0)
+    , m_damagedFrames(0)
+{
+    for (Cursor& cursor : m_cursors)
+    {
+        cursor.next           = 0;
+        cursor.firstDelivered = 0;
+        cursor.playerIndex    = true;
+        cursor.width          = 0;
+        cursor.height         = 0;
+    }
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+ReplaySensorSource::~ReplaySensorSource()
+{
+    StopProducing();
+}
+
+/// <summary>
+/// Open the recording to replay. Before any stream is opened
+/// </summary>
+/// <param name="path">Path of a container file or of a session folder</param>
+/// <returns>False if the recording cannot be read or holds no frames</returns>
+bool ReplaySensorSource::Open(const std::string& path)
+{
+    if (!m_reader.Open(path))
+    {
+        return false;
+    }
+
+    // Sensor time starts with the first frame of either stream, so both keep their offset to each other
+    bool found = false;
+    for (int stream = 0; stream < RecordStreamCount; stream++)
+    {
+        if (m_reader.GetFrameCount((RecordStream)stream) > 0)
+        {
+            double timestamp = m_reader.GetTimestamp((RecordStream)stream, 0);
+            m_firstTimestamp = found ? (std::min)(m_firstTimestamp, timestamp) : timestamp;
+            found = true;
+        }
+    }
+
+    return found;
+}
+
+/// <summary>
+/// Position a stream at its first frame at or after a sensor time. The frames keep their recorded size
+/// </summary>
+bool ReplaySensorSource::OpenFrames(SensorStream stream, SensorImageType type, uint32_t& width, uint32_t& height, int64_t sensorTime)
+{
+    if (SensorStreamSkeleton == stream)
+    {
+        // Nothing to replay, the stream ends with its first frame
+        return true;
+    }
+
+    if (SensorStreamColor == stream && SensorImageColor != type)
+    {
+        return false;
+    }
+
+    RecordStream recorded = (RecordStream)stream;
+    size_t       count    = m_reader.GetFrameCount(recorded);
+    FrameView    view;
+    if (0 == count || !m_reader.GetFrame(recorded, 0, view) || 0 == view.width || 0 == view.height)
+    {
+        return false;
+    }
+
+    // First frame at or after the sensor time
+    double timestamp = m_firstTimestamp + sensorTime / 1000.0;
+    size_t index     = 0;
+    if (sensorTime > 0 && m_reader.FindByTimestamp(recorded, timestamp, index) && m_reader.GetTimestamp(recorded, index) < timestamp - 1e-6)
+    {
+        index++;
+    }
+
+    // Frames predicted from earlier ones are decoded from their keyframe on
+    size_t keyframe = index;
+    if (index < count && !m_reader.FindKeyframe(recorded, index, keyframe))
+    {
+        keyframe = index;
+    }
+
+    Cursor& cursor = m_cursors[stream];
+    cursor.pIterator.reset(new RecordingIterator(m_reader, recorded));
+    cursor.pIterator->Seek(keyframe);
+    cursor.next           = keyframe;
+    cursor.firstDelivered = index;
+    cursor.playerIndex    = SensorImageDepth != type;
+    cursor.width          = view.width;
+    cursor.height         = view.height;
+
+    width  = view.width;
+    height = view.height;
+    return true;
+}
+
+/// <summary>
+/// Make the next frame of an open stream from the recording
+/// </summary>
+bool ReplaySensorSource::ProduceFrame(SensorStream stream, StandInFrame& frame)
+{
+    if (SensorStreamSkeleton == stream)
+    {
+        return false;
+    }
+
+    Cursor&           cursor = m_cursors[stream];
+    size_t            count  = m_reader.GetFrameCount((RecordStream)stream);
+    RecordPixelFormat format = SensorStreamColor == stream ? RecordPixelFormatBgra32 : RecordPixelFormatDepthPixel32;
+
+    while (cursor.next < count)
+    {
+        size_t    index = cursor.next++;
+        FrameView view;
+        if (!cursor.pIterator->Next(view) || !Decode(cursor, view))
+        {
+            m_damagedFrames++;
+            continue;
+        }
+
+        if (index < cursor.firstDelivered)
+        {
+            continue;
+        }
+
+        const RecordFrame& decoded = cursor.decoded;
+        if (decoded.format != format || decoded.width != cursor.width || decoded.height != cursor.height ||
+            decoded.data.size() < (size_t)decoded.stride * decoded.height)
+        {
+            // Recorded with another resolution or layout, a sensor would not deliver it on this stream
+            m_damagedFrames++;
+            continue;
+        }
+
+        frame.pitch       = decoded.stride;
+        frame.frameNumber = view.frameNumber;
+        frame.sensorTime  = (int64_t)std::floor((view.timestamp - m_firstTimestamp) * 1000.0 + 0.5);
+        frame.bits.assign(decoded.data.data(), decoded.data.data() + (size_t)decoded.stride * decoded.height);
+
+        if (!cursor.playerIndex)
+        {
+            // Depth alone, as a sensor without skeleton tracking delivers it
+            for (uint32_t y = 0; y < decoded.height; y++)
+            {
+                uint16_t* pRow = reinterpret_cast<uint16_t*>(frame.bits.data() + (size_t)y * frame.pitch);
+                for (uint32_t x = 0; x < decoded.width; x++)
+                {
+                    pRow[2 * x] = 0;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+/// <summary>
+/// Decode the payload of a recorded frame
+/// </summary>
+bool ReplaySensorSource::Decode(Cursor& cursor, const FrameView& view)
+{
+    RecordFrame& frame = cursor.decoded;
+    frame.stream      = view.stream;
+    frame.format      = view.format;
+    frame.width       = view.width;
+    frame.height      = view.height;
+    frame.stride      = view.stride;
+    frame.frameNumber = view.frameNumber;
+    frame.timestamp   = view.timestamp;
+
+    switch (view.codec)
+    {
+    case RecordCodecPng:
+    case RecordCodecJpeg:
+        // Image files are decoded by the image library of the caller, if any
+        return m_decodeImage && m_decodeImage(view.codec, view.pData, view.size, frame);
+
+    default:
+        return cursor.decoder.Decode(view.codec, view.pData, view.size, frame);
+    }
+}
@@ -0,0 +1,90 @@
+//------------------------------------------------------------------------------
+// <copyright file="ReplaySensorSource.h">
+//     Stand-in sensor replaying a recorded session.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "FrameCodec.h"
+#include "RecordingReader.h"
+#include "StandInSensorSource.h"
+
+/// <summary>
+/// Replays the color and depth frames of a container file or a session folder as a sensor would deliver
+/// them, at the pace they were recorded at, a multiple of it, or as fast as the streams take them. The
+/// sensor times of the frames are their recorded timestamps, counted from the first frame of the session,
+/// and the frame numbers are the recorded ones, so a replay delivers the same frames in the same order
+/// every time. Streams open with the size of the recorded frames. Depth frames keep the player index they
+/// were recorded with, as if skeletons were tracked, but recordings hold no skeletons, so the skeleton stream
+/// opens and ends right away. Recordings hold no color other than BGRA, no other color image type opens.
+/// </summary>
+class ReplaySensorSource : public StandInSensorSource
+{
+public:
+    // Decodes the image files of a session folder FrameDecoder does not handle, PNG and JPEG
+    typedef std::function<bool(RecordCodec codec, const uint8_t* pData, size_t size, RecordFrame& frame)> ImageDecoder;
+
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    ReplaySensorSource();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    virtual ~ReplaySensorSource();
+
+public:
+    /// <summary>
+    /// Open the recording to replay. Before any stream is opened
+    /// </summary>
+    /// <param name="path">Path of a container file or of a session folder</param>
+    /// <returns>False if the recording cannot be read or holds no frames</returns>
+    bool Open(const std::string& path);
+
+    /// <summary>
+    /// Set the decoder of image files with codecs FrameDecoder does not handle. Before any stream is opened
+    /// </summary>
+    void SetImageDecoder(const ImageDecoder& decode) { m_decodeImage = decode; }
+
+    /// <summary>
+    /// Get the number of recorded frames skipped because they could not be read or decoded
+    /// </summary>
+    uint64_t GetDamagedFrames() const { return m_damagedFrames; }
+
+protected:
+    virtual bool OpenFrames(SensorStream stream, SensorImageType type, uint32_t& width, uint32_t& height, int64_t sensorTime);
+    virtual bool ProduceFrame(SensorStream stream, StandInFrame& frame);
+
+private:
+    // Position of a stream in the recording
+    struct Cursor
+    {
+        std::unique_ptr<RecordingIterator>  pIterator;
+        size_t                  next;               // Frame the iterator returns next
+        size_t                  firstDelivered;     // Frames before it are only decoded as references of later ones
+        bool                    playerIndex;        // Keep the recorded player index
+        uint32_t                width;
+        uint32_t                height;
+        FrameDecoder            decoder;
+        RecordFrame             decoded;
+    };
+
+    /// <summary>
+    /// Decode the payload of a recorded frame
+    /// </summary>
+    bool Decode(Cursor& cursor, const FrameView& view);
+
+private:
+    RecordingReader         m_reader;
+    double                  m_firstTimestamp;   // Recorded timestamp of sensor time 0
+    ImageDecoder            m_decodeImage;
+    Cursor                  m_cursors[RecordStreamCount];
+    std::atomic<uint64_t>   m_damagedFrames;
+};
@@ -0,0 +1,879 @@
+//------------------------------------------------------------------------------
+// <copyright file="RgbdContainer.cpp">
+//     Append-only single-file container for recorded color and depth frames.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "RgbdContainer.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#ifdef __linux__
+#include <fcntl.h>
+#endif
+#endif
+
+/// <summary>
+/// Compute CRC-32 (IEEE 802.3) of a block of memory
+/// </summary>
+/// <param name="pData">The pointer to data</param>
+/// <param name="size">Size of data in bytes</param>
+/// <param name="crc">CRC of the preceding data when computing incrementally</param>
+/// <returns>CRC of data</returns>
+uint32_t RgbdCrc32(const void* pData, size_t size, uint32_t crc)
+{
+    struct Crc32Table
+    {
+        uint32_t entries[256];
+
+        Crc32Table()
+        {
+            for (uint32_t i = 0; i < 256; i++)
+            {
+                uint32_t value = i;
+                for (int bit = 0; bit < 8; bit++)
+                {
+                    value = (value & 1) ? (0xEDB88320 ^ (value >> 1)) : (value >> 1);
+                }
+                entries[i] = value;
+            }
+        }
+    };
+    static const Crc32Table table;
+
+    const uint8_t* pByte = static_cast<const uint8_t*>(pData);
+
+    crc = ~crc;
+    while (size--)
+    {
+        crc = table.entries[(crc ^ *pByte++) & 0xFF] ^ (crc >> 8);
+    }
+
+    return ~crc;
+}
+
+/// <summary>
+/// Compute the checksum stored in a chunk header
+/// </summary>
+/// <param name="header">Chunk header</param>
+/// <param name="pPayload">The pointer to payload</param>
+/// <param name="version">Version of the file the chunk belongs to</param>
+/// <returns>CRC of the payload, preceded by the header fields from version 2</returns>
+uint32_t RgbdChunkCrc(const RgbdChunkHeader& header, const void* pPayload, uint32_t version)
+{
+    // A header damaged in a way that keeps the payload size is caught too, e.g. a wrong timestamp
+    uint32_t crc = version >= 2 ? RgbdCrc32(&header, offsetof(RgbdChunkHeader, payloadCrc)) : 0;
+    return RgbdCrc32(pPayload, header.payloadSize, crc);
+}
+
+/// <summary>
+/// Seek to an absolute 64-bit file offset
+/// </summary>
+bool RgbdSeek(FILE* pFile, uint64_t offset)
+{
+#ifdef _WIN32
+    return 0 == _fseeki64(pFile, (__int64)offset, SEEK_SET);
+#else
+    return 0 == fseeko(pFile, (off_t)offset, SEEK_SET);
+#endif
+}
+
+/// <summary>
+/// Get the current 64-bit file offset
+/// </summary>
+uint64_t RgbdTell(FILE* pFile)
+{
+#ifdef _WIN32
+    return (uint64_t)_ftelli64(pFile);
+#else
+    return (uint64_t)ftello(pFile);
+#endif
+}
+
+/// <summary>
+/// Reserve disk space for a file without changing its size, so it is not extended piece by piece while it is written
+/// </summary>
+/// <param name="pFile">Open file</param>
+/// <param name="bytes">Bytes to reserve</param>
+/// <returns>False if the file system does not support it</returns>
+bool RgbdReserve(FILE* pFile, uint64_t bytes)
+{
+    // The end of file stays where it is, so a file cut short still ends with its last chunk
+#ifdef _WIN32
+    FILE_ALLOCATION_INFO allocation;
+    allocation.AllocationSize.QuadPart = (LONGLONG)bytes;
+    HANDLE hFile = (HANDLE)_get_osfhandle(_fileno(pFile));
+    return INVALID_HANDLE_VALUE != hFile &&
+        FALSE != SetFileInformationByHandle(hFile, FileAllocationInfo, &allocation, sizeof(allocation));
+#elif defined(__linux__)
+    return 0 == fallocate(fileno(pFile), FALLOC_FL_KEEP_SIZE, 0, (off_t)bytes);
+#else
+    (void)pFile;
+    (void)bytes;
+    return false;
+#endif
+}
+
+/// <summary>
+/// Write the buffered data of a file through to the disk
+/// </summary>
+/// <param name="pFile">Open file</param>
+/// <returns>Indicates success or failure</returns>
+bool RgbdSync(FILE* pFile)
+{
+    if (0 != fflush(pFile))
+    {
+        return false;
+    }
+
+#ifdef _WIN32
+    return 0 == _commit(_fileno(pFile));
+#else
+    return 0 == fsync(fileno(pFile));
+#endif
+}
+
+/// <summary>
+/// Set the size of a file, cutting off what follows
+/// </summary>
+/// <param name="pFile">File open for writing</param>
+/// <param name="size">New size in bytes</param>
+/// <returns>Indicates success or failure</returns>
+bool RgbdTruncate(FILE* pFile, uint64_t size)
+{
+    if (0 != fflush(pFile))
+    {
+        return false;
+    }
+
+#ifdef _WIN32
+    return 0 == _chsize_s(_fileno(pFile), (__int64)size);
+#else
+    return 0 == ftruncate(fileno(pFile), (off_t)size);
+#endif
+}
+
+// -----------------------------------------------------------------------------
+//
+// RgbdContainerWriter
+//
+// -----------------------------------------------------------------------------
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="path">Path of the container file to create</param>
+RgbdContainerWriter::RgbdContainerWriter(const std::string& path)
+    : m_path(path)
+    , m_pFile(nullptr)
+    , m_openCount(0)
+    , m_offset(0)
+    , m_preallocateBytes(0)
+    , m_discardIfEmpty(false)
+    , m_append(false)
+    , m_failed(false)
+    , m_checkpointSeconds(RGBD_CHECKPOINT_INTERVAL)
+    , m_checkpointOffset(0)
+    , m_checkpointedCount(0)
+    , m_syncing(false)
+{
+}
+
+/// <summary>
+/// Destructor. Finalizes the file if it is still open
+/// </summary>
+RgbdContainerWriter::~RgbdContainerWriter()
+{
+    if (m_openCount > 0)
+    {
+        m_openCount = 1;
+        Close();
+    }
+}
+
+/// <summary>
+/// Create the file on first call. Every call must be paired with Close
+/// </summary>
+/// <returns>Indicates success or failure</returns>
+bool RgbdContainerWriter::Open()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    if (m_openCount > 0)
+    {
+        ++m_openCount;
+        return true;
+    }
+
+    if (m_append)
+    {
+        FILE* pExisting = fopen(m_path.c_str(), "rb");
+        if (pExisting)
+        {
+            fclose(pExisting);
+            return OpenExisting();
+        }
+    }
+
+    m_pFile = fopen(m_path.c_str(), "wb");
+    if (!m_pFile)
+    {
+        return false;
+    }
+
+    RgbdFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RGBD_FILE_MAGIC, sizeof(header.magic));
+    header.version     = RGBD_FILE_VERSION;
+    header.headerSize  = sizeof(RgbdFileHeader);
+    header.createdTime = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    if (1 != fwrite(&header, sizeof(header), 1, m_pFile))
+    {
+        fclose(m_pFile);
+        m_pFile = nullptr;
+        return false;
+    }
+
+    if (m_preallocateBytes)
+    {
+        // Only a hint, the file grows as usual where space can not be reserved
+        fflush(m_pFile);
+        RgbdReserve(m_pFile, m_preallocateBytes);
+    }
+
+    m_offset            = sizeof(header);
+    m_openCount         = 1;
+    m_discardIfEmpty    = false;
+    m_failed            = false;
+    m_lastCheckpoint    = std::chrono::steady_clock::now();
+    m_checkpointOffset  = 0;
+    m_checkpointedCount = 0;
+    m_index.clear();
+
+    return true;
+}
+
+/// <summary>
+/// Reopen an existing file to append to it, dropping its footer. Called with the lock held
+/// </summary>
+/// <returns>False if the file has no valid footer or an older version</returns>
+bool RgbdContainerWriter::OpenExisting()
+{
+    RgbdContainerReader reader;
+    if (!reader.Open(m_path, false) || !reader.HasIndexFooter() || RGBD_FILE_VERSION != reader.GetVersion())
+    {
+        return false;
+    }
+
+    uint64_t indexOffset = reader.GetFileSize() - sizeof(RgbdFileTrailer) - reader.GetFrameCount() * sizeof(RgbdIndexEntry);
+    m_index = reader.GetIndex();
+    reader.Close();
+
+    // Cut off the footer, until the next one is written the file is recovered like one cut short
+    m_pFile = fopen(m_path.c_str(), "r+b");
+    if (!m_pFile || !RgbdTruncate(m_pFile, indexOffset) || !RgbdSeek(m_pFile, indexOffset))
+    {
+        if (m_pFile)
+        {
+            fclose(m_pFile);
+            m_pFile = nullptr;
+        }
+        m_index.clear();
+        return false;
+    }
+
+    // The first checkpoint lists all frames, starting a new chain
+    m_offset            = indexOffset;
+    m_openCount         = 1;
+    m_discardIfEmpty    = false;
+    m_failed            = false;
+    m_lastCheckpoint    = std::chrono::steady_clock::now();
+    m_checkpointOffset  = 0;
+    m_checkpointedCount = 0;
+
+    return true;
+}
+
+/// <summary>
+/// Write the index footer and close the file when the last user closes it
+/// </summary>
+void RgbdContainerWriter::Close()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    if (m_openCount <= 0 || --m_openCount > 0)
+    {
+        return;
+    }
+
+    if (m_failed)
+    {
+        // Index and footer would point at the wrong bytes, recovery lists the chunks from the checkpoints or a scan
+        fclose(m_pFile);
+        m_pFile = nullptr;
+        m_index.clear();
+        return;
+    }
+
+    RgbdFileTrailer trailer;
+    memset(&trailer, 0, sizeof(trailer));
+    trailer.magic       = RGBD_INDEX_MAGIC;
+    trailer.entryCount  = (uint32_t)m_index.size();
+    trailer.indexOffset = m_offset;
+    trailer.indexCrc    = RgbdCrc32(m_index.data(), m_index.size() * sizeof(RgbdIndexEntry));
+    memcpy(trailer.endMagic, RGBD_FILE_END_MAGIC, sizeof(trailer.endMagic));
+
+    if (!m_index.empty())
+    {
+        fwrite(m_index.data(), sizeof(RgbdIndexEntry), m_index.size(), m_pFile);
+    }
+    fwrite(&trailer, sizeof(trailer), 1, m_pFile);
+
+    if (m_checkpointSeconds > 0)
+    {
+        // The footer supersedes the checkpoints only once it is on disk
+        RgbdSync(m_pFile);
+    }
+
+    fclose(m_pFile);
+    m_pFile = nullptr;
+
+    if (m_discardIfEmpty && m_index.empty())
+    {
+        remove(m_path.c_str());
+    }
+    m_index.clear();
+}
+
+/// <summary>
+/// Close like Close, and delete the file if the last user closes it without a frame having been appended,
+/// e.g. a segment prepared ahead which the recording did not reach
+/// </summary>
+void RgbdContainerWriter::Discard()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_discardIfEmpty = true;
+    }
+
+    Close();
+}
+
+/// <summary>
+/// Append a frame chunk
+/// </summary>
+/// <param name="frame">Frame description</param>
+/// <param name="codec">Encoding of the payload</param>
+/// <param name="pPayload">The pointer to payload</param>
+/// <param name="payloadSize">Size of payload in bytes</param>
+/// <returns>Indicates success or failure</returns>
+bool RgbdContainerWriter::AppendFrame(const RecordFrame& frame, RecordCodec codec, const uint8_t* pPayload, uint32_t payloadSize)
+{
+    RgbdChunkHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic       = RGBD_CHUNK_MAGIC;
+    header.stream      = (uint8_t)frame.stream;
+    header.format      = (uint8_t)frame.format;
+    header.codec       = (uint8_t)codec;
+    header.width       = frame.width;
+    header.height      = frame.height;
+    header.stride      = frame.stride;
+    header.frameNumber = frame.frameNumber;
+    header.timestamp   = frame.timestamp;
+    header.payloadSize = payloadSize;
+
+    // Checksum outside the lock, the other stream may be appending meanwhile
+    header.payloadCrc  = RgbdChunkCrc(header, pPayload, RGBD_FILE_VERSION);
+
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    if (!m_pFile || m_failed)
+    {
+        return false;
+    }
+
+    if (1 != fwrite(&header, sizeof(header), 1, m_pFile) ||
+        (payloadSize && 1 != fwrite(pPayload, payloadSize, 1, m_pFile)))
+    {
+        DropPartialWrite();
+        return false;
+    }
+
+    RgbdIndexEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.offset      = m_offset;
+    entry.timestamp   = header.timestamp;
+    entry.frameNumber = header.frameNumber;
+    entry.payloadSize = header.payloadSize;
+    entry.width       = header.width;
+    entry.height      = header.height;
+    entry.stream      = header.stream;
+    entry.format      = header.format;
+    entry.codec       = header.codec;
+    m_index.push_back(entry);
+
+    m_offset += sizeof(header) + payloadSize;
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (m_checkpointSeconds <= 0 || m_syncing ||
+        std::chrono::duration<double>(now - m_lastCheckpoint).count() < m_checkpointSeconds)
+    {
+        return true;
+    }
+
+    // Flush outside the lock, the other stream keeps appending meanwhile. The file stays open,
+    // as the caller has not closed it yet
+    m_syncing      = true;
+    size_t durable = m_index.size();
+    FILE*  pFile   = m_pFile;
+    lock.unlock();
+
+    bool synced = RgbdSync(pFile);
+
+    lock.lock();
+    if (synced)
+    {
+        WriteCheckpoint(durable);
+    }
+    m_lastCheckpoint = now;
+    m_syncing        = false;
+
+    return true;
+}
+
+/// <summary>
+/// Append a checkpoint listing the frames which are on disk. Called with the lock held
+/// </summary>
+/// <param name="durableCount">Number of frames written through to the disk</param>
+void RgbdContainerWriter::WriteCheckpoint(size_t durableCount)
+{
+    if (durableCount <= m_checkpointedCount)
+    {
+        return;
+    }
+
+    const RgbdIndexEntry* pEntries = m_index.data() + m_checkpointedCount;
+
+    RgbdCheckpoint checkpoint;
+    memset(&checkpoint, 0, sizeof(checkpoint));
+    checkpoint.magic          = RGBD_CHECKPOINT_MAGIC;
+    checkpoint.entryCount     = (uint32_t)(durableCount - m_checkpointedCount);
+    checkpoint.previousOffset = m_checkpointOffset;
+    checkpoint.frameCount     = durableCount;
+    checkpoint.entriesCrc     = RgbdCrc32(pEntries, checkpoint.entryCount * sizeof(RgbdIndexEntry));
+    checkpoint.headerCrc      = RgbdCrc32(&checkpoint, offsetof(RgbdCheckpoint, headerCrc));
+
+    if (1 != fwrite(&checkpoint, sizeof(checkpoint), 1, m_pFile) ||
+        checkpoint.entryCount != fwrite(pEntries, sizeof(RgbdIndexEntry), checkpoint.entryCount, m_pFile))
+    {
+        // The frames are listed by the next checkpoint
+        DropPartialWrite();
+        return;
+    }
+
+    // The checkpoint itself reaches the disk with the next one, until then recovery uses the previous
+    m_checkpointOffset   = m_offset;
+    m_checkpointedCount  = durableCount;
+    m_offset            += sizeof(checkpoint) + checkpoint.entryCount * sizeof(RgbdIndexEntry);
+}
+
+/// <summary>
+/// Cut off what a failed write left after the last complete chunk and continue from there. If that
+/// fails too, the file takes no more frames. Called with the lock held
+/// </summary>
+void RgbdContainerWriter::DropPartialWrite()
+{
+    // Bytes of the failed write still buffered are flushed and cut off with the rest
+    clearerr(m_pFile);
+    if (!RgbdTruncate(m_pFile, m_offset) || !RgbdSeek(m_pFile, m_offset))
+    {
+        m_failed = true;
+    }
+}
+
+// -----------------------------------------------------------------------------
+//
+// ContainerFrameWriter
+//
+// -----------------------------------------------------------------------------
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="pContainer">Container shared with the writers of the other streams</param>
+/// <param name="pEncoder">Encoder for the frames, owned by the writer. Frames are stored raw if null</param>
+ContainerFrameWriter::ContainerFrameWriter(const std::shared_ptr<RgbdContainerWriter>& pContainer, FrameEncoder* pEncoder)
+    : m_pContainer(pContainer)
+    , m_pEncoder(pEncoder)
+    , m_stream(RecordStreamColor)
+    , m_storeFailed(false)
+{
+}
+
+/// <summary>
+/// Open the shared container
+/// </summary>
+/// <returns>Indicates success or failure</returns>
+bool ContainerFrameWriter::Open()
+{
+    if (m_pEncoder)
+    {
+        m_pEncoder->Reset();
+    }
+    m_storeFailed = false;
+
+    return m_pContainer->Open();
+}
+
+/// <summary>
+/// Append a frame to the shared container
+/// </summary>
+/// <param name="frame">Frame to write</param>
+/// <returns>Indicates success or failure</returns>
+bool ContainerFrameWriter::WriteFrame(const RecordFrame& frame)
+{
+    m_stream = frame.stream;
+
+    if (!m_pEncoder)
+    {
+        return m_pContainer->AppendFrame(frame, RecordCodecRaw, frame.data.data(), (uint32_t)frame.data.size());
+    }
+
+    return EncodeFrame(frame, m_encoded) && StoreFrame(frame, m_encoded);
+}
+
+/// <summary>
+/// Encode a frame ahead of StoreFrame
+/// </summary>
+/// <param name="frame">Frame to encode</param>
+/// <param name="encoded">Receives the payload</param>
+/// <returns>Indicates success or failure</returns>
+bool ContainerFrameWriter::EncodeFrame(const RecordFrame& frame, EncodedFrame& encoded)
+{
+    bool result = m_pEncoder->Encode(frame, encoded.payload);
+    encoded.encodeSeconds = m_pEncoder->GetStats().lastEncodeSeconds;
+    encoded.keyframe      = m_pEncoder->GetStats().lastKeyframe;
+    return result;
+}
+
+/// <summary>
+/// Append an encoded frame to the shared container
+/// </summary>
+/// <param name="frame">Frame to store</param>
+/// <param name="encoded">Payload of the frame</param>
+/// <returns>Indicates success or failure</returns>
+bool ContainerFrameWriter::StoreFrame(const RecordFrame& frame, const EncodedFrame& encoded)
+{
+    m_stream = frame.stream;
+
+    // Frames predicted from one which was lost would not decode. They are turned away until the
+    // keyframe the encoder was asked for, which may be a frame or two behind those encoded already
+    if (m_storeFailed && !encoded.keyframe)
+    {
+        return false;
+    }
+
+    m_storeFailed = !m_pContainer->AppendFrame(frame, m_pEncoder->GetCodec(), encoded.payload.data(), (uint32_t)encoded.payload.size());
+    if (m_storeFailed)
+    {
+        m_pEncoder->RequestKeyframe();
+        return false;
+    }
+    return true;
+}
+
+/// <summary>
+/// Log the compression achieved in the session and release the shared container
+/// </summary>
+void ContainerFrameWriter::Close()
+{
+    if (m_pEncoder)
+    {
+        LogEncoderSession(m_stream, *m_pEncoder);
+    }
+
+    m_pContainer->Close();
+}
+
+// -----------------------------------------------------------------------------
+//
+// RgbdContainerReader
+//
+// -----------------------------------------------------------------------------
+
+/// <summary>
+/// Constructor
+/// </summary>
+RgbdContainerReader::RgbdContainerReader()
+    : m_pFile(nullptr)
+    , m_fileSize(0)
+    , m_version(0)
+    , m_headerSize(0)
+    , m_hasFooter(false)
+{
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+RgbdContainerReader::~RgbdContainerReader()
+{
+    Close();
+}
+
+/// <summary>
+/// Open a container file and load its index. If the index footer is missing or damaged,
+/// the index is rebuilt by scanning the chunks
+/// </summary>
+/// <param name="path">Path of container file</param>
+/// <param name="scanIfDamaged">False to leave the index empty if the footer is missing or damaged</param>
+/// <returns>Indicates success or failure</returns>
+bool RgbdContainerReader::Open(const std::string& path, bool scanIfDamaged)
+{
+    Close();
+
+    m_pFile = fopen(path.c_str(), "rb");
+    if (!m_pFile)
+    {
+        return false;
+    }
+
+    RgbdFileHeader header;
+    if (1 != fread(&header, sizeof(header), 1, m_pFile) ||
+        0 != memcmp(header.magic, RGBD_FILE_MAGIC, sizeof(header.magic)) ||
+        header.version < 1 || header.version > RGBD_FILE_VERSION ||
+        header.headerSize < sizeof(header))
+    {
+        Close();
+        return false;
+    }
+
+#ifdef _WIN32
+    _fseeki64(m_pFile, 0, SEEK_END);
+#else
+    fseeko(m_pFile, 0, SEEK_END);
+#endif
+    m_fileSize   = RgbdTell(m_pFile);
+    m_version    = header.version;
+    m_headerSize = header.headerSize;
+
+    m_hasFooter = LoadFooter();
+    if (!m_hasFooter)
+    {
+        m_index.clear();
+        if (scanIfDamaged)
+        {
+            ScanChunks(m_pFile, header.headerSize, m_fileSize, m_index);
+        }
+    }
+
+    return true;
+}
+
+/// <summary>
+/// Close the file
+/// </summary>
+void RgbdContainerReader::Close()
+{
+    if (m_pFile)
+    {
+        fclose(m_pFile);
+        m_pFile = nullptr;
+    }
+
+    m_index.clear();
+    m_fileSize   = 0;
+    m_version    = 0;
+    m_headerSize = 0;
+    m_hasFooter  = false;
+}
+
+/// <summary>
+/// Load the index footer
+/// </summary>
+/// <returns>True if a valid footer was found</returns>
+bool RgbdContainerReader::LoadFooter()
+{
+    if (m_fileSize < sizeof(RgbdFileHeader) + sizeof(RgbdFileTrailer))
+    {
+        return false;
+    }
+
+    RgbdFileTrailer trailer;
+    if (!RgbdSeek(m_pFile, m_fileSize - sizeof(trailer)) ||
+        1 != fread(&trailer, sizeof(trailer), 1, m_pFile))
+    {
+        return false;
+    }
+
+    if (RGBD_INDEX_MAGIC != trailer.magic ||
+        0 != memcmp(trailer.endMagic, RGBD_FILE_END_MAGIC, sizeof(trailer.endMagic)) ||
+        trailer.indexOffset + (uint64_t)trailer.entryCount * sizeof(RgbdIndexEntry) + sizeof(trailer) != m_fileSize)
+    {
+        return false;
+    }
+
+    m_index.resize(trailer.entryCount);
+    if (!RgbdSeek(m_pFile, trailer.indexOffset) ||
+        (trailer.entryCount && trailer.entryCount != fread(m_index.data(), sizeof(RgbdIndexEntry), trailer.entryCount, m_pFile)))
+    {
+        return false;
+    }
+
+    if (trailer.indexCrc != RgbdCrc32(m_index.data(), m_index.size() * sizeof(RgbdIndexEntry)))
+    {
+        return false;
+    }
+
+    // Every chunk must lie between the file header and the index
+    for (const RgbdIndexEntry& entry : m_index)
+    {
+        if (entry.offset < m_headerSize ||
+            entry.offset + sizeof(RgbdChunkHeader) + entry.payloadSize > trailer.indexOffset)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/// <summary>
+/// Scan chunks sequentially from a file offset and collect their index entries, skipping checkpoints.
+/// Stops at the first chunk which is truncated or whose header is invalid.
+/// </summary>
+/// <param name="pFile">Open container file</param>
+/// <param name="start">Offset of the first chunk</param>
+/// <param name="end">Offset to stop at</param>
+/// <param name="entries">Receives the index entries</param>
+/// <returns>Offset just past the last valid chunk</returns>
+uint64_t RgbdContainerReader::ScanChunks(FILE* pFile, uint64_t start, uint64_t end, std::vector<RgbdIndexEntry>& entries)
+{
+    uint64_t offset = start;
+
+    while (offset + sizeof(RgbdCheckpoint) <= end)
+    {
+        RgbdChunkHeader header;
+        if (!RgbdSeek(pFile, offset) ||
+            1 != fread(&header.magic, sizeof(header.magic), 1, pFile))
+        {
+            break;
+        }
+
+        if (RGBD_CHECKPOINT_MAGIC == header.magic)
+        {
+            // The frames listed by a checkpoint are indexed from their own chunks
+            RgbdCheckpoint checkpoint;
+            if (!RgbdSeek(pFile, offset) ||
+                1 != fread(&checkpoint, sizeof(checkpoint), 1, pFile) ||
+                checkpoint.headerCrc != RgbdCrc32(&checkpoint, offsetof(RgbdCheckpoint, headerCrc)) ||
+                offset + sizeof(checkpoint) + (uint64_t)checkpoint.entryCount * sizeof(RgbdIndexEntry) > end)
+            {
+                break;
+            }
+
+            offset += sizeof(checkpoint) + (uint64_t)checkpoint.entryCount * sizeof(RgbdIndexEntry);
+            continue;
+        }
+
+        if (RGBD_CHUNK_MAGIC != header.magic ||
+            offset + sizeof(header) > end ||
+            1 != fread(&header.stream, sizeof(header) - sizeof(header.magic), 1, pFile) ||
+            offset + sizeof(header) + header.payloadSize > end)
+        {
+            break;
+        }
+
+        RgbdIndexEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.offset      = offset;
+        entry.timestamp   = header.timestamp;
+        entry.frameNumber = header.frameNumber;
+        entry.payloadSize = header.payloadSize;
+        entry.width       = header.width;
+        entry.height      = header.height;
+        entry.stream      = header.stream;
+        entry.format      = header.format;
+        entry.codec       = header.codec;
+        entries.push_back(entry);
+
+        offset += sizeof(header) + header.payloadSize;
+    }
+
+    return offset;
+}
+
+/// <summary>
+/// Read a frame chunk
+/// </summary>
+/// <param name="index">Index of the frame</param>
+/// <param name="header">Receives the chunk header</param>
+/// <param name="payload">Receives the payload</param>
+/// <returns>Indicates success or failure, failure also if the payload size differs from the index entry</returns>
+bool RgbdContainerReader::ReadChunk(size_t index, RgbdChunkHeader& header, std::vector<uint8_t>& payload)
+{
+    if (!m_pFile || index >= m_index.size())
+    {
+        return false;
+    }
+
+    if (!RgbdSeek(m_pFile, m_index[index].offset) ||
+        1 != fread(&header, sizeof(header), 1, m_pFile) ||
+        RGBD_CHUNK_MAGIC != header.magic)
+    {
+        return false;
+    }
+
+    // The index entry was bounded by the file when the index was loaded, the chunk header was not
+    if (m_index[index].payloadSize != header.payloadSize)
+    {
+        return false;
+    }
+
+    payload.resize(header.payloadSize);
+    return 0 == header.payloadSize || 1 == fread(payload.data(), header.payloadSize, 1, m_pFile);
+}
+
+/// <summary>
+/// Check that the chunk of a frame matches its index entry and its payload CRC
+/// </summary>
+/// <param name="index">Index of the frame</param>
+/// <param name="error">Receives a description of the problem</param>
+/// <returns>True if the chunk is intact</returns>
+bool RgbdContainerReader::VerifyChunk(size_t index, std::string& error)
+{
+    RgbdChunkHeader      header = {};
+    std::vector<uint8_t> payload;
+
+    if (!ReadChunk(index, header, payload))
+    {
+        error = (RGBD_CHUNK_MAGIC == header.magic && m_index[index].payloadSize != header.payloadSize) ?
+            "index entry does not match chunk header" : "chunk header unreadable";
+        return false;
+    }
+
+    const RgbdIndexEntry& entry = m_index[index];
+    if (entry.stream != header.stream || entry.frameNumber != header.frameNumber ||
+        entry.payloadSize != header.payloadSize || entry.timestamp != header.timestamp)
+    {
+        error = "index entry does not match chunk header";
+        return false;
+    }
+
+    if (header.payloadCrc != RgbdChunkCrc(header, payload.data(), m_version))
+    {
+        error = m_version >= 2 ? "chunk checksum mismatch" : "payload checksum mismatch";
+        return false;
+    }
+
+    return true;
+}
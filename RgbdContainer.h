@@ -0,0 +1,442 @@
+//------------------------------------------------------------------------------
+// <copyright file="RgbdContainer.h">
+//     Append-only single-file container for recorded color and depth frames.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "FrameCodec.h"
+#include "FrameRecorder.h"
+
+// File layout, all fields little-endian:
+//
+//   RgbdFileHeader
+//   RgbdChunkHeader + payload      (one chunk per frame, any stream, in arrival order)
+//   RgbdCheckpoint + entries       (version 2, between the frame chunks every RGBD_CHECKPOINT_INTERVAL)
+//   ...
+//   RgbdIndexEntry[entryCount]     (written on close)
+//   RgbdFileTrailer
+//
+// A file without trailer (e.g. the recorder was killed) is still readable by scanning the chunks.
+// From version 2 the chunk checksum covers the chunk header as well, and the writer periodically flushes
+// the file to disk and then appends a checkpoint listing the frames made durable since the previous one,
+// so RgbdRecovery restores a file cut short without reading the frames before the last checkpoint.
+
+#define RGBD_FILE_MAGIC         "KRGBD\0\0\0"
+#define RGBD_FILE_END_MAGIC     "KRGBDEND"
+#define RGBD_FILE_VERSION       2
+#define RGBD_CHUNK_MAGIC        0x454D5246      // 'FRME'
+#define RGBD_INDEX_MAGIC        0x58444E49      // 'INDX'
+#define RGBD_CHECKPOINT_MAGIC   0x54504B43      // 'CKPT'
+
+#define RGBD_CHECKPOINT_INTERVAL    1.0         // Seconds between checkpoints, about the recording lost when the machine fails
+
+#pragma pack(push, 1)
+
+struct RgbdFileHeader
+{
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    headerSize;
+    uint64_t    createdTime;    // Microseconds since epoch
+    uint8_t     reserved[8];
+};
+
+struct RgbdChunkHeader
+{
+    uint32_t    magic;
+    uint8_t     stream;         // RecordStream
+    uint8_t     format;         // RecordPixelFormat
+    uint8_t     codec;          // RecordCodec
+    uint8_t     reserved;
+    uint32_t    width;
+    uint32_t    height;
+    uint32_t    stride;
+    uint32_t    frameNumber;
+    double      timestamp;
+    uint32_t    payloadSize;
+    uint32_t    payloadCrc;     // CRC-32 of the payload, from version 2 of the header fields above followed by the payload
+};
+
+struct RgbdIndexEntry
+{
+    uint64_t    offset;         // File offset of the chunk header
+    double      timestamp;
+    uint32_t    frameNumber;
+    uint32_t    payloadSize;
+    uint32_t    width;
+    uint32_t    height;
+    uint8_t     stream;
+    uint8_t     format;
+    uint8_t     codec;
+    uint8_t     reserved;
+};
+
+struct RgbdFileTrailer
+{
+    uint32_t    magic;          // RGBD_INDEX_MAGIC
+    uint32_t    entryCount;
+    uint64_t    indexOffset;
+    uint32_t    indexCrc;       // CRC-32 of the index entries
+    uint32_t    reserved;
+    char        endMagic[8];
+};
+
+struct RgbdCheckpoint
+{
+    uint32_t    magic;          // RGBD_CHECKPOINT_MAGIC
+    uint32_t    entryCount;     // Index entries following, of the frames appended since the previous checkpoint
+    uint64_t    previousOffset; // File offset of the previous checkpoint, 0 for the first
+    uint64_t    frameCount;     // Frames in the file up to this checkpoint
+    uint32_t    entriesCrc;     // CRC-32 of the index entries
+    uint32_t    headerCrc;      // CRC-32 of the fields above
+};
+
+#pragma pack(pop)
+
+/// <summary>
+/// Compute CRC-32 (IEEE 802.3) of a block of memory
+/// </summary>
+/// <param name="pData">The pointer to data</param>
+/// <param name="size">Size of data in bytes</param>
+/// <param name="crc">CRC of the preceding data when computing incrementally</param>
+/// <returns>CRC of data</returns>
+uint32_t RgbdCrc32(const void* pData, size_t size, uint32_t crc = 0);
+
+/// <summary>
+/// Compute the checksum stored in a chunk header
+/// </summary>
+/// <param name="header">Chunk header</param>
+/// <param name="pPayload">The pointer to payload</param>
+/// <param name="version">Version of the file the chunk belongs to</param>
+/// <returns>CRC of the payload, preceded by the header fields from version 2</returns>
+uint32_t RgbdChunkCrc(const RgbdChunkHeader& header, const void* pPayload, uint32_t version);
+
+/// <summary>
+/// Seek to an absolute 64-bit file offset
+/// </summary>
+bool RgbdSeek(FILE* pFile, uint64_t offset);
+
+/// <summary>
+/// Get the current 64-bit file offset
+/// </summary>
+uint64_t RgbdTell(FILE* pFile);
+
+/// <summary>
+/// Reserve disk space for a file without changing its size, so it is not extended piece by piece while it is written
+/// </summary>
+/// <param name="pFile">Open file</param>
+/// <param name="bytes">Bytes to reserve</param>
+/// <returns>False if the file system does not support it</returns>
+bool RgbdReserve(FILE* pFile, uint64_t bytes);
+
+/// <summary>
+/// Write the buffered data of a file through to the disk
+/// </summary>
+/// <param name="pFile">Open file</param>
+/// <returns>Indicates success or failure</returns>
+bool RgbdSync(FILE* pFile);
+
+/// <summary>
+/// Set the size of a file, cutting off what follows
+/// </summary>
+/// <param name="pFile">File open for writing</param>
+/// <param name="size">New size in bytes</param>
+/// <returns>Indicates success or failure</returns>
+bool RgbdTruncate(FILE* pFile, uint64_t size);
+
+/// <summary>
+/// Writes frames of all streams into one container file. Thread safe, so the
+/// color and depth recorder threads can append to the same file.
+/// </summary>
+class RgbdContainerWriter
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="path">Path of the container file to create</param>
+    RgbdContainerWriter(const std::string& path);
+
+    /// <summary>
+    /// Destructor. Finalizes the file if it is still open
+    /// </summary>
+   ~RgbdContainerWriter();
+
+public:
+    /// <summary>
+    /// Create the file on first call. Every call must be paired with Close
+    /// </summary>
+    /// <returns>Indicates success or failure</returns>
+    bool Open();
+
+    /// <summary>
+    /// Write the index footer and close the file when the last user closes it
+    /// </summary>
+    void Close();
+
+    /// <summary>
+    /// Close like Close, and delete the file if the last user closes it without a frame having been appended,
+    /// e.g. a segment prepared ahead which the recording did not reach
+    /// </summary>
+    void Discard();
+
+    /// <summary>
+    /// Set the disk space reserved when the file is created. Must be called before the first Open
+    /// </summary>
+    /// <param name="bytes">Bytes to reserve, 0 for none</param>
+    void SetPreallocation(uint64_t bytes) { m_preallocateBytes = bytes; }
+
+    /// <summary>
+    /// Set the time between checkpoints. Must be called before the first Open
+    /// </summary>
+    /// <param name="seconds">Seconds between checkpoints, 0 to never flush the file to disk before it is closed</param>
+    void SetCheckpointInterval(double seconds) { m_checkpointSeconds = seconds; }
+
+    /// <summary>
+    /// Continue an existing file instead of replacing it, e.g. to resume an interrupted transcode.
+    /// The file must have a valid footer, so a file cut short is recovered first. Must be called before the first Open
+    /// </summary>
+    /// <param name="append">True to append to the file if it exists</param>
+    void SetAppend(bool append) { m_append = append; }
+
+    /// <summary>
+    /// Get the index entries of the frames appended so far. Only while no frame is being appended
+    /// </summary>
+    const std::vector<RgbdIndexEntry>& GetIndex() const { return m_index; }
+
+    /// <summary>
+    /// Append a frame chunk
+    /// </summary>
+    /// <param name="frame">Frame description</param>
+    /// <param name="codec">Encoding of the payload</param>
+    /// <param name="pPayload">The pointer to payload</param>
+    /// <param name="payloadSize">Size of payload in bytes</param>
+    /// <returns>Indicates success or failure</returns>
+    bool AppendFrame(const RecordFrame& frame, RecordCodec codec, const uint8_t* pPayload, uint32_t payloadSize);
+
+    /// <summary>
+    /// Get path of the container file
+    /// </summary>
+    const std::string& GetPath() const { return m_path; }
+
+private:
+    /// <summary>
+    /// Reopen an existing file to append to it, dropping its footer. Called with the lock held
+    /// </summary>
+    /// <returns>False if the file has no valid footer or an older version</returns>
+    bool OpenExisting();
+
+    /// <summary>
+    /// Append a checkpoint listing the frames which are on disk. Called with the lock held
+    /// </summary>
+    /// <param name="durableCount">Number of frames written through to the disk</param>
+    void WriteCheckpoint(size_t durableCount);
+
+    /// <summary>
+    /// Cut off what a failed write left after the last complete chunk and continue from there. If that
+    /// fails too, the file takes no more frames. Called with the lock held
+    /// </summary>
+    void DropPartialWrite();
+
+private:
+    std::string                 m_path;
+    FILE*                       m_pFile;
+    int                         m_openCount;
+    uint64_t                    m_offset;
+    uint64_t                    m_preallocateBytes;
+    bool                        m_discardIfEmpty;
+    bool                        m_append;
+    bool                        m_failed;               // A failed write could not be cut off, offsets no longer match the file
+    std::vector<RgbdIndexEntry> m_index;
+    std::mutex                  m_lock;
+
+    double                                  m_checkpointSeconds;
+    std::chrono::steady_clock::time_point   m_lastCheckpoint;
+    uint64_t                                m_checkpointOffset;     // Offset of the latest checkpoint, 0 before the first
+    size_t                                  m_checkpointedCount;    // Frames listed by checkpoints
+    bool                                    m_syncing;              // An append is flushing the file outside the lock
+};
+
+/// <summary>
+/// Frame writer storing the frames of one stream into a shared container file
+/// </summary>
+class ContainerFrameWriter : public FrameWriter
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="pContainer">Container shared with the writers of the other streams</param>
+    /// <param name="pEncoder">Encoder for the frames, owned by the writer. Frames are stored raw if null</param>
+    ContainerFrameWriter(const std::shared_ptr<RgbdContainerWriter>& pContainer, FrameEncoder* pEncoder = nullptr);
+
+    /// <summary>
+    /// Open the shared container
+    /// </summary>
+    /// <returns>Indicates success or failure</returns>
+    virtual bool Open();
+
+    /// <summary>
+    /// Append a frame to the shared container
+    /// </summary>
+    /// <param name="frame">Frame to write</param>
+    /// <returns>Indicates success or failure</returns>
+    virtual bool WriteFrame(const RecordFrame& frame);
+
+    /// <summary>
+    /// One frame at a time if frames are encoded, the encoder may keep state from frame to frame
+    /// </summary>
+    virtual unsigned GetEncodeConcurrency() const { return m_pEncoder ? 1 : 0; }
+
+    /// <summary>
+    /// Encode a frame ahead of StoreFrame
+    /// </summary>
+    /// <param name="frame">Frame to encode</param>
+    /// <param name="encoded">Receives the payload</param>
+    /// <returns>Indicates success or failure</returns>
+    virtual bool EncodeFrame(const RecordFrame& frame, EncodedFrame& encoded);
+
+    /// <summary>
+    /// Append an encoded frame to the shared container
+    /// </summary>
+    /// <param name="frame">Frame to store</param>
+    /// <param name="encoded">Payload of the frame</param>
+    /// <returns>Indicates success or failure</returns>
+    virtual bool StoreFrame(const RecordFrame& frame, const EncodedFrame& encoded);
+
+    /// <summary>
+    /// Log the compression achieved in the session and release the shared container
+    /// </summary>
+    virtual void Close();
+
+    /// <summary>
+    /// Release the shared container, which is deleted if no stream wrote a frame to it
+    /// </summary>
+    virtual void Discard() { m_pContainer->Discard(); }
+
+private:
+    std::shared_ptr<RgbdContainerWriter> m_pContainer;
+    std::unique_ptr<FrameEncoder>        m_pEncoder;
+    EncodedFrame                         m_encoded;     // Payload of frames written by WriteFrame
+    RecordStream                         m_stream;      // Stream of the frames written, for the session log
+    bool                                 m_storeFailed; // Until a keyframe has been stored again
+};
+
+/// <summary>
+/// Reads frames back from a container file
+/// </summary>
+class RgbdContainerReader
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    RgbdContainerReader();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+   ~RgbdContainerReader();
+
+public:
+    /// <summary>
+    /// Open a container file and load its index. If the index footer is missing or damaged,
+    /// the index is rebuilt by scanning the chunks
+    /// </summary>
+    /// <param name="path">Path of container file</param>
+    /// <param name="scanIfDamaged">False to leave the index empty if the footer is missing or damaged</param>
+    /// <returns>Indicates success or failure</returns>
+    bool Open(const std::string& path, bool scanIfDamaged = true);
+
+    /// <summary>
+    /// Close the file
+    /// </summary>
+    void Close();
+
+    /// <summary>
+    /// Check whether the index was loaded from the footer rather than rebuilt by scanning
+    /// </summary>
+    bool HasIndexFooter() const { return m_hasFooter; }
+
+    /// <summary>
+    /// Get the format version of the file
+    /// </summary>
+    uint32_t GetVersion() const { return m_version; }
+
+    /// <summary>
+    /// Get the size of the file in bytes
+    /// </summary>
+    uint64_t GetFileSize() const { return m_fileSize; }
+
+    /// <summary>
+    /// Get the size of the file header, the offset of the first chunk
+    /// </summary>
+    uint32_t GetHeaderSize() const { return m_headerSize; }
+
+    /// <summary>
+    /// Get number of frames in the container
+    /// </summary>
+    size_t GetFrameCount() const { return m_index.size(); }
+
+    /// <summary>
+    /// Get index entry of a frame
+    /// </summary>
+    const RgbdIndexEntry& GetEntry(size_t index) const { return m_index[index]; }
+
+    /// <summary>
+    /// Get all index entries
+    /// </summary>
+    const std::vector<RgbdIndexEntry>& GetIndex() const { return m_index; }
+
+    /// <summary>
+    /// Read a frame chunk
+    /// </summary>
+    /// <param name="index">Index of the frame</param>
+    /// <param name="header">Receives the chunk header</param>
+    /// <param name="payload">Receives the payload</param>
+    /// <returns>Indicates success or failure, failure also if the payload size differs from the index entry</returns>
+    bool ReadChunk(size_t index, RgbdChunkHeader& header, std::vector<uint8_t>& payload);
+
+    /// <summary>
+    /// Check that the chunk of a frame matches its index entry and its payload CRC
+    /// </summary>
+    /// <param name="index">Index of the frame</param>
+    /// <param name="error">Receives a description of the problem</param>
+    /// <returns>True if the chunk is intact</returns>
+    bool VerifyChunk(size_t index, std::string& error);
+
+    /// <summary>
+    /// Scan chunks sequentially from a file offset and collect their index entries, skipping checkpoints.
+    /// Stops at the first chunk which is truncated or whose header is invalid.
+    /// </summary>
+    /// <param name="pFile">Open container file</param>
+    /// <param name="start">Offset of the first chunk</param>
+    /// <param name="end">Offset to stop at</param>
+    /// <param name="entries">Receives the index entries</param>
+    /// <returns>Offset just past the last valid chunk</returns>
+    static uint64_t ScanChunks(FILE* pFile, uint64_t start, uint64_t end, std::vector<RgbdIndexEntry>& entries);
+
+private:
+    /// <summary>
+    /// Load the index footer
+    /// </summary>
+    /// <returns>True if a valid footer was found</returns>
+    bool LoadFooter();
+
+private:
+    FILE*                       m_pFile;
+    uint64_t                    m_fileSize;
+    uint32_t                    m_version;
+    uint32_t                    m_headerSize;
+    bool                        m_hasFooter;
+    std::vector<RgbdIndexEntry> m_index;
+};
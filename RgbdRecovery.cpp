@@ -0,0 +1,622 @@
+//------------------------------------------------------------------------------
+// <copyright file="RgbdRecovery.cpp">
+//     Restoring container files of a recording which did not end normally.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "RgbdRecovery.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <mutex>
+
+#include "RecordingSegments.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#define RGBD_FILE_EXTENSION     ".krgbd"
+
+/// <summary>
+/// List the files and subdirectories of a directory
+/// </summary>
+/// <param name="directory">Path of the directory</param>
+/// <param name="files">Receives the names of the files</param>
+/// <param name="directories">Receives the names of the subdirectories</param>
+/// <returns>False if the path is not a directory</returns>
+static bool ListDirectory(const std::string& directory, std::vector<std::string>& files, std::vector<std::string>& directories)
+{
+#ifdef _WIN32
+    WIN32_FIND_DATAA data;
+    HANDLE hFind = FindFirstFileA((directory + "/*").c_str(), &data);
+    if (INVALID_HANDLE_VALUE == hFind)
+    {
+        return false;
+    }
+
+    do
+    {
+        std::string name = data.cFileName;
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+        {
+            if ("." != name && ".." != name)
+            {
+                directories.push_back(name);
+            }
+        }
+        else
+        {
+            files.push_back(name);
+        }
+    }
+    while (FindNextFileA(hFind, &data));
+
+    FindClose(hFind);
+    return true;
+#else
+    DIR* pDirectory = opendir(directory.c_str());
+    if (!pDirectory)
+    {
+        return false;
+    }
+
+    while (struct dirent* pEntry = readdir(pDirectory))
+    {
+        std::string name = pEntry->d_name;
+        struct stat status;
+        if ("." == name || ".." == name || 0 != stat((directory + "/" + name).c_str(), &status))
+        {
+            continue;
+        }
+
+        if (S_ISDIR(status.st_mode))
+        {
+            directories.push_back(name);
+        }
+        else
+        {
+            files.push_back(name);
+        }
+    }
+
+    closedir(pDirectory);
+    return true;
+#endif
+}
+
+/// <summary>
+/// Check whether a file name has the container extension
+/// </summary>
+static bool IsContainerName(const std::string& name)
+{
+    const size_t length = sizeof(RGBD_FILE_EXTENSION) - 1;
+    return name.size() > length && 0 == name.compare(name.size() - length, length, RGBD_FILE_EXTENSION);
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="pool">Pool the files are scanned on, must outlive the recovery</param>
+RgbdRecovery::RgbdRecovery(TaskPool& pool)
+    : m_pool(pool)
+    , m_rangeBytes(DefaultRangeBytes)
+{
+}
+
+/// <summary>
+/// Recover container files, all of them in parallel. Must not be called from a task of the pool
+/// </summary>
+/// <param name="paths">Paths of the container files</param>
+/// <param name="results">Receives the outcome for each file, in the order given</param>
+void RgbdRecovery::Recover(const std::vector<std::string>& paths, std::vector<RgbdRecoveryResult>& results)
+{
+    std::vector<File>           files(paths.size());
+    std::vector<TaskPool::Task> tasks;
+
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        File& file = files[i];
+        file.result.path             = paths[i];
+        file.result.intact           = false;
+        file.result.recovered        = false;
+        file.result.frames           = 0;
+        file.result.checkpointFrames = 0;
+        file.result.scannedBytes     = 0;
+        file.result.droppedBytes     = 0;
+        file.version                 = 0;
+        file.size                    = 0;
+        file.scanStart               = 0;
+
+        tasks.push_back([this, &file]() { Prepare(file); });
+    }
+    RunAll(tasks);
+
+    // The ranges of all files are scanned together, so a long file does not leave the other workers idle
+    for (File& file : files)
+    {
+        if (file.result.intact || !file.result.error.empty())
+        {
+            continue;
+        }
+
+        uint64_t length = file.size - file.scanStart;
+        size_t   count  = (size_t)(std::max<uint64_t>)(1, (length + m_rangeBytes - 1) / m_rangeBytes);
+
+        file.ranges.resize(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            Range& range = file.ranges[i];
+            range.begin = file.scanStart + i * m_rangeBytes;
+            range.end   = (std::min)(file.size, range.begin + m_rangeBytes);
+
+            tasks.push_back([this, &file, &range, i]() { Scan(file, range, i > 0); });
+        }
+    }
+    RunAll(tasks);
+
+    for (File& file : files)
+    {
+        if (!file.result.intact && file.result.error.empty())
+        {
+            tasks.push_back([this, &file]() { Finish(file); });
+        }
+    }
+    RunAll(tasks);
+
+    results.clear();
+    for (File& file : files)
+    {
+        results.push_back(file.result);
+    }
+}
+
+/// <summary>
+/// Find the container files of a session
+/// </summary>
+/// <param name="path">A container file, or a session directory whose container files and those
+/// of its segment directories are collected</param>
+/// <param name="paths">Receives the paths of the container files, sorted</param>
+/// <returns>False if the path is neither a file nor a directory</returns>
+bool RgbdRecovery::FindContainers(const std::string& path, std::vector<std::string>& paths)
+{
+    std::vector<std::string> files;
+    std::vector<std::string> directories;
+
+    if (!ListDirectory(path, files, directories))
+    {
+        FILE* pFile = fopen(path.c_str(), "rb");
+        if (!pFile)
+        {
+            return false;
+        }
+
+        fclose(pFile);
+        paths.push_back(path);
+        return true;
+    }
+
+    for (const std::string& name : files)
+    {
+        if (IsContainerName(name))
+        {
+            paths.push_back(path + "/" + name);
+        }
+    }
+
+    for (const std::string& directory : directories)
+    {
+        unsigned segment;
+        if (1 != sscanf(directory.c_str(), SEGMENT_NAME_FORMAT, &segment))
+        {
+            continue;
+        }
+
+        std::vector<std::string> segmentFiles;
+        std::vector<std::string> subdirectories;
+        ListDirectory(path + "/" + directory, segmentFiles, subdirectories);
+
+        for (const std::string& name : segmentFiles)
+        {
+            if (IsContainerName(name))
+            {
+                paths.push_back(path + "/" + directory + "/" + name);
+            }
+        }
+    }
+
+    std::sort(paths.begin(), paths.end());
+    return true;
+}
+
+/// <summary>
+/// Check the footer and take the frames listed by the checkpoints of a file. Runs on the pool
+/// </summary>
+void RgbdRecovery::Prepare(File& file) const
+{
+    RgbdContainerReader reader;
+    if (!reader.Open(file.result.path, false))
+    {
+        file.result.error = "not a container file";
+        return;
+    }
+
+    if (reader.HasIndexFooter())
+    {
+        file.result.intact = true;
+        file.result.frames = reader.GetFrameCount();
+        return;
+    }
+
+    file.version   = reader.GetVersion();
+    file.size      = reader.GetFileSize();
+    file.scanStart = (std::min<uint64_t>)(reader.GetHeaderSize(), file.size);
+    reader.Close();
+
+    if (file.version < 2)
+    {
+        // Written before checkpoints, every chunk is verified
+        return;
+    }
+
+    FILE* pFile = fopen(file.result.path.c_str(), "rb");
+    if (!pFile)
+    {
+        file.result.error = "cannot open";
+        return;
+    }
+
+    RgbdCheckpoint              checkpoint;
+    std::vector<RgbdIndexEntry> entries;
+    uint64_t offset = FindLastCheckpoint(pFile, file.scanStart, file.size, checkpoint, entries);
+    uint64_t end    = offset + sizeof(checkpoint) + entries.size() * sizeof(RgbdIndexEntry);
+
+    // Follow the checkpoints back to the first, each one lists the frames since the previous
+    std::vector<std::vector<RgbdIndexEntry>> lists;
+    bool chained = 0 != offset;
+    while (chained)
+    {
+        for (const RgbdIndexEntry& entry : entries)
+        {
+            chained = chained && entry.offset >= file.scanStart &&
+                      entry.offset + sizeof(RgbdChunkHeader) + entry.payloadSize <= offset;
+        }
+
+        if (!chained || checkpoint.entryCount > checkpoint.frameCount)
+        {
+            chained = false;
+            break;
+        }
+
+        uint64_t remaining = checkpoint.frameCount - checkpoint.entryCount;
+        uint64_t previous  = checkpoint.previousOffset;
+        lists.push_back(std::move(entries));
+
+        if (0 == previous)
+        {
+            chained = 0 == remaining;
+            break;
+        }
+
+        // The previous checkpoint has to end before this one
+        if (previous >= offset || !ReadCheckpoint(pFile, previous, offset, checkpoint, entries) ||
+            checkpoint.frameCount != remaining)
+        {
+            chained = false;
+            break;
+        }
+        offset = previous;
+    }
+    fclose(pFile);
+
+    if (!chained)
+    {
+        // Without a complete chain every chunk is verified
+        return;
+    }
+
+    for (std::vector<std::vector<RgbdIndexEntry>>::reverse_iterator it = lists.rbegin(); it != lists.rend(); ++it)
+    {
+        file.index.insert(file.index.end(), it->begin(), it->end());
+    }
+    file.scanStart               = end;
+    file.result.checkpointFrames = file.index.size();
+}
+
+/// <summary>
+/// Verify the chunks of a range of a file. Runs on the pool
+/// </summary>
+/// <param name="resync">False if the range starts at a chunk, true to look for the first one</param>
+void RgbdRecovery::Scan(const File& file, Range& range, bool resync) const
+{
+    const size_t BlockBytes = 1 << 20;
+
+    FILE* pFile = fopen(file.result.path.c_str(), "rb");
+    if (!pFile)
+    {
+        return;
+    }
+
+    std::vector<uint8_t> buffer;
+    Chunk                chunk;
+    uint64_t             offset = range.begin;
+
+    if (resync)
+    {
+        // The range most likely starts inside a chunk of the previous range, the first offset at which
+        // a chunk passes its checksum is where the chunks of this range begin
+        const uint32_t       magics[] = { RGBD_CHUNK_MAGIC, RGBD_CHECKPOINT_MAGIC };
+        std::vector<uint8_t> block;
+        bool                 found = false;
+
+        for (uint64_t blockBegin = range.begin; !found && blockBegin < range.end; blockBegin += BlockBytes)
+        {
+            uint64_t blockEnd = (std::min)(range.end, blockBegin + BlockBytes);
+            uint64_t readEnd  = (std::min)(file.size, blockEnd + sizeof(uint32_t) - 1);
+
+            block.resize((size_t)(readEnd - blockBegin));
+            if (!RgbdSeek(pFile, blockBegin) || block.size() != fread(block.data(), 1, block.size(), pFile))
+            {
+                break;
+            }
+
+            for (size_t i = 0; !found && i < blockEnd - blockBegin && i + sizeof(uint32_t) <= block.size(); i++)
+            {
+                if ((0 == memcmp(&block[i], &magics[0], sizeof(uint32_t)) || 0 == memcmp(&block[i], &magics[1], sizeof(uint32_t))) &&
+                    ReadChunk(pFile, blockBegin + i, file.size, file.version, buffer, chunk))
+                {
+                    offset = blockBegin + i;
+                    found  = true;
+                }
+            }
+        }
+
+        if (!found)
+        {
+            fclose(pFile);
+            return;
+        }
+
+        range.chunks.push_back(chunk);
+        offset += chunk.size;
+    }
+
+    // The last chunk of the range may end in the next range
+    while (offset < range.end && ReadChunk(pFile, offset, file.size, file.version, buffer, chunk))
+    {
+        range.chunks.push_back(chunk);
+        offset += chunk.size;
+    }
+
+    fclose(pFile);
+}
+
+/// <summary>
+/// Chain the chunks of the ranges, cut the file after the last one and append the index footer. Runs on the pool
+/// </summary>
+void RgbdRecovery::Finish(File& file) const
+{
+    // A range whose first chunk does not start where the previous range ended follows a damaged chunk,
+    // everything from the damaged chunk on is dropped
+    uint64_t end     = file.scanStart;
+    bool     chained = true;
+    for (size_t i = 0; chained && i < file.ranges.size(); i++)
+    {
+        for (const Chunk& chunk : file.ranges[i].chunks)
+        {
+            if (chunk.entry.offset != end)
+            {
+                chained = false;
+                break;
+            }
+
+            if (chunk.frame)
+            {
+                file.index.push_back(chunk.entry);
+            }
+            end += chunk.size;
+        }
+    }
+
+    RgbdFileTrailer trailer;
+    memset(&trailer, 0, sizeof(trailer));
+    trailer.magic       = RGBD_INDEX_MAGIC;
+    trailer.entryCount  = (uint32_t)file.index.size();
+    trailer.indexOffset = end;
+    trailer.indexCrc    = RgbdCrc32(file.index.data(), file.index.size() * sizeof(RgbdIndexEntry));
+    memcpy(trailer.endMagic, RGBD_FILE_END_MAGIC, sizeof(trailer.endMagic));
+
+    FILE* pFile = fopen(file.result.path.c_str(), "r+b");
+    if (!pFile)
+    {
+        file.result.error = "cannot open for writing";
+        return;
+    }
+
+    bool written = RgbdSeek(pFile, end) &&
+                   (file.index.empty() || file.index.size() == fwrite(file.index.data(), sizeof(RgbdIndexEntry), file.index.size(), pFile)) &&
+                   1 == fwrite(&trailer, sizeof(trailer), 1, pFile) &&
+                   RgbdTruncate(pFile, end + file.index.size() * sizeof(RgbdIndexEntry) + sizeof(trailer)) &&
+                   RgbdSync(pFile);
+    fclose(pFile);
+
+    if (!written)
+    {
+        file.result.error = "cannot write the index";
+        return;
+    }
+
+    file.result.recovered    = true;
+    file.result.frames       = file.index.size();
+    file.result.scannedBytes = file.size - file.scanStart;
+    file.result.droppedBytes = file.size - end;
+}
+
+/// <summary>
+/// Run tasks on the pool and wait until all of them have finished
+/// </summary>
+void RgbdRecovery::RunAll(std::vector<TaskPool::Task>& tasks)
+{
+    std::mutex              lock;
+    std::condition_variable finished;
+    size_t                  remaining = tasks.size();
+
+    for (TaskPool::Task& task : tasks)
+    {
+        m_pool.Submit([&lock, &finished, &remaining, task]()
+        {
+            task();
+
+            std::lock_guard<std::mutex> guard(lock);
+            if (0 == --remaining)
+            {
+                finished.notify_all();
+            }
+        });
+    }
+
+    std::unique_lock<std::mutex> guard(lock);
+    finished.wait(guard, [&remaining]() { return 0 == remaining; });
+
+    tasks.clear();
+}
+
+/// <summary>
+/// Find the last checkpoint of a file which passes its checksums, searching back from the end
+/// </summary>
+/// <param name="pFile">Open container file</param>
+/// <param name="start">Offset of the first chunk</param>
+/// <param name="size">Size of the file</param>
+/// <param name="checkpoint">Receives the checkpoint</param>
+/// <param name="entries">Receives the index entries of the checkpoint</param>
+/// <returns>Offset of the checkpoint, 0 if there is none</returns>
+uint64_t RgbdRecovery::FindLastCheckpoint(FILE* pFile, uint64_t start, uint64_t size, RgbdCheckpoint& checkpoint, std::vector<RgbdIndexEntry>& entries)
+{
+    const size_t   BlockBytes = 1 << 20;
+    const uint32_t magic      = RGBD_CHECKPOINT_MAGIC;
+
+    // Usually found in the last block, the writer checkpoints every RGBD_CHECKPOINT_INTERVAL
+    std::vector<uint8_t> block;
+    for (uint64_t blockEnd = size; blockEnd > start; )
+    {
+        uint64_t blockBegin = blockEnd - start > BlockBytes ? blockEnd - BlockBytes : start;
+        uint64_t readEnd    = (std::min)(size, blockEnd + sizeof(magic) - 1);
+
+        block.resize((size_t)(readEnd - blockBegin));
+        if (!RgbdSeek(pFile, blockBegin) || block.size() != fread(block.data(), 1, block.size(), pFile))
+        {
+            return 0;
+        }
+
+        for (size_t i = (size_t)(blockEnd - blockBegin); i-- > 0; )
+        {
+            if (i + sizeof(magic) <= block.size() && 0 == memcmp(&block[i], &magic, sizeof(magic)) &&
+                ReadCheckpoint(pFile, blockBegin + i, size, checkpoint, entries))
+            {
+                return blockBegin + i;
+            }
+        }
+
+        blockEnd = blockBegin;
+    }
+
+    return 0;
+}
+
+/// <summary>
+/// Read a checkpoint and its index entries and check both checksums
+/// </summary>
+/// <returns>True if the checkpoint is intact and ends within the file</returns>
+bool RgbdRecovery::ReadCheckpoint(FILE* pFile, uint64_t offset, uint64_t size, RgbdCheckpoint& checkpoint, std::vector<RgbdIndexEntry>& entries)
+{
+    if (offset + sizeof(checkpoint) > size ||
+        !RgbdSeek(pFile, offset) ||
+        1 != fread(&checkpoint, sizeof(checkpoint), 1, pFile) ||
+        RGBD_CHECKPOINT_MAGIC != checkpoint.magic ||
+        checkpoint.headerCrc != RgbdCrc32(&checkpoint, offsetof(RgbdCheckpoint, headerCrc)) ||
+        offset + sizeof(checkpoint) + (uint64_t)checkpoint.entryCount * sizeof(RgbdIndexEntry) > size)
+    {
+        return false;
+    }
+
+    entries.resize(checkpoint.entryCount);
+    if (checkpoint.entryCount && checkpoint.entryCount != fread(entries.data(), sizeof(RgbdIndexEntry), checkpoint.entryCount, pFile))
+    {
+        return false;
+    }
+
+    return checkpoint.entriesCrc == RgbdCrc32(entries.data(), entries.size() * sizeof(RgbdIndexEntry));
+}
+
+/// <summary>
+/// Read the chunk at an offset and check its checksum
+/// </summary>
+/// <param name="pFile">Open container file</param>
+/// <param name="offset">Offset of the chunk</param>
+/// <param name="size">Size of the file</param>
+/// <param name="version">Version of the file</param>
+/// <param name="buffer">Scratch memory for the payload</param>
+/// <param name="chunk">Receives the chunk</param>
+/// <returns>True if an intact frame or checkpoint starts at the offset</returns>
+bool RgbdRecovery::ReadChunk(FILE* pFile, uint64_t offset, uint64_t size, uint32_t version, std::vector<uint8_t>& buffer, Chunk& chunk)
+{
+    uint32_t magic;
+    if (offset + sizeof(magic) > size ||
+        !RgbdSeek(pFile, offset) ||
+        1 != fread(&magic, sizeof(magic), 1, pFile))
+    {
+        return false;
+    }
+
+    memset(&chunk.entry, 0, sizeof(chunk.entry));
+    chunk.entry.offset = offset;
+
+    if (RGBD_CHECKPOINT_MAGIC == magic)
+    {
+        RgbdCheckpoint              checkpoint;
+        std::vector<RgbdIndexEntry> entries;
+        if (version < 2 || !ReadCheckpoint(pFile, offset, size, checkpoint, entries))
+        {
+            return false;
+        }
+
+        chunk.size  = sizeof(checkpoint) + entries.size() * sizeof(RgbdIndexEntry);
+        chunk.frame = false;
+        return true;
+    }
+
+    RgbdChunkHeader header;
+    if (RGBD_CHUNK_MAGIC != magic ||
+        offset + sizeof(header) > size ||
+        !RgbdSeek(pFile, offset) ||
+        1 != fread(&header, sizeof(header), 1, pFile) ||
+        header.stream >= RecordStreamCount ||
+        offset + sizeof(header) + header.payloadSize > size)
+    {
+        return false;
+    }
+
+    buffer.resize(header.payloadSize);
+    if ((header.payloadSize && 1 != fread(buffer.data(), header.payloadSize, 1, pFile)) ||
+        header.payloadCrc != RgbdChunkCrc(header, buffer.data(), version))
+    {
+        return false;
+    }
+
+    chunk.entry.timestamp   = header.timestamp;
+    chunk.entry.frameNumber = header.frameNumber;
+    chunk.entry.payloadSize = header.payloadSize;
+    chunk.entry.width       = header.width;
+    chunk.entry.height      = header.height;
+    chunk.entry.stream      = header.stream;
+    chunk.entry.format      = header.format;
+    chunk.entry.codec       = header.codec;
+    chunk.size              = sizeof(header) + header.payloadSize;
+    chunk.frame             = true;
+    return true;
+}
@@ -0,0 +1,151 @@
+//------------------------------------------------------------------------------
+// <copyright file="RgbdRecovery.h">
+//     Restoring container files of a recording which did not end normally.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "RgbdContainer.h"
+#include "TaskPool.h"
+
+// Outcome of the recovery of a container file
+struct RgbdRecoveryResult
+{
+    std::string path;
+    bool        intact;             // The index footer is valid, the file was left alone
+    bool        recovered;          // The file was cut after its last valid frame and its index written
+    uint64_t    frames;             // Frames in the index
+    uint64_t    checkpointFrames;   // Frames listed by checkpoints, which were not read again
+    uint64_t    scannedBytes;       // Bytes after the last checkpoint whose chunks were verified
+    uint64_t    droppedBytes;       // Bytes cut off after the last valid frame
+    std::string error;              // Why the file could not be recovered
+};
+
+/// <summary>
+/// Restores container files left without index footer, e.g. when the recorder was killed or the machine
+/// lost power. The frames listed by the last intact checkpoint are on disk and are taken from the
+/// checkpoints without reading them; only the chunks after it are verified, split into ranges which are
+/// scanned in parallel, each resynchronizing on the next chunk which passes its checksum. The file is cut
+/// after the last frame which continues the chain of intact chunks, and the index footer is appended, so
+/// recovering a long session takes about as long as reading the last seconds of it.
+/// </summary>
+class RgbdRecovery
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="pool">Pool the files are scanned on, must outlive the recovery</param>
+    explicit RgbdRecovery(TaskPool& pool);
+
+    static const uint64_t DefaultRangeBytes = 16 << 20;    // Bytes of a file scanned by one task
+
+    /// <summary>
+    /// Set the size of the ranges a file is split into for scanning
+    /// </summary>
+    /// <param name="bytes">Bytes of a range</param>
+    void SetRangeBytes(uint64_t bytes) { m_rangeBytes = bytes ? bytes : (uint64_t)DefaultRangeBytes; }
+
+    /// <summary>
+    /// Recover container files, all of them in parallel. Must not be called from a task of the pool
+    /// </summary>
+    /// <param name="paths">Paths of the container files</param>
+    /// <param name="results">Receives the outcome for each file, in the order given</param>
+    void Recover(const std::vector<std::string>& paths, std::vector<RgbdRecoveryResult>& results);
+
+    /// <summary>
+    /// Find the container files of a session
+    /// </summary>
+    /// <param name="path">A container file, or a session directory whose container files and those
+    /// of its segment directories are collected</param>
+    /// <param name="paths">Receives the paths of the container files, sorted</param>
+    /// <returns>False if the path is neither a file nor a directory</returns>
+    static bool FindContainers(const std::string& path, std::vector<std::string>& paths);
+
+private:
+    // A chunk which passed its checksum
+    struct Chunk
+    {
+        RgbdIndexEntry  entry;          // Offset set for checkpoints too
+        uint64_t        size;           // Bytes of the chunk including its header
+        bool            frame;          // False for a checkpoint
+    };
+
+    // Part of a file scanned by one task
+    struct Range
+    {
+        uint64_t            begin;      // Chunks starting at or after begin and before end belong to the range
+        uint64_t            end;
+        std::vector<Chunk>  chunks;     // Consecutive chunks from the first one found
+    };
+
+    // Recovery state of one file
+    struct File
+    {
+        RgbdRecoveryResult          result;
+        uint32_t                    version;
+        uint64_t                    size;
+        uint64_t                    scanStart;  // Offset just past the last intact checkpoint, or of the first chunk
+        std::vector<RgbdIndexEntry> index;      // Frames listed by the checkpoints
+        std::vector<Range>          ranges;
+    };
+
+    /// <summary>
+    /// Check the footer and take the frames listed by the checkpoints of a file. Runs on the pool
+    /// </summary>
+    void Prepare(File& file) const;
+
+    /// <summary>
+    /// Verify the chunks of a range of a file. Runs on the pool
+    /// </summary>
+    /// <param name="resync">False if the range starts at a chunk, true to look for the first one</param>
+    void Scan(const File& file, Range& range, bool resync) const;
+
+    /// <summary>
+    /// Chain the chunks of the ranges, cut the file after the last one and append the index footer. Runs on the pool
+    /// </summary>
+    void Finish(File& file) const;
+
+    /// <summary>
+    /// Run tasks on the pool and wait until all of them have finished
+    /// </summary>
+    void RunAll(std::vector<TaskPool::Task>& tasks);
+
+    /// <summary>
+    /// Find the last checkpoint of a file which passes its checksums, searching back from the end
+    /// </summary>
+    /// <param name="pFile">Open container file</param>
+    /// <param name="start">Offset of the first chunk</param>
+    /// <param name="size">Size of the file</param>
+    /// <param name="checkpoint">Receives the checkpoint</param>
+    /// <param name="entries">Receives the index entries of the checkpoint</param>
+    /// <returns>Offset of the checkpoint, 0 if there is none</returns>
+    static uint64_t FindLastCheckpoint(FILE* pFile, uint64_t start, uint64_t size, RgbdCheckpoint& checkpoint, std::vector<RgbdIndexEntry>& entries);
+
+    /// <summary>
+    /// Read a checkpoint and its index entries and check both checksums
+    /// </summary>
+    /// <returns>True if the checkpoint is intact and ends within the file</returns>
+    static bool ReadCheckpoint(FILE* pFile, uint64_t offset, uint64_t size, RgbdCheckpoint& checkpoint, std::vector<RgbdIndexEntry>& entries);
+
+    /// <summary>
+    /// Read the chunk at an offset and check its checksum
+    /// </summary>
+    /// <param name="pFile">Open container file</param>
+    /// <param name="offset">Offset of the chunk</param>
+    /// <param name="size">Size of the file</param>
+    /// <param name="version">Version of the file</param>
+    /// <param name="buffer">Scratch memory for the payload</param>
+    /// <param name="chunk">Receives the chunk</param>
+    /// <returns>True if an intact frame or checkpoint starts at the offset</returns>
+    static bool ReadChunk(FILE* pFile, uint64_t offset, uint64_t size, uint32_t version, std::vector<uint8_t>& buffer, Chunk& chunk);
+
+private:
+    TaskPool&   m_pool;
+    uint64_t    m_rangeBytes;
+};
@@ -0,0 +1,3476 @@
+//------------------------------------------------------------------------------
+// <copyright file="RgbdTool.cpp">
+//     Command line tool to list, extract, verify, index, recover, capture and benchmark recorded sessions.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <codecvt>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <locale>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../RecordingReader.h"
+#include "../CaptureProfile.h"
+#include "../CaptureSession.h"
+#include "../CaptureStreams.h"
+#include "../DepthSplit.h"
+#include "../EventDispatcher.h"
+#include "../FrameAssociator.h"
+#include "../FramePath.h"
+#include "../FramePool.h"
+#include "../FrameRecorder.h"
+#include "../FrameWriters.h"
+#include "../JpegCodec.h"
+#include "../Pipeline.h"
+#include "../PreTriggerBuffer.h"
+#include "../QoiCodec.h"
+#include "../RecordingSegments.h"
+#include "../RgbdContainer.h"
+#include "../RgbdRecovery.h"
+#include "../RvlCodec.h"
+#include "../SessionTranscoder.h"
+#include "../SyntheticSensorSource.h"
+#include "../TaskPool.h"
+#include "../TemporalDepthCodec.h"
+#include "../TripleBuffer.h"
+
+#ifdef RGBDTOOL_WITH_OPENCV
+#include <opencv2/opencv.hpp>
+#endif
+
+#ifdef _WIN32
+#include <direct.h>
+#define MakeDirectory(path) _mkdir(path)
+#define RemoveEmptyDirectory(path) _rmdir(path)
+#define ChangeDirectory(path) _chdir(path)
+#else
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MakeDirectory(path) mkdir(path, 0755)
+#define RemoveEmptyDirectory(path) rmdir(path)
+#define ChangeDirectory(path) chdir(path)
+#endif
+
+/// <summary>
+/// Get printable name of a stream
+/// </summary>
+static const char* StreamName(uint8_t stream)
+{
+    switch (stream)
+    {
+    case RecordStreamColor: return "color";
+    case RecordStreamDepth: return "depth";
+    default:                return "unknown";
+    }
+}
+
+/// <summary>
+/// Get printable name of a pixel format
+/// </summary>
+static const char* FormatName(uint8_t format)
+{
+    switch (format)
+    {
+    case RecordPixelFormatBgra32:       return "bgra32";
+    case RecordPixelFormatDepthPixel32: return "depthpixel32";
+    default:                            return "unknown";
+    }
+}
+
+/// <summary>
+/// Store a 16-bit value little-endian
+/// </summary>
+static void PutLE16(uint8_t* p, uint16_t value)
+{
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+}
+
+/// <summary>
+/// Store a 32-bit value little-endian
+/// </summary>
+static void PutLE32(uint8_t* p, uint32_t value)
+{
+    PutLE16(p, (uint16_t)value);
+    PutLE16(p + 2, (uint16_t)(value >> 16));
+}
+
+/// <summary>
+/// Write a top-down 32-bit bitmap, the same layout the capture application writes
+/// </summary>
+static bool WriteBitmap(const std::string& path, const uint8_t* pPixels, uint32_t width, uint32_t height, uint32_t stride)
+{
+    FILE* pFile = fopen(path.c_str(), "wb");
+    if (!pFile)
+    {
+        return false;
+    }
+
+    uint8_t header[54] = {0};
+    uint32_t imageSize = width * height * 4;
+    header[0] = 'B';
+    header[1] = 'M';
+    PutLE32(header + 2, sizeof(header) + imageSize);
+    PutLE32(header + 10, sizeof(header));
+    PutLE32(header + 14, 40);
+    PutLE32(header + 18, width);
+    PutLE32(header + 22, (uint32_t)(-(int32_t)height));
+    PutLE16(header + 26, 1);
+    PutLE16(header + 28, 32);
+
+    bool result = (1 == fwrite(header, sizeof(header), 1, pFile));
+    for (uint32_t y = 0; result && y < height; y++)
+    {
+        result = (1 == fwrite(pPixels + (size_t)y * stride, width * 4, 1, pFile));
+    }
+
+    fclose(pFile);
+    return result;
+}
+
+/// <summary>
+/// Write 16-bit depth values as a binary PGM image
+/// </summary>
+static bool WriteDepthPgm(const std::string& path, const uint16_t* pDepth, uint32_t width, uint32_t height)
+{
+    FILE* pFile = fopen(path.c_str(), "wb");
+    if (!pFile)
+    {
+        return false;
+    }
+
+    fprintf(pFile, "P5\n%u %u\n65535\n", width, height);
+
+    // PGM samples are big-endian
+    std::vector<uint8_t> row(width * 2);
+    bool result = true;
+    for (uint32_t y = 0; result && y < height; y++)
+    {
+        for (uint32_t x = 0; x < width; x++)
+        {
+            uint16_t value = pDepth[(size_t)y * width + x];
+            row[x * 2]     = (uint8_t)(value >> 8);
+            row[x * 2 + 1] = (uint8_t)value;
+        }
+        result = (1 == fwrite(row.data(), row.size(), 1, pFile));
+    }
+
+    fclose(pFile);
+    return result;
+}
+
+/// <summary>
+/// Decode the payload of a chunk into raw frame pixels. Chunks of a stream must be decoded in order
+/// </summary>
+static bool DecodePayload(const RgbdChunkHeader& header, const std::vector<uint8_t>& payload, FrameDecoder& decoder, RecordFrame& frame)
+{
+    frame.stream      = (RecordStream)header.stream;
+    frame.format      = (RecordPixelFormat)header.format;
+    frame.width       = header.width;
+    frame.height      = header.height;
+    frame.stride      = header.stride;
+    frame.frameNumber = header.frameNumber;
+    frame.timestamp   = header.timestamp;
+
+    return decoder.Decode((RecordCodec)header.codec, payload.data(), payload.size(), frame);
+}
+
+/// <summary>
+/// Print the index of a container
+/// </summary>
+static int List(const std::string& path)
+{
+    RgbdContainerReader reader;
+    if (!reader.Open(path))
+    {
+        fprintf(stderr, "Cannot open container %s\n", path.c_str());
+        return 1;
+    }
+
+    printf("# %s: %u frames, index %s\n", path.c_str(), (unsigned)reader.GetFrameCount(),
+        reader.HasIndexFooter() ? "footer" : "rebuilt by scanning");
+    printf("# index stream frame timestamp width height format codec bytes\n");
+
+    uint64_t frames[RecordStreamCount]      = { 0 };
+    uint64_t rawBytes[RecordStreamCount]    = { 0 };
+    uint64_t storedBytes[RecordStreamCount] = { 0 };
+
+    for (size_t i = 0; i < reader.GetFrameCount(); i++)
+    {
+        const RgbdIndexEntry& entry = reader.GetEntry(i);
+        printf("%u %s %u %.6f %u %u %s %s %u\n",
+            (unsigned)i, StreamName(entry.stream), entry.frameNumber, entry.timestamp,
+            entry.width, entry.height, FormatName(entry.format), GetCodecName((RecordCodec)entry.codec), entry.payloadSize);
+
+        if (entry.stream < RecordStreamCount)
+        {
+            ++frames[entry.stream];
+            rawBytes[entry.stream]    += (uint64_t)entry.width * entry.height * 4;
+            storedBytes[entry.stream] += entry.payloadSize;
+        }
+    }
+
+    // Compression ratio of the session, relative to the frames as copied from the sensor
+    for (int stream = 0; stream < RecordStreamCount; stream++)
+    {
+        if (frames[stream])
+        {
+            printf("# %s: %llu frames, %.1f MB raw, %.1f MB stored, ratio %.2f\n", StreamName((uint8_t)stream),
+                (unsigned long long)frames[stream], rawBytes[stream] / (1024.0 * 1024.0), storedBytes[stream] / (1024.0 * 1024.0),
+                storedBytes[stream] ? (double)rawBytes[stream] / storedBytes[stream] : 0.0);
+        }
+    }
+
+    return 0;
+}
+
+/// <summary>
+/// Extract all frames of a container into the folder layout written by the capture application
+/// </summary>
+static int Extract(const std::string& path, const std::string& outDir)
+{
+    RgbdContainerReader reader;
+    if (!reader.Open(path))
+    {
+        fprintf(stderr, "Cannot open container %s\n", path.c_str());
+        return 1;
+    }
+
+    MakeDirectory(outDir.c_str());
+    MakeDirectory((outDir + "/rgb").c_str());
+    MakeDirectory((outDir + "/depth").c_str());
+
+    FILE* pRgbLog   = fopen((outDir + "/rgb.txt").c_str(), "w");
+    FILE* pDepthLog = fopen((outDir + "/depth.txt").c_str(), "w");
+    if (!pRgbLog || !pDepthLog)
+    {
+        fprintf(stderr, "Cannot create output files in %s\n", outDir.c_str());
+        if (pRgbLog)   fclose(pRgbLog);
+        if (pDepthLog) fclose(pDepthLog);
+        return 1;
+    }
+
+    int failures = 0;
+    FrameDecoder         decoders[RecordStreamCount];
+    RgbdChunkHeader      header;
+    std::vector<uint8_t> payload;
+    RecordFrame          frame;
+    std::vector<uint16_t> depth;
+    char name[64];
+
+    for (size_t i = 0; i < reader.GetFrameCount(); i++)
+    {
+        if (!reader.ReadChunk(i, header, payload) || header.stream >= RecordStreamCount)
+        {
+            fprintf(stderr, "Frame %u: cannot read\n", (unsigned)i);
+            ++failures;
+            continue;
+        }
+
+        bool written = false;
+        if (RecordCodecJpeg == header.codec)
+        {
+            // No JPEG decoder here, the payload already is the image file
+            snprintf(name, sizeof(name), "rgb/rgb_%.6f.jpg", header.timestamp);
+            FILE* pFile = fopen((outDir + "/" + name).c_str(), "wb");
+            if (pFile)
+            {
+                written = payload.size() == fwrite(payload.data(), 1, payload.size(), pFile);
+                fclose(pFile);
+            }
+            if (written)
+            {
+                fprintf(pRgbLog, "%.6f\t%s\n", header.timestamp, name);
+            }
+        }
+        else if (!DecodePayload(header, payload, decoders[header.stream], frame))
+        {
+            fprintf(stderr, "Frame %u: cannot decode\n", (unsigned)i);
+            ++failures;
+            continue;
+        }
+        else if (RecordPixelFormatBgra32 == frame.format)
+        {
+            snprintf(name, sizeof(name), "rgb/rgb_%.6f.bmp", frame.timestamp);
+            written = WriteBitmap(outDir + "/" + name, frame.data.data(), frame.width, frame.height, frame.stride);
+            if (written)
+            {
+                fprintf(pRgbLog, "%.6f\t%s\n", frame.timestamp, name);
+            }
+        }
+        else if (RecordPixelFormatDepthPixel32 == frame.format)
+        {
+            // NUI_DEPTH_IMAGE_PIXEL holds the player index in the low and the depth in the high 16 bits
+            depth.resize((size_t)frame.width * frame.height);
+            for (uint32_t y = 0; y < frame.height; y++)
+            {
+                SplitDepthPixels(reinterpret_cast<const uint16_t*>(frame.data.data() + (size_t)y * frame.stride), frame.width,
+                                 depth.data() + (size_t)y * frame.width, nullptr);
+            }
+
+            snprintf(name, sizeof(name), "depth/depth_%.6f.pgm", frame.timestamp);
+            written = WriteDepthPgm(outDir + "/" + name, depth.data(), frame.width, frame.height);
+            if (written)
+            {
+                fprintf(pDepthLog, "%.6f\t%s\n", frame.timestamp, name);
+            }
+        }
+
+        if (!written)
+        {
+            fprintf(stderr, "Frame %u: cannot write %s frame\n", (unsigned)i, FormatName(header.format));
+            ++failures;
+        }
+    }
+
+    fclose(pRgbLog);
+    fclose(pDepthLog);
+
+    printf("Extracted %u frames, %d failures\n", (unsigned)reader.GetFrameCount(), failures);
+    return failures ? 1 : 0;
+}
+
+/// <summary>
+/// Check the index footer and the checksum of every chunk
+/// </summary>
+static int Verify(const std::string& path)
+{
+    RgbdContainerReader reader;
+    if (!reader.Open(path))
+    {
+        fprintf(stderr, "Cannot open container %s\n", path.c_str());
+        return 1;
+    }
+
+    int failures = 0;
+    if (!reader.HasIndexFooter())
+    {
+        printf("Index footer missing or damaged, index rebuilt by scanning\n");
+        ++failures;
+    }
+
+    std::string error;
+    for (size_t i = 0; i < reader.GetFrameCount(); i++)
+    {
+        if (!reader.VerifyChunk(i, error))
+        {
+            printf("Frame %u: %s\n", (unsigned)i, error.c_str());
+            ++failures;
+        }
+    }
+
+    printf("%s: %u frames, %d problems\n", path.c_str(), (unsigned)reader.GetFrameCount(), failures);
+    return failures ? 1 : 0;
+}
+
+/// <summary>
+/// Generate the index file of a session folder and print what it covers
+/// </summary>
+static int Index(const std::string& folder)
+{
+    if (!RecordingReader::BuildFolderIndex(folder))
+    {
+        fprintf(stderr, "Cannot index session folder %s\n", folder.c_str());
+        return 1;
+    }
+
+    RecordingReader reader;
+    if (!reader.Open(folder))
+    {
+        fprintf(stderr, "Cannot open session folder %s\n", folder.c_str());
+        return 1;
+    }
+
+    for (int stream = 0; stream < RecordStreamCount; stream++)
+    {
+        size_t count = reader.GetFrameCount((RecordStream)stream);
+        if (count)
+        {
+            printf("%-5s %6u frames  %.6f - %.6f\n", StreamName((uint8_t)stream), (unsigned)count,
+                reader.GetTimestamp((RecordStream)stream, 0), reader.GetTimestamp((RecordStream)stream, count - 1));
+        }
+    }
+
+    return 0;
+}
+
+/// <summary>
+/// Cut the container files of a session after their last intact frame and rebuild their index
+/// </summary>
+static int Recover(const std::string& path)
+{
+    std::vector<std::string> paths;
+    if (!RgbdRecovery::FindContainers(path, paths))
+    {
+        fprintf(stderr, "Cannot open %s\n", path.c_str());
+        return 1;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    TaskPool                        pool;
+    RgbdRecovery                    recovery(pool);
+    std::vector<RgbdRecoveryResult> results;
+    recovery.Recover(paths, results);
+
+    int failures = 0;
+    for (const RgbdRecoveryResult& result : results)
+    {
+        if (!result.error.empty())
+        {
+            printf("%s: %s\n", result.path.c_str(), result.error.c_str());
+            ++failures;
+        }
+        else if (result.intact)
+        {
+            printf("%s: intact, %u frames\n", result.path.c_str(), (unsigned)result.frames);
+        }
+        else
+        {
+            printf("%s: recovered %u frames, %u from checkpoints, %.1f MB verified, %u bytes cut off\n",
+                result.path.c_str(), (unsigned)result.frames, (unsigned)result.checkpointFrames,
+                result.scannedBytes / 1e6, (unsigned)result.droppedBytes);
+        }
+    }
+
+    printf("%u files, %d failures, %.2f s\n", (unsigned)results.size(), failures,
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    return failures ? 1 : 0;
+}
+
+#ifdef RGBDTOOL_WITH_OPENCV
+/// <summary>
+/// Decode a PNG or JPEG file of a session folder with OpenCV. 16-bit images are depth planes
+/// written without player index, 8-bit ones color images
+/// </summary>
+static bool DecodeImage(RecordCodec codec, const uint8_t* pData, size_t size, RecordFrame& frame)
+{
+    (void)codec;
+
+    cv::Mat image = cv::imdecode(cv::Mat(1, (int)size, CV_8UC1, const_cast<uint8_t*>(pData)), cv::IMREAD_UNCHANGED);
+    if (image.empty())
+    {
+        return false;
+    }
+
+    frame.width  = (uint32_t)image.cols;
+    frame.height = (uint32_t)image.rows;
+    frame.stride = frame.width * 4;
+    frame.data.resize((size_t)frame.stride * frame.height);
+
+    if (CV_16UC1 == image.type())
+    {
+        frame.format = RecordPixelFormatDepthPixel32;
+        for (uint32_t y = 0; y < frame.height; y++)
+        {
+            const uint16_t* pDepth = image.ptr<uint16_t>(y);
+            uint16_t*       pPixel = reinterpret_cast<uint16_t*>(frame.data.data() + (size_t)y * frame.stride);
+            for (uint32_t x = 0; x < frame.width; x++)
+            {
+                pPixel[2 * x]     = 0;
+                pPixel[2 * x + 1] = pDepth[x];
+            }
+        }
+        return true;
+    }
+
+    cv::Mat bgra(image.rows, image.cols, CV_8UC4, frame.data.data(), frame.stride);
+    switch (image.type())
+    {
+    case CV_8UC3:   cv::cvtColor(image, bgra, cv::COLOR_BGR2BGRA);   break;
+    case CV_8UC4:   image.copyTo(bgra);                             break;
+    default:        return false;
+    }
+
+    frame.format = RecordPixelFormatBgra32;
+    return true;
+}
+#endif
+
+/// <summary>
+/// Convert a session into a session folder of compact files or a container, resuming an interrupted run
+/// </summary>
+static int Transcode(const std::string& input, const std::string& output, int argc, char* argv[])
+{
+    bool        container = false;
+    std::string color     = "qoi";
+    std::string depth     = "rvl";
+    for (int i = 0; i < argc; i++)
+    {
+        std::string option = argv[i];
+        if ("--container" == option)
+        {
+            container = true;
+        }
+        else if ("--color" == option && i + 1 < argc)
+        {
+            color = argv[++i];
+        }
+        else if ("--depth" == option && i + 1 < argc)
+        {
+            depth = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option %s\n", option.c_str());
+            return 2;
+        }
+    }
+
+    TaskPool          pool;
+    SessionTranscoder transcoder(pool);
+    unsigned          workers = pool.GetWorkerCount();
+
+    if ("qoi" == color)
+    {
+        transcoder.SetEncoder(RecordStreamColor, []() { return new QoiColorEncoder(); }, workers);
+    }
+    else if ("raw" == color && container)
+    {
+        transcoder.SetEncoder(RecordStreamColor, nullptr, 1);
+    }
+    else
+    {
+        fprintf(stderr, "Color codec %s is not lossless or needs --container\n", color.c_str());
+        return 2;
+    }
+
+    if ("rvl" == depth)
+    {
+        transcoder.SetEncoder(RecordStreamDepth, []() { return new RvlDepthEncoder(); }, workers);
+    }
+    else if ("tdp" == depth)
+    {
+        // Predicted from the previous frame, so one encoder sees every frame
+        transcoder.SetEncoder(RecordStreamDepth, []() { return new TemporalDepthEncoder(); }, 1);
+    }
+    else
+    {
+        fprintf(stderr, "Depth codec %s is not lossless\n", depth.c_str());
+        return 2;
+    }
+
+#ifdef RGBDTOOL_WITH_OPENCV
+    transcoder.SetImageDecoder(DecodeImage);
+#endif
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    std::string error;
+    if (!transcoder.Transcode(input, output, container, error))
+    {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+
+    double                 seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    SessionTranscoderStats stats   = transcoder.GetStats();
+    uint64_t               frames  = stats.frames[RecordStreamColor] + stats.frames[RecordStreamDepth];
+    for (int i = 0; i < RecordStreamCount; i++)
+    {
+        printf("%-5s %u transcoded, %u resumed, %u failed, %u mismatched\n", StreamName((uint8_t)i),
+            (unsigned)stats.frames[i], (unsigned)stats.resumed[i], (unsigned)stats.failures[i], (unsigned)stats.mismatches[i]);
+    }
+    printf("%.1f MB in, %.1f MB out, %.1f fps, %.2f s\n", stats.inputBytes / 1e6, stats.outputBytes / 1e6,
+        seconds > 0 ? frames / seconds : 0.0, seconds);
+
+    uint64_t failed = 0;
+    for (int i = 0; i < RecordStreamCount; i++)
+    {
+        failed += stats.failures[i] + stats.mismatches[i];
+    }
+    return failed ? 1 : 0;
+}
+
+static CaptureSession* volatile s_pCaptureSession = nullptr;     // Session Ctrl+C stops
+
+/// <summary>
+/// Stop the capture on Ctrl+C. Only sets a flag, the capture winds down on the main thread
+/// </summary>
+static void StopCapture(int)
+{
+    CaptureSession* pSession = s_pCaptureSession;
+    if (pSession)
+    {
+        pSession->RequestStop();
+    }
+}
+
+/// <summary>
+/// Run a capture from a profile with a replay or generated frames in place of a sensor, as KinectExplorer
+/// /headless does with one, so the whole capture path can be load-tested on any machine
+/// </summary>
+static int Capture(const std::string& profilePath)
+{
+    CaptureProfile profile;
+    std::string    error;
+    if (!LoadCaptureProfile(profilePath.c_str(), profile, error))
+    {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+
+    if (CaptureSourceKinect == profile.source)
+    {
+        fprintf(stderr, "%s: captures from a sensor, set source = replay or synthetic\n", profilePath.c_str());
+        return 2;
+    }
+
+    ReplaySensorSource::ImageDecoder decodeImage;
+#ifdef RGBDTOOL_WITH_OPENCV
+    decodeImage = DecodeImage;
+#endif
+
+    std::unique_ptr<SensorSource> pSource(CreateStandInSource(profile, decodeImage, error));
+    if (!pSource)
+    {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+
+    // The session enters the recording directory, everything after it writes there
+    CaptureSession session(profile);
+    if (!session.Open(error))
+    {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+
+    uint64_t frames[CaptureStreamCount] = {};
+    double   seconds = 0.0;
+    {
+        CaptureStreams streams(*pSource, session);
+        if (!session.Start() || !streams.Start())
+        {
+            fprintf(stderr, "Streams of the source cannot be started\n");
+            streams.Stop();
+            pSource.reset();
+            return 1;
+        }
+
+        printf("Capturing color %ux%u and depth %ux%u from %s at %s\n",
+            streams.GetColorStream().GetWidth(), streams.GetColorStream().GetHeight(),
+            streams.GetDepthStream().GetWidth(), streams.GetDepthStream().GetHeight(),
+            CaptureSourceReplay == profile.source ? profile.replayPath.c_str() : "generated frames",
+            profile.speed > 0.0 ? "real time" : "full speed");
+        fflush(stdout);
+
+        s_pCaptureSession = &session;
+        signal(SIGINT, StopCapture);
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        session.Run([&](uint64_t counts[CaptureStreamCount]) { return streams.CountFrames(counts); }, stdout);
+
+        // The source sets the frame ready events of the streams until it is gone
+        streams.Stop();
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        signal(SIGINT, SIG_DFL);
+        s_pCaptureSession = nullptr;
+
+        streams.CountFrames(frames);
+        pSource.reset();
+    }
+    session.Stop();
+
+    FrameRecorderStats stats[RecordStreamCount];
+    for (int i = 0; i < RecordStreamCount; i++)
+    {
+        stats[i] = session.GetRecorder().GetStats((RecordStream)i);
+    }
+
+    printf("%u + %u frames captured, %u skeleton frames, %u + %u written, %u + %u dropped, %.1f fps, %.2f s\n",
+        (unsigned)frames[CaptureStreamColor], (unsigned)frames[CaptureStreamDepth], (unsigned)frames[CaptureStreamSkeleton],
+        (unsigned)stats[RecordStreamColor].framesWritten, (unsigned)stats[RecordStreamDepth].framesWritten,
+        (unsigned)stats[RecordStreamColor].framesDropped, (unsigned)stats[RecordStreamDepth].framesDropped,
+        seconds > 0.0 ? (frames[CaptureStreamColor] + frames[CaptureStreamDepth]) / seconds : 0.0, seconds);
+
+    uint64_t failures = session.GetWriteFailures();
+    if (failures > 0)
+    {
+        fprintf(stderr, "%llu frames could not be written, see session.log\n", (unsigned long long)failures);
+        return 1;
+    }
+
+    return 0;
+}
+
+/// <summary>
+/// Load the frames of a stream of a recording which can be decoded without external libraries
+/// </summary>
+static bool LoadFrames(const std::string& path, RecordStream stream, RecordPixelFormat format, size_t maxFrames, std::vector<RecordFrame>& frames)
+{
+    RecordingReader reader;
+    if (!reader.Open(path))
+    {
+        fprintf(stderr, "Cannot open recording %s\n", path.c_str());
+        return false;
+    }
+
+    RecordingIterator it(reader, stream);
+    FrameDecoder      decoder;
+    FrameView         view;
+    size_t            skipped = 0;
+
+    while (frames.size() < maxFrames && it.Next(view))
+    {
+        RecordFrame frame;
+        frame.stream = stream;
+        frame.format = view.format;
+        frame.width  = view.width;
+        frame.height = view.height;
+        frame.stride = view.stride;
+        frame.frameNumber = view.frameNumber;
+        frame.timestamp   = view.timestamp;
+
+        if (format == view.format &&
+            decoder.Decode(view.codec, view.pData, view.size, frame))
+        {
+            frames.push_back(frame);
+        }
+        else
+        {
+            ++skipped;
+        }
+    }
+
+    if (skipped)
+    {
+        printf("Skipped %u %s frames which cannot be decoded here\n", (unsigned)skipped, StreamName((uint8_t)stream));
+    }
+
+    return true;
+}
+
+/// <summary>
+/// Generate depth frames resembling a Kinect scene: a static wall, a moving object in front of it,
+/// invalid (0) shadow and border areas and a little sensor noise
+/// </summary>
+static void GenerateDepthFrames(size_t count, std::vector<RecordFrame>& frames)
+{
+    const uint32_t width  = 640;
+    const uint32_t height = 480;
+    uint32_t random = 12345;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        RecordFrame frame;
+        frame.stream = RecordStreamDepth;
+        frame.format = RecordPixelFormatDepthPixel32;
+        frame.width  = width;
+        frame.height = height;
+        frame.stride = width * 4;
+        frame.data.resize((size_t)frame.stride * height);
+
+        uint16_t* pPixel = reinterpret_cast<uint16_t*>(frame.data.data());
+        uint32_t  boxLeft = 100 + (uint32_t)(i * 4) % 300;
+
+        for (uint32_t y = 0; y < height; y++)
+        {
+            for (uint32_t x = 0; x < width; x++, pPixel += 2)
+            {
+                random = random * 1103515245 + 12345;
+
+                bool inBox    = x >= boxLeft && x < boxLeft + 160 && y >= 120 && y < 400;
+                bool inShadow = x >= boxLeft + 160 && x < boxLeft + 184 && y >= 120 && y < 400;
+                uint16_t depth = (uint16_t)(inBox ? 1200 + y / 8 : 2800 + x / 2);
+
+                // Holes stay at the same place from frame to frame, the noise flickers
+                if (x < 8 || inShadow || 0 == (x * 7919 + y * 104729) % 53)
+                {
+                    depth = 0;
+                }
+                else if (0 == (random >> 16) % 8)
+                {
+                    depth = (uint16_t)(depth + ((random >> 20) % 5) - 2);
+                }
+
+                pPixel[0] = (uint16_t)(inBox && depth ? 1 : 0);
+                pPixel[1] = depth;
+            }
+        }
+
+        frames.push_back(frame);
+    }
+}
+
+/// <summary>
+/// Generate color frames resembling a camera image: smooth shading, a moving textured object
+/// and per-pixel sensor noise in every channel
+/// </summary>
+static void GenerateColorFrames(size_t count, uint32_t width, uint32_t height, std::vector<RecordFrame>& frames)
+{
+    uint32_t random = 54321;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        RecordFrame frame;
+        frame.stream = RecordStreamColor;
+        frame.format = RecordPixelFormatBgra32;
+        frame.width  = width;
+        frame.height = height;
+        frame.stride = width * 4;
+        frame.data.resize((size_t)frame.stride * height);
+
+        uint8_t* pPixel  = frame.data.data();
+        uint32_t boxLeft = 100 + (uint32_t)(i * 4) % 300;
+
+        for (uint32_t y = 0; y < height; y++)
+        {
+            for (uint32_t x = 0; x < width; x++, pPixel += 4)
+            {
+                random = random * 1103515245 + 12345;
+
+                bool inBox = x >= boxLeft && x < boxLeft + 160 && y >= 120 && y < 400;
+                int  noise = (int)((random >> 16) % 5) - 2;
+                int  b, g, r;
+                if (inBox)
+                {
+                    // Checkered texture moving with the object
+                    int shade = 0 == (((x - boxLeft) / 16 + y / 16) & 1) ? 40 : 0;
+                    b = 60 + shade;
+                    g = 90 + shade;
+                    r = 170 + shade;
+                }
+                else
+                {
+                    b = 120 + (int)(x / 8);
+                    g = 110 + (int)(y / 6);
+                    r = 100 + (int)((x + y) / 16);
+                }
+
+                pPixel[0] = (uint8_t)(b + noise);
+                pPixel[1] = (uint8_t)(g + noise);
+                pPixel[2] = (uint8_t)(r + noise);
+                pPixel[3] = 255;
+            }
+        }
+
+        frames.push_back(frame);
+    }
+}
+
+/// <summary>
+/// Get seconds elapsed since a point in time
+/// </summary>
+static double SecondsSince(const std::chrono::steady_clock::time_point& start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/// <summary>
+/// Print one line of benchmark results. Rates and ratios refer to the bytes the default
+/// writer stores: the 16-bit depth plane written to PNG, and the 32-bit color frame written to BMP
+/// </summary>
+static void PrintBenchResult(const char* pName, size_t frames, double planeBytes, double encodedBytes, double encodeSeconds, double decodeSeconds)
+{
+    const double MB = 1024.0 * 1024.0;
+
+    printf("%-5s %6u %10.1f %10.1f %8.2f %12.1f %10.0f", pName, (unsigned)frames,
+        planeBytes / MB, encodedBytes / MB, encodedBytes > 0 ? planeBytes / encodedBytes : 0.0, planeBytes / MB / encodeSeconds,
+        frames / encodeSeconds);
+    if (decodeSeconds > 0)
+    {
+        printf(" %12.1f\n", planeBytes / MB / decodeSeconds);
+    }
+    else
+    {
+        printf(" %12s\n", "-");
+    }
+}
+
+/// <summary>
+/// Time an encoder and its decoder on a sequence of frames and print the results
+/// </summary>
+/// <returns>Number of frames which did not decode to the exact input</returns>
+static int BenchEncoder(FrameEncoder& encoder, const std::vector<RecordFrame>& frames, double planeBytes)
+{
+    std::vector<std::vector<uint8_t>> payloads(frames.size());
+
+    encoder.Reset();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        encoder.Encode(frames[i], payloads[i]);
+    }
+    double encodeSeconds = SecondsSince(start);
+
+    FrameDecoder             decoder;
+    std::vector<RecordFrame> decoded(frames.size());
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        decoder.Decode(encoder.GetCodec(), payloads[i].data(), payloads[i].size(), decoded[i]);
+    }
+    double decodeSeconds = SecondsSince(start);
+
+    int mismatches = 0;
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        const RecordFrame& frame = frames[i];
+        bool equal = decoded[i].width == frame.width && decoded[i].height == frame.height;
+        for (uint32_t y = 0; equal && y < frame.height; y++)
+        {
+            equal = 0 == memcmp(decoded[i].data.data() + (size_t)y * decoded[i].stride,
+                                frame.data.data() + (size_t)y * frame.stride, frame.width * 4);
+        }
+        if (!equal)
+        {
+            ++mismatches;
+        }
+    }
+
+    PrintBenchResult(GetCodecName(encoder.GetCodec()), frames.size(), planeBytes,
+        (double)encoder.GetStats().encodedBytes, encodeSeconds, decodeSeconds);
+    return mismatches;
+}
+
+/// <summary>
+/// Check that an encoder turns away a frame whose rows are narrower than its width and one whose
+/// pixels are cut short, rather than reading past the rows or the buffer
+/// </summary>
+/// <returns>Number of malformed frames encoded</returns>
+static int BenchMalformedFrames(FrameEncoder& encoder, const RecordFrame& frame)
+{
+    RecordFrame narrow = frame;
+    narrow.stride = frame.width * 4 - 4;
+
+    RecordFrame cut = frame;
+    cut.data.resize((size_t)frame.stride * frame.height - 1);
+
+    std::vector<uint8_t> payload;
+    int violations = (encoder.Encode(narrow, payload) ? 1 : 0) + (encoder.Encode(cut, payload) ? 1 : 0);
+    if (violations)
+    {
+        printf("%s encoded a malformed frame\n", GetCodecName(encoder.GetCodec()));
+    }
+
+    return violations;
+}
+
+/// <summary>
+/// Check that the decoder of a depth codec turns away a payload whose header claims 65535 x 65535 pixels,
+/// as a damaged file may, rather than allocating 17 GB for it
+/// </summary>
+/// <returns>Number of oversized payloads decoded</returns>
+static int BenchOversizedPayload(FrameEncoder& encoder, const RecordFrame& frame)
+{
+    // A keyframe, so the decoder needs no earlier payload. Both headers start with magic, width and height
+    std::vector<uint8_t> payload;
+    encoder.Reset();
+    if (!encoder.Encode(frame, payload))
+    {
+        return 1;
+    }
+    const uint16_t size = 0xFFFF;
+    memcpy(payload.data() + sizeof(uint32_t), &size, sizeof(size));
+    memcpy(payload.data() + sizeof(uint32_t) + sizeof(uint16_t), &size, sizeof(size));
+
+    FrameDecoder decoder;
+    RecordFrame  decoded;
+    bool accepted = decoder.Decode(encoder.GetCodec(), payload.data(), payload.size(), decoded);
+    int violations = (accepted || decoded.data.size() > frame.data.size()) ? 1 : 0;
+    if (violations)
+    {
+        printf("%s allocated %.1f MB for a payload of 65535 x 65535 pixels\n", GetCodecName(encoder.GetCodec()),
+            decoded.data.size() / 1e6);
+    }
+
+    return violations;
+}
+
+/// <summary>
+/// Write temporally predicted depth frames encoding each one ahead of storing the one before, as the
+/// recorder does, and make one store fail by moving the folder away. Check that the frame predicted from
+/// the lost one is turned away, that the encoder starts over with a keyframe, and that every stored
+/// payload decodes in order to the exact pixels
+/// </summary>
+/// <returns>Number of violations found</returns>
+static int BenchLostPayload(const std::vector<RecordFrame>& source)
+{
+    const size_t Frames    = 30;
+    const size_t LostFrame = 10;
+    const char*  pSession  = "rgbdtool_bench_lost";
+
+    std::vector<RecordFrame> frames(source.begin(), source.begin() + std::min(Frames, source.size()));
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        frames[i].timestamp = 1300000000.0 + i / 30.0;
+    }
+
+    EncodedFrameWriter writer(RecordStreamDepth, new TemporalDepthEncoder(), pSession);
+    int violations = !writer.Open() ? 1 : 0;
+
+    std::string folder    = std::string(pSession) + "/depth";
+    std::string moved     = folder + "_moved";
+    EncodedFrame encoded[2];
+    std::vector<std::vector<uint8_t>> stored;
+    std::vector<size_t>               storedFrames;
+
+    violations += !writer.EncodeFrame(frames[0], encoded[0]) ? 1 : 0;
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        if (i + 1 < frames.size())
+        {
+            violations += !writer.EncodeFrame(frames[i + 1], encoded[(i + 1) % 2]) ? 1 : 0;
+        }
+
+        if (LostFrame == i)
+        {
+            rename(folder.c_str(), moved.c_str());
+        }
+        if (writer.StoreFrame(frames[i], encoded[i % 2]))
+        {
+            stored.push_back(encoded[i % 2].payload);
+            storedFrames.push_back(i);
+        }
+        if (LostFrame == i)
+        {
+            rename(moved.c_str(), folder.c_str());
+        }
+    }
+    writer.Close();
+
+    // The lost frame and the one encoded from it before the loss was known
+    violations += (frames.size() - 2 != stored.size()) ? 1 : 0;
+    for (size_t i = 0; i < storedFrames.size(); i++)
+    {
+        violations += (storedFrames[i] != (i < LostFrame ? i : i + 2)) ? 1 : 0;
+    }
+
+    FrameDecoder decoder;
+    RecordFrame  decoded;
+    size_t       exact = 0;
+    for (size_t i = 0; i < stored.size(); i++)
+    {
+        const RecordFrame& frame = frames[storedFrames[i]];
+        bool equal = decoder.Decode(RecordCodecTemporalDepth, stored[i].data(), stored[i].size(), decoded) &&
+                     decoded.width == frame.width && decoded.height == frame.height;
+        for (uint32_t y = 0; equal && y < frame.height; y++)
+        {
+            equal = 0 == memcmp(decoded.data.data() + (size_t)y * decoded.stride,
+                                frame.data.data() + (size_t)y * frame.stride, frame.width * 4);
+        }
+        exact += equal ? 1 : 0;
+    }
+    violations += (stored.size() != exact) ? 1 : 0;
+
+    FramePathFormatter path("depth", ".tdp", pSession);
+    for (const RecordFrame& frame : frames)
+    {
+        remove(path.Format(frame.timestamp));
+    }
+    remove((std::string(pSession) + "/depth.txt").c_str());
+    RemoveEmptyDirectory(folder.c_str());
+    RemoveEmptyDirectory(pSession);
+
+    printf("lost   tdp frame %u not stored, %u of %u frames stored, %u decoded exactly\n",
+        (unsigned)LostFrame, (unsigned)stored.size(), (unsigned)frames.size(), (unsigned)exact);
+    if (violations)
+    {
+        printf("Frames predicted from a lost payload were stored or did not decode\n");
+    }
+
+    return violations;
+}
+
+/// <summary>
+/// Time the lossless color codec on recorded or generated frames and check that it round-trips exactly
+/// </summary>
+/// <returns>Number of frames which did not decode to the exact input</returns>
+static int BenchColor(const char* pPath, size_t maxFrames)
+{
+    std::vector<RecordFrame> frames;
+    if (pPath)
+    {
+        LoadFrames(pPath, RecordStreamColor, RecordPixelFormatBgra32, maxFrames, frames);
+    }
+    else
+    {
+        GenerateColorFrames(maxFrames, 640, 480, frames);
+    }
+
+    if (frames.empty())
+    {
+        printf("No color frames to benchmark\n");
+        return 0;
+    }
+
+    double frameBytes = 0;
+    for (const RecordFrame& frame : frames)
+    {
+        frameBytes += (double)frame.width * frame.height * 4;
+    }
+
+    QoiColorEncoder qoi;
+    int mismatches = BenchEncoder(qoi, frames, frameBytes);
+
+    // JPEG is lossy and cannot be decoded here, so only encoding is timed
+    JpegColorEncoder jpeg;
+    std::vector<uint8_t> payload;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (const RecordFrame& frame : frames)
+    {
+        jpeg.Encode(frame, payload);
+    }
+    double encodeSeconds = SecondsSince(start);
+    PrintBenchResult("jpg", frames.size(), frameBytes, (double)jpeg.GetStats().encodedBytes, encodeSeconds, 0);
+
+    return mismatches;
+}
+
+/// <summary>
+/// Time the per-frame file name and frame list formatting of the capture path against the
+/// stream-based formatting it replaced, and check that both produce the same text and that long
+/// directory names are not cut
+/// </summary>
+/// <returns>Number of timestamps formatted differently</returns>
+static int BenchPaths()
+{
+    const int    Frames   = 20000;
+    const char*  pList    = "rgbdtool_bench_list.tmp";
+    const double Start    = 1700000000.0;
+
+    // String streams, UTF-8 conversion and a list file opened for every frame
+    double timestamp = Start;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < Frames; i++, timestamp += 1 / 30.0)
+    {
+        std::wstringstream wss;
+        wss << L"depth" << FRAME_PATH_SEPARATOR << L"depth_" << std::fixed << std::setprecision(6) << timestamp << L".png";
+        std::wstring wfilename = wss.str();
+        std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
+        std::string filename = converter.to_bytes(wfilename);
+
+        std::wofstream log(pList, std::ios::app);
+        log << std::fixed << std::setprecision(6) << timestamp << L"\t" << wfilename << std::endl;
+    }
+    double streamSeconds = SecondsSince(start);
+    remove(pList);
+
+    // Preformatted buffers and a list kept open
+    FramePathFormatter path("depth", ".png");
+    FrameListFile      list;
+    list.Open(pList);
+
+    timestamp = Start;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < Frames; i++, timestamp += 1 / 30.0)
+    {
+        path.Format(timestamp);
+        list.Append(timestamp, path.GetPath(), path.GetLength());
+    }
+    list.Close();
+    double bufferSeconds = SecondsSince(start);
+    remove(pList);
+
+    printf("paths  streams %.2f us/frame, buffers %.3f us/frame\n",
+        streamSeconds * 1e6 / Frames, bufferSeconds * 1e6 / Frames);
+
+    // Integer formatting must match printf, which the lists were written with so far
+    int  mismatches = 0;
+    char expected[512];
+    char actual[64];
+    uint32_t random = 777;
+    for (int i = 0; i < 100000; i++)
+    {
+        random = random * 1103515245 + 12345;
+        timestamp = Start + (random % 100000000) / 1000.0 + i / 7.0;
+
+        snprintf(expected, sizeof(expected), "%.6f", timestamp);
+        actual[FormatFixed(actual, timestamp, 6)] = '\0';
+        if (0 != strcmp(expected, actual))
+        {
+            if (0 == mismatches)
+            {
+                printf("Timestamp formatted as %s instead of %s\n", actual, expected);
+            }
+            ++mismatches;
+        }
+    }
+
+    // Directories and folders are kept whole however long they are, as are the list lines naming them
+    std::string directory(150, 'd');
+    std::string folder(80, 'f');
+    FramePathFormatter longPath(folder.c_str(), ".rvl", directory.c_str());
+    snprintf(expected, sizeof(expected), "%s%c%s%c%s_%.6f.rvl", directory.c_str(), FRAME_PATH_SEPARATOR,
+        folder.c_str(), FRAME_PATH_SEPARATOR, folder.c_str(), Start);
+    longPath.Format(Start);
+    if (strlen(expected) != longPath.GetLength() || 0 != strcmp(expected, longPath.GetPath()))
+    {
+        printf("Long path formatted as %s\n", longPath.GetPath());
+        ++mismatches;
+    }
+
+    list.Open(pList);
+    list.Append(Start, longPath.GetPath(), longPath.GetLength());
+    list.Close();
+    {
+        std::ifstream in(pList, std::ios::binary);
+        std::string line((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        mismatches += (line.size() != 19 + longPath.GetLength() || 0 != line.compare(18, longPath.GetLength(), longPath.GetPath())) ? 1 : 0;
+    }
+    remove(pList);
+
+    return mismatches;
+}
+
+/// <summary>
+/// Check every depth split kernel against the scalar one on random pixels, at all alignments and
+/// for lengths around the vector widths, and time them on the benchmark frames
+/// </summary>
+/// <returns>Number of mismatching splits</returns>
+static int BenchDepthSplit(const std::vector<RecordFrame>& frames)
+{
+    const size_t MaxCount = 200;
+
+    std::vector<uint16_t> pixels(2 * (MaxCount + 16));
+    uint32_t random = 99;
+    for (uint16_t& value : pixels)
+    {
+        random = random * 1103515245 + 12345;
+        value  = (uint16_t)(random >> 16);
+    }
+
+    int mismatches = 0;
+    std::vector<uint16_t> expectedDepth(MaxCount), depth(MaxCount + 1);
+    std::vector<uint8_t>  expectedIndex(MaxCount), index(MaxCount + 1);
+    for (int kernel = DepthSplitKernelSse2; kernel < DepthSplitKernelCount; kernel++)
+    {
+        for (size_t offset = 0; offset < 8; offset++)
+        {
+            for (size_t count = 0; count <= MaxCount; count++)
+            {
+                const uint16_t* pPixels = pixels.data() + 2 * offset;
+                SplitDepthPixels(DepthSplitKernelScalar, pPixels, count, expectedDepth.data(), expectedIndex.data());
+
+                // Sentinels behind the planes catch kernels writing too far
+                depth[count] = 0xbeef;
+                index[count] = 0xa5;
+                if (!SplitDepthPixels((DepthSplitKernel)kernel, pPixels, count, depth.data(), index.data()))
+                {
+                    break;
+                }
+
+                if (0 != memcmp(expectedDepth.data(), depth.data(), count * sizeof(uint16_t)) ||
+                    0 != memcmp(expectedIndex.data(), index.data(), count) ||
+                    0xbeef != depth[count] || 0xa5 != index[count])
+                {
+                    if (0 == mismatches)
+                    {
+                        printf("Depth split %s differs for %u pixels at offset %u\n",
+                            GetDepthSplitKernelName((DepthSplitKernel)kernel), (unsigned)count, (unsigned)offset);
+                    }
+                    ++mismatches;
+                }
+            }
+        }
+    }
+
+    // Throughput on whole frames, in megapixels per second
+    size_t framePixels = (size_t)frames[0].width * frames[0].height;
+    depth.resize(framePixels);
+    index.resize(framePixels);
+    printf("split ");
+    for (int kernel = DepthSplitKernelScalar; kernel < DepthSplitKernelCount; kernel++)
+    {
+        size_t split = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int pass = 0; pass < 10; pass++)
+        {
+            for (const RecordFrame& frame : frames)
+            {
+                if ((size_t)frame.width * frame.height == framePixels && frame.stride == frame.width * 4 &&
+                    SplitDepthPixels((DepthSplitKernel)kernel, reinterpret_cast<const uint16_t*>(frame.data.data()),
+                                     framePixels, depth.data(), index.data()))
+                {
+                    split += framePixels;
+                }
+            }
+        }
+        double seconds = SecondsSince(start);
+
+        if (split)
+        {
+            printf(" %s %.0f Mpx/s", GetDepthSplitKernelName((DepthSplitKernel)kernel), split / 1e6 / seconds);
+        }
+    }
+    printf(", using %s\n", GetDepthSplitKernelName(GetDepthSplitKernel()));
+
+    return mismatches;
+}
+
+/// <summary>
+/// Pair generated color and depth timestamps with jitter and dropped frames the way the capture
+/// path does, skipping unpaired frames, and check the pairs and the order of the released frames
+/// </summary>
+/// <returns>Number of violations found</returns>
+static int BenchAssociation()
+{
+    const int    Frames = 9000;
+    const double Period = 1 / 30.0;
+    const double Start  = 1700000000.0;
+
+    FrameAssociator associator(nullptr, ASSOCIATION_DEFAULT_TOLERANCE, true);
+    associator.Open(nullptr, nullptr);
+
+    FrameAssociator::FrameList released;
+    uint32_t random = 4242;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < Frames; i++)
+    {
+        // Depth is captured a few milliseconds after color, either may be dropped
+        for (int stream = 0; stream < RecordStreamCount; stream++)
+        {
+            random = random * 1103515245 + 12345;
+            if ((random >> 16) % 100 < 3)
+            {
+                continue;
+            }
+
+            FrameHandle frame = FrameHandle::Create();
+            frame.GetMutable()->stream    = (RecordStream)stream;
+            frame.GetMutable()->timestamp = Start + i * Period + (RecordStreamDepth == stream ? 0.007 : 0.0) + ((random >> 8) % 1000) * 1e-6;
+            associator.Add(std::move(frame), released);
+        }
+    }
+    associator.Close(released);
+    double seconds = SecondsSince(start);
+
+    FrameAssociatorStats stats = associator.GetStats();
+    int    violations = 0;
+    double last[RecordStreamCount] = { 0, 0 };
+    size_t count[RecordStreamCount] = { 0, 0 };
+    for (const FrameHandle& frame : released)
+    {
+        violations += frame->timestamp <= last[frame->stream] ? 1 : 0;
+        last[frame->stream] = frame->timestamp;
+        ++count[frame->stream];
+    }
+    violations += (count[RecordStreamColor] != stats.pairs || count[RecordStreamDepth] != stats.pairs) ? 1 : 0;
+    violations += stats.maxOffsetSeconds > ASSOCIATION_DEFAULT_TOLERANCE ? 1 : 0;
+
+    printf("assoc  %llu pairs, %llu color and %llu depth unpaired, offset %.2f ms (max %.2f), %.2f us/frame\n",
+        (unsigned long long)stats.pairs, (unsigned long long)stats.unpairedColor, (unsigned long long)stats.unpairedDepth,
+        stats.offsetSeconds * 1000 / stats.pairs, stats.maxOffsetSeconds * 1000, seconds * 1e6 / (2 * Frames));
+    if (violations)
+    {
+        printf("Association released unpaired or out of order frames\n");
+    }
+
+    return violations;
+}
+
+/// <summary>
+/// Cycle frames through a pool the way acquisition, the viewer and a writer falling behind do, across a
+/// resolution switch, check that frames out at the same time never share memory, that the viewer shares
+/// the frames of the writer instead of holding copies, and compare with heap allocation
+/// </summary>
+/// <returns>Number of violations found</returns>
+static int BenchFramePool()
+{
+    const size_t Frames    = 600;
+    const size_t InFlight  = FrameRecorder::DefaultQueueCapacity;
+    const size_t Geometries[] = { 640 * 480 * 4, 1280 * 960 * 4 };
+
+    std::vector<uint8_t> source(Geometries[1]);
+    for (size_t i = 0; i < source.size(); i++)
+    {
+        source[i] = (uint8_t)(i * 7);
+    }
+
+    FramePool pool;
+    pool.SetFrameSize(RecordStreamColor, Geometries[0]);
+
+    int violations = 0;
+    double poolSeconds = 0;
+    for (size_t geometry = 0; geometry < 2; geometry++)
+    {
+        size_t bytes = Geometries[geometry];
+        pool.SetFrameSize(RecordStreamColor, bytes);
+
+        std::deque<FrameHandle> queue;
+        FrameHandle shown;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < Frames; i++)
+        {
+            FrameHandle frame = pool.Acquire(RecordStreamColor, bytes);
+            frame.GetMutable()->data.assign(source.data(), source.data() + bytes);
+            frame.GetMutable()->data.data()[0] = (uint8_t)i;
+
+            // Published to the viewer and the writer queue
+            shown = frame;
+            queue.push_back(std::move(frame));
+            violations += 2 != shown.GetReferenceCount() ? 1 : 0;
+
+            if (queue.size() == InFlight)
+            {
+                // Every frame still carries its own first byte
+                for (size_t j = 0; j < queue.size(); j++)
+                {
+                    violations += queue[j]->data.data()[0] != (uint8_t)(i + 1 - InFlight + j) ? 1 : 0;
+                }
+
+                queue.pop_front();
+            }
+        }
+        queue.clear();
+        shown.Reset();
+        poolSeconds += SecondsSince(start);
+    }
+
+    FramePoolStats stats = pool.GetStats(RecordStreamColor);
+    violations += stats.heapFallbacks || stats.slabsInUse || stats.geometryChanges != 1 ||
+                  stats.maxSlabsInUse != InFlight || stats.slabBytes != Geometries[1] ? 1 : 0;
+
+    // The same traffic with a new frame and buffer per frame, as before the pool
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t geometry = 0; geometry < 2; geometry++)
+    {
+        size_t bytes = Geometries[geometry];
+        std::deque<std::unique_ptr<RecordFrame>> queue;
+        for (size_t i = 0; i < Frames; i++)
+        {
+            std::unique_ptr<RecordFrame> pFrame(new RecordFrame());
+            pFrame->data.assign(source.data(), source.data() + bytes);
+
+            // The viewer kept its own copy
+            std::unique_ptr<RecordFrame> pShown(new RecordFrame(*pFrame));
+            queue.push_back(std::move(pFrame));
+            if (queue.size() == InFlight)
+            {
+                queue.pop_front();
+            }
+        }
+    }
+    double heapSeconds = SecondsSince(start);
+
+    printf("pool   %llu frames, peak %llu of %llu slabs, %llu on the heap, %llu geometry change, "
+        "%.1f us/frame (heap %.1f)\n",
+        (unsigned long long)stats.acquisitions, (unsigned long long)stats.maxSlabsInUse, (unsigned long long)stats.slabCount,
+        (unsigned long long)stats.heapFallbacks, (unsigned long long)stats.geometryChanges,
+        poolSeconds * 1e6 / (2 * Frames), heapSeconds * 1e6 / (2 * Frames));
+    if (violations)
+    {
+        printf("Frame pool handed out shared or heap memory, or frames were not shared with the viewer\n");
+    }
+
+    return violations;
+}
+
+/// <summary>
+/// Publish images through a triple buffer from an acquisition thread while this thread paints them
+/// the way the viewer does, and check that every painted image is complete and never older than the
+/// one painted before
+/// </summary>
+/// <returns>Number of violations found</returns>
+static int BenchTripleBuffer()
+{
+    const uint32_t Frames = 20000;
+    const size_t   Pixels = 320 * 240;
+
+    struct Image
+    {
+        uint32_t                sequence;
+        std::vector<uint32_t>   pixels;
+    };
+
+    TripleBuffer<Image> images;
+    std::atomic<bool> done(false);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::thread producer([&]()
+    {
+        for (uint32_t i = 1; i <= Frames; i++)
+        {
+            Image& image = images.GetBack();
+            image.sequence = i;
+            image.pixels.assign(Pixels, i);
+            images.Publish();
+        }
+        done.store(true, std::memory_order_release);
+    });
+
+    int      violations = 0;
+    uint32_t last       = 0;
+    uint32_t painted    = 0;
+    for (;;)
+    {
+        bool finished = done.load(std::memory_order_acquire);
+        if (images.Update())
+        {
+            const Image& image = images.GetFront();
+            violations += image.sequence <= last ? 1 : 0;
+            for (uint32_t pixel : image.pixels)
+            {
+                if (pixel != image.sequence)
+                {
+                    ++violations;
+                    break;
+                }
+            }
+            last = image.sequence;
+            ++painted;
+        }
+        else if (finished)
+        {
+            break;
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    double seconds = SecondsSince(start);
+
+    // The last image published is the last one painted
+    violations += last != Frames ? 1 : 0;
+
+    printf("triple %u images published, %u painted, %.2f us/image\n", Frames, painted, seconds * 1e6 / Frames);
+    if (violations)
+    {
+        printf("Triple buffer handed out torn, stale or out of order images\n");
+    }
+
+    return violations;
+}
+
+/// <summary>
+/// Set the ready events of a color, a depth and a skeleton stream the way the sensor does, depth and
+/// skeleton together, and check that every signal reaches the handler of its own stream only
+/// </summary>
+/// <returns>Number of violations found</returns>
+static int BenchDispatch()
+{
+    const int    Rounds    = 5000;
+    const int    Streams   = 3;
+    const char*  Names[]   = { "color", "depth", "skeleton" };
+
+    DispatchEvent     events[Streams];
+    std::atomic<bool> pending[Streams];
+    std::atomic<int>  misrouted(0);
+    EventDispatcher   dispatcher;
+    size_t            sources[Streams];
+    for (int i = 0; i < Streams; i++)
+    {
+        pending[i] = false;
+        sources[i] = dispatcher.Add(Names[i], events[i].GetHandle(), [&, i]()
+        {
+            // Consumed before it is marked done, so the next signal is not lost
+            events[i].Reset();
+            if (!pending[i].exchange(false))
+            {
+                ++misrouted;
+            }
+        });
+    }
+    dispatcher.Start();
+
+    double latency = 0;
+    for (int round = 0; round < Rounds; round++)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int i = 0; i < Streams; i++)
+        {
+            pending[i] = true;
+            events[i].Set();
+        }
+
+        while (pending[0] || pending[1] || pending[2])
+        {
+            std::this_thread::yield();
+        }
+        latency += SecondsSince(start);
+    }
+    dispatcher.Stop();
+
+    int violations = misrouted;
+    uint64_t dispatches = 0;
+    uint64_t batched    = 0;
+    for (int i = 0; i < Streams; i++)
+    {
+        EventSourceStats stats = dispatcher.GetStats(sources[i]);
+        violations += stats.dispatches != (uint64_t)Rounds ? 1 : 0;
+        dispatches += stats.dispatches;
+        batched    += stats.batchedDispatches;
+    }
+    violations += dispatcher.GetWakeups() > dispatches ? 1 : 0;
+
+    printf("events %llu dispatched in %llu wakeups, %llu batched, %.2f us from signal to service\n",
+        (unsigned long long)dispatches, (unsigned long long)dispatcher.GetWakeups(), (unsigned long long)batched,
+        latency * 1e6 / Rounds);
+    if (violations)
+    {
+        printf("Event dispatcher lost signals or routed them to the wrong stream\n");
+    }
+
+    return violations;
+}
+
+/// <summary>
+/// Frame of the pipeline benchmark
+/// </summary>
+struct BenchJob
+{
+    const RecordFrame*      pFrame;
+    uint32_t                number;
+    std::vector<uint8_t>    payload;
+};
+
+/// <summary>
+/// Encoders a stage runs on at the same time, each frame gets one nobody else is using
+/// </summary>
+class BenchEncoders
+{
+public:
+    BenchEncoders(const std::function<FrameEncoder*()>& createEncoder, unsigned count)
+    {
+        for (unsigned i = 0; i < count; i++)
+        {
+            m_encoders.push_back(std::unique_ptr<FrameEncoder>(createEncoder()));
+            m_idle.push_back(m_encoders.back().get());
+        }
+    }
+
+    void Encode(BenchJob& job)
+    {
+        FrameEncoder* pEncoder;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            pEncoder = m_idle.back();
+            m_idle.pop_back();
+        }
+
+        pEncoder->Encode(*job.pFrame, job.payload);
+
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_idle.push_back(pEncoder);
+    }
+
+private:
+    std::mutex                                  m_lock;
+    std::vector<std::unique_ptr<FrameEncoder>>  m_encoders;
+    std::vector<FrameEncoder*>                  m_idle;
+};
+
+/// <summary>
+/// Record 1280x960 color as JPEG and depth as RVL at the same time through pipelines laid out like the
+/// recorder's, on a pool of one worker and on the default pool, and check that every frame is written
+/// once, in order, and that no stage ran on more frames or held more than it was allowed to
+/// </summary>
+/// <returns>Number of violations found</returns>
+static int BenchPipeline()
+{
+    const size_t Generated = 15;
+    const size_t Rounds    = 6;
+    const size_t Frames    = Generated * Rounds;
+    const size_t Capacity  = FrameRecorder::DefaultQueueCapacity;
+
+    std::vector<RecordFrame> colorFrames;
+    std::vector<RecordFrame> depthFrames;
+    GenerateColorFrames(Generated, 1280, 960, colorFrames);
+    GenerateDepthFrames(Generated, depthFrames);
+
+    std::atomic<int> misordered(0);
+    int              violations  = 0;
+    double           baseSeconds = 0;
+    const unsigned Workers[] = { 1, TaskPool::DefaultWorkerCount() };
+    for (unsigned workers : Workers)
+    {
+        TaskPool pool(workers);
+
+        // Color frames are encoded on every worker, depth frames by one encoder as it may keep state
+        BenchEncoders jpeg([]() { return new JpegColorEncoder(); }, workers);
+        BenchEncoders rvl([]() { return new RvlDepthEncoder(); }, 1);
+
+        uint32_t written[RecordStreamCount] = { 0, 0 };
+        Pipeline<BenchJob> color(pool);
+        Pipeline<BenchJob> depth(pool);
+        color.AddStage("encode", workers, Capacity, [&](BenchJob& job) { jpeg.Encode(job); });
+        depth.AddStage("encode", 1, Capacity, [&](BenchJob& job) { rvl.Encode(job); });
+        for (int stream = 0; stream < RecordStreamCount; stream++)
+        {
+            (RecordStreamColor == stream ? color : depth).AddStage("write", 1, 2, [&, stream](BenchJob& job)
+            {
+                misordered += job.number != written[stream] || job.payload.empty() ? 1 : 0;
+                ++written[stream];
+            });
+        }
+        color.Start();
+        depth.Start();
+
+        // Each stream is submitted by a thread of its own, like the acquisition threads
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::thread depthThread([&]()
+        {
+            for (uint32_t i = 0; i < Frames; i++)
+            {
+                depth.Submit([&](BenchJob& job) { job.pFrame = &depthFrames[i % Generated]; job.number = i; });
+            }
+        });
+        for (uint32_t i = 0; i < Frames; i++)
+        {
+            color.Submit([&](BenchJob& job) { job.pFrame = &colorFrames[i % Generated]; job.number = i; });
+        }
+        depthThread.join();
+        color.Stop();
+        depth.Stop();
+        double seconds = SecondsSince(start);
+        baseSeconds = baseSeconds ? baseSeconds : seconds;
+
+        violations += Frames != written[RecordStreamColor] || Frames != written[RecordStreamDepth] ? 1 : 0;
+        for (Pipeline<BenchJob>* pPipeline : { &color, &depth })
+        {
+            PipelineStats stats = pPipeline->GetStats();
+            violations += stats.submitted != Frames || stats.inFlight || stats.maxInFlight > Capacity + 2 ? 1 : 0;
+        }
+        PipelineStageStats encode = color.GetStageStats(0);
+        violations += encode.maxRunning > workers || encode.maxDepth > Capacity ? 1 : 0;
+        violations += depth.GetStageStats(0).maxRunning > 1 || color.GetStageStats(1).maxRunning > 1 ? 1 : 0;
+
+        TaskPoolStats poolStats = pool.GetStats();
+        printf("pipe/%u 1280x960 jpg + 640x480 rvl: %.1f fps each, x%.2f, encode %.2f ms/frame on up to %u at once, "
+            "%llu tasks, %llu stolen\n",
+            workers, Frames / seconds, baseSeconds / seconds, encode.busySeconds * 1000 / encode.items, encode.maxRunning,
+            (unsigned long long)poolStats.tasks, (unsigned long long)poolStats.steals);
+    }
+
+    violations += misordered;
+    if (violations)
+    {
+        printf("Pipeline lost frames, wrote them out of order or ran stages beyond their limits\n");
+    }
+
+    return violations;
+}
+
+/// <summary>
+/// Writer as slow as a saturated disk, keeping the numbers of the frames it wrote
+/// </summary>
+class BenchSlowWriter : public FrameWriter
+{
+public:
+    explicit BenchSlowWriter(std::chrono::milliseconds delay, std::vector<uint32_t>& written)
+        : m_delay(delay)
+        , m_written(written)
+    {
+    }
+
+    bool WriteFrame(const RecordFrame& frame) override
+    {
+        std::this_thread::sleep_for(m_delay);
+        m_written.push_back(frame.frameNumber);
+        return true;
+    }
+
+private:
+    std::chrono::milliseconds   m_delay;
+    std::vector<uint32_t>&      m_written;
+};
+
+/// <summary>
+/// Submit color and depth frames from a thread each, faster than the writers store them, under every
+/// drop policy and check that each frame is either written, in order, or counted as dropped, which
+/// frames give way, and that acquisition no longer waits for the disk once frames may be dropped
+/// </summary>
+/// <returns>Number of violations found</returns>
+static int BenchDropPolicy()
+{
+    const uint32_t Frames   = 60;
+    const size_t   Capacity = 8;
+    const char*    Names[]  = { "block", "newest", "oldest", "color" };
+
+    TaskPool pool(2);
+    int violations = 0;
+    for (int policy = RecordDropPolicyBlock; policy <= RecordDropPolicyColorFirst; policy++)
+    {
+        std::vector<uint32_t> written[RecordStreamCount];
+        FrameRecorder recorder(pool, Capacity);
+        recorder.SetDroppedListPath(nullptr);
+        recorder.SetDropPolicy((RecordDropPolicy)policy);
+        recorder.SetWriter(RecordStreamColor, new BenchSlowWriter(std::chrono::milliseconds(4), written[RecordStreamColor]));
+        recorder.SetWriter(RecordStreamDepth, new BenchSlowWriter(std::chrono::milliseconds(2), written[RecordStreamDepth]));
+        recorder.Start();
+
+        double maxSubmitSeconds[RecordStreamCount] = { 0, 0 };
+        auto submit = [&](RecordStream stream)
+        {
+            for (uint32_t i = 0; i < Frames; i++)
+            {
+                FrameHandle frame = FrameHandle::Create();
+                frame.GetMutable()->stream      = stream;
+                frame.GetMutable()->frameNumber = i;
+                frame.GetMutable()->timestamp   = i / 30.0;
+
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                recorder.SubmitFrame(std::move(frame));
+                maxSubmitSeconds[stream] = std::max(maxSubmitSeconds[stream], SecondsSince(start));
+            }
+        };
+        std::thread depthThread(submit, RecordStreamDepth);
+        submit(RecordStreamColor);
+        depthThread.join();
+
+        recorder.Stop();
+
+        FrameRecorderStats stats[RecordStreamCount];
+        for (int stream = 0; stream < RecordStreamCount; stream++)
+        {
+            stats[stream] = recorder.GetStats((RecordStream)stream);
+
+            const std::vector<uint32_t>& numbers = written[stream];
+            violations += numbers.size() != stats[stream].framesWritten || numbers.size() + stats[stream].framesDropped != Frames ? 1 : 0;
+            for (size_t i = 1; i < numbers.size(); i++)
+            {
+                violations += numbers[i] <= numbers[i - 1] ? 1 : 0;
+            }
+
+            // Dropping the newest keeps the first frames, dropping the oldest keeps the last one
+            bool dropping = RecordDropPolicyBlock != policy && (RecordStreamColor == stream || RecordDropPolicyColorFirst != policy);
+            violations += dropping != (0 != stats[stream].framesDropped) ? 1 : 0;
+            violations += RecordDropPolicyNewest == policy && (numbers.empty() || 0 != numbers[0]) ? 1 : 0;
+            violations += RecordDropPolicyOldest == policy && (numbers.empty() || Frames - 1 != numbers.back()) ? 1 : 0;
+        }
+
+        printf("drop/%-6s color %llu written, %llu dropped; depth %llu written, %llu dropped; submit max %.1f/%.1f ms\n",
+            Names[policy], (unsigned long long)written[RecordStreamColor].size(), (unsigned long long)stats[RecordStreamColor].framesDropped,
+            (unsigned long long)written[RecordStreamDepth].size(), (unsigned long long)stats[RecordStreamDepth].framesDropped,
+            maxSubmitSeconds[RecordStreamColor] * 1000, maxSubmitSeconds[RecordStreamDepth] * 1000);
+    }
+
+    if (violations)
+    {
+        printf("Drop policy lost frames without counting them, wrote them out of order or dropped the wrong ones\n");
+    }
+
+    return violations;
+}
+
+/// <summary>
+/// Stop and start a recorder over and over while a thread each keeps submitting color and depth frames,
+/// as the recording menu does while the sensor streams, and check that every frame reported as queued
+/// was written or counted as dropped and that the counters of a session no longer change once it has stopped
+/// </summary>
+/// <returns>Number of violations found</returns>
+static int BenchRecorderRestart()
+{
+    const int    Sessions = 40;
+    const size_t Capacity = 4;
+
+    TaskPool pool(2);
+    std::vector<uint32_t> written[RecordStreamCount];
+    FrameRecorder recorder(pool, Capacity);
+    recorder.SetDroppedListPath(nullptr);
+    recorder.SetWriter(RecordStreamColor, new BenchSlowWriter(std::chrono::milliseconds(1), written[RecordStreamColor]));
+    recorder.SetWriter(RecordStreamDepth, new BenchSlowWriter(std::chrono::milliseconds(0), written[RecordStreamDepth]));
+
+    std::atomic<bool> submitting(true);
+    uint64_t queued[RecordStreamCount] = { 0, 0 };
+    auto submit = [&](RecordStream stream)
+    {
+        for (uint32_t i = 0; submitting; i++)
+        {
+            FrameHandle frame = FrameHandle::Create();
+            frame.GetMutable()->stream      = stream;
+            frame.GetMutable()->frameNumber = i;
+            frame.GetMutable()->timestamp   = i / 30.0;
+
+            if (recorder.SubmitFrame(std::move(frame)))
+            {
+                ++queued[stream];
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+    };
+    std::thread colorThread(submit, RecordStreamColor);
+    std::thread depthThread(submit, RecordStreamDepth);
+
+    int      violations = 0;
+    uint64_t counted[RecordStreamCount] = { 0, 0 };
+    uint64_t dropped[RecordStreamCount] = { 0, 0 };
+    for (int session = 0; session < Sessions; session++)
+    {
+        // Every policy in turn, the color first one also looks at the queue of the depth stream
+        recorder.SetDropPolicy((RecordDropPolicy)(session % (RecordDropPolicyColorFirst + 1)));
+        violations += !recorder.Start() ? 1 : 0;
+        std::this_thread::sleep_for(std::chrono::milliseconds(3));
+        recorder.Stop();
+
+        FrameRecorderStats stopped[RecordStreamCount];
+        for (int stream = 0; stream < RecordStreamCount; stream++)
+        {
+            stopped[stream] = recorder.GetStats((RecordStream)stream);
+            counted[stream] += stopped[stream].framesWritten;
+            dropped[stream] += stopped[stream].framesDropped;
+        }
+
+        // Every other session starts again right away, while submissions let in before Stop may still run
+        if (session % 2)
+        {
+            continue;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        for (int stream = 0; stream < RecordStreamCount; stream++)
+        {
+            FrameRecorderStats stats = recorder.GetStats((RecordStream)stream);
+            violations += (stats.framesWritten != stopped[stream].framesWritten || stats.writeFailures != stopped[stream].writeFailures ||
+                           stats.framesDropped != stopped[stream].framesDropped) ? 1 : 0;
+        }
+    }
+
+    submitting = false;
+    colorThread.join();
+    depthThread.join();
+
+    for (int stream = 0; stream < RecordStreamCount; stream++)
+    {
+        // Frames evicted by the drop oldest policy had been reported as queued
+        violations += (queued[stream] < counted[stream] || queued[stream] > counted[stream] + dropped[stream] ||
+                       written[stream].size() != counted[stream]) ? 1 : 0;
+    }
+
+    printf("restart %d sessions, %llu + %llu frames written, %llu dropped, while submitting from 2 threads\n",
+        Sessions, (unsigned long long)counted[RecordStreamColor], (unsigned long long)counted[RecordStreamDepth],
+        (unsigned long long)(dropped[RecordStreamColor] + dropped[RecordStreamDepth]));
+    if (violations)
+    {
+        printf("Restarting the recorder lost frames or counted them in the wrong session\n");
+    }
+
+    return violations;
+}
+
+/// <summary>
+/// Push 10 seconds of generated frames at 30 fps through 5 second pre-trigger buffers, as they are and
+/// compressed, then replay them and check that the window and the memory held, that replayed frames come
+/// out in order with their exact pixels, and that every frame pushed in is accounted for
+/// </summary>
+/// <returns>Number of violations found</returns>
+static int BenchPreTrigger()
+{
+    const size_t   Sources     = 30;
+    const uint32_t Frames      = 300;
+    const double   Seconds     = 5.0;
+    const size_t   MemoryBytes = (size_t)64 << 20;
+
+    std::vector<RecordFrame> sources[RecordStreamCount];
+    GenerateColorFrames(Sources, 640, 480, sources[RecordStreamColor]);
+    GenerateDepthFrames(Sources, sources[RecordStreamDepth]);
+
+    FramePool framePool;
+    int violations = 0;
+    for (int compress = 0; compress < 2; compress++)
+    {
+        for (int stream = 0; stream < RecordStreamCount; stream++)
+        {
+            FrameEncoder* pEncoder = nullptr;
+            if (compress)
+            {
+                pEncoder = RecordStreamColor == stream ? static_cast<FrameEncoder*>(new QoiColorEncoder())
+                                                       : static_cast<FrameEncoder*>(new RvlDepthEncoder());
+            }
+
+            PreTriggerBuffer buffer((RecordStream)stream, Seconds, MemoryBytes, pEncoder);
+            violations += buffer.IsValid() ? 0 : 1;
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            for (uint32_t i = 0; i < Frames; i++)
+            {
+                RecordFrame& frame = sources[stream][i % Sources];
+                frame.frameNumber = i;
+                frame.timestamp   = i / 30.0;
+                buffer.Push(frame);
+
+                violations += buffer.GetWindowSeconds() > Seconds ? 1 : 0;
+            }
+            double pushSeconds = SecondsSince(start);
+
+            PreTriggerStats stats  = buffer.GetStats();
+            double          window = buffer.GetWindowSeconds();
+            violations += stats.framesBuffered + stats.framesLost != Frames ||
+                          stats.framesEvicted + stats.framesInUse != stats.framesBuffered ||
+                          stats.maxBytesInUse > MemoryBytes || 0 == stats.framesInUse ? 1 : 0;
+
+            // Replayed oldest first up to the last frame pushed, each with the pixels it went in with
+            uint32_t    expected = Frames - (uint32_t)stats.framesInUse;
+            FrameHandle frame;
+            start = std::chrono::steady_clock::now();
+            while (buffer.Pop(&framePool, frame))
+            {
+                const RecordFrame& source = sources[stream][expected % Sources];
+                bool equal = frame->frameNumber == expected && frame->width == source.width && frame->height == source.height;
+                for (uint32_t y = 0; equal && y < source.height; y++)
+                {
+                    equal = 0 == memcmp(frame->data.data() + (size_t)y * frame->stride,
+                                        source.data.data() + (size_t)y * source.stride, source.width * 4);
+                }
+                violations += equal ? 0 : 1;
+                ++expected;
+            }
+            double popSeconds = SecondsSince(start);
+            frame.Reset();
+
+            const PreTriggerStats& replayed = buffer.GetStats();
+            violations += Frames != expected || replayed.framesReplayed != stats.framesInUse ||
+                          replayed.framesInUse || replayed.bytesInUse ? 1 : 0;
+
+            printf("pretrig/%-4s %s %llu of %u frames kept covering %.2f s, peak %.1f of %.1f MB, %.2f:1, "
+                "push %.2f ms, pop %.2f ms/frame\n",
+                compress ? GetCodecName(pEncoder->GetCodec()) : "raw", RecordStreamColor == stream ? "color" : "depth",
+                (unsigned long long)stats.framesInUse, Frames, window, stats.maxBytesInUse / 1048576.0,
+                MemoryBytes / 1048576.0, stats.storedBytes ? (double)stats.rawBytes / stats.storedBytes : 0.0,
+                pushSeconds * 1000 / Frames, popSeconds * 1000 / (double)std::max<uint64_t>(1, stats.framesInUse));
+        }
+    }
+
+    if (violations)
+    {
+        printf("Pre-trigger buffer exceeded its window or memory, lost count of frames or replayed them wrong\n");
+    }
+
+    return violations;
+}
+
+/// <summary>
+/// Stream publishing given frames as if they came from a sensor
+/// </summary>
+class BenchFrameStream : public FrameStream
+{
+public:
+    BenchFrameStream()
+        : FrameStream(nullptr)
+    {
+    }
+
+    void ProcessStreamFrame() override
+    {
+    }
+
+    void Publish(const RecordFrame& source, uint32_t frameNumber)
+    {
+        StreamLock lock(this);
+
+        FrameHandle   frame  = FrameHandle::Create();
+        RecordFrame*  pFrame = frame.GetMutable();
+        pFrame->stream      = source.stream;
+        pFrame->format      = source.format;
+        pFrame->width       = source.width;
+        pFrame->height      = source.height;
+        pFrame->stride      = source.stride;
+        pFrame->frameNumber = frameNumber;
+        pFrame->timestamp   = frameNumber / 30.0;
+        pFrame->data.assign(source.data.data(), source.data.data() + source.data.size());
+        PublishFrame(frame);
+    }
+};
+
+/// <summary>
+/// Publish depth frames through a stream with a pre-trigger ring held to fewer frames than its window by
+/// its memory, start recording, stop it before the ring has caught up and start again. Each recording must
+/// hold its pre-trigger frames and every live frame once, in order, and nothing of the one before
+/// </summary>
+/// <returns>Number of violations found</returns>
+static int BenchPreTriggerSessions()
+{
+    const size_t   Sources     = 10;
+    const uint32_t Idle        = 90;    // Frames before each recording, more than the ring keeps
+    const uint32_t ShortLive   = 5;     // Live frames of the recording stopped early
+    const uint32_t LongLive    = 40;    // Live frames of the recording which catches up
+
+    std::vector<RecordFrame> sources;
+    GenerateDepthFrames(Sources, sources);
+    size_t frameBytes = (size_t)sources[0].stride * sources[0].height;
+
+    TaskPool pool(2);
+    std::vector<uint32_t> written[RecordStreamCount];
+    FrameRecorder recorder(pool, 8);
+    recorder.SetDroppedListPath(nullptr);
+    recorder.SetWriter(RecordStreamColor, new BenchSlowWriter(std::chrono::milliseconds(0), written[RecordStreamColor]));
+    recorder.SetWriter(RecordStreamDepth, new BenchSlowWriter(std::chrono::milliseconds(0), written[RecordStreamDepth]));
+
+    BenchFrameStream stream;
+    stream.SetFrameRecorder(&recorder);
+    stream.SetPreTriggerBuffer(new PreTriggerBuffer(RecordStreamDepth, 2.0, frameBytes * 20, nullptr));
+
+    // Idle, recording stopped after a few live frames, idle again, recording until stopped after catching up
+    uint32_t number = 0;
+    uint32_t lastLive[2];
+    size_t   sessionEnd[2];
+    for (int session = 0; session < 2; session++)
+    {
+        for (uint32_t i = 0; i < Idle; i++, number++)
+        {
+            stream.Publish(sources[number % Sources], number);
+        }
+
+        recorder.Start();
+        for (uint32_t i = 0; i < (0 == session ? ShortLive : LongLive); i++, number++)
+        {
+            stream.Publish(sources[number % Sources], number);
+        }
+        lastLive[session] = number - 1;
+
+        stream.FlushPreTrigger();
+        recorder.Stop();
+        sessionEnd[session] = written[RecordStreamDepth].size();
+    }
+
+    // Consecutive frame numbers up to the last live frame, starting after the frames of the recording before
+    int violations = 0;
+    const std::vector<uint32_t>& numbers = written[RecordStreamDepth];
+    size_t begin = 0;
+    for (int session = 0; session < 2; session++)
+    {
+        size_t end  = sessionEnd[session];
+        size_t live = 0 == session ? ShortLive : LongLive;
+        violations += end - begin <= live || numbers[end - 1] != lastLive[session] ? 1 : 0;
+        violations += 0 != session && numbers[begin] <= lastLive[session - 1] ? 1 : 0;
+        for (size_t i = begin + 1; i < end; i++)
+        {
+            violations += numbers[i] != numbers[i - 1] + 1 ? 1 : 0;
+        }
+        begin = end;
+    }
+
+    printf("pretrig/sessions %llu + %llu frames recorded, first stopped after %u live frames, in order, none carried over\n",
+        (unsigned long long)sessionEnd[0], (unsigned long long)(sessionEnd[1] - sessionEnd[0]), ShortLive);
+    if (violations)
+    {
+        printf("Pre-trigger ring lost, repeated or carried over frames between recordings\n");
+    }
+
+    return violations;
+}
+
+// What the writers of the segments saw, shared by all of them
+struct BenchSegmentLog
+{
+    struct Entry
+    {
+        uint32_t    segment;
+        uint32_t    frameNumber;
+        double      timestamp;
+    };
+
+    std::mutex          lock;
+    std::vector<Entry>  written[RecordStreamCount];
+    unsigned            opened;
+    unsigned            closed;
+    unsigned            discarded;
+    unsigned            misuse;         // Frames stored by a writer which was not open, writers closed twice
+};
+
+/// <summary>
+/// Writer of one segment which takes a while to open, as if it preallocated its files, and logs the frames it stores
+/// </summary>
+class BenchSegmentWriter : public FrameWriter
+{
+public:
+    BenchSegmentWriter(RecordStream stream, uint32_t segment, unsigned concurrency, BenchSegmentLog& log)
+        : m_stream(stream)
+        , m_segment(segment)
+        , m_concurrency(concurrency)
+        , m_open(false)
+        , m_log(log)
+    {
+    }
+
+    bool Open() override
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+        std::lock_guard<std::mutex> lock(m_log.lock);
+        ++m_log.opened;
+        m_open = true;
+        return true;
+    }
+
+    bool WriteFrame(const RecordFrame& frame) override { return Store(frame); }
+
+    unsigned GetEncodeConcurrency() const override { return m_concurrency; }
+
+    bool EncodeFrame(const RecordFrame& /*frame*/, EncodedFrame& encoded) override
+    {
+        encoded.payload.assign(1000, 0);
+        return true;
+    }
+
+    bool StoreFrame(const RecordFrame& frame, const EncodedFrame& /*encoded*/) override { return Store(frame); }
+
+    const char* GetFileExtension() const override { return ".bin"; }
+
+    void Close() override
+    {
+        std::lock_guard<std::mutex> lock(m_log.lock);
+        m_log.misuse += m_open ? 0 : 1;
+        m_log.closed += m_open ? 1 : 0;
+        m_open = false;
+    }
+
+    void Discard() override
+    {
+        std::lock_guard<std::mutex> lock(m_log.lock);
+        m_log.misuse    += m_open ? 0 : 1;
+        m_log.discarded += m_open ? 1 : 0;
+        m_open = false;
+    }
+
+private:
+    bool Store(const RecordFrame& frame)
+    {
+        std::lock_guard<std::mutex> lock(m_log.lock);
+        m_log.misuse += m_open ? 0 : 1;
+
+        BenchSegmentLog::Entry entry = { m_segment, frame.frameNumber, frame.timestamp };
+        m_log.written[m_stream].push_back(entry);
+        return m_open;
+    }
+
+private:
+    RecordStream        m_stream;
+    uint32_t            m_segment;
+    unsigned            m_concurrency;
+    bool                m_open;
+    BenchSegmentLog&    m_log;
+};
+
+/// <summary>
+/// Record 10 seconds of frames from a thread per stream into 1 second segments, color through a writer
+/// encoding frames in parallel and depth through one writing them one at a time, and check that every
+/// frame is stored once, in order, by the writer of the segment its capture time falls in, that segments
+/// follow each other in time across the streams, that every writer opened is closed or discarded once,
+/// and that the list of segments accounts for all frames
+/// </summary>
+/// <returns>Number of violations found</returns>
+static int BenchSegments()
+{
+    const uint32_t Frames      = 300;
+    const double   Seconds     = 1.0;
+    const char*    pIndexPath  = "rgbdtool_bench_segments.tmp";
+
+    remove(pIndexPath);
+
+    TaskPool pool(2);
+    std::shared_ptr<RecordingSegmenter> pSegmenter = std::make_shared<RecordingSegmenter>(pool, Seconds, 0);
+    pSegmenter->SetIndexPath(pIndexPath);
+
+    BenchSegmentLog log;
+    log.opened    = 0;
+    log.closed    = 0;
+    log.discarded = 0;
+    log.misuse    = 0;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    double maxSubmitSeconds = 0;
+    {
+        FrameRecorder recorder(pool);
+        recorder.SetDroppedListPath(nullptr);
+        recorder.SetSegmenter(pSegmenter);
+        recorder.SetWriter(RecordStreamColor, new SegmentedFrameWriter(pSegmenter,
+            [&log](uint32_t segment) { return new BenchSegmentWriter(RecordStreamColor, segment, 2, log); }));
+        recorder.SetWriter(RecordStreamDepth, new SegmentedFrameWriter(pSegmenter,
+            [&log](uint32_t segment) { return new BenchSegmentWriter(RecordStreamDepth, segment, 0, log); }));
+        recorder.Start();
+
+        std::mutex maxLock;
+        auto submit = [&](RecordStream stream)
+        {
+            for (uint32_t i = 0; i < Frames; i++)
+            {
+                FrameHandle frame = FrameHandle::Create();
+                frame.GetMutable()->stream      = stream;
+                frame.GetMutable()->frameNumber = i;
+                frame.GetMutable()->timestamp   = i / 30.0 + (RecordStreamDepth == stream ? 0.007 : 0.0);
+
+                // Faster than the sensor, slower than a writer takes to open
+                std::chrono::steady_clock::time_point submitStart = std::chrono::steady_clock::now();
+                recorder.SubmitFrame(std::move(frame));
+                double submitSeconds = SecondsSince(submitStart);
+                {
+                    std::lock_guard<std::mutex> lock(maxLock);
+                    maxSubmitSeconds = std::max(maxSubmitSeconds, submitSeconds);
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        };
+        std::thread depthThread(submit, RecordStreamDepth);
+        submit(RecordStreamColor);
+        depthThread.join();
+
+        recorder.Stop();
+    }
+    double seconds = SecondsSince(start);
+
+    int violations = log.misuse ? 1 : 0;
+    RecordingSegmenterStats stats = pSegmenter->GetStats();
+    std::vector<double> first(stats.segments, 1e300);
+    std::vector<double> last(stats.segments, -1e300);
+    for (int stream = 0; stream < RecordStreamCount; stream++)
+    {
+        const std::vector<BenchSegmentLog::Entry>& written = log.written[stream];
+        violations += Frames != written.size() ? 1 : 0;
+        for (size_t i = 0; i < written.size(); i++)
+        {
+            const BenchSegmentLog::Entry& entry = written[i];
+            violations += i != entry.frameNumber || entry.segment >= stats.segments ||
+                          entry.segment != pSegmenter->GetSegment(entry.timestamp) ||
+                          (i > 0 && entry.segment < written[i - 1].segment) ? 1 : 0;
+            if (entry.segment < stats.segments)
+            {
+                first[entry.segment] = std::min(first[entry.segment], entry.timestamp);
+                last[entry.segment]  = std::max(last[entry.segment], entry.timestamp);
+            }
+        }
+    }
+
+    // A segment ends before the next one starts in either stream, and runs for about the time given
+    for (uint32_t segment = 0; segment < stats.segments; segment++)
+    {
+        violations += last[segment] - first[segment] > Seconds + 0.1 ? 1 : 0;
+        violations += segment > 0 && last[segment - 1] >= first[segment] ? 1 : 0;
+    }
+    violations += log.opened != log.closed + log.discarded || 0 == stats.segments ? 1 : 0;
+
+    // "[first timestamp]\t[last timestamp]\t[directory]\t[frames]\t[bytes]" per segment
+    std::ifstream index(pIndexPath);
+    std::string   line;
+    uint32_t      listed = 0;
+    uint64_t      listedFrames = 0;
+    while (std::getline(index, line))
+    {
+        std::istringstream fields(line);
+        double      firstTimestamp = 0, lastTimestamp = 0;
+        std::string name;
+        uint64_t    frames = 0, bytes = 0;
+        fields >> firstTimestamp >> lastTimestamp >> name >> frames >> bytes;
+
+        char expected[32];
+        snprintf(expected, sizeof(expected), SEGMENT_NAME_FORMAT, listed);
+        violations += name != expected || fabs(firstTimestamp - first[listed]) > 1e-6 ||
+                      fabs(lastTimestamp - last[listed]) > 1e-6 ? 1 : 0;
+        listedFrames += frames;
+        ++listed;
+    }
+    index.close();
+    remove(pIndexPath);
+    violations += listed != stats.segments || listedFrames != 2 * Frames ? 1 : 0;
+
+    printf("segment %u segments, %u writers opened, %u discarded, %u of %u switches opened ahead, "
+        "switch max %.2f ms, submit max %.2f ms, %.2f s\n",
+        stats.segments, log.opened, log.discarded, stats.prefetchedRollovers, stats.rollovers,
+        stats.maxRolloverSeconds * 1000, maxSubmitSeconds * 1000, seconds);
+    if (violations)
+    {
+        printf("Segments lost frames, stored them in the wrong segment or out of order, or listed them wrong\n");
+    }
+
+    return violations;
+}
+
+/// <summary>
+/// Let the file size limit cut a frame short while a container is written, as a full disk does, and check that
+/// the append fails, the frames appended after it are indexed at their chunks and the footer holds them all
+/// </summary>
+/// <returns>Number of violations found</returns>
+static int BenchShortWrite()
+{
+#ifdef _WIN32
+    // No file size limit to run into
+    printf("shortwrite skipped, needs a file size limit\n");
+    return 0;
+#else
+    const uint32_t Frames       = 10;
+    const uint32_t FailedFrame  = 4;
+    const uint32_t PayloadBytes = 64 * 1024;
+    const char*    pPath        = "rgbdtool_bench_shortwrite.tmp";
+
+    std::vector<uint8_t> payload(PayloadBytes);
+    rlimit original;
+    getrlimit(RLIMIT_FSIZE, &original);
+    void (*previousHandler)(int) = signal(SIGXFSZ, SIG_IGN);
+
+    int violations = 0;
+    {
+        RgbdContainerWriter writer(pPath);
+        writer.SetCheckpointInterval(0);
+        violations += writer.Open() ? 0 : 1;
+
+        for (uint32_t i = 0; i < Frames; i++)
+        {
+            RecordFrame frame;
+            frame.stream      = RecordStreamDepth;
+            frame.frameNumber = i;
+            frame.timestamp   = i / 30.0;
+            for (size_t j = 0; j < payload.size(); j++)
+            {
+                payload[j] = (uint8_t)(j * 13 + i);
+            }
+
+            if (FailedFrame == i && !writer.GetIndex().empty())
+            {
+                // The file may grow to half of the payload of this frame
+                const RgbdIndexEntry& last = writer.GetIndex().back();
+                rlimit limited = original;
+                limited.rlim_cur = (rlim_t)(last.offset + sizeof(RgbdChunkHeader) + last.payloadSize + sizeof(RgbdChunkHeader) + PayloadBytes / 2);
+                setrlimit(RLIMIT_FSIZE, &limited);
+            }
+
+            bool appended = writer.AppendFrame(frame, RecordCodecRaw, payload.data(), PayloadBytes);
+            if (FailedFrame == i)
+            {
+                setrlimit(RLIMIT_FSIZE, &original);
+            }
+            violations += appended != (FailedFrame != i) ? 1 : 0;
+        }
+        writer.Close();
+    }
+    signal(SIGXFSZ, previousHandler);
+
+    // Every frame but the one cut short, each at its chunk
+    RgbdContainerReader reader;
+    violations += reader.Open(pPath, false) && reader.HasIndexFooter() ? 0 : 1;
+    const std::vector<RgbdIndexEntry>& index = reader.GetIndex();
+    violations += Frames - 1 != index.size() ? 1 : 0;
+    for (size_t i = 0; i < index.size(); i++)
+    {
+        std::string error;
+        uint32_t    expected = (uint32_t)(i < FailedFrame ? i : i + 1);
+        violations += index[i].frameNumber != expected || !reader.VerifyChunk(i, error) ? 1 : 0;
+    }
+    size_t indexed = index.size();
+    reader.Close();
+    remove(pPath);
+
+    printf("shortwrite frame %u of %u cut short, %u frames indexed and verified\n",
+        FailedFrame, Frames, (unsigned)indexed);
+    if (violations)
+    {
+        printf("Container index points at the wrong bytes after a short write\n");
+    }
+
+    return violations;
+#endif
+}
+
+/// <summary>
+/// Damage container files the way a crash does and check that recovery keeps exactly the intact frames before the damage
+/// </summary>
+static int BenchRecovery()
+{
+    const uint32_t Frames = 60;
+    const char*    pPaths[] = { "rgbdtool_bench_recovery_0.tmp", "rgbdtool_bench_recovery_1.tmp", "rgbdtool_bench_recovery_2.tmp" };
+    const size_t   Files    = sizeof(pPaths) / sizeof(pPaths[0]);
+
+    // A checkpoint after every frame in the first two files, none in the last one
+    std::vector<std::vector<RgbdIndexEntry>> written(Files);
+    std::vector<uint8_t> payload;
+    for (size_t file = 0; file < Files; file++)
+    {
+        RgbdContainerWriter writer(pPaths[file]);
+        writer.SetCheckpointInterval(file < 2 ? 1e-9 : 0);
+        writer.Open();
+
+        for (uint32_t i = 0; i < Frames; i++)
+        {
+            RecordFrame frame;
+            frame.stream      = (RecordStream)(i % 2);
+            frame.frameNumber = i / 2;
+            frame.timestamp   = i / 60.0;
+
+            // Larger than the scan ranges now and then, so ranges start inside chunks
+            payload.resize(1000 + (i * 7919) % 9000);
+            for (size_t j = 0; j < payload.size(); j++)
+            {
+                payload[j] = (uint8_t)((j * 31 + i * 17) ^ (j >> 5));
+            }
+            writer.AppendFrame(frame, RecordCodecRaw, payload.data(), (uint32_t)payload.size());
+        }
+        writer.Close();
+
+        RgbdContainerReader reader;
+        reader.Open(pPaths[file]);
+        written[file] = reader.GetIndex();
+    }
+
+    int violations = 0;
+    for (size_t file = 0; file < Files; file++)
+    {
+        violations += Frames != written[file].size() ? 1 : 0;
+    }
+    if (violations)
+    {
+        printf("recovery could not write the containers\n");
+        return violations;
+    }
+
+    std::vector<std::vector<char>> contents(Files);
+    for (size_t file = 0; file < Files; file++)
+    {
+        std::ifstream in(pPaths[file], std::ios::binary);
+        contents[file].assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    // Torn in the middle of the last frame, after the checkpoint of the frames before it
+    for (size_t file = 0; file < 2; file++)
+    {
+        const RgbdIndexEntry& last = written[file][Frames - 1];
+        contents[file].resize((size_t)(last.offset + sizeof(RgbdChunkHeader) + last.payloadSize / 2));
+    }
+
+    // Torn likewise, with the checkpoint before the last frame damaged, so the frame before it is verified
+    // from its chunk and the file ends at the damaged checkpoint
+    const RgbdIndexEntry& beforeLast = written[1][Frames - 2];
+    uint64_t damagedCheckpoint = beforeLast.offset + sizeof(RgbdChunkHeader) + beforeLast.payloadSize;
+    contents[1][(size_t)damagedCheckpoint + sizeof(RgbdCheckpoint) + 3] ^= 0x40;
+
+    // Without checkpoints, a frame damaged in the middle and the trailer cut short
+    const uint32_t DamagedFrame = 40;
+    contents[2][(size_t)(written[2][DamagedFrame].offset + sizeof(RgbdChunkHeader) + 100)] ^= 0x01;
+    contents[2].resize(contents[2].size() - 10);
+
+    for (size_t file = 0; file < Files; file++)
+    {
+        std::ofstream out(pPaths[file], std::ios::binary | std::ios::trunc);
+        out.write(contents[file].data(), contents[file].size());
+    }
+
+    const uint32_t expectedFrames[]     = { Frames - 1, Frames - 1, DamagedFrame };
+    const uint32_t expectedCheckpoint[] = { Frames - 1, Frames - 2, 0 };
+
+    TaskPool                        pool(2);
+    RgbdRecovery                    recovery(pool);
+    std::vector<std::string>        paths(pPaths, pPaths + Files);
+    std::vector<RgbdRecoveryResult> results;
+    recovery.SetRangeBytes(4096);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    recovery.Recover(paths, results);
+    double seconds = SecondsSince(start);
+
+    uint64_t scannedBytes = 0;
+    for (size_t file = 0; file < Files; file++)
+    {
+        const RgbdRecoveryResult& result = results[file];
+        violations += !result.recovered || !result.error.empty() || expectedFrames[file] != result.frames ||
+                      expectedCheckpoint[file] != result.checkpointFrames ? 1 : 0;
+        scannedBytes += result.scannedBytes;
+
+        RgbdContainerReader reader;
+        std::string         error;
+        if (!reader.Open(pPaths[file]) || !reader.HasIndexFooter() || expectedFrames[file] != reader.GetFrameCount())
+        {
+            ++violations;
+            continue;
+        }
+
+        for (size_t i = 0; i < reader.GetFrameCount(); i++)
+        {
+            const RgbdIndexEntry& entry = reader.GetEntry(i);
+            violations += !reader.VerifyChunk(i, error) ||
+                          0 != memcmp(&entry, &written[file][i], sizeof(entry)) ? 1 : 0;
+        }
+    }
+
+    // Recovered files are left alone the next time
+    recovery.Recover(paths, results);
+    for (size_t file = 0; file < Files; file++)
+    {
+        violations += !results[file].intact || expectedFrames[file] != results[file].frames ? 1 : 0;
+        remove(pPaths[file]);
+    }
+
+    printf("recover %u files, %u + %u + %u frames, %u from checkpoints, %.1f KB verified, %.2f ms\n",
+        (unsigned)Files, expectedFrames[0], expectedFrames[1], expectedFrames[2],
+        expectedCheckpoint[0] + expectedCheckpoint[1], scannedBytes / 1e3, seconds * 1000);
+    if (violations)
+    {
+        printf("Recovery lost intact frames, kept damaged ones or left the index unreadable\n");
+    }
+
+    return violations;
+}
+
+/// <summary>
+/// Claim a huge payload in one chunk header of an indexed container and check that the chunk is rejected
+/// against its index entry before anything is allocated for it, and that the chunks around it still verify
+/// </summary>
+static int BenchCorruptChunk()
+{
+    const uint32_t Frames       = 8;
+    const uint32_t DamagedFrame = 3;
+    const char*    pPath        = "rgbdtool_bench_chunk.tmp";
+
+    std::vector<uint8_t> payload(1000);
+    {
+        RgbdContainerWriter writer(pPath);
+        writer.Open();
+        for (uint32_t i = 0; i < Frames; i++)
+        {
+            RecordFrame frame;
+            frame.stream      = (RecordStream)(i % 2);
+            frame.frameNumber = i / 2;
+            frame.timestamp   = i / 60.0;
+            std::fill(payload.begin(), payload.end(), (uint8_t)i);
+            writer.AppendFrame(frame, RecordCodecRaw, payload.data(), (uint32_t)payload.size());
+        }
+        writer.Close();
+    }
+
+    uint64_t offset = 0;
+    {
+        RgbdContainerReader reader;
+        if (!reader.Open(pPath) || Frames != reader.GetFrameCount())
+        {
+            remove(pPath);
+            printf("chunk could not write the container\n");
+            return 1;
+        }
+        offset = reader.GetEntry(DamagedFrame).offset;
+    }
+
+    // The index footer does not cover the chunk headers, so the file still opens with its index
+    {
+        std::fstream file(pPath, std::ios::binary | std::ios::in | std::ios::out);
+        uint32_t claimed = 0xFFFFFFF0;
+        file.seekp((std::streamoff)(offset + offsetof(RgbdChunkHeader, payloadSize)));
+        file.write((const char*)&claimed, sizeof(claimed));
+    }
+
+    int violations = 0;
+    RgbdContainerReader  reader;
+    RgbdChunkHeader      header;
+    std::vector<uint8_t> read;
+    std::string          error;
+    if (!reader.Open(pPath) || !reader.HasIndexFooter() || Frames != reader.GetFrameCount())
+    {
+        ++violations;
+    }
+    else
+    {
+        violations += reader.ReadChunk(DamagedFrame, header, read) || read.size() > payload.size() ? 1 : 0;
+        violations += reader.VerifyChunk(DamagedFrame, error) ? 1 : 0;
+        for (uint32_t i = 0; i < Frames; i++)
+        {
+            std::string intact;
+            violations += (DamagedFrame != i && !reader.VerifyChunk(i, intact)) ? 1 : 0;
+        }
+    }
+    reader.Close();
+    remove(pPath);
+
+    printf("chunk  header of frame %u claims %u bytes, %s\n", DamagedFrame, 0xFFFFFFF0u, error.c_str());
+    if (violations)
+    {
+        printf("A chunk header was trusted over its index entry\n");
+    }
+
+    return violations;
+}
+
+/// <summary>
+/// Read back every frame of a transcoded session and compare it with the frames it was made from
+/// </summary>
+/// <returns>Number of frames missing or different</returns>
+static int CheckTranscoded(const std::string& path, const std::vector<RecordFrame>* pFrames)
+{
+    RecordingReader reader;
+    if (!reader.Open(path))
+    {
+        return 1;
+    }
+
+    int violations = 0;
+    for (int i = 0; i < RecordStreamCount; i++)
+    {
+        const std::vector<RecordFrame>& frames = pFrames[i];
+        violations += (frames.size() != reader.GetFrameCount((RecordStream)i)) ? 1 : 0;
+
+        FrameDecoder decoder;
+        FrameView    view;
+        for (size_t j = 0; j < frames.size() && j < reader.GetFrameCount((RecordStream)i); j++)
+        {
+            RecordFrame decoded;
+            decoded.format = frames[j].format;
+            decoded.width  = frames[j].width;
+            decoded.height = frames[j].height;
+            decoded.stride = frames[j].stride;
+
+            // The lists hold timestamps with 6 decimals
+            if (!reader.GetFrame((RecordStream)i, j, view) || fabs(frames[j].timestamp - view.timestamp) > 1e-6 ||
+                !decoder.Decode(view.codec, view.pData, view.size, decoded) ||
+                decoded.data.size() < frames[j].data.size() || decoded.stride != frames[j].stride ||
+                0 != memcmp(decoded.data.data(), frames[j].data.data(), frames[j].data.size()))
+            {
+                ++violations;
+            }
+        }
+    }
+
+    return violations;
+}
+
+/// <summary>
+/// Transcode a generated session of bitmaps and RVL files into a session folder and a container,
+/// interrupt both outputs and check that the resumed runs complete them without duplicates and that
+/// every frame reads back exactly, also when a source frame failed to transcode before the interruption
+/// </summary>
+/// <returns>Number of frames lost, duplicated or different</returns>
+static int BenchTranscode()
+{
+    const size_t Frames   = 30;
+    const double Start    = 1300000000.0;
+    const char*  pInput   = "rgbdtool_bench_transcode_in";
+    const char*  pOutput  = "rgbdtool_bench_transcode_out";
+    const char*  pPackage = "rgbdtool_bench_transcode.tmp";
+
+    std::vector<RecordFrame> frames[RecordStreamCount];
+    GenerateColorFrames(Frames, 320, 240, frames[RecordStreamColor]);
+    GenerateDepthFrames(Frames, frames[RecordStreamDepth]);
+
+    // The session layout the capture application has always written
+    RvlDepthEncoder rvl;
+    std::vector<uint8_t> payload;
+    int violations = 0;
+
+    MakeDirectory(pInput);
+    for (int i = 0; i < RecordStreamCount; i++)
+    {
+        const char* pName = (RecordStreamColor == i) ? "rgb" : "depth";
+        MakeDirectory((std::string(pInput) + "/" + pName).c_str());
+
+        FramePathFormatter path(pName, (RecordStreamColor == i) ? ".bmp" : ".rvl");
+        FrameListFile      list;
+        list.Open((std::string(pInput) + "/" + pName + ".txt").c_str());
+
+        for (size_t j = 0; j < Frames; j++)
+        {
+            RecordFrame& frame = frames[i][j];
+            frame.timestamp = Start + j / 30.0 + i * 0.004;
+
+            std::string file = std::string(pInput) + "/" + path.Format(frame.timestamp);
+            if (RecordStreamColor == i)
+            {
+                violations += !WriteBitmap(file, frame.data.data(), frame.width, frame.height, frame.stride) ? 1 : 0;
+            }
+            else
+            {
+                std::ofstream out(file.c_str(), std::ios::binary);
+                rvl.Encode(frame, payload);
+                out.write(reinterpret_cast<const char*>(payload.data()), payload.size());
+            }
+            list.Append(frame.timestamp, path.GetPath(), path.GetLength());
+        }
+    }
+
+    TaskPool pool(4);
+    SessionTranscoder transcoder(pool);
+    transcoder.SetEncoder(RecordStreamColor, []() { return new QoiColorEncoder(); }, 4);
+    transcoder.SetEncoder(RecordStreamDepth, []() { return new TemporalDepthEncoder(); }, 1);
+
+    // Into a session folder, then again after the lists were cut, one in the middle of a line
+    std::string error;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    violations += !transcoder.Transcode(pInput, pOutput, false, error) ? 1 : 0;
+    double seconds = SecondsSince(start);
+
+    SessionTranscoderStats stats = transcoder.GetStats();
+    double inputBytes  = (double)stats.inputBytes;
+    double outputBytes = (double)stats.outputBytes;
+    for (int i = 0; i < RecordStreamCount; i++)
+    {
+        violations += (Frames != stats.frames[i] || stats.failures[i] || stats.mismatches[i]) ? 1 : 0;
+    }
+    violations += CheckTranscoded(pOutput, frames);
+
+    const size_t KeptLines[] = { 25, 10 };
+    for (int i = 0; i < RecordStreamCount; i++)
+    {
+        std::string listPath = std::string(pOutput) + ((RecordStreamColor == i) ? "/rgb.txt" : "/depth.txt");
+        std::ifstream in(listPath.c_str(), std::ios::binary);
+        std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        in.close();
+
+        size_t end = 0;
+        for (size_t line = 0; line < KeptLines[i]; line++)
+        {
+            end = text.find('\n', end) + 1;
+        }
+        text.resize(RecordStreamColor == i ? end : end + 12);
+
+        std::ofstream out(listPath.c_str(), std::ios::binary | std::ios::trunc);
+        out.write(text.data(), text.size());
+    }
+
+    violations += !transcoder.Transcode(pInput, pOutput, false, error) ? 1 : 0;
+    stats = transcoder.GetStats();
+    for (int i = 0; i < RecordStreamCount; i++)
+    {
+        violations += (KeptLines[i] != stats.resumed[i] || Frames - KeptLines[i] != stats.frames[i] ||
+                       stats.failures[i] || stats.mismatches[i]) ? 1 : 0;
+    }
+    violations += CheckTranscoded(pOutput, frames);
+
+    // Into a container, which is cut in the middle of a frame and recovered before the run resumes
+    transcoder.SetEncoder(RecordStreamDepth, []() { return new RvlDepthEncoder(); }, 4);
+    violations += !transcoder.Transcode(pInput, pPackage, true, error) ? 1 : 0;
+
+    const size_t KeptFrames = 37;
+    {
+        RgbdContainerReader reader;
+        reader.Open(pPackage);
+        violations += (2 * Frames != reader.GetFrameCount()) ? 1 : 0;
+
+        std::ifstream in(pPackage, std::ios::binary);
+        std::vector<char> contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        in.close();
+
+        const RgbdIndexEntry& torn = reader.GetEntry(KeptFrames);
+        contents.resize((size_t)(torn.offset + sizeof(RgbdChunkHeader) + torn.payloadSize / 2));
+
+        std::ofstream out(pPackage, std::ios::binary | std::ios::trunc);
+        out.write(contents.data(), contents.size());
+    }
+
+    violations += !transcoder.Transcode(pInput, pPackage, true, error) ? 1 : 0;
+    stats = transcoder.GetStats();
+    violations += (KeptFrames != stats.resumed[RecordStreamColor] + stats.resumed[RecordStreamDepth] ||
+                   2 * Frames - KeptFrames != stats.frames[RecordStreamColor] + stats.frames[RecordStreamDepth]) ? 1 : 0;
+    violations += CheckTranscoded(pPackage, frames);
+    {
+        RgbdContainerReader reader;
+        reader.Open(pPackage);
+        for (size_t i = 0; i < reader.GetFrameCount(); i++)
+        {
+            violations += !reader.VerifyChunk(i, error) ? 1 : 0;
+        }
+    }
+
+    // With a source frame which cannot be decoded, which both outputs leave out. Resuming either
+    // after the gap must skip the frame rather than take the output for a different session
+    const size_t FailedFrame = 5;
+    {
+        FramePathFormatter path("depth", ".rvl");
+        std::ofstream out((std::string(pInput) + "/" + path.Format(frames[RecordStreamDepth][FailedFrame].timestamp)).c_str(),
+            std::ios::binary | std::ios::trunc);
+        out.write("RVL", 3);
+    }
+
+    std::vector<RecordFrame> written[RecordStreamCount] = { frames[RecordStreamColor], frames[RecordStreamDepth] };
+    written[RecordStreamDepth].erase(written[RecordStreamDepth].begin() + FailedFrame);
+
+    const size_t GapLines = 20;
+    transcoder.SetEncoder(RecordStreamDepth, []() { return new TemporalDepthEncoder(); }, 1);
+    for (int i = 0; i < RecordStreamCount; i++)
+    {
+        remove((std::string(pOutput) + ((RecordStreamColor == i) ? "/rgb.txt" : "/depth.txt")).c_str());
+    }
+    violations += !transcoder.Transcode(pInput, pOutput, false, error) ? 1 : 0;
+    violations += (1 != transcoder.GetStats().failures[RecordStreamDepth]) ? 1 : 0;
+
+    for (int i = 0; i < RecordStreamCount; i++)
+    {
+        std::string listPath = std::string(pOutput) + ((RecordStreamColor == i) ? "/rgb.txt" : "/depth.txt");
+        std::ifstream in(listPath.c_str(), std::ios::binary);
+        std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        in.close();
+
+        size_t end = 0;
+        for (size_t line = 0; line < GapLines; line++)
+        {
+            end = text.find('\n', end) + 1;
+        }
+        text.resize(end);
+
+        std::ofstream out(listPath.c_str(), std::ios::binary | std::ios::trunc);
+        out.write(text.data(), text.size());
+    }
+
+    violations += !transcoder.Transcode(pInput, pOutput, false, error) ? 1 : 0;
+    stats = transcoder.GetStats();
+    violations += (GapLines != stats.resumed[RecordStreamColor] || GapLines + 1 != stats.resumed[RecordStreamDepth] ||
+                   stats.failures[RecordStreamColor] || stats.failures[RecordStreamDepth]) ? 1 : 0;
+    violations += CheckTranscoded(pOutput, written);
+
+    transcoder.SetEncoder(RecordStreamDepth, []() { return new RvlDepthEncoder(); }, 4);
+    remove(pPackage);
+    violations += !transcoder.Transcode(pInput, pPackage, true, error) ? 1 : 0;
+    violations += (1 != transcoder.GetStats().failures[RecordStreamDepth]) ? 1 : 0;
+    {
+        // Either stream holds more than the failed frame in the entries kept, whatever the order they were written
+        RgbdContainerReader reader;
+        reader.Open(pPackage);
+
+        std::ifstream in(pPackage, std::ios::binary);
+        std::vector<char> contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        in.close();
+
+        const RgbdIndexEntry& torn = reader.GetEntry(KeptFrames);
+        contents.resize((size_t)(torn.offset + sizeof(RgbdChunkHeader) + torn.payloadSize / 2));
+
+        std::ofstream out(pPackage, std::ios::binary | std::ios::trunc);
+        out.write(contents.data(), contents.size());
+    }
+
+    violations += !transcoder.Transcode(pInput, pPackage, true, error) ? 1 : 0;
+    stats = transcoder.GetStats();
+    violations += (KeptFrames + 1 != stats.resumed[RecordStreamColor] + stats.resumed[RecordStreamDepth] ||
+                   stats.failures[RecordStreamColor] || stats.failures[RecordStreamDepth]) ? 1 : 0;
+    violations += CheckTranscoded(pPackage, written);
+
+    // Remove the sessions
+    for (int i = 0; i < RecordStreamCount; i++)
+    {
+        const char* pName = (RecordStreamColor == i) ? "rgb" : "depth";
+        FramePathFormatter input(pName, (RecordStreamColor == i) ? ".bmp" : ".rvl");
+        FramePathFormatter output(pName, (RecordStreamColor == i) ? ".qoi" : ".tdp");
+        for (size_t j = 0; j < Frames; j++)
+        {
+            remove((std::string(pInput) + "/" + input.Format(frames[i][j].timestamp)).c_str());
+            remove((std::string(pOutput) + "/" + output.Format(frames[i][j].timestamp)).c_str());
+        }
+
+        for (const char* pSession : { pInput, pOutput })
+        {
+            remove((std::string(pSession) + "/" + pName + ".txt").c_str());
+            RemoveEmptyDirectory((std::string(pSession) + "/" + pName).c_str());
+        }
+    }
+    for (const char* pSession : { pInput, pOutput })
+    {
+        remove((std::string(pSession) + "/" RECORDING_INDEX_FILENAME).c_str());
+        RemoveEmptyDirectory(pSession);
+    }
+    remove(pPackage);
+
+    printf("transcode %u + %u frames, %.1f MB to %.1f MB, resumed after %u + %u and %u frames, "
+        "and past a failed frame, %.2f ms\n",
+        (unsigned)Frames, (unsigned)Frames, inputBytes / 1e6, outputBytes / 1e6,
+        (unsigned)KeptLines[0], (unsigned)KeptLines[1], (unsigned)KeptFrames, seconds * 1000);
+    if (violations)
+    {
+        printf("Transcoding lost, duplicated or changed frames\n");
+    }
+
+    return violations;
+}
+
+/// <summary>
+/// Read a capture profile and check every setting, reject profiles with unknown keys or bad values, then
+/// run a capture session from the profile with generated frames in place of a sensor until it is stopped,
+/// and check that the throughput lines were printed and every frame reached the container
+/// </summary>
+/// <returns>Number of violations found</returns>
+static int BenchCapture()
+{
+    const size_t Frames      = 30;
+    const char*  pProfile    = "rgbdtool_bench_capture.txt";
+    const char*  pDirectory  = "rgbdtool_bench_capture";
+
+    int violations = 0;
+    {
+        std::ofstream out(pProfile);
+        out << "# Production rig\n"
+               "directory        = " << pDirectory << "\n"
+               "duration         = 60        # stopped long before\n"
+               "stats_interval   = 0.1\n"
+               "output           = container\n"
+               "color_format     = qoi\n"
+               "depth_format     = rvl\n"
+               "drop_policy      = oldest\n"
+               "\n"
+               "color_resolution = 1280x960\n"
+               "depth_resolution = 320x240\n"
+               "skeleton         = off\n"
+               "split_mb         = 0\n";
+    }
+
+    CaptureProfile profile;
+    std::string    error;
+    violations += !LoadCaptureProfile(pProfile, profile, error) ? 1 : 0;
+    violations += profile.directory != pDirectory || 60.0 != profile.durationSeconds || 0.1 != profile.statsSeconds ? 1 : 0;
+    violations += RecordingOutputContainer != profile.recording.output || RecordingColorFormatQoi != profile.recording.colorFormat ||
+                  RecordingDepthFormatRvl != profile.recording.depthFormat || RecordDropPolicyOldest != profile.dropPolicy ? 1 : 0;
+    violations += 1280 != profile.colorWidth || 960 != profile.colorHeight || 320 != profile.depthWidth || 240 != profile.depthHeight ? 1 : 0;
+    violations += profile.skeleton || profile.recording.splitBytes ? 1 : 0;
+
+    // A bad line rejects the whole profile and names the line
+    const char* badProfiles[] = { "output = files\nframe_rate = 30\n", "output = files\ncolor_resolution = 800x600\n", "output = files\nnear_mode\n" };
+    for (const char* pBad : badProfiles)
+    {
+        {
+            std::ofstream out(pProfile);
+            out << pBad;
+        }
+        CaptureProfile rejected = profile;
+        violations += LoadCaptureProfile(pProfile, rejected, error) || std::string::npos == error.find(":2: ") ||
+                      RecordingOutputContainer != rejected.recording.output ? 1 : 0;
+    }
+    remove(pProfile);
+
+    // A session enters its directory and records whatever the streams submit
+    std::vector<RecordFrame> frames[RecordStreamCount];
+    GenerateColorFrames(Frames, 320, 240, frames[RecordStreamColor]);
+    GenerateDepthFrames(Frames, frames[RecordStreamDepth]);
+
+    std::vector<std::string> containers;
+    std::vector<RgbdIndexEntry> index;
+    size_t lines = 0;
+    double seconds = 0.0;
+    {
+        CaptureSession session(profile);
+        violations += !session.Open(error) || !session.Start() ? 1 : 0;
+
+        std::atomic<uint64_t> submitted[CaptureStreamCount] = {};
+        std::thread feeder([&]()
+        {
+            for (size_t i = 0; i < Frames; i++)
+            {
+                for (int stream = 0; stream < RecordStreamCount; stream++)
+                {
+                    FrameHandle frame = FrameHandle::Create();
+                    *frame.GetMutable() = frames[stream][i];
+                    frame.GetMutable()->frameNumber = (uint32_t)i;
+                    frame.GetMutable()->timestamp   = i / 30.0 + stream * 0.004;
+                    session.GetRecorder().SubmitFrame(std::move(frame));
+                    submitted[stream]++;
+                }
+                submitted[CaptureStreamSkeleton]++;
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            session.RequestStop();
+        });
+
+        FILE* pStats = tmpfile();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        session.Run([&](uint64_t counts[CaptureStreamCount])
+        {
+            for (int stream = 0; stream < CaptureStreamCount; stream++)
+            {
+                counts[stream] = submitted[stream];
+            }
+            return true;
+        }, pStats);
+        seconds = SecondsSince(start);
+        feeder.join();
+        session.Stop();
+
+        rewind(pStats);
+        char line[256];
+        while (fgets(line, sizeof(line), pStats))
+        {
+            lines += nullptr != strstr(line, " fps ") ? 1 : 0;
+        }
+        fclose(pStats);
+
+        RgbdRecovery::FindContainers(".", containers);
+        RgbdContainerReader reader;
+        if (1 == containers.size() && reader.Open(containers[0]))
+        {
+            index = reader.GetIndex();
+        }
+    }
+    ChangeDirectory("..");
+
+    // Every frame once, in order
+    size_t counts[RecordStreamCount] = {};
+    for (const RgbdIndexEntry& entry : index)
+    {
+        violations += entry.stream >= RecordStreamCount || entry.frameNumber != counts[entry.stream]++ ? 1 : 0;
+    }
+    violations += Frames != counts[RecordStreamColor] || Frames != counts[RecordStreamDepth] ? 1 : 0;
+    violations += lines < 2 || seconds > 5.0 ? 1 : 0;
+
+    for (const std::string& container : containers)
+    {
+        remove((std::string(pDirectory) + "/" + container).c_str());
+    }
+    for (const char* pName : { "associations.txt", "dropped.txt", "session.log" })
+    {
+        remove((std::string(pDirectory) + "/" + pName).c_str());
+    }
+    RemoveEmptyDirectory(pDirectory);
+
+    printf("capture profile, %u + %u frames recorded, %u stats lines, stopped after %.2f s\n",
+        (unsigned)counts[RecordStreamColor], (unsigned)counts[RecordStreamDepth], (unsigned)lines, seconds);
+    if (violations)
+    {
+        printf("Capture profile misread or capture session lost frames\n");
+    }
+
+    return violations;
+}
+
+/// <summary>
+/// Capture from a stand-in source as RgbdTool capture does, into the directory of the profile, and read back
+/// the frames recorded
+/// </summary>
+/// <returns>Number of violations found</returns>
+static int CaptureStandIn(const CaptureProfile& profile, uint64_t counts[CaptureStreamCount], double& seconds,
+                          std::vector<RecordFrame> frames[RecordStreamCount])
+{
+    std::string error;
+    std::unique_ptr<SensorSource> pSource(CreateStandInSource(profile, ReplaySensorSource::ImageDecoder(), error));
+    if (!pSource)
+    {
+        printf("%s\n", error.c_str());
+        return 1;
+    }
+
+    int violations = 0;
+    {
+        CaptureSession session(profile);
+        violations += !session.Open(error) ? 1 : 0;
+        {
+            CaptureStreams streams(*pSource, session);
+            violations += !session.Start() || !streams.Start() ? 1 : 0;
+
+            // Ends by itself once the source has delivered its frames
+            FILE* pStats = tmpfile();
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            session.Run([&](uint64_t frameCounts[CaptureStreamCount]) { return streams.CountFrames(frameCounts); }, pStats);
+            seconds = SecondsSince(start);
+            fclose(pStats);
+
+            streams.Stop();
+            streams.CountFrames(counts);
+            pSource.reset();
+        }
+        session.Stop();
+    }
+    ChangeDirectory("..");
+
+    std::vector<std::string> containers;
+    RgbdRecovery::FindContainers(profile.directory, containers);
+    for (const std::string& path : containers)
+    {
+        violations += !LoadFrames(path, RecordStreamColor, RecordPixelFormatBgra32, SIZE_MAX, frames[RecordStreamColor]) ||
+                      !LoadFrames(path, RecordStreamDepth, RecordPixelFormatDepthPixel32, SIZE_MAX, frames[RecordStreamDepth]) ? 1 : 0;
+    }
+    violations += 1 != containers.size() ? 1 : 0;
+
+    return violations;
+}
+
+/// <summary>
+/// Remove the directory of a capture and the files in it
+/// </summary>
+static void RemoveCapture(const std::string& directory)
+{
+    std::vector<std::string> containers;
+    RgbdRecovery::FindContainers(directory, containers);
+    for (const std::string& container : containers)
+    {
+        remove(container.c_str());
+    }
+    for (const char* pName : { "associations.txt", "dropped.txt", "session.log" })
+    {
+        remove((directory + "/" + pName).c_str());
+    }
+    RemoveEmptyDirectory(directory.c_str());
+}
+
+/// <summary>
+/// Count the frames of two recordings which differ in pixels or frame number
+/// </summary>
+static int CompareCaptures(const std::vector<RecordFrame>* pExpected, const std::vector<RecordFrame>* pActual)
+{
+    int violations = 0;
+    for (int i = 0; i < RecordStreamCount; i++)
+    {
+        violations += pExpected[i].size() != pActual[i].size() ? 1 : 0;
+        for (size_t j = 0; j < pExpected[i].size() && j < pActual[i].size(); j++)
+        {
+            const RecordFrame& expected = pExpected[i][j];
+            const RecordFrame& actual   = pActual[i][j];
+            violations += expected.frameNumber != actual.frameNumber || expected.width != actual.width || expected.height != actual.height ||
+                          expected.stride != actual.stride || expected.data.size() != actual.data.size() ||
+                          0 != memcmp(expected.data.data(), actual.data.data(), expected.data.size()) ? 1 : 0;
+        }
+    }
+
+    return violations;
+}
+
+/// <summary>
+/// Run the capture path on the stand-in sources: generated frames at full speed until the frame limit, twice,
+/// which must record the same frames, then a replay of the recording at full speed, which must record it again
+/// unchanged, and a replay at real time, which must take as long as the frames it replays
+/// </summary>
+/// <returns>Number of violations found</returns>
+static int BenchSensor()
+{
+    const uint64_t Frames         = 60;
+    const uint64_t RealTimeFrames = 15;
+    const char*    pDirectories[] = { "rgbdtool_bench_sensor_a", "rgbdtool_bench_sensor_b", "rgbdtool_bench_sensor_c", "rgbdtool_bench_sensor_d" };
+
+    CaptureProfile profile;
+    profile.source                = CaptureSourceSynthetic;
+    profile.speed                 = 0.0;
+    profile.frameLimit            = Frames;
+    profile.statsSeconds          = 0.1;
+    profile.scene.noise           = 4;
+    profile.depthWidth            = 320;
+    profile.depthHeight           = 240;
+    profile.recording.output      = RecordingOutputContainer;
+    profile.recording.colorFormat = RecordingColorFormatQoi;
+    profile.recording.depthFormat = RecordingDepthFormatRvl;
+
+    int violations = 0;
+
+    // Generated at full speed, every frame of both streams is recorded and the skeleton frames counted
+    uint64_t                 counts[CaptureStreamCount] = {};
+    double                   seconds = 0.0;
+    std::vector<RecordFrame> generated[RecordStreamCount];
+    profile.directory = pDirectories[0];
+    violations += CaptureStandIn(profile, counts, seconds, generated);
+    violations += Frames != counts[CaptureStreamColor] || Frames != counts[CaptureStreamDepth] || Frames != counts[CaptureStreamSkeleton] ? 1 : 0;
+    violations += Frames != generated[RecordStreamColor].size() || Frames != generated[RecordStreamDepth].size() ? 1 : 0;
+    double fps = seconds > 0.0 ? (counts[CaptureStreamColor] + counts[CaptureStreamDepth]) / seconds : 0.0;
+
+    // The same frames in a second run
+    uint64_t                 againCounts[CaptureStreamCount] = {};
+    double                   againSeconds = 0.0;
+    std::vector<RecordFrame> again[RecordStreamCount];
+    profile.directory = pDirectories[1];
+    violations += CaptureStandIn(profile, againCounts, againSeconds, again);
+    violations += CompareCaptures(generated, again);
+
+    // Replayed as fast as it goes and recorded again, pixels and frame numbers unchanged
+    std::vector<std::string> containers;
+    RgbdRecovery::FindContainers(pDirectories[0], containers);
+    profile.source     = CaptureSourceReplay;
+    profile.replayPath = containers.empty() ? std::string() : containers[0];
+    profile.frameLimit = 0;
+
+    uint64_t                 replayCounts[CaptureStreamCount] = {};
+    double                   replaySeconds = 0.0;
+    std::vector<RecordFrame> replayed[RecordStreamCount];
+    profile.directory = pDirectories[2];
+    violations += CaptureStandIn(profile, replayCounts, replaySeconds, replayed);
+    violations += CompareCaptures(generated, replayed);
+
+    // Replayed at real time, the frames come 33 ms apart. A stream falling behind loses frames as with a sensor,
+    // which a loaded machine may see, but the time the frames take does not change
+    uint64_t                 realTimeCounts[CaptureStreamCount] = {};
+    double                   realTimeSeconds = 0.0;
+    std::vector<RecordFrame> realTime[RecordStreamCount];
+    profile.speed      = 1.0;
+    profile.frameLimit = RealTimeFrames;
+    profile.directory  = pDirectories[3];
+    violations += CaptureStandIn(profile, realTimeCounts, realTimeSeconds, realTime);
+    violations += realTime[RecordStreamColor].empty() || realTime[RecordStreamColor].size() > RealTimeFrames ||
+                  realTime[RecordStreamDepth].empty() || realTime[RecordStreamDepth].size() > RealTimeFrames ? 1 : 0;
+    double expectedSeconds = (RealTimeFrames - 1) / 30.0;
+    violations += realTimeSeconds < expectedSeconds || realTimeSeconds > expectedSeconds + 1.0 ? 1 : 0;
+
+    for (const char* pDirectory : pDirectories)
+    {
+        RemoveCapture(pDirectory);
+    }
+
+    printf("sensor stand-ins, %u + %u generated frames at %.0f fps, replayed %s at %.0f fps, %u frames at real time in %.2f s\n",
+        (unsigned)counts[CaptureStreamColor], (unsigned)counts[CaptureStreamDepth], fps,
+        CompareCaptures(generated, replayed) ? "with differences" : "unchanged",
+        replaySeconds > 0.0 ? (replayCounts[CaptureStreamColor] + replayCounts[CaptureStreamDepth]) / replaySeconds : 0.0,
+        (unsigned)realTime[RecordStreamColor].size(), realTimeSeconds);
+    if (violations)
+    {
+        printf("Stand-in sources delivered other frames than expected\n");
+    }
+
+    return violations;
+}
+
+/// <summary>
+/// Compare the lossless codecs with PNG depth and BMP color on recorded or generated frames
+/// and check that they round-trip exactly
+/// </summary>
+static int Bench(const char* pPath)
+{
+    const size_t MaxFrames = 150;
+
+    std::vector<RecordFrame> frames;
+    if (pPath)
+    {
+        if (!LoadFrames(pPath, RecordStreamDepth, RecordPixelFormatDepthPixel32, MaxFrames, frames))
+        {
+            return 1;
+        }
+    }
+    else
+    {
+        GenerateDepthFrames(MaxFrames, frames);
+    }
+
+    if (frames.empty())
+    {
+        fprintf(stderr, "No depth frames to benchmark\n");
+        return 1;
+    }
+
+    double planeBytes = 0;
+    for (const RecordFrame& frame : frames)
+    {
+        planeBytes += (double)frame.width * frame.height * sizeof(uint16_t);
+    }
+
+    printf("codec frames    in (MB)   out (MB)    ratio  enc (MB/s)  enc (fps)   dec (MB/s)\n");
+
+    RvlDepthEncoder      rvl;
+    TemporalDepthEncoder temporal;
+    int mismatches = BenchEncoder(rvl, frames, planeBytes) + BenchEncoder(temporal, frames, planeBytes);
+    mismatches += BenchMalformedFrames(rvl, frames[0]) + BenchMalformedFrames(temporal, frames[0]);
+    mismatches += BenchOversizedPayload(rvl, frames[0]) + BenchOversizedPayload(temporal, frames[0]);
+    mismatches += BenchLostPayload(frames);
+
+#ifdef RGBDTOOL_WITH_OPENCV
+    // The capture path encodes a 16-bit image with cv::imwrite; imencode measures the same encoder without the disk
+    std::vector<cv::Mat> planes;
+    for (const RecordFrame& frame : frames)
+    {
+        cv::Mat plane(frame.height, frame.width, CV_16UC1);
+        for (uint32_t y = 0; y < frame.height; y++)
+        {
+            SplitDepthPixels(reinterpret_cast<const uint16_t*>(frame.data.data() + (size_t)y * frame.stride), frame.width,
+                             plane.ptr<uint16_t>(y), nullptr);
+        }
+        planes.push_back(plane);
+    }
+
+    std::vector<uchar> png;
+    double encodedBytes = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (const cv::Mat& plane : planes)
+    {
+        cv::imencode(".png", plane, png);
+        encodedBytes += (double)png.size();
+    }
+    double encodeSeconds = SecondsSince(start);
+
+    PrintBenchResult("png", frames.size(), planeBytes, encodedBytes, encodeSeconds, 0);
+#else
+    printf("png   (built without OpenCV)\n");
+#endif
+
+    mismatches += BenchDepthSplit(frames);
+    mismatches += BenchColor(pPath, MaxFrames);
+    mismatches += BenchPaths();
+    mismatches += BenchAssociation();
+    mismatches += BenchFramePool();
+    mismatches += BenchTripleBuffer();
+    mismatches += BenchDispatch();
+    mismatches += BenchPipeline();
+    mismatches += BenchDropPolicy();
+    mismatches += BenchRecorderRestart();
+    mismatches += BenchPreTrigger();
+    mismatches += BenchPreTriggerSessions();
+    mismatches += BenchSegments();
+    mismatches += BenchShortWrite();
+    mismatches += BenchRecovery();
+    mismatches += BenchCorruptChunk();
+    mismatches += BenchTranscode();
+    mismatches += BenchCapture();
+    mismatches += BenchSensor();
+
+    if (mismatches)
+    {
+        printf("Round trip FAILED for %d frames\n", mismatches);
+        return 1;
+    }
+
+    printf("Round trip exact for all frames of every codec\n");
+    return 0;
+}
+
+/// <summary>
+/// Print command line usage
+/// </summary>
+static void Usage()
+{
+    fprintf(stderr,
+        "Usage:\n"
+        "  RgbdTool list    <container>\n"
+        "  RgbdTool extract <container> <output directory>\n"
+        "  RgbdTool verify  <container>\n"
+        "  RgbdTool index   <session folder>\n"
+        "  RgbdTool recover <container or session folder>\n"
+        "  RgbdTool transcode <container or session folder> <output> [--container] [--color qoi|raw] [--depth rvl|tdp]\n"
+        "  RgbdTool capture <profile with source = replay or synthetic>\n"
+        "  RgbdTool bench   [container or session folder]\n");
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        Usage();
+        return 2;
+    }
+
+    std::string command = argv[1];
+    if ("bench" == command)
+    {
+        // Generated frames are used when no recording is given
+        return Bench(argc >= 3 ? argv[2] : nullptr);
+    }
+    else if (argc < 3)
+    {
+        Usage();
+        return 2;
+    }
+    else if ("list" == command)
+    {
+        return List(argv[2]);
+    }
+    else if ("extract" == command && argc >= 4)
+    {
+        return Extract(argv[2], argv[3]);
+    }
+    else if ("verify" == command)
+    {
+        return Verify(argv[2]);
+    }
+    else if ("index" == command)
+    {
+        return Index(argv[2]);
+    }
+    else if ("recover" == command)
+    {
+        return Recover(argv[2]);
+    }
+    else if ("transcode" == command && argc >= 4)
+    {
+        return Transcode(argv[2], argv[3], argc - 4, argv + 4);
+    }
+    else if ("capture" == command)
+    {
+        return Capture(argv[2]);
+    }
+
+    Usage();
+    return 2;
+}
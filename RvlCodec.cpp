@@ -0,0 +1,346 @@
+//------------------------------------------------------------------------------
+// <copyright file="RvlCodec.cpp">
+//     Lossless run-length/variable-length (RVL) compression of depth frames.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "RvlCodec.h"
+
+#include <cstring>
+
+namespace
+{
+    /// <summary>
+    /// Packs variable-length nibbles into 32-bit words, most significant nibble first
+    /// </summary>
+    class NibbleWriter
+    {
+    public:
+        NibbleWriter(std::vector<uint32_t>& output)
+            : m_output(output)
+            , m_word(0)
+            , m_nibbles(0)
+        {
+        }
+
+        void Write(uint32_t value)
+        {
+            do
+            {
+                uint32_t nibble = value & 0x7;
+                value >>= 3;
+                if (value)
+                {
+                    nibble |= 0x8;
+                }
+
+                m_word = (m_word << 4) | nibble;
+                if (8 == ++m_nibbles)
+                {
+                    m_output.push_back(m_word);
+                    m_word    = 0;
+                    m_nibbles = 0;
+                }
+            } while (value);
+        }
+
+        void Flush()
+        {
+            if (m_nibbles)
+            {
+                m_output.push_back(m_word << (4 * (8 - m_nibbles)));
+                m_word    = 0;
+                m_nibbles = 0;
+            }
+        }
+
+    private:
+        std::vector<uint32_t>&  m_output;
+        uint32_t                m_word;
+        int                     m_nibbles;
+    };
+
+    /// <summary>
+    /// Reads variable-length nibbles back from 32-bit words
+    /// </summary>
+    class NibbleReader
+    {
+    public:
+        NibbleReader(const uint32_t* pWords, size_t wordCount)
+            : m_pWords(pWords)
+            , m_pEnd(pWords + wordCount)
+            , m_word(0)
+            , m_nibbles(0)
+        {
+        }
+
+        bool Read(uint32_t& value)
+        {
+            value = 0;
+            for (int shift = 0; shift < 32; shift += 3)
+            {
+                if (0 == m_nibbles)
+                {
+                    if (m_pWords == m_pEnd)
+                    {
+                        return false;
+                    }
+                    m_word    = *m_pWords++;
+                    m_nibbles = 8;
+                }
+
+                uint32_t nibble = m_word >> 28;
+                m_word <<= 4;
+                --m_nibbles;
+
+                value |= (nibble & 0x7) << shift;
+                if (!(nibble & 0x8))
+                {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+    private:
+        const uint32_t* m_pWords;
+        const uint32_t* m_pEnd;
+        uint32_t        m_word;
+        int             m_nibbles;
+    };
+}
+
+/// <summary>
+/// Compress a sequence of 16-bit values
+/// </summary>
+/// <param name="pValues">The pointer to the first value</param>
+/// <param name="count">Number of values</param>
+/// <param name="step">Distance between consecutive values in elements</param>
+/// <param name="output">Receives the RVL words, appended to existing content</param>
+/// <param name="deltaCoding">Store non-zero values as differences to the previous non-zero value
+/// rather than as they are. Values which are already small, like prediction residuals, are stored as they are</param>
+/// <returns>Number of words appended</returns>
+size_t RvlEncode(const uint16_t* pValues, size_t count, size_t step, std::vector<uint32_t>& output, bool deltaCoding)
+{
+    size_t       start = output.size();
+    NibbleWriter writer(output);
+
+    const uint16_t* pValue = pValues;
+    const uint16_t* pEnd   = pValues + count * step;
+    int             previous = 0;
+
+    while (pValue < pEnd)
+    {
+        uint32_t zeros = 0;
+        while (pValue < pEnd && 0 == *pValue)
+        {
+            pValue += step;
+            ++zeros;
+        }
+        writer.Write(zeros);
+
+        const uint16_t* pRun = pValue;
+        uint32_t nonZeros = 0;
+        while (pRun < pEnd && 0 != *pRun)
+        {
+            pRun += step;
+            ++nonZeros;
+        }
+        writer.Write(nonZeros);
+
+        if (!deltaCoding)
+        {
+            for (; pValue < pRun; pValue += step)
+            {
+                writer.Write(*pValue);
+            }
+            continue;
+        }
+
+        for (; pValue < pRun; pValue += step)
+        {
+            int delta = (int)*pValue - previous;
+            previous  = *pValue;
+            writer.Write(((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31));   // Zigzag keeps small negative deltas short
+        }
+    }
+
+    writer.Flush();
+    return output.size() - start;
+}
+
+/// <summary>
+/// Decompress a sequence of 16-bit values
+/// </summary>
+/// <param name="pWords">The pointer to the RVL words</param>
+/// <param name="wordCount">Number of words</param>
+/// <param name="pValues">Receives the values</param>
+/// <param name="count">Number of values to decode</param>
+/// <param name="step">Distance between consecutive values in elements</param>
+/// <param name="deltaCoding">Must match the value used for encoding</param>
+/// <returns>False if the words do not hold count values</returns>
+bool RvlDecode(const uint32_t* pWords, size_t wordCount, uint16_t* pValues, size_t count, size_t step, bool deltaCoding)
+{
+    NibbleReader reader(pWords, wordCount);
+
+    uint16_t* pValue   = pValues;
+    size_t    left     = count;
+    int       previous = 0;
+
+    while (left)
+    {
+        uint32_t zeros, nonZeros;
+        if (!reader.Read(zeros) || zeros > left)
+        {
+            return false;
+        }
+        for (left -= zeros; zeros; --zeros, pValue += step)
+        {
+            *pValue = 0;
+        }
+
+        if (!reader.Read(nonZeros) || nonZeros > left)
+        {
+            return false;
+        }
+        for (left -= nonZeros; nonZeros; --nonZeros, pValue += step)
+        {
+            uint32_t value;
+            if (!reader.Read(value))
+            {
+                return false;
+            }
+
+            if (deltaCoding)
+            {
+                previous += (int)(value >> 1) ^ -(int)(value & 1);
+                value = (uint32_t)previous;
+            }
+            *pValue = (uint16_t)value;
+        }
+    }
+
+    return true;
+}
+
+/// <summary>
+/// Decode the depth and player index streams of a payload into NUI_DEPTH_IMAGE_PIXEL values
+/// </summary>
+/// <param name="pWordBytes">The pointer to the depth words, followed by the player index words</param>
+/// <param name="depthWords">Number of depth words</param>
+/// <param name="playerWords">Number of player index words</param>
+/// <param name="pPixels">Receives pairs of player index and depth</param>
+/// <param name="pixels">Number of pixels</param>
+/// <param name="deltaCoding">Must match the value used for encoding</param>
+/// <returns>Indicates success or failure</returns>
+bool RvlDecodeDepthPixels(const uint8_t* pWordBytes, size_t depthWords, size_t playerWords, uint16_t* pPixels, size_t pixels, bool deltaCoding)
+{
+    // Payloads inside a mapped container are not necessarily 4-byte aligned
+    std::vector<uint32_t> aligned;
+    if (reinterpret_cast<uintptr_t>(pWordBytes) & 3)
+    {
+        aligned.resize(depthWords + playerWords);
+        memcpy(aligned.data(), pWordBytes, aligned.size() * sizeof(uint32_t));
+        pWordBytes = reinterpret_cast<const uint8_t*>(aligned.data());
+    }
+
+    const uint32_t* pDepthWords  = reinterpret_cast<const uint32_t*>(pWordBytes);
+    const uint32_t* pPlayerWords = pDepthWords + depthWords;
+
+    // NUI_DEPTH_IMAGE_PIXEL is { USHORT playerIndex; USHORT depth; }
+    return RvlDecode(pDepthWords, depthWords, pPixels + 1, pixels, 2, deltaCoding) &&
+           RvlDecode(pPlayerWords, playerWords, pPixels, pixels, 2, deltaCoding);
+}
+
+/// <summary>
+/// Decode an RVL depth payload into a NUI_DEPTH_IMAGE_PIXEL frame
+/// </summary>
+/// <param name="pPayload">The pointer to payload</param>
+/// <param name="size">Size of payload in bytes</param>
+/// <param name="frame">Receives format, size and pixels</param>
+/// <returns>Indicates success or failure</returns>
+bool RvlDecodeDepth(const uint8_t* pPayload, size_t size, RecordFrame& frame)
+{
+    RvlHeader header;
+    if (size < sizeof(header))
+    {
+        return false;
+    }
+    memcpy(&header, pPayload, sizeof(header));
+
+    if (RVL_MAGIC != header.magic || (size_t)header.width * header.height > RVL_MAX_PIXELS ||
+        sizeof(header) + ((uint64_t)header.depthWords + header.playerWords) * sizeof(uint32_t) > size)
+    {
+        return false;
+    }
+
+    size_t pixels = (size_t)header.width * header.height;
+
+    frame.format = RecordPixelFormatDepthPixel32;
+    frame.width  = header.width;
+    frame.height = header.height;
+    frame.stride = header.width * 4;
+    frame.data.resize(pixels * 4);
+
+    return RvlDecodeDepthPixels(pPayload + sizeof(header), header.depthWords, header.playerWords,
+                                reinterpret_cast<uint16_t*>(frame.data.data()), pixels, true);
+}
+
+/// <summary>
+/// Get the NUI_DEPTH_IMAGE_PIXEL values of a frame without row padding
+/// </summary>
+/// <param name="frame">Depth frame</param>
+/// <param name="packed">Storage for the values if the rows of the frame are padded</param>
+/// <returns>The pointer to width * height pairs of player index and depth</returns>
+const uint16_t* GetPackedDepthPixels(const RecordFrame& frame, std::vector<uint16_t>& packed)
+{
+    if (frame.stride == frame.width * 4)
+    {
+        return reinterpret_cast<const uint16_t*>(frame.data.data());
+    }
+
+    // Runs may cross rows, so padded rows are packed first
+    packed.resize((size_t)frame.width * frame.height * 2);
+    for (uint32_t y = 0; y < frame.height; y++)
+    {
+        memcpy(&packed[(size_t)y * frame.width * 2], frame.data.data() + (size_t)y * frame.stride, frame.width * 4);
+    }
+    return packed.data();
+}
+
+/// <summary>
+/// Encode a depth frame
+/// </summary>
+/// <param name="frame">Frame to encode, must be RecordPixelFormatDepthPixel32</param>
+/// <param name="payload">Receives the encoded payload</param>
+/// <param name="keyframe">Receives true, every RVL frame decodes on its own</param>
+/// <returns>Indicates success or failure</returns>
+bool RvlDepthEncoder::EncodeFrame(const RecordFrame& frame, std::vector<uint8_t>& payload, bool& keyframe)
+{
+    if (RecordPixelFormatDepthPixel32 != frame.format ||
+        frame.width > 0xFFFF || frame.height > 0xFFFF || (size_t)frame.width * frame.height > RVL_MAX_PIXELS ||
+        frame.stride < frame.width * 4 ||
+        frame.data.size() < (size_t)frame.stride * frame.height)
+    {
+        return false;
+    }
+
+    size_t          pixels  = (size_t)frame.width * frame.height;
+    const uint16_t* pPixels = GetPackedDepthPixels(frame, m_packed);
+
+    m_words.clear();
+    RvlHeader header;
+    header.magic       = RVL_MAGIC;
+    header.width       = (uint16_t)frame.width;
+    header.height      = (uint16_t)frame.height;
+    header.depthWords  = (uint32_t)RvlEncode(pPixels + 1, pixels, 2, m_words);
+    header.playerWords = (uint32_t)RvlEncode(pPixels, pixels, 2, m_words);
+
+    payload.resize(sizeof(header) + m_words.size() * sizeof(uint32_t));
+    memcpy(payload.data(), &header, sizeof(header));
+    memcpy(payload.data() + sizeof(header), m_words.data(), m_words.size() * sizeof(uint32_t));
+
+    keyframe = true;
+    return true;
+}
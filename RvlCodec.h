@@ -0,0 +1,124 @@
+//------------------------------------------------------------------------------
+// <copyright file="RvlCodec.h">
+//     Lossless run-length/variable-length (RVL) compression of depth frames.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "FrameCodec.h"
+
+// Payload layout, all fields little-endian:
+//
+//   RvlHeader
+//   uint32_t[depthWords]       RVL stream of the depth values
+//   uint32_t[playerWords]      RVL stream of the player indices
+//
+// Each RVL stream alternates a count of zero values and a count of non-zero values, followed by
+// the zigzag-encoded differences between consecutive non-zero values. All numbers are written as
+// variable-length nibbles, 3 bits of data and a continuation bit, packed 8 to a 32-bit word.
+// Kinect depth is 13 bits wide with large invalid (0) areas, so both runs and deltas stay short.
+
+#define RVL_MAGIC   0x314C5652      // 'RVL1'
+
+// Frames are at most the largest NUI resolution. Runs of zeros cost a few nibbles however long they are,
+// so the payload size does not bound the geometry; a header claiming more pixels is damaged
+#define RVL_MAX_PIXELS  (1280 * 960)
+
+#pragma pack(push, 1)
+
+struct RvlHeader
+{
+    uint32_t    magic;
+    uint16_t    width;
+    uint16_t    height;
+    uint32_t    depthWords;
+    uint32_t    playerWords;
+};
+
+#pragma pack(pop)
+
+/// <summary>
+/// Compress a sequence of 16-bit values
+/// </summary>
+/// <param name="pValues">The pointer to the first value</param>
+/// <param name="count">Number of values</param>
+/// <param name="step">Distance between consecutive values in elements</param>
+/// <param name="output">Receives the RVL words, appended to existing content</param>
+/// <param name="deltaCoding">Store non-zero values as differences to the previous non-zero value
+/// rather than as they are. Values which are already small, like prediction residuals, are stored as they are</param>
+/// <returns>Number of words appended</returns>
+size_t RvlEncode(const uint16_t* pValues, size_t count, size_t step, std::vector<uint32_t>& output, bool deltaCoding = true);
+
+/// <summary>
+/// Decompress a sequence of 16-bit values
+/// </summary>
+/// <param name="pWords">The pointer to the RVL words</param>
+/// <param name="wordCount">Number of words</param>
+/// <param name="pValues">Receives the values</param>
+/// <param name="count">Number of values to decode</param>
+/// <param name="step">Distance between consecutive values in elements</param>
+/// <param name="deltaCoding">Must match the value used for encoding</param>
+/// <returns>False if the words do not hold count values</returns>
+bool RvlDecode(const uint32_t* pWords, size_t wordCount, uint16_t* pValues, size_t count, size_t step, bool deltaCoding = true);
+
+/// <summary>
+/// Get the NUI_DEPTH_IMAGE_PIXEL values of a frame without row padding
+/// </summary>
+/// <param name="frame">Depth frame</param>
+/// <param name="packed">Storage for the values if the rows of the frame are padded</param>
+/// <returns>The pointer to width * height pairs of player index and depth</returns>
+const uint16_t* GetPackedDepthPixels(const RecordFrame& frame, std::vector<uint16_t>& packed);
+
+/// <summary>
+/// Decode the depth and player index streams of a payload into NUI_DEPTH_IMAGE_PIXEL values
+/// </summary>
+/// <param name="pWordBytes">The pointer to the depth words, followed by the player index words</param>
+/// <param name="depthWords">Number of depth words</param>
+/// <param name="playerWords">Number of player index words</param>
+/// <param name="pPixels">Receives pairs of player index and depth</param>
+/// <param name="pixels">Number of pixels</param>
+/// <param name="deltaCoding">Must match the value used for encoding</param>
+/// <returns>Indicates success or failure</returns>
+bool RvlDecodeDepthPixels(const uint8_t* pWordBytes, size_t depthWords, size_t playerWords, uint16_t* pPixels, size_t pixels, bool deltaCoding);
+
+/// <summary>
+/// Decode an RVL depth payload into a NUI_DEPTH_IMAGE_PIXEL frame
+/// </summary>
+/// <param name="pPayload">The pointer to payload</param>
+/// <param name="size">Size of payload in bytes</param>
+/// <param name="frame">Receives format, size and pixels</param>
+/// <returns>Indicates success or failure</returns>
+bool RvlDecodeDepth(const uint8_t* pPayload, size_t size, RecordFrame& frame);
+
+/// <summary>
+/// Lossless depth encoder. Compresses both the depth and the player index of
+/// NUI_DEPTH_IMAGE_PIXEL frames, so decoding gives back the exact sensor data.
+/// </summary>
+class RvlDepthEncoder : public FrameEncoder
+{
+public:
+    /// <summary>
+    /// Get the codec the payloads are encoded with
+    /// </summary>
+    virtual RecordCodec GetCodec() const { return RecordCodecRvl; }
+
+    /// <summary>
+    /// Get file name extension for payloads stored as separate files
+    /// </summary>
+    virtual const char* GetFileExtension() const { return ".rvl"; }
+
+protected:
+    /// <summary>
+    /// Encode a depth frame
+    /// </summary>
+    /// <param name="frame">Frame to encode, must be RecordPixelFormatDepthPixel32</param>
+    /// <param name="payload">Receives the encoded payload</param>
+    /// <param name="keyframe">Receives true, every RVL frame decodes on its own</param>
+    /// <returns>Indicates success or failure</returns>
+    virtual bool EncodeFrame(const RecordFrame& frame, std::vector<uint8_t>& payload, bool& keyframe);
+
+private:
+    std::vector<uint32_t>   m_words;        // Reused between frames to avoid reallocation
+    std::vector<uint16_t>   m_packed;       // Frame with row padding removed, only used for padded frames
+};
@@ -0,0 +1,158 @@
+//------------------------------------------------------------------------------
+// <copyright file="SensorClock.cpp">
+//     Mapping of sensor frame timestamps to wall-clock time.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "SensorClock.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace
+{
+    // The rate is only trusted once the samples span this many seconds
+    const double MinRateSpan = 10.0;
+
+    // Crystal tolerances are far below this. A larger fitted deviation means bad samples
+    const double MaxRateDeviation = 1e-3;
+
+    // A sensor timestamp going back by more than this means the sensor has been restarted
+    const int64_t MaxBackwardMilliseconds = 1000;
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+SensorClock::SensorClock()
+    : m_freeRunning(false)
+{
+    Reset();
+}
+
+/// <summary>
+/// Get the time of the monotonic host clock
+/// </summary>
+/// <returns>Seconds since an arbitrary point in time</returns>
+double SensorClock::GetHostTime()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// <summary>
+/// Forget all samples, e.g. when the sensor has been restarted
+/// </summary>
+void SensorClock::Reset()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    ResetLocked();
+}
+
+/// <summary>
+/// Map sensor time straight onto wall-clock time from the first frame on, without fitting it to the
+/// arrival of the frames. For stand-in sources delivering faster or slower than real time, whose
+/// frames arrive at host times which say nothing of their sensor time
+/// </summary>
+/// <param name="freeRunning">Follow sensor time, or fit it to host time as for a sensor</param>
+void SensorClock::SetFreeRunning(bool freeRunning)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_freeRunning = freeRunning;
+}
+
+/// <summary>
+/// Clear the fit. Called with the lock held
+/// </summary>
+void SensorClock::ResetLocked()
+{
+    double wall = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+    m_hostToWall = wall - GetHostTime();
+
+    m_sensorOrigin = 0;
+    m_hostOrigin   = 0;
+    m_lastSensor   = 0;
+    m_count        = 0;
+    m_meanSensor   = 0;
+    m_meanHost     = 0;
+    m_covariance   = 0;
+    m_variance     = 0;
+}
+
+/// <summary>
+/// Get the fitted rate of the host clock relative to the sensor clock
+/// </summary>
+double SensorClock::GetRate() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return GetRateLocked();
+}
+
+/// <summary>
+/// Get the fitted rate. Called with the lock held
+/// </summary>
+double SensorClock::GetRateLocked() const
+{
+    // Variance of a uniform spread over the span is span^2 / 12
+    if (m_count < 2 || m_variance / m_count < MinRateSpan * MinRateSpan / 12)
+    {
+        return 1.0;
+    }
+
+    double rate = m_covariance / m_variance;
+    return std::max(1.0 - MaxRateDeviation, std::min(1.0 + MaxRateDeviation, rate));
+}
+
+/// <summary>
+/// Add the sample of a frame and map its sensor timestamp to wall-clock time
+/// </summary>
+/// <param name="sensorMilliseconds">Sensor timestamp of the frame, NUI_IMAGE_FRAME::liTimeStamp</param>
+/// <param name="hostTime">Host time the frame arrived at, from GetHostTime</param>
+/// <returns>Capture time in seconds since epoch</returns>
+double SensorClock::Map(int64_t sensorMilliseconds, double hostTime)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    if (m_count > 0 && sensorMilliseconds < m_lastSensor - MaxBackwardMilliseconds)
+    {
+        ResetLocked();
+    }
+
+    if (0 == m_count)
+    {
+        m_sensorOrigin = sensorMilliseconds;
+        m_hostOrigin   = hostTime;
+    }
+    m_lastSensor = std::max(m_lastSensor, sensorMilliseconds);
+
+    double sensor = (sensorMilliseconds - m_sensorOrigin) / 1000.0;
+    double host   = hostTime - m_hostOrigin;
+
+    if (m_freeRunning)
+    {
+        m_count++;
+        return m_hostOrigin + sensor + m_hostToWall;
+    }
+
+    // Welford update of means and co-moments
+    ++m_count;
+    double deltaSensor = sensor - m_meanSensor;
+    m_meanSensor += deltaSensor / m_count;
+    m_meanHost   += (host - m_meanHost) / m_count;
+    m_covariance += deltaSensor * (host - m_meanHost);
+    m_variance   += deltaSensor * (sensor - m_meanSensor);
+
+    size_t slot = (size_t)((m_count - 1) % SampleWindow);
+    m_sensorSamples[slot] = sensor;
+    m_hostSamples[slot]   = host;
+
+    // Move the line down to the sample delayed least
+    double rate    = GetRateLocked();
+    size_t samples = m_count < SampleWindow ? (size_t)m_count : SampleWindow;
+    double offset  = m_hostSamples[0] - rate * m_sensorSamples[0];
+    for (size_t i = 1; i < samples; i++)
+    {
+        offset = std::min(offset, m_hostSamples[i] - rate * m_sensorSamples[i]);
+    }
+
+    return m_hostOrigin + offset + rate * sensor + m_hostToWall;
+}
@@ -0,0 +1,98 @@
+//------------------------------------------------------------------------------
+// <copyright file="SensorClock.h">
+//     Mapping of sensor frame timestamps to wall-clock time.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+/// <summary>
+/// Maps the timestamps the sensor puts on its frames to wall-clock time, so that recorded frames
+/// are stamped with the time they were captured rather than the time they were processed.
+///
+/// Every frame contributes a sample pairing its sensor timestamp with the monotonic host time it
+/// arrived at. The host time is the capture time plus a transfer and scheduling delay which is
+/// never negative, so the mapping is the line with the sensor clock rate, fitted by least squares
+/// over the whole session, moved down to the lowest recent sample: the one delayed least. Host time
+/// is converted to wall time with an offset taken once per session, so wall-clock adjustments
+/// during a recording do not show up in the timestamps.
+///
+/// Color and depth timestamps come from the same sensor clock, so both streams share one instance.
+/// </summary>
+class SensorClock
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    SensorClock();
+
+    /// <summary>
+    /// Get the time of the monotonic host clock
+    /// </summary>
+    /// <returns>Seconds since an arbitrary point in time</returns>
+    static double GetHostTime();
+
+    /// <summary>
+    /// Forget all samples, e.g. when the sensor has been restarted
+    /// </summary>
+    void Reset();
+
+    /// <summary>
+    /// Map sensor time straight onto wall-clock time from the first frame on, without fitting it to the
+    /// arrival of the frames. For stand-in sources delivering faster or slower than real time, whose
+    /// frames arrive at host times which say nothing of their sensor time
+    /// </summary>
+    /// <param name="freeRunning">Follow sensor time, or fit it to host time as for a sensor</param>
+    void SetFreeRunning(bool freeRunning);
+
+    /// <summary>
+    /// Add the sample of a frame and map its sensor timestamp to wall-clock time
+    /// </summary>
+    /// <param name="sensorMilliseconds">Sensor timestamp of the frame, NUI_IMAGE_FRAME::liTimeStamp</param>
+    /// <param name="hostTime">Host time the frame arrived at, from GetHostTime</param>
+    /// <returns>Capture time in seconds since epoch</returns>
+    double Map(int64_t sensorMilliseconds, double hostTime);
+
+    /// <summary>
+    /// Get the fitted rate of the host clock relative to the sensor clock
+    /// </summary>
+    double GetRate() const;
+
+    static const size_t SampleWindow = 256;         // Recent samples searched for the least delayed one, several seconds of frames
+
+private:
+    /// <summary>
+    /// Clear the fit. Called with the lock held
+    /// </summary>
+    void ResetLocked();
+
+    /// <summary>
+    /// Get the fitted rate. Called with the lock held
+    /// </summary>
+    double GetRateLocked() const;
+
+private:
+    mutable std::mutex  m_lock;
+
+    bool        m_freeRunning;
+    double      m_hostToWall;       // Wall-clock time minus host time, taken at reset
+    int64_t     m_sensorOrigin;     // First sensor timestamp, samples are relative to it to keep precision
+    double      m_hostOrigin;
+    int64_t     m_lastSensor;
+
+    // Running least squares fit of host time over sensor time
+    uint64_t    m_count;
+    double      m_meanSensor;
+    double      m_meanHost;
+    double      m_covariance;
+    double      m_variance;
+
+    // Ring of recent samples relative to the origins
+    double      m_sensorSamples[SampleWindow];
+    double      m_hostSamples[SampleWindow];
+};
@@ -0,0 +1,187 @@
+//------------------------------------------------------------------------------
+// <copyright file="SensorSource.h">
+//     Interface between the streams and whatever delivers their frames.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "EventDispatcher.h"
+#include "RecordFrame.h"
+
+// Streams a source delivers, the recorded ones first
+enum SensorStream
+{
+    SensorStreamColor = RecordStreamColor,
+    SensorStreamDepth = RecordStreamDepth,
+    SensorStreamSkeleton,
+    SensorStreamCount,
+};
+
+// Images an image stream can be opened for. Depth images always come as NUI_DEPTH_IMAGE_PIXEL,
+// RecordPixelFormatDepthPixel32, the type only says whether the player index is filled in
+enum SensorImageType
+{
+    SensorImageColor = 0,           // BGRA
+    SensorImageColorYuv,
+    SensorImageColorInfrared,
+    SensorImageColorRawBayer,
+    SensorImageDepth,
+    SensorImageDepthAndPlayerIndex,
+};
+
+// Options of skeleton tracking, NUI_SKELETON_TRACKING_FLAG_*
+enum SensorTrackingFlags
+{
+    SensorTrackingSeated          = 0x1,
+    SensorTrackingNearRange       = 0x2,
+    SensorTrackingChooseSkeletons = 0x4,    // The application picks the skeletons tracked in full with SetTrackedSkeletons
+};
+
+static const int SensorSkeletonCount = 6;       // NUI_SKELETON_COUNT
+static const int SensorJointCount    = 20;      // NUI_SKELETON_POSITION_COUNT
+
+// Tracking states of skeletons and joints, same values as NUI_SKELETON_TRACKING_STATE and NUI_SKELETON_POSITION_TRACKING_STATE
+enum SensorTrackingState
+{
+    SensorTrackingNone = 0,         // Not tracked
+    SensorTrackingPartial,          // Skeleton tracked by position only, joint inferred
+    SensorTrackingFull,             // Skeleton or joint tracked
+};
+
+// Point or plane in skeleton space, meters with y up, Vector4
+struct SensorVector
+{
+    float x;
+    float y;
+    float z;
+    float w;
+};
+
+// One skeleton of a frame, NUI_SKELETON_DATA
+struct SensorSkeleton
+{
+    uint32_t        trackingState;
+    uint32_t        trackingId;
+    uint32_t        enrollmentIndex;
+    uint32_t        userIndex;
+    SensorVector    position;
+    SensorVector    joints[SensorJointCount];
+    uint32_t        jointStates[SensorJointCount];
+    uint32_t        qualityFlags;
+};
+
+// Skeleton frame, NUI_SKELETON_FRAME, smoothed by the source where it can
+struct SensorSkeletonFrame
+{
+    int64_t         sensorTime;         // Milliseconds of the sensor clock
+    uint32_t        frameNumber;
+    uint32_t        flags;
+    SensorVector    floorClipPlane;
+    SensorVector    normalToGravity;
+    SensorSkeleton  skeletons[SensorSkeletonCount];
+};
+
+// Image taken from an open stream, valid until it is released
+struct SensorImage
+{
+    const uint8_t*  pBits;
+    uint32_t        pitch;              // Bytes per row, rows may be padded
+    uint32_t        size;               // Bytes of all rows
+    uint32_t        frameNumber;
+    int64_t         sensorTime;         // Milliseconds of the sensor clock, the clock color and depth share
+    bool            nearMode;           // Depth images only, near range was on when the image was taken
+};
+
+/// <summary>
+/// What the streams take their frames from: a Kinect, or a stand-in delivering recorded or generated
+/// frames, so the capture pipeline runs and can be measured without the hardware. Streams are opened with
+/// the frame ready event of the stream. The source sets it while a frame is waiting and the stream gets
+/// the frame on the dispatcher thread, which resets the event once no other frame is waiting.
+///
+/// A source is shared by the streams of one sensor. Each stream only calls it for its own stream, one call at a time.
+/// </summary>
+class SensorSource
+{
+public:
+    virtual ~SensorSource() {}
+
+    /// <summary>
+    /// Open or reopen an image stream. Frames of the stream start arriving right away
+    /// </summary>
+    /// <param name="stream">Color or depth</param>
+    /// <param name="type">Image type, one of the color or of the depth types</param>
+    /// <param name="width">Width to open with. A source which cannot choose, e.g. a replay, sets the width it delivers</param>
+    /// <param name="height">Height to open with, set like width</param>
+    /// <param name="frameReady">Event set while a frame of the stream is waiting, must outlive the source</param>
+    /// <returns>Indicates success or failure</returns>
+    virtual bool OpenImageStream(SensorStream stream, SensorImageType type, uint32_t& width, uint32_t& height, DispatchEvent& frameReady) = 0;
+
+    /// <summary>
+    /// Set the range of the depth stream, opened or not
+    /// </summary>
+    /// <param name="nearMode">True for near range, false for the default range</param>
+    virtual void SetNearMode(bool nearMode) = 0;
+
+    /// <summary>
+    /// Take the next image of an open stream. It has to be released before the next one is taken
+    /// </summary>
+    /// <param name="stream">Color or depth</param>
+    /// <param name="image">Receives the image</param>
+    /// <returns>False if no image is waiting or the image is damaged</returns>
+    virtual bool GetNextImage(SensorStream stream, SensorImage& image) = 0;
+
+    /// <summary>
+    /// Hand an image taken with GetNextImage back to the source
+    /// </summary>
+    /// <param name="stream">Stream the image was taken from</param>
+    virtual void ReleaseImage(SensorStream stream) = 0;
+
+    /// <summary>
+    /// Check whether the source tracks skeletons. Without, depth images carry no player index
+    /// </summary>
+    virtual bool HasSkeletonTracking() const = 0;
+
+    /// <summary>
+    /// Start tracking skeletons, or change the options of tracking
+    /// </summary>
+    /// <param name="flags">SensorTrackingFlags</param>
+    /// <param name="frameReady">Event set while a skeleton frame is waiting, must outlive the source</param>
+    /// <returns>Indicates success or failure</returns>
+    virtual bool EnableSkeletonTracking(uint32_t flags, DispatchEvent& frameReady) = 0;
+
+    /// <summary>
+    /// Stop tracking skeletons
+    /// </summary>
+    /// <returns>Indicates success or failure</returns>
+    virtual bool DisableSkeletonTracking() = 0;
+
+    /// <summary>
+    /// Take the next skeleton frame
+    /// </summary>
+    /// <param name="frame">Receives the frame</param>
+    /// <returns>False if no frame is waiting</returns>
+    virtual bool GetNextSkeletonFrame(SensorSkeletonFrame& frame) = 0;
+
+    /// <summary>
+    /// Choose the skeletons tracked in full, with tracking enabled with SensorTrackingChooseSkeletons
+    /// </summary>
+    /// <param name="trackingIds">Tracking IDs of up to two skeletons, 0 for none</param>
+    virtual void SetTrackedSkeletons(const uint32_t trackingIds[2]) = 0;
+
+    /// <summary>
+    /// Get the latest reading of the accelerometer
+    /// </summary>
+    /// <param name="reading">Receives the gravity vector in units of g</param>
+    /// <returns>Indicates success or failure</returns>
+    virtual bool GetAccelerometerReading(SensorVector& reading) = 0;
+
+    /// <summary>
+    /// Check whether the source has delivered all its frames and every one has been taken, e.g. at the end of
+    /// a replay. A sensor never finishes
+    /// </summary>
+    virtual bool IsFinished() const = 0;
+};
@@ -0,0 +1,634 @@
+//------------------------------------------------------------------------------
+// <copyright file="SessionTranscoder.cpp">
+//     Offline conversion of recorded sessions to compact lossless formats.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "SessionTranscoder.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#include "Pipeline.h"
+#include "RgbdRecovery.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+/// <summary>
+/// Create a directory, if it does not exist yet
+/// </summary>
+static void MakeDirectoryIfMissing(const std::string& path)
+{
+#ifdef _WIN32
+    _mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0755);
+#endif
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="pool">Pool the stages run on, must outlive the transcoder</param>
+SessionTranscoder::SessionTranscoder(TaskPool& pool)
+    : m_pool(pool)
+{
+    for (int i = 0; i < RecordStreamCount; ++i)
+    {
+        Stream& stream = m_streams[i];
+        stream.stream           = (RecordStream)i;
+        stream.concurrency      = 1;
+        stream.codec            = RecordCodecRaw;
+        stream.pExtension       = nullptr;
+        stream.frameCount       = 0;
+        stream.resumed          = 0;
+        stream.sequentialSource = false;
+        stream.awaitingKeyframe = false;
+    }
+
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+SessionTranscoder::~SessionTranscoder()
+{
+    CloseOutput();
+}
+
+/// <summary>
+/// Set the encoder of a stream
+/// </summary>
+/// <param name="stream">Stream to encode</param>
+/// <param name="createEncoder">Creates an encoder, nullptr to store the pixels raw, only into a container</param>
+/// <param name="concurrency">Frames encoded at the same time, each with an encoder of its own.
+/// 1 for encoders which keep state from frame to frame</param>
+void SessionTranscoder::SetEncoder(RecordStream stream, const EncoderFactory& createEncoder, unsigned concurrency)
+{
+    m_streams[stream].createEncoder = createEncoder;
+    m_streams[stream].concurrency   = (std::max)(1u, concurrency);
+}
+
+/// <summary>
+/// Get the counters of the last run
+/// </summary>
+SessionTranscoderStats SessionTranscoder::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_statsLock);
+    return m_stats;
+}
+
+/// <summary>
+/// Transcode a session. Must not be called from a task of the pool
+/// </summary>
+/// <param name="input">Session folder or container file to read</param>
+/// <param name="output">Session folder or container file to write, created or resumed</param>
+/// <param name="container">True to write a container file, false for a session folder</param>
+/// <param name="error">Receives why the session could not be transcoded</param>
+/// <returns>False if the input or the output could not be opened. Frames which fail are counted</returns>
+bool SessionTranscoder::Transcode(const std::string& input, const std::string& output, bool container, std::string& error)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_statsLock);
+        memset(&m_stats, 0, sizeof(m_stats));
+    }
+
+    CloseOutput();
+    m_output = output;
+
+    for (int i = 0; i < RecordStreamCount; ++i)
+    {
+        Stream& stream = m_streams[i];
+
+        stream.pReader.reset(new RecordingReader());
+        if (!stream.pReader->Open(input))
+        {
+            error = "Cannot open " + input;
+            CloseOutput();
+            return false;
+        }
+
+        stream.frameCount       = stream.pReader->GetFrameCount(stream.stream);
+        stream.resumed          = 0;
+        stream.sequentialSource = false;
+        stream.awaitingKeyframe = false;
+        stream.pSourceDecoder.reset(new FrameDecoder());
+        stream.pVerifyDecoder.reset(new FrameDecoder());
+
+        FrameView view;
+        if (stream.frameCount > 0 && stream.pReader->GetFrame(stream.stream, 0, view))
+        {
+            stream.sequentialSource = (RecordCodecTemporalDepth == view.codec);
+        }
+
+        stream.codec      = RecordCodecRaw;
+        stream.pExtension = nullptr;
+        if (stream.createEncoder)
+        {
+            for (unsigned j = 0; j < stream.concurrency; ++j)
+            {
+                stream.encoders.push_back(std::unique_ptr<FrameEncoder>(stream.createEncoder()));
+                stream.idleEncoders.push_back(stream.encoders.back().get());
+            }
+
+            stream.codec      = stream.encoders.front()->GetCodec();
+            stream.pExtension = stream.encoders.front()->GetFileExtension();
+        }
+        else if (!container)
+        {
+            error = "Every stream of a session folder needs an encoder";
+            CloseOutput();
+            return false;
+        }
+    }
+
+    if (container)
+    {
+        // A run which was killed left the container without index footer, restore it before appending
+        RgbdContainerReader existing;
+        if (existing.Open(output, false) && !existing.HasIndexFooter())
+        {
+            existing.Close();
+
+            RgbdRecovery                    recovery(m_pool);
+            std::vector<RgbdRecoveryResult> results;
+            recovery.Recover(std::vector<std::string>(1, output), results);
+            if (!results.front().error.empty())
+            {
+                error = "Cannot recover " + output + ": " + results.front().error;
+                CloseOutput();
+                return false;
+            }
+        }
+        existing.Close();
+
+        m_pContainer = std::make_shared<RgbdContainerWriter>(output);
+        m_pContainer->SetAppend(true);
+        if (!m_pContainer->Open())
+        {
+            m_pContainer.reset();
+            error = "Cannot open " + output + " for appending";
+            CloseOutput();
+            return false;
+        }
+
+        for (int i = 0; i < RecordStreamCount; ++i)
+        {
+            if (!ResumeContainer(m_streams[i], m_pContainer->GetIndex()))
+            {
+                error = output + " holds frames which are not in " + input;
+                CloseOutput();
+                return false;
+            }
+        }
+    }
+    else
+    {
+        MakeDirectoryIfMissing(output);
+
+        for (int i = 0; i < RecordStreamCount; ++i)
+        {
+            Stream&     stream = m_streams[i];
+            const char* pName  = (RecordStreamColor == stream.stream) ? "rgb" : "depth";
+
+            MakeDirectoryIfMissing(output + FRAME_PATH_SEPARATOR + pName);
+
+            // Paths relative to the session folder, as the lists hold them
+            std::string listPath = output + FRAME_PATH_SEPARATOR + pName + ".txt";
+            stream.resumed = ResumeList(stream, listPath);
+            stream.pPath.reset(new FramePathFormatter(pName, stream.pExtension));
+
+            if (!stream.list.Open(listPath.c_str()))
+            {
+                error = "Cannot open " + listPath;
+                CloseOutput();
+                return false;
+            }
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_statsLock);
+        for (int i = 0; i < RecordStreamCount; ++i)
+        {
+            m_stats.resumed[i] = m_streams[i].resumed;
+        }
+    }
+
+    // The streams share the pool, each is fed by a thread of its own
+    std::vector<std::thread> threads;
+    for (int i = 1; i < RecordStreamCount; ++i)
+    {
+        threads.push_back(std::thread([this, i]() { RunStream(m_streams[i]); }));
+    }
+    RunStream(m_streams[0]);
+
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    CloseOutput();
+    return true;
+}
+
+/// <summary>
+/// Close the frame lists or write the container index, and release readers and encoders
+/// </summary>
+void SessionTranscoder::CloseOutput()
+{
+    if (m_pContainer)
+    {
+        m_pContainer->Close();
+        m_pContainer.reset();
+    }
+
+    for (int i = 0; i < RecordStreamCount; ++i)
+    {
+        Stream& stream = m_streams[i];
+        stream.list.Close();
+        stream.pPath.reset();
+        stream.pReader.reset();
+        stream.pSourceDecoder.reset();
+        stream.pVerifyDecoder.reset();
+        stream.idleEncoders.clear();
+        stream.encoders.clear();
+    }
+}
+
+/// <summary>
+/// Find the frames of a stream an earlier run has already written to the session folder, and cut
+/// its frame list after the last of them
+/// </summary>
+/// <returns>Number of frames to skip</returns>
+size_t SessionTranscoder::ResumeList(Stream& stream, const std::string& listPath) const
+{
+    FILE* pFile = fopen(listPath.c_str(), "rb");
+    if (!pFile)
+    {
+        return 0;
+    }
+
+    std::vector<char> text;
+    char   buffer[64 * 1024];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), pFile)) > 0)
+    {
+        text.insert(text.end(), buffer, buffer + read);
+    }
+    fclose(pFile);
+
+    // A frame file is written before its line, so every complete line which lists a later
+    // source frame stands for a finished frame. Frames which failed to transcode have no line,
+    // so the lines may skip source frames. The list is cut after the last finished frame,
+    // which also drops a line torn by the interruption
+    size_t resumed  = 0;
+    size_t position = 0;
+    char   timestamp[32];
+    while (resumed < stream.frameCount && position < text.size())
+    {
+        const char* pLine = text.data() + position;
+        const char* pEnd  = (const char*)memchr(pLine, '\n', text.size() - position);
+        if (!pEnd)
+        {
+            break;
+        }
+
+        size_t frame = resumed;
+        for (; frame < stream.frameCount; ++frame)
+        {
+            size_t length = FormatFixed(timestamp, stream.pReader->GetTimestamp(stream.stream, frame), 6);
+            if ((size_t)(pEnd - pLine) > length && 0 == memcmp(pLine, timestamp, length) && '\t' == pLine[length])
+            {
+                break;
+            }
+        }
+        if (frame >= stream.frameCount)
+        {
+            break;
+        }
+
+        position = (size_t)(pEnd - text.data()) + 1;
+        resumed  = frame + 1;
+    }
+
+    if (position < text.size())
+    {
+        pFile = fopen(listPath.c_str(), "r+b");
+        if (!pFile || !RgbdTruncate(pFile, position))
+        {
+            resumed = 0;
+        }
+        if (pFile)
+        {
+            fclose(pFile);
+        }
+    }
+
+    return resumed;
+}
+
+/// <summary>
+/// Find the frames of a stream an earlier run has already written to the container, and skip them
+/// </summary>
+/// <returns>False if the container holds frames of the stream which are not in the source</returns>
+bool SessionTranscoder::ResumeContainer(Stream& stream, const std::vector<RgbdIndexEntry>& index) const
+{
+    // Each stream is appended in source order, but frames which failed to transcode were never
+    // written, so its frames in the container are the source with gaps. Resuming continues after
+    // the last of them and leaves the failed frames out
+    size_t resumed = 0;
+    for (const RgbdIndexEntry& entry : index)
+    {
+        if (stream.stream != entry.stream)
+        {
+            continue;
+        }
+
+        while (resumed < stream.frameCount && stream.pReader->GetTimestamp(stream.stream, resumed) != entry.timestamp)
+        {
+            ++resumed;
+        }
+        if (resumed >= stream.frameCount)
+        {
+            return false;
+        }
+        ++resumed;
+    }
+
+    stream.resumed = resumed;
+    return true;
+}
+
+/// <summary>
+/// Run the frames of a stream from the first one not resumed through the stages
+/// </summary>
+void SessionTranscoder::RunStream(Stream& stream)
+{
+    if (stream.resumed >= stream.frameCount)
+    {
+        return;
+    }
+
+    // Frames predicted from earlier ones need the reference of the first frame to transcode
+    size_t keyframe;
+    if (stream.sequentialSource && stream.resumed > 0 && stream.pReader->FindKeyframe(stream.stream, stream.resumed, keyframe))
+    {
+        Item item;
+        for (size_t i = keyframe; i < stream.resumed; ++i)
+        {
+            if (stream.pReader->GetFrame(stream.stream, i, item.view))
+            {
+                DecodeSource(stream, item);
+            }
+        }
+    }
+
+    unsigned workers = (std::max)(1u, m_pool.GetWorkerCount());
+    bool     encode  = static_cast<bool>(stream.createEncoder);
+
+    Pipeline<Item> pipeline(m_pool);
+
+    pipeline.AddStage("read", 1, StageCapacity, [&stream](Item& item)
+    {
+        item.failed = !stream.pReader->GetFrame(stream.stream, item.index, item.view);
+    });
+
+    pipeline.AddStage("decode", stream.sequentialSource ? 1 : workers, StageCapacity, [this, &stream](Item& item)
+    {
+        item.failed = item.failed || !DecodeSource(stream, item);
+    });
+
+    if (encode)
+    {
+        pipeline.AddStage("encode", stream.concurrency, StageCapacity, [this, &stream](Item& item)
+        {
+            item.failed = item.failed || !Encode(stream, item);
+        });
+
+        // Payloads predicted from earlier ones decode in order
+        bool sequential = (RecordCodecTemporalDepth == stream.codec);
+        pipeline.AddStage("verify", sequential ? 1 : workers, StageCapacity, [this, &stream](Item& item)
+        {
+            item.failed = item.failed || !Verify(stream, item);
+        });
+    }
+
+    pipeline.AddStage("write", 1, StageCapacity, [this, &stream](Item& item)
+    {
+        // Payloads predicted from a frame which was not written would not decode, they are left
+        // out until the keyframe the encoders were asked for
+        if (!item.failed && stream.awaitingKeyframe && !item.keyframe)
+        {
+            item.failed = true;
+        }
+
+        bool written = !item.failed && Write(stream, item);
+        if (written)
+        {
+            stream.awaitingKeyframe = false;
+        }
+        else if (item.encoded && !stream.awaitingKeyframe)
+        {
+            stream.awaitingKeyframe = true;
+
+            std::lock_guard<std::mutex> lock(stream.lock);
+            for (const std::unique_ptr<FrameEncoder>& pEncoder : stream.encoders)
+            {
+                pEncoder->RequestKeyframe();
+            }
+        }
+
+        if (!written && !item.mismatched)
+        {
+            std::lock_guard<std::mutex> lock(m_statsLock);
+            ++m_stats.failures[stream.stream];
+        }
+
+        // Items are reused, the buffers are kept but the file is unmapped
+        item.view.mapping.reset();
+        item.view.pData = nullptr;
+    });
+
+    pipeline.Start();
+
+    for (size_t index = stream.resumed; index < stream.frameCount; ++index)
+    {
+        pipeline.Submit([index](Item& item)
+        {
+            item.index      = index;
+            item.encoded    = false;
+            item.keyframe   = true;
+            item.failed     = false;
+            item.mismatched = false;
+        });
+    }
+
+    pipeline.Stop();
+}
+
+/// <summary>
+/// Decode a source frame into pixels
+/// </summary>
+bool SessionTranscoder::DecodeSource(Stream& stream, Item& item)
+{
+    const FrameView& view  = item.view;
+    RecordFrame&     frame = item.frame;
+
+    frame.stream      = stream.stream;
+    frame.format      = view.format;
+    frame.width       = view.width;
+    frame.height      = view.height;
+    frame.stride      = view.stride;
+    frame.frameNumber = view.frameNumber;
+    frame.timestamp   = view.timestamp;
+    frame.sensorTime  = 0;
+    frame.hostTime    = 0.0;
+
+    if (stream.sequentialSource)
+    {
+        return stream.pSourceDecoder->Decode(view.codec, view.pData, view.size, frame);
+    }
+
+    switch (view.codec)
+    {
+    case RecordCodecRaw:
+    case RecordCodecRvl:
+    case RecordCodecTemporalDepth:
+    case RecordCodecQoi:
+        return DecodeFramePayload(view.codec, view.pData, view.size, frame);
+
+    default:
+        // PNG and JPEG files are decoded by the image library of the caller, if any
+        return m_decodeImage && m_decodeImage(view.codec, view.pData, view.size, frame);
+    }
+}
+
+/// <summary>
+/// Encode a frame with an encoder no other frame is using
+/// </summary>
+bool SessionTranscoder::Encode(Stream& stream, Item& item)
+{
+    FrameEncoder* pEncoder;
+    {
+        std::lock_guard<std::mutex> lock(stream.lock);
+        if (stream.idleEncoders.empty())
+        {
+            // Called more often at the same time than announced, add another encoder rather than wait
+            stream.encoders.push_back(std::unique_ptr<FrameEncoder>(stream.createEncoder()));
+            stream.idleEncoders.push_back(stream.encoders.back().get());
+        }
+
+        pEncoder = stream.idleEncoders.back();
+        stream.idleEncoders.pop_back();
+    }
+
+    bool result = pEncoder->Encode(item.frame, item.payload);
+    item.encoded  = result;
+    item.keyframe = pEncoder->GetStats().lastKeyframe;
+
+    std::lock_guard<std::mutex> lock(stream.lock);
+    stream.idleEncoders.push_back(pEncoder);
+    return result;
+}
+
+/// <summary>
+/// Decode the payload of a frame and compare it with the source pixels
+/// </summary>
+bool SessionTranscoder::Verify(Stream& stream, Item& item)
+{
+    const RecordFrame& source  = item.frame;
+    RecordFrame&       decoded = item.decoded;
+
+    decoded.stream = source.stream;
+    decoded.format = source.format;
+    decoded.width  = source.width;
+    decoded.height = source.height;
+    decoded.stride = source.stride;
+
+    bool match = (RecordCodecTemporalDepth == stream.codec)
+        ? stream.pVerifyDecoder->Decode(stream.codec, item.payload.data(), item.payload.size(), decoded)
+        : DecodeFramePayload(stream.codec, item.payload.data(), item.payload.size(), decoded);
+
+    // Color and depth pixels both take 4 bytes, rows are compared without their padding
+    size_t rowBytes = (size_t)source.width * 4;
+    match = match
+        && source.format == decoded.format
+        && source.width  == decoded.width
+        && source.height == decoded.height
+        && source.data.size()  >= (size_t)source.stride  * source.height
+        && decoded.data.size() >= (size_t)decoded.stride * decoded.height;
+
+    for (uint32_t y = 0; match && y < source.height; ++y)
+    {
+        match = (0 == memcmp(source.data.data() + (size_t)y * source.stride, decoded.data.data() + (size_t)y * decoded.stride, rowBytes));
+    }
+
+    if (!match)
+    {
+        item.mismatched = true;
+
+        std::lock_guard<std::mutex> lock(m_statsLock);
+        ++m_stats.mismatches[stream.stream];
+    }
+
+    return match;
+}
+
+/// <summary>
+/// Write a frame to the output and count it
+/// </summary>
+bool SessionTranscoder::Write(Stream& stream, Item& item)
+{
+    const RecordFrame& frame = item.frame;
+
+    const uint8_t* pPayload = item.payload.data();
+    size_t         size     = item.payload.size();
+    if (!stream.createEncoder)
+    {
+        pPayload = frame.data.data();
+        size     = (size_t)frame.stride * frame.height;
+    }
+
+    if (m_pContainer)
+    {
+        if (!m_pContainer->AppendFrame(frame, stream.codec, pPayload, (uint32_t)size))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        const char* pPath = stream.pPath->Format(frame.timestamp);
+        stream.filePath.assign(m_output).append(1, FRAME_PATH_SEPARATOR).append(pPath, stream.pPath->GetLength());
+
+        FILE* pFile = fopen(stream.filePath.c_str(), "wb");
+        if (!pFile)
+        {
+            return false;
+        }
+
+        bool written = (size == fwrite(pPayload, 1, size, pFile));
+        written = (0 == fclose(pFile)) && written;
+        if (!written)
+        {
+            return false;
+        }
+
+        // Listed only once the file is complete, so a resumed run can trust the list
+        stream.list.Append(frame.timestamp, pPath, stream.pPath->GetLength());
+    }
+
+    std::lock_guard<std::mutex> lock(m_statsLock);
+    ++m_stats.frames[stream.stream];
+    m_stats.inputBytes  += item.view.size;
+    m_stats.outputBytes += size;
+    return true;
+}
@@ -0,0 +1,190 @@
+//------------------------------------------------------------------------------
+// <copyright file="SessionTranscoder.h">
+//     Offline conversion of recorded sessions to compact lossless formats.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "FrameCodec.h"
+#include "FramePath.h"
+#include "RecordFrame.h"
+#include "RecordingReader.h"
+#include "RgbdContainer.h"
+#include "TaskPool.h"
+
+// Counters of a transcoding run
+struct SessionTranscoderStats
+{
+    uint64_t frames[RecordStreamCount];     // Frames transcoded by this run
+    uint64_t resumed[RecordStreamCount];    // Frames an earlier run transcoded or failed on, which are skipped
+    uint64_t failures[RecordStreamCount];   // Frames which could not be read, decoded, encoded or written
+    uint64_t mismatches[RecordStreamCount]; // Frames whose payload did not decode back to the source pixels
+    uint64_t inputBytes;                    // Size of the source files of the frames transcoded
+    uint64_t outputBytes;                   // Size of the payloads written
+};
+
+/// <summary>
+/// Converts a recorded session, e.g. the rgb\*.bmp and depth\*.png folders with rgb.txt and depth.txt, into
+/// a session folder of compact files or a single container file. Each stream runs through a pipeline of
+/// read, decode, encode, verify and write stages on a shared pool, so frames are decoded and encoded on
+/// all cores while they are written in order. Every payload is decoded again and compared with the source
+/// pixels before it is written. A run which was interrupted is resumed: the frames already in the output,
+/// from the frame lists or the container index, are skipped along with the frames that run failed on, and
+/// a container cut short is recovered first.
+/// </summary>
+class SessionTranscoder
+{
+public:
+    typedef std::function<FrameEncoder*()> EncoderFactory;
+
+    /// <summary>
+    /// Decodes a source file the transcoder has no decoder for, e.g. a PNG depth image
+    /// </summary>
+    /// <param name="codec">Codec of the file</param>
+    /// <param name="pData">Contents of the file</param>
+    /// <param name="size">Size of the file in bytes</param>
+    /// <param name="frame">Receives format, size and pixels</param>
+    /// <returns>Indicates success or failure</returns>
+    typedef std::function<bool(RecordCodec codec, const uint8_t* pData, size_t size, RecordFrame& frame)> ImageDecoder;
+
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="pool">Pool the stages run on, must outlive the transcoder</param>
+    explicit SessionTranscoder(TaskPool& pool);
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+   ~SessionTranscoder();
+
+    static const size_t StageCapacity = 16;    // Frames each stage holds, bounds the memory of a run
+
+    /// <summary>
+    /// Set the encoder of a stream
+    /// </summary>
+    /// <param name="stream">Stream to encode</param>
+    /// <param name="createEncoder">Creates an encoder, nullptr to store the pixels raw, only into a container</param>
+    /// <param name="concurrency">Frames encoded at the same time, each with an encoder of its own.
+    /// 1 for encoders which keep state from frame to frame</param>
+    void SetEncoder(RecordStream stream, const EncoderFactory& createEncoder, unsigned concurrency);
+
+    /// <summary>
+    /// Set the decoder of source files with codecs FrameDecoder does not handle
+    /// </summary>
+    void SetImageDecoder(const ImageDecoder& decode) { m_decodeImage = decode; }
+
+    /// <summary>
+    /// Transcode a session. Must not be called from a task of the pool
+    /// </summary>
+    /// <param name="input">Session folder or container file to read</param>
+    /// <param name="output">Session folder or container file to write, created or resumed</param>
+    /// <param name="container">True to write a container file, false for a session folder</param>
+    /// <param name="error">Receives why the session could not be transcoded</param>
+    /// <returns>False if the input or the output could not be opened. Frames which fail are counted</returns>
+    bool Transcode(const std::string& input, const std::string& output, bool container, std::string& error);
+
+    /// <summary>
+    /// Get the counters of the last run
+    /// </summary>
+    SessionTranscoderStats GetStats() const;
+
+private:
+    // A frame passing through the stages
+    struct Item
+    {
+        size_t                  index;          // Position of the frame in its stream
+        FrameView               view;           // Source file, mapped
+        RecordFrame             frame;          // Source pixels
+        std::vector<uint8_t>    payload;        // Encoded frame
+        bool                    encoded;        // The encoder has taken the frame as the prediction for the next
+        bool                    keyframe;       // The payload decodes without those before it
+        RecordFrame             decoded;        // Pixels decoded from the payload
+        bool                    failed;         // Later stages pass the frame on untouched
+        bool                    mismatched;     // Failed because the payload did not decode to the source pixels
+    };
+
+    // State of one stream during a run
+    struct Stream
+    {
+        RecordStream                                stream;
+        EncoderFactory                              createEncoder;
+        unsigned                                    concurrency;
+        RecordCodec                                 codec;              // Codec of the output, raw without encoder
+        const char*                                 pExtension;         // File name extension of the output
+        std::unique_ptr<RecordingReader>            pReader;            // Each stream reads through its own
+        size_t                                      frameCount;
+        size_t                                      resumed;            // Frames before this one were written by an earlier run
+        bool                                        sequentialSource;   // Source frames are predicted from the previous one
+        bool                                        awaitingKeyframe;   // An encoded frame was not written, the next keyframe is
+        std::mutex                                  lock;               // Guards the idle encoders
+        std::vector<std::unique_ptr<FrameEncoder>>  encoders;
+        std::vector<FrameEncoder*>                  idleEncoders;
+        std::unique_ptr<FrameDecoder>               pSourceDecoder;     // Used by one item at a time, in order
+        std::unique_ptr<FrameDecoder>               pVerifyDecoder;
+        std::unique_ptr<FramePathFormatter>         pPath;              // Session folder output, relative to the folder
+        std::string                                 filePath;
+        FrameListFile                               list;
+    };
+
+    /// <summary>
+    /// Find the frames of a stream an earlier run has already written to the session folder, and cut
+    /// its frame list after the last of them
+    /// </summary>
+    /// <returns>Number of frames to skip</returns>
+    size_t ResumeList(Stream& stream, const std::string& listPath) const;
+
+    /// <summary>
+    /// Find the frames of a stream an earlier run has already written to the container, and skip them
+    /// </summary>
+    /// <returns>False if the container holds frames of the stream which are not in the source</returns>
+    bool ResumeContainer(Stream& stream, const std::vector<RgbdIndexEntry>& index) const;
+
+    /// <summary>
+    /// Run the frames of a stream from the first one not resumed through the stages
+    /// </summary>
+    void RunStream(Stream& stream);
+
+    /// <summary>
+    /// Decode a source frame into pixels
+    /// </summary>
+    bool DecodeSource(Stream& stream, Item& item);
+
+    /// <summary>
+    /// Encode a frame with an encoder no other frame is using
+    /// </summary>
+    bool Encode(Stream& stream, Item& item);
+
+    /// <summary>
+    /// Decode the payload of a frame and compare it with the source pixels
+    /// </summary>
+    bool Verify(Stream& stream, Item& item);
+
+    /// <summary>
+    /// Write a frame to the output and count it
+    /// </summary>
+    bool Write(Stream& stream, Item& item);
+
+    /// <summary>
+    /// Close the frame lists or write the container index, and release readers and encoders
+    /// </summary>
+    void CloseOutput();
+
+private:
+    TaskPool&                               m_pool;
+    ImageDecoder                            m_decodeImage;
+    Stream                                  m_streams[RecordStreamCount];
+    std::string                             m_output;
+    std::shared_ptr<RgbdContainerWriter>    m_pContainer;
+
+    mutable std::mutex                      m_statsLock;
+    SessionTranscoderStats                  m_stats;
+};
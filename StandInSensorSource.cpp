@@ -0,0 +1,510 @@
+//------------------------------------------------------------------------------
+// <copyright file="StandInSensorSource.cpp">
+//     Base of the sources which deliver frames made in software in place of a sensor.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "StandInSensorSource.h"
+
+#include <algorithm>
+
+/// <summary>
+/// Constructor. Real time, no frame limit
+/// </summary>
+StandInSensorSource::StandInSensorSource()
+    : m_stopping(false)
+    , m_speed(1.0)
+    , m_frameLimit(0)
+    , m_nearMode(false)
+    , m_trackingFlags(0)
+    , m_started(false)
+    , m_originSensorTime(0)
+    , m_lastSensorTime(0)
+    , m_takenSensorTime(-1)
+{
+    m_trackingIds[0] = 0;
+    m_trackingIds[1] = 0;
+
+    for (Stream& stream : m_streams)
+    {
+        stream.open        = false;
+        stream.ended       = false;
+        stream.pFrameReady = nullptr;
+        stream.generation  = 0;
+        stream.delivered   = 0;
+        stream.dropped     = 0;
+        stream.hasPending  = false;
+        stream.hasCurrent  = false;
+    }
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+StandInSensorSource::~StandInSensorSource()
+{
+    StopProducing();
+}
+
+/// <summary>
+/// Stop the producer thread. Called by the destructor of a subclass, before the members the frames are made from go
+/// </summary>
+void StandInSensorSource::StopProducing()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_stopping = true;
+    }
+    m_changed.notify_all();
+
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+}
+
+/// <summary>
+/// Set the speed frames are delivered at. Before any stream is opened
+/// </summary>
+/// <param name="speed">Multiple of real time, 0 for as fast as the streams take the frames</param>
+void StandInSensorSource::SetSpeed(double speed)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_speed = speed > 0.0 ? speed : 0.0;
+}
+
+/// <summary>
+/// Set the number of frames each stream delivers before it ends. Before any stream is opened
+/// </summary>
+/// <param name="frames">Frames per stream, 0 for no limit</param>
+void StandInSensorSource::SetFrameLimit(uint64_t frames)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_frameLimit = frames;
+}
+
+/// <summary>
+/// Get the number of frames a stream has delivered
+/// </summary>
+uint64_t StandInSensorSource::GetDeliveredFrames(SensorStream stream) const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_streams[stream].delivered;
+}
+
+/// <summary>
+/// Get the number of frames a stream lost because it did not take them in time. Only at real time
+/// </summary>
+uint64_t StandInSensorSource::GetDroppedFrames(SensorStream stream) const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_streams[stream].dropped;
+}
+
+/// <summary>
+/// Open or reopen an image stream. Frames of the stream start arriving right away
+/// </summary>
+bool StandInSensorSource::OpenImageStream(SensorStream stream, SensorImageType type, uint32_t& width, uint32_t& height, DispatchEvent& frameReady)
+{
+    if (SensorStreamColor != stream && SensorStreamDepth != stream)
+    {
+        return false;
+    }
+
+    return OpenStream(stream, type, width, height, frameReady);
+}
+
+/// <summary>
+/// Set the range of the depth stream, opened or not
+/// </summary>
+void StandInSensorSource::SetNearMode(bool nearMode)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_nearMode = nearMode;
+}
+
+/// <summary>
+/// Take the next image of an open stream. It has to be released before the next one is taken
+/// </summary>
+bool StandInSensorSource::GetNextImage(SensorStream stream, SensorImage& image)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    Stream& state = m_streams[stream];
+    if (!TakeFrameLocked(state))
+    {
+        return false;
+    }
+
+    image.pBits       = state.current.bits.data();
+    image.pitch       = state.current.pitch;
+    image.size        = (uint32_t)state.current.bits.size();
+    image.frameNumber = state.current.frameNumber;
+    image.sensorTime  = state.current.sensorTime;
+    image.nearMode    = m_nearMode;
+
+    return true;
+}
+
+/// <summary>
+/// Hand an image taken with GetNextImage back to the source
+/// </summary>
+void StandInSensorSource::ReleaseImage(SensorStream stream)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    Stream& state = m_streams[stream];
+    if (state.hasCurrent)
+    {
+        state.spares.push_back(std::move(state.current));
+        state.hasCurrent = false;
+    }
+}
+
+/// <summary>
+/// Check whether the source tracks skeletons. Stand-ins fill in the player index when a subclass has skeletons to deliver
+/// </summary>
+bool StandInSensorSource::HasSkeletonTracking() const
+{
+    return true;
+}
+
+/// <summary>
+/// Start tracking skeletons, or change the options of tracking. Changing the options does not move the stream
+/// </summary>
+bool StandInSensorSource::EnableSkeletonTracking(uint32_t flags, DispatchEvent& frameReady)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+
+        m_trackingFlags = flags;
+        if (m_streams[SensorStreamSkeleton].open && &frameReady == m_streams[SensorStreamSkeleton].pFrameReady)
+        {
+            return true;
+        }
+    }
+
+    uint32_t width  = 0;
+    uint32_t height = 0;
+    return OpenStream(SensorStreamSkeleton, SensorImageDepthAndPlayerIndex, width, height, frameReady);
+}
+
+/// <summary>
+/// Stop tracking skeletons
+/// </summary>
+bool StandInSensorSource::DisableSkeletonTracking()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    Stream& state = m_streams[SensorStreamSkeleton];
+    if (state.open)
+    {
+        state.open = false;
+        state.generation++;
+        state.hasPending = false;
+        while (!state.queue.empty())
+        {
+            state.spares.push_back(std::move(state.queue.front()));
+            state.queue.pop_front();
+        }
+        state.pFrameReady->Reset();
+    }
+    m_changed.notify_all();
+
+    return true;
+}
+
+/// <summary>
+/// Take the next skeleton frame
+/// </summary>
+bool StandInSensorSource::GetNextSkeletonFrame(SensorSkeletonFrame& frame)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    Stream& state = m_streams[SensorStreamSkeleton];
+    if (!TakeFrameLocked(state))
+    {
+        return false;
+    }
+
+    frame = state.current.skeleton;
+    frame.sensorTime  = state.current.sensorTime;
+    frame.frameNumber = state.current.frameNumber;
+
+    state.spares.push_back(std::move(state.current));
+    state.hasCurrent = false;
+
+    return true;
+}
+
+/// <summary>
+/// Choose the skeletons tracked in full, with tracking enabled with SensorTrackingChooseSkeletons
+/// </summary>
+void StandInSensorSource::SetTrackedSkeletons(const uint32_t trackingIds[2])
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_trackingIds[0] = trackingIds[0];
+    m_trackingIds[1] = trackingIds[1];
+}
+
+/// <summary>
+/// Get the latest reading of the accelerometer. A stand-in sits level, with gravity straight down
+/// </summary>
+bool StandInSensorSource::GetAccelerometerReading(SensorVector& reading)
+{
+    reading.x = 0.0f;
+    reading.y = -1.0f;
+    reading.z = 0.0f;
+    reading.w = 0.0f;
+
+    return true;
+}
+
+/// <summary>
+/// Check whether the source has delivered all its frames and every one has been taken
+/// </summary>
+bool StandInSensorSource::IsFinished() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    bool opened = false;
+    for (const Stream& state : m_streams)
+    {
+        if (state.open)
+        {
+            opened = true;
+            if (!state.ended || state.hasPending || !state.queue.empty())
+            {
+                return false;
+            }
+        }
+    }
+
+    return opened;
+}
+
+/// <summary>
+/// Get the depth range and the skeleton choice of the application, to make frames which follow them
+/// </summary>
+void StandInSensorSource::GetTrackingOptions(bool& nearMode, uint32_t& trackingFlags, uint32_t trackingIds[2]) const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    nearMode       = m_nearMode;
+    trackingFlags  = m_trackingFlags;
+    trackingIds[0] = m_trackingIds[0];
+    trackingIds[1] = m_trackingIds[1];
+}
+
+/// <summary>
+/// Open a stream, or reopen it from the current sensor time
+/// </summary>
+bool StandInSensorSource::OpenStream(SensorStream stream, SensorImageType type, uint32_t& width, uint32_t& height, DispatchEvent& frameReady)
+{
+    // Not while the producer thread makes a frame of the stream, it would be positioned in between
+    std::lock_guard<std::mutex> produce(m_produceLock);
+
+    int64_t sensorTime = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        sensorTime = GetSensorTimeLocked();
+    }
+
+    if (!OpenFrames(stream, type, width, height, sensorTime))
+    {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+
+        Stream& state = m_streams[stream];
+        if (state.pFrameReady)
+        {
+            state.pFrameReady->Reset();
+        }
+        state.open        = true;
+        state.ended       = false;
+        state.pFrameReady = &frameReady;
+        state.generation++;
+        state.hasPending  = false;
+        while (!state.queue.empty())
+        {
+            state.spares.push_back(std::move(state.queue.front()));
+            state.queue.pop_front();
+        }
+        if (state.hasCurrent)
+        {
+            state.spares.push_back(std::move(state.current));
+            state.hasCurrent = false;
+        }
+
+        if (!m_thread.joinable() && !m_stopping)
+        {
+            m_thread = std::thread(&StandInSensorSource::ProducerThread, this);
+        }
+    }
+    m_changed.notify_all();
+
+    return true;
+}
+
+/// <summary>
+/// Take the next frame of a stream into its current frame. Called with the lock held
+/// </summary>
+bool StandInSensorSource::TakeFrameLocked(Stream& state)
+{
+    if (!state.open || state.queue.empty())
+    {
+        return false;
+    }
+
+    // An image not released yet is released now
+    if (state.hasCurrent)
+    {
+        state.spares.push_back(std::move(state.current));
+    }
+    state.current = std::move(state.queue.front());
+    state.queue.pop_front();
+    state.hasCurrent = true;
+    m_takenSensorTime = (std::max)(m_takenSensorTime, state.current.sensorTime);
+
+    // Set again when the next frame is queued
+    if (state.queue.empty())
+    {
+        state.pFrameReady->Reset();
+    }
+
+    // Room for the next frame at full speed
+    m_changed.notify_all();
+    return true;
+}
+
+/// <summary>
+/// Get the sensor time the source has reached. Called with the lock held
+/// </summary>
+int64_t StandInSensorSource::GetSensorTimeLocked() const
+{
+    if (!m_started)
+    {
+        return 0;
+    }
+
+    if (m_speed > 0.0)
+    {
+        double elapsed = std::chrono::duration<double>(Clock::now() - m_originTime).count();
+        return (std::max)(m_lastSensorTime, m_originSensorTime + (int64_t)(elapsed * m_speed * 1000.0));
+    }
+
+    // Frames queued ahead at full speed have not been seen yet, a stream opened meanwhile starts with them
+    return m_takenSensorTime + 1;
+}
+
+/// <summary>
+/// Thread procedure making and queueing the frames
+/// </summary>
+void StandInSensorSource::ProducerThread()
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    while (!m_stopping)
+    {
+        // Every open stream has its next frame made, so the earliest of them can be picked
+        for (int i = 0; i < SensorStreamCount; i++)
+        {
+            Stream& state = m_streams[i];
+            if (!state.open || state.ended || state.hasPending)
+            {
+                continue;
+            }
+
+            StandInFrame frame;
+            if (!state.spares.empty())
+            {
+                frame = std::move(state.spares.back());
+                state.spares.pop_back();
+            }
+            lock.unlock();
+
+            std::lock_guard<std::mutex> produce(m_produceLock);
+            lock.lock();
+            uint64_t generation = state.generation;
+            bool     open       = state.open && !m_stopping;
+            lock.unlock();
+
+            bool produced = open && ProduceFrame((SensorStream)i, frame);
+
+            lock.lock();
+            if (generation != state.generation || !open)
+            {
+                // Reopened or closed meanwhile
+                state.spares.push_back(std::move(frame));
+            }
+            else if (produced)
+            {
+                state.pending    = std::move(frame);
+                state.hasPending = true;
+            }
+            else
+            {
+                state.ended = true;
+            }
+        }
+
+        // The earliest frame goes first, color before depth at the same time
+        Stream* pNext = nullptr;
+        for (Stream& state : m_streams)
+        {
+            if (state.open && state.hasPending && (!pNext || state.pending.sensorTime < pNext->pending.sensorTime))
+            {
+                pNext = &state;
+            }
+        }
+        if (!pNext)
+        {
+            m_changed.wait(lock);
+            continue;
+        }
+
+        if (!m_started)
+        {
+            m_started          = true;
+            m_originTime       = Clock::now();
+            m_originSensorTime = pNext->pending.sensorTime;
+        }
+
+        if (m_speed > 0.0)
+        {
+            // Due when its sensor time comes up
+            double seconds = (pNext->pending.sensorTime - m_originSensorTime) / (1000.0 * m_speed);
+            Clock::time_point due = m_originTime + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+            if (Clock::now() < due)
+            {
+                m_changed.wait_until(lock, due);
+                continue;
+            }
+
+            // A stream falling behind loses its oldest frame, as it would with a sensor
+            if (pNext->queue.size() >= QueueDepth)
+            {
+                pNext->spares.push_back(std::move(pNext->queue.front()));
+                pNext->queue.pop_front();
+                pNext->dropped++;
+            }
+        }
+        else if (pNext->queue.size() >= QueueDepth)
+        {
+            // Full speed waits for the stream, and with it all others
+            m_changed.wait(lock);
+            continue;
+        }
+
+        m_lastSensorTime = (std::max)(m_lastSensorTime, pNext->pending.sensorTime);
+        pNext->queue.push_back(std::move(pNext->pending));
+        pNext->hasPending = false;
+        pNext->delivered++;
+        if (m_frameLimit && pNext->delivered >= m_frameLimit)
+        {
+            pNext->ended = true;
+        }
+        pNext->pFrameReady->Set();
+    }
+}
@@ -0,0 +1,188 @@
+//------------------------------------------------------------------------------
+// <copyright file="StandInSensorSource.h">
+//     Base of the sources which deliver frames made in software in place of a sensor.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "SensorSource.h"
+
+/// <summary>
+/// Delivers frames made in software as a sensor would: the frames of the open streams are queued in the
+/// order of their sensor time, at most QueueDepth per stream, and the ready event of a stream is set while
+/// one is waiting. One producer thread makes the frames, so the interleaving of the streams, and with it a
+/// whole run, only depends on the frames and not on thread timing.
+///
+/// At real time, or at a multiple of it, a frame is queued when its sensor time comes up. A stream which has
+/// not taken its frames by then loses the oldest one, as with a sensor, and the loss is counted. At full
+/// speed a frame is queued as soon as the stream has room for it, so the streams run as fast as the slowest
+/// of them takes its frames and nothing is lost, which is what a load test measures.
+///
+/// Subclasses make the frames. Their destructors call StopProducing, the producer thread calls into them.
+/// </summary>
+class StandInSensorSource : public SensorSource
+{
+public:
+    /// <summary>
+    /// Constructor. Real time, no frame limit
+    /// </summary>
+    StandInSensorSource();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    virtual ~StandInSensorSource();
+
+    static const size_t QueueDepth = 2;     // Frames waiting per stream, as the Kinect streams are opened with
+
+public:
+    /// <summary>
+    /// Set the speed frames are delivered at. Before any stream is opened
+    /// </summary>
+    /// <param name="speed">Multiple of real time, 0 for as fast as the streams take the frames</param>
+    void SetSpeed(double speed);
+
+    /// <summary>
+    /// Set the number of frames each stream delivers before it ends. Before any stream is opened
+    /// </summary>
+    /// <param name="frames">Frames per stream, 0 for no limit</param>
+    void SetFrameLimit(uint64_t frames);
+
+    /// <summary>
+    /// Get the number of frames a stream has delivered
+    /// </summary>
+    uint64_t GetDeliveredFrames(SensorStream stream) const;
+
+    /// <summary>
+    /// Get the number of frames a stream lost because it did not take them in time. Only at real time
+    /// </summary>
+    uint64_t GetDroppedFrames(SensorStream stream) const;
+
+    // SensorSource
+    virtual bool OpenImageStream(SensorStream stream, SensorImageType type, uint32_t& width, uint32_t& height, DispatchEvent& frameReady);
+    virtual void SetNearMode(bool nearMode);
+    virtual bool GetNextImage(SensorStream stream, SensorImage& image);
+    virtual void ReleaseImage(SensorStream stream);
+    virtual bool HasSkeletonTracking() const;
+    virtual bool EnableSkeletonTracking(uint32_t flags, DispatchEvent& frameReady);
+    virtual bool DisableSkeletonTracking();
+    virtual bool GetNextSkeletonFrame(SensorSkeletonFrame& frame);
+    virtual void SetTrackedSkeletons(const uint32_t trackingIds[2]);
+    virtual bool GetAccelerometerReading(SensorVector& reading);
+    virtual bool IsFinished() const;
+
+protected:
+    // Frame made by a subclass: the pixels of an image, or a skeleton frame
+    struct StandInFrame
+    {
+        std::vector<uint8_t>    bits;
+        uint32_t                pitch;
+        uint32_t                frameNumber;
+        int64_t                 sensorTime;
+        SensorSkeletonFrame     skeleton;
+    };
+
+    /// <summary>
+    /// Position a stream at its first frame at or after a sensor time. Type and size are only given for images
+    /// </summary>
+    /// <param name="stream">Stream to open</param>
+    /// <param name="type">Image type the stream is opened for</param>
+    /// <param name="width">Width asked for, set to the width the frames have</param>
+    /// <param name="height">Height asked for, set to the height the frames have</param>
+    /// <param name="sensorTime">Sensor time the other streams have reached, 0 at the start</param>
+    /// <returns>False if the source cannot deliver the stream</returns>
+    virtual bool OpenFrames(SensorStream stream, SensorImageType type, uint32_t& width, uint32_t& height, int64_t sensorTime) = 0;
+
+    /// <summary>
+    /// Make the next frame of an open stream. Called on the producer thread, never at the same time as OpenFrames
+    /// </summary>
+    /// <param name="stream">Stream to make the frame of</param>
+    /// <param name="frame">Receives the frame. Its vector holds the pixels of an earlier frame, for reuse</param>
+    /// <returns>False at the end of the stream</returns>
+    virtual bool ProduceFrame(SensorStream stream, StandInFrame& frame) = 0;
+
+    /// <summary>
+    /// Stop the producer thread. Called by the destructor of a subclass, before the members the frames are made from go
+    /// </summary>
+    void StopProducing();
+
+    /// <summary>
+    /// Get the depth range and the skeleton choice of the application, to make frames which follow them
+    /// </summary>
+    /// <param name="nearMode">Receives the depth range</param>
+    /// <param name="trackingFlags">Receives the SensorTrackingFlags of skeleton tracking</param>
+    /// <param name="trackingIds">Receives the skeletons chosen to be tracked in full</param>
+    void GetTrackingOptions(bool& nearMode, uint32_t& trackingFlags, uint32_t trackingIds[2]) const;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Stream
+    {
+        bool                    open;
+        bool                    ended;          // Delivered its last frame
+        DispatchEvent*          pFrameReady;
+        uint64_t                generation;     // Counts openings, frames made for an earlier one are discarded
+        uint64_t                delivered;
+        uint64_t                dropped;
+        bool                    hasPending;     // The next frame is made and waits for its time
+        StandInFrame            pending;
+        std::deque<StandInFrame> queue;
+        bool                    hasCurrent;     // A frame has been taken and not released
+        StandInFrame            current;
+        std::vector<StandInFrame> spares;       // Frames released, their buffers are reused
+    };
+
+    /// <summary>
+    /// Open a stream, or reopen it from the current sensor time
+    /// </summary>
+    bool OpenStream(SensorStream stream, SensorImageType type, uint32_t& width, uint32_t& height, DispatchEvent& frameReady);
+
+    /// <summary>
+    /// Take the next frame of a stream into its current frame. Called with the lock held
+    /// </summary>
+    bool TakeFrameLocked(Stream& stream);
+
+    /// <summary>
+    /// Get the sensor time the source has reached. Called with the lock held
+    /// </summary>
+    int64_t GetSensorTimeLocked() const;
+
+    /// <summary>
+    /// Thread procedure making and queueing the frames
+    /// </summary>
+    void ProducerThread();
+
+private:
+    StandInSensorSource(const StandInSensorSource&);
+    StandInSensorSource& operator=(const StandInSensorSource&);
+
+private:
+    std::mutex              m_produceLock;      // Serializes OpenFrames and ProduceFrame, taken before m_lock
+    mutable std::mutex      m_lock;
+    std::condition_variable m_changed;          // Streams opened, frames taken, or stopping
+    std::thread             m_thread;
+    bool                    m_stopping;
+
+    Stream                  m_streams[SensorStreamCount];
+    double                  m_speed;
+    uint64_t                m_frameLimit;
+    bool                    m_nearMode;
+    uint32_t                m_trackingFlags;
+    uint32_t                m_trackingIds[2];
+
+    bool                    m_started;          // The first frame has been queued, the origins are set
+    Clock::time_point       m_originTime;
+    int64_t                 m_originSensorTime;
+    int64_t                 m_lastSensorTime;   // Sensor time of the latest frame queued
+    int64_t                 m_takenSensorTime;  // Sensor time of the latest frame taken by a stream, -1 before the first
+};
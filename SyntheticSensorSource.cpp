@@ -0,0 +1,452 @@
+//------------------------------------------------------------------------------
+// <copyright file="SyntheticSensorSource.cpp">
+//     Stand-in sensor generating depth, color and skeleton frames of a parametric scene.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "SyntheticSensorSource.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+    // Nominal focal lengths of the Kinect, NUI_CAMERA_*_NOMINAL_FOCAL_LENGTH_IN_PIXELS, at 320 and 640 pixels wide
+    const float DepthFocalLength = 285.63f / 320.0f;
+    const float ColorFocalLength = 531.15f / 640.0f;
+
+    // Room and bodies in meters
+    const float SensorHeight    = 1.0f;     // Above the floor
+    const float WallDistance    = 3.8f;     // Within the default range, beyond the near range
+    const float BodyHeight      = 1.75f;
+    const float BodyHalfWidth   = 0.28f;
+    const float BodyDepth       = 0.15f;    // Front of the body ahead of its center
+
+    // Depth ranges of the sensor in millimeters
+    const uint16_t DefaultRangeFar = 4000;
+    const uint16_t NearRangeFar    = 3000;
+
+    const float Pi = 3.14159265f;
+
+    // Joints of a standing body, NUI_SKELETON_POSITION_INDEX order: offset to the side, height above the floor,
+    // and how far the joint moves forward with the swing of the arms and legs
+    struct JointPose
+    {
+        float side;
+        float height;
+        float swing;
+    };
+
+    const JointPose StandingPose[SensorJointCount] =
+    {
+        {  0.00f, 0.95f,  0.00f },  // Hip center
+        {  0.00f, 1.15f,  0.00f },  // Spine
+        {  0.00f, 1.45f,  0.00f },  // Shoulder center
+        {  0.00f, 1.65f,  0.00f },  // Head
+        { -0.18f, 1.42f,  0.00f },  // Shoulder left
+        { -0.22f, 1.15f,  0.10f },  // Elbow left
+        { -0.25f, 0.90f,  0.20f },  // Wrist left
+        { -0.26f, 0.82f,  0.22f },  // Hand left
+        {  0.18f, 1.42f,  0.00f },  // Shoulder right
+        {  0.22f, 1.15f, -0.10f },  // Elbow right
+        {  0.25f, 0.90f, -0.20f },  // Wrist right
+        {  0.26f, 0.82f, -0.22f },  // Hand right
+        { -0.10f, 0.90f,  0.00f },  // Hip left
+        { -0.10f, 0.50f, -0.10f },  // Knee left
+        { -0.10f, 0.08f, -0.20f },  // Ankle left
+        { -0.10f, 0.03f, -0.20f },  // Foot left
+        {  0.10f, 0.90f,  0.00f },  // Hip right
+        {  0.10f, 0.50f,  0.10f },  // Knee right
+        {  0.10f, 0.08f,  0.20f },  // Ankle right
+        {  0.10f, 0.03f,  0.20f },  // Foot right
+    };
+
+    // Joints tracked in seated mode: shoulder center to right hand
+    const int FirstSeatedJoint = 2;
+    const int LastSeatedJoint  = 11;
+
+    // Body colors of the players, B, G, R
+    const uint8_t PlayerColors[SensorSkeletonCount][3] =
+    {
+        {  60,  60, 200 },
+        {  60, 170,  60 },
+        { 200,  90,  40 },
+        {  40, 180, 200 },
+        { 180,  60, 180 },
+        { 200, 200,  60 },
+    };
+
+    /// <summary>
+    /// Mix the coordinates of a pixel and a frame number into noise which is the same in every run
+    /// </summary>
+    inline int Noise(uint32_t x, uint32_t y, uint32_t frame, int amplitude)
+    {
+        uint32_t h = x * 73856093u ^ y * 19349663u ^ frame * 83492791u;
+        h ^= h >> 13;
+        h *= 0x5bd1e995u;
+        h ^= h >> 15;
+        return (int)(h % (uint32_t)(2 * amplitude + 1)) - amplitude;
+    }
+
+    /// <summary>
+    /// Where the body of a player shows up in an image
+    /// </summary>
+    struct Silhouette
+    {
+        float centerX;
+        float centerY;
+        float radiusX;
+        float radiusY;
+    };
+
+    Silhouette Project(float x, float z, float focalLength, uint32_t width, uint32_t height)
+    {
+        float center = -SensorHeight + BodyHeight / 2;
+
+        Silhouette silhouette;
+        silhouette.centerX = width  / 2.0f + focalLength * x / z;
+        silhouette.centerY = height / 2.0f - focalLength * center / z;
+        silhouette.radiusX = focalLength * BodyHalfWidth / z;
+        silhouette.radiusY = focalLength * BodyHeight / 2 / z;
+        return silhouette;
+    }
+}
+
+/// <summary>
+/// Constructor. Two players at 30 frames per second, without noise
+/// </summary>
+SyntheticScene::SyntheticScene()
+    : frameRate(30.0)
+    , players(2)
+    , periodSeconds(4.0)
+    , noise(0)
+{
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="scene">Parameters of the scene</param>
+SyntheticSensorSource::SyntheticSensorSource(const SyntheticScene& scene)
+    : m_scene(scene)
+{
+    m_scene.frameRate     = (std::max)(m_scene.frameRate, 1.0);
+    m_scene.players       = (std::max)(0, (std::min)(m_scene.players, SensorSkeletonCount));
+    m_scene.periodSeconds = (std::max)(m_scene.periodSeconds, 0.1);
+    m_scene.noise         = (std::max)(0, (std::min)(m_scene.noise, 255));
+
+    for (int i = 0; i < SensorStreamCount; i++)
+    {
+        m_type[i]      = SensorImageColor;
+        m_width[i]     = 0;
+        m_height[i]    = 0;
+        m_nextIndex[i] = 0;
+    }
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+SyntheticSensorSource::~SyntheticSensorSource()
+{
+    StopProducing();
+}
+
+/// <summary>
+/// Position a stream at its first frame at or after a sensor time
+/// </summary>
+bool SyntheticSensorSource::OpenFrames(SensorStream stream, SensorImageType type, uint32_t& width, uint32_t& height, int64_t sensorTime)
+{
+    if (SensorStreamColor == stream && SensorImageColor != type)
+    {
+        return false;
+    }
+    if (SensorStreamDepth == stream && SensorImageDepth != type && SensorImageDepthAndPlayerIndex != type)
+    {
+        return false;
+    }
+    if (SensorStreamSkeleton != stream && (0 == width || 0 == height))
+    {
+        return false;
+    }
+
+    m_type[stream]      = type;
+    m_width[stream]     = width;
+    m_height[stream]    = height;
+    m_nextIndex[stream] = sensorTime > 0 ? (uint64_t)std::ceil(sensorTime * m_scene.frameRate / 1000.0) : 0;
+
+    return true;
+}
+
+/// <summary>
+/// Make the next frame of an open stream. The scene never ends
+/// </summary>
+bool SyntheticSensorSource::ProduceFrame(SensorStream stream, StandInFrame& frame)
+{
+    uint64_t index = m_nextIndex[stream]++;
+    frame.frameNumber = (uint32_t)index;
+    frame.sensorTime  = (int64_t)std::floor(index * 1000.0 / m_scene.frameRate + 0.5);
+
+    bool     nearMode = false;
+    uint32_t flags    = 0;
+    uint32_t ids[2]   = {};
+    GetTrackingOptions(nearMode, flags, ids);
+
+    switch (stream)
+    {
+    case SensorStreamColor:
+        MakeColor(index, frame);
+        break;
+
+    case SensorStreamDepth:
+        MakeDepth(index, SensorImageDepthAndPlayerIndex == m_type[stream], nearMode, frame);
+        break;
+
+    default:
+        MakeSkeletons(index, frame);
+        break;
+    }
+
+    return true;
+}
+
+/// <summary>
+/// Place the players at the time of a frame, the farthest first
+/// </summary>
+void SyntheticSensorSource::PlacePlayers(uint64_t index, Player players[SensorSkeletonCount], int order[SensorSkeletonCount]) const
+{
+    double seconds = index / m_scene.frameRate;
+    for (int p = 0; p < m_scene.players; p++)
+    {
+        // Each on a lane of its own, out of step with the others
+        float angle = (float)(2 * Pi * std::fmod(seconds / m_scene.periodSeconds, 1.0)) + p * 2 * Pi / m_scene.players;
+        players[p].z     = (std::min)(2.0f + 0.5f * p + 0.3f * std::cos(angle), WallDistance - 0.4f);
+        players[p].x     = 0.35f * players[p].z * std::sin(angle);
+        players[p].swing = std::sin(4 * angle);
+        order[p] = p;
+    }
+
+    std::sort(order, order + m_scene.players, [&](int a, int b) { return players[a].z > players[b].z; });
+}
+
+/// <summary>
+/// Generate a depth image, NUI_DEPTH_IMAGE_PIXEL
+/// </summary>
+void SyntheticSensorSource::MakeDepth(uint64_t index, bool playerIndex, bool nearMode, StandInFrame& frame) const
+{
+    const uint32_t width    = m_width[SensorStreamDepth];
+    const uint32_t height   = m_height[SensorStreamDepth];
+    const float    focal    = DepthFocalLength * width;
+    const int      farthest = nearMode ? NearRangeFar : DefaultRangeFar;
+
+    frame.pitch = width * 4;
+    frame.bits.resize((size_t)frame.pitch * height);
+
+    // Floor and wall only change from row to row
+    for (uint32_t y = 0; y < height; y++)
+    {
+        float slope = (y + 0.5f - height / 2.0f) / focal;
+        float z     = slope > 0.0f ? (std::min)(SensorHeight / slope, WallDistance) : WallDistance;
+        uint16_t depth = (uint16_t)(z * 1000.0f);
+
+        uint16_t* pRow = reinterpret_cast<uint16_t*>(frame.bits.data() + (size_t)y * frame.pitch);
+        for (uint32_t x = 0; x < width; x++)
+        {
+            pRow[2 * x]     = 0;
+            pRow[2 * x + 1] = depth;
+        }
+    }
+
+    Player players[SensorSkeletonCount];
+    int    order[SensorSkeletonCount];
+    PlacePlayers(index, players, order);
+    for (int i = 0; i < m_scene.players; i++)
+    {
+        const Player& player = players[order[i]];
+        Silhouette body = Project(player.x, player.z, focal, width, height);
+
+        int top    = (std::max)(0, (int)std::ceil(body.centerY - body.radiusY));
+        int bottom = (std::min)((int)height - 1, (int)(body.centerY + body.radiusY));
+        for (int y = top; y <= bottom; y++)
+        {
+            float dy   = (y + 0.5f - body.centerY) / body.radiusY;
+            float span = body.radiusX * std::sqrt((std::max)(0.0f, 1.0f - dy * dy));
+            int   left  = (std::max)(0, (int)std::ceil(body.centerX - span));
+            int   right = (std::min)((int)width - 1, (int)(body.centerX + span));
+
+            uint16_t* pRow = reinterpret_cast<uint16_t*>(frame.bits.data() + (size_t)y * frame.pitch);
+            for (int x = left; x <= right; x++)
+            {
+                float dx    = (x + 0.5f - body.centerX) / body.radiusX;
+                float bulge = BodyDepth * std::sqrt((std::max)(0.0f, 1.0f - dx * dx - dy * dy));
+                pRow[2 * x]     = playerIndex ? (uint16_t)(order[i] + 1) : 0;
+                pRow[2 * x + 1] = (uint16_t)((player.z - bulge) * 1000.0f);
+            }
+        }
+    }
+
+    // Noise, then what is out of range reads as unknown
+    for (uint32_t y = 0; y < height; y++)
+    {
+        uint16_t* pRow = reinterpret_cast<uint16_t*>(frame.bits.data() + (size_t)y * frame.pitch);
+        for (uint32_t x = 0; x < width; x++)
+        {
+            int depth = pRow[2 * x + 1];
+            if (m_scene.noise)
+            {
+                depth += Noise(x, y, (uint32_t)index, m_scene.noise);
+            }
+            pRow[2 * x + 1] = (depth < 0 || depth > farthest) ? 0 : (uint16_t)depth;
+        }
+    }
+}
+
+/// <summary>
+/// Generate a BGRA color image
+/// </summary>
+void SyntheticSensorSource::MakeColor(uint64_t index, StandInFrame& frame) const
+{
+    const uint32_t width  = m_width[SensorStreamColor];
+    const uint32_t height = m_height[SensorStreamColor];
+    const float    focal  = ColorFocalLength * width;
+
+    frame.pitch = width * 4;
+    frame.bits.resize((size_t)frame.pitch * height);
+
+    // Plain wall above a checkered floor, so the image has edges to encode
+    for (uint32_t y = 0; y < height; y++)
+    {
+        uint8_t* pRow  = frame.bits.data() + (size_t)y * frame.pitch;
+        float    slope = (y + 0.5f - height / 2.0f) / focal;
+        float    z     = slope > 0.0f ? SensorHeight / slope : WallDistance;
+        if (z >= WallDistance)
+        {
+            uint8_t shade = (uint8_t)(150 + 60 * y / height);
+            for (uint32_t x = 0; x < width; x++)
+            {
+                pRow[4 * x]     = (uint8_t)(shade - 40);
+                pRow[4 * x + 1] = shade;
+                pRow[4 * x + 2] = (uint8_t)(shade + 20);
+                pRow[4 * x + 3] = 0xFF;
+            }
+        }
+        else
+        {
+            int row = (int)std::floor(z * 2.0f);
+            for (uint32_t x = 0; x < width; x++)
+            {
+                int     column = (int)std::floor((x + 0.5f - width / 2.0f) / focal * z * 2.0f);
+                uint8_t shade  = ((row + column) & 1) ? 140 : 90;
+                pRow[4 * x]     = (uint8_t)(shade + 10);
+                pRow[4 * x + 1] = shade;
+                pRow[4 * x + 2] = shade;
+                pRow[4 * x + 3] = 0xFF;
+            }
+        }
+    }
+
+    Player players[SensorSkeletonCount];
+    int    order[SensorSkeletonCount];
+    PlacePlayers(index, players, order);
+    for (int i = 0; i < m_scene.players; i++)
+    {
+        const Player&  player = players[order[i]];
+        const uint8_t* pColor = PlayerColors[order[i]];
+        Silhouette body = Project(player.x, player.z, focal, width, height);
+
+        int top    = (std::max)(0, (int)std::ceil(body.centerY - body.radiusY));
+        int bottom = (std::min)((int)height - 1, (int)(body.centerY + body.radiusY));
+        for (int y = top; y <= bottom; y++)
+        {
+            float dy   = (y + 0.5f - body.centerY) / body.radiusY;
+            float span = body.radiusX * std::sqrt((std::max)(0.0f, 1.0f - dy * dy));
+            int   left  = (std::max)(0, (int)std::ceil(body.centerX - span));
+            int   right = (std::min)((int)width - 1, (int)(body.centerX + span));
+
+            uint8_t* pRow = frame.bits.data() + (size_t)y * frame.pitch;
+            for (int x = left; x <= right; x++)
+            {
+                // Lit from the front, darker towards the outline
+                float dx    = (x + 0.5f - body.centerX) / body.radiusX;
+                float light = 0.6f + 0.4f * std::sqrt((std::max)(0.0f, 1.0f - dx * dx - dy * dy));
+                pRow[4 * x]     = (uint8_t)(pColor[0] * light);
+                pRow[4 * x + 1] = (uint8_t)(pColor[1] * light);
+                pRow[4 * x + 2] = (uint8_t)(pColor[2] * light);
+            }
+        }
+    }
+
+    if (m_scene.noise)
+    {
+        for (uint32_t y = 0; y < height; y++)
+        {
+            uint8_t* pRow = frame.bits.data() + (size_t)y * frame.pitch;
+            for (uint32_t x = 0; x < width; x++)
+            {
+                int noise = Noise(x, y, (uint32_t)index, m_scene.noise);
+                for (int c = 0; c < 3; c++)
+                {
+                    pRow[4 * x + c] = (uint8_t)(std::max)(0, (std::min)(255, pRow[4 * x + c] + noise));
+                }
+            }
+        }
+    }
+}
+
+/// <summary>
+/// Generate a skeleton frame following the seated mode and the skeleton choice of the application
+/// </summary>
+void SyntheticSensorSource::MakeSkeletons(uint64_t index, StandInFrame& frame) const
+{
+    bool     nearMode = false;
+    uint32_t flags    = 0;
+    uint32_t ids[2]   = {};
+    GetTrackingOptions(nearMode, flags, ids);
+
+    SensorSkeletonFrame& skeletons = frame.skeleton;
+    memset(&skeletons, 0, sizeof(skeletons));
+    skeletons.floorClipPlane.y  = 1.0f;
+    skeletons.floorClipPlane.w  = SensorHeight;
+    skeletons.normalToGravity.y = 1.0f;
+    frame.pitch = 0;
+    frame.bits.clear();
+
+    Player players[SensorSkeletonCount];
+    int    order[SensorSkeletonCount];
+    PlacePlayers(index, players, order);
+    for (int p = 0; p < m_scene.players; p++)
+    {
+        SensorSkeleton& skeleton = skeletons.skeletons[p];
+        const Player&   player   = players[p];
+
+        skeleton.trackingId = p + 1;
+        skeleton.position.x = player.x;
+        skeleton.position.y = StandingPose[0].height - SensorHeight;
+        skeleton.position.z = player.z;
+        skeleton.position.w = 1.0f;
+
+        // Two skeletons are tracked in full, the first ones or those the application chose
+        bool full = (flags & SensorTrackingChooseSkeletons) ? (skeleton.trackingId == ids[0] || skeleton.trackingId == ids[1]) : (p < 2);
+        skeleton.trackingState = full ? SensorTrackingFull : SensorTrackingPartial;
+        if (!full)
+        {
+            continue;
+        }
+
+        bool seated = 0 != (flags & SensorTrackingSeated);
+        for (int j = 0; j < SensorJointCount; j++)
+        {
+            if (seated && (j < FirstSeatedJoint || j > LastSeatedJoint))
+            {
+                continue;
+            }
+
+            skeleton.joints[j].x = player.x + StandingPose[j].side;
+            skeleton.joints[j].y = StandingPose[j].height - SensorHeight;
+            skeleton.joints[j].z = player.z - StandingPose[j].swing * player.swing;
+            skeleton.joints[j].w = 1.0f;
+            skeleton.jointStates[j] = SensorTrackingFull;
+        }
+    }
+}
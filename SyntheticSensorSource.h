@@ -0,0 +1,90 @@
+//------------------------------------------------------------------------------
+// <copyright file="SyntheticSensorSource.h">
+//     Stand-in sensor generating depth, color and skeleton frames of a parametric scene.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "StandInSensorSource.h"
+
+// Parameters of the generated scene
+struct SyntheticScene
+{
+    double  frameRate;          // Frames per second of every stream
+    int     players;            // People walking in front of the sensor, up to SensorSkeletonCount
+    double  periodSeconds;      // Time a player takes to walk to one side and back
+    int     noise;              // Amplitude of the pixel noise, millimeters of depth and levels of color. Raises the cost of encoding
+
+    /// <summary>
+    /// Constructor. Two players at 30 frames per second, without noise
+    /// </summary>
+    SyntheticScene();
+};
+
+/// <summary>
+/// Generates the frames of a room with people walking back and forth: a floor and a back wall, and a body for
+/// each player, with its player index in the depth image and its skeleton at the same place in skeleton space.
+/// Every frame is a function of its frame number only, so two runs deliver the same frames, and the pixel
+/// noise, when asked for, is the same in every run too. Color is delivered as BGRA at any size, depth at any
+/// size; the other color image types are not generated.
+/// </summary>
+class SyntheticSensorSource : public StandInSensorSource
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="scene">Parameters of the scene</param>
+    explicit SyntheticSensorSource(const SyntheticScene& scene);
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    virtual ~SyntheticSensorSource();
+
+protected:
+    virtual bool OpenFrames(SensorStream stream, SensorImageType type, uint32_t& width, uint32_t& height, int64_t sensorTime);
+    virtual bool ProduceFrame(SensorStream stream, StandInFrame& frame);
+
+private:
+    // Where a player is in skeleton space
+    struct Player
+    {
+        float x;            // Meters to the side of the sensor
+        float z;            // Meters in front of the sensor
+        float swing;        // Arm swing, -1 to 1
+    };
+
+    /// <summary>
+    /// Place the players at the time of a frame, the farthest first
+    /// </summary>
+    /// <param name="index">Frame number</param>
+    /// <param name="players">Receives a position for each player of the scene</param>
+    /// <param name="order">Receives the indices of the players from the farthest to the nearest</param>
+    void PlacePlayers(uint64_t index, Player players[SensorSkeletonCount], int order[SensorSkeletonCount]) const;
+
+    /// <summary>
+    /// Generate a depth image, NUI_DEPTH_IMAGE_PIXEL
+    /// </summary>
+    void MakeDepth(uint64_t index, bool playerIndex, bool nearMode, StandInFrame& frame) const;
+
+    /// <summary>
+    /// Generate a BGRA color image
+    /// </summary>
+    void MakeColor(uint64_t index, StandInFrame& frame) const;
+
+    /// <summary>
+    /// Generate a skeleton frame following the seated mode and the skeleton choice of the application
+    /// </summary>
+    void MakeSkeletons(uint64_t index, StandInFrame& frame) const;
+
+private:
+    SyntheticScene  m_scene;
+
+    // Open streams, only touched by OpenFrames and ProduceFrame, which never run at the same time
+    SensorImageType m_type[SensorStreamCount];
+    uint32_t        m_width[SensorStreamCount];
+    uint32_t        m_height[SensorStreamCount];
+    uint64_t        m_nextIndex[SensorStreamCount];
+};
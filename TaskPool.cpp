@@ -0,0 +1,262 @@
+//------------------------------------------------------------------------------
+// <copyright file="TaskPool.cpp">
+//     Work-stealing thread pool shared by the capture pipelines of all streams.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "TaskPool.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+
+namespace
+{
+    // Pool and index of the worker running on this thread, so tasks queued by a task stay on its worker
+    struct CurrentWorker
+    {
+        const TaskPool* pPool;
+        size_t          index;
+    };
+
+    thread_local CurrentWorker t_currentWorker = { nullptr, 0 };
+}
+
+/// <summary>
+/// Constructor. Starts the workers
+/// </summary>
+/// <param name="workers">Number of worker threads</param>
+TaskPool::TaskPool(unsigned workers)
+    : m_queued(0)
+    , m_nextWorker(0)
+    , m_stopping(false)
+{
+    for (unsigned i = 0; i < std::max(1u, workers); i++)
+    {
+        std::unique_ptr<Worker> pWorker(new Worker());
+        pWorker->ran    = 0;
+        pWorker->stolen = 0;
+        pWorker->sleeps = 0;
+        m_workers.push_back(std::move(pWorker));
+    }
+
+    // Started once every queue exists, as workers steal from all of them
+    for (size_t i = 0; i < m_workers.size(); i++)
+    {
+        m_workers[i]->thread = std::thread(&TaskPool::WorkerThread, this, i);
+    }
+}
+
+/// <summary>
+/// Destructor. Runs the queued tasks and stops the workers
+/// </summary>
+TaskPool::~TaskPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sleepLock);
+        m_stopping = true;
+        m_taskQueued.notify_all();
+    }
+
+    for (size_t i = 0; i < m_workers.size(); i++)
+    {
+        m_workers[i]->thread.join();
+    }
+}
+
+/// <summary>
+/// Number of workers leaving a core each to the acquisition threads
+/// </summary>
+unsigned TaskPool::DefaultWorkerCount()
+{
+    unsigned cores = std::thread::hardware_concurrency();
+    return cores > 3 ? std::min(cores - 2, 8u) : 2;
+}
+
+/// <summary>
+/// Queue a task. Tasks queued by a worker go to its own queue, others are spread over the workers
+/// </summary>
+/// <param name="task">Task to run on a worker</param>
+void TaskPool::Submit(Task task)
+{
+    size_t index;
+    {
+        std::lock_guard<std::mutex> lock(m_sleepLock);
+        if (this == t_currentWorker.pPool)
+        {
+            index = t_currentWorker.index;
+        }
+        else
+        {
+            index = m_nextWorker;
+            m_nextWorker = (m_nextWorker + 1) % m_workers.size();
+        }
+
+        // Counted before it is queued, so a worker never sleeps while it is on its way
+        ++m_queued;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_workers[index]->lock);
+        m_workers[index]->tasks.push_back(std::move(task));
+    }
+
+    m_taskQueued.notify_one();
+}
+
+/// <summary>
+/// Get a snapshot of the counters
+/// </summary>
+TaskPoolStats TaskPool::GetStats() const
+{
+    TaskPoolStats stats = { 0, 0, 0 };
+    for (const std::unique_ptr<Worker>& pWorker : m_workers)
+    {
+        std::lock_guard<std::mutex> lock(pWorker->lock);
+        stats.tasks  += pWorker->ran;
+        stats.steals += pWorker->stolen;
+        stats.sleeps += pWorker->sleeps;
+    }
+
+    return stats;
+}
+
+/// <summary>
+/// Reset the counters, e.g. at the start of a recording session
+/// </summary>
+void TaskPool::ResetStats()
+{
+    for (const std::unique_ptr<Worker>& pWorker : m_workers)
+    {
+        std::lock_guard<std::mutex> lock(pWorker->lock);
+        pWorker->ran    = 0;
+        pWorker->stolen = 0;
+        pWorker->sleeps = 0;
+    }
+}
+
+/// <summary>
+/// Append the counters to session.log in the current directory
+/// </summary>
+void TaskPool::LogSession() const
+{
+    TaskPoolStats stats = GetStats();
+    if (0 == stats.tasks)
+    {
+        return;
+    }
+
+    FILE* pLog = fopen("session.log", "a");
+    if (!pLog)
+    {
+        return;
+    }
+
+    char   timeText[32];
+    time_t now = time(nullptr);
+    tm     local;
+#ifdef _WIN32
+    localtime_s(&local, &now);
+#else
+    localtime_r(&now, &local);
+#endif
+    strftime(timeText, sizeof(timeText), "%Y-%m-%d %H:%M:%S", &local);
+
+    fprintf(pLog, "%s task pool: %llu tasks on %u workers, %llu stolen (%.1f%%), %llu sleeps\n",
+        timeText, (unsigned long long)stats.tasks, GetWorkerCount(), (unsigned long long)stats.steals,
+        stats.steals * 100.0 / stats.tasks, (unsigned long long)stats.sleeps);
+
+    fclose(pLog);
+}
+
+/// <summary>
+/// Worker thread procedure
+/// </summary>
+/// <param name="index">Index of the worker</param>
+void TaskPool::WorkerThread(size_t index)
+{
+    t_currentWorker.pPool = this;
+    t_currentWorker.index = index;
+
+    Worker& worker = *m_workers[index];
+    Task    task;
+
+    while (true)
+    {
+        if (TakeTask(index, task))
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_sleepLock);
+                --m_queued;
+            }
+
+            task();
+            task = nullptr;
+
+            std::lock_guard<std::mutex> lock(worker.lock);
+            ++worker.ran;
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_sleepLock);
+        if (m_queued > 0)
+        {
+            // Counted but not in a queue yet, or taken by another worker a moment ago
+            lock.unlock();
+            std::this_thread::yield();
+            continue;
+        }
+
+        if (m_stopping)
+        {
+            break;
+        }
+
+        {
+            std::lock_guard<std::mutex> workerLock(worker.lock);
+            ++worker.sleeps;
+        }
+        m_taskQueued.wait(lock, [&]() { return m_queued > 0 || m_stopping; });
+    }
+
+    t_currentWorker.pPool = nullptr;
+}
+
+/// <summary>
+/// Take the newest task of a worker's own queue, or else the oldest task of another queue
+/// </summary>
+/// <param name="index">Index of the worker</param>
+/// <param name="task">Receives the task</param>
+/// <returns>True if a task was taken</returns>
+bool TaskPool::TakeTask(size_t index, Task& task)
+{
+    {
+        Worker& own = *m_workers[index];
+        std::lock_guard<std::mutex> lock(own.lock);
+        if (!own.tasks.empty())
+        {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    // Start with the next worker, so thieves spread over the queues
+    for (size_t i = 1; i < m_workers.size(); i++)
+    {
+        Worker& victim = *m_workers[(index + i) % m_workers.size()];
+        std::unique_lock<std::mutex> lock(victim.lock);
+        if (!victim.tasks.empty())
+        {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            lock.unlock();
+
+            std::lock_guard<std::mutex> ownLock(m_workers[index]->lock);
+            ++m_workers[index]->stolen;
+            return true;
+        }
+    }
+
+    return false;
+}
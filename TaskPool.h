@@ -0,0 +1,118 @@
+//------------------------------------------------------------------------------
+// <copyright file="TaskPool.h">
+//     Work-stealing thread pool shared by the capture pipelines of all streams.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Counters of a pool
+struct TaskPoolStats
+{
+    uint64_t tasks;         // Tasks run
+    uint64_t steals;        // Tasks run by another worker than the one they were queued to
+    uint64_t sleeps;        // Times a worker found no task anywhere and went to sleep
+};
+
+/// <summary>
+/// Fixed set of worker threads, each with its own task queue. A worker runs the newest task of its own
+/// queue first, so a stage queueing the next stage of a frame continues on the same core while the data
+/// is warm, and steals the oldest task of another queue when its own is empty, so a burst queued to one
+/// worker, e.g. the encoding of a large color frame, spreads over all cores. Tasks must not block on
+/// other tasks, as every task of the pool may be queued behind them.
+/// </summary>
+class TaskPool
+{
+public:
+    typedef std::function<void()> Task;
+
+    /// <summary>
+    /// Constructor. Starts the workers
+    /// </summary>
+    /// <param name="workers">Number of worker threads</param>
+    explicit TaskPool(unsigned workers = DefaultWorkerCount());
+
+    /// <summary>
+    /// Destructor. Runs the queued tasks and stops the workers
+    /// </summary>
+   ~TaskPool();
+
+public:
+    /// <summary>
+    /// Number of workers leaving a core each to the acquisition threads
+    /// </summary>
+    static unsigned DefaultWorkerCount();
+
+    /// <summary>
+    /// Queue a task. Tasks queued by a worker go to its own queue, others are spread over the workers
+    /// </summary>
+    /// <param name="task">Task to run on a worker</param>
+    void Submit(Task task);
+
+    /// <summary>
+    /// Get the number of worker threads
+    /// </summary>
+    unsigned GetWorkerCount() const { return (unsigned)m_workers.size(); }
+
+    /// <summary>
+    /// Get a snapshot of the counters
+    /// </summary>
+    TaskPoolStats GetStats() const;
+
+    /// <summary>
+    /// Reset the counters, e.g. at the start of a recording session
+    /// </summary>
+    void ResetStats();
+
+    /// <summary>
+    /// Append the counters to session.log in the current directory
+    /// </summary>
+    void LogSession() const;
+
+private:
+    struct Worker
+    {
+        std::mutex          lock;
+        std::deque<Task>    tasks;
+        std::thread         thread;
+        uint64_t            ran;            // Counters, guarded by lock
+        uint64_t            stolen;
+        uint64_t            sleeps;
+    };
+
+    /// <summary>
+    /// Worker thread procedure
+    /// </summary>
+    /// <param name="index">Index of the worker</param>
+    void WorkerThread(size_t index);
+
+    /// <summary>
+    /// Take the newest task of a worker's own queue, or else the oldest task of another queue
+    /// </summary>
+    /// <param name="index">Index of the worker</param>
+    /// <param name="task">Receives the task</param>
+    /// <returns>True if a task was taken</returns>
+    bool TakeTask(size_t index, Task& task);
+
+private:
+    TaskPool(const TaskPool&);
+    TaskPool& operator=(const TaskPool&);
+
+private:
+    std::vector<std::unique_ptr<Worker>>    m_workers;
+
+    std::mutex                  m_sleepLock;        // Guards the counts below, waited on by idle workers
+    std::condition_variable     m_taskQueued;
+    size_t                      m_queued;           // Tasks queued and not taken yet, over all workers
+    size_t                      m_nextWorker;       // Round robin for tasks queued from outside the pool
+    bool                        m_stopping;
+};
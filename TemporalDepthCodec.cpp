@@ -0,0 +1,197 @@
+//------------------------------------------------------------------------------
+// <copyright file="TemporalDepthCodec.cpp">
+//     Lossless depth compression predicting each frame from the previous one.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "TemporalDepthCodec.h"
+#include "RvlCodec.h"
+
+#include <cstring>
+
+// -----------------------------------------------------------------------------
+//
+// TemporalDepthEncoder
+//
+// -----------------------------------------------------------------------------
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="keyframeInterval">Number of frames from one keyframe to the next</param>
+TemporalDepthEncoder::TemporalDepthEncoder(uint32_t keyframeInterval)
+    : m_keyframeInterval(keyframeInterval ? keyframeInterval : 1)
+    , m_sequence(0)
+    , m_sinceKeyframe(0)
+    , m_width(0)
+    , m_height(0)
+    , m_keyframeRequested(false)
+{
+}
+
+/// <summary>
+/// Start a new session. The next frame is a keyframe
+/// </summary>
+void TemporalDepthEncoder::Reset()
+{
+    FrameEncoder::Reset();
+
+    m_sequence = 0;
+    m_previous.clear();
+    m_keyframeRequested = false;
+}
+
+/// <summary>
+/// Encode a depth frame
+/// </summary>
+/// <param name="frame">Frame to encode, must be RecordPixelFormatDepthPixel32</param>
+/// <param name="payload">Receives the encoded payload</param>
+/// <param name="keyframe">Receives whether a keyframe was written</param>
+/// <returns>Indicates success or failure</returns>
+bool TemporalDepthEncoder::EncodeFrame(const RecordFrame& frame, std::vector<uint8_t>& payload, bool& keyframe)
+{
+    if (RecordPixelFormatDepthPixel32 != frame.format ||
+        frame.width > 0xFFFF || frame.height > 0xFFFF || (size_t)frame.width * frame.height > RVL_MAX_PIXELS ||
+        frame.stride < frame.width * 4 ||
+        frame.data.size() < (size_t)frame.stride * frame.height)
+    {
+        return false;
+    }
+
+    size_t          pixels  = (size_t)frame.width * frame.height;
+    size_t          values  = pixels * 2;
+    const uint16_t* pPixels = GetPackedDepthPixels(frame, m_packed);
+
+    keyframe = m_keyframeRequested.exchange(false) || m_previous.empty() || m_sinceKeyframe + 1 >= m_keyframeInterval ||
+               frame.width != m_width || frame.height != m_height;
+
+    TemporalDepthHeader header;
+    header.magic     = TEMPORAL_DEPTH_MAGIC;
+    header.width     = (uint16_t)frame.width;
+    header.height    = (uint16_t)frame.height;
+    header.sequence  = m_sequence;
+    header.reference = keyframe ? m_sequence : m_sequence - 1;
+
+    m_words.clear();
+    if (keyframe)
+    {
+        header.depthWords  = (uint32_t)RvlEncode(pPixels + 1, pixels, 2, m_words);
+        header.playerWords = (uint32_t)RvlEncode(pPixels, pixels, 2, m_words);
+        m_sinceKeyframe    = 0;
+    }
+    else
+    {
+        // Zigzag-encoded 16-bit differences, zero wherever the pixel did not change
+        m_residual.resize(values);
+        for (size_t i = 0; i < values; i++)
+        {
+            int16_t difference = (int16_t)(uint16_t)(pPixels[i] - m_previous[i]);
+            m_residual[i] = (uint16_t)(((uint16_t)difference << 1) ^ (uint16_t)(difference >> 15));
+        }
+
+        header.depthWords  = (uint32_t)RvlEncode(&m_residual[1], pixels, 2, m_words, false);
+        header.playerWords = (uint32_t)RvlEncode(&m_residual[0], pixels, 2, m_words, false);
+        ++m_sinceKeyframe;
+    }
+
+    m_previous.assign(pPixels, pPixels + values);
+    m_width  = frame.width;
+    m_height = frame.height;
+    ++m_sequence;
+
+    payload.resize(sizeof(header) + m_words.size() * sizeof(uint32_t));
+    memcpy(payload.data(), &header, sizeof(header));
+    memcpy(payload.data() + sizeof(header), m_words.data(), m_words.size() * sizeof(uint32_t));
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+//
+// TemporalDepthDecoder
+//
+// -----------------------------------------------------------------------------
+
+/// <summary>
+/// Constructor
+/// </summary>
+TemporalDepthDecoder::TemporalDepthDecoder()
+    : m_valid(false)
+    , m_sequence(0)
+    , m_width(0)
+    , m_height(0)
+{
+}
+
+/// <summary>
+/// Read the header of a payload
+/// </summary>
+/// <returns>False if the payload is not a temporal depth payload</returns>
+bool TemporalDepthDecoder::ReadHeader(const uint8_t* pPayload, size_t size, TemporalDepthHeader& header)
+{
+    if (size < sizeof(header))
+    {
+        return false;
+    }
+    memcpy(&header, pPayload, sizeof(header));
+
+    // The geometry is bounded like that of RVL payloads, the payload size does not bound it
+    return TEMPORAL_DEPTH_MAGIC == header.magic && (size_t)header.width * header.height <= RVL_MAX_PIXELS &&
+           sizeof(header) + ((uint64_t)header.depthWords + header.playerWords) * sizeof(uint32_t) <= size;
+}
+
+/// <summary>
+/// Decode the next payload
+/// </summary>
+/// <param name="pPayload">The pointer to payload</param>
+/// <param name="size">Size of payload in bytes</param>
+/// <param name="frame">Receives format, size and pixels</param>
+/// <returns>False if the payload is damaged or does not follow the last decoded frame</returns>
+bool TemporalDepthDecoder::Decode(const uint8_t* pPayload, size_t size, RecordFrame& frame)
+{
+    TemporalDepthHeader header;
+    if (!ReadHeader(pPayload, size, header))
+    {
+        return false;
+    }
+
+    bool keyframe = header.reference == header.sequence;
+    if (!keyframe &&
+        (!m_valid || header.reference != m_sequence || header.width != m_width || header.height != m_height))
+    {
+        return false;
+    }
+
+    size_t pixels = (size_t)header.width * header.height;
+
+    frame.format = RecordPixelFormatDepthPixel32;
+    frame.width  = header.width;
+    frame.height = header.height;
+    frame.stride = header.width * 4;
+    frame.data.resize(pixels * 4);
+
+    uint16_t* pPixels = reinterpret_cast<uint16_t*>(frame.data.data());
+    m_valid = false;
+
+    if (!RvlDecodeDepthPixels(pPayload + sizeof(header), header.depthWords, header.playerWords, pPixels, pixels, keyframe))
+    {
+        return false;
+    }
+
+    if (!keyframe)
+    {
+        for (size_t i = 0; i < pixels * 2; i++)
+        {
+            uint16_t zigzag = pPixels[i];
+            pPixels[i] = (uint16_t)(m_previous[i] + ((zigzag >> 1) ^ (uint16_t)-(int)(zigzag & 1)));
+        }
+    }
+
+    m_previous.assign(pPixels, pPixels + pixels * 2);
+    m_sequence = header.sequence;
+    m_width    = header.width;
+    m_height   = header.height;
+    m_valid    = true;
+
+    return true;
+}
@@ -0,0 +1,136 @@
+//------------------------------------------------------------------------------
+// <copyright file="TemporalDepthCodec.h">
+//     Lossless depth compression predicting each frame from the previous one.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+
+#include "FrameCodec.h"
+
+// Payload layout, all fields little-endian:
+//
+//   TemporalDepthHeader
+//   uint32_t[depthWords]       RVL stream of the depth plane
+//   uint32_t[playerWords]      RVL stream of the player index plane
+//
+// A keyframe stores the planes like an RVL frame. Any other frame stores the zigzag-encoded
+// difference to the previous frame, which is zero wherever the scene did not change, so a
+// static sensor produces long zero runs. Keyframes are written periodically so that playback
+// can start at any keyframe.
+
+#define TEMPORAL_DEPTH_MAGIC    0x31504454      // 'TDP1'
+
+#pragma pack(push, 1)
+
+struct TemporalDepthHeader
+{
+    uint32_t    magic;
+    uint16_t    width;
+    uint16_t    height;
+    uint32_t    sequence;       // Position of the frame in the encoded sequence
+    uint32_t    reference;      // Sequence of the frame this one is predicted from, equal to sequence for keyframes
+    uint32_t    depthWords;
+    uint32_t    playerWords;
+};
+
+#pragma pack(pop)
+
+/// <summary>
+/// Lossless depth encoder exploiting the similarity of consecutive frames
+/// </summary>
+class TemporalDepthEncoder : public FrameEncoder
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="keyframeInterval">Number of frames from one keyframe to the next</param>
+    TemporalDepthEncoder(uint32_t keyframeInterval = DefaultKeyframeInterval);
+
+    static const uint32_t DefaultKeyframeInterval = 30;
+
+    /// <summary>
+    /// Get the codec the payloads are encoded with
+    /// </summary>
+    virtual RecordCodec GetCodec() const { return RecordCodecTemporalDepth; }
+
+    /// <summary>
+    /// Get file name extension for payloads stored as separate files
+    /// </summary>
+    virtual const char* GetFileExtension() const { return ".tdp"; }
+
+    /// <summary>
+    /// Start a new session. The next frame is a keyframe
+    /// </summary>
+    virtual void Reset();
+
+    /// <summary>
+    /// Make the next frame a keyframe, the frames after a lost one would not decode otherwise
+    /// </summary>
+    virtual void RequestKeyframe() { m_keyframeRequested = true; }
+
+protected:
+    /// <summary>
+    /// Encode a depth frame
+    /// </summary>
+    /// <param name="frame">Frame to encode, must be RecordPixelFormatDepthPixel32</param>
+    /// <param name="payload">Receives the encoded payload</param>
+    /// <param name="keyframe">Receives whether a keyframe was written</param>
+    /// <returns>Indicates success or failure</returns>
+    virtual bool EncodeFrame(const RecordFrame& frame, std::vector<uint8_t>& payload, bool& keyframe);
+
+private:
+    uint32_t                m_keyframeInterval;
+    uint32_t                m_sequence;
+    uint32_t                m_sinceKeyframe;
+    uint32_t                m_width;
+    uint32_t                m_height;
+    std::vector<uint16_t>   m_previous;     // Pixels of the previous frame, the prediction for the next one
+    std::vector<uint16_t>   m_residual;
+    std::vector<uint16_t>   m_packed;
+    std::vector<uint32_t>   m_words;
+    std::atomic<bool>       m_keyframeRequested;    // Set by the thread storing the payloads
+};
+
+/// <summary>
+/// Decoder of temporally predicted depth payloads. Payloads must be passed in
+/// recording order starting at a keyframe
+/// </summary>
+class TemporalDepthDecoder
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    TemporalDepthDecoder();
+
+    /// <summary>
+    /// Decode the next payload
+    /// </summary>
+    /// <param name="pPayload">The pointer to payload</param>
+    /// <param name="size">Size of payload in bytes</param>
+    /// <param name="frame">Receives format, size and pixels</param>
+    /// <returns>False if the payload is damaged or does not follow the last decoded frame</returns>
+    bool Decode(const uint8_t* pPayload, size_t size, RecordFrame& frame);
+
+    /// <summary>
+    /// Forget the reference frame, e.g. after seeking
+    /// </summary>
+    void Reset() { m_valid = false; }
+
+    /// <summary>
+    /// Read the header of a payload
+    /// </summary>
+    /// <returns>False if the payload is not a temporal depth payload</returns>
+    static bool ReadHeader(const uint8_t* pPayload, size_t size, TemporalDepthHeader& header);
+
+private:
+    bool                    m_valid;
+    uint32_t                m_sequence;
+    uint32_t                m_width;
+    uint32_t                m_height;
+    std::vector<uint16_t>   m_previous;
+};
@@ -0,0 +1,83 @@
+//------------------------------------------------------------------------------
+// <copyright file="TripleBuffer.h">
+//     Lock-free hand-off of the latest value from one producer to one consumer.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/// <summary>
+/// Three slots shared by one producer and one consumer, e.g. acquisition and paint. The producer fills
+/// the back slot and publishes it by swapping it with the middle slot; the consumer picks up the latest
+/// published slot by swapping the middle slot with its front slot. Both swaps are a single atomic
+/// exchange of the middle index, so neither side ever waits for the other, the producer never writes a
+/// slot the consumer reads and the consumer always sees a complete value. Values published while the
+/// consumer is not looking are skipped, only the latest one is kept.
+/// </summary>
+template <typename T>
+class TripleBuffer
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    TripleBuffer()
+        : m_back(0)
+        , m_middle(1)
+        , m_front(2)
+    {
+    }
+
+public:
+    /// <summary>
+    /// Get the slot the producer fills. Producer only
+    /// </summary>
+    T& GetBack() { return m_slots[m_back]; }
+
+    /// <summary>
+    /// Hand the back slot over to the consumer, replacing a published slot it has not picked up yet.
+    /// The producer gets that slot, or the one the consumer gave up, as its new back slot. Producer only
+    /// </summary>
+    void Publish()
+    {
+        // Release, so the contents of the slot are visible to the consumer before the index
+        m_back = m_middle.exchange(m_back | FreshFlag, std::memory_order_acq_rel) & IndexMask;
+    }
+
+    /// <summary>
+    /// Pick up the latest published slot, if one was published since the last call. Consumer only
+    /// </summary>
+    /// <returns>True if the front slot changed</returns>
+    bool Update()
+    {
+        if (0 == (m_middle.load(std::memory_order_relaxed) & FreshFlag))
+        {
+            return false;
+        }
+
+        // Acquire, so the contents of the slot written by the producer are visible
+        m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & IndexMask;
+        return true;
+    }
+
+    /// <summary>
+    /// Get the slot the consumer reads, valid until the next Update. Consumer only
+    /// </summary>
+    const T& GetFront() const { return m_slots[m_front]; }
+
+private:
+    TripleBuffer(const TripleBuffer&);
+    TripleBuffer& operator=(const TripleBuffer&);
+
+    static const uint32_t IndexMask = 0x3;
+    static const uint32_t FreshFlag = 0x4;      // Middle slot was published and not picked up yet
+
+private:
+    T                       m_slots[3];
+    uint32_t                m_back;         // Owned by the producer
+    std::atomic<uint32_t>   m_middle;       // Index and FreshFlag, the only state both sides touch
+    uint32_t                m_front;        // Owned by the consumer
+};
@@ -23,7 +23,6 @@
 // The user defined message
 #define WM_UPDATEMAINWINDOW             WM_USER + 1
 #define WM_CLOSEKINECTWINDOW            WM_USER + 2
-#define WM_STREAMEVENT                  WM_USER + 3
 #define WM_TIMEREVENT                   WM_USER + 4
 #define WM_SHOWKINECTWINDOW             WM_USER + 5
 